@@ -0,0 +1,515 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#ifndef WIN32
+# include <fcntl.h>
+# include <sys/stat.h>
+#endif
+
+#include "dataio/AsyncFileDataIO.h"
+#include "util/NetworkUtilityFunctions.h"
+#include "util/SocketMultiplexer.h"
+
+namespace muscle {
+
+ThreadPool & AsyncFileDataIO :: GetIOThreadPool()
+{
+   static ThreadPool _ioThreadPool(MUSCLE_ASYNC_FILE_IO_THREAD_POOL_SIZE);
+   return _ioThreadPool;
+}
+
+AsyncFileDataIO :: AsyncFileDataIO(const char * path, const char * mode, uint32 maxParallelIOs, uint32 readAheadBlockSize, uint32 numReadAheadBlocks, uint32 writeBehindBatchSize, uint32 maxPendingWriteBytes)
+   : _maxParallelIOs(muscleMax(maxParallelIOs, (uint32)1))
+   , _readAheadBlockSize(muscleMax(readAheadBlockSize, (uint32)1))
+   , _numReadAheadBlocks(muscleMax(numReadAheadBlocks, (uint32)1))
+   , _writeBehindBatchSize(muscleMax(writeBehindBatchSize, (uint32)1))
+   , _maxPendingWriteBytes(muscleMax(maxPendingWriteBytes, writeBehindBatchSize))
+#ifdef WIN32
+   , _handle(INVALID_HANDLE_VALUE)
+#else
+   , _fd(-1)
+#endif
+   , _isOpen(false)
+   , _canRead(false)
+   , _canWrite(false)
+   , _nextLaneIndex(0)
+   , _position(0)
+   , _knownLength(0)
+   , _readJobOffset(0)
+   , _nextReadAheadPos(0)
+   , _readAheadHitEOF(false)
+   , _pendingWriteBytes(0)
+   , _writeBatchPos(0)
+{
+   if (OpenFile(path, mode).IsError(_openError))
+   {
+      LogTime(MUSCLE_LOG_ERROR, "AsyncFileDataIO:  Unable to open file [%s] with mode [%s] [%s]\n", path, mode, _openError());
+      CloseFile();
+   }
+   else ScheduleReadAhead();  // so that our GetReadSelectSocket() will become ready-for-read as soon as there is data to read
+}
+
+AsyncFileDataIO :: ~AsyncFileDataIO()
+{
+   Shutdown();
+}
+
+status_t AsyncFileDataIO :: OpenFile(const char * path, const char * mode)
+{
+   const bool plus = (strchr(mode, '+') != NULL);
+   switch(mode[0])
+   {
+      case 'r': _canRead  = true; _canWrite = plus; break;
+      case 'w': case 'a': _canWrite = true; _canRead  = plus; break;
+      default:  return B_BAD_ARGUMENT;
+   }
+
+#ifdef WIN32
+   const DWORD access      = (_canRead ? GENERIC_READ : 0) | (_canWrite ? GENERIC_WRITE : 0);
+   const DWORD disposition = (mode[0] == 'w') ? CREATE_ALWAYS : ((mode[0] == 'a') ? OPEN_ALWAYS : OPEN_EXISTING);
+   _handle = CreateFileA(path, access, FILE_SHARE_READ, NULL, disposition, FILE_ATTRIBUTE_NORMAL, NULL);
+   if (_handle == INVALID_HANDLE_VALUE) return B_ERRNO|B_IO_ERROR;
+
+   LARGE_INTEGER fileSize;
+   if (GetFileSizeEx(_handle, &fileSize) == false) return B_ERRNO|B_IO_ERROR;
+   _knownLength = fileSize.QuadPart;
+#else
+   int flags = (_canRead&&_canWrite) ? O_RDWR : (_canWrite ? O_WRONLY : O_RDONLY);
+        if (mode[0] == 'w') flags |= (O_CREAT|O_TRUNC);
+   else if (mode[0] == 'a') flags |= O_CREAT;  // not O_APPEND, since that would make pwrite() ignore its offset
+   _fd = open(path, flags, 0666);
+   if (_fd < 0) return B_ERRNO|B_IO_ERROR;
+
+   struct stat st;
+   if (fstat(_fd, &st) != 0) return B_ERRNO|B_IO_ERROR;
+   _knownLength = st.st_size;
+#endif
+
+   if (mode[0] == 'a') _position = _nextReadAheadPos = _knownLength;
+
+   MRETURN_ON_ERROR(CreateConnectedSocketPair(_mainThreadNotifySocket, _ioThreadNotifySocket));
+   _isOpen = true;
+
+   _jobMsg = GetMessageFromPool();
+   MRETURN_ON_ERROR(_jobMsg);
+
+   for (uint32 i=0; i<_maxParallelIOs; i++)
+   {
+      IOLaneRef lane(newnothrow IOLane(this));
+      MRETURN_OOM_ON_NULL(lane());
+      if (lane()->GetThreadPool() == NULL) return B_ERROR("Couldn't register with the I/O ThreadPool");  // SetThreadPool() already logged why
+      MRETURN_ON_ERROR(_ioLanes.AddTail(lane));
+   }
+   return B_NO_ERROR;
+}
+
+void AsyncFileDataIO :: CloseFile()
+{
+   {
+      DECLARE_MUTEXGUARD(_jobsMutex);
+      _pendingJobs.Clear();  // any remaining jobs are read-aheads we no longer care about
+   }
+
+   // Each IOLane's destructor blocks until the I/O pool has finished executing any job it started on our behalf
+   _ioLanes.Clear();
+   _jobMsg.Reset();
+
+   // Now that the I/O threads are done with us, nobody else is looking at our jobs, so we can mark them all as complete
+   for (uint32 i=0; i<_readJobs.GetNumItems();  i++) _readJobs[i]()->_isComplete  = true;
+   for (uint32 i=0; i<_writeJobs.GetNumItems(); i++) _writeJobs[i]()->_isComplete = true;
+   _readJobs.Clear();
+   _writeJobs.Clear();
+   _writeBatch.Reset();
+   _pendingWriteBytes = 0;
+
+#ifdef WIN32
+   if (_handle != INVALID_HANDLE_VALUE) {(void) CloseHandle(_handle); _handle = INVALID_HANDLE_VALUE;}
+#else
+   if (_fd >= 0) {(void) close(_fd); _fd = -1;}
+#endif
+
+   _mainThreadNotifySocket.Reset();
+   _ioThreadNotifySocket.Reset();
+   _isOpen = false;
+}
+
+void AsyncFileDataIO :: ExecuteNextJob()
+{
+   // Called from within an I/O pool thread, once per submitted job.  Jobs aren't tied to the wakeup-Message
+   // that was sent for them, so we just execute the oldest job that nobody has started on yet (if any).
+   IOJobRef job;
+   {
+      DECLARE_MUTEXGUARD(_jobsMutex);
+      while((_pendingJobs.RemoveHead(job).IsOK())&&(job()->_isCancelled)) job.Reset();  // skip read-aheads that nobody wants anymore
+   }
+   if (job() == NULL) return;
+
+   ExecuteJob(*job());
+   {
+      DECLARE_MUTEXGUARD(_jobsMutex);
+      job()->_isComplete = true;
+   }
+
+   const char c = 'j';
+   (void) SendData(_ioThreadNotifySocket, &c, sizeof(c), false);  // wake up the main thread
+}
+
+void AsyncFileDataIO :: ExecuteJob(IOJob & job) const
+{
+   ByteBuffer & buf = *job._buf();
+   uint32 numDone = 0;
+   while(numDone < buf.GetNumBytes())
+   {
+      const uint64 offset  = job._offset+numDone;
+      const uint32 numLeft = buf.GetNumBytes()-numDone;
+#ifdef WIN32
+      OVERLAPPED ol; memset(&ol, 0, sizeof(ol));
+      ol.Offset     = (DWORD) (offset & 0xFFFFFFFF);
+      ol.OffsetHigh = (DWORD) (offset >> 32);
+      DWORD numTransferred = 0;
+      const BOOL ok = job._isWrite ? WriteFile(_handle, buf.GetBuffer()+numDone, numLeft, &numTransferred, &ol)
+                                   :  ReadFile(_handle, buf.GetBuffer()+numDone, numLeft, &numTransferred, &ol);
+      if ((ok == false)&&(GetLastError() != ERROR_HANDLE_EOF)) {job._result = B_ERRNO|B_IO_ERROR; break;}
+      const int64 r = numTransferred;
+#else
+      const int64 r = job._isWrite ? pwrite(_fd, buf.GetBuffer()+numDone, numLeft, (off_t)offset)
+                                   :  pread(_fd, buf.GetBuffer()+numDone, numLeft, (off_t)offset);
+      if (r < 0)
+      {
+         if (errno == EINTR) continue;
+         job._result = B_ERRNO|B_IO_ERROR;
+         break;
+      }
+#endif
+      if (r == 0)
+      {
+         if (job._isWrite) job._result = B_IO_ERROR;  // a zero-byte write shouldn't happen, but we don't want to spin forever if it does
+         break;  // for a read, this means we've reached the end of the file
+      }
+      numDone += (uint32) r;
+   }
+   job._numBytesTransferred = numDone;
+}
+
+status_t AsyncFileDataIO :: SubmitJob(const IOJobRef & job)
+{
+   if (_ioLanes.IsEmpty()) return B_BAD_OBJECT;
+
+   {
+      DECLARE_MUTEXGUARD(_jobsMutex);
+      MRETURN_ON_ERROR(_pendingJobs.AddTail(job));
+   }
+
+   status_t ret;
+   if (_ioLanes[_nextLaneIndex]()->SendMessageToThreadPool(_jobMsg).IsError(ret))
+   {
+      // roll back, so that the job won't get executed by a wakeup-Message that was meant for a later job
+      DECLARE_MUTEXGUARD(_jobsMutex);
+      (void) _pendingJobs.RemoveLastInstanceOf(job);
+      return ret;
+   }
+   _nextLaneIndex = (_nextLaneIndex+1)%_ioLanes.GetNumItems();
+   return B_NO_ERROR;
+}
+
+void AsyncFileDataIO :: ScheduleReadAhead()
+{
+   if ((_canRead == false)||(_writeJobs.HasItems())||((_writeBatch())&&(_writeBatch()->GetNumBytes() > 0))) return;  // reads must wait until our writes are on disk
+
+   while((_readAheadHitEOF == false)&&(_readJobs.GetNumItems() < _numReadAheadBlocks))
+   {
+      ByteBufferRef buf = GetByteBufferFromPool(_readAheadBlockSize);
+      IOJobRef job(buf() ? newnothrow IOJob(false, _nextReadAheadPos, buf) : NULL);
+      if (job() == NULL) {MWARN_OUT_OF_MEMORY; break;}
+      if (_readJobs.AddTail(job).IsError()) break;
+      if (SubmitJob(job).IsError())
+      {
+         (void) _readJobs.RemoveTail();
+         break;
+      }
+      _nextReadAheadPos += _readAheadBlockSize;
+   }
+}
+
+void AsyncFileDataIO :: DiscardReadAhead()
+{
+   if (_readJobs.HasItems())
+   {
+      DECLARE_MUTEXGUARD(_jobsMutex);
+      for (uint32 i=0; i<_readJobs.GetNumItems(); i++) _readJobs[i]()->_isCancelled = true;  // in-flight jobs will finish, but nobody will look at them
+   }
+   _readJobs.Clear();
+   _readJobOffset    = 0;
+   _nextReadAheadPos = _position;
+   _readAheadHitEOF  = false;
+}
+
+status_t AsyncFileDataIO :: SubmitWriteBatch()
+{
+   if ((_writeBatch() == NULL)||(_writeBatch()->GetNumBytes() == 0)) return B_NO_ERROR;
+
+   IOJobRef job(newnothrow IOJob(true, _writeBatchPos, _writeBatch));
+   MRETURN_OOM_ON_NULL(job());
+   MRETURN_ON_ERROR(_writeJobs.AddTail(job));
+   _writeBatch.Reset();
+   return SubmitHeldWrites();
+}
+
+status_t AsyncFileDataIO :: SubmitHeldWrites()
+{
+   // Our I/O threads may execute jobs in any order, so a write that overlaps an earlier write that
+   // hasn't completed yet must wait until that write is on disk; otherwise the earlier one might win
+   for (uint32 i=0; i<_writeJobs.GetNumItems(); i++)
+   {
+      IOJob & job = *_writeJobs[i]();
+      if (job._isSubmitted == false)
+      {
+         bool mustWait = false;
+         for (uint32 j=0; j<i; j++) if (job.Overlaps(*_writeJobs[j]())) {mustWait = true; break;}
+         if (mustWait == false)
+         {
+            MRETURN_ON_ERROR(SubmitJob(_writeJobs[i]));
+            job._isSubmitted = true;
+         }
+      }
+   }
+   return B_NO_ERROR;
+}
+
+void AsyncFileDataIO :: ReapCompletedWrites()
+{
+   if (_writeJobs.IsEmpty()) return;
+
+   bool reapedAny = false;
+   {
+      DECLARE_MUTEXGUARD(_jobsMutex);
+      for (int32 i=_writeJobs.GetLastValidIndex(); i>=0; i--)
+      {
+         const IOJob & job = *_writeJobs[i]();
+         if (job._isComplete)
+         {
+            if (job._result.IsError()) _writeError = job._result;
+            _pendingWriteBytes -= job._buf()->GetNumBytes();
+            (void) _writeJobs.RemoveItemAt(i);
+            reapedAny = true;
+         }
+      }
+   }
+
+   status_t ret;
+   if ((reapedAny)&&(SubmitHeldWrites().IsError(ret))&&(_writeError.IsOK())) _writeError = ret;  // in case a held-back write can go now
+}
+
+void AsyncFileDataIO :: DrainNotifySocket()
+{
+   char junk[256];
+   while(ReceiveData(_mainThreadNotifySocket, junk, sizeof(junk), false).GetByteCount() > 0) {/* empty */}
+}
+
+io_status_t AsyncFileDataIO :: Read(void * buffer, uint32 size)
+{
+   if (_isOpen == false) return _openError.IsError() ? _openError : B_BAD_OBJECT;
+
+   DrainNotifySocket();  // must be done before we look at our jobs' states, so that we can't miss a wakeup
+   ReapCompletedWrites();
+
+   if ((_canRead == false)||(size == 0)) return io_status_t(0);  // write-only files still need Read() calls to drain the notify-socket
+   if ((_writeJobs.HasItems())||((_writeBatch())&&(_writeBatch()->GetNumBytes() > 0)))
+   {
+      MRETURN_ON_ERROR(SubmitWriteBatch());
+      return _writeError.IsError() ? io_status_t(_writeError) : io_status_t(0);  // we'll be woken up again when the writes complete
+   }
+   ScheduleReadAhead();
+
+   uint8 * outBytes = (uint8 *) buffer;
+   uint32 numCopied = 0;
+   bool nextBlockIsReady = false;
+   while((numCopied < size)&&(_readJobs.HasItems()))
+   {
+      const IOJob & job = *_readJobs.Head()();
+      {
+         DECLARE_MUTEXGUARD(_jobsMutex);
+         nextBlockIsReady = job._isComplete;
+      }
+      if (nextBlockIsReady == false) break;
+
+      if (job._result.IsError())
+      {
+         const status_t ret = job._result;
+         DiscardReadAhead();  // so that a subsequent Read() will try again
+         if (numCopied > 0) break;
+         return ret;
+      }
+
+      const uint32 numToCopy = muscleMin(size-numCopied, job._numBytesTransferred-_readJobOffset);
+      memcpy(outBytes+numCopied, job._buf()->GetBuffer()+_readJobOffset, numToCopy);
+      numCopied      += numToCopy;
+      _readJobOffset += numToCopy;
+      _position      += numToCopy;
+
+      if (_readJobOffset == job._numBytesTransferred)
+      {
+         const bool hitEOF = (job._numBytesTransferred < job._buf()->GetNumBytes());
+         (void) _readJobs.RemoveHead();
+         _readJobOffset = 0;
+         if (hitEOF)
+         {
+            DiscardReadAhead();  // any blocks after this one are beyond the end of the file
+            _readAheadHitEOF = true;
+            break;
+         }
+      }
+   }
+
+   ScheduleReadAhead();
+   if ((numCopied == 0)&&(_readAheadHitEOF)&&(_readJobs.IsEmpty())) return B_END_OF_STREAM;
+
+   if ((numCopied > 0)&&(_readJobs.HasItems()))
+   {
+      // If there's still more data ready to go, make sure our select-socket will tell the caller about it
+      {
+         DECLARE_MUTEXGUARD(_jobsMutex);
+         nextBlockIsReady = _readJobs.Head()()->_isComplete;
+      }
+      if (nextBlockIsReady)
+      {
+         const char c = 'r';
+         (void) SendData(_ioThreadNotifySocket, &c, sizeof(c), false);
+      }
+   }
+   return io_status_t((int32)numCopied);
+}
+
+io_status_t AsyncFileDataIO :: Write(const void * buffer, uint32 size)
+{
+   if (_isOpen == false) return _openError.IsError() ? _openError : B_BAD_OBJECT;
+   if (_canWrite == false) return B_ACCESS_DENIED;
+
+   ReapCompletedWrites();
+   if (_writeError.IsError()) return _writeError;
+   if (size == 0) return io_status_t(0);
+
+   DiscardReadAhead();  // since it might not reflect what we're about to write
+
+   const uint32 numToAccept = muscleMin(size, (_pendingWriteBytes < _maxPendingWriteBytes) ? (_maxPendingWriteBytes-_pendingWriteBytes) : 0);
+   const uint8 * inBytes = (const uint8 *) buffer;
+   uint32 numAccepted = 0;
+   while(numAccepted < numToAccept)
+   {
+      if (_writeBatch() == NULL)
+      {
+         _writeBatch = GetByteBufferFromPool(_writeBehindBatchSize);
+         MRETURN_OOM_ON_NULL(_writeBatch());
+         _writeBatch()->Clear(false);  // keeps the allocation, so that the appends below won't need to reallocate
+         _writeBatchPos = _position;
+      }
+
+      const uint32 numToAppend = muscleMin(numToAccept-numAccepted, _writeBehindBatchSize-_writeBatch()->GetNumBytes());
+      MRETURN_ON_ERROR(_writeBatch()->AppendBytes(inBytes+numAccepted, numToAppend, false));
+      numAccepted        += numToAppend;
+      _position          += numToAppend;
+      _pendingWriteBytes += numToAppend;
+
+      if (_writeBatch()->GetNumBytes() >= _writeBehindBatchSize) MRETURN_ON_ERROR(SubmitWriteBatch());
+   }
+
+   _knownLength = muscleMax(_knownLength, _position);
+   return io_status_t((int32)numAccepted);
+}
+
+status_t AsyncFileDataIO :: Seek(int64 offset, int whence)
+{
+   if (_isOpen == false) return _openError.IsError() ? _openError : B_BAD_OBJECT;
+
+   int64 newPos;
+   switch(whence)
+   {
+      case IO_SEEK_SET: newPos = offset;                      break;
+      case IO_SEEK_CUR: newPos = offset+(int64)_position;    break;
+      case IO_SEEK_END: newPos = offset+(int64)_knownLength; break;  // yes, the + is intentional; in this case, offset is expected to be a negative value, or zero
+      default:          return B_BAD_ARGUMENT;
+   }
+   if (newPos < 0) return B_BAD_ARGUMENT;
+   if ((uint64)newPos == _position) return B_NO_ERROR;
+
+   MRETURN_ON_ERROR(SubmitWriteBatch());  // since the next write won't be contiguous with the batch's bytes
+   _position = (uint64) newPos;
+   DiscardReadAhead();
+   ScheduleReadAhead();
+   return B_NO_ERROR;
+}
+
+int64 AsyncFileDataIO :: GetLength() const
+{
+   return _isOpen ? (int64)_knownLength : -1;
+}
+
+status_t AsyncFileDataIO :: Truncate()
+{
+   if (_isOpen == false) return _openError.IsError() ? _openError : B_BAD_OBJECT;
+   if (_canWrite == false) return B_ACCESS_DENIED;
+
+   // Truncation has to be ordered with respect to our writes, so this is the one operation that blocks
+   MRETURN_ON_ERROR(WaitForPendingWrites());
+   DiscardReadAhead();
+
+#ifdef WIN32
+   LARGE_INTEGER li; li.QuadPart = _position;
+   if ((SetFilePointerEx(_handle, li, NULL, FILE_BEGIN) == false)||(SetEndOfFile(_handle) == false)) return B_ERRNO;
+#else
+   if (ftruncate(_fd, (off_t)_position) != 0) return B_ERRNO;
+#endif
+
+   _knownLength = _position;
+   ScheduleReadAhead();
+   return B_NO_ERROR;
+}
+
+void AsyncFileDataIO :: FlushOutput()
+{
+   if (_isOpen)
+   {
+      ReapCompletedWrites();
+      (void) SubmitWriteBatch();
+   }
+}
+
+bool AsyncFileDataIO :: HasBufferedOutput() const
+{
+   return ((_writeBatch())&&(_writeBatch()->GetNumBytes() > 0));
+}
+
+status_t AsyncFileDataIO :: WaitForPendingWrites(uint64 timeoutMicros)
+{
+   if (_isOpen == false) return _openError.IsError() ? _openError : B_BAD_OBJECT;
+
+   MRETURN_ON_ERROR(SubmitWriteBatch());
+
+   const uint64 deadline = (timeoutMicros == MUSCLE_TIME_NEVER) ? MUSCLE_TIME_NEVER : (GetRunTime64()+timeoutMicros);
+   SocketMultiplexer sm;
+   while(true)
+   {
+      DrainNotifySocket();
+      ReapCompletedWrites();
+      if (_writeJobs.IsEmpty()) break;
+      if (GetRunTime64() >= deadline) return B_TIMED_OUT;
+
+      MRETURN_ON_ERROR(sm.RegisterSocketForReadReady(_mainThreadNotifySocket.GetFileDescriptor()));
+      MRETURN_ON_ERROR(sm.WaitForEvents(deadline));
+   }
+
+   const status_t ret = _writeError;
+   ScheduleReadAhead();  // in case reads were waiting for our writes to finish
+   return ret;
+}
+
+void AsyncFileDataIO :: Shutdown()
+{
+   if (_isOpen)
+   {
+      status_t ret;
+      if (WaitForPendingWrites().IsError(ret)) LogTime(MUSCLE_LOG_ERROR, "AsyncFileDataIO::Shutdown():  Error writing buffered data to disk [%s]\n", ret());
+      CloseFile();
+   }
+}
+
+} // end namespace muscle
@@ -0,0 +1,226 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#ifndef MuscleAsyncFileDataIO_h
+#define MuscleAsyncFileDataIO_h
+
+#include "dataio/SeekableDataIO.h"
+#include "system/Mutex.h"
+#include "system/ThreadPool.h"
+#include "util/ByteBuffer.h"
+#include "util/Queue.h"
+
+namespace muscle {
+
+#ifndef MUSCLE_ASYNC_FILE_IO_THREAD_POOL_SIZE
+/** The maximum number of threads in the process-wide ThreadPool that all AsyncFileDataIO objects share for their disk I/O.
+  * Defaults to 8; can be overridden at compile-time via eg -DMUSCLE_ASYNC_FILE_IO_THREAD_POOL_SIZE=16
+  */
+# define MUSCLE_ASYNC_FILE_IO_THREAD_POOL_SIZE 8
+#endif
+
+/**
+ * A non-blocking DataIO for reading and/or writing a file on disk.  Unlike wrapping a FileDataIO in an AsyncDataIO (which
+ * hands one command at a time to a single helper thread), this class has the threads of a process-wide I/O ThreadPool
+ * perform positional reads and writes (pread()/pwrite()) on the file in parallel:
+ *
+ *  - When reading, it keeps several fixed-size blocks of read-ahead in flight, so that the file's contents are usually
+ *    already in memory by the time Read() is called.
+ *  - When writing, it coalesces the bytes passed to Write() into large batches, and hands each full batch to the I/O pool
+ *    to be written behind the caller's back.  A batch that overlaps an earlier batch that hasn't been written yet (e.g.
+ *    after a Seek() backwards) is held back until the earlier batch is on disk, so that the last write always wins.
+ *
+ * Read() and Write() never block; Read() returns 0 if the next block hasn't arrived yet, and Write() returns 0 if too many
+ * bytes are already waiting to be written.  GetReadSelectSocket() becomes ready-for-read whenever an I/O operation completes,
+ * so this object can be used as a session's DataIO inside a ReflectServer just like a socket-based DataIO can.
+ *
+ * @note reads and writes may be mixed, but switching from writing to reading waits (non-blockingly) for all pending writes
+ *       to complete first, and any Write() or Seek() discards any read-ahead that was in progress.
+ * @note since all AsyncFileDataIO objects share the same I/O threads (see GetIOThreadPool()), opening many files
+ *       at once doesn't create any more threads than opening one does.
+ */
+class AsyncFileDataIO : public SeekableDataIO
+{
+public:
+   /** Constructor.
+    *  @param path the path of the file to open.
+    *  @param mode an fopen()-style mode string ("rb", "wb", "ab", "r+b", etc) that specifies how the file should be opened.
+    *  @param maxParallelIOs the maximum number of this file's I/O operations that the I/O pool may execute at once.  Defaults to 2.
+    *  @param readAheadBlockSize the number of bytes to read from the file with each read operation.  Defaults to 64KB.
+    *  @param numReadAheadBlocks the maximum number of read-ahead blocks to have outstanding at once.  Defaults to 4.
+    *  @param writeBehindBatchSize the number of written bytes to accumulate before handing them to an I/O thread.  Defaults to 256KB.
+    *  @param maxPendingWriteBytes the maximum number of bytes that may be waiting to be written to disk at once;
+    *                              beyond this, Write() will return 0 until some pending writes have completed.  Defaults to 4MB.
+    *  @note the file is opened (and read-ahead begins, if the file is readable) immediately.  If the file can't be opened,
+    *        an error is logged and subsequent calls will return that error; call IsFileOpen() to check for that.
+    *  @note when opened in append-mode, the file's initial position is set to its end and writes proceed from there;
+    *        O_APPEND isn't used, since the write-behind batches may be written in parallel.
+    */
+   AsyncFileDataIO(const char * path, const char * mode, uint32 maxParallelIOs = 2, uint32 readAheadBlockSize = 64*1024, uint32 numReadAheadBlocks = 4, uint32 writeBehindBatchSize = 256*1024, uint32 maxPendingWriteBytes = 4*1024*1024);
+
+   /** Destructor.  Waits for any pending writes to complete, then detaches from the I/O pool and closes the file. */
+   virtual ~AsyncFileDataIO();
+
+   /** Returns true iff our file was opened successfully and Shutdown() hasn't been called. */
+   MUSCLE_NODISCARD bool IsFileOpen() const {return _isOpen;}
+
+   /** Copies already-read-ahead bytes into (buffer), and schedules more read-ahead as necessary.
+    *  @param buffer Buffer to write the bytes into
+    *  @param size Number of bytes in the buffer.
+    *  @return Number of bytes read (which may be zero if the data hasn't arrived from disk yet), or B_END_OF_STREAM
+    *          at the end of the file, or an error code.
+    */
+   virtual io_status_t Read(void * buffer, uint32 size);
+
+   /** Appends bytes to our write-behind batch; when the batch is full, it is handed to the I/O pool to be written.
+    *  @param buffer Buffer to read the bytes from.
+    *  @param size Number of bytes in the buffer.
+    *  @return Number of bytes accepted (which may be zero if too many bytes are already waiting to be written), or an error code.
+    */
+   virtual io_status_t Write(const void * buffer, uint32 size);
+
+   /** Seeks to the specified point in the file.  Any partial write-batch is handed off first, and any read-ahead is discarded.
+    *  @param offset Where to seek to.
+    *  @param whence IO_SEEK_SET, IO_SEEK_CUR, or IO_SEEK_END.
+    *  @return B_NO_ERROR on success, an error code on failure.
+    */
+   virtual status_t Seek(int64 offset, int whence);
+
+   /** Returns our current position in the file (as seen by the caller, i.e. including bytes that haven't been written to disk yet). */
+   MUSCLE_NODISCARD virtual int64 GetPosition() const {return (int64) _position;}
+
+   /** Returns the length of the file (as seen by the caller, i.e. including bytes that haven't been written to disk yet). */
+   MUSCLE_NODISCARD virtual int64 GetLength() const;
+
+   /** Waits for all pending writes to complete, and then truncates the file's length to our current position.
+    *  @note unlike our other methods, this method blocks until the pending writes have completed.
+    */
+   virtual status_t Truncate();
+
+   /** Hands our partially-filled write-batch (if any) to the I/O pool, without waiting for it to be written. */
+   virtual void FlushOutput();
+
+   /** Waits for all pending writes to complete, then detaches from the I/O pool and closes the file. */
+   virtual void Shutdown();
+
+   /** Returns true iff some bytes passed to Write() are still waiting in our partially-filled write-batch. */
+   MUSCLE_NODISCARD virtual bool HasBufferedOutput() const;
+
+   /** Implemented to call FlushOutput(), so that partial batches get written when the gateway has nothing more to send. */
+   virtual void WriteBufferedOutput() {FlushOutput();}
+
+   /** Returns a socket that will select() as ready-for-read whenever an I/O thread finishes a read or write operation. */
+   MUSCLE_NODISCARD virtual const ConstSocketRef & GetReadSelectSocket()  const {return _mainThreadNotifySocket;}
+
+   /** Returns the same socket as GetReadSelectSocket() (which is always ready-for-write), or a NULL socket if too many bytes
+     * are already waiting to be written.  In the latter case, GetReadSelectSocket() will select as ready-for-read when some
+     * pending writes have completed, and the next call to Read() will make room for more.
+     */
+   MUSCLE_NODISCARD virtual const ConstSocketRef & GetWriteSelectSocket() const {return (_pendingWriteBytes < _maxPendingWriteBytes) ? _mainThreadNotifySocket : GetNullSocket();}
+
+   /** Blocks until all bytes passed to Write() so far have been written to disk.
+    *  @param timeoutMicros the maximum number of microseconds to wait.  Defaults to MUSCLE_TIME_NEVER (i.e. no timeout).
+    *  @returns B_NO_ERROR once everything has been written, B_TIMED_OUT on timeout, or the error code of any write that failed.
+    */
+   status_t WaitForPendingWrites(uint64 timeoutMicros = MUSCLE_TIME_NEVER);
+
+   /** Returns the process-wide ThreadPool whose threads perform the disk I/O for all AsyncFileDataIO objects.
+     * It is created the first time this method is called, holds at most MUSCLE_ASYNC_FILE_IO_THREAD_POOL_SIZE threads,
+     * and is shut down when the CompleteSetupSystem object is destroyed.
+     */
+   static ThreadPool & GetIOThreadPool();
+
+private:
+#ifndef DOXYGEN_SHOULD_IGNORE_THIS  // this is here so doxygen-coverage won't complain that I haven't documented this class -- it's a private class so I don't need to
+   class IOJob : public RefCountable
+   {
+   public:
+      IOJob(bool isWrite, uint64 offset, const ByteBufferRef & buf) : _isWrite(isWrite), _offset(offset), _buf(buf), _numBytesTransferred(0), _isComplete(false), _isCancelled(false), _isSubmitted(false) {/* empty */}
+
+      MUSCLE_NODISCARD bool Overlaps(const IOJob & rhs) const {return ((_offset < rhs._offset+rhs._buf()->GetNumBytes())&&(rhs._offset < _offset+_buf()->GetNumBytes()));}
+
+      const bool _isWrite;
+      const uint64 _offset;
+      ByteBufferRef _buf;
+      uint32 _numBytesTransferred;  // set by the I/O thread
+      status_t _result;             // set by the I/O thread
+      bool _isComplete;             // guarded by _jobsMutex
+      bool _isCancelled;            // guarded by _jobsMutex
+      bool _isSubmitted;            // accessed from the main thread only; false if the job is being held back behind an overlapping write
+   };
+   DECLARE_REFTYPES(IOJob);
+
+   // The I/O pool handles each client's Messages serially, so we register (_maxParallelIOs) of these with it
+   // and hand out our jobs' wakeup-Messages round-robin, so that up to that many of our jobs can execute at once
+   class IOLane : public IThreadPoolClient, public RefCountable
+   {
+   public:
+      IOLane(AsyncFileDataIO * owner) : IThreadPoolClient(&GetIOThreadPool()), _owner(owner) {/* empty */}
+      virtual ~IOLane() {SetThreadPool(NULL);}
+
+   protected:
+      virtual void MessageReceivedFromThreadPool(const MessageRef & /*msg*/, uint32 /*numLeft*/) {_owner->ExecuteNextJob();}
+
+   private:
+      AsyncFileDataIO * _owner;
+   };
+   DECLARE_REFTYPES(IOLane);
+#endif
+
+   friend class IOLane;
+   status_t OpenFile(const char * path, const char * mode);
+   void ExecuteNextJob();
+   void ExecuteJob(IOJob & job) const;
+   status_t SubmitJob(const IOJobRef & job);
+   status_t SubmitWriteBatch();
+   void ScheduleReadAhead();
+   void DiscardReadAhead();
+   void ReapCompletedWrites();
+   status_t SubmitHeldWrites();
+   void DrainNotifySocket();
+   void CloseFile();
+
+   const uint32 _maxParallelIOs;
+   const uint32 _readAheadBlockSize;
+   const uint32 _numReadAheadBlocks;
+   const uint32 _writeBehindBatchSize;
+   const uint32 _maxPendingWriteBytes;
+
+#ifdef WIN32
+   HANDLE _handle;
+#else
+   int _fd;
+#endif
+   bool _isOpen;
+   bool _canRead;
+   bool _canWrite;
+   status_t _openError;   // sticky error from a failed open attempt
+   status_t _writeError;  // sticky error from a failed write-behind operation
+
+   ConstSocketRef _mainThreadNotifySocket, _ioThreadNotifySocket;
+   Queue<IOLaneRef> _ioLanes;
+   uint32 _nextLaneIndex;  // which of (_ioLanes) will get the next job's wakeup-Message
+   MessageRef _jobMsg;     // the wakeup-Message we send to the I/O pool for each job; its contents don't matter
+
+   // Shared with the I/O threads
+   Mutex _jobsMutex;
+   Queue<IOJobRef> _pendingJobs;  // jobs waiting for an I/O thread to pick them up
+
+   // Accessed from the main thread only
+   uint64 _position;           // the caller's current position within the file
+   uint64 _knownLength;        // length of the file, including any bytes we've accepted but not written yet
+   Queue<IOJobRef> _readJobs;  // outstanding read-ahead jobs, in file-order
+   uint32 _readJobOffset;      // how many bytes of _readJobs.Head() have already been returned by Read()
+   uint64 _nextReadAheadPos;   // file-offset of the next read-ahead block to schedule
+   bool _readAheadHitEOF;
+   Queue<IOJobRef> _writeJobs; // outstanding write-behind jobs, in the order they were created
+   uint32 _pendingWriteBytes;  // total bytes in (_writeBatch) and (_writeJobs)
+   ByteBufferRef _writeBatch;  // bytes accepted by Write() that haven't been handed to an I/O thread yet
+   uint64 _writeBatchPos;      // file-offset where (_writeBatch)'s first byte should go
+
+   DECLARE_COUNTED_OBJECT(AsyncFileDataIO);
+};
+DECLARE_REFTYPES(AsyncFileDataIO);
+
+} // end namespace muscle
+
+#endif
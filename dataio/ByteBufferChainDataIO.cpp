@@ -0,0 +1,44 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#include "dataio/ByteBufferChainDataIO.h"
+
+namespace muscle {
+
+ByteBufferChainDataIO :: ByteBufferChainDataIO(bool okayToReturnEndOfStream)
+   : _okayToReturnEndOfStream(okayToReturnEndOfStream)
+{
+   // empty
+}
+
+ByteBufferChainDataIO :: ByteBufferChainDataIO(const ByteBufferChain & chain, bool okayToReturnEndOfStream)
+   : _chain(chain)
+   , _okayToReturnEndOfStream(okayToReturnEndOfStream)
+{
+   // empty
+}
+
+ByteBufferChainDataIO :: ~ByteBufferChainDataIO()
+{
+   // empty
+}
+
+io_status_t ByteBufferChainDataIO :: Read(void * buffer, uint32 size)
+{
+   if (size == 0) return io_status_t(0);
+   if (_chain.IsEmpty()) return _okayToReturnEndOfStream ? io_status_t(B_END_OF_STREAM) : io_status_t(0);
+
+   const uint32 numBytesCopied = _chain.CopyBytes(0, buffer, muscleMin(size, (uint32)INT32_MAX));
+   (void) _chain.RemoveHeadBytes(numBytesCopied);
+   return io_status_t((int32)numBytesCopied);
+}
+
+io_status_t ByteBufferChainDataIO :: Write(const void * buffer, uint32 size)
+{
+   if (size == 0) return io_status_t(0);
+
+   size = muscleMin(size, (uint32)INT32_MAX);
+   MRETURN_ON_ERROR(_chain.AppendBytes(buffer, size));
+   return io_status_t((int32)size);
+}
+
+} // end namespace muscle
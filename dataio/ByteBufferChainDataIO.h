@@ -0,0 +1,81 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#ifndef MuscleByteBufferChainDataIO_h
+#define MuscleByteBufferChainDataIO_h
+
+#include "dataio/DataIO.h"
+#include "util/ByteBufferChain.h"
+
+namespace muscle {
+
+/**
+ *  DataIO class that acts as a FIFO of bytes stored in a ByteBufferChain.  Write() appends bytes to the
+ *  end of the chain, and Read() consumes bytes from the beginning of it.  Code that already has its data
+ *  in ByteBuffers can call GetChain() and append them to the chain directly, to avoid copying the bytes.
+ */
+class ByteBufferChainDataIO : public DataIO
+{
+public:
+   /** Constructor.
+    *  @param okayToReturnEndOfStream if true, then when Read() has no more data to supply because the
+    *             chain is empty, Read() will return B_END_OF_STREAM to indicate that fact.  If false,
+    *             it will just return 0.  Default value is false.
+    */
+   ByteBufferChainDataIO(bool okayToReturnEndOfStream = false);
+
+   /** Convenience constructor.
+    *  @param chain the initial contents of our chain.  No bytes are copied.
+    *  @param okayToReturnEndOfStream if true, then when Read() has no more data to supply because the
+    *             chain is empty, Read() will return B_END_OF_STREAM to indicate that fact.  If false,
+    *             it will just return 0.  Default value is false.
+    */
+   ByteBufferChainDataIO(const ByteBufferChain & chain, bool okayToReturnEndOfStream = false);
+
+   /** Virtual Destructor, to keep C++ honest */
+   virtual ~ByteBufferChainDataIO();
+
+   /**
+    *  Copies bytes from the beginning of our chain into (buffer), and removes them from the chain.
+    *  @param buffer Points to a buffer to read bytes into.
+    *  @param size Number of bytes in the buffer.
+    *  @returns the number of bytes that were written into (buffer), or an error code.
+    */
+   virtual io_status_t Read(void * buffer, uint32 size);
+
+   /**
+    *  Copies the bytes from (buffer) into a new ByteBuffer, and appends it to the end of our chain.
+    *  @param buffer Points to a buffer to write bytes from.
+    *  @param size Number of bytes in the buffer.
+    *  @return the number of bytes that were read out of (buffer), or an error code.
+    */
+   virtual io_status_t Write(const void * buffer, uint32 size);
+
+   /** Implemented as a no-op, since a ByteBufferChain has no concept of flushing output */
+   virtual void FlushOutput() {/* empty */}
+
+   /** Implemented to clear our chain */
+   virtual void Shutdown() {_chain.Clear();}
+
+   /** Returns a null ConstSocketRef, since there's no way to select() on a ByteBufferChain */
+   MUSCLE_NODISCARD virtual const ConstSocketRef & GetReadSelectSocket() const {return GetNullSocket();}
+
+   /** Returns a null ConstSocketRef, since there's no way to select() on a ByteBufferChain */
+   MUSCLE_NODISCARD virtual const ConstSocketRef & GetWriteSelectSocket() const {return GetNullSocket();}
+
+   /** Returns a read/write reference to our chain, so that buffers can be added to or removed from it without copying */
+   MUSCLE_NODISCARD ByteBufferChain & GetChain() {return _chain;}
+
+   /** Returns a read-only reference to our chain */
+   MUSCLE_NODISCARD const ByteBufferChain & GetChain() const {return _chain;}
+
+private:
+   ByteBufferChain _chain;
+   const bool _okayToReturnEndOfStream;
+
+   DECLARE_COUNTED_OBJECT(ByteBufferChainDataIO);
+};
+DECLARE_REFTYPES(ByteBufferChainDataIO);
+
+} // end namespace muscle
+
+#endif
@@ -0,0 +1,252 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#ifndef WIN32
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif
+
+#include "dataio/MMapDataIO.h"
+
+namespace muscle {
+
+// Owns a single mapping of a file; shared (via reference-counting) by the MMapDataIO and any slices it has handed out
+class MMapDataIOMapping : public RefCountable
+{
+public:
+   MMapDataIOMapping()
+      : _bytes(NULL)
+      , _numBytes(0)
+#ifdef WIN32
+      , _file(INVALID_HANDLE_VALUE)
+      , _map(NULL)
+#endif
+   {
+      // empty
+   }
+
+   virtual ~MMapDataIOMapping()
+   {
+#ifdef WIN32
+      if (_bytes) (void) UnmapViewOfFile(_bytes);
+      if (_map) (void) CloseHandle(_map);
+      if (_file != INVALID_HANDLE_VALUE) (void) CloseHandle(_file);
+#else
+      if (_bytes) (void) munmap(_bytes, (size_t) _numBytes);
+#endif
+   }
+
+   status_t MapFile(const char * path)
+   {
+#ifdef WIN32
+      _file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+      if (_file == INVALID_HANDLE_VALUE) return B_ERRNO|B_FILE_NOT_FOUND;
+
+      LARGE_INTEGER fileSize;
+      if (GetFileSizeEx(_file, &fileSize) == false) return B_ERRNO|B_IO_ERROR;
+      if (fileSize.QuadPart == 0) return B_NO_ERROR;  // CreateFileMapping() won't map an empty file, but we can represent it anyway
+      if ((uint64)fileSize.QuadPart > (uint64)((size_t)-1)) return B_RESOURCE_LIMIT;  // too big for our address space
+
+      _map = CreateFileMapping(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+      if (_map == NULL) return B_ERRNO|B_IO_ERROR;
+
+      _bytes = (uint8 *) MapViewOfFile(_map, FILE_MAP_READ, 0, 0, 0);
+      if (_bytes == NULL) return B_ERRNO|B_IO_ERROR;
+
+      _numBytes = fileSize.QuadPart;
+      return B_NO_ERROR;
+#else
+      const int fd = open(path, O_RDONLY);
+      if (fd < 0) return B_ERRNO|B_FILE_NOT_FOUND;
+
+      status_t ret;
+      struct stat st;
+      if (fstat(fd, &st) == 0)
+      {
+              if (st.st_size == 0) {/* empty */}  // mmap() won't map zero bytes, but we can represent an empty file anyway
+         else if ((uint64)st.st_size > (uint64)((size_t)-1)) ret = B_RESOURCE_LIMIT;  // too big for our address space
+         else
+         {
+            void * area = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (area != MAP_FAILED)
+            {
+               _bytes    = (uint8 *) area;
+               _numBytes = st.st_size;
+            }
+            else ret = B_ERRNO|B_IO_ERROR;
+         }
+      }
+      else ret = B_ERRNO|B_IO_ERROR;
+
+      (void) close(fd);  // the mapping remains valid after the file descriptor is closed
+      return ret;
+#endif
+   }
+
+   MUSCLE_NODISCARD const uint8 * GetBytes() const {return _bytes;}
+   MUSCLE_NODISCARD uint64 GetNumBytes() const {return _numBytes;}
+
+private:
+   uint8 * _bytes;
+   uint64 _numBytes;
+#ifdef WIN32
+   HANDLE _file;
+   HANDLE _map;
+#endif
+};
+
+// Allocation-strategy for ByteBuffers that point into a mapping:  they can't be resized, and they must never free() their bytes
+class MMapSliceAllocationStrategy : public IMemoryAllocationStrategy
+{
+public:
+   MMapSliceAllocationStrategy() {/* empty */}
+
+   MUSCLE_NODISCARD virtual void * Malloc(size_t /*size*/) {return NULL;}
+   MUSCLE_NODISCARD virtual void * Realloc(void * /*ptr*/, size_t /*newSize*/, size_t /*oldSize*/, bool /*retainData*/) {return NULL;}
+   virtual void Free(void * /*ptr*/, size_t /*size*/) {/* empty */}
+};
+static MMapSliceAllocationStrategy _sliceAllocationStrategy;
+
+// A ByteBuffer whose bytes live inside a mapping; it keeps the mapping alive for as long as it exists
+class MMapSliceByteBuffer : public ByteBuffer
+{
+public:
+   MMapSliceByteBuffer(const Ref<MMapDataIOMapping> & mapping, uint64 offset, uint32 numBytes)
+      : ByteBuffer(0, NULL, &_sliceAllocationStrategy)
+      , _mapping(mapping)
+   {
+      AdoptBuffer(numBytes, const_cast<uint8 *>(_mapping()->GetBytes())+offset);
+   }
+
+private:
+   const Ref<MMapDataIOMapping> _mapping;
+};
+
+MMapDataIO :: MMapDataIO()
+   : _bytes(NULL)
+   , _numBytes(0)
+   , _seekPos(0)
+{
+   // empty
+}
+
+MMapDataIO :: MMapDataIO(const char * path)
+   : _bytes(NULL)
+   , _numBytes(0)
+   , _seekPos(0)
+{
+   status_t ret;
+   if (SetFile(path).IsError(ret)) LogTime(MUSCLE_LOG_ERROR, "MMapDataIO:  Unable to map file [%s] [%s]\n", path, ret());
+}
+
+MMapDataIO :: ~MMapDataIO()
+{
+   // empty
+}
+
+status_t MMapDataIO :: SetFile(const char * path)
+{
+   Shutdown();
+
+   Ref<MMapDataIOMapping> mapping(newnothrow MMapDataIOMapping);
+   MRETURN_OOM_ON_NULL(mapping());
+   MRETURN_ON_ERROR(mapping()->MapFile(path));
+
+   _mapping  = mapping;
+   _bytes    = mapping()->GetBytes();
+   _numBytes = mapping()->GetNumBytes();
+   return B_NO_ERROR;
+}
+
+void MMapDataIO :: Shutdown()
+{
+   _mapping.Reset();
+   _bytes    = NULL;
+   _numBytes = 0;
+   _seekPos  = 0;
+}
+
+ConstByteBufferRef MMapDataIO :: GetSlice(uint64 offset, uint32 numBytes) const
+{
+   if ((_mapping() == NULL)||(offset > _numBytes)) return ConstByteBufferRef();
+   if (offset == _numBytes) return GetEmptyByteBufferRef();
+
+   ConstByteBufferRef ret(newnothrow MMapSliceByteBuffer(_mapping, offset, (uint32) muscleMin((uint64)numBytes, _numBytes-offset)));
+   if (ret() == NULL) MWARN_OUT_OF_MEMORY;
+   return ret;
+}
+
+ConstByteBufferRef MMapDataIO :: ReadSlice(uint32 numBytes)
+{
+   ConstByteBufferRef ret = GetSlice(_seekPos, numBytes);
+   if (ret()) _seekPos += ret()->GetNumBytes();
+   return ret;
+}
+
+status_t MMapDataIO :: SetAccessPatternHint(uint32 accessPattern, uint64 offset, uint64 numBytes)
+{
+   if (_mapping() == NULL) return B_BAD_OBJECT;
+   if (accessPattern >= NUM_MMAP_ACCESSES) return B_BAD_ARGUMENT;
+   if ((offset >= _numBytes)||(numBytes == 0)) return B_NO_ERROR;  // nothing to advise about
+
+#if defined(WIN32) || defined(__EMSCRIPTEN__)
+   return B_UNIMPLEMENTED;
+#else
+   int advice;
+   switch(accessPattern)
+   {
+      case MMAP_ACCESS_SEQUENTIAL: advice = MADV_SEQUENTIAL; break;
+      case MMAP_ACCESS_RANDOM:     advice = MADV_RANDOM;     break;
+      case MMAP_ACCESS_WILL_NEED:  advice = MADV_WILLNEED;   break;
+      default:                     advice = MADV_NORMAL;     break;
+   }
+
+   // madvise() requires a page-aligned starting address, so round (offset) down to the start of its page
+   const long pageSize        = sysconf(_SC_PAGESIZE);
+   const uint64 alignedOffset = (pageSize > 0) ? (offset-(offset%((uint64)pageSize))) : 0;
+   const uint64 endOffset     = offset+muscleMin(numBytes, _numBytes-offset);
+   return (madvise(const_cast<uint8 *>(_bytes)+alignedOffset, (size_t)(endOffset-alignedOffset), advice) == 0) ? B_NO_ERROR : B_ERRNO;
+#endif
+}
+
+io_status_t MMapDataIO :: Read(void * buffer, uint32 size)
+{
+   if (_mapping() == NULL) return B_BAD_OBJECT;
+   if (size == 0) return io_status_t(0);
+   if (_seekPos >= _numBytes) return B_END_OF_STREAM;
+
+   const uint32 numBytesToCopy = (uint32) muscleMin((uint64)muscleMin(size, (uint32)INT32_MAX), _numBytes-_seekPos);
+   memcpy(buffer, _bytes+_seekPos, numBytesToCopy);
+   _seekPos += numBytesToCopy;
+   return io_status_t((int32)numBytesToCopy);
+}
+
+io_status_t MMapDataIO :: Write(const void * /*buffer*/, uint32 /*size*/)
+{
+   return _mapping() ? B_ACCESS_DENIED : B_BAD_OBJECT;
+}
+
+status_t MMapDataIO :: Seek(int64 offset, int whence)
+{
+   if (_mapping() == NULL) return B_BAD_OBJECT;
+
+   int64 newSeekPos;
+   switch(whence)
+   {
+      case IO_SEEK_SET: newSeekPos = offset;                   break;
+      case IO_SEEK_CUR: newSeekPos = offset+(int64)_seekPos;  break;
+      case IO_SEEK_END: newSeekPos = offset+(int64)_numBytes; break;  // yes, the + is intentional; in this case, offset is expected to be a negative value, or zero
+      default:          return B_BAD_ARGUMENT;
+   }
+   if ((newSeekPos < 0)||(newSeekPos > (int64)_numBytes)) return B_BAD_ARGUMENT;  // yes, the strictly-greater-than test is intentional, so we can successfully seek to EOF
+
+   _seekPos = (uint64) newSeekPos;
+   return B_NO_ERROR;
+}
+
+status_t MMapDataIO :: Truncate()
+{
+   return _mapping() ? B_ACCESS_DENIED : B_BAD_OBJECT;
+}
+
+} // end namespace muscle
@@ -0,0 +1,136 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#ifndef MuscleMMapDataIO_h
+#define MuscleMMapDataIO_h
+
+#include "dataio/SeekableDataIO.h"
+#include "util/ByteBuffer.h"
+
+namespace muscle {
+
+class MMapDataIOMapping;
+
+/**
+ *  Read-only DataIO that memory-maps a file (via mmap() or MapViewOfFile()) rather than reading it through
+ *  a stdio buffer.  Read() still copies bytes out of the mapping, but GetSlice() lets you access any portion
+ *  of the file as a ConstByteBufferRef without copying anything, which is handy when you want to
+ *  unflatten a large archived Message (e.g. via Message::UnflattenFromByteBuffer()) straight out of the file.
+ *  @note the ConstByteBuffers returned by GetSlice() keep the mapping alive, so they remain valid even after
+ *        this MMapDataIO has been Shutdown() or deleted.
+ */
+class MMapDataIO : public SeekableDataIO
+{
+public:
+   /** Values to pass to SetAccessPatternHint() */
+   enum {
+      MMAP_ACCESS_NORMAL = 0, /**< No special treatment (this is the default) */
+      MMAP_ACCESS_SEQUENTIAL, /**< We expect to read the file from start to finish; the OS should read ahead aggressively and can drop pages behind us */
+      MMAP_ACCESS_RANDOM,     /**< We expect to jump around in the file; the OS shouldn't bother reading ahead */
+      MMAP_ACCESS_WILL_NEED,  /**< We'll need the whole file soon; the OS should start paging it in now */
+      NUM_MMAP_ACCESSES       /**< Guard value */
+   };
+
+   /** Default constructor.  You'll need to call SetFile() before this object will be useful. */
+   MMapDataIO();
+
+   /** Constructor.
+    *  @param path the path of the file to map.  If the file can't be opened or mapped, an error will be
+    *              logged and this object will act like an empty file; you can call IsMapped() to check for that.
+    */
+   MMapDataIO(const char * path);
+
+   /** Destructor.  Unmaps our file (unless it is still being referenced by slices returned by GetSlice()) */
+   virtual ~MMapDataIO();
+
+   /** Maps the specified file into memory, replacing any file we had mapped previously.  The seek-position is reset to zero.
+    *  @param path the path of the file to map.
+    *  @returns B_NO_ERROR on success, or an error code if the file couldn't be opened or mapped.
+    *  @note a zero-length file can be "mapped" successfully; it just won't have any bytes in it.
+    */
+   status_t SetFile(const char * path);
+
+   /** Returns true iff we currently have a file mapped. */
+   MUSCLE_NODISCARD bool IsMapped() const {return (_mapping() != NULL);}
+
+   /** Returns a pointer to the first byte of our mapped file, or NULL if there isn't one. */
+   MUSCLE_NODISCARD const uint8 * GetMappedBytes() const {return _bytes;}
+
+   /** Returns a zero-copy view of the specified region of our mapped file.
+    *  @param offset the offset (in bytes from the start of the file) of the first byte of the region.
+    *  @param numBytes the number of bytes in the region.  Will be clamped to the number of bytes available at (offset).
+    *  @returns a read-only ByteBuffer that points directly into our mapping, or a NULL reference if (offset) is out of range,
+    *           or if we have no file mapped, or if the region is too large to be represented by a ByteBuffer (i.e. 4GB or more).
+    */
+   MUSCLE_NODISCARD ConstByteBufferRef GetSlice(uint64 offset, uint32 numBytes) const;
+
+   /** Convenience method:  Returns a zero-copy view of the (numBytes) bytes at our current seek-position,
+    *  and advances our seek-position past them.
+    *  @param numBytes the number of bytes to return.  Will be clamped to the number of bytes remaining in the file.
+    *  @returns a read-only ByteBuffer that points directly into our mapping, or a NULL reference on failure.
+    */
+   ConstByteBufferRef ReadSlice(uint32 numBytes);
+
+   /** Tells the operating system how we expect to access our file, so that it can tune its paging behavior accordingly.
+    *  @param accessPattern an MMAP_ACCESS_* value.
+    *  @param offset the first byte of the region the hint applies to.  Defaults to 0.
+    *  @param numBytes the number of bytes the hint applies to.  Defaults to MUSCLE_NO_LIMIT, meaning the rest of the file.
+    *  @returns B_NO_ERROR on success, B_BAD_OBJECT if we have no file mapped, or B_UNIMPLEMENTED if the hint isn't
+    *           supported on this platform.
+    */
+   status_t SetAccessPatternHint(uint32 accessPattern, uint64 offset = 0, uint64 numBytes = MUSCLE_NO_LIMIT);
+
+   /** Copies bytes from our mapped file into (buffer).
+    *  @param buffer Buffer to write the bytes into
+    *  @param size Number of bytes in the buffer.
+    *  @return Number of bytes read, or B_END_OF_STREAM if we're at the end of the file, or B_BAD_OBJECT if no file is mapped.
+    */
+   virtual io_status_t Read(void * buffer, uint32 size);
+
+   /** Implemented to return B_ACCESS_DENIED, since our mapping is read-only.
+    *  @param buffer Buffer to read the bytes from.
+    *  @param size Number of bytes in the buffer.
+    *  @return B_ACCESS_DENIED, or B_BAD_OBJECT if no file is mapped.
+    */
+   virtual io_status_t Write(const void * buffer, uint32 size);
+
+   /** Seeks to the specified point in the file.
+    *  @param offset Where to seek to.
+    *  @param whence IO_SEEK_SET, IO_SEEK_CUR, or IO_SEEK_END.
+    *  @return B_NO_ERROR on success, or B_BAD_ARGUMENT if the resulting position would be outside the file.
+    */
+   virtual status_t Seek(int64 offset, int whence);
+
+   /** Returns our current position in the file. */
+   MUSCLE_NODISCARD virtual int64 GetPosition() const {return (int64) _seekPos;}
+
+   /** Returns the length of our mapped file, in bytes. */
+   MUSCLE_NODISCARD virtual int64 GetLength() const {return (int64) _numBytes;}
+
+   /** Returns B_ACCESS_DENIED or B_BAD_OBJECT, since our mapping is read-only. */
+   virtual status_t Truncate();
+
+   /** Implemented as a no-op, since we never write anything. */
+   virtual void FlushOutput() {/* empty */}
+
+   /** Unmaps our file (unless it is still being referenced by slices returned by GetSlice()) */
+   virtual void Shutdown();
+
+   /** Returns a null ConstSocketRef, since reading from memory never blocks (except for page faults, which select() can't help with) */
+   MUSCLE_NODISCARD virtual const ConstSocketRef & GetReadSelectSocket()  const {return GetNullSocket();}
+
+   /** Returns a null ConstSocketRef, since reading from memory never blocks (except for page faults, which select() can't help with) */
+   MUSCLE_NODISCARD virtual const ConstSocketRef & GetWriteSelectSocket() const {return GetNullSocket();}
+
+private:
+   Ref<MMapDataIOMapping> _mapping;  // shared with any slices we've handed out
+   const uint8 * _bytes;             // cached from (_mapping) for convenience
+   uint64 _numBytes;                 // ditto
+   uint64 _seekPos;
+
+   DECLARE_COUNTED_OBJECT(MMapDataIO);
+};
+DECLARE_REFTYPES(MMapDataIO);
+
+} // end namespace muscle
+
+#endif
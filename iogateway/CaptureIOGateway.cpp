@@ -0,0 +1,242 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#include "iogateway/CaptureIOGateway.h"
+#include "support/DataFlattener.h"
+#include "support/DataUnflattener.h"
+#include "util/MiscUtilityFunctions.h"  // for ResolveFileSystemAliasesInFilePath()
+
+namespace muscle {
+
+static const uint32 CAPTURE_FILE_HEADER_SIZE   = (2*sizeof(uint32))+sizeof(uint64);
+static const uint32 CAPTURE_RECORD_HEADER_SIZE = sizeof(uint64)+(2*sizeof(uint32));  // the Message's size-header is written by FlattenToDataIO()
+
+MessageCaptureWriter :: MessageCaptureWriter()
+   : _startTime(0)
+   , _lastFlushTime(0)
+   , _numRecordsWritten(0)
+{
+   // empty
+}
+
+MessageCaptureWriter :: ~MessageCaptureWriter()
+{
+   Close();
+}
+
+status_t MessageCaptureWriter :: Open(const String & filePath)
+{
+   DECLARE_MUTEXGUARD(_mutex);
+
+   _file.SetFile(muscleFopen(ResolveFileSystemAliasesInFilePath(filePath)(), "wb"));
+   if (_file.GetFile() == NULL) return B_ERRNO;
+
+   _startTime         = GetRunTime64();
+   _lastFlushTime     = _startTime;
+   _numRecordsWritten = 0;
+
+   uint8 headerBuf[CAPTURE_FILE_HEADER_SIZE];
+   DataFlattener flat(headerBuf, sizeof(headerBuf));
+   flat.WriteInt32(MESSAGE_CAPTURE_FILE_MAGIC);
+   flat.WriteInt32(MESSAGE_CAPTURE_FILE_VERSION);
+   flat.WriteInt64(GetCurrentTime64());
+
+   status_t ret;
+   if (_file.WriteFully(headerBuf, sizeof(headerBuf)).IsError(ret)) _file.Shutdown();
+   return ret;
+}
+
+void MessageCaptureWriter :: Close()
+{
+   DECLARE_MUTEXGUARD(_mutex);
+   _file.Shutdown();  // fclose() flushes any buffered records for us
+}
+
+bool MessageCaptureWriter :: IsOpen() const
+{
+   DECLARE_MUTEXGUARD(_mutex);
+   return (_file.GetFile() != NULL);
+}
+
+uint64 MessageCaptureWriter :: GetNumRecordsWritten() const
+{
+   DECLARE_MUTEXGUARD(_mutex);
+   return _numRecordsWritten;
+}
+
+status_t MessageCaptureWriter :: WriteMessage(uint32 sessionID, uint32 direction, const Message & msg)
+{
+   DECLARE_MUTEXGUARD(_mutex);
+   if (_file.GetFile() == NULL) return B_BAD_OBJECT;
+
+   const uint64 now = GetRunTime64();
+   uint8 headerBuf[CAPTURE_RECORD_HEADER_SIZE];
+   DataFlattener flat(headerBuf, sizeof(headerBuf));
+   flat.WriteInt64(now-_startTime);
+   flat.WriteInt32(sessionID);
+   flat.WriteInt32(direction);
+
+   MRETURN_ON_ERROR(_file.WriteFully(headerBuf, sizeof(headerBuf)));
+   MRETURN_ON_ERROR(msg.FlattenToDataIO(_file, true));
+   _numRecordsWritten++;
+
+   // Flush once in a while, so that not much of the capture is lost if our process gets killed
+   if (now >= _lastFlushTime+MICROS_PER_SECOND)
+   {
+      _file.FlushOutput();
+      _lastFlushTime = now;
+   }
+   return B_NO_ERROR;
+}
+
+MessageCaptureReader :: MessageCaptureReader()
+   : _startTime(0)
+{
+   // empty
+}
+
+MessageCaptureReader :: ~MessageCaptureReader()
+{
+   Close();
+}
+
+status_t MessageCaptureReader :: Open(const String & filePath)
+{
+   _file.SetFile(muscleFopen(ResolveFileSystemAliasesInFilePath(filePath)(), "rb"));
+   if (_file.GetFile() == NULL) return B_ERRNO;
+
+   uint8 headerBuf[CAPTURE_FILE_HEADER_SIZE];
+   status_t ret;
+   if (_file.ReadFully(headerBuf, sizeof(headerBuf)).IsOK(ret))
+   {
+      DataUnflattener unflat(headerBuf, sizeof(headerBuf));
+      const uint32 magic   = unflat.ReadInt32();
+      const uint32 version = unflat.ReadInt32();
+      _startTime = unflat.ReadInt64();
+      if ((magic != MESSAGE_CAPTURE_FILE_MAGIC)||(version > MESSAGE_CAPTURE_FILE_VERSION)) ret = B_BAD_DATA;
+   }
+
+   if (ret.IsError()) Close();
+   return ret;
+}
+
+status_t MessageCaptureReader :: ReadNextMessage(uint64 & retTimeStamp, uint32 & retSessionID, uint32 & retDirection, MessageRef & retMsg)
+{
+   if (_file.GetFile() == NULL) return B_BAD_OBJECT;
+
+   uint8 headerBuf[CAPTURE_RECORD_HEADER_SIZE];
+   const io_status_t numRead = _file.ReadFullyUpTo(headerBuf, sizeof(headerBuf));
+   MRETURN_ON_ERROR(numRead);
+   if (numRead.GetByteCount() == 0) return B_DATA_NOT_FOUND;  // clean end-of-file
+   if (numRead.GetByteCount() != sizeof(headerBuf)) return B_BAD_DATA;  // truncated record
+
+   DataUnflattener unflat(headerBuf, sizeof(headerBuf));
+   retTimeStamp = unflat.ReadInt64();
+   retSessionID = unflat.ReadInt32();
+   retDirection = unflat.ReadInt32();
+
+   retMsg = GetMessageFromPool();
+   MRETURN_ON_ERROR(retMsg);
+   return retMsg()->UnflattenFromDataIO(_file, -1);
+}
+
+CaptureIOGateway :: CaptureIOGateway(const AbstractMessageIOGatewayRef & slaveGateway, const MessageCaptureWriterRef & writer, uint32 sessionID)
+   : _writer(writer)
+   , _sessionID(sessionID)
+   , _scratchReceiver(NULL)
+{
+   SetSlaveGateway(slaveGateway);
+}
+
+CaptureIOGateway :: ~CaptureIOGateway()
+{
+   // empty
+}
+
+void CaptureIOGateway :: SetDataIO(const DataIORef & ref)
+{
+   AbstractMessageIOGateway::SetDataIO(ref);
+   if (_slaveGateway()) _slaveGateway()->SetDataIO(ref);
+}
+
+void CaptureIOGateway :: SetSlaveGateway(const AbstractMessageIOGatewayRef & slaveGateway)
+{
+   if (_slaveGateway()) _slaveGateway()->SetDataIO(DataIORef());
+   _slaveGateway = slaveGateway;
+   if (_slaveGateway()) _slaveGateway()->SetDataIO(GetDataIO());
+}
+
+status_t CaptureIOGateway :: AddOutgoingMessage(const MessageRef & messageRef)
+{
+   // Outgoing Messages wait in our own queue (rather than the slave's) so that the session can still prune them before they go out
+   return _slaveGateway() ? AbstractMessageIOGateway::AddOutgoingMessage(messageRef) : B_BAD_OBJECT;
+}
+
+bool CaptureIOGateway :: IsReadyForInput() const
+{
+   return ((_slaveGateway())&&(_slaveGateway()->IsReadyForInput()));
+}
+
+bool CaptureIOGateway :: HasBytesToOutput() const
+{
+   return ((_slaveGateway())&&((GetOutgoingMessageQueue().HasItems())||(_slaveGateway()->HasBytesToOutput())));
+}
+
+uint64 CaptureIOGateway :: GetOutputStallLimit() const
+{
+   return _slaveGateway() ? _slaveGateway()->GetOutputStallLimit() : MUSCLE_TIME_NEVER;
+}
+
+void CaptureIOGateway :: Shutdown()
+{
+   AbstractMessageIOGateway::Shutdown();
+   if (_slaveGateway()) _slaveGateway()->Shutdown();
+}
+
+void CaptureIOGateway :: Reset()
+{
+   AbstractMessageIOGateway::Reset();
+   if (_slaveGateway()) _slaveGateway()->Reset();
+}
+
+io_status_t CaptureIOGateway :: DoOutputImplementation(uint32 maxBytes)
+{
+   AbstractMessageIOGateway * slave = _slaveGateway();
+   if (slave == NULL) return B_BAD_OBJECT;
+
+   // We only hand the slave one Message at a time, and only once it has nothing else queued up,
+   // so that each Message gets recorded at (approximately) the time it actually goes out
+   uint32 totalBytesWritten = 0;
+   while(totalBytesWritten < maxBytes)
+   {
+      MessageRef msg;
+      if ((slave->GetOutgoingMessageQueue().IsEmpty())&&(PopNextOutgoingMessage(msg).IsOK()))
+      {
+         if (_writer()) (void) _writer()->WriteMessage(_sessionID, MESSAGE_CAPTURE_DIRECTION_OUTGOING, *msg());
+         MRETURN_ON_ERROR(slave->AddOutgoingMessage(msg));
+      }
+
+      const io_status_t r = slave->DoOutput(maxBytes-totalBytesWritten);
+      MRETURN_ON_ERROR(r);
+      if (r.GetByteCount() == 0) break;
+      totalBytesWritten += r.GetByteCount();
+   }
+   return io_status_t((int32) totalBytesWritten);
+}
+
+io_status_t CaptureIOGateway :: DoInputImplementation(AbstractGatewayMessageReceiver & receiver, uint32 maxBytes)
+{
+   if (_slaveGateway() == NULL) return B_BAD_OBJECT;
+
+   _scratchReceiver = &receiver;
+   const io_status_t ret = _slaveGateway()->DoInput(*this, maxBytes);
+   _scratchReceiver = NULL;
+   return ret;
+}
+
+void CaptureIOGateway :: MessageReceivedFromGateway(const MessageRef & msg, void * userData)
+{
+   if ((_writer())&&(msg())) (void) _writer()->WriteMessage(_sessionID, MESSAGE_CAPTURE_DIRECTION_INCOMING, *msg());
+   if (_scratchReceiver) CallMessageReceivedFromGateway(*_scratchReceiver, msg, userData);
+}
+
+} // end namespace muscle
@@ -0,0 +1,183 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#ifndef MuscleCaptureIOGateway_h
+#define MuscleCaptureIOGateway_h
+
+#include "dataio/FileDataIO.h"
+#include "iogateway/AbstractMessageIOGateway.h"
+#include "system/Mutex.h"
+
+namespace muscle {
+
+enum {
+   MESSAGE_CAPTURE_FILE_MAGIC   = 1835229552, /**< 'mcap' -- the first four bytes of every Message-capture file */
+   MESSAGE_CAPTURE_FILE_VERSION = 1          /**< the version of the Message-capture file format written by this code */
+};
+
+/** Values indicating which way a captured Message was travelling */
+enum {
+   MESSAGE_CAPTURE_DIRECTION_INCOMING = 0, /**< the Message was received from the remote peer */
+   MESSAGE_CAPTURE_DIRECTION_OUTGOING,     /**< the Message was sent to the remote peer */
+   NUM_MESSAGE_CAPTURE_DIRECTIONS          /**< guard value */
+};
+
+/** This class writes a stream of timestamped Messages out to a Message-capture file.
+  * A single MessageCaptureWriter is typically shared by many CaptureIOGateways (one per session),
+  * so that the traffic of all sessions ends up interleaved, in the order it happened, in a single file.
+  *
+  * The file consists of a 16-byte header (the uint32 MESSAGE_CAPTURE_FILE_MAGIC, the uint32
+  * MESSAGE_CAPTURE_FILE_VERSION, and the uint64 wall-clock time (in microseconds since 1970) when
+  * the capture began) followed by zero or more records.  Each record consists of a uint64 timestamp
+  * (in microseconds since the capture began), a uint32 session ID, a uint32 direction
+  * (MESSAGE_CAPTURE_DIRECTION_*), a uint32 byte-count, and then that many bytes of flattened Message.
+  * All values are stored in little-endian format.
+  *
+  * Writes are buffered by the FILE layer and flushed about once per second, so the file should be
+  * closed (or the writer destroyed) before the file is read back in, if you want all of it.
+  * This class is thread-safe.
+  */
+class MessageCaptureWriter : public RefCountable, private NotCopyable
+{
+public:
+   /** Default constructor.  You'll need to call Open() before this object will write anything. */
+   MessageCaptureWriter();
+
+   /** Destructor.  Closes our file, if it is still open. */
+   virtual ~MessageCaptureWriter();
+
+   /** Creates (or truncates) the specified file and writes a capture-file header into it.
+     * @param filePath path of the file to write captured Messages into.
+     * @returns B_NO_ERROR on success, or an error code on failure.
+     */
+   status_t Open(const String & filePath);
+
+   /** Flushes and closes our file.  Has no effect if our file wasn't open. */
+   void Close();
+
+   /** Returns true iff our file is currently open for writing. */
+   MUSCLE_NODISCARD bool IsOpen() const;
+
+   /** Appends a record for the specified Message to our file.
+     * @param sessionID an ID number indicating which session the Message belonged to.
+     * @param direction a MESSAGE_CAPTURE_DIRECTION_* value indicating which way the Message was going.
+     * @param msg the Message to record.
+     * @returns B_NO_ERROR on success, or an error code on failure.
+     */
+   status_t WriteMessage(uint32 sessionID, uint32 direction, const Message & msg);
+
+   /** Returns the number of records we have written since Open() was called. */
+   MUSCLE_NODISCARD uint64 GetNumRecordsWritten() const;
+
+private:
+   mutable Mutex _mutex;
+   FileDataIO _file;
+   uint64 _startTime;
+   uint64 _lastFlushTime;
+   uint64 _numRecordsWritten;
+
+   DECLARE_COUNTED_OBJECT(MessageCaptureWriter);
+};
+DECLARE_REFTYPES(MessageCaptureWriter);
+
+/** This class reads back the records of a Message-capture file that was written by a MessageCaptureWriter. */
+class MessageCaptureReader : private NotCopyable
+{
+public:
+   /** Default constructor.  You'll need to call Open() before this object will read anything. */
+   MessageCaptureReader();
+
+   /** Destructor.  Closes our file, if it is still open. */
+   ~MessageCaptureReader();
+
+   /** Opens the specified capture file and reads its header.
+     * @param filePath path of the Message-capture file to read.
+     * @returns B_NO_ERROR on success, or B_BAD_DATA if the file isn't a Message-capture file, or another error code on failure.
+     */
+   status_t Open(const String & filePath);
+
+   /** Closes our file.  Has no effect if our file wasn't open. */
+   void Close() {_file.Shutdown();}
+
+   /** Reads the next record from our file.
+     * @param retTimeStamp on success, the record's timestamp (in microseconds since the capture began) is written here.
+     * @param retSessionID on success, the record's session ID is written here.
+     * @param retDirection on success, the record's MESSAGE_CAPTURE_DIRECTION_* value is written here.
+     * @param retMsg on success, this will be set to point to a newly-allocated copy of the recorded Message.
+     * @returns B_NO_ERROR on success, B_DATA_NOT_FOUND when there are no more records, or another error code on failure.
+     */
+   status_t ReadNextMessage(uint64 & retTimeStamp, uint32 & retSessionID, uint32 & retDirection, MessageRef & retMsg);
+
+   /** Returns the wall-clock time (in microseconds since 1970) when the capture began, as recorded in the file's header. */
+   MUSCLE_NODISCARD uint64 GetCaptureStartTime() const {return _startTime;}
+
+private:
+   FileDataIO _file;
+   uint64 _startTime;
+};
+
+/**
+ * This gateway "wraps" a caller-supplied AbstractMessageIOGateway and records every
+ * Message that passes through it (in either direction) to a MessageCaptureWriter, before
+ * handing it on to the slave gateway (for outgoing Messages) or to the receiver (for incoming
+ * Messages).  The wrapped gateway's wire behavior is unchanged.
+ *
+ * Incoming Messages are timestamped when they are received; outgoing Messages are
+ * timestamped when they are handed to the slave gateway to be sent.  (Outgoing Messages
+ * wait in our own outgoing-Message-queue until then, so that the session can still prune them)
+ */
+class CaptureIOGateway : public AbstractMessageIOGateway
+{
+public:
+   /** Constructor
+     * @param slaveGateway Reference to the AbstractMessageIOGateway we want to proxy for.
+     * @param writer Reference to the MessageCaptureWriter to record our Messages with.
+     * @param sessionID the session ID to tag our records with.
+     */
+   CaptureIOGateway(const AbstractMessageIOGatewayRef & slaveGateway, const MessageCaptureWriterRef & writer, uint32 sessionID);
+
+   /** Destructor */
+   virtual ~CaptureIOGateway();
+
+   virtual status_t AddOutgoingMessage(const MessageRef & messageRef);
+
+   MUSCLE_NODISCARD virtual bool IsReadyForInput() const;
+   MUSCLE_NODISCARD virtual bool HasBytesToOutput() const;
+   MUSCLE_NODISCARD virtual uint64 GetOutputStallLimit() const;
+   virtual void Shutdown();
+   virtual void Reset();
+   virtual void SetDataIO(const DataIORef & ref);
+
+   /** Sets our slave gateway to something else.
+     * @param slaveGateway Reference to the new AbstractMessageIOGateway we want to proxy for.
+     */
+   void SetSlaveGateway(const AbstractMessageIOGatewayRef & slaveGateway);
+
+   /** Returns a reference to our held slave gateway (or a NULL reference if we haven't got one) */
+   MUSCLE_NODISCARD const AbstractMessageIOGatewayRef & GetSlaveGateway() const {return _slaveGateway;}
+
+   /** Returns the MessageCaptureWriter we are recording our Messages with. */
+   MUSCLE_NODISCARD const MessageCaptureWriterRef & GetCaptureWriter() const {return _writer;}
+
+   /** Returns the session ID that our records are tagged with. */
+   MUSCLE_NODISCARD uint32 GetCaptureSessionID() const {return _sessionID;}
+
+protected:
+   virtual io_status_t DoOutputImplementation(uint32 maxBytes = MUSCLE_NO_LIMIT);
+   virtual io_status_t DoInputImplementation(AbstractGatewayMessageReceiver & receiver, uint32 maxBytes = MUSCLE_NO_LIMIT);
+
+private:
+   // Called by our slave gateway during DoInputImplementation(); records (msg) and passes it on to our caller's receiver
+   virtual void MessageReceivedFromGateway(const MessageRef & msg, void * userData);
+
+   AbstractMessageIOGatewayRef _slaveGateway;
+   MessageCaptureWriterRef _writer;
+   const uint32 _sessionID;
+   AbstractGatewayMessageReceiver * _scratchReceiver;
+
+   DECLARE_COUNTED_OBJECT(CaptureIOGateway);
+};
+DECLARE_REFTYPES(CaptureIOGateway);
+
+} // end namespace muscle
+
+#endif
@@ -3,6 +3,7 @@
 #include "iogateway/RawDataMessageIOGateway.h"    // for PR_COMMAND_RAW_DATA
 #include "iogateway/WebSocketMessageIOGateway.h"
 #include "support/DataFlattener.h"
+#include "support/MuscleSIMD.h"
 #include "util/IncrementalHashCalculator.h"
 #include "util/MiscUtilityFunctions.h"  // for Base64Encode()
 #include "util/StringTokenizer.h"
@@ -30,6 +31,11 @@ enum {
 };
 
 static const String WS_GATEWAY_NAME_SPECIAL = "_wsgwy_";  // used to differentiate our own Messages from the user's Messages
+static const uint32 MAX_WEBSOCKET_PAYLOAD_BYTES = 10*1024*1024;  // we won't accept (or inflate) any incoming payloads larger than this
+
+static const char * WS_EXTENSIONS_HEADER    = "Sec-WebSocket-Extensions";
+static const char * WS_PERMESSAGE_DEFLATE   = "permessage-deflate";
+static const uint8 WS_SYNC_FLUSH_TRAILER[4] = {0x00, 0x00, 0xFF, 0xFF};  // RFC 7692 section 7.2.1:  senders strip these bytes from the end of each compressed message
 
 static String GetWebSocketHashKeyString(const String & orig)
 {
@@ -49,6 +55,18 @@ WebSocketMessageIOGateway :: WebSocketMessageIOGateway(const bool * isClient)
    , _opCode(0)
    , _inputClosed(false)
    , _outputBytesWritten(0)
+   , _deflateEnabled(false)
+   , _deflateCompressionLevel(6)
+   , _deflateMaxWindowBits(15)
+   , _deflateMemLevel(8)
+   , _deflateNoContextTakeover(false)
+   , _deflateMinBytes(64)
+   , _deflateActive(false)
+   , _outgoingWindowBits(15)
+   , _incomingWindowBits(15)
+   , _outgoingNoContextTakeover(false)
+   , _incomingNoContextTakeover(false)
+   , _payloadIsCompressed(false)
 {
    // empty
 }
@@ -66,6 +84,18 @@ WebSocketMessageIOGateway :: WebSocketMessageIOGateway(const StringMatcher & pro
    , _opCode(0)
    , _inputClosed(false)
    , _outputBytesWritten(0)
+   , _deflateEnabled(false)
+   , _deflateCompressionLevel(6)
+   , _deflateMaxWindowBits(15)
+   , _deflateMemLevel(8)
+   , _deflateNoContextTakeover(false)
+   , _deflateMinBytes(64)
+   , _deflateActive(false)
+   , _outgoingWindowBits(15)
+   , _incomingWindowBits(15)
+   , _outgoingNoContextTakeover(false)
+   , _incomingNoContextTakeover(false)
+   , _payloadIsCompressed(false)
 {
    // empty
 }
@@ -81,6 +111,18 @@ WebSocketMessageIOGateway :: WebSocketMessageIOGateway(const String & getPath, c
    , _opCode(0)
    , _inputClosed(false)
    , _outputBytesWritten(0)
+   , _deflateEnabled(false)
+   , _deflateCompressionLevel(6)
+   , _deflateMaxWindowBits(15)
+   , _deflateMemLevel(8)
+   , _deflateNoContextTakeover(false)
+   , _deflateMinBytes(64)
+   , _deflateActive(false)
+   , _outgoingWindowBits(15)
+   , _incomingWindowBits(15)
+   , _outgoingNoContextTakeover(false)
+   , _incomingNoContextTakeover(false)
+   , _payloadIsCompressed(false)
 {
    {
       uint8 randomBytes[16];
@@ -110,6 +152,173 @@ void WebSocketMessageIOGateway :: ResetHeaderReceiveState()
    _headerSize          = 2;
 }
 
+void WebSocketMessageIOGateway :: SetPerMessageDeflateSettings(bool enable, int compressionLevel, uint32 maxWindowBits, uint32 memLevel, bool noContextTakeover, uint32 minBytesToCompress)
+{
+#ifdef MUSCLE_ENABLE_ZLIB_ENCODING
+   _deflateEnabled = enable;
+#else
+   if (enable) LogTime(MUSCLE_LOG_WARNING, "WebSocketMessageIOGateway::SetPerMessageDeflateSettings():  permessage-deflate is unavailable because MUSCLE_ENABLE_ZLIB_ENCODING isn't defined\n");
+   _deflateEnabled = false;
+#endif
+   _deflateCompressionLevel  = muscleClamp(compressionLevel, 0, 9);
+   _deflateMaxWindowBits     = (uint8) muscleClamp(maxWindowBits, (uint32)9, (uint32)15);  // 9 is the minimum because zlib can't deflate using an 8-bit window
+   _deflateMemLevel          = (uint8) muscleClamp(memLevel, (uint32)1, (uint32)9);
+   _deflateNoContextTakeover = noContextTakeover;
+   _deflateMinBytes          = minBytesToCompress;
+
+   UpdateClientHandshakeRequest();
+}
+
+void WebSocketMessageIOGateway :: UpdateClientHandshakeRequest()
+{
+   if ((_handshakeState != WEBSOCKET_HANDSHAKE_AS_CLIENT)||(_numHTTPBytesWritten > 0)) return;  // too late to change what we're asking for
+
+   // Remove the extensions-header we added previously, if any (it's always the last header), and the blank line that terminates the request
+   const int32 extIdx = _httpTextToWrite.IndexOf(WS_EXTENSIONS_HEADER);
+   _httpTextToWrite = _httpTextToWrite.Substring(0, (extIdx >= 0) ? (uint32)extIdx : (_httpTextToWrite.Length()-2));
+
+   if (_deflateEnabled)
+   {
+      String offer = WS_PERMESSAGE_DEFLATE;
+      if (_deflateMaxWindowBits < 15) offer += String("; client_max_window_bits=%1; server_max_window_bits=%2").Arg(_deflateMaxWindowBits).Arg(_deflateMaxWindowBits);
+                                 else offer += "; client_max_window_bits";  // i.e. the server may limit our window-size if it wants to
+      if (_deflateNoContextTakeover) offer += "; client_no_context_takeover; server_no_context_takeover";
+      _httpTextToWrite += String("%1: %2\r\n").Arg(WS_EXTENSIONS_HEADER).Arg(offer);
+   }
+   _httpTextToWrite += "\r\n";
+}
+
+// Parses a window-bits parameter value; returns 0 if the value is missing or invalid
+static uint32 ParseWindowBits(const String & value)
+{
+   const String v = value.Trimmed().WithoutPrefix("\"").WithoutSuffix("\"");  // RFC 7692 allows the value to be quoted
+   const uint32 bits = v.HasChars() ? (uint32) atoi(v()) : 0;
+   return ((bits >= 8)&&(bits <= 15)) ? bits : 0;
+}
+
+status_t WebSocketMessageIOGateway :: HandleReceivedExtensionsHeader(const String & extensionsStr, String & retResponseStr)
+{
+   const bool amServer = (_handshakeState == WEBSOCKET_HANDSHAKE_AS_SERVER);
+
+   // Each comma-separated item is an extension-name followed by semicolon-separated parameters
+   StringTokenizer offersTok(extensionsStr(), ",");
+   const char * nextOffer;
+   while((nextOffer = offersTok()) != NULL)
+   {
+      StringTokenizer paramsTok(nextOffer, ";");
+      const String extName = String(paramsTok()).Trimmed();
+      if (extName.IsEmpty()) continue;
+
+      if ((extName != WS_PERMESSAGE_DEFLATE)||(_deflateEnabled == false))
+      {
+         if (amServer) continue;  // servers simply ignore offers of extensions they don't support
+
+         LogTime(MUSCLE_LOG_ERROR, "WebSocketMessageIOGateway:  Server accepted extension [%s] which we didn't offer!\n", extName());
+         return B_BAD_DATA;
+      }
+
+      // Our starting assumptions, which the parameters may modify
+      bool serverNoContextTakeover = amServer ? _deflateNoContextTakeover : false;
+      bool clientNoContextTakeover = amServer ? _deflateNoContextTakeover : false;
+      uint32 serverWindowBits      = amServer ? _deflateMaxWindowBits : 15;
+      uint32 clientWindowBits      = amServer ? 15 : _deflateMaxWindowBits;
+      bool clientCanLimitWindow    = false;
+      bool paramsOkay              = true;
+
+      const char * nextParam;
+      while((nextParam = paramsTok()) != NULL)
+      {
+         const String param    = String(nextParam).Trimmed();
+         const int32 eqIdx     = param.IndexOf('=');
+         const String paramName = (eqIdx >= 0) ? param.Substring(0, eqIdx).Trimmed() : param;
+         const uint32 bits      = (eqIdx >= 0) ? ParseWindowBits(param.Substring(eqIdx+1)) : 0;
+
+              if (paramName == "server_no_context_takeover") serverNoContextTakeover = true;
+         else if (paramName == "client_no_context_takeover") clientNoContextTakeover = true;
+         else if (paramName == "server_max_window_bits")
+         {
+            if (bits == 0) paramsOkay = false;
+                      else serverWindowBits = muscleMin(serverWindowBits, bits);
+         }
+         else if (paramName == "client_max_window_bits")
+         {
+            clientCanLimitWindow = true;
+                 if (bits > 0)      clientWindowBits = muscleMin(clientWindowBits, bits);
+            else if (amServer == false) paramsOkay = false;  // in a server's response, this parameter must have a value
+         }
+         else paramsOkay = false;  // unknown parameter
+      }
+
+      const uint32 ourWindowBits = amServer ? serverWindowBits : clientWindowBits;
+      if (ourWindowBits < 9) paramsOkay = false;  // zlib can't deflate using an 8-bit window
+
+      if (paramsOkay == false)
+      {
+         if (amServer) continue;  // decline this offer, maybe we'll like the next one better
+
+         LogTime(MUSCLE_LOG_ERROR, "WebSocketMessageIOGateway:  Server's permessage-deflate response [%s] is unacceptable\n", nextOffer);
+         return B_BAD_DATA;
+      }
+
+      if (amServer)
+      {
+         if (clientCanLimitWindow) clientWindowBits = muscleMin(clientWindowBits, (uint32)_deflateMaxWindowBits);  // so that our inflater's window can be smaller too
+
+         retResponseStr = WS_PERMESSAGE_DEFLATE;
+         if (serverNoContextTakeover) retResponseStr += "; server_no_context_takeover";
+         if (clientNoContextTakeover) retResponseStr += "; client_no_context_takeover";
+         if (serverWindowBits < 15) retResponseStr += String("; server_max_window_bits=%1").Arg(serverWindowBits);
+         if ((clientCanLimitWindow)&&(clientWindowBits < 15)) retResponseStr += String("; client_max_window_bits=%1").Arg(clientWindowBits);
+      }
+      else clientNoContextTakeover |= _deflateNoContextTakeover;  // we're always allowed to reset our own deflater
+
+      _deflateActive             = true;
+      _outgoingWindowBits        = (uint8) (amServer ? serverWindowBits        : clientWindowBits);
+      _incomingWindowBits        = (uint8) (amServer ? clientWindowBits        : serverWindowBits);
+      _outgoingNoContextTakeover = amServer ? serverNoContextTakeover : clientNoContextTakeover;
+      _incomingNoContextTakeover = amServer ? clientNoContextTakeover : serverNoContextTakeover;
+
+      LogTime(MUSCLE_LOG_DEBUG, "WebSocketMessageIOGateway %p:  permessage-deflate is active (outgoing window=%u%s, incoming window=%u%s)\n", this, _outgoingWindowBits, _outgoingNoContextTakeover?" no-context-takeover":"", _incomingWindowBits, _incomingNoContextTakeover?" no-context-takeover":"");
+      return B_NO_ERROR;
+   }
+   return B_NO_ERROR;
+}
+
+status_t WebSocketMessageIOGateway :: InflateReceivedPayload()
+{
+#ifdef MUSCLE_ENABLE_ZLIB_ENCODING
+   if (_payload() == NULL) return B_NO_ERROR;  // an empty compressed message is just an empty message
+
+   MRETURN_ON_ERROR(_payload()->AppendBytes(WS_SYNC_FLUSH_TRAILER, sizeof(WS_SYNC_FLUSH_TRAILER)));
+
+   if (_incomingCodec() == NULL) _incomingCodec.SetRef(newnothrow ZLibCodec(0, _incomingWindowBits));
+   MRETURN_OOM_ON_NULL(_incomingCodec());
+
+   ByteBufferRef inflated = GetByteBufferFromPool(0);
+   MRETURN_OOM_ON_NULL(inflated());
+   MRETURN_ON_ERROR(_incomingCodec()->InflateRaw(_payload()->GetBuffer(), _payload()->GetNumBytes(), _incomingNoContextTakeover, *inflated(), MAX_WEBSOCKET_PAYLOAD_BYTES));
+
+   _payload = inflated;
+   return B_NO_ERROR;
+#else
+   return B_UNIMPLEMENTED;
+#endif
+}
+
+void WebSocketMessageIOGateway :: ReleaseIdleCodecs()
+{
+#ifdef MUSCLE_ENABLE_ZLIB_ENCODING
+   // When no compression context is carried over from one message to the next, there's no
+   // reason to hold on to zlib's (sizable) internal state while the connection is idle.
+   if ((_outgoingNoContextTakeover)&&(_outgoingCodec())&&(_outputBytesWritten >= _outputBuf.GetNumBytes())&&(GetOutgoingMessageQueue().HasItems() == false))
+   {
+      _outgoingCodec.Reset();
+      _scratchDeflateBuf.Clear(true);
+   }
+   if ((_incomingNoContextTakeover)&&(_incomingCodec())&&(_payload() == NULL)) _incomingCodec.Reset();
+#endif
+}
+
 status_t WebSocketMessageIOGateway :: HandleReceivedHTTPText()
 {
    bool hasGet = false, hasSwitching = false;
@@ -138,7 +347,15 @@ status_t WebSocketMessageIOGateway :: HandleReceivedHTTPText()
          else
          {
             const int32 colIdx = s.IndexOf(':');
-            if (colIdx > 0) (void) args.Put(s.Substring(0, colIdx).Trimmed(), s.Substring(colIdx+1).Trimmed());
+            if (colIdx > 0)
+            {
+               // Per RFC 7230, a header that appears more than once is equivalent to a single comma-separated header
+               const String key = s.Substring(0, colIdx).Trimmed();
+               const String val = s.Substring(colIdx+1).Trimmed();
+               String * existingVal = args.Get(key);
+               if (existingVal) (*existingVal) += String(", ").WithAppend(val);
+                           else (void) args.Put(key, val);
+            }
          }
       }
    }
@@ -198,6 +415,10 @@ status_t WebSocketMessageIOGateway :: HandleReceivedHTTPText()
             _httpTextToWrite += "Connection: Upgrade\r\n";
             _httpTextToWrite += String("Sec-WebSocket-Accept: %1\r\n").Arg(GetWebSocketHashKeyString(key));
             if (foundProto.HasChars()) _httpTextToWrite += String("Sec-WebSocket-Protocol: %1\r\n").Arg(foundProto);
+
+            String extensionsResponse;
+            MRETURN_ON_ERROR(HandleReceivedExtensionsHeader(args[WS_EXTENSIONS_HEADER], extensionsResponse));
+            if (extensionsResponse.HasChars()) _httpTextToWrite += String("%1: %2\r\n").Arg(WS_EXTENSIONS_HEADER).Arg(extensionsResponse);
             _httpTextToWrite += "\r\n";
 
             return B_NO_ERROR;
@@ -222,7 +443,9 @@ status_t WebSocketMessageIOGateway :: HandleReceivedHTTPText()
          if (key == GetWebSocketHashKeyString(_clientGeneratedKey))
          {
             _acceptedProtocol = args["Sec-WebSocket-Protocol"];
-            return B_NO_ERROR;
+
+            String unused;
+            return HandleReceivedExtensionsHeader(args[WS_EXTENSIONS_HEADER], unused);
          }
          else
          {
@@ -279,7 +502,7 @@ io_status_t WebSocketMessageIOGateway :: DoInputImplementation(AbstractGatewayMe
       }
       else if (_headerBytesReceived == _headerSize)
       {
-         // download payload bytes
+         // We're in the middle of a frame's payload, so read the remaining payload bytes directly into the payload buffer
          if (_payload() == NULL)
          {
             LogTime(MUSCLE_LOG_ERROR, "WebSocketMessageIOGateway:  Can't receive payload, no _payload buffer is present!\n");
@@ -294,114 +517,31 @@ io_status_t WebSocketMessageIOGateway :: DoInputImplementation(AbstractGatewayMe
          const uint32 numBytesRead = readRet.GetByteCount();
          if (numBytesRead > 0)
          {
-            readBytes         += numBytesRead;
-            _payloadBytesRead += numBytesRead;
-            maxBytes          -= numBytesRead;
-
-            if (_payloadBytesRead == _payload()->GetNumBytes())
-            {
-               if (_isClient == false)   // clients should never receive masked frames anyway
-               {
-                  // Unmask the payload segment
-                  uint8 * payloadBytes = _payload() ? _payload()->GetBuffer() : NULL;
-                  const uint32 numPayloadBytes = _payload() ? _payload()->GetNumBytes() : 0;
-                  if (payloadBytes) for (uint32 i=_firstByteToMask; i<numPayloadBytes; i++) payloadBytes[i] ^= _mask[(i-_firstByteToMask)%sizeof(_mask)];
-                  _firstByteToMask = numPayloadBytes;
-               }
-
-               // If FIN is set, we'll execute this frame and clear it; otherwise we'll append the next frame's data to this one's.
-               if ((_inputClosed)||(_headerBytes[0] & 0x80)) ExecuteReceivedFrame(receiver);
-               ResetHeaderReceiveState();
-            }
+            readBytes += numBytesRead;
+            maxBytes  -= numBytesRead;
+            HandleReceivedPayloadBytes(_payload()->GetBuffer()+_payloadBytesRead, numBytesRead, receiver);  // unmasks in-place
          }
          else break;
       }
       else
       {
-         const uint32 headerBytesToReceive = muscleMin(maxBytes, _headerSize-_headerBytesReceived);
-         const io_status_t readRet         = GetDataIO()()->Read(&_headerBytes[_headerBytesReceived], headerBytesToReceive);
+         // We're expecting a frame header, so read as many bytes as we can and then parse every
+         // frame in them that is complete, so that a burst of small frames costs only a single Read() call.
+         uint8 readBuf[4096];
+         const io_status_t readRet = GetDataIO()()->Read(readBuf, muscleMin(maxBytes, (uint32) sizeof(readBuf)));
          if (readRet.IsError()) {ret = readRet.GetStatus(); break;}
 
          const uint32 numBytesRead = readRet.GetByteCount();
          if (numBytesRead > 0)
          {
-            readBytes            += numBytesRead;
-            _headerBytesReceived += numBytesRead;
-            maxBytes             -= numBytesRead;
-            if (_headerBytesReceived == _headerSize)
-            {
-               const bool maskBit = ((_headerBytes[1] & 0x80) != 0);
-               switch(_headerSize)
-               {
-                  case 2:  // initial header-bytes read (we'll use the contents of these two bytes to determine the actual header-size)
-                  {
-                     const bool peerIsServer = _isClient;  // just for code clarity
-                     const char * peerDesc   = peerIsServer ? "server" : "client";
-
-                     if (_headerBytes[0] & 0x70)
-                     {
-                        LogTime(MUSCLE_LOG_ERROR, "WebSocketMessageIOGateway:  Frame from %s had reserved bits set!  %x\n", peerDesc, _headerBytes[0]);
-                        SetUnrecoverableErrorStatus(B_BAD_DATA);
-                        return B_BAD_DATA;
-                     }
-
-                     if (peerIsServer ? (maskBit != 0) : (maskBit == 0))  // RFC 6455:  clients MUST send us masked frames; servers MUST NOT send us masked frames.  Check incoming frames accordingly.
-                     {
-                        LogTime(MUSCLE_LOG_ERROR, "WebSocketMessageIOGateway::DoInputImplementation():  Frame from %s %s its mask bit set! (%x)\n", peerDesc, peerIsServer ? "had" : "didn't have", _headerBytes[1]);
-                        SetUnrecoverableErrorStatus(B_BAD_DATA);
-                        return B_BAD_DATA;
-                     }
-
-                     switch(_headerBytes[1] & 0x7F)
-                     {
-                        case 126: _headerSize += 2; break; /* need to read 2 more header-bytes to find out the payload-size */
-                        case 127: _headerSize += 8; break; /* need to read 8 more header-bytes to find out the payload-size */
-                        default:  _headerSize += 0; break; /* no more header-bytes needed; the payload-size is just the lower bits of _headerBytes[1] */
-                     }
-                     if (maskBit) _headerSize += 4;
-
-                     if (_headerSize == 2) MRETURN_ON_ERROR(InitializeIncomingPayload(_headerBytes[1]&0x7F, -1, receiver));  // no further header-bytes to read, so get ready to receive payload bytes
-                  }
-                  break;
-
-                  // note that the no-mask variant of this case is handled at the end of "case 2" above
-                  case 6: // 2-byte header-size + 0-byte-payload-size + 4-byte-mask
-                     MRETURN_ON_ERROR(InitializeIncomingPayload(_headerBytes[1]&0x7F, 2, receiver));
-                  break;
+            readBytes += numBytesRead;
+            maxBytes  -= numBytesRead;
 
-                  case 4: // 2-byte header-size + 2-byte-payload-size + no-mask
-                     // fall-through
-                  case 8: // 2-byte header-size + 2-byte-payload-size + 4-byte-mask
-                     // MEM-142:  yes, the (uint16) cast is 100% necessary, or else any negative int16 values get sign-extended to 2^32-N !
-                     MRETURN_ON_ERROR(InitializeIncomingPayload((uint16) (B_BENDIAN_TO_HOST_INT16(muscleCopyIn<int16>(&_headerBytes[2]))), maskBit?4:-1, receiver));
-                  break;
-
-                  case 10:  // 2-byte header-size + 8-byte-payload-size + no-mask
-                     // fall through
-                  case 14:  // 2-byte header-size + 8-byte-payload-size + 4-byte-mask
-                  {
-                     const uint64 payloadSize = B_BENDIAN_TO_HOST_INT64(muscleCopyIn<uint64>(&_headerBytes[2]));
-                     if ((payloadSize & (1ULL<<63)) != 0)
-                     {
-                        LogTime(MUSCLE_LOG_ERROR, "WebSocketMessageIOGateway:  High bit was illegally set on payload word " UINT64_FORMAT_SPEC "\n", payloadSize);
-                        SetUnrecoverableErrorStatus(B_RESOURCE_LIMIT);
-                        return B_BAD_DATA;
-                     }
-                     else if (payloadSize > (10*1024*1024ULL))
-                     {
-                        LogTime(MUSCLE_LOG_ERROR, "WebSocketMessageIOGateway:  Payload size " UINT64_FORMAT_SPEC " is too large!\n", payloadSize);
-                        SetUnrecoverableErrorStatus(B_RESOURCE_LIMIT);
-                        return B_RESOURCE_LIMIT;
-                     }
-                     MRETURN_ON_ERROR(InitializeIncomingPayload((uint32) payloadSize, maskBit?10:-1, receiver));
-                  }
-                  break;
-
-                  default:
-                     LogTime(MUSCLE_LOG_ERROR, "WebSocketMessageIOGateway:  Unexpected header size " UINT32_FORMAT_SPEC "!\n", _headerSize);
-                     SetUnrecoverableErrorStatus(B_BAD_DATA);
-                     return B_BAD_DATA;
-               }
+            const status_t parseRet = ParseReceivedBytes(readBuf, numBytesRead, receiver);
+            if (parseRet.IsError())
+            {
+               SetUnrecoverableErrorStatus(parseRet);
+               return parseRet;
             }
          }
          else break;
@@ -409,9 +549,157 @@ io_status_t WebSocketMessageIOGateway :: DoInputImplementation(AbstractGatewayMe
    }
 
    FlushReceivedMessage(receiver);
+   ReleaseIdleCodecs();
    return ((ret.IsError())&&(readBytes == 0)) ? io_status_t(ret) : io_status_t(readBytes);
 }
 
+status_t WebSocketMessageIOGateway :: ParseReceivedBytes(const uint8 * bytes, uint32 numBytes, AbstractGatewayMessageReceiver & receiver)
+{
+   while(numBytes > 0)
+   {
+      uint32 numBytesUsed;
+      if (_headerBytesReceived < _headerSize)
+      {
+         numBytesUsed = muscleMin(numBytes, _headerSize-_headerBytesReceived);
+         memcpy(&_headerBytes[_headerBytesReceived], bytes, numBytesUsed);
+         _headerBytesReceived += numBytesUsed;
+         if (_headerBytesReceived == _headerSize) MRETURN_ON_ERROR(HandleReceivedHeaderBytes(receiver));
+      }
+      else if (_payload())
+      {
+         // Copy and unmask the payload bytes in a single pass
+         numBytesUsed = muscleMin(numBytes, _payload()->GetNumBytes()-_payloadBytesRead);
+         HandleReceivedPayloadBytes(bytes, numBytesUsed, receiver);
+      }
+      else
+      {
+         LogTime(MUSCLE_LOG_ERROR, "WebSocketMessageIOGateway:  Can't receive payload, no _payload buffer is present!\n");
+         return B_LOGIC_ERROR;
+      }
+
+      bytes    += numBytesUsed;
+      numBytes -= numBytesUsed;
+   }
+   return B_NO_ERROR;
+}
+
+void WebSocketMessageIOGateway :: HandleReceivedPayloadBytes(const uint8 * srcBytes, uint32 numBytes, AbstractGatewayMessageReceiver & receiver)
+{
+   uint8 * dstBytes = _payload()->GetBuffer()+_payloadBytesRead;
+        if (_isClient == false) ApplyMask(_mask, _payloadBytesRead-_firstByteToMask, srcBytes, dstBytes, numBytes);  // clients should never receive masked frames anyway
+   else if (srcBytes != dstBytes) memcpy(dstBytes, srcBytes, numBytes);
+
+   _payloadBytesRead += numBytes;
+   if (_payloadBytesRead == _payload()->GetNumBytes())
+   {
+      // If FIN is set, we'll execute this frame and clear it; otherwise we'll append the next frame's data to this one's.
+      if ((_inputClosed)||(_headerBytes[0] & 0x80)) ExecuteReceivedFrame(receiver);
+      ResetHeaderReceiveState();
+   }
+}
+
+status_t WebSocketMessageIOGateway :: HandleReceivedHeaderBytes(AbstractGatewayMessageReceiver & receiver)
+{
+   const bool maskBit = ((_headerBytes[1] & 0x80) != 0);
+   switch(_headerSize)
+   {
+      case 2:  // initial header-bytes read (we'll use the contents of these two bytes to determine the actual header-size)
+      {
+         const bool peerIsServer = _isClient;  // just for code clarity
+         const char * peerDesc   = peerIsServer ? "server" : "client";
+
+         const uint8 opCode = _headerBytes[0] & 0x0F;
+         const bool isCompressedMessageStart = ((_deflateActive)&&(_payload() == NULL)&&((opCode == WS_OPCODE_TEXT)||(opCode == WS_OPCODE_BINARY)));  // RFC 7692 section 6:  RSV1 may be set only on the first frame of a data message
+         if ((_headerBytes[0] & 0x70) != ((isCompressedMessageStart)&&(_headerBytes[0] & 0x40) ? 0x40 : 0x00))
+         {
+            LogTime(MUSCLE_LOG_ERROR, "WebSocketMessageIOGateway:  Frame from %s had reserved bits set!  %x\n", peerDesc, _headerBytes[0]);
+            return B_BAD_DATA;
+         }
+
+         if (peerIsServer ? (maskBit != 0) : (maskBit == 0))  // RFC 6455:  clients MUST send us masked frames; servers MUST NOT send us masked frames.  Check incoming frames accordingly.
+         {
+            LogTime(MUSCLE_LOG_ERROR, "WebSocketMessageIOGateway::HandleReceivedHeaderBytes():  Frame from %s %s its mask bit set! (%x)\n", peerDesc, peerIsServer ? "had" : "didn't have", _headerBytes[1]);
+            return B_BAD_DATA;
+         }
+
+         switch(_headerBytes[1] & 0x7F)
+         {
+            case 126: _headerSize += 2; break; /* need to read 2 more header-bytes to find out the payload-size */
+            case 127: _headerSize += 8; break; /* need to read 8 more header-bytes to find out the payload-size */
+            default:  _headerSize += 0; break; /* no more header-bytes needed; the payload-size is just the lower bits of _headerBytes[1] */
+         }
+         if (maskBit) _headerSize += 4;
+
+         if (_headerSize == 2) return InitializeIncomingPayload(_headerBytes[1]&0x7F, -1, receiver);  // no further header-bytes to read, so get ready to receive payload bytes
+      }
+      break;
+
+      // note that the no-mask variant of this case is handled at the end of "case 2" above
+      case 6: // 2-byte header-size + 0-byte-payload-size + 4-byte-mask
+         return InitializeIncomingPayload(_headerBytes[1]&0x7F, 2, receiver);
+
+      case 4: // 2-byte header-size + 2-byte-payload-size + no-mask
+         // fall-through
+      case 8: // 2-byte header-size + 2-byte-payload-size + 4-byte-mask
+         // MEM-142:  yes, the (uint16) cast is 100% necessary, or else any negative int16 values get sign-extended to 2^32-N !
+         return InitializeIncomingPayload((uint16) (B_BENDIAN_TO_HOST_INT16(muscleCopyIn<int16>(&_headerBytes[2]))), maskBit?4:-1, receiver);
+
+      case 10:  // 2-byte header-size + 8-byte-payload-size + no-mask
+         // fall through
+      case 14:  // 2-byte header-size + 8-byte-payload-size + 4-byte-mask
+      {
+         const uint64 payloadSize = B_BENDIAN_TO_HOST_INT64(muscleCopyIn<uint64>(&_headerBytes[2]));
+         if ((payloadSize & (1ULL<<63)) != 0)
+         {
+            LogTime(MUSCLE_LOG_ERROR, "WebSocketMessageIOGateway:  High bit was illegally set on payload word " UINT64_FORMAT_SPEC "\n", payloadSize);
+            return B_BAD_DATA;
+         }
+         else if (payloadSize > MAX_WEBSOCKET_PAYLOAD_BYTES)
+         {
+            LogTime(MUSCLE_LOG_ERROR, "WebSocketMessageIOGateway:  Payload size " UINT64_FORMAT_SPEC " is too large!\n", payloadSize);
+            return B_RESOURCE_LIMIT;
+         }
+         return InitializeIncomingPayload((uint32) payloadSize, maskBit?10:-1, receiver);
+      }
+
+      default:
+         LogTime(MUSCLE_LOG_ERROR, "WebSocketMessageIOGateway:  Unexpected header size " UINT32_FORMAT_SPEC "!\n", _headerSize);
+         return B_BAD_DATA;
+   }
+   return B_NO_ERROR;
+}
+
+void WebSocketMessageIOGateway :: ApplyMask(const uint8 * mask, uint32 maskPhase, const uint8 * inBytes, uint8 * outBytes, uint32 numBytes)
+{
+   // Rotate the mask so that rotatedMask[0] lines up with inBytes[0]; then every block below starts at a multiple of 4 bytes
+   uint8 rotatedMask[16];
+   for (uint32 i=0; i<sizeof(rotatedMask); i++) rotatedMask[i] = mask[(i+maskPhase)%4];
+
+   uint32 i = 0;
+#ifdef MUSCLE_USE_AVX2
+   {
+      const __m256i m = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(rotatedMask)));
+      for (; (i+32)<=numBytes; i+=32) _mm256_storeu_si256(reinterpret_cast<__m256i *>(outBytes+i), _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(inBytes+i)), m));
+   }
+#endif
+#if defined(MUSCLE_USE_SSE2)
+   {
+      const __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rotatedMask));
+      for (; (i+16)<=numBytes; i+=16) _mm_storeu_si128(reinterpret_cast<__m128i *>(outBytes+i), _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(inBytes+i)), m));
+   }
+#elif defined(MUSCLE_USE_NEON)
+   {
+      const uint8x16_t m = vld1q_u8(rotatedMask);
+      for (; (i+16)<=numBytes; i+=16) vst1q_u8(outBytes+i, veorq_u8(vld1q_u8(inBytes+i), m));
+   }
+#endif
+   {
+      const uint64 m = muscleCopyIn<uint64>(rotatedMask);
+      for (; (i+8)<=numBytes; i+=8) muscleCopyOut(outBytes+i, muscleCopyIn<uint64>(inBytes+i)^m);
+   }
+   for (; i<numBytes; i++) outBytes[i] = inBytes[i]^rotatedMask[i%4];
+}
+
 void WebSocketMessageIOGateway :: FlushReceivedMessage(AbstractGatewayMessageReceiver & receiver)
 {
    if (_receivedMsg())
@@ -535,11 +823,29 @@ io_status_t WebSocketMessageIOGateway :: DoOutputImplementation(uint32 maxBytes)
       }
    }
 
+   ReleaseIdleCodecs();
    return io_status_t(totalBytesWritten);
 }
 
 status_t WebSocketMessageIOGateway :: CreateReplyFrame(const uint8 * data, uint32 numBytes, uint8 opCode)
 {
+   uint8 rsv1Bit = 0x00;
+#ifdef MUSCLE_ENABLE_ZLIB_ENCODING
+   if ((_deflateActive)&&((opCode == WS_OPCODE_TEXT)||(opCode == WS_OPCODE_BINARY))&&(numBytes >= _deflateMinBytes))
+   {
+      if (_outgoingCodec() == NULL) _outgoingCodec.SetRef(newnothrow ZLibCodec(_deflateCompressionLevel, _outgoingWindowBits, _deflateMemLevel));
+      MRETURN_OOM_ON_NULL(_outgoingCodec());
+      MRETURN_ON_ERROR(_outgoingCodec()->DeflateRaw(data, numBytes, _outgoingNoContextTakeover, _scratchDeflateBuf));
+
+      const uint32 numDeflatedBytes = _scratchDeflateBuf.GetNumBytes();
+      if ((numDeflatedBytes >= sizeof(WS_SYNC_FLUSH_TRAILER))&&(memcmp(_scratchDeflateBuf.GetBuffer()+numDeflatedBytes-sizeof(WS_SYNC_FLUSH_TRAILER), WS_SYNC_FLUSH_TRAILER, sizeof(WS_SYNC_FLUSH_TRAILER)) == 0)) MRETURN_ON_ERROR(_scratchDeflateBuf.SetNumBytes(numDeflatedBytes-sizeof(WS_SYNC_FLUSH_TRAILER), true));
+
+      data     = _scratchDeflateBuf.GetBuffer();
+      numBytes = _scratchDeflateBuf.GetNumBytes();
+      rsv1Bit  = 0x40;  // RFC 7692 section 6:  RSV1 indicates a compressed message
+   }
+#endif
+
    uint32 frameSize = 2+numBytes;
 
         if (numBytes > 65535) frameSize += 8;  // oops, we need the 8-byte-payload field
@@ -555,7 +861,7 @@ status_t WebSocketMessageIOGateway :: CreateReplyFrame(const uint8 * data, uint3
 
    const uint8 maskBit = _isClient ? 0x80 : 0x00;
 
-   flat.WriteInt8(0x80 | opCode);  // 0x80 == FIN bit
+   flat.WriteInt8(0x80 | rsv1Bit | opCode);  // 0x80 == FIN bit
    if (numBytes > 65535)
    {
       flat.WriteInt8(maskBit | ((uint8)127)); // magic number for 8-byte payload
@@ -574,12 +880,9 @@ status_t WebSocketMessageIOGateway :: CreateReplyFrame(const uint8 * data, uint3
       const uint32 mask = GetInsecurePseudoRandomNumber32();
       flat.WriteInt32(mask);
 
-      const uint8 * mask8 = reinterpret_cast<const uint8 *>(&mask);
-      MRETURN_ON_ERROR(_scratchMaskBuf.SetNumBytes(numBytes, false));
-      uint8 * payloadBytes = _scratchMaskBuf.GetBuffer();
-      for (uint32 i=0; i<numBytes; i++) payloadBytes[i] = data[i] ^ mask8[i%sizeof(mask)];
-      flat.WriteBytes(payloadBytes, numBytes);
-      _scratchMaskBuf.Clear();
+      uint8 * payloadBytes = flat.GetCurrentWritePointer();
+      ApplyMask(payloadBytes-sizeof(mask), 0, data, payloadBytes, numBytes);  // mask with the bytes exactly as they appear on the wire, since that's what the server will unmask with
+      (void) flat.SeekRelative((int32) numBytes);
    }
    else flat.WriteBytes(data, numBytes);  // servers always send unmasked data to the client
 
@@ -591,7 +894,11 @@ status_t WebSocketMessageIOGateway :: InitializeIncomingPayload(uint32 payloadSi
    if (payloadSizeBytes == 0)
    {
       // Special case for when there is no payload to receive
-      if (_payload() == NULL) _opCode = _headerBytes[0] & 0x0F;
+      if (_payload() == NULL)
+      {
+         _opCode              = _headerBytes[0] & 0x0F;
+         _payloadIsCompressed = ((_headerBytes[0] & 0x40) != 0);
+      }
       if (_headerBytes[0] & 0x80) ExecuteReceivedFrame(receiver);
       ResetHeaderReceiveState();
       return B_NO_ERROR;
@@ -600,6 +907,7 @@ status_t WebSocketMessageIOGateway :: InitializeIncomingPayload(uint32 payloadSi
    {
       if (optMaskOffset >= 0) memcpy(&_mask, &_headerBytes[optMaskOffset], sizeof(_mask));
                          else memset(&_mask, 0, sizeof(_mask));  // not really necessary but just to be tidy
+      _firstByteToMask = _payloadBytesRead;  // the mask-phase restarts at the beginning of each frame's payload
       if (_payload())
       {
          // don't change _opCode if we are merely extending a fragment...
@@ -607,8 +915,9 @@ status_t WebSocketMessageIOGateway :: InitializeIncomingPayload(uint32 payloadSi
       }
       else
       {
-         _opCode  = _headerBytes[0] & 0x0F;
-         _payload = GetByteBufferFromPool(payloadSizeBytes);
+         _opCode              = _headerBytes[0] & 0x0F;
+         _payloadIsCompressed = ((_headerBytes[0] & 0x40) != 0);
+         _payload             = GetByteBufferFromPool(payloadSizeBytes);
       }
       return _payload() ? B_NO_ERROR : B_ERROR;
    }
@@ -616,6 +925,17 @@ status_t WebSocketMessageIOGateway :: InitializeIncomingPayload(uint32 payloadSi
 
 void WebSocketMessageIOGateway :: ExecuteReceivedFrame(AbstractGatewayMessageReceiver & receiver)
 {
+   if ((_inputClosed == false)&&(_payloadIsCompressed))
+   {
+      const status_t ret = InflateReceivedPayload();
+      if (ret.IsError())
+      {
+         LogTime(MUSCLE_LOG_ERROR, "WebSocketMessageIOGateway::ExecuteReceivedFrame():  %p couldn't inflate a compressed " UINT32_FORMAT_SPEC "-byte payload [%s]\n", this, _payload()?_payload()->GetNumBytes():0, ret());
+         SetUnrecoverableErrorStatus(ret);
+         _inputClosed = true;  // no point trying to parse anything else
+      }
+   }
+
    if (_inputClosed == false)
    {
       const uint8 * payloadBytes = _payload() ? _payload()->GetBuffer()   : NULL;
@@ -698,9 +1018,10 @@ void WebSocketMessageIOGateway :: ExecuteReceivedFrame(AbstractGatewayMessageRec
    }
 
    _payload.Reset();
-   _opCode           = 0;
-   _payloadBytesRead = 0;
-   _firstByteToMask  = 0;
+   _opCode              = 0;
+   _payloadBytesRead    = 0;
+   _firstByteToMask     = 0;
+   _payloadIsCompressed = false;
 }
 
 }  // end namespace muscle
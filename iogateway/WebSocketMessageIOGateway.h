@@ -4,6 +4,7 @@
 #include "iogateway/AbstractMessageIOGateway.h"
 #include "regex/StringMatcher.h"
 #include "util/ByteBuffer.h"
+#include "zlib/ZLibCodec.h"
 
 namespace muscle {
 
@@ -59,6 +60,39 @@ public:
      */
    const AbstractMessageIOGatewayRef & GetSlaveGateway() const {return _slaveGateway;}
 
+   /** Enables or disables support for the permessage-deflate WebSocket extension (RFC 7692), which compresses the payload
+     * of each outgoing text or binary message, and decompresses incoming ones.  When enabled, a client-side gateway will offer
+     * the extension in its handshake request, and a server-side gateway will accept a client's offer of it.  Disabled by default.
+     * @param enable true to enable permessage-deflate negotiation, or false to disable it.
+     * @param compressionLevel the zlib compression level (0-9) to use when compressing outgoing messages.  Defaults to 6.
+     * @param maxWindowBits base-2 logarithm of the largest LZ77 window (9-15) that we will allow either side of the connection to
+     *                      use.  Smaller windows use less RAM but compress less well.  Defaults to 15 (i.e. a 32KB window).
+     * @param memLevel the zlib memLevel (1-9) to use when compressing outgoing messages.  Defaults to 8.
+     * @param noContextTakeover if true, we'll ask that both sides compress each message independently of previous ones.
+     *                          That lowers the compression ratio, but it lets the gateway free its zlib state whenever the
+     *                          connection goes idle.  Defaults to false.
+     * @param minBytesToCompress outgoing payloads smaller than this many bytes will be sent uncompressed.  Defaults to 64.
+     * @note this method must be called before the HTTP handshake begins, or it will have no effect.
+     * @note when compression context is being retained, the gateway's zlib state uses roughly (1<<(maxWindowBits+2))+(1<<(memLevel+9))
+     *       bytes of RAM for outgoing messages, plus (1<<maxWindowBits)+7KB for incoming messages, for the lifetime of the connection.
+     *       Reducing (maxWindowBits) and (memLevel) is therefore the way to cap the per-connection memory cost of compression.
+     */
+   void SetPerMessageDeflateSettings(bool enable, int compressionLevel = 6, uint32 maxWindowBits = 15, uint32 memLevel = 8, bool noContextTakeover = false, uint32 minBytesToCompress = 64);
+
+   /** Returns true iff the permessage-deflate extension was successfully negotiated during the HTTP handshake. */
+   bool IsPerMessageDeflateActive() const {return _deflateActive;}
+
+   /** Applies (or removes -- it's the same operation) a WebSocket frame-mask to a span of payload bytes, as described in RFC 6455 section 5.3.
+     * Uses SSE2, AVX2 or NEON instructions when they are available, and a word-at-a-time loop otherwise.
+     * @param mask the 4-byte masking-key, as it appeared in the frame header.
+     * @param maskPhase the offset of (inBytes[0]) relative to the start of the frame's payload.  Only the lowest two bits of this value are used.
+     * @param inBytes pointer to the bytes to read.
+     * @param outBytes pointer to the location to write the masked bytes to.  May be equal to (inBytes) to mask in-place,
+     *                 but otherwise the two ranges must not overlap.
+     * @param numBytes the number of bytes to process.
+     */
+   static void ApplyMask(const uint8 * mask, uint32 maskPhase, const uint8 * inBytes, uint8 * outBytes, uint32 numBytes);
+
 protected:
    virtual io_status_t DoInputImplementation(AbstractGatewayMessageReceiver & receiver, uint32 maxBytes = MUSCLE_NO_LIMIT);
    virtual io_status_t DoOutputImplementation(uint32 maxBytes);
@@ -72,8 +106,15 @@ private:
    };
 
    status_t HandleReceivedHTTPText();
+   status_t HandleReceivedExtensionsHeader(const String & extensionsStr, String & retResponseStr);
+   void UpdateClientHandshakeRequest();
+   status_t InflateReceivedPayload();
+   void ReleaseIdleCodecs();
    status_t CreateReplyFrame(const uint8 * data, uint32 numBytes, uint8 opCode);
    status_t InitializeIncomingPayload(uint32 payloadSizeBytes, int32 optMaskOffset, AbstractGatewayMessageReceiver & receiver);
+   status_t HandleReceivedHeaderBytes(AbstractGatewayMessageReceiver & receiver);
+   status_t ParseReceivedBytes(const uint8 * bytes, uint32 numBytes, AbstractGatewayMessageReceiver & receiver);
+   void HandleReceivedPayloadBytes(const uint8 * srcBytes, uint32 numBytes, AbstractGatewayMessageReceiver & receiver);
    void ExecuteReceivedFrame(AbstractGatewayMessageReceiver & receiver);
    void FlushReceivedMessage(AbstractGatewayMessageReceiver & receiver);
    void ResetHeaderReceiveState();
@@ -96,7 +137,7 @@ private:
    uint32 _headerSize;
 
    ByteBufferRef _payload;
-   uint32 _firstByteToMask;
+   uint32 _firstByteToMask;  // offset within (_payload) where the current frame's (masked) payload-bytes begin
    uint32 _payloadBytesRead;
    uint8 _mask[4];
    uint8 _opCode;
@@ -109,7 +150,26 @@ private:
    AbstractMessageIOGatewayRef _slaveGateway;
    ByteBuffer _scratchSlaveBuf;
 
-   ByteBuffer _scratchMaskBuf;
+   // permessage-deflate settings, as specified by the user
+   bool _deflateEnabled;
+   int _deflateCompressionLevel;
+   uint8 _deflateMaxWindowBits;
+   uint8 _deflateMemLevel;
+   bool _deflateNoContextTakeover;
+   uint32 _deflateMinBytes;
+
+   // permessage-deflate state, as negotiated during the handshake
+   bool _deflateActive;
+   uint8 _outgoingWindowBits;
+   uint8 _incomingWindowBits;
+   bool _outgoingNoContextTakeover;
+   bool _incomingNoContextTakeover;
+   bool _payloadIsCompressed;  // true iff the RSV1 bit was set on the first frame of the message we're currently receiving
+#ifdef MUSCLE_ENABLE_ZLIB_ENCODING
+   ZLibCodecRef _outgoingCodec;  // demand-allocated
+   ZLibCodecRef _incomingCodec;  // demand-allocated
+   ByteBuffer _scratchDeflateBuf;
+#endif
 };
 DECLARE_REFTYPES(WebSocketMessageIOGateway);
 
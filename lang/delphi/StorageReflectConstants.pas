@@ -140,8 +140,8 @@ const
     /// Reserved for future expansion */
     PR_COMMAND_RESERVED20        = 558916427;
 
-    /// Reserved for future expansion */
-    PR_COMMAND_RESERVED21        = 558916428;
+    /// Returns traffic statistics for every session on the server (Requires privilege)
+    PR_COMMAND_GETSESSIONSTATS   = 558916428;
 
     /// Reserved for future expansion */
     PR_COMMAND_RESERVED22        = 558916429;
@@ -196,8 +196,8 @@ const
     /// Reserved for future expansion
     PR_RESULT_RESERVED8          = 558920251;
 
-    /// Reserved for future expansion
-    PR_RESULT_RESERVED9          = 558920252;
+    /// Reply to a PR_COMMAND_GETSESSIONSTATS message
+    PR_RESULT_SESSIONSTATS       = 558920252;
 
     /// Reserved for future expansion
     PR_RESULT_RESERVED10         = 558920253;
@@ -262,8 +262,16 @@ const
     /// other clients from the MUSCLE server
     PR_PRIVILEGE_REMOVEBANS      = 2;
 
+    /// Privilege bit, indicates that the client has all privileges
+    /// (this value must never change)
+    PR_PRIVILEGE_ALL             = 3;
+
+    /// Privilege bit, indicates that the client is allowed to retrieve
+    /// other clients' traffic statistics from the MUSCLE server
+    PR_PRIVILEGE_GETSTATS        = 4;
+
     /// Number of defined privilege bits
-    PR_NUM_PRIVILEGES            = 3;
+    PR_NUM_PRIVILEGES            = 5;
 
     /// Op-code that indicates that an entry was inserted at the
     /// given slot index, with the given ID
@@ -90,8 +90,8 @@ public interface StorageReflectConstants
    /** Reserved for future expansion */
    public static final int PR_COMMAND_RESERVED20        = 558916427;
 
-   /** Reserved for future expansion */
-   public static final int PR_COMMAND_RESERVED21        = 558916428;
+   /** Returns traffic statistics for every session on the server (Requires privilege) */
+   public static final int PR_COMMAND_GETSESSIONSTATS   = 558916428;
 
    /** Reserved for future expansion */
    public static final int PR_COMMAND_RESERVED22        = 558916429;
@@ -144,8 +144,8 @@ public interface StorageReflectConstants
    /** Reserved for future expansion */
    public static final int PR_RESULT_RESERVED8          = 558920251;
 
-   /** Reserved for future expansion */
-   public static final int PR_RESULT_RESERVED9          = 558920252;
+   /** Reply to a PR_COMMAND_GETSESSIONSTATS message */
+   public static final int PR_RESULT_SESSIONSTATS       = 558920252;
 
    /** Reserved for future expansion */
    public static final int PR_RESULT_RESERVED10         = 558920253;
@@ -207,8 +207,14 @@ public interface StorageReflectConstants
    /** Privilege bit, indicates that the client is allowed to unban other clients from the MUSCLE server */
    public static final int PR_PRIVILEGE_REMOVEBANS      = 2;
 
+   /** Privilege bit, indicates that the client has all privileges (this value must never change) */
+   public static final int PR_PRIVILEGE_ALL             = 3;
+
+   /** Privilege bit, indicates that the client is allowed to retrieve other clients' traffic statistics from the MUSCLE server */
+   public static final int PR_PRIVILEGE_GETSTATS        = 4;
+
    /** Number of defined privilege bits */
-   public static final int PR_NUM_PRIVILEGES            = 3;
+   public static final int PR_NUM_PRIVILEGES            = 5;
 
    /** Op-code that indicates that an entry was inserted at the given slot index, with the given ID */
    public static final char INDEX_OP_ENTRYINSERTED = 'i';
@@ -432,6 +438,12 @@ public interface StorageReflectConstants
 //    the server again.  Of course, this will only be done if the client who sent the
 //    PR_COMMAND_REMOVEBANS field has PR_PRIVILEGE_REMOVEBANS access.
 //
+// if 'what' is PR_COMMAND_GETSESSIONSTATS:
+//    The server will send back a PR_RESULT_SESSIONSTATS message containing the traffic
+//    statistics of every session currently on the server.  Of course, this will only be
+//    done if the client who sent the PR_COMMAND_GETSESSIONSTATS message has
+//    PR_PRIVILEGE_GETSTATS access.
+//
 // if 'what' is PR_COMMAND_RESERVED_*:
 //    The server will change the 'what' code of your message to PR_RESULT_UNIMPLEMENTED,
 //    and send it back to your client.
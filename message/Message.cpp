@@ -36,6 +36,7 @@ const ConstMessageRef & GetEmptyMessageRef() {return _emptyMsgRef;}
 
 MessageRef GetMessageFromPool(uint32 what)
 {
+   DECLARE_MEMORY_TAG_GUARD(MUSCLE_MEMORY_TAG_MESSAGES);
    MessageRef ref(_messagePool.ObtainObject());
    if (ref())
    {
@@ -47,6 +48,7 @@ MessageRef GetMessageFromPool(uint32 what)
 
 MessageRef GetMessageFromPool(const Message & copyMe)
 {
+   DECLARE_MEMORY_TAG_GUARD(MUSCLE_MEMORY_TAG_MESSAGES);
    MessageRef ref(_messagePool.ObtainObject());
    if (ref())
    {
@@ -58,6 +60,7 @@ MessageRef GetMessageFromPool(const Message & copyMe)
 
 MessageRef GetMessageFromPool(const uint8 * flatBytes, uint32 numBytes)
 {
+   DECLARE_MEMORY_TAG_GUARD(MUSCLE_MEMORY_TAG_MESSAGES);
    MessageRef ref(_messagePool.ObtainObject());
    if (ref())
    {
@@ -69,6 +72,7 @@ MessageRef GetMessageFromPool(const uint8 * flatBytes, uint32 numBytes)
 
 MessageRef GetMessageFromPool(ObjectPool<Message> & pool, uint32 what)
 {
+   DECLARE_MEMORY_TAG_GUARD(MUSCLE_MEMORY_TAG_MESSAGES);
    MessageRef ref(pool.ObtainObject());
    if (ref())
    {
@@ -80,6 +84,7 @@ MessageRef GetMessageFromPool(ObjectPool<Message> & pool, uint32 what)
 
 MessageRef GetMessageFromPool(ObjectPool<Message> & pool, const Message & copyMe)
 {
+   DECLARE_MEMORY_TAG_GUARD(MUSCLE_MEMORY_TAG_MESSAGES);
    MessageRef ref(pool.ObtainObject());
    if (ref())
    {
@@ -91,6 +96,7 @@ MessageRef GetMessageFromPool(ObjectPool<Message> & pool, const Message & copyMe
 
 MessageRef GetMessageFromPool(ObjectPool<Message> & pool, const uint8 * flatBytes, uint32 numBytes)
 {
+   DECLARE_MEMORY_TAG_GUARD(MUSCLE_MEMORY_TAG_MESSAGES);
    MessageRef ref(pool.ObtainObject());
    if (ref())
    {
@@ -102,6 +108,7 @@ MessageRef GetMessageFromPool(ObjectPool<Message> & pool, const uint8 * flatByte
 
 MessageRef GetLightweightCopyOfMessageFromPool(const Message & copyMe)
 {
+   DECLARE_MEMORY_TAG_GUARD(MUSCLE_MEMORY_TAG_MESSAGES);
    MessageRef ref(_messagePool.ObtainObject());
    if (ref())
    {
@@ -113,6 +120,7 @@ MessageRef GetLightweightCopyOfMessageFromPool(const Message & copyMe)
 
 MessageRef GetLightweightCopyOfMessageFromPool(ObjectPool<Message> & pool, const Message & copyMe)
 {
+   DECLARE_MEMORY_TAG_GUARD(MUSCLE_MEMORY_TAG_MESSAGES);
    MessageRef ref(pool.ObtainObject());
    if (ref())
    {
@@ -1109,6 +1117,8 @@ const MessageField * Message :: GetMessageFieldAndTypeCode(const String & fieldN
 
 status_t Message :: GetOrCreateMessageField(const String & fieldName, uint32 tc, MessageField * & retPtr)
 {
+   DECLARE_MEMORY_TAG_GUARD(MUSCLE_MEMORY_TAG_MESSAGES);
+
    retPtr = GetMessageField(fieldName, tc);
    if (retPtr) return B_NO_ERROR;
 
@@ -1223,6 +1233,7 @@ bool Message :: BytesMightContainFlattenedMessage(const uint8 * bytes, uint32 nu
 status_t Message :: Unflatten(DataUnflattener & unflat)
 {
    TCHECKPOINT;
+   DECLARE_MEMORY_TAG_GUARD(MUSCLE_MEMORY_TAG_MESSAGES);
 
    const uint32 messageProtocolVersion = unflat.ReadInt32();
    if (muscleInRange(messageProtocolVersion, (uint32)OLDEST_SUPPORTED_PROTOCOL_VERSION, (uint32)CURRENT_PROTOCOL_VERSION) == false)
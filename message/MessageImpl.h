@@ -168,14 +168,14 @@ public:
    status_t Unflatten(DataUnflattener & unflat);
 
    // Pseudo-AbstractDataArray interface
-   status_t AddDataItem(const void * data, uint32 numBytes) {return HasArray() ? GetArray()->AddDataItem(data, numBytes) : SingleAddDataItem(data, numBytes);}
+   status_t AddDataItem(const void * data, uint32 numBytes) {DECLARE_MEMORY_TAG_GUARD(MUSCLE_MEMORY_TAG_MESSAGES); return HasArray() ? GetArray()->AddDataItem(data, numBytes) : SingleAddDataItem(data, numBytes);}
    status_t RemoveDataItem(uint32 index) {return HasArray() ? GetArray()->RemoveDataItem(index) : SingleRemoveDataItem(index);}
-   status_t PrependDataItem(const void * data, uint32 numBytes) {return HasArray() ? GetArray()->PrependDataItem(data, numBytes) : SinglePrependDataItem(data, numBytes);}
+   status_t PrependDataItem(const void * data, uint32 numBytes) {DECLARE_MEMORY_TAG_GUARD(MUSCLE_MEMORY_TAG_MESSAGES); return HasArray() ? GetArray()->PrependDataItem(data, numBytes) : SinglePrependDataItem(data, numBytes);}
    void Clear();
    void Normalize() {if (HasArray()) GetArray()->Normalize();}
    void Sort(uint32 from, uint32 to) {if (HasArray()) GetArray()->Sort(from, to);}
    status_t FindDataItem(uint32 index, const void ** setDataLoc) const {return HasArray() ? GetArray()->FindDataItem(index, setDataLoc) : SingleFindDataItem(index, setDataLoc);}
-   status_t ReplaceDataItem(uint32 index, const void * data, uint32 numBytes) {return HasArray() ? GetArray()->ReplaceDataItem(index, data, numBytes) : SingleReplaceDataItem(index, data, numBytes);}
+   status_t ReplaceDataItem(uint32 index, const void * data, uint32 numBytes) {DECLARE_MEMORY_TAG_GUARD(MUSCLE_MEMORY_TAG_MESSAGES); return HasArray() ? GetArray()->ReplaceDataItem(index, data, numBytes) : SingleReplaceDataItem(index, data, numBytes);}
    MUSCLE_NODISCARD uint32 GetItemSize(uint32 index) const {return HasArray() ? GetArray()->GetItemSize(index) : SingleGetItemSize(index);}
    MUSCLE_NODISCARD uint32 GetNumItems() const {return (_state == FIELD_STATE_EMPTY) ? 0 : (HasArray() ? GetArray()->GetNumItems() : 1);}
    MUSCLE_NODISCARD int32 GetLastValidIndex() const {return ((int32)GetNumItems())-1;}
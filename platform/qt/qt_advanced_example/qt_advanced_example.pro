@@ -29,6 +29,7 @@ MUSCLE_SOURCES = $$MUSCLE_DIR/dataio/FileDataIO.cpp                   \
                  $$MUSCLE_DIR/platform/qt/QMessageTransceiverThread.cpp \
                  $$MUSCLE_DIR/reflector/AbstractReflectSession.cpp    \
                  $$MUSCLE_DIR/reflector/DataNode.cpp                  \
+                 $$MUSCLE_DIR/util/InternedString.cpp                 \
                  $$MUSCLE_DIR/reflector/DumbReflectSession.cpp        \
                  $$MUSCLE_DIR/reflector/SignalHandlerSession.cpp      \
                  $$MUSCLE_DIR/reflector/StorageReflectSession.cpp     \
@@ -44,6 +45,7 @@ MUSCLE_SOURCES = $$MUSCLE_DIR/dataio/FileDataIO.cpp                   \
                  $$MUSCLE_DIR/system/SetupSystem.cpp                  \
                  $$MUSCLE_DIR/system/SignalMultiplexer.cpp            \
                  $$MUSCLE_DIR/system/StackTrace.cpp                   \
+                 $$MUSCLE_DIR/system/SystemInfo.cpp                   \
                  $$MUSCLE_DIR/system/Thread.cpp                       \
                  $$MUSCLE_DIR/util/ByteBuffer.cpp                     \
                  $$MUSCLE_DIR/util/Directory.cpp                      \
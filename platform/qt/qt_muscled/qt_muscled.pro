@@ -24,6 +24,7 @@ SOURCES += $$MUSCLE_DIR/message/Message.cpp \
         $$MUSCLE_DIR/iogateway/MessageIOGateway.cpp \
         $$MUSCLE_DIR/iogateway/AbstractMessageIOGateway.cpp \
         $$MUSCLE_DIR/iogateway/PlainTextMessageIOGateway.cpp \
+        $$MUSCLE_DIR/iogateway/CaptureIOGateway.cpp \
         $$MUSCLE_DIR/dataio/ChildProcessDataIO.cpp \
         $$MUSCLE_DIR/dataio/FileDataIO.cpp \
         $$MUSCLE_DIR/dataio/TCPSocketDataIO.cpp \
@@ -42,9 +43,11 @@ SOURCES += $$MUSCLE_DIR/message/Message.cpp \
         $$MUSCLE_DIR/reflector/StorageReflectSession.cpp \
         $$MUSCLE_DIR/reflector/DumbReflectSession.cpp \
         $$MUSCLE_DIR/reflector/DataNode.cpp \
+        $$MUSCLE_DIR/util/InternedString.cpp \
         $$MUSCLE_DIR/reflector/ReflectServer.cpp \
         $$MUSCLE_DIR/reflector/FilterSessionFactory.cpp \
         $$MUSCLE_DIR/reflector/RateLimitSessionIOPolicy.cpp \
+        $$MUSCLE_DIR/reflector/FairShareSessionIOPolicy.cpp \
         $$MUSCLE_DIR/reflector/ServerComponent.cpp \
         $$MUSCLE_DIR/util/MemoryAllocator.cpp \
         $$MUSCLE_DIR/util/Directory.cpp \
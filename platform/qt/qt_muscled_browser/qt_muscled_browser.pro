@@ -33,6 +33,7 @@ SOURCES += \
         $$MUSCLE_DIR/system/SetupSystem.cpp \
         $$MUSCLE_DIR/system/MessageTransceiverThread.cpp \
         $$MUSCLE_DIR/system/StackTrace.cpp \
+        $$MUSCLE_DIR/system/SystemInfo.cpp \
         $$MUSCLE_DIR/system/Thread.cpp \
         $$MUSCLE_DIR/system/SignalMultiplexer.cpp \
         $$MUSCLE_DIR/system/GlobalMemoryAllocator.cpp \
@@ -47,9 +48,11 @@ SOURCES += \
         $$MUSCLE_DIR/reflector/StorageReflectSession.cpp \
         $$MUSCLE_DIR/reflector/DumbReflectSession.cpp \
         $$MUSCLE_DIR/reflector/DataNode.cpp \
+        $$MUSCLE_DIR/util/InternedString.cpp \
         $$MUSCLE_DIR/reflector/ReflectServer.cpp \
         $$MUSCLE_DIR/reflector/FilterSessionFactory.cpp \
         $$MUSCLE_DIR/reflector/RateLimitSessionIOPolicy.cpp \
+        $$MUSCLE_DIR/reflector/FairShareSessionIOPolicy.cpp \
         $$MUSCLE_DIR/reflector/ServerComponent.cpp \
         $$MUSCLE_DIR/util/MemoryAllocator.cpp \
         $$MUSCLE_DIR/util/Directory.cpp \
@@ -86,6 +86,12 @@ AbstractReflectSession()
    , _isExpendable(false)
    , _mostRecentInputTimeStamp(MUSCLE_TIME_NEVER)
    , _mostRecentOutputTimeStamp(MUSCLE_TIME_NEVER)
+   , _numBytesReceived(0)
+   , _numBytesSent(0)
+   , _numMessagesReceived(0)
+   , _numMessagesSent(0)
+   , _maxOutgoingQueueDepth(0)
+   , _totalCallbackTime(0)
 {
    char buf[64]; muscleSprintf(buf, UINT32_FORMAT_SPEC, _sessionID);
    _idString = buf;
@@ -128,7 +134,12 @@ AbstractReflectSession ::
 AddOutgoingMessage(const MessageRef & ref)
 {
    MASSERT(IsAttachedToServer(), "Can not call AddOutgoingMessage() while not attached to the server");
-   return _gateway() ? _gateway()->AddOutgoingMessage(ref) : B_BAD_OBJECT;
+   if (_gateway() == NULL) return B_BAD_OBJECT;
+
+   MRETURN_ON_ERROR(_gateway()->AddOutgoingMessage(ref));
+   _numMessagesSent++;
+   _maxOutgoingQueueDepth = muscleMax(_maxOutgoingQueueDepth, _gateway()->GetOutgoingMessageQueue().GetNumItems());
+   return B_NO_ERROR;
 }
 
 status_t
@@ -285,7 +296,7 @@ void AbstractReflectSession :: AsyncConnectCompleted()
 }
 
 void AbstractReflectSession :: SetInputPolicy(const AbstractSessionIOPolicyRef & newRef) {SetPolicyAux(_inputPolicyRef, _maxInputChunk, newRef, true);}
-void AbstractReflectSession :: SetOutputPolicy(const AbstractSessionIOPolicyRef & newRef) {SetPolicyAux(_outputPolicyRef, _maxOutputChunk, newRef, true);}
+void AbstractReflectSession :: SetOutputPolicy(const AbstractSessionIOPolicyRef & newRef) {SetPolicyAux(_outputPolicyRef, _maxOutputChunk, newRef, false);}
 void AbstractReflectSession :: SetPolicyAux(AbstractSessionIOPolicyRef & myRef, uint32 & chunk, const AbstractSessionIOPolicyRef & newRef, bool isInput)
 {
    TCHECKPOINT;
@@ -542,14 +553,9 @@ PrintSessionsInfo(const OutputPrinter & p) const
       uint64 numNodes = 0, numNodeBytes = 0;
       ars->TallySubscriberTablesInfo(numCachedSubscribersTables, numNodes, numNodeBytes);
 
-      uint64 numOutMessages = 0, numOutBytes = 0;
-      const AbstractMessageIOGateway * gw = ars->GetGateway()();
-      if (gw)
-      {
-         const Queue<MessageRef> & q = gw->GetOutgoingMessageQueue();
-         numOutMessages = q.GetNumItems();
-         for (uint32 i=0; i<numOutMessages; i++) if (q[i]()) numOutBytes += q[i]()->FlattenedSize();
-      }
+      uint32 numOutMessages;
+      uint64 numOutBytes;
+      ars->GetOutgoingQueueSize(numOutMessages, numOutBytes);
 
       String stateStr;
       if (ars->IsConnectingAsync()) stateStr = stateStr.WithAppendedWord("ConnectingAsync",  ", ");
@@ -562,7 +568,7 @@ PrintSessionsInfo(const OutputPrinter & p) const
       if (ars->GetMostRecentOutputTimeStamp() != MUSCLE_TIME_NEVER) stateStr = stateStr.WithAppendedWord(String("LastOutput: %1 ago").Arg(GetHumanReadableSignedTimeIntervalString(now-ars->GetMostRecentOutputTimeStamp(), 1)), ", ");
       if (stateStr.HasChars()) stateStr = stateStr.WithPrepend(", ");
 
-      p.printf("  Session [%s] (rfd=%i,wfd=%i) is [%s]:  (" UINT64_FORMAT_SPEC " outgoing Messages, " UINT64_FORMAT_SPEC " Message-bytes, " UINT32_FORMAT_SPEC " tables, " UINT64_FORMAT_SPEC " nodes, " UINT64_FORMAT_SPEC " node-bytes%s)\n", iter.GetKey()->Cstr(), ars->GetSessionReadSelectSocket().GetFileDescriptor(), ars->GetSessionWriteSelectSocket().GetFileDescriptor(), ars->GetSessionDescriptionString()(), numOutMessages, numOutBytes, numCachedSubscribersTables, numNodes, numNodeBytes, stateStr());
+      p.printf("  Session [%s] (rfd=%i,wfd=%i) is [%s]:  (" UINT32_FORMAT_SPEC " outgoing Messages, " UINT64_FORMAT_SPEC " Message-bytes, " UINT32_FORMAT_SPEC " tables, " UINT64_FORMAT_SPEC " nodes, " UINT64_FORMAT_SPEC " node-bytes%s)\n", iter.GetKey()->Cstr(), ars->GetSessionReadSelectSocket().GetFileDescriptor(), ars->GetSessionWriteSelectSocket().GetFileDescriptor(), ars->GetSessionDescriptionString()(), numOutMessages, numOutBytes, numCachedSubscribersTables, numNodes, numNodeBytes, stateStr());
       totalNumCachedSubscribersTables += numCachedSubscribersTables;
       totalNumOutMessages             += numOutMessages;
       totalNumOutBytes                += numOutBytes;
@@ -573,4 +579,42 @@ PrintSessionsInfo(const OutputPrinter & p) const
    p.printf("Totals: " UINT64_FORMAT_SPEC " outgoing Messages, " UINT64_FORMAT_SPEC " Message-bytes, " UINT64_FORMAT_SPEC " tables, " UINT64_FORMAT_SPEC " nodes, " UINT64_FORMAT_SPEC " node-bytes.\n", totalNumOutMessages, totalNumOutBytes, totalNumCachedSubscribersTables, totalNumNodes, totalNumNodeBytes);
 }
 
+void
+AbstractReflectSession ::
+GetOutgoingQueueSize(uint32 & retNumMessages, uint64 & retNumBytes) const
+{
+   retNumMessages = 0;
+   retNumBytes    = 0;
+
+   const AbstractMessageIOGateway * gw = GetGateway()();
+   if (gw)
+   {
+      const Queue<MessageRef> & q = gw->GetOutgoingMessageQueue();
+      retNumMessages = q.GetNumItems();
+      for (uint32 i=0; i<retNumMessages; i++) if (q[i]()) retNumBytes += q[i]()->FlattenedSize();
+   }
+}
+
+status_t
+AbstractReflectSession ::
+SaveTrafficStatsToMessage(Message & msg) const
+{
+   uint32 numOutMessages;
+   uint64 numOutBytes;
+   GetOutgoingQueueSize(numOutMessages, numOutBytes);
+
+   MRETURN_ON_ERROR(msg.AddString("id",         GetSessionIDString()));
+   MRETURN_ON_ERROR(msg.AddString("type",       GetTypeName()));
+   MRETURN_ON_ERROR(msg.AddString("host",       GetHostName()));
+   MRETURN_ON_ERROR(msg.AddString("desc",       GetSessionDescriptionString()));
+   MRETURN_ON_ERROR(msg.AddInt64("bytesin",     _numBytesReceived));
+   MRETURN_ON_ERROR(msg.AddInt64("bytesout",    _numBytesSent));
+   MRETURN_ON_ERROR(msg.AddInt64("msgsin",      _numMessagesReceived));
+   MRETURN_ON_ERROR(msg.AddInt64("msgsout",     _numMessagesSent));
+   MRETURN_ON_ERROR(msg.AddInt64("outqmsgs",    numOutMessages));
+   MRETURN_ON_ERROR(msg.AddInt64("outqbytes",   numOutBytes));
+   MRETURN_ON_ERROR(msg.AddInt64("maxoutq",     _maxOutgoingQueueDepth));
+   return           msg.AddInt64("callbackus",  _totalCallbackTime);
+}
+
 } // end namespace muscle
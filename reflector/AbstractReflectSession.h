@@ -506,6 +506,41 @@ public:
      */
    MUSCLE_NODISCARD uint64 GetMostRecentOutputTimeStamp() const {return _mostRecentOutputTimeStamp;}
 
+   /** Returns the total number of bytes this session has read from its client. */
+   MUSCLE_NODISCARD uint64 GetNumBytesReceived() const {return _numBytesReceived;}
+
+   /** Returns the total number of bytes this session has written to its client. */
+   MUSCLE_NODISCARD uint64 GetNumBytesSent() const {return _numBytesSent;}
+
+   /** Returns the total number of Messages the ReflectServer has passed to this session's MessageReceivedFromGateway() method. */
+   MUSCLE_NODISCARD uint64 GetNumMessagesReceived() const {return _numMessagesReceived;}
+
+   /** Returns the total number of Messages that have been successfully queued up for sending via AddOutgoingMessage(). */
+   MUSCLE_NODISCARD uint64 GetNumMessagesSent() const {return _numMessagesSent;}
+
+   /** Returns the largest number of Messages that have been waiting in our gateway's outgoing-Message-queue at any one time. */
+   MUSCLE_NODISCARD uint32 GetMaxOutgoingQueueDepth() const {return _maxOutgoingQueueDepth;}
+
+   /** Returns the total number of microseconds the ReflectServer has spent inside this session's Pulse(), DoInput()
+     * and DoOutput() calls.  Only tallied while the ReflectServer's event-loop stats are enabled.
+     */
+   MUSCLE_NODISCARD uint64 GetTotalCallbackTime() const {return _totalCallbackTime;}
+
+   /** Computes how much data is currently waiting in our gateway's outgoing-Message-queue.
+     * @param retNumMessages on return, the number of Messages in the queue is written here.
+     * @param retNumBytes on return, the sum of the FlattenedSize()s of the Messages in the queue is written here.
+     * @note this method iterates over the entire queue, so it's O(N).
+     */
+   void GetOutgoingQueueSize(uint32 & retNumMessages, uint64 & retNumBytes) const;
+
+   /** Adds this session's traffic counters to the specified Message, as int64 fields named "bytesin", "bytesout",
+     * "msgsin", "msgsout", "outqmsgs", "outqbytes", "maxoutq" and "callbackus", along with some descriptive
+     * String fields ("id", "type", "host" and "desc").  Subclasses may override this to add more fields.
+     * @param msg the Message to add our fields to.
+     * @returns B_NO_ERROR on success, or an error code on failure.
+     */
+   virtual status_t SaveTrafficStatsToMessage(Message & msg) const;
+
 protected:
    /** Set by StorageReflectSession::AttachedToServer()
      * @param p the new session-root-path for us to use (eg "/127.0.0.1/12345")
@@ -571,6 +606,14 @@ private:
    uint64 _mostRecentInputTimeStamp;
    uint64 _mostRecentOutputTimeStamp;
 
+   // traffic counters, mostly updated by ReflectServer.cpp
+   uint64 _numBytesReceived;
+   uint64 _numBytesSent;
+   uint64 _numMessagesReceived;
+   uint64 _numMessagesSent;
+   uint32 _maxOutgoingQueueDepth;
+   uint64 _totalCallbackTime;
+
    DECLARE_COUNTED_OBJECT(AbstractReflectSession);
 };
 
@@ -14,25 +14,36 @@ const char * DataNode :: _setDataFlagsLabels[] = {
 
 DataNode :: DataNode()
    : _parent(NULL)
-   , _cachedDataChecksum(INVALID_CACHED_CHECKSUM)
-   , _children(NULL)
+   , _smallChildren(NULL)
    , _orderedIndex(NULL)
+   , _cachedDataChecksum(INVALID_CACHED_CHECKSUM)
    , _orderedCounter(0)
-   , _depth(0)
    , _maxChildIDHint(0)
+   , _depth(0)
+   , _numSmallChildren(0)
+   , _childrenInTable(false)
 {
    MUSCLE_STATIC_ASSERT_ARRAY_LENGTH(DataNode::_setDataFlagsLabels, NUM_SET_DATA_FLAGS);  // placed here only to get around privacy restrictions
 }
 
 DataNode :: ~DataNode()
 {
-   delete _children;
+   ClearChildren();
    delete _orderedIndex;
 }
 
+void DataNode :: ClearChildren()
+{
+   if (_childrenInTable) delete _children;
+                    else delete [] _smallChildren;
+   _smallChildren    = NULL;
+   _numSmallChildren = 0;
+   _childrenInTable  = false;
+}
+
 void DataNode :: Init(const String & name, const ConstMessageRef & initData)
 {
-   _nodeName           = name;
+   (void) _nodeName.SetFromString(name);  // on out-of-memory, the node will just be nameless
    _parent             = NULL;
    _depth              = 0;
    _maxChildIDHint     = 0;
@@ -48,14 +59,16 @@ void DataNode :: Reset()
    // just clearing them.  That will save memory, and also makes a
    // newly-reset DataNode behavior more like a just-created one
    // (See FogBugz #9845 for details)
-   delete _children;     _children     = NULL;
+   ClearChildren();
    delete _orderedIndex; _orderedIndex = NULL;
    _subscribers.Reset();
+   _snapshot.Reset();
 
    _parent             = NULL;
    _depth              = 0;
    _maxChildIDHint     = 0;
    _data.Reset();
+   _nodeName.Reset();  // so that pooled DataNodes don't keep their names alive in the InternedString table
    _cachedDataChecksum = INVALID_CACHED_CHECKSUM;
 }
 
@@ -106,6 +119,7 @@ DataNodeRef DataNode :: InsertOrderedChild(const ConstMessageRef & data, const S
       if ((optRetAdded)&&(newNode()->GetNodePath(np).IsOK(ret))&&(optRetAdded->Put(np, newNode).IsError(ret))) (void) _orderedIndex->RemoveItemAt(insertIndex);  // roll back!
 
       // Notify anyone monitoring this node that the ordered-index has been updated
+      InvalidateSnapshots();
       if ((ret.IsOK())&&(optNotifyWithOnSetParent)) optNotifyWithOnSetParent->NotifySubscribersThatNodeIndexChanged(*this, INDEX_OP_ENTRYINSERTED, insertIndex, newNode()->GetNodeName());
    }
 
@@ -120,6 +134,7 @@ status_t DataNode :: RemoveIndexEntryAt(uint32 removeIndex, StorageReflectSessio
    if ((_orderedIndex == NULL)||(removeIndex >= _orderedIndex->GetNumItems())) return B_DATA_NOT_FOUND;
 
    DataNodeRef holdKey = _orderedIndex->RemoveItemAtWithDefault(removeIndex);  // gotta make a temp copy here, or it's dangling pointer time
+   InvalidateSnapshots();
    if ((holdKey())&&(optNotifyWith)) optNotifyWith->NotifySubscribersThatNodeIndexChanged(*this, INDEX_OP_ENTRYREMOVED, removeIndex, holdKey()->GetNodeName());
    return B_NO_ERROR;
 }
@@ -127,14 +142,18 @@ status_t DataNode :: RemoveIndexEntryAt(uint32 removeIndex, StorageReflectSessio
 status_t DataNode :: InsertIndexEntryAt(uint32 insertIndex, StorageReflectSession * optNotifyWith, const String & key)
 {
    TCHECKPOINT;
+   DECLARE_MEMORY_TAG_GUARD(MUSCLE_MEMORY_TAG_DATANODES);
+
+   if (HasChildren() == false) return B_BAD_OBJECT;
 
-   if (_children == NULL) return B_BAD_OBJECT;
+   const DataNodeRef * childRef = GetChildRef(key);
+   if (childRef == NULL) return B_DATA_NOT_FOUND;
 
-   DataNodeRef childNode;
-   MRETURN_ON_ERROR(_children->Get(&key, childNode));
+   const DataNodeRef childNode = *childRef;
 
    if (_orderedIndex == NULL) _orderedIndex = new Queue<DataNodeRef>;
    MRETURN_ON_ERROR(_orderedIndex->InsertItemAt(insertIndex, childNode));
+   InvalidateSnapshots();
 
    // Notify anyone monitoring this node that the ordered-index has been updated
    if (optNotifyWith) optNotifyWith->NotifySubscribersThatNodeIndexChanged(*this, INDEX_OP_ENTRYINSERTED, insertIndex, childNode()->GetNodeName());
@@ -181,6 +200,7 @@ status_t DataNode :: ReorderChild(const DataNodeRef & child, const String & optM
    {
       // Now add the child into the index at his new position
       MRETURN_ON_ERROR(_orderedIndex->InsertItemAt(targetIndex, child));
+      InvalidateSnapshots();
 
       // Notify anyone monitoring this node that the ordered-index has been updated
       if (optNotifyWith) optNotifyWith->NotifySubscribersThatNodeIndexChanged(*this, INDEX_OP_ENTRYINSERTED, targetIndex, child()->GetNodeName());
@@ -192,22 +212,23 @@ status_t DataNode :: ReorderChild(const DataNodeRef & child, const String & optM
 status_t DataNode :: PutChild(const DataNodeRef & node, StorageReflectSession * optNotifyWithOnSetParent, StorageReflectSession * optNotifyChangedData)
 {
    TCHECKPOINT;
+   DECLARE_MEMORY_TAG_GUARD(MUSCLE_MEMORY_TAG_DATANODES);
 
    DataNode * child = node();
    if (child == NULL) return B_BAD_ARGUMENT;
 
-   if (_children == NULL) _children = new Hashtable<const String *, DataNodeRef>;
-   if ((optNotifyWithOnSetParent)&&(_children->GetNumItems() >= optNotifyWithOnSetParent->_maxChildrenPerDataNodeCount)&&(_children->ContainsKey(&child->_nodeName) == false)) return B_RESOURCE_LIMIT;  // BAB-1081
+   if ((optNotifyWithOnSetParent)&&(GetNumChildren() >= optNotifyWithOnSetParent->_maxChildrenPerDataNodeCount)&&(HasChild(child->GetNodeName()) == false)) return B_RESOURCE_LIMIT;  // BAB-1081
 
    MRETURN_ON_ERROR(child->SetParent(this, optNotifyWithOnSetParent));
 
    DataNodeRef oldNode;
-   const status_t ret = _children->Put(&child->_nodeName, node, oldNode);
+   const status_t ret = PutChildRef(node, oldNode);
    if (ret.IsError())
    {
       (void) child->SetParent(NULL, optNotifyWithOnSetParent);
       return ret;
    }
+   InvalidateSnapshots();
 
    if (optNotifyChangedData)
    {
@@ -217,6 +238,173 @@ status_t DataNode :: PutChild(const DataNodeRef & node, StorageReflectSession *
    return B_NO_ERROR;
 }
 
+// Returns the number of slots our (_smallChildren) array should have, when we have (numChildren) children.
+// Grows in a few steps so that nodes with only one or two children don't pay for a full-sized array.
+static uint32 GetNumSmallChildrenSlots(uint32 numChildren)
+{
+   const uint32 numSlots = (numChildren <= 2) ? 2 : ((numChildren <= 4) ? 4 : MUSCLE_DATANODE_MAX_INLINE_CHILDREN);
+   return muscleMin(numSlots, (uint32) MUSCLE_DATANODE_MAX_INLINE_CHILDREN);
+}
+
+status_t DataNode :: PutChildRef(const DataNodeRef & child, DataNodeRef & retOldChild)
+{
+   const String & childName = child()->GetNodeName();
+   if (_childrenInTable) return _children->Put(&childName, child, retOldChild);
+
+   // Replacing an existing child of the same name?
+   for (uint32 i=0; i<_numSmallChildren; i++)
+   {
+      DataNodeRef & nextChild = _smallChildren[i];
+      if (nextChild()->GetNodeName() == childName)
+      {
+         retOldChild = nextChild;
+         nextChild   = child;
+         return B_NO_ERROR;
+      }
+   }
+
+   if (_numSmallChildren >= MUSCLE_DATANODE_MAX_INLINE_CHILDREN)
+   {
+      // Too many children to search linearly any more; time to switch over to a Hashtable
+      MRETURN_ON_ERROR(MoveSmallChildrenToTable());
+      return _children->Put(&childName, child, retOldChild);
+   }
+
+   // Note that our array may be bigger than GetNumSmallChildrenSlots() says, if children were removed since it was allocated
+   if ((_smallChildren == NULL)||(_numSmallChildren == GetNumSmallChildrenSlots(_numSmallChildren)))
+   {
+      DataNodeRef * newArray = newnothrow_array(DataNodeRef, GetNumSmallChildrenSlots(_numSmallChildren+1));
+      MRETURN_OOM_ON_NULL(newArray);
+
+      for (uint32 i=0; i<_numSmallChildren; i++) newArray[i].SwapContents(_smallChildren[i]);
+      delete [] _smallChildren;
+      _smallChildren = newArray;
+   }
+
+   _smallChildren[_numSmallChildren++] = child;
+   retOldChild.Reset();
+   return B_NO_ERROR;
+}
+
+status_t DataNode :: MoveSmallChildrenToTable()
+{
+   Hashtable<const String *, DataNodeRef> * table = newnothrow Hashtable<const String *, DataNodeRef>;
+   MRETURN_OOM_ON_NULL(table);
+
+   status_t ret;
+   if (table->EnsureSize(_numSmallChildren+1).IsOK(ret))
+   {
+      for (uint32 i=0; i<_numSmallChildren; i++)
+      {
+         const DataNodeRef & nextChild = _smallChildren[i];
+         if (table->Put(&nextChild()->GetNodeName(), nextChild).IsError(ret)) break;
+      }
+   }
+   if (ret.IsError())
+   {
+      delete table;
+      return ret;
+   }
+
+   delete [] _smallChildren;
+   _children         = table;
+   _numSmallChildren = 0;
+   _childrenInTable  = true;
+   return B_NO_ERROR;
+}
+
+status_t DataNode :: RemoveChildRef(const String & key)
+{
+   if (_childrenInTable) return _children->Remove(&key);
+
+   for (uint32 i=0; i<_numSmallChildren; i++)
+   {
+      if (_smallChildren[i]()->GetNodeName() == key)
+      {
+         // Shift the later children down, so that the rest of our children stay in the order they were added
+         DataNodeRef removedChild;
+         removedChild.SwapContents(_smallChildren[i]);
+         for (uint32 j=i+1; j<_numSmallChildren; j++) _smallChildren[j-1].SwapContents(_smallChildren[j]);
+         if (--_numSmallChildren == 0)
+         {
+            delete [] _smallChildren;
+            _smallChildren = NULL;
+         }
+         return B_NO_ERROR;
+      }
+   }
+   return B_DATA_NOT_FOUND;
+}
+
+uint32 DataNode :: GetTotalDataSize() const
+{
+   uint32 ret = sizeof(*this);
+   if (_childrenInTable) ret += _children->GetTotalDataSize();
+   else if (_smallChildren) ret += GetNumSmallChildrenSlots(_numSmallChildren)*sizeof(DataNodeRef);
+   if (_orderedIndex) ret += _orderedIndex->GetTotalDataSize();
+   return ret;
+}
+
+void DataNode :: InvalidateSnapshots()
+{
+   // Our ancestors' snapshots include ours, so they are out of date now too.  But if a node has no
+   // cached snapshot, then neither do any of its ancestors, so we can stop as soon as we find one.
+   for (DataNode * n = this; ((n)&&(n->_snapshot())); n = n->_parent) n->_snapshot.Reset();
+}
+
+void DataNode :: DropCachedSnapshots()
+{
+   InvalidateSnapshots();
+   DropSubtreeSnapshots();
+}
+
+void DataNode :: DropSubtreeSnapshots()
+{
+   // A descendant may have a cached snapshot even if we don't (if GetSnapshot() was called on it directly), so we have to visit them all
+   _snapshot.Reset();
+   for (DataNodeRefIterator iter = GetChildIterator(); iter.HasData(); iter++) iter.GetValue()()->DropSubtreeSnapshots();
+}
+
+ConstDataNodeSnapshotRef DataNode :: GetSnapshot() const
+{
+   if (_snapshot()) return _snapshot;  // nothing has changed since the last snapshot was taken
+
+   TCHECKPOINT;
+   DECLARE_MEMORY_TAG_GUARD(MUSCLE_MEMORY_TAG_DATANODES);
+
+   DataNodeSnapshot * snap = newnothrow DataNodeSnapshot(_nodeName, _data);
+   MRETURN_OOM_ON_NULL(snap);
+
+   const ConstDataNodeSnapshotRef ret(snap);
+   const uint32 numChildren = GetNumChildren();
+   MRETURN_ON_ERROR(snap->_children.EnsureSize(numChildren));
+   for (DataNodeRefIterator iter = GetChildIterator(); iter.HasData(); iter++)
+   {
+      const ConstDataNodeSnapshotRef childSnap = iter.GetValue()()->GetSnapshot();  // re-uses the child's cached snapshot, if it has one
+      MRETURN_ON_ERROR(childSnap);
+      MRETURN_ON_ERROR(snap->_children.AddTail(childSnap));
+   }
+
+   if (numChildren > MUSCLE_DATANODE_MAX_INLINE_CHILDREN)
+   {
+      snap->_childIndices = newnothrow Hashtable<const String *, uint32>;
+      MRETURN_OOM_ON_NULL(snap->_childIndices);
+      MRETURN_ON_ERROR(snap->_childIndices->EnsureSize(numChildren));
+      for (uint32 i=0; i<numChildren; i++) MRETURN_ON_ERROR(snap->_childIndices->Put(&snap->_children[i]()->GetNodeName(), i));
+   }
+
+   if (_orderedIndex)
+   {
+      snap->_orderedIndex = newnothrow Queue<ConstDataNodeSnapshotRef>;
+      MRETURN_OOM_ON_NULL(snap->_orderedIndex);
+      MRETURN_ON_ERROR(snap->_orderedIndex->EnsureSize(_orderedIndex->GetNumItems()));
+      for (uint32 i=0; i<_orderedIndex->GetNumItems(); i++) MRETURN_ON_ERROR(snap->_orderedIndex->AddTail((*_orderedIndex)[i]()->_snapshot));  // cached by the loop above
+   }
+
+   _snapshot = ret;
+   return ret;
+}
+
 status_t DataNode :: SetParent(DataNode * optParent, StorageReflectSession * optNotifyWith)
 {
    TCHECKPOINT;
@@ -241,7 +429,7 @@ status_t DataNode :: SetParent(DataNode * optParent, StorageReflectSession * opt
 
    if (_parent)
    {
-      _depth = _parent->_depth+1;
+      _depth = (uint16) (_parent->_depth+1);
       if (optNotifyWith) optNotifyWith->NotifySubscribersOfNewNode(*this);
    }
    else _depth = 0;
@@ -319,15 +507,13 @@ status_t DataNode :: RemoveChild(const String & key, StorageReflectSession * opt
 {
    TCHECKPOINT;
 
-   if (_children == NULL) return B_DATA_NOT_FOUND;
-
    DataNodeRef childRef;
-   MRETURN_ON_ERROR(_children->Get(&key, childRef));
+   MRETURN_ON_ERROR(GetChild(key, childRef));
 
    DataNode * child = childRef();
    if (child)
    {
-      if (recurse) while(child->HasChildren()) (void) child->RemoveChild(**(child->_children->GetFirstKey()), optNotifyWith, recurse, optCurrentNodeCount);
+      if (recurse) while(child->HasChildren()) (void) child->RemoveChild(*child->GetChildIterator().GetKey(), optNotifyWith, recurse, optCurrentNodeCount);
 
       (void) RemoveIndexEntry(key, optNotifyWith);
       if (optNotifyWith) optNotifyWith->NotifySubscribersThatNodeChanged(*child, child->GetData(), StorageReflectSession::NodeChangeFlags(StorageReflectSession::NODE_CHANGE_FLAG_ISBEINGREMOVED));
@@ -337,7 +523,9 @@ status_t DataNode :: RemoveChild(const String & key, StorageReflectSession * opt
       if (optCurrentNodeCount) (*optCurrentNodeCount)--;
    }
 
-   return _children->Remove(&key, childRef);
+   MRETURN_ON_ERROR(RemoveChildRef(key));
+   InvalidateSnapshots();
+   return B_NO_ERROR;
 }
 
 status_t DataNode :: RemoveIndexEntry(const String & key, StorageReflectSession * optNotifyWith)
@@ -352,6 +540,7 @@ status_t DataNode :: RemoveIndexEntry(const String & key, StorageReflectSession
          if (key == (*_orderedIndex)[i]()->GetNodeName())
          {
             (void) _orderedIndex->RemoveItemAt(i);
+            InvalidateSnapshots();
             if (optNotifyWith) optNotifyWith->NotifySubscribersThatNodeIndexChanged(*this, INDEX_OP_ENTRYREMOVED, i, key);
             return B_NO_ERROR;
          }
@@ -366,6 +555,7 @@ void DataNode :: SetData(const ConstMessageRef & data, StorageReflectSession * o
    if (setDataFlags.IsBitSet(SET_DATA_FLAG_ISBEINGCREATED) == false) oldData = _data;
    _data = data;
    _cachedDataChecksum = INVALID_CACHED_CHECKSUM;
+   InvalidateSnapshots();
    if (optNotifyWith) optNotifyWith->NotifySubscribersThatNodeChanged(*this, oldData, setDataFlags.IsBitSet(SET_DATA_FLAG_ENABLESUPERCEDE)?StorageReflectSession::NodeChangeFlags(StorageReflectSession::NODE_CHANGE_FLAG_ENABLESUPERCEDE):StorageReflectSession::NodeChangeFlags());
 }
 
@@ -408,7 +598,7 @@ uint32 DataNode :: CalculateChecksum(uint32 maxRecursionDepth) const
          ret += CalculateOrderedPairChecksum(prevChk, CalculateOptStringChecksum(NULL));   // (lastItem, end-of-list) counts as a pair
       }
 
-      if (_children) for (ConstHashtableIterator<const String *, DataNodeRef> iter(*_children); iter.HasData(); iter++) ret += iter.GetValue()()->CalculateChecksum(maxRecursionDepth-1);
+      for (DataNodeRefIterator iter = GetChildIterator(); iter.HasData(); iter++) ret += iter.GetValue()()->CalculateChecksum(maxRecursionDepth-1);
       return ret;
    }
 }
@@ -454,7 +644,7 @@ void DataNode :: Print(const OutputPrinter & p, uint32 maxRecursionDepth, int in
 {
    p.putc(' ', indentLevel);
    String np; (void) GetNodePath(np);
-   p.printf("DataNode [%s] numChildren=" UINT32_FORMAT_SPEC " orderedIndex=" INT32_FORMAT_SPEC " checksum=" UINT32_FORMAT_SPEC " msgChecksum=" UINT32_FORMAT_SPEC "\n", np(), _children?_children->GetNumItems():0, _orderedIndex?(int32)_orderedIndex->GetNumItems():(int32)-1, CalculateChecksum(maxRecursionDepth), _data()?_data()->CalculateChecksum():0);
+   p.printf("DataNode [%s] numChildren=" UINT32_FORMAT_SPEC " orderedIndex=" INT32_FORMAT_SPEC " checksum=" UINT32_FORMAT_SPEC " msgChecksum=" UINT32_FORMAT_SPEC "\n", np(), GetNumChildren(), _orderedIndex?(int32)_orderedIndex->GetNumItems():(int32)-1, CalculateChecksum(maxRecursionDepth), _data()?_data()->CalculateChecksum():0);
    if (_data()) _data()->Print(p.WithIndent(1), true);
    if (maxRecursionDepth > 0)
    {
@@ -466,11 +656,11 @@ void DataNode :: Print(const OutputPrinter & p, uint32 maxRecursionDepth, int in
             p.printf("   Index slot " UINT32_FORMAT_SPEC " = %s\n", i, (*_orderedIndex)[i]()->GetNodeName()());
          }
       }
-      if (_children)
+      if (HasChildren())
       {
          p.putc(' ', indentLevel);
          p.printf("Children for node [%s] follow:\n", np());
-         for (ConstHashtableIterator<const String *, DataNodeRef> iter(*_children); iter.HasData(); iter++) iter.GetValue()()->Print(p, maxRecursionDepth-1, indentLevel+2);
+         for (DataNodeRefIterator iter = GetChildIterator(); iter.HasData(); iter++) iter.GetValue()()->Print(p, maxRecursionDepth-1, indentLevel+2);
       }
    }
 }
@@ -484,7 +674,7 @@ DataNode * DataNode :: FindFirstMatchingNode(const char * path, uint32 maxDepth)
 
       default:
       {
-         if ((_children == NULL)||(maxDepth == 0)) return NULL;
+         if ((HasChildren() == false)||(maxDepth == 0)) return NULL;
 
          const char * nextSlash = strchr(path, '/');
          const String childKey(path, (nextSlash)?((uint32)(nextSlash-path)):MUSCLE_NO_LIMIT);
@@ -504,7 +694,7 @@ DataNode * DataNode :: FindFirstMatchingNode(const char * path, uint32 maxDepth)
          }
          else
          {
-            const DataNodeRef * childRef = _children->Get(&childKey);
+            const DataNodeRef * childRef = GetChildRef(childKey);
             if (childRef) return childRef->GetItemPointer()->FindFirstMatchingNode(recurseArg, maxDepth-1);
          }
       }
@@ -525,11 +715,172 @@ DataNodeRef DataNode :: GetDescendantAux(const char * subPath) const
 
 void DataNode :: SetNodeName(const String & newNodeName)
 {
-   if (newNodeName != _nodeName)
+   if (_nodeName == newNodeName) return;
+
+   if ((_parent)&&(_parent->HasChild(newNodeName)))
+   {
+      LogTime(MUSCLE_LOG_ERROR, "DataNode::SetNodeName():  Can't rename node [%s] to [%s], its parent already has a child with that name!\n", GetNodePath()(), newNodeName());
+      return;
+   }
+
+   InternedString newName;
+   if (newName.SetFromString(newNodeName).IsError()) {MWARN_OUT_OF_MEMORY; return;}
+
+   // Our parent's Hashtable (if it is using one) is keyed on a pointer to our name, so we have to re-key ourself in it
+   Hashtable<const String *, DataNodeRef> * parentTable = ((_parent)&&(_parent->_childrenInTable)) ? _parent->_children : NULL;
+   if (parentTable)
+   {
+      const int32 idx = parentTable->IndexOfKey(&GetNodeName());
+      DataNodeRef self;
+      if ((idx < 0)||(parentTable->Remove(&GetNodeName(), self).IsError())) return;  // shouldn't ever happen
+
+      _nodeName.SwapContents(newName);
+      (void) parentTable->PutAtPosition(&GetNodeName(), (uint32) idx, self);  // can't fail, since Remove() just freed up a slot
+   }
+   else _nodeName.SwapContents(newName);
+
+   _cachedDataChecksum = INVALID_CACHED_CHECKSUM;
+   InvalidateSnapshots();
+}
+
+DataNodeSnapshot :: ~DataNodeSnapshot()
+{
+   delete _childIndices;
+   delete _orderedIndex;
+}
+
+ConstDataNodeSnapshotRef DataNodeSnapshot :: GetChild(const String & key) const
+{
+   if (_childIndices)
    {
-      _nodeName = newNodeName;
-      _cachedDataChecksum = INVALID_CACHED_CHECKSUM;
+      const uint32 * idx = _childIndices->Get(&key);
+      return idx ? _children[*idx] : ConstDataNodeSnapshotRef();
    }
+
+   for (uint32 i=0; i<_children.GetNumItems(); i++) if (_children[i]()->GetNodeName() == key) return _children[i];
+   return ConstDataNodeSnapshotRef();
+}
+
+ConstDataNodeSnapshotRef DataNodeSnapshot :: GetDescendantAux(const char * subPath) const
+{
+   const char * slash = strchr(subPath, '/');
+   if (slash)
+   {
+      ConstDataNodeSnapshotRef child = GetChild(String(subPath, (uint32)(slash-subPath)));
+      return child() ? child()->GetDescendantAux(slash+1) : ConstDataNodeSnapshotRef();
+   }
+   else return GetChild(subPath);
+}
+
+uint32 DataNodeSnapshot :: CalculateChecksum(uint32 maxRecursionDepth) const
+{
+   // Same algorithm as DataNode::CalculateChecksum(), except that we don't cache anything, since other threads may be reading us
+   uint32 ret = _nodeName.CalculateChecksum()+(_data()?_data()->CalculateChecksum():0);
+   if (ret == INVALID_CACHED_CHECKSUM) ret++;  // to match DataNode's cached-checksum value
+
+   if (maxRecursionDepth > 0)
+   {
+      if ((_orderedIndex)&&(_orderedIndex->HasItems()))
+      {
+         uint32 prevChk = CalculateOptStringChecksum(NULL);
+
+         const Queue<ConstDataNodeSnapshotRef> & oi = *_orderedIndex;
+         for (uint32 i=0; i<oi.GetNumItems(); i++)
+         {
+            const uint32 curChk = CalculateOptStringChecksum(&oi[i]()->GetNodeName());
+            ret += CalculateOrderedPairChecksum(prevChk, curChk);
+            prevChk = curChk;
+         }
+
+         ret += CalculateOrderedPairChecksum(prevChk, CalculateOptStringChecksum(NULL));
+      }
+
+      for (uint32 i=0; i<_children.GetNumItems(); i++) ret += _children[i]()->CalculateChecksum(maxRecursionDepth-1);
+   }
+   return ret;
+}
+
+status_t DataNodeSnapshot :: SaveNodeTreeToMessage(Message & msg, bool saveData, uint32 maxDepth) const
+{
+   if ((saveData)&&(_data())) MRETURN_ON_ERROR(msg.AddMessage(PR_NAME_NODEDATA, CastAwayConstFromRef(_data)));
+
+   if ((HasChildren())&&(maxDepth > 0))
+   {
+      // Save the node-index, if there is one
+      if ((_orderedIndex)&&(_orderedIndex->HasItems()))
+      {
+         MessageRef indexMsgRef(GetMessageFromPool());
+         MRETURN_ON_ERROR(indexMsgRef);
+         MRETURN_ON_ERROR(msg.AddMessage(PR_NAME_NODEINDEX, indexMsgRef));
+         for (uint32 i=0; i<_orderedIndex->GetNumItems(); i++) MRETURN_ON_ERROR(indexMsgRef()->AddString(PR_NAME_KEYS, (*_orderedIndex)[i]()->GetNodeName()));
+      }
+
+      // Then save the children, recursing to each one as necessary
+      MessageRef childrenMsgRef(GetMessageFromPool());
+      MRETURN_ON_ERROR(childrenMsgRef);
+      MRETURN_ON_ERROR(msg.AddMessage(PR_NAME_NODECHILDREN, childrenMsgRef));
+      for (uint32 i=0; i<_children.GetNumItems(); i++)
+      {
+         const DataNodeSnapshot * child = _children[i]();
+
+         MessageRef childMsgRef(GetMessageFromPool());
+         MRETURN_ON_ERROR(childMsgRef);
+         MRETURN_ON_ERROR(childrenMsgRef()->AddMessage(child->GetNodeName(), childMsgRef));
+         MRETURN_ON_ERROR(child->SaveNodeTreeToMessage(*childMsgRef(), true, maxDepth-1));
+      }
+   }
+   return B_NO_ERROR;
+}
+
+// Returns true iff at least one of (matcher)'s paths might match a node-name of (nodeName) at the (clauseIdx)'th level
+static bool IsPossiblePathMatch(const PathMatcher & matcher, uint32 clauseIdx, const String & nodeName)
+{
+   for (ConstHashtableIterator<uint32, Hashtable<String, PathMatcherEntry> > iter(matcher.GetEntries(), HTIT_FLAG_NOREGISTER); iter.HasData(); iter++)
+   {
+      if (iter.GetKey() > clauseIdx)
+      {
+         for (ConstHashtableIterator<String, PathMatcherEntry> subIter(iter.GetValue(), HTIT_FLAG_NOREGISTER); subIter.HasData(); subIter++)
+         {
+            const StringMatcherQueue * smq = subIter.GetValue().GetParser()();
+            if (smq)
+            {
+               const StringMatcherRef * smRef = smq->GetStringMatchers().GetItemAt(clauseIdx);
+               const StringMatcher * sm = smRef ? smRef->GetItemPointer() : NULL;
+               if ((sm == NULL)||(sm->Match(nodeName()))) return true;
+            }
+         }
+      }
+   }
+   return false;
+}
+
+status_t DataNodeSnapshot :: SaveMatchingNodesToMessage(const PathMatcher & matcher, const String & nodePath, Message & retMsg) const
+{
+   uint32 maxDepth = 0;
+   for (ConstHashtableIterator<uint32, Hashtable<String, PathMatcherEntry> > iter(matcher.GetEntries(), HTIT_FLAG_NOREGISTER); iter.HasData(); iter++) if (iter.GetValue().HasItems()) maxDepth = muscleMax(maxDepth, iter.GetKey());
+
+   return SaveMatchingNodesToMessageAux(matcher, nodePath, GetPathDepth(nodePath()), maxDepth, retMsg);
+}
+
+status_t DataNodeSnapshot :: SaveMatchingNodesToMessageAux(const PathMatcher & matcher, const String & nodePath, uint32 depth, uint32 maxDepth, Message & retMsg) const
+{
+   if ((depth > 0)&&(_data())&&(matcher.MatchesPath(nodePath(), _data(), NULL))) MRETURN_ON_ERROR(retMsg.AddMessage(nodePath, CastAwayConstFromRef(_data)));
+
+   if (depth < maxDepth)
+   {
+      for (uint32 i=0; i<_children.GetNumItems(); i++)
+      {
+         const DataNodeSnapshot * child = _children[i]();
+         if (IsPossiblePathMatch(matcher, depth, child->GetNodeName()))  // don't bother descending into subtrees that can't match
+         {
+            String childPath(nodePath);
+            if (depth > 0) childPath += '/';
+            childPath += child->GetNodeName();
+            MRETURN_ON_ERROR(child->SaveMatchingNodesToMessageAux(matcher, childPath, depth+1, maxDepth, retMsg));
+         }
+      }
+   }
+   return B_NO_ERROR;
 }
 
 } // end namespace muscle
@@ -8,6 +8,7 @@
 #include "support/NotCopyable.h"
 #include "regex/PathMatcher.h"
 #include "util/ImmutableHashtablePool.h"
+#include "util/InternedString.h"
 
 namespace muscle {
 
@@ -16,6 +17,9 @@ class StorageReflectSession;
 class DataNode;
 DECLARE_REFTYPES(DataNode);
 
+class DataNodeSnapshot;
+DECLARE_REFTYPES(DataNodeSnapshot);
+
 /** Declares DataNodeSubscribersTable, DataNodeSubscribersTablePool, and ConstDataNodeSubscribersTableRef */
 DECLARE_IMMUTABLE_HASHTABLE_POOL_TYPES(DataNodeSubscribersTable, uint32, uint32, MUSCLE_NO_LIMIT);
 
@@ -23,8 +27,19 @@ DECLARE_IMMUTABLE_HASHTABLE_POOL_TYPES(DataNodeSubscribersTable, uint32, uint32,
 # define MUSCLE_MAX_NODE_DEPTH (100)  ///< we don't allow anyone to create nodes at a depth greater than this, to thwart potential stack-overflow attacks based on overly-deep recursions
 #endif
 
-/** Iterator type for our child objects */
-typedef HashtableIterator<const String *, DataNodeRef> DataNodeRefIterator;
+#ifndef MUSCLE_DATANODE_MAX_INLINE_CHILDREN
+# define MUSCLE_DATANODE_MAX_INLINE_CHILDREN (7)  ///< DataNodes with up to this many children keep them in a small array rather than in a Hashtable, to save memory
+#endif
+
+#if (MUSCLE_MAX_NODE_DEPTH > 65535)
+# error "MUSCLE_MAX_NODE_DEPTH must not be greater than 65535, since DataNode stores its depth as a uint16"
+#endif
+
+#if (MUSCLE_DATANODE_MAX_INLINE_CHILDREN > 255)
+# error "MUSCLE_DATANODE_MAX_INLINE_CHILDREN must not be greater than 255, since DataNode stores its small-children count as a uint8"
+#endif
+
+class DataNodeRefIterator;
 
 /** Each object of this class represents one node in the server-side data-storage tree.  */
 class DataNode MUSCLE_FINAL_CLASS : public RefCountable, private NotCopyable
@@ -71,22 +86,29 @@ public:
    status_t ReorderChild(const DataNodeRef & child, const String & optMoveToBeforeThis, StorageReflectSession * optNotifyWith);
 
    /** Returns true iff we have a child with the given name
-     * @param key node-name that we should check our child-nodes-table for (it's an O(1) lookup)
+     * @param key node-name that we should check our child-nodes-table for (it's an O(1) lookup, or a short linear search if we have only a few children)
      */
-   MUSCLE_NODISCARD bool HasChild(const String & key) const {return ((_children)&&(_children->ContainsKey(&key)));}
+   MUSCLE_NODISCARD bool HasChild(const String & key) const {return (GetChildRef(key) != NULL);}
 
    /** Retrieves the child with the given name.
     *  @param key The name of the child we wish to retrieve
     *  @param returnChild On success, a reference to the retrieved child is written into this object.
     *  @return B_NO_ERROR if a child node was successfully retrieved, or B_DATA_NOT_FOUND if it was not found.
     */
-   status_t GetChild(const String & key, DataNodeRef & returnChild) const {return ((_children)&&(_children->Get(&key, returnChild).IsOK())) ? B_NO_ERROR : B_DATA_NOT_FOUND;}
+   status_t GetChild(const String & key, DataNodeRef & returnChild) const
+   {
+      const DataNodeRef * childRef = GetChildRef(key);
+      if (childRef == NULL) return B_DATA_NOT_FOUND;
+
+      returnChild = *childRef;
+      return B_NO_ERROR;
+   }
 
    /** As above, except the reference to the child is returned as the return value rather than in a parameter.
     *  @param key The name of the child we wish to retrieve
     *  @return On success, a reference to the specified child node is returned.  On failure, a NULL DataNodeRef is returned.
     */
-   DataNodeRef GetChild(const String & key) const {return _children ? _children->GetWithDefault(&key) : DataNodeRef();}
+   DataNodeRef GetChild(const String & key) const {const DataNodeRef * childRef = GetChildRef(key); return childRef ? *childRef : DataNodeRef();}
 
    /** Finds and returns a descendant node (i.e child, grandchild, etc) by following the provided
     *  slash-separated relative node path.
@@ -106,20 +128,23 @@ public:
 
    /** Returns an iterator that can be used for iterating over our set of children.
      * @param flags If specified, this is the set of HTIT_FLAG_* flags to pass to the Hashtable iterator constructor.
+     *              (HTIT_FLAG_BACKWARDS is honored even when we don't have enough children to need a Hashtable)
      */
-   DataNodeRefIterator GetChildIterator(uint32 flags = 0) const {return _children ? _children->GetIterator(flags) : DataNodeRefIterator();}
+   inline DataNodeRefIterator GetChildIterator(uint32 flags = 0) const;
 
    /** Returns the number of child nodes this node contains. */
-   MUSCLE_NODISCARD uint32 GetNumChildren() const {return _children ? _children->GetNumItems() : 0;}
+   MUSCLE_NODISCARD uint32 GetNumChildren() const {return _childrenInTable ? _children->GetNumItems() : _numSmallChildren;}
 
    /** Returns true iff this node contains any child nodes. */
-   MUSCLE_NODISCARD bool HasChildren() const {return ((_children)&&(_children->HasItems()));}
+   MUSCLE_NODISCARD bool HasChildren() const {return (GetNumChildren() > 0);}
 
    /** Returns the ASCII name of this node (eg "joe") */
-   MUSCLE_NODISCARD const String & GetNodeName() const {return _nodeName;}
+   MUSCLE_NODISCARD const String & GetNodeName() const {return _nodeName.GetString();}
 
    /** Sets this DataNode's node name to something different.
-     * @param newNodeName the new name to use
+     * If this node has a parent, the parent will find this node under its new name afterwards.
+     * @param newNodeName the new name to use.  If our parent already has a different child with this name,
+     *                    an error is logged and our name is left unchanged.
      * @note Don't call this unless you know what you are doing -- most of the MUSCLE codebase expects node-names to be constant.
      */
    void SetNodeName(const String & newNodeName);
@@ -306,9 +331,38 @@ public:
      */
    status_t UpdateRunningChecksumToReflectOrderedIndexUpdate(char opCode, uint32 index, const String & key, uint32 & runningChecksum) const;
 
+   /** Returns the (approximate) number of bytes of memory taken up by this DataNode and its child-table and ordered-index.
+     * Our payload Message, our node-name and our child nodes aren't included, since they may be shared with other DataNodes.
+     */
+   MUSCLE_NODISCARD uint32 GetTotalDataSize() const;
+
+   /** Returns a read-only snapshot of this node and all of its descendants, as they are right now.
+     * Snapshots are copy-on-write:  the snapshot is cached, and returned again by later calls until this node or one of
+     * its descendants changes.  After that, the next snapshot is built by re-using the cached snapshots of all the
+     * subtrees that haven't changed.  So taking a snapshot of an unchanged tree is O(1), and taking one after some changes
+     * costs time proportional to the number of changed nodes (and their siblings), rather than to the size of the tree.
+     * Since a DataNodeSnapshot never changes after it has been created, other threads (e.g. ThreadPool workers) may safely
+     * read it while this thread goes on modifying the tree.
+     * @returns a reference to the snapshot on success, or a NULL reference (with an error code) on failure (out of memory?)
+     * @note like every other DataNode method, this method must be called only by the thread that owns the node tree.
+     * @note the cached snapshots are kept even after the caller's reference is gone.  They share the nodes' payloads
+     *       and names, but the snapshot of each node still costs about as much memory as the node's own child-table
+     *       does, so while a whole tree's snapshots are cached, the tree's structural memory-usage roughly doubles.
+     *       If you take snapshots only now and then, call DropCachedSnapshots() when you're done with them.
+     */
+   ConstDataNodeSnapshotRef GetSnapshot() const;
+
+   /** Discards the snapshots that GetSnapshot() has cached for this node, its descendants and its ancestors, so that
+     * their memory can be freed once the last reference to them is gone.  (The ancestors' snapshots are discarded
+     * too, since they contain this node's snapshot)  Snapshots that are still referenced elsewhere remain valid.
+     * The next call to GetSnapshot() will have to build its snapshot of the affected nodes from scratch.
+     */
+   void DropCachedSnapshots();
+
 private:
    friend class StorageReflectSession;
    friend class ObjectPool<DataNode>;
+   friend class DataNodeRefIterator;
    DataNodeRef GetDescendantAux(const char * subPath) const;
 
    /** @copydoc DoxyTemplate::operator=(const DoxyTemplate &)
@@ -322,17 +376,32 @@ private:
    status_t SetParent(DataNode * parent, StorageReflectSession * optNotifyWith);
    status_t RemoveIndexEntry(const String & key, StorageReflectSession * optNotifyWith);
 
+   MUSCLE_NODISCARD inline const DataNodeRef * GetChildRef(const String & key) const;
+   status_t PutChildRef(const DataNodeRef & child, DataNodeRef & retOldChild);
+   status_t RemoveChildRef(const String & key);
+   status_t MoveSmallChildrenToTable();
+   void ClearChildren();
+   void InvalidateSnapshots();
+   void DropSubtreeSnapshots();
+
    DataNode * _parent;
    ConstMessageRef _data;
-   mutable uint32 _cachedDataChecksum;  // if not set to INVALID_CACHED_CHECKSUM, contains checksum(_nodeName)+checksum(_data)
-   Hashtable<const String *, DataNodeRef> * _children;  // lazy-allocated
+   union {
+      DataNodeRef * _smallChildren;  // used while (_childrenInTable) is false:  lazy-allocated array of our first few children, in the order they were added
+      Hashtable<const String *, DataNodeRef> * _children;  // used once (_childrenInTable) is true:  our children, keyed by their node-names
+   };
    Queue<DataNodeRef> * _orderedIndex;  // only used when tracking the ordering of our children (lazy-allocated)
+   InternedString _nodeName;  // shared with every other DataNode that has the same name
+   ConstDataNodeSubscribersTableRef _subscribers;  // NULL ref means no subscribers
+   mutable ConstDataNodeSnapshotRef _snapshot;  // cached by GetSnapshot(); reset whenever this node or one of its descendants changes
+
+   // grouped together here so that the compiler won't need to add padding between them
+   mutable uint32 _cachedDataChecksum;  // if not set to INVALID_CACHED_CHECKSUM, contains checksum(_nodeName)+checksum(_data)
    uint32 _orderedCounter;
-   String _nodeName;
-   uint32 _depth;  // number of ancestors our node has (eg root's _depth is zero)
    uint32 _maxChildIDHint;  // keep track of the largest child ID, for easier allocation of non-conflicting future child IDs
-
-   ConstDataNodeSubscribersTableRef _subscribers;  // NULL ref means no subscribers
+   uint16 _depth;  // number of ancestors our node has (eg root's _depth is zero)
+   uint8 _numSmallChildren;  // number of valid entries in (_smallChildren), when (_childrenInTable) is false
+   bool _childrenInTable;  // true iff we've had too many children to keep them in (_smallChildren), and are using (_children) instead
 
    DECLARE_COUNTED_OBJECT(DataNode);
 };
@@ -342,6 +411,155 @@ inline const Hashtable<uint32, uint32> & DataNode :: GetSubscribers() const
    return _subscribers() ? _subscribers()->GetTable() : GetDefaultObjectForType<Hashtable<uint32, uint32> >();
 }
 
+inline const DataNodeRef * DataNode :: GetChildRef(const String & key) const
+{
+   if (_childrenInTable) return _children->Get(&key);
+
+   // With this few children, a linear search is faster than a hash lookup would be anyway
+   for (uint32 i=0; i<_numSmallChildren; i++) if (_smallChildren[i]()->GetNodeName() == key) return &_smallChildren[i];
+   return NULL;
+}
+
+/** Iterator type for our child objects.  Works like a HashtableIterator<const String *, DataNodeRef> would. */
+class DataNodeRefIterator MUSCLE_FINAL_CLASS
+{
+public:
+   /** Default constructor.  Creates an iterator that has no data. */
+   DataNodeRefIterator() : _numSmallChildren(0), _smallIdx(0) {/* empty */}
+
+   /** Constructor.
+     * @param node The DataNode whose children we should iterate over.
+     * @param flags A bit-chord of HTIT_FLAG_* constants.  Defaults to zero, for default behaviour.
+     * @note when (node) has only a few children, the iterator keeps its own references to them, so
+     *       children added or removed during the iteration won't affect which children it returns.
+     */
+   DataNodeRefIterator(const DataNode & node, uint32 flags = 0) : _numSmallChildren(0), _smallIdx(0)
+   {
+      if (node._childrenInTable) _tableIter = node._children->GetIterator(flags);
+      else
+      {
+         _numSmallChildren = node._numSmallChildren;
+         const bool backwards = ((flags & HTIT_FLAG_BACKWARDS) != 0);
+         for (uint32 i=0; i<_numSmallChildren; i++) _smallChildren[i] = node._smallChildren[backwards ? (_numSmallChildren-(i+1)) : i];
+      }
+   }
+
+   /** Advances this iterator to the next child. */
+   void operator++(int) {if (_smallIdx < _numSmallChildren) _smallIdx++; else _tableIter++;}
+
+   /** Advances this iterator to the next child. */
+   void operator++() {(*this)++;}
+
+   /** Returns true iff this iterator is pointing to valid child data. */
+   MUSCLE_NODISCARD bool HasData() const {return (_smallIdx < _numSmallChildren) ? true : _tableIter.HasData();}
+
+   /** Returns a pointer to the node-name of the child this iterator is currently pointing at.
+     * Only valid when HasData() returns true.
+     */
+   MUSCLE_NODISCARD const String * GetKey() const {return (_smallIdx < _numSmallChildren) ? &_smallChildren[_smallIdx]()->GetNodeName() : _tableIter.GetKey();}
+
+   /** Returns a reference to the child this iterator is currently pointing at.
+     * Only valid when HasData() returns true.
+     */
+   MUSCLE_NODISCARD const DataNodeRef & GetValue() const {return (_smallIdx < _numSmallChildren) ? _smallChildren[_smallIdx] : _tableIter.GetValue();}
+
+private:
+   HashtableIterator<const String *, DataNodeRef> _tableIter;
+   DataNodeRef _smallChildren[(MUSCLE_DATANODE_MAX_INLINE_CHILDREN > 0) ? MUSCLE_DATANODE_MAX_INLINE_CHILDREN : 1];
+   uint32 _numSmallChildren;
+   uint32 _smallIdx;
+};
+
+inline DataNodeRefIterator DataNode :: GetChildIterator(uint32 flags) const
+{
+   return DataNodeRefIterator(*this, flags);
+}
+
+/** A read-only copy of a DataNode and its descendants, as returned by DataNode::GetSnapshot().
+  * A DataNodeSnapshot shares its payload Message and node-name with the DataNode it was taken from, and shares
+  * its unchanged subtrees with other snapshots of the same tree, so snapshots are cheap to create and to keep around.
+  * Since a DataNodeSnapshot is never modified after it has been created, any number of threads may read it at once.
+  * @note as with the DataNode tree itself, the payload Messages must never be modified in place.
+  */
+class DataNodeSnapshot MUSCLE_FINAL_CLASS : public RefCountable, private NotCopyable
+{
+public:
+   /** Destructor. */
+   ~DataNodeSnapshot();
+
+   /** Returns the name of the node this snapshot was taken of (eg "joe") */
+   MUSCLE_NODISCARD const String & GetNodeName() const {return _nodeName.GetString();}
+
+   /** Returns a reference to the node's Message payload, as it was when the snapshot was taken. */
+   MUSCLE_NODISCARD const ConstMessageRef & GetData() const {return _data;}
+
+   /** Returns the snapshots of the node's children, in the same order that DataNode::GetChildIterator() returned them. */
+   MUSCLE_NODISCARD const Queue<ConstDataNodeSnapshotRef> & GetChildren() const {return _children;}
+
+   /** Returns the number of child nodes the node had. */
+   MUSCLE_NODISCARD uint32 GetNumChildren() const {return _children.GetNumItems();}
+
+   /** Returns true iff the node had any child nodes. */
+   MUSCLE_NODISCARD bool HasChildren() const {return _children.HasItems();}
+
+   /** Returns the snapshot of the child with the given name, or a NULL reference if there was no such child.
+     * @param key The name of the child we wish to retrieve
+     */
+   ConstDataNodeSnapshotRef GetChild(const String & key) const;
+
+   /** Finds and returns the snapshot of a descendant node (i.e child, grandchild, etc) by following the provided
+    *  slash-separated relative node path.
+    *  @param subPath A list of child-names to descend down, with the child node-name separated from each other via slashes.
+    *  @returns A valid ConstDataNodeSnapshotRef on success, or a NULL reference if no child could be found at that sub-path.
+    */
+   ConstDataNodeSnapshotRef GetDescendant(const String & subPath) const {return GetDescendantAux(subPath());}
+
+   /** Returns a pointer to the node's ordered-child index, or NULL if the node didn't have one. */
+   MUSCLE_NODISCARD const Queue<ConstDataNodeSnapshotRef> * GetIndex() const {return _orderedIndex;}
+
+   /** Returns the same checksum that DataNode::CalculateChecksum() would have returned
+     * for the node, at the time the snapshot was taken.
+     * @param maxRecursionCount The maximum number of times to recurse.  Defaults to MUSCLE_NO_LIMIT.
+     * @note This method can be CPU-intensive; it is meant primarily for debugging.
+     */
+   MUSCLE_NODISCARD uint32 CalculateChecksum(uint32 maxRecursionCount = MUSCLE_NO_LIMIT) const;
+
+   /** Recursively saves this snapshot into (msg), in the same format that StorageReflectSession::SaveNodeTreeToMessage() uses,
+     * so that StorageReflectSession::RestoreNodeTreeFromMessage() can later restore the subtree from it.
+     * @param msg the Message to save the subtree into.
+     * @param saveData Whether or not the payload Message of this node should be saved.  The payload Messages of its descendants are always saved (if they have one).
+     * @param maxDepth How many levels of children should be saved to the Message.  Defaults to MUSCLE_NO_LIMIT.
+     * @returns B_NO_ERROR on success, or an error code on failure.
+     */
+   status_t SaveNodeTreeToMessage(Message & msg, bool saveData, uint32 maxDepth = MUSCLE_NO_LIMIT) const;
+
+   /** Adds the payload of every node in this snapshot whose path matches (matcher) to (retMsg), with each payload
+     * stored in a field named after its node's path, as in a PR_RESULT_DATAITEMS Message.
+     * @param matcher The node-paths (and optional QueryFilters) to match against.  QueryFilters that need to examine
+     *                the DataNode itself (rather than its payload) will be given a NULL DataNode pointer.
+     * @param nodePath The absolute node-path of the node this snapshot was taken of (as returned by DataNode::GetNodePath())
+     * @param retMsg the Message to add the matching payloads to.
+     * @returns B_NO_ERROR on success, or an error code on failure.
+     */
+   status_t SaveMatchingNodesToMessage(const PathMatcher & matcher, const String & nodePath, Message & retMsg) const;
+
+private:
+   friend class DataNode;
+
+   DataNodeSnapshot(const InternedString & nodeName, const ConstMessageRef & data) : _nodeName(nodeName), _data(data), _childIndices(NULL), _orderedIndex(NULL) {/* empty */}
+
+   ConstDataNodeSnapshotRef GetDescendantAux(const char * subPath) const;
+   status_t SaveMatchingNodesToMessageAux(const PathMatcher & matcher, const String & nodePath, uint32 depth, uint32 maxDepth, Message & retMsg) const;
+
+   const InternedString _nodeName;
+   const ConstMessageRef _data;
+   Queue<ConstDataNodeSnapshotRef> _children;
+   Hashtable<const String *, uint32> * _childIndices;  // node-name -> index in (_children); only allocated when there are too many children to search linearly
+   Queue<ConstDataNodeSnapshotRef> * _orderedIndex;   // NULL if the node had no ordered-child index
+
+   DECLARE_COUNTED_OBJECT(DataNodeSnapshot);
+};
+
 } // end namespace muscle
 
 #endif
@@ -0,0 +1,292 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#include "reflector/FairShareSessionIOPolicy.h"
+
+namespace muscle {
+
+FairShareSessionIOPolicy ::
+FairShareSessionIOPolicy(uint32 maxRate, uint32 quantum, uint32 burstBytes)
+   : _maxRate(maxRate)
+   , _quantum(muscleMax(quantum, (uint32)128))
+   , _burstBytes(muscleMax(burstBytes, (uint32)128))
+   , _groupByHost(true)
+   , _groupByFactory(true)
+   , _tokens(_burstBytes)
+   , _totalDeficit(0)
+   , _lastRefillAt(0)
+   , _refillRemainder(0)
+   , _numApproved(0)
+   , _sharesAllocated(false)
+   , _holderWasRefused(false)
+{
+   // empty
+}
+
+FairShareSessionIOPolicy ::
+~FairShareSessionIOPolicy()
+{
+   // empty
+}
+
+void
+FairShareSessionIOPolicy ::
+SetGroupByHost(bool groupByHost)
+{
+   if (groupByHost != _groupByHost)
+   {
+      _groupByHost = groupByHost;
+      InvalidateGroupKeys();
+   }
+}
+
+void
+FairShareSessionIOPolicy ::
+SetGroupByFactory(bool groupByFactory)
+{
+   if (groupByFactory != _groupByFactory)
+   {
+      _groupByFactory = groupByFactory;
+      InvalidateGroupKeys();
+   }
+}
+
+void
+FairShareSessionIOPolicy ::
+InvalidateGroupKeys()
+{
+   for (HashtableIterator<PolicyHolder, HolderState> iter(_holders); iter.HasData(); iter++) iter.GetValue()._groupKeyValid = false;
+}
+
+void
+FairShareSessionIOPolicy ::
+PolicyHolderAdded(const PolicyHolder & holder)
+{
+   (void) _holders.PutWithDefault(holder);  // if this fails, OkayToTransfer() will try again later
+}
+
+void
+FairShareSessionIOPolicy ::
+PolicyHolderRemoved(const PolicyHolder & holder)
+{
+   HolderState * hs = _holders.Get(holder);
+   if (hs)
+   {
+      ReturnDeficit(*hs);
+      (void) _holders.Remove(holder);
+   }
+
+   // Once the session isn't using us for either direction anymore, we can forget its weight too; otherwise
+   // _sessionWeights would keep growing for as long as sessions keep coming and going
+   if (_holders.ContainsKey(PolicyHolder(holder.GetSession(), !holder.IsAsInput())) == false) (void) _sessionWeights.Remove(holder.GetSession()->GetSessionID());
+}
+
+void
+FairShareSessionIOPolicy ::
+ReturnDeficit(HolderState & hs)
+{
+   if (IsRateLimited())
+   {
+      // Any bytes the holder was allotted but didn't use go back into the bucket, so other holders can use them
+      _tokens       += hs._deficit;
+      _totalDeficit -= hs._deficit;
+   }
+   hs._deficit = 0;
+}
+
+void
+FairShareSessionIOPolicy ::
+RefillTokens(uint64 now)
+{
+   if ((IsRateLimited() == false)||(_maxRate == 0)) return;
+
+   if (_lastRefillAt > 0)
+   {
+      const uint64 elapsed = (now > _lastRefillAt) ? (now-_lastRefillAt) : 0;
+      const uint64 scaled  = SaturatingUnsignedMultiply(elapsed, (uint64)_maxRate);
+      const uint64 total   = WillUnsignedAddOverflow(scaled, _refillRemainder) ? ((uint64)-1) : (scaled+_refillRemainder);
+      const int64 cap      = ((int64)_burstBytes)-_totalDeficit;  // the bucket plus outstanding allotments may never exceed (burstBytes)
+      const uint64 newBytes = total/MICROS_PER_SECOND;
+      if ((newBytes >= (uint64)_burstBytes)||(_tokens+((int64)newBytes) >= cap))
+      {
+         _tokens          = muscleMax(_tokens, cap);
+         _refillRemainder = 0;
+      }
+      else
+      {
+         _tokens         += (int64) newBytes;
+         _refillRemainder = total%MICROS_PER_SECOND;
+      }
+   }
+   _lastRefillAt = now;
+}
+
+void
+FairShareSessionIOPolicy ::
+BeginIO(uint64 now)
+{
+   RefillTokens(now);
+
+   _numApproved      = 0;
+   _sharesAllocated  = false;
+   _holderWasRefused = false;
+
+   InvalidatePulseTime();  // since our wakeup time depends on who gets refused during this pass
+}
+
+bool
+FairShareSessionIOPolicy ::
+OkayToTransfer(const PolicyHolder & holder)
+{
+   HolderState * hs = _holders.GetOrPut(holder);
+   if (hs == NULL) {MWARN_OUT_OF_MEMORY; return false;}
+
+   hs->_isActive = true;
+   if ((IsRateLimited() == false)||(_tokens > 0)||(hs->_deficit > 0))
+   {
+      hs->_isApproved = true;
+      _numApproved++;
+      return true;
+   }
+   else
+   {
+      _holderWasRefused = true;  // so GetPulseTime() will wake us up when there are enough tokens again
+      return false;
+   }
+}
+
+void
+FairShareSessionIOPolicy ::
+UpdateGroupKey(const PolicyHolder & holder, HolderState & hs) const
+{
+   const AbstractReflectSession * session = holder.GetSession();
+   hs._hostName = session->GetHostName();
+   hs._port     = session->GetPort();
+   hs._groupKey = _groupByHost ? hs._hostName : session->GetSessionIDString();
+   if (_groupByFactory) hs._groupKey += String(":%1").Arg(hs._port);
+   hs._groupKeyValid = true;
+}
+
+void
+FairShareSessionIOPolicy ::
+AllocateShares()
+{
+   _sharesAllocated = true;
+
+   const int64 budget = IsRateLimited() ? muscleMax(_tokens, (int64)0) : (((int64)_quantum)*_numApproved);
+   if ((budget == 0)||(_numApproved == 0)) return;  // approved holders will have to make do with what they have left over
+
+   // First pass:  sum up the weights at each level of the factory -> host -> session hierarchy
+   _groupTotals.Clear();
+   _factoryTotals.Clear();
+   double rootTotal = 0.0;
+   bool useEqualShares = false;  // in case we run out of memory
+   for (HashtableIterator<PolicyHolder, HolderState> iter(_holders); iter.HasData(); iter++)
+   {
+      HolderState & hs = iter.GetValue();
+      if (hs._isApproved)
+      {
+         if (hs._groupKeyValid == false) UpdateGroupKey(iter.GetKey(), hs);
+
+         double * groupTotal = _groupTotals.Get(hs._groupKey);
+         if (groupTotal == NULL)
+         {
+            // First approved holder in this host-group, so add the group's weight to its factory's total
+            const uint16 factoryKey = _groupByFactory ? hs._port : 0;
+            double * factoryTotal = _factoryTotals.Get(factoryKey);
+            if (factoryTotal == NULL)
+            {
+               factoryTotal = _factoryTotals.PutAndGet(factoryKey, 0.0);
+               if (factoryTotal) rootTotal += _groupByFactory ? _factoryWeights.GetWithDefault(hs._port, 1) : 1;
+            }
+            groupTotal = _groupTotals.PutAndGet(hs._groupKey, 0.0);
+            if ((factoryTotal == NULL)||(groupTotal == NULL)) {MWARN_OUT_OF_MEMORY; useEqualShares = true; break;}
+
+            const uint32 hostWeight = _hostWeights.GetWithDefault(hs._hostName, 1);
+            *factoryTotal += _groupByHost ? hostWeight : (hostWeight*_sessionWeights.GetWithDefault(iter.GetKey().GetSession()->GetSessionID(), 1));
+         }
+         *groupTotal += _groupByHost ? _sessionWeights.GetWithDefault(iter.GetKey().GetSession()->GetSessionID(), 1) : 1;
+      }
+   }
+
+   // Second pass:  give each approved holder its weighted portion of the budget
+   for (HashtableIterator<PolicyHolder, HolderState> iter(_holders); iter.HasData(); iter++)
+   {
+      HolderState & hs = iter.GetValue();
+      if (hs._isApproved)
+      {
+         double fraction = 1.0/_numApproved;
+         if (useEqualShares == false)
+         {
+            const uint32 sessionID  = iter.GetKey().GetSession()->GetSessionID();
+            const uint32 hostWeight = _hostWeights.GetWithDefault(hs._hostName, 1);
+            const double fw = _groupByFactory ? _factoryWeights.GetWithDefault(hs._port, 1) : 1;
+            const double hw = _groupByHost ? hostWeight : (hostWeight*_sessionWeights.GetWithDefault(sessionID, 1));
+            const double sw = _groupByHost ? _sessionWeights.GetWithDefault(sessionID, 1) : 1;
+            fraction = (fw/rootTotal)*(hw/_factoryTotals[_groupByFactory?hs._port:0])*(sw/_groupTotals[hs._groupKey]);
+         }
+
+         const int64 share = muscleMax((int64)(budget*fraction), (int64)1);
+         if (IsRateLimited())
+         {
+            // Deficits carry over from pass to pass for as long as the holder stays busy, so even a
+            // holder whose share is smaller than a single write will get its turn eventually
+            hs._deficit   += share;
+            _totalDeficit += share;
+            _tokens       -= share;
+         }
+         else hs._deficit = share;  // with no rate limit there's nothing to save up for
+      }
+   }
+}
+
+uint32
+FairShareSessionIOPolicy ::
+GetMaxTransferChunkSize(const PolicyHolder & holder)
+{
+   if (_sharesAllocated == false) AllocateShares();  // by now, every call to OkayToTransfer() for this pass has been made
+
+   const HolderState * hs = _holders.Get(holder);
+   return hs ? (uint32) muscleClamp(hs->_deficit, (int64)0, (int64)MUSCLE_NO_LIMIT-1) : 0;
+}
+
+void
+FairShareSessionIOPolicy ::
+BytesTransferred(const PolicyHolder & holder, uint32 numBytes)
+{
+   HolderState * hs = _holders.Get(holder);
+   if (hs)
+   {
+      const int64 used = muscleMin((int64)numBytes, muscleMax(hs->_deficit, (int64)0));
+      hs->_deficit -= used;
+      if (IsRateLimited()) _totalDeficit -= used;
+   }
+}
+
+void
+FairShareSessionIOPolicy ::
+EndIO(uint64)
+{
+   for (HashtableIterator<PolicyHolder, HolderState> iter(_holders); iter.HasData(); iter++)
+   {
+      HolderState & hs = iter.GetValue();
+      if ((hs._isActive == false)&&(hs._deficit != 0))
+      {
+         ReturnDeficit(hs);     // holders that went idle forfeit whatever they didn't use (that's what keeps deficit-round-robin fair)
+         InvalidatePulseTime();  // since the returned bytes may let a refused holder go sooner
+      }
+      hs._isActive = hs._isApproved = false;
+   }
+}
+
+uint64
+FairShareSessionIOPolicy ::
+GetPulseTime(const PulseArgs & args)
+{
+   if ((_holderWasRefused == false)||(IsRateLimited() == false)||(_maxRate == 0)) return MUSCLE_TIME_NEVER;
+
+   // Wake up when the bucket has refilled enough to be worth another pass
+   const int64 bytesNeeded = ((int64)GetWakeupThreshold())-_tokens;
+   return (bytesNeeded > 0) ? (args.GetCallbackTime()+((((uint64)bytesNeeded)*MICROS_PER_SECOND)/_maxRate)) : args.GetCallbackTime();
+}
+
+} // end namespace muscle
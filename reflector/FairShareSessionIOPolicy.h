@@ -0,0 +1,168 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#ifndef FairShareSessionIOPolicy_h
+#define FairShareSessionIOPolicy_h
+
+#include "reflector/AbstractSessionIOPolicy.h"
+#include "util/Hashtable.h"
+#include "util/String.h"
+
+namespace muscle {
+
+/**
+ * This policy divides bandwidth fairly amongst the AbstractReflectSessions that use it,
+ * using a weighted deficit-round-robin scheme.  On each pass through the server's event loop,
+ * the byte-budget for that pass is split amongst the sessions that are ready to transfer data,
+ * hierarchically:  first amongst the session-factories (i.e. listening ports) that the sessions
+ * were accepted on, then amongst the client hosts within each factory, and finally amongst the
+ * sessions from each host.  At each level, the split is proportional to the configured weights,
+ * so that (for example) a host with many bulk-transfer connections open can't crowd out a host
+ * that has only one interactive connection open.
+ * <p>
+ * If a maximum rate is specified, the budget comes from a token bucket that refills at that rate
+ * and holds at most (burstBytes) bytes, so the aggregate transfer rate of all the policy's sessions
+ * is limited as with RateLimitSessionIOPolicy.  Otherwise, each ready session's budget is one quantum
+ * per pass (scaled by its weight), which keeps a few high-volume sessions from monopolizing each pass
+ * through the event loop.  In either case, a session that becomes ready after being idle gets its
+ * share on the very next pass, so small messages don't have to wait behind bulk transfers.
+ * <p>
+ * Each FairShareSessionIOPolicy object may referenced by zero or more PolicyHolders at once.
+ */
+class FairShareSessionIOPolicy : public AbstractSessionIOPolicy
+{
+public:
+   /** Constructor.
+     * @param maxRate The maximum aggregate transfer rate to be enforced for all sessions
+     *                that use this policy, in bytes per second.  Defaults to MUSCLE_NO_LIMIT,
+     *                meaning the policy only shares out each pass's I/O fairly and doesn't limit the rate.
+     * @param quantum The number of bytes each ready session (of weight 1) may transfer per pass
+     *                through the event loop, when there is no rate limit.  When there is a rate
+     *                limit, the policy waits for this many bytes' worth of tokens (or burstBytes,
+     *                whichever is less) to accumulate before waking up sessions that ran out of tokens.
+     *                Defaults to 8 kilobytes; minimum value is 128 bytes.
+     * @param burstBytes The maximum number of bytes that may be accumulated in the token bucket,
+     *                   and thereby transferred in a burst after the sessions have been idle for a while.
+     *                   Only meaningful when there is a rate limit.  Defaults to 64 kilobytes; minimum value is 128 bytes.
+     */
+   FairShareSessionIOPolicy(uint32 maxRate = MUSCLE_NO_LIMIT, uint32 quantum = 8*1024, uint32 burstBytes = 64*1024);
+
+   /** Destructor. */
+   virtual ~FairShareSessionIOPolicy();
+
+   /** Sets the weight of the session with the given session ID, relative to the other sessions from the same host.
+     * @param sessionID the session ID of the session (as returned by its GetSessionID() method)
+     * @param weight the session's new weight.  Default weight for sessions is 1; values less than 1 are treated as 1.
+     * @returns B_NO_ERROR on success, or B_OUT_OF_MEMORY on failure.
+     * @note the weight is forgotten when the session stops using this policy for both its input and its output
+     *       (e.g. when the session goes away), so if you detach a session and then re-attach it, you'll need to set its weight again.
+     */
+   status_t SetSessionWeight(uint32 sessionID, uint32 weight) {return _sessionWeights.Put(sessionID, muscleMax(weight, (uint32)1));}
+
+   /** Returns the weight of the session with the given session ID, as previously set via SetSessionWeight(), or 1 if no weight is set for it.
+     * @param sessionID the session ID of the session (as returned by its GetSessionID() method)
+     */
+   MUSCLE_NODISCARD uint32 GetSessionWeight(uint32 sessionID) const {return _sessionWeights.GetWithDefault(sessionID, 1);}
+
+   /** Sets the weight of the given client host, relative to the other hosts connecting through the same factory.
+     * @param hostName the host name of the client (as returned by its sessions' GetHostName() method)
+     * @param weight the host's new weight.  Default weight for hosts is 1; values less than 1 are treated as 1.
+     * @returns B_NO_ERROR on success, or B_OUT_OF_MEMORY on failure.
+     */
+   status_t SetHostWeight(const String & hostName, uint32 weight) {return _hostWeights.Put(hostName, muscleMax(weight, (uint32)1));}
+
+   /** Sets the weight of the sessions accepted on the given port, relative to the sessions accepted on other ports.
+     * @param port the port the session-factory is listening on (as returned by its sessions' GetPort() method)
+     * @param weight the factory's new weight.  Default weight for factories is 1; values less than 1 are treated as 1.
+     * @returns B_NO_ERROR on success, or B_OUT_OF_MEMORY on failure.
+     */
+   status_t SetFactoryWeight(uint16 port, uint32 weight) {return _factoryWeights.Put(port, muscleMax(weight, (uint32)1));}
+
+   /** Removes all the weights previously set via SetSessionWeight(), SetHostWeight() and SetFactoryWeight(). */
+   void ClearWeights() {_sessionWeights.Clear(); _hostWeights.Clear(); _factoryWeights.Clear();}
+
+   /** Sets whether sessions from the same client host should share their host's portion of the bandwidth
+     * (true), or whether each session should be treated as if it were its own host (false).  Defaults to true.
+     * @param groupByHost true to group sessions by host, or false not to.
+     */
+   void SetGroupByHost(bool groupByHost);
+
+   /** Returns true iff sessions are grouped by host.  See SetGroupByHost() for details. */
+   MUSCLE_NODISCARD bool GetGroupByHost() const {return _groupByHost;}
+
+   /** Sets whether sessions accepted on the same port should share that port's portion of the bandwidth
+     * (true), or whether all sessions should be treated as if they had come from the same factory (false).
+     * Defaults to true.
+     * @param groupByFactory true to group sessions by factory, or false not to.
+     */
+   void SetGroupByFactory(bool groupByFactory);
+
+   /** Returns true iff sessions are grouped by factory.  See SetGroupByFactory() for details. */
+   MUSCLE_NODISCARD bool GetGroupByFactory() const {return _groupByFactory;}
+
+   /** Returns the maximum aggregate transfer rate, in bytes per second, as passed in to our constructor. */
+   MUSCLE_NODISCARD uint32 GetMaxRate() const {return _maxRate;}
+
+   virtual void PolicyHolderAdded(const PolicyHolder & holder);
+   virtual void PolicyHolderRemoved(const PolicyHolder & holder);
+
+   virtual void BeginIO(uint64 now);
+   virtual bool OkayToTransfer(const PolicyHolder & holder);
+   MUSCLE_NODISCARD virtual uint32 GetMaxTransferChunkSize(const PolicyHolder & holder);
+   virtual void BytesTransferred(const PolicyHolder & holder, uint32 numBytes);
+   virtual void EndIO(uint64 now);
+
+   MUSCLE_NODISCARD virtual uint64 GetPulseTime(const PulseArgs & args);
+
+private:
+   class HolderState
+   {
+   public:
+      HolderState() : _deficit(0), _port(0), _isActive(false), _isApproved(false), _groupKeyValid(false) {/* empty */}
+
+      int64 _deficit;      // how many bytes this holder may still transfer
+      String _hostName;    // cached, since it won't change while the session is attached
+      String _groupKey;    // identifies our host-group within our factory-group
+      uint16 _port;
+      bool _isActive;      // true iff OkayToTransfer() was called for us during the current pass
+      bool _isApproved;    // true iff OkayToTransfer() returned true for us during the current pass
+      bool _groupKeyValid;
+   };
+
+   bool IsRateLimited() const {return (_maxRate != MUSCLE_NO_LIMIT);}
+   uint32 GetWakeupThreshold() const {return muscleMin(_quantum, _burstBytes);}
+   void RefillTokens(uint64 now);
+   void AllocateShares();
+   void UpdateGroupKey(const PolicyHolder & holder, HolderState & hs) const;
+   void InvalidateGroupKeys();
+   void ReturnDeficit(HolderState & hs);
+
+   const uint32 _maxRate;
+   const uint32 _quantum;
+   const uint32 _burstBytes;
+   bool _groupByHost;
+   bool _groupByFactory;
+
+   Hashtable<PolicyHolder, HolderState> _holders;
+   Hashtable<uint32, uint32> _sessionWeights;
+   Hashtable<String, uint32> _hostWeights;
+   Hashtable<uint16, uint32> _factoryWeights;
+
+   // scratch tables used by AllocateShares(); kept as members to avoid reallocating them on every pass
+   Hashtable<String, double> _groupTotals;    // host-group key -> sum of session weights of the approved sessions in that group
+   Hashtable<uint16, double> _factoryTotals;  // port -> sum of host weights of the host-groups with approved sessions in that factory
+
+   int64 _tokens;             // bytes in the token bucket (only used when rate-limited)
+   int64 _totalDeficit;       // sum of all our holders' deficits (only used when rate-limited)
+   uint64 _lastRefillAt;
+   uint64 _refillRemainder;   // fractional bytes (times MICROS_PER_SECOND) left over from the previous refill
+   uint32 _numApproved;       // number of holders approved during the current pass
+   bool _sharesAllocated;     // true iff AllocateShares() has been called during the current pass
+   bool _holderWasRefused;    // true iff OkayToTransfer() returned false for someone during the current pass
+
+   DECLARE_COUNTED_OBJECT(FairShareSessionIOPolicy);
+};
+DECLARE_REFTYPES(FairShareSessionIOPolicy);
+
+} // end namespace muscle
+
+#endif
@@ -7,6 +7,7 @@
 #include "reflector/SignalHandlerSession.h"
 #include "system/SetupSystem.h"  // for IsCurrentThreadMainThread()
 #endif
+#include "system/StackTrace.h"   // for StackTrace::StaticPrintStackTrace()
 #include "system/SystemInfo.h"   // for PrintBuildFlags()
 #include "util/MiscUtilityFunctions.h"  // for GetInsecurePseudoRandomNumber64()
 #include "util/NetworkUtilityFunctions.h"
@@ -274,11 +275,24 @@ ReflectServer :: ReflectServer()
    , _lameDuckSessions(PreallocatedItemSlotsCount(256)) // make sure _lameDuckSessions has plenty of memory available in advance (we need might need it in a tight spot later!)
    , _maxInputChunkSize(DEFAULT_MAX_CHUNK_SIZE)
    , _maxOutputChunkSize(DEFAULT_MAX_CHUNK_SIZE)
+   , _numAcceptSocketsPerPort(1)
+   , _acceptBacklog(20)
+   , _maxAcceptsPerIteration(64)
+   , _numAcceptedConnections(0)
+   , _numAcceptBudgetExhaustions(0)
+   , _largestAcceptBatch(0)
+   , _acceptRateWindowStart(0)
+   , _acceptsInRateWindow(0)
+   , _acceptRate(0.0)
    , _keepServerGoing(true)
    , _serverStartedAt(0)
    , _doLogging(true)
    , _serverSessionID(GetInsecurePseudoRandomNumber64())
    , _computerIsAboutToSleep(false)
+   , _eventLoopStatsEnabled(false)
+   , _slowCallbackThreshold(MUSCLE_TIME_NEVER)
+   , _numSlowCallbacks(0)
+   , _lastSlowCallbackStackTraceTime(0)
 {
    if (_serverSessionID == 0) _serverSessionID++;  // paranoia:  make sure 0 can be used as a guard value
 }
@@ -389,9 +403,15 @@ uint64 ReflectServer :: PrepareToWaitForEvents()
    {
       for (ConstHashtableIterator<IPAddressAndPort, ReflectSessionFactoryRef> iter(_factories); iter.HasData(); iter++)
       {
-         ConstSocketRef * nextAcceptSocket = iter.GetValue()()->IsReadyToAcceptSessions() ? _factorySockets.Get(iter.GetKey()) : NULL;
-         const int nfd = nextAcceptSocket ? nextAcceptSocket->GetFileDescriptor() : -1;
-         if (nfd >= 0) (void) _multiplexer.RegisterSocketForReadReady(nfd);
+         const Queue<ConstSocketRef> * acceptSockets = iter.GetValue()()->IsReadyToAcceptSessions() ? _factorySockets.Get(iter.GetKey()) : NULL;
+         if (acceptSockets)
+         {
+            for (uint32 i=0; i<acceptSockets->GetNumItems(); i++)
+            {
+               const int nfd = (*acceptSockets)[i].GetFileDescriptor();
+               if (nfd >= 0) (void) _multiplexer.RegisterSocketForReadReady(nfd);
+            }
+         }
          CallGetPulseTimeAux(*iter.GetValue()(), now, nextPulseAt);
       }
    }
@@ -485,6 +505,212 @@ uint64 ReflectServer :: PrepareToWaitForEvents()
    return nextPulseAt;
 }
 
+static const char * _eventLoopPhaseNames[] = {
+   "LoopIteration",
+   "DoInput",
+   "DoOutput",
+   "Pulse",
+   "MessageReceivedFromGateway"
+};
+MUSCLE_STATIC_ASSERT_ARRAY_LENGTH(_eventLoopPhaseNames, NUM_EVENT_LOOP_PHASES);
+
+const char * GetEventLoopPhaseName(uint32 phase)
+{
+   return (phase < ARRAYITEMS(_eventLoopPhaseNames)) ? _eventLoopPhaseNames[phase] : "???";
+}
+
+/** Passes incoming Messages on to a session, counting them, and (if event-loop stats are enabled) recording how long the session takes to handle each one */
+class ReflectServer :: SessionMessageReceiver : public AbstractGatewayMessageReceiver
+{
+public:
+   SessionMessageReceiver(ReflectServer & server, AbstractReflectSession & session)
+      : _server(server)
+      , _session(session)
+   {
+      // empty
+   }
+
+protected:
+   virtual void MessageReceivedFromGateway(const MessageRef & msg, void * userData)
+   {
+      _session._numMessagesReceived++;
+      if (_server._eventLoopStatsEnabled)
+      {
+         const uint64 startTime = GetRunTime64();
+         _session.MessageReceivedFromGateway(msg, userData);
+         _session.AfterMessageReceivedFromGateway(msg, userData);
+         _server.RecordEventLoopPhase(EVENT_LOOP_PHASE_MESSAGE_RECEIVED, &_session, startTime, msg());
+      }
+      else
+      {
+         _session.MessageReceivedFromGateway(msg, userData);
+         _session.AfterMessageReceivedFromGateway(msg, userData);
+      }
+   }
+
+   virtual void BeginMessageReceivedFromGatewayBatch() {_session.BeginMessageReceivedFromGatewayBatch();}
+   virtual void EndMessageReceivedFromGatewayBatch()   {_session.EndMessageReceivedFromGatewayBatch();}
+
+private:
+   ReflectServer & _server;
+   AbstractReflectSession & _session;
+};
+
+void ReflectServer :: RecordEventLoopPhase(uint32 phase, AbstractReflectSession * optSession, uint64 startTime, const Message * optMsg)
+{
+   const uint64 elapsed = GetRunTime64()-startTime;
+   _eventLoopStats._histograms[phase].RecordValue(elapsed);
+   if (optSession)
+   {
+      if (phase != EVENT_LOOP_PHASE_MESSAGE_RECEIVED) optSession->_totalCallbackTime += elapsed;  // MessageReceivedFromGateway() calls are already included in DoInput()'s time
+
+      EventLoopPhaseStats * typeStats = _sessionTypeEventLoopStats.GetOrPut(typeid(*optSession).name());
+      if (typeStats)
+      {
+         if (typeStats->_typeName.IsEmpty()) typeStats->_typeName = optSession->GetTypeName();
+         typeStats->_histograms[phase].RecordValue(elapsed);
+      }
+      if (elapsed >= _slowCallbackThreshold) ReportSlowCallback(phase, *optSession, elapsed, optMsg);
+   }
+}
+
+void ReflectServer :: ReportSlowCallback(uint32 phase, const AbstractReflectSession & session, uint64 elapsed, const Message * optMsg)
+{
+   _numSlowCallbacks++;
+
+   const String whatStr = optMsg ? String(" while handling a Message with what-code %1").Arg(GetTypeCodeString(optMsg->what)) : String();
+   LogTime(MUSCLE_LOG_WARNING, "Slow callback:  %s() took %s for session [%s]%s (threshold is %s)\n", GetEventLoopPhaseName(phase), GetHumanReadableUnsignedTimeIntervalString(elapsed)(), session.GetSessionDescriptionString()(), whatStr(), GetHumanReadableUnsignedTimeIntervalString(_slowCallbackThreshold)());
+
+   // Stack traces are expensive, so we'll print at most one per second
+   if (OnceEvery(MICROS_PER_SECOND, _lastSlowCallbackStackTraceTime)) (void) StackTrace::StaticPrintStackTrace(MUSCLE_LOG_WARNING);
+}
+
+void ReflectServer :: ResetEventLoopStats()
+{
+   for (uint32 i=0; i<NUM_EVENT_LOOP_PHASES; i++) _eventLoopStats._histograms[i].Reset();
+   _sessionTypeEventLoopStats.Clear();
+   _numSlowCallbacks = 0;
+}
+
+static status_t SaveEventLoopPhaseHistogramsToMessage(const LatencyHistogram * histograms, Message & msg)
+{
+   for (uint32 i=0; i<NUM_EVENT_LOOP_PHASES; i++)
+   {
+      const LatencyHistogram & h = histograms[i];
+      if (h.GetCount() > 0)
+      {
+         MessageRef hMsg = GetMessageFromPool();
+         MRETURN_ON_ERROR(hMsg);
+         MRETURN_ON_ERROR(h.SaveToMessage(*hMsg()));
+         MRETURN_ON_ERROR(msg.AddMessage(GetEventLoopPhaseName(i), hMsg));
+      }
+   }
+   return B_NO_ERROR;
+}
+
+status_t ReflectServer :: SaveEventLoopStatsToMessage(Message & msg) const
+{
+   MRETURN_ON_ERROR(msg.AddInt64("slowcallbacks", _numSlowCallbacks));
+   if (_slowCallbackThreshold != MUSCLE_TIME_NEVER) MRETURN_ON_ERROR(msg.AddInt64("slowthreshold", _slowCallbackThreshold));
+   MRETURN_ON_ERROR(SaveEventLoopPhaseHistogramsToMessage(_eventLoopStats._histograms, msg));
+
+   MessageRef typesMsg = GetMessageFromPool();
+   MRETURN_ON_ERROR(typesMsg);
+   for (ConstHashtableIterator<const void *, EventLoopPhaseStats> iter(_sessionTypeEventLoopStats); iter.HasData(); iter++)
+   {
+      MessageRef typeMsg = GetMessageFromPool();
+      MRETURN_ON_ERROR(typeMsg);
+      MRETURN_ON_ERROR(SaveEventLoopPhaseHistogramsToMessage(iter.GetValue()._histograms, *typeMsg()));
+      MRETURN_ON_ERROR(typesMsg()->AddMessage(iter.GetValue()._typeName, typeMsg));
+   }
+   return msg.AddMessage("sessiontypes", typesMsg);
+}
+
+static void PrintEventLoopPhaseHistograms(const OutputPrinter & p, const LatencyHistogram * histograms)
+{
+   for (uint32 i=0; i<NUM_EVENT_LOOP_PHASES; i++)
+   {
+      const LatencyHistogram & h = histograms[i];
+      if (h.GetCount() > 0)
+      {
+         p.printf("%s:  ", GetEventLoopPhaseName(i));
+         h.Print(p);
+      }
+   }
+}
+
+void ReflectServer :: PrintEventLoopStats(const OutputPrinter & p) const
+{
+   p.printf("Event-loop latency statistics for %s (" UINT64_FORMAT_SPEC " slow callbacks detected):\n", GetServerName(), _numSlowCallbacks);
+   PrintEventLoopPhaseHistograms(p.WithIndent(), _eventLoopStats._histograms);
+   for (ConstHashtableIterator<const void *, EventLoopPhaseStats> iter(_sessionTypeEventLoopStats); iter.HasData(); iter++)
+   {
+      p.WithIndent().printf("Session type [%s]:\n", iter.GetValue()._typeName());
+      PrintEventLoopPhaseHistograms(p.WithIndent(6), iter.GetValue()._histograms);
+   }
+}
+
+status_t ReflectServer :: SaveSessionStatsToMessage(Message & msg) const
+{
+   for (ConstHashtableIterator<const String *, AbstractReflectSessionRef> iter(_sessions); iter.HasData(); iter++)
+   {
+      const AbstractReflectSession * session = iter.GetValue()();
+      if (session)
+      {
+         MessageRef sessionMsg = GetMessageFromPool();
+         MRETURN_ON_ERROR(sessionMsg);
+         MRETURN_ON_ERROR(session->SaveTrafficStatsToMessage(*sessionMsg()));
+         MRETURN_ON_ERROR(msg.AddMessage(*iter.GetKey(), sessionMsg));
+      }
+   }
+   return B_NO_ERROR;
+}
+
+// Escapes a String for use as a label-value in Prometheus's text format
+static String GetPrometheusLabelValue(const String & s)
+{
+   return s.WithReplacements("\\", "\\\\").WithReplacements("\"", "\\\"").WithReplacements("\n", "\\n");
+}
+
+void ReflectServer :: PrintSessionStatsAsPrometheusText(const OutputPrinter & p) const
+{
+   static const char * const _metrics[][4] = {
+      {"bytesin",       "muscle_session_received_bytes_total",        "counter", "Bytes received from the session's client."},
+      {"bytesout",      "muscle_session_sent_bytes_total",            "counter", "Bytes sent to the session's client."},
+      {"msgsin",        "muscle_session_received_messages_total",     "counter", "Messages received from the session's client."},
+      {"msgsout",       "muscle_session_sent_messages_total",         "counter", "Messages queued for sending to the session's client."},
+      {"outqmsgs",      "muscle_session_output_queue_messages",       "gauge",   "Messages currently waiting in the session's output queue."},
+      {"outqbytes",     "muscle_session_output_queue_bytes",          "gauge",   "Flattened size of the Messages currently waiting in the session's output queue."},
+      {"maxoutq",       "muscle_session_output_queue_max_messages",   "gauge",   "Largest number of Messages ever waiting in the session's output queue."},
+      {"callbackus",    "muscle_session_callback_microseconds_total", "counter", "Time spent in the session's Pulse(), DoInput() and DoOutput() calls."},
+      {"subscriptions", "muscle_session_subscriptions",               "gauge",   "Number of node-path subscriptions the session has."},
+      {"nodes",         "muscle_session_nodes",                       "gauge",   "Number of database nodes the session owns."}
+   };
+
+   Message statsMsg;
+   if (SaveSessionStatsToMessage(statsMsg).IsError()) return;
+
+   for (uint32 i=0; i<ARRAYITEMS(_metrics); i++)
+   {
+      const char * const * m = _metrics[i];
+      bool printedHeader = false;
+      for (MessageFieldNameIterator iter = statsMsg.GetFieldNameIterator(B_MESSAGE_TYPE); iter.HasData(); iter++)
+      {
+         MessageRef sessionMsg;
+         int64 val;
+         if ((statsMsg.FindMessage(iter.GetFieldName(), sessionMsg).IsOK())&&(sessionMsg()->FindInt64(m[0], val).IsOK()))
+         {
+            if (printedHeader == false)
+            {
+               p.printf("# HELP %s %s\n# TYPE %s %s\n", m[1], m[3], m[1], m[2]);
+               printedHeader = true;
+            }
+            p.printf("%s{session=\"%s\",type=\"%s\",host=\"%s\"} " INT64_FORMAT_SPEC "\n", m[1], iter.GetFieldName()(), GetPrometheusLabelValue(sessionMsg()->GetString("type"))(), GetPrometheusLabelValue(sessionMsg()->GetString("host"))(), val);
+         }
+      }
+   }
+}
+
 status_t ReflectServer :: WaitForEvents(uint64 waitUntil)
 {
    (void) _inWaitForEvents.AtomicIncrement();   // so a watchdog thread can know we're meant to be waiting at this point
@@ -519,7 +745,9 @@ void ReflectServer :: HandleEvents()
 
             CallSetCycleStartTime(*session, GetRunTime64());
             TCHECKPOINT;
-            CallPulseAux(*session, session->GetCycleStartTime());
+            const uint64 pulseStartTime = session->GetCycleStartTime();
+            bool pulseWasDue = IsPulseDue(*session, pulseStartTime);
+            CallPulseAux(*session, pulseStartTime);
             {
                AbstractMessageIOGateway * gateway = session->GetGateway()();
                if (gateway)
@@ -527,9 +755,11 @@ void ReflectServer :: HandleEvents()
                   TCHECKPOINT;
 
                   CallSetCycleStartTime(*gateway, GetRunTime64());
+                  if (IsPulseDue(*gateway, gateway->GetCycleStartTime())) pulseWasDue = true;
                   CallPulseAux(*gateway, gateway->GetCycleStartTime());
                }
             }
+            if ((pulseWasDue)&&(_eventLoopStatsEnabled)) RecordEventLoopPhase(EVENT_LOOP_PHASE_PULSE, session, pulseStartTime);
 
             TCHECKPOINT;
 
@@ -539,10 +769,14 @@ void ReflectServer :: HandleEvents()
                io_status_t readBytes;
                if (_multiplexer.IsSocketReadyForRead(readSock))
                {
-                  readBytes = session->DoInput(*session, muscleMin(_maxInputChunkSize, session->_maxInputChunk));  // session->MessageReceivedFromGateway() gets called here
+                  const uint64 inputStartTime = _eventLoopStatsEnabled ? GetRunTime64() : 0;
+                  SessionMessageReceiver receiver(*this, *session);
+                  readBytes = session->DoInput(receiver, muscleMin(_maxInputChunkSize, session->_maxInputChunk));  // session->MessageReceivedFromGateway() gets called here (via the receiver)
+                  if (_eventLoopStatsEnabled) RecordEventLoopPhase(EVENT_LOOP_PHASE_DO_INPUT, session, inputStartTime);
                   if (readBytes.IsOK())
                   {
                      session->_mostRecentInputTimeStamp = GetCycleStartTime();
+                     session->_numBytesReceived += readBytes.GetByteCount();
 
                      AbstractSessionIOPolicy * p = session->GetInputPolicy()();
                      if (p) p->BytesTransferred(PolicyHolder(session, true), readBytes.GetByteCount());
@@ -585,10 +819,13 @@ void ReflectServer :: HandleEvents()
                         if (io) io->WriteBufferedOutput();
                      }
 
+                     const uint64 outputStartTime = _eventLoopStatsEnabled ? GetRunTime64() : 0;
                      wroteBytes = session->DoOutput(muscleMin(_maxOutputChunkSize, session->_maxOutputChunk));
+                     if (_eventLoopStatsEnabled) RecordEventLoopPhase(EVENT_LOOP_PHASE_DO_OUTPUT, session, outputStartTime);
                      if (wroteBytes.IsOK())
                      {
                         session->_mostRecentOutputTimeStamp = GetCycleStartTime();
+                        session->_numBytesSent += wroteBytes.GetByteCount();
 
                         AbstractSessionIOPolicy * p = session->GetOutputPolicy()();
                         if (p) p->BytesTransferred(PolicyHolder(session, false), wroteBytes.GetByteCount());
@@ -671,6 +908,8 @@ void ReflectServer :: HandleEvents()
    // Lastly, check our accepting ports to see if anyone is trying to connect...
    if (_factories.HasItems())
    {
+      uint32 acceptBudget = _maxAcceptsPerIteration;  // shared by all factories, so that a connection-storm can't starve our existing sessions
+      bool budgetExhausted = false;
       for (ConstHashtableIterator<IPAddressAndPort, ReflectSessionFactoryRef> iter(_factories); iter.HasData(); iter++)
       {
          ReflectSessionFactory * factory = iter.GetValue()();
@@ -679,12 +918,28 @@ void ReflectServer :: HandleEvents()
 
          if (factory->IsReadyToAcceptSessions())
          {
-            ConstSocketRef * as = _factorySockets.Get(iter.GetKey());
-            const int fd = as ? as->GetFileDescriptor() : -1;
-            if ((fd >= 0)&&(_multiplexer.IsSocketReadyForRead(fd))) (void) DoAccept(iter.GetKey(), *as, factory);
+            // Note that we re-look-up the socket each time, since a new session's setup code could add or remove factories
+            const Queue<ConstSocketRef> * acceptSockets;
+            for (uint32 i=0; (((acceptSockets = _factorySockets.Get(iter.GetKey())) != NULL)&&(i<acceptSockets->GetNumItems())); i++)
+            {
+               const ConstSocketRef as = (*acceptSockets)[i];
+               const int fd = as.GetFileDescriptor();
+               if ((fd >= 0)&&(_multiplexer.IsSocketReadyForRead(fd)))
+               {
+                  if (acceptBudget == 0) {budgetExhausted = true; break;}  // we'll get the rest next time around
+                  acceptBudget -= DoAcceptBatch(iter.GetKey(), as, factory, acceptBudget, budgetExhausted);
+               }
+            }
          }
       }
+
+      const uint32 numAccepted = _maxAcceptsPerIteration-acceptBudget;
+      if (budgetExhausted) _numAcceptBudgetExhaustions++;
+      if (numAccepted > _largestAcceptBatch) _largestAcceptBatch = numAccepted;
+      UpdateAcceptRate(GetRunTime64(), numAccepted);
    }
+
+   if (_eventLoopStatsEnabled) RecordEventLoopPhase(EVENT_LOOP_PHASE_ITERATION, NULL, GetCycleStartTime());
 }
 
 status_t ReflectServer :: DoFirstTimeServerSetup()
@@ -793,10 +1048,12 @@ status_t ReflectServer :: ServerProcessLoop(uint64 maxTime, uint64 * userRetNext
          }
          else if (_doLogging) LogTime(MUSCLE_LOG_CRITICALERROR, "WaitForEvents() failed, aborting! [%s]\n", ret());
       }
+      MergeBiasedRefCountsForCurrentThread();  // a safe point at which to free objects that other threads have released (no-op unless biased refcounting is enabled for this thread)
       EventLoopCycleEnds();
    }
 
    (void) ClearLameDucks();  // get rid of any leftover ducks
+   MergeBiasedRefCountsForCurrentThread();
    return ret;
 }
 
@@ -848,66 +1105,142 @@ void ReflectServer :: LogAcceptFailed(int lvl, const char * desc, const char * i
    }
 }
 
-status_t ReflectServer :: DoAccept(const IPAddressAndPort & iap, const ConstSocketRef & acceptSocket, ReflectSessionFactory * optFactory)
+uint32 ReflectServer :: DoAcceptBatch(const IPAddressAndPort & iap, const ConstSocketRef & acceptSocket, ReflectSessionFactory * factory, uint32 maxAccepts, bool & setIfBudgetExhausted)
 {
-   // Accept a new connection and try to start up a session for it
-   IPAddress acceptedFromIP;
-   ConstSocketRef newSocket = Accept(acceptSocket, &acceptedFromIP);
-   if (newSocket())
+   // Keep accepting until the backlog-queue is empty, so that a burst of connections doesn't
+   // have to wait for one event-loop iteration per connection (and overflow the backlog meanwhile)
+   uint32 numAccepted = 0;
+   while((numAccepted < maxAccepts)&&(factory->IsReadyToAcceptSessions()))
    {
-      if (optFactory)
+      IPAddress acceptedFromIP;
+      ConstSocketRef newSocket = Accept(acceptSocket, &acceptedFromIP);
+      if (newSocket() == NULL)
       {
-         optFactory->_mostRecentAcceptTimeStamp = GetCycleStartTime();
-         optFactory->_acceptCount++;
+         if (numAccepted == 0) LogAcceptFailed(MUSCLE_LOG_DEBUG, "Accept() failed", NULL, iap, newSocket.GetStatus());  // a failure after the first is just the empty-queue case
+         break;
       }
 
-      NestCountGuard ncg(_inDoAccept);
-      status_t gpaStatus;
-      const IPAddressAndPort nip(acceptedFromIP, iap.GetPort());
-      const IPAddress remoteIP = GetPeerAddress(newSocket, true, &gpaStatus).GetIPAddress();
-      if (remoteIP == invalidIP)
-      {
-         LogAcceptFailed(MUSCLE_LOG_DEBUG, "GetPeerAddress() failed", NULL, nip, gpaStatus);
-         return gpaStatus;
-      }
-      else
-      {
-         status_t ret;
+      numAccepted++;
+      _numAcceptedConnections++;
+      (void) DoAccept(iap, newSocket, acceptedFromIP, factory);
+   }
 
-         char ipbuf[64]; Inet_NtoA(remoteIP, ipbuf);
+   // If we stopped because we used up our budget (rather than because Accept() found the backlog-queue empty), say so.
+   // This is only for the statistics; the accept-socket will still select as ready-for-read next time if anyone is left waiting.
+   if ((numAccepted > 0)&&(numAccepted == maxAccepts)&&(factory->IsReadyToAcceptSessions())) setIfBudgetExhausted = true;
+   return numAccepted;
+}
 
-         AbstractReflectSessionRef newSessionRef;
-         if (optFactory) newSessionRef = optFactory->CreateSession(ipbuf, nip);
+void ReflectServer :: UpdateAcceptRate(uint64 now, uint32 numNewAccepts)
+{
+   if (now >= _acceptRateWindowStart+MICROS_PER_SECOND)
+   {
+      const uint64 elapsed = now-_acceptRateWindowStart;
+      _acceptRate            = (elapsed < 2*MICROS_PER_SECOND) ? (((double)_acceptsInRateWindow)*MICROS_PER_SECOND/elapsed) : 0.0;  // a stale interval means nobody connected recently
+      _acceptRateWindowStart = now;
+      _acceptsInRateWindow   = 0;
+   }
+   _acceptsInRateWindow += numNewAccepts;
+}
 
-         if (newSessionRef())
+double ReflectServer :: GetAcceptRate() const
+{
+   return (GetRunTime64() < _acceptRateWindowStart+(2*MICROS_PER_SECOND)) ? _acceptRate : 0.0;
+}
+
+status_t ReflectServer :: SaveAcceptStatsToMessage(Message & msg) const
+{
+   MRETURN_ON_ERROR(msg.AddInt64("accepts",         _numAcceptedConnections));
+   MRETURN_ON_ERROR(msg.AddInt64("budgetexhausted", _numAcceptBudgetExhaustions));
+   MRETURN_ON_ERROR(msg.AddInt64("maxbatch",        _largestAcceptBatch));
+   MRETURN_ON_ERROR(msg.AddDouble("acceptrate",     GetAcceptRate()));
+
+   uint32 numSockets = 0;
+   for (ConstHashtableIterator<IPAddressAndPort, Queue<ConstSocketRef> > iter(_factorySockets); iter.HasData(); iter++) numSockets += iter.GetValue().GetNumItems();
+   MRETURN_ON_ERROR(msg.AddInt64("acceptsockets", numSockets));
+
+   uint64 numOverflows, numDrops;
+   if (GetListenQueueOverflowCounts(numOverflows, numDrops).IsOK())
+   {
+      MRETURN_ON_ERROR(msg.AddInt64("listenoverflows", numOverflows));
+      MRETURN_ON_ERROR(msg.AddInt64("listendrops",     numDrops));
+   }
+   return B_NO_ERROR;
+}
+
+void ReflectServer :: PrintAcceptStatsAsPrometheusText(const OutputPrinter & p) const
+{
+   static const char * const _metrics[][4] = {
+      {"accepts",         "muscle_accepted_connections_total",       "counter", "Incoming TCP connections accepted by the server."},
+      {"budgetexhausted", "muscle_accept_budget_exhaustions_total",  "counter", "Event-loop iterations that used up their accept-budget with connections still waiting."},
+      {"maxbatch",        "muscle_accept_batch_max",                 "gauge",   "Largest number of connections accepted in a single event-loop iteration."},
+      {"acceptsockets",   "muscle_accept_sockets",                   "gauge",   "Number of listening sockets the server is accepting connections on."},
+      {"listenoverflows", "muscle_listen_queue_overflows_total",     "counter", "Connections the host's kernel dropped because a listen-queue was full."},
+      {"listendrops",     "muscle_listen_queue_drops_total",         "counter", "Connections the host's kernel dropped while they were waiting to be accepted."}
+   };
+
+   Message statsMsg;
+   if (SaveAcceptStatsToMessage(statsMsg).IsError()) return;
+
+   for (uint32 i=0; i<ARRAYITEMS(_metrics); i++)
+   {
+      const char * const * m = _metrics[i];
+      int64 val;
+      if (statsMsg.FindInt64(m[0], val).IsOK()) p.printf("# HELP %s %s\n# TYPE %s %s\n%s " INT64_FORMAT_SPEC "\n", m[1], m[3], m[1], m[2], m[1], val);
+   }
+   p.printf("# HELP muscle_accept_rate Connections accepted per second, over the most recent one-second interval.\n# TYPE muscle_accept_rate gauge\nmuscle_accept_rate %f\n", GetAcceptRate());
+}
+
+status_t ReflectServer :: DoAccept(const IPAddressAndPort & iap, const ConstSocketRef & newSocket, const IPAddress & acceptedFromIP, ReflectSessionFactory * optFactory)
+{
+   // Try to start up a session for the newly accepted connection
+   if (optFactory)
+   {
+      optFactory->_mostRecentAcceptTimeStamp = GetCycleStartTime();
+      optFactory->_acceptCount++;
+   }
+
+   NestCountGuard ncg(_inDoAccept);
+   status_t gpaStatus;
+   const IPAddressAndPort nip(acceptedFromIP, iap.GetPort());
+   const IPAddress remoteIP = GetPeerAddress(newSocket, true, &gpaStatus).GetIPAddress();
+   if (remoteIP == invalidIP)
+   {
+      LogAcceptFailed(MUSCLE_LOG_DEBUG, "GetPeerAddress() failed", NULL, nip, gpaStatus);
+      return gpaStatus;
+   }
+   else
+   {
+      status_t ret;
+
+      char ipbuf[64]; Inet_NtoA(remoteIP, ipbuf);
+
+      AbstractReflectSessionRef newSessionRef;
+      if (optFactory) newSessionRef = optFactory->CreateSession(ipbuf, nip);
+
+      if (newSessionRef())
+      {
+         if (newSessionRef()->_isExpendable.HasValueBeenSet() == false) newSessionRef()->SetExpendable(true);
+         newSessionRef()->_ipAddressAndPort = iap;
+         newSessionRef()->_isConnected      = true;
+         if (AddNewSession(newSessionRef, newSocket).IsOK(ret))
          {
-            if (newSessionRef()->_isExpendable.HasValueBeenSet() == false) newSessionRef()->SetExpendable(true);
-            newSessionRef()->_ipAddressAndPort = iap;
-            newSessionRef()->_isConnected      = true;
-            if (AddNewSession(newSessionRef, newSocket).IsOK(ret))
-            {
-               newSessionRef()->_wasConnected = true;
-               return B_NO_ERROR;  // success!
-            }
-            else
-            {
-               newSessionRef()->_isConnected = false;
-               newSessionRef()->_ipAddressAndPort.Reset();
-            }
+            newSessionRef()->_wasConnected = true;
+            return B_NO_ERROR;  // success!
          }
-         else if (optFactory)
+         else
          {
-            LogAcceptFailed(MUSCLE_LOG_DEBUG, "Session creation denied", ipbuf, nip, newSessionRef.GetStatus());
-            ret = B_ACCESS_DENIED;
+            newSessionRef()->_isConnected = false;
+            newSessionRef()->_ipAddressAndPort.Reset();
          }
-
-         return ret | B_ERROR;
       }
-   }
-   else
-   {
-      LogAcceptFailed(MUSCLE_LOG_DEBUG, "Accept() failed", NULL, iap, newSocket.GetStatus());
-      return B_ERROR("Accept() failed");
+      else if (optFactory)
+      {
+         LogAcceptFailed(MUSCLE_LOG_DEBUG, "Session creation denied", ipbuf, nip, newSessionRef.GetStatus());
+         ret = B_ACCESS_DENIED;
+      }
+
+      return ret | B_ERROR;
    }
 }
 
@@ -1027,14 +1360,35 @@ PutAcceptFactory(uint16 port, const ReflectSessionFactoryRef & factoryRef, const
    ReflectSessionFactory * f = factoryRef();
    if (f)
    {
-      ConstSocketRef acceptSocket = CreateAcceptingSocket(port, 20, &port, optInterfaceIP);
+      const bool wantReusePort = (_numAcceptSocketsPerPort > 1);
+      ConstSocketRef acceptSocket = CreateAcceptingSocket(port, _acceptBacklog, &port, optInterfaceIP, SOCKET_FAMILY_PREFERRED, wantReusePort);
+      const bool reusePort = ((wantReusePort)&&(acceptSocket.GetStatus() != B_UNIMPLEMENTED));
+      if ((wantReusePort)&&(reusePort == false)) acceptSocket = CreateAcceptingSocket(port, _acceptBacklog, &port, optInterfaceIP);  // no SO_REUSEPORT here, so just use one socket
       if (acceptSocket())
       {
          status_t ret;
          const IPAddressAndPort iap(optInterfaceIP, port);
-         if ((SetSocketBlockingEnabled(acceptSocket, false).IsOK(ret))&&(_factories.Put(iap, factoryRef).IsOK(ret)))
+
+         Queue<ConstSocketRef> acceptSockets;
+         if ((SetSocketBlockingEnabled(acceptSocket, false).IsOK(ret))&&(acceptSockets.AddTail(acceptSocket).IsOK(ret)))
+         {
+            // Any additional sockets must bind to the port the first one got, in case (port) was zero
+            for (uint32 i=1; ((reusePort)&&(i<_numAcceptSocketsPerPort)); i++)
+            {
+               ConstSocketRef extraSocket = CreateAcceptingSocket(port, _acceptBacklog, NULL, optInterfaceIP, SOCKET_FAMILY_PREFERRED, true);
+               status_t extraRet = extraSocket.GetStatus();
+               if ((extraSocket() == NULL)||(SetSocketBlockingEnabled(extraSocket, false).IsError(extraRet))||(acceptSockets.AddTail(extraSocket).IsError(extraRet)))
+               {
+                  // Not fatal; we'll just have to make do with fewer backlog-queues
+                  if (_doLogging) LogTime(MUSCLE_LOG_WARNING, "Could only create " UINT32_FORMAT_SPEC " of " UINT32_FORMAT_SPEC " accepting sockets for port %u [%s]\n", acceptSockets.GetNumItems(), _numAcceptSocketsPerPort, port, (extraRet|B_ERROR)());
+                  break;
+               }
+            }
+         }
+
+         if ((ret.IsOK())&&(_factories.Put(iap, factoryRef).IsOK(ret)))
          {
-            if (_factorySockets.Put(iap, acceptSocket).IsOK(ret))
+            if (_factorySockets.Put(iap, acceptSockets).IsOK(ret))
             {
                f->SetOwner(this);
                if (f->AttachedToServer().IsOK(ret))
@@ -6,11 +6,27 @@
 #include "reflector/AbstractReflectSession.h"
 #include "support/NotCopyable.h"
 #include "system/AtomicCounter.h"
+#include "util/LatencyHistogram.h"
 #include "util/NestCount.h"
 #include "util/SocketMultiplexer.h"
 
 namespace muscle {
 
+/** Phases of the ReflectServer's event loop that latency histograms are kept for.  See ReflectServer::SetEventLoopStatsEnabled(). */
+enum {
+   EVENT_LOOP_PHASE_ITERATION = 0,    /**< one pass through the event loop, not counting the time spent waiting for events */
+   EVENT_LOOP_PHASE_DO_INPUT,         /**< a session's DoInput() call (including any MessageReceivedFromGateway() calls it makes) */
+   EVENT_LOOP_PHASE_DO_OUTPUT,        /**< a session's DoOutput() call */
+   EVENT_LOOP_PHASE_PULSE,            /**< a session's (and its gateway's) Pulse() calls */
+   EVENT_LOOP_PHASE_MESSAGE_RECEIVED, /**< a session's MessageReceivedFromGateway() and AfterMessageReceivedFromGateway() calls for a single Message */
+   NUM_EVENT_LOOP_PHASES              /**< guard value */
+};
+
+/** Returns a human-readable name for the given EVENT_LOOP_PHASE_* value (e.g. "DoInput"), or "???" if the value isn't valid.
+  * @param phase an EVENT_LOOP_PHASE_* value
+  */
+MUSCLE_NODISCARD MUSCLE_NEVER_RETURNS_NULL const char * GetEventLoopPhaseName(uint32 phase);
+
 /** This class represents a MUSCLE server:  It runs on a centrally located machine,
  *  and many clients may connect to it simultaneously.  This server can then redirect messages
  *  uploaded by any client to other clients in a somewhat efficient manner.
@@ -326,6 +342,134 @@ public:
      */
    MUSCLE_NODISCARD bool IsWaitingForEvents() const {return (_inWaitForEvents.GetCount() == 1);}
 
+   /** Sets whether or not this server should time each phase of its event loop (see the EVENT_LOOP_PHASE_* enum)
+     * and record the timings in per-phase, per-session-type latency histograms.  The overhead is a couple of
+     * GetRunTime64() calls per callback.  Default state is false.
+     * @param enable true to record event-loop timings, or false to stop recording them.
+     */
+   void SetEventLoopStatsEnabled(bool enable) {_eventLoopStatsEnabled = enable;}
+
+   /** Returns true iff we are currently recording event-loop timings.  See SetEventLoopStatsEnabled(). */
+   MUSCLE_NODISCARD bool GetEventLoopStatsEnabled() const {return _eventLoopStatsEnabled;}
+
+   /** Sets a threshold for the slow-callback detector.  Whenever a session's DoInput(), DoOutput(), Pulse() or
+     * MessageReceivedFromGateway() call takes this long or longer, a warning (including the session's description,
+     * the Message's what-code, and a stack trace) will be logged.  Event-loop stats must be enabled for this to work.
+     * @param threshold the threshold, in microseconds, or MUSCLE_TIME_NEVER to disable the detector.  Default is MUSCLE_TIME_NEVER.
+     */
+   void SetSlowCallbackThreshold(uint64 threshold) {_slowCallbackThreshold = threshold;}
+
+   /** Returns the current slow-callback threshold, in microseconds.  See SetSlowCallbackThreshold(). */
+   MUSCLE_NODISCARD uint64 GetSlowCallbackThreshold() const {return _slowCallbackThreshold;}
+
+   /** Returns the number of slow callbacks that have been detected since the event-loop stats were last reset. */
+   MUSCLE_NODISCARD uint64 GetNumSlowCallbacks() const {return _numSlowCallbacks;}
+
+   /** Returns the server-wide latency histogram for the specified event-loop phase.
+     * @param phase an EVENT_LOOP_PHASE_* value
+     */
+   MUSCLE_NODISCARD const LatencyHistogram & GetEventLoopHistogram(uint32 phase) const {return _eventLoopStats._histograms[muscleMin(phase, (uint32)NUM_EVENT_LOOP_PHASES-1)];}
+
+   /** Clears all of our event-loop latency histograms and our slow-callback count. */
+   void ResetEventLoopStats();
+
+   /** Adds our event-loop statistics to the specified Message.  For each event-loop phase that has recorded any
+     * timings, a sub-Message (as written by LatencyHistogram::SaveToMessage()) is added under the phase's name.
+     * A "sessiontypes" sub-Message contains per-phase sub-Messages for each session type, under the type's name.
+     * @param msg the Message to add our statistics to.
+     * @returns B_NO_ERROR on success, or an error code on failure.
+     */
+   status_t SaveEventLoopStatsToMessage(Message & msg) const;
+
+   /** Prints our event-loop statistics using the specified OutputPrinter.
+     * @param p the OutputPrinter to print with
+     */
+   void PrintEventLoopStats(const OutputPrinter & p) const;
+
+   /** Adds the traffic counters of each of our attached sessions to the specified Message.  Each session's
+     * counters (as written by AbstractReflectSession::SaveTrafficStatsToMessage()) are added as a sub-Message,
+     * under the session's ID string.
+     * @param msg the Message to add our sub-Messages to.
+     * @returns B_NO_ERROR on success, or an error code on failure.
+     */
+   status_t SaveSessionStatsToMessage(Message & msg) const;
+
+   /** Prints the traffic counters of each of our attached sessions using the specified OutputPrinter, in the
+     * Prometheus text exposition format, so that the output can be scraped by a Prometheus server (e.g. via
+     * the textfile-collector of node_exporter).
+     * @param p the OutputPrinter to print with
+     */
+   void PrintSessionStatsAsPrometheusText(const OutputPrinter & p) const;
+
+   /** Sets the number of listening-sockets that PutAcceptFactory() will create for each port.  If more than one,
+     * the sockets are all bound to the same port using SO_REUSEPORT, so that the kernel can spread incoming
+     * connections across their separate backlog-queues; that makes it much less likely that connections will
+     * be dropped when many clients try to connect at once (e.g. when they all reconnect after a failover).
+     * Only affects subsequent calls to PutAcceptFactory().  Default value is 1.
+     * @param numSockets the number of listening-sockets per port.  Values less than 1 are treated as 1.
+     * @note SO_REUSEPORT's load-balancing is a Linux feature; on OS's without SO_REUSEPORT, only one socket will be created.
+     */
+   void SetNumAcceptSocketsPerPort(uint32 numSockets) {_numAcceptSocketsPerPort = muscleMax(numSockets, (uint32)1);}
+
+   /** Returns the number of listening-sockets that PutAcceptFactory() will create for each port.  Default value is 1. */
+   MUSCLE_NODISCARD uint32 GetNumAcceptSocketsPerPort() const {return _numAcceptSocketsPerPort;}
+
+   /** Sets the maximum length of the backlog-queue that PutAcceptFactory() will specify when creating its
+     * listening-sockets.  (The OS may silently clamp this value; under Linux, see /proc/sys/net/core/somaxconn)
+     * Only affects subsequent calls to PutAcceptFactory().  Default value is 20.
+     * @param backlog the new maximum backlog-queue length, per listening-socket.
+     */
+   void SetAcceptBacklog(uint32 backlog) {_acceptBacklog = muscleMax(backlog, (uint32)1);}
+
+   /** Returns the backlog-queue length that PutAcceptFactory() will use.  Default value is 20. */
+   MUSCLE_NODISCARD uint32 GetAcceptBacklog() const {return _acceptBacklog;}
+
+   /** Sets the maximum number of incoming connections this ReflectServer will accept during a single
+     * iteration of its event loop.  When a listening-socket is ready, the server accepts connections from
+     * it until its backlog-queue is empty or this budget is used up, so that a flood of new connections
+     * can't keep the already-connected sessions from being serviced.  Default value is 64.
+     * @param maxAccepts the new per-iteration budget.  Values less than 1 are treated as 1.
+     */
+   void SetMaxAcceptsPerIteration(uint32 maxAccepts) {_maxAcceptsPerIteration = muscleMax(maxAccepts, (uint32)1);}
+
+   /** Returns the maximum number of incoming connections that will be accepted per event-loop iteration.  Default value is 64. */
+   MUSCLE_NODISCARD uint32 GetMaxAcceptsPerIteration() const {return _maxAcceptsPerIteration;}
+
+   /** Returns the number of incoming TCP connections that have been accepted since this ReflectServer was created.
+     * (This includes connections that were accepted but then refused by their factory)
+     */
+   MUSCLE_NODISCARD uint64 GetNumAcceptedConnections() const {return _numAcceptedConnections;}
+
+   /** Returns the number of event-loop iterations in which the accept-budget (see SetMaxAcceptsPerIteration())
+     * was used up before all of the waiting connections could be accepted.  If this number climbs steadily,
+     * connections are arriving faster than the server is accepting them.
+     * @note an iteration that used up its budget on exactly as many connections as were waiting is counted too,
+     *       since finding out that the backlog-queue had just emptied would take another Accept() call.
+     */
+   MUSCLE_NODISCARD uint64 GetNumAcceptBudgetExhaustions() const {return _numAcceptBudgetExhaustions;}
+
+   /** Returns the largest number of connections that were accepted during a single event-loop iteration. */
+   MUSCLE_NODISCARD uint32 GetLargestAcceptBatch() const {return _largestAcceptBatch;}
+
+   /** Returns the rate at which incoming connections were accepted, in connections per second,
+     * as measured over the most recent one-second interval.
+     */
+   MUSCLE_NODISCARD double GetAcceptRate() const;
+
+   /** Adds our connection-accepting statistics to the specified Message, as int64 fields named "accepts",
+     * "budgetexhausted", "maxbatch", "acceptsockets", and (if the OS supports it) "listenoverflows" and "listendrops"
+     * (see GetListenQueueOverflowCounts()), and as a double field named "acceptrate".
+     * @param msg the Message to add our statistics to.
+     * @returns B_NO_ERROR on success, or an error code on failure.
+     */
+   status_t SaveAcceptStatsToMessage(Message & msg) const;
+
+   /** Prints our connection-accepting statistics (as described in SaveAcceptStatsToMessage()) using the
+     * specified OutputPrinter, in the Prometheus text exposition format.
+     * @param p the OutputPrinter to print with
+     */
+   void PrintAcceptStatsAsPrometheusText(const OutputPrinter & p) const;
+
    /** Implemented to call DisconnectSession() on any attached TCP-based sessions, just before
      * the computer goes to sleep, so that other computers won't have to deal with moribund
      * TCP connections that this computer won't handle while it's asleep.
@@ -420,7 +564,9 @@ private:
    uint32 DumpBoggedSessions();
    status_t RemoveAcceptFactoryAux(const IPAddressAndPort & iap);
    status_t FinalizeAsyncConnect(const AbstractReflectSessionRef & ref);
-   status_t DoAccept(const IPAddressAndPort & iap, const ConstSocketRef & acceptSocket, ReflectSessionFactory * optFactory);
+   uint32 DoAcceptBatch(const IPAddressAndPort & iap, const ConstSocketRef & acceptSocket, ReflectSessionFactory * factory, uint32 maxAccepts, bool & setIfBudgetExhausted);
+   status_t DoAccept(const IPAddressAndPort & iap, const ConstSocketRef & newSocket, const IPAddress & acceptedFromIP, ReflectSessionFactory * optFactory);
+   void UpdateAcceptRate(uint64 now, uint32 numNewAccepts);
    void LogAcceptFailed(int lvl, const char * desc, const char * ipbuf, const IPAddressAndPort & iap, status_t failStatus);
    uint32 CheckPolicy(Hashtable<AbstractSessionIOPolicyRef, Void> & policies, const AbstractSessionIOPolicyRef & policyRef, const PolicyHolder & ph, uint64 now) const;
    void CheckForOutOfMemory(const AbstractReflectSessionRef & optSessionRef);
@@ -431,9 +577,23 @@ private:
    uint64 PrepareToWaitForEvents();
    status_t WaitForEvents(uint64 waitUntil);
    void HandleEvents();
+   void RecordEventLoopPhase(uint32 phase, AbstractReflectSession * optSession, uint64 startTime, const Message * optMsg = NULL);
+   void ReportSlowCallback(uint32 phase, const AbstractReflectSession & session, uint64 elapsed, const Message * optMsg);
+
+   class SessionMessageReceiver;  // passes Messages on to a session, counting and timing each callback
+   friend class SessionMessageReceiver;
+
+   class EventLoopPhaseStats
+   {
+   public:
+      EventLoopPhaseStats() {/* empty */}
+
+      String _typeName;
+      LatencyHistogram _histograms[NUM_EVENT_LOOP_PHASES];
+   };
 
    Hashtable<IPAddressAndPort, ReflectSessionFactoryRef> _factories;
-   Hashtable<IPAddressAndPort, ConstSocketRef> _factorySockets;
+   Hashtable<IPAddressAndPort, Queue<ConstSocketRef> > _factorySockets;  // one or more SO_REUSEPORT sockets per factory
 
    Queue<ReflectSessionFactoryRef> _lameDuckFactories;  // for delayed-deletion of factories when they go away
 
@@ -446,6 +606,16 @@ private:
    uint32 _maxInputChunkSize;
    uint32 _maxOutputChunkSize;
 
+   uint32 _numAcceptSocketsPerPort;
+   uint32 _acceptBacklog;
+   uint32 _maxAcceptsPerIteration;
+   uint64 _numAcceptedConnections;
+   uint64 _numAcceptBudgetExhaustions;
+   uint32 _largestAcceptBatch;
+   uint64 _acceptRateWindowStart;   // start time of the current accept-rate measurement interval
+   uint32 _acceptsInRateWindow;     // connections accepted so far during the current interval
+   double _acceptRate;              // connections per second during the previous interval
+
    bool _keepServerGoing;
    uint64 _serverStartedAt;
    bool _doLogging;
@@ -470,6 +640,13 @@ private:
    bool _computerIsAboutToSleep;
    Hashtable<String, bool> _sessionsToReconnectOnWakeup;
 
+   bool _eventLoopStatsEnabled;
+   uint64 _slowCallbackThreshold;
+   uint64 _numSlowCallbacks;
+   uint64 _lastSlowCallbackStackTraceTime;
+   EventLoopPhaseStats _eventLoopStats;  // server-wide totals
+   Hashtable<const void *, EventLoopPhaseStats> _sessionTypeEventLoopStats;  // keyed by the session's typeid().name() pointer
+
    DECLARE_COUNTED_OBJECT(ReflectServer);
 };
 DECLARE_REFTYPES(ReflectServer);
@@ -1,5 +1,10 @@
 /* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
 
+#ifndef WIN32
+# include <signal.h>  // for SIGUSR1
+#endif
+
+#include "reflector/ReflectServer.h"
 #include "reflector/SignalHandlerSession.h"
 #include "system/AtomicCounter.h"
 #include "system/SignalMultiplexer.h"
@@ -55,8 +60,31 @@ void SignalHandlerSession :: AboutToDetachFromServer()
    _numValidRecvBytes = 0;  // so any currently-received partial-SignalEventInfo bytes won't confuse us later on (should we ever re-attach)
 }
 
+status_t SignalHandlerSession :: GetNthSignalNumber(uint32 n, int & signalNumber) const
+{
+   const status_t ret = ISignalHandler::GetNthSignalNumber(n, signalNumber);
+#ifdef SIGUSR1
+   int junk;
+   if ((ret.IsError())&&(n > 0)&&(ISignalHandler::GetNthSignalNumber(n-1, junk).IsOK()))
+   {
+      signalNumber = SIGUSR1;  // appended just after the default signals
+      return B_NO_ERROR;
+   }
+#endif
+   return ret;
+}
+
 void SignalHandlerSession :: SignalReceived(const SignalEventInfo & sei)
 {
+#ifdef SIGUSR1
+   if (sei.GetSignalNumber() == SIGUSR1)
+   {
+      ReflectServer * server = GetOwner();
+      if (server) server->PrintEventLoopStats(MUSCLE_LOG_INFO);
+      return;
+   }
+#endif
+
    LogTime(MUSCLE_LOG_CRITICALERROR, "Signal #%i received from process #" UINT64_FORMAT_SPEC ", ending event loop!\n", sei.GetSignalNumber(), (uint64) sei.GetFromProcessID());
    EndServer();
 }
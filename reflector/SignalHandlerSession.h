@@ -11,6 +11,8 @@ namespace muscle {
 /** This session can be added to a ReflectServer in order to have the server
   * catch signals (eg SIGINT on Unix/MacOS, Console signals on Windows)
   * and react by initiating a controlled shutdown of the server.
+  * Under Unix/MacOS it also catches SIGUSR1, and reacts to that by logging the
+  * server's event-loop latency statistics (see ReflectServer::PrintEventLoopStats()).
   */
 class SignalHandlerSession : public AbstractReflectSession, public ISignalHandler
 {
@@ -30,10 +32,18 @@ public:
    virtual void AboutToDetachFromServer();
    virtual void SignalHandlerFunc(const SignalEventInfo & sei);
 
+   /** Overridden to add SIGUSR1 (where available) to the default set of signals.
+     * @param n the index of the signal number to return
+     * @param signalNumber on success, the signal number is written here
+     * @returns B_NO_ERROR on success, or an error code if (n) is out of range.
+     */
+   virtual status_t GetNthSignalNumber(uint32 n, int & signalNumber) const;
+
 protected:
    /** This method is called in the main thread whenever a signal is received.
      * @param sei information about what signal was receive, and from whom.
-     * Default behavior is to always just call EndServer() so that the server process
+     * Default behavior is to log our ReflectServer's event-loop statistics if the
+     * signal was SIGUSR1, or otherwise to call EndServer() so that the server process
      * will exit cleanly as soon as possible.
      */
    virtual void SignalReceived(const SignalEventInfo & sei);
@@ -37,7 +37,7 @@ enum
    PR_COMMAND_SETDATATREES,       /**< Sets an entire subtree of data from a single Message (Not implemented!) */
    PR_COMMAND_GETDATATREES,       /**< Returns an entire subtree of data as a single Message */
    PR_COMMAND_JETTISONDATATREES,  /**< Removes matching RESULT_DATATREES Messages from the outgoing queue */
-   PR_COMMAND_RESERVED21,         /**< reserved for future expansion */
+   PR_COMMAND_GETSESSIONSTATS,    /**< Returns traffic statistics for every session on the server (Requires privilege) */
    PR_COMMAND_RESERVED22,         /**< reserved for future expansion */
    PR_COMMAND_RESERVED23,         /**< reserved for future expansion */
    PR_COMMAND_RESERVED24,         /**< reserved for future expansion */
@@ -64,7 +64,7 @@ enum
    PR_RESULT_ERRORACCESSDENIED,  /**< Your client isn't allowed to do something it tried to do */
    PR_RESULT_DATATREES,          /**< Reply to a PR_COMMAND_GETDATATREES message */
    PR_RESULT_NOOP,               /**< Clients should ignore this message.  Servers can send this to check TCP connectivity. */
-   PR_RESULT_RESERVED9,          /**< reserved for future expansion */
+   PR_RESULT_SESSIONSTATS,       /**< Reply to a PR_COMMAND_GETSESSIONSTATS message */
    PR_RESULT_RESERVED10,         /**< reserved for future expansion */
    PR_RESULT_RESERVED11,         /**< reserved for future expansion */
    PR_RESULT_RESERVED12,         /**< reserved for future expansion */
@@ -93,6 +93,8 @@ enum
    PR_PRIVILEGE_KICK = 0,   /**< indicates that the client can disconnect other clients from the server */
    PR_PRIVILEGE_ADDBANS,    /**< indicates that the client can add ban-patterns to the server */
    PR_PRIVILEGE_REMOVEBANS, /**< indicates that the client can remove ban-patterns from the server */
+   PR_PRIVILEGE_ALL,        /**< indicates that the client has all of the privileges (its value, and therefore the "priv3" central-state key, must never change) */
+   PR_PRIVILEGE_GETSTATS,   /**< indicates that the client can retrieve other clients' traffic statistics from the server */
    PR_NUM_PRIVILEGES        /**< guard value */
 };
 
@@ -137,6 +139,8 @@ DECLARE_LABELLED_BITCHORD_FLAGS_TYPE(SetDataNodeFlags, NUM_SETDATANODE_FLAGS, _s
 #define PR_NAME_SERVER_MEM_AVAILABLE       "!Mav"       /**< int64 indicating how many more bytes are available for MUSCLE server to use */
 #define PR_NAME_SERVER_MEM_USED            "!Mus"       /**< int64 indicating how many bytes the MUSCLE server currently has allocated */
 #define PR_NAME_SERVER_MEM_MAX             "!Mmx"       /**< uint64 indicating the maximum number of heap-bytes the MUSCLE server is allowed to have allocated at once. */
+#define PR_NAME_SERVER_MEM_USED_BY_TAG     "!Mut"       /**< Message containing an int64 per memory-tag (e.g. "Messages", "ByteBuffers", "DataNodes") indicating how many bytes are allocated under that tag.  Only present if the server was compiled with -DMUSCLE_ENABLE_MEMORY_TRACKING */
+#define PR_NAME_SERVER_EVENT_LOOP_STATS    "!Mel"       /**< Message containing the server's event-loop latency histograms (see ReflectServer::SaveEventLoopStatsToMessage()).  Only present if event-loop stats are enabled */
 #define PR_NAME_SERVER_VERSION             "!Msv"       /**< String indicating version of MUSCLE that the server was compiled from */
 #define PR_NAME_SERVER_UPTIME              "!Mup"       /**< uint64 indicating how many microseconds the server has been running for */
 #define PR_NAME_SERVER_CURRENTTIMEUTC      "!Mct"       /**< uint64 indicating the server's current wall-clock (microseconds since 1970), in UTC format */
@@ -324,6 +328,12 @@ DECLARE_LABELLED_BITCHORD_FLAGS_TYPE(SetDataNodeFlags, NUM_SETDATANODE_FLAGS, _s
 //    the server again.  Of course, this will only be done if the client who sent the
 //    PR_COMMAND_REMOVEBANS field has PR_PRIVILEGE_REMOVEBANS access.
 //
+// if 'what' is PR_COMMAND_GETSESSIONSTATS:
+//    The server will send back a PR_RESULT_SESSIONSTATS message containing the traffic
+//    statistics of every session currently on the server.  Of course, this will only be
+//    done if the client who sent the PR_COMMAND_GETSESSIONSTATS message has
+//    PR_PRIVILEGE_GETSTATS access.
+//
 // if 'what' is PR_COMMAND_RESERVED_*:
 //    The server will change the 'what' code of your message to PR_RESULT_ERRORUNIMPLEMENTED,
 //    and send it back to your client.
@@ -383,6 +393,13 @@ DECLARE_LABELLED_BITCHORD_FLAGS_TYPE(SetDataNodeFlags, NUM_SETDATANODE_FLAGS, _s
 //    This is the response to a PR_COMMAND_GETDATATREES message you sent earlier.  If
 //    contains the contents of the subtree(s) you requested.
 //
+// if 'what' is PR_RESULT_SESSIONSTATS:
+//    This is the response to a PR_COMMAND_GETSESSIONSTATS message you sent earlier.  It
+//    contains one sub-message per session, under that session's ID string.  Each
+//    sub-message contains int64 fields "bytesin", "bytesout", "msgsin", "msgsout",
+//    "outqmsgs", "outqbytes", "maxoutq", "callbackus", "subscriptions" and "nodes",
+//    and string fields "id", "type", "host" and "desc", describing that session.
+//
 // if 'what' is PR_RESULT_NOOP:
 //    This is a dummy Message, probably sent just to force the TCP layer to verify that
 //    connectivity is still present.  Please ignore it.
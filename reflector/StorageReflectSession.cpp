@@ -138,7 +138,7 @@ AttachedToServer()
 
       // See if we get any special privileges
       int32 privBits = 0;
-      for (int p=0; p<=PR_NUM_PRIVILEGES; p++)
+      for (int p=0; p<PR_NUM_PRIVILEGES; p++)
       {
          char temp[32]; muscleSprintf(temp, "priv%i", p);
          const String * privPattern;
@@ -146,7 +146,7 @@ AttachedToServer()
          {
             if (StringMatcher(*privPattern).Match(matchHostname()))
             {
-               if (p == PR_NUM_PRIVILEGES) privBits = ~0;  // all privileges granted!
+               if (p == PR_PRIVILEGE_ALL) privBits = ~0;  // all privileges granted!
                                       else privBits |= (1L<<p);
                break;
             }
@@ -645,6 +645,16 @@ MessageReceivedFromGateway(const MessageRef & msgRef, void * userData)
             else BounceMessage(PR_RESULT_ERRORACCESSDENIED, msgRef);
          break;
 
+         case PR_COMMAND_GETSESSIONSTATS:
+            if (HasPrivilege(PR_PRIVILEGE_GETSTATS))
+            {
+               const ReflectServer * server = GetOwner();
+               MessageRef reply = GetMessageFromPool(PR_RESULT_SESSIONSTATS);
+               if ((server)&&(reply())&&(server->SaveSessionStatsToMessage(*reply()).IsOK())) MessageReceivedFromSession(*this, reply, NULL);  // send the result back to our client
+            }
+            else BounceMessage(PR_RESULT_ERRORACCESSDENIED, msgRef);
+         break;
+
          case PR_COMMAND_REMOVEBANS: case PR_COMMAND_REMOVEREQUIRES:
             if (HasPrivilege(PR_PRIVILEGE_REMOVEBANS))
             {
@@ -931,6 +941,24 @@ MessageRef StorageReflectSession :: GetEffectiveParameters() const
    // coverity[underflow] - it's okay if the value gets cast to a negative value here
    (void) resultMessage()->AddInt64(PR_NAME_SERVER_MEM_MAX, GetMaxNumBytes());
 
+#ifdef MUSCLE_ENABLE_MEMORY_TRACKING
+   (void) resultMessage()->RemoveName(PR_NAME_SERVER_MEM_USED_BY_TAG);
+   MessageRef tagsMsg = GetMessageFromPool();
+   if (tagsMsg())
+   {
+      for (uint32 i=0; i<NUM_MUSCLE_MEMORY_TAGS; i++) (void) tagsMsg()->AddInt64(GetMemoryTagName(i), GetNumAllocatedBytesForTag(i));
+      (void) resultMessage()->AddMessage(PR_NAME_SERVER_MEM_USED_BY_TAG, tagsMsg);
+   }
+#endif
+
+   (void) resultMessage()->RemoveName(PR_NAME_SERVER_EVENT_LOOP_STATS);
+   const ReflectServer * server = GetOwner();
+   if ((server)&&(server->GetEventLoopStatsEnabled()))
+   {
+      MessageRef statsMsg = GetMessageFromPool();
+      if ((statsMsg())&&(server->SaveEventLoopStatsToMessage(*statsMsg()).IsOK())) (void) resultMessage()->AddMessage(PR_NAME_SERVER_EVENT_LOOP_STATS, statsMsg);
+   }
+
    const uint64 now = GetRunTime64();
 
    (void) resultMessage()->RemoveName(PR_NAME_SERVER_UPTIME);
@@ -1721,6 +1749,7 @@ GetNewDataNode(const String & name, const ConstMessageRef & initialValue)
 {
    static DataNodeRef::ItemPool _nodePool;
 
+   DECLARE_MEMORY_TAG_GUARD(MUSCLE_MEMORY_TAG_DATANODES);
    DataNodeRef ret(_nodePool.ObtainObject());
    if (ret()) ret()->Init(name, initialValue);
    return ret;
@@ -2023,12 +2052,20 @@ void StorageReflectSession :: AddApplicationSpecificParametersToParametersResult
 void StorageReflectSession :: TallyNodeBytes(const DataNode & n, uint64 & retNumNodes, uint64 & retNodeBytes) const
 {
    retNumNodes++;
+   retNodeBytes += n.GetTotalDataSize();
    const Message * msg = n.GetData()();
    if (msg) retNodeBytes += msg->FlattenedSize();
 
    for (DataNodeRefIterator iter = n.GetChildIterator(); iter.HasData(); iter++) TallyNodeBytes(*iter.GetValue()(), retNumNodes, retNodeBytes);
 }
 
+status_t StorageReflectSession :: SaveTrafficStatsToMessage(Message & msg) const
+{
+   MRETURN_ON_ERROR(DumbReflectSession::SaveTrafficStatsToMessage(msg));
+   MRETURN_ON_ERROR(msg.AddInt64("subscriptions", _subscriptions.GetNumPaths()));
+   return           msg.AddInt64("nodes",         _currentNodeCount);
+}
+
 void StorageReflectSession :: TallySubscriberTablesInfo(uint32 & retNumCachedSubscriberTables, uint64 & tallyNumNodes, uint64 & tallyNumNodeBytes) const
 {
    retNumCachedSubscriberTables = muscleMax(retNumCachedSubscriberTables, _sharedData->_cachedSubscribersTables.GetNumCachedItems());
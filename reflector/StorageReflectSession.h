@@ -105,6 +105,13 @@ public:
      */
    MessageRef GetEffectiveParameters() const;
 
+   /** Overridden to also add int64 fields named "subscriptions" (the number of node-paths we are subscribed to)
+     * and "nodes" (the number of database nodes we own) to (msg).
+     * @param msg the Message to add our fields to.
+     * @returns B_NO_ERROR on success, or an error code on failure.
+     */
+   virtual status_t SaveTrafficStatsToMessage(Message & msg) const;
+
    MUSCLE_NODISCARD virtual bool ClientConnectionClosed();
    virtual void AsyncConnectCompleted();
    MUSCLE_NODISCARD virtual uint64 GetPulseTime(const PulseArgs & args);
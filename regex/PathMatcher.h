@@ -190,6 +190,14 @@ public:
    /** Returns the number of QueryFilters we are currently using. */
    MUSCLE_NODISCARD uint32 GetNumFilters() const {return _numFilters;}
 
+   /** Returns the number of path strings currently in this matcher (at all depths). */
+   MUSCLE_NODISCARD uint32 GetNumPaths() const
+   {
+      uint32 ret = 0;
+      for (ConstHashtableIterator<uint32, Hashtable<String, PathMatcherEntry> > iter(_entries); iter.HasData(); iter++) ret += iter.GetValue().GetNumItems();
+      return ret;
+   }
+
 private:
    Hashtable<uint32, Hashtable<String, PathMatcherEntry> > _entries;
    uint32 _numFilters;  // count how many filters are installed; so we can optimize when there are none
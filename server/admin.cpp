@@ -52,9 +52,94 @@ status_t Require(MessageIOGateway & gw, const char * arg, bool unRequire)
    return B_NO_ERROR;
 }
 
+static status_t RequestSessionStats(MessageIOGateway & gw);
+status_t RequestSessionStats(MessageIOGateway & gw)
+{
+   return gw.AddOutgoingMessage(MessageRef(GetMessageFromPool(PR_COMMAND_GETSESSIONSTATS)));
+}
+
+// One row of our "top"-style session-stats table
+class SessionStatsRow
+{
+public:
+   SessionStatsRow() : _bytesInRate(0), _bytesOutRate(0), _msgsInRate(0), _msgsOutRate(0), _outQBytes(0), _maxOutQ(0), _callbackPercent(0.0f), _subscriptions(0) {/* empty */}
+
+   String _id;
+   String _desc;
+   uint64 _bytesInRate;   // bytes per second, or total bytes if we don't have a previous sample to compare with
+   uint64 _bytesOutRate;
+   uint64 _msgsInRate;
+   uint64 _msgsOutRate;
+   uint64 _outQBytes;
+   uint64 _maxOutQ;
+   float _callbackPercent;
+   uint64 _subscriptions;
+};
+
+// Sorts the busiest sessions to the top of the table
+class SessionStatsRowCompareFunctor
+{
+public:
+   MUSCLE_NODISCARD int Compare(const SessionStatsRow & a, const SessionStatsRow & b, void *) const
+   {
+      const int ret = muscleCompare(b._bytesInRate+b._bytesOutRate, a._bytesInRate+a._bytesOutRate);
+      return (ret != 0) ? ret : muscleCompare(b._outQBytes, a._outQBytes);
+   }
+};
+
+// Returns how much the (fieldName) counter of the session with ID (id) has gone up since (optPrevStatsMsg), per second
+static uint64 GetCounterRate(const Message & sessionMsg, const Message * optPrevStatsMsg, const String & id, const char * fieldName, uint64 elapsed)
+{
+   const uint64 count = (uint64) sessionMsg.GetInt64(fieldName);
+   MessageRef prevSessionMsg;
+   if ((optPrevStatsMsg == NULL)||(elapsed == 0)||(optPrevStatsMsg->FindMessage(id, prevSessionMsg).IsError())) return count;
+
+   const uint64 prevCount = (uint64) prevSessionMsg()->GetInt64(fieldName);
+   return (count > prevCount) ? ((((count-prevCount)*MICROS_PER_SECOND)+(elapsed/2))/elapsed) : 0;  // rounded to the nearest integer
+}
+
+// Prints a "top"-style table of the per-session traffic counters in a PR_RESULT_SESSIONSTATS Message.
+// If (optPrevStatsMsg) is non-NULL, rates are computed relative to it (it was received (elapsed) microseconds earlier)
+static void PrintSessionStats(const Message & statsMsg, const Message * optPrevStatsMsg, uint64 elapsed)
+{
+   Queue<SessionStatsRow> rows;
+   for (MessageFieldNameIterator iter = statsMsg.GetFieldNameIterator(B_MESSAGE_TYPE); iter.HasData(); iter++)
+   {
+      MessageRef sessionMsg;
+      if (statsMsg.FindMessage(iter.GetFieldName(), sessionMsg).IsError()) continue;
+
+      const String & id = iter.GetFieldName();
+      const Message & m = *sessionMsg();
+      SessionStatsRow row;
+      row._id              = id;
+      row._desc            = m.GetString("desc");
+      row._bytesInRate     = GetCounterRate(m, optPrevStatsMsg, id, "bytesin",  elapsed);
+      row._bytesOutRate    = GetCounterRate(m, optPrevStatsMsg, id, "bytesout", elapsed);
+      row._msgsInRate      = GetCounterRate(m, optPrevStatsMsg, id, "msgsin",   elapsed);
+      row._msgsOutRate     = GetCounterRate(m, optPrevStatsMsg, id, "msgsout",  elapsed);
+      row._outQBytes       = m.GetInt64("outqbytes");
+      row._maxOutQ         = m.GetInt64("maxoutq");
+      row._subscriptions   = m.GetInt64("subscriptions");
+      row._callbackPercent = ((optPrevStatsMsg)&&(elapsed > 0)) ? (100.0f*GetCounterRate(m, optPrevStatsMsg, id, "callbackus", elapsed))/MICROS_PER_SECOND : 0.0f;
+      (void) rows.AddTail(row);
+   }
+   rows.Sort(SessionStatsRowCompareFunctor());
+
+   const char * rateStr = optPrevStatsMsg ? "/s" : "  ";
+   printf("%-8s %12s%s %12s%s %9s%s %9s%s %10s %7s %6s %5s  %s\n", "ID", "BytesIn", rateStr, "BytesOut", rateStr, "MsgsIn", rateStr, "MsgsOut", rateStr, "OutQBytes", "MaxOutQ", "CPU%", "Subs", "Session");
+   for (uint32 i=0; i<rows.GetNumItems(); i++)
+   {
+      const SessionStatsRow & r = rows[i];
+      printf("%-8s %14" UINT64_FORMAT_SPEC_NOPERCENT " %14" UINT64_FORMAT_SPEC_NOPERCENT " %11" UINT64_FORMAT_SPEC_NOPERCENT " %11" UINT64_FORMAT_SPEC_NOPERCENT " %10" UINT64_FORMAT_SPEC_NOPERCENT " %7" UINT64_FORMAT_SPEC_NOPERCENT " %6.1f %5" UINT64_FORMAT_SPEC_NOPERCENT "  %s\n", r._id(), r._bytesInRate, r._bytesOutRate, r._msgsInRate, r._msgsOutRate, r._outQBytes, r._maxOutQ, r._callbackPercent, r._subscriptions, r._desc());
+   }
+   printf("(" UINT32_FORMAT_SPEC " sessions)\n", rows.GetNumItems());
+   fflush(stdout);
+}
+
 // This is a little admin program, useful for kicking, banning, or unbanning users
 // without having to restart the MUSCLE server.  Example command line:
 //   admin server=muscleserver.mycompany.com kick=192.168.0.23 ban=16.25.29.2 kickban=1.2.3.4 unban=1.2.3.4 ban=2.3.4.5 ban=3.4.5.*
+// It can also show the server's per-session traffic counters, either once (stats) or continuously, like top (top[=seconds]).
 // Note that you can only do this if your IP address has the requisite privileges on
 // the MUSCLE server!  (i.e. to ban, the server must have been run with an argument like privban=your.ip.address)
 #ifdef UNIFIED_DAEMON
@@ -66,18 +151,26 @@ int main(int argc, char ** argv)
    CompleteSetupSystem css;
 
    const char * hostName = "localhost";
+   bool printStats = false;
+   uint64 topInterval = MUSCLE_TIME_NEVER;  // if set, we'll keep re-requesting the session stats this often
 
    // First, find out if there is a server specified.
    for (int i=1; i<argc; i++)
    {
       char * next = argv[i];
            if (strncmp(next, "server=", 7) == 0) hostName = &next[7];
+      else if (strcmp(next, "stats") == 0) printStats = true;
+      else if ((strcmp(next, "top") == 0)||(strncmp(next, "top=", 4) == 0))
+      {
+         printStats  = true;
+         topInterval = SecondsToMicros((next[3] == '=') ? muscleMax(1, atoi(&next[4])) : 2);
+      }
       else if (strcmp(next, "help") == 0)
       {
          LogTime(MUSCLE_LOG_INFO, "This program lets you send admin commands to a running MUSCLE server.\n");
          LogTime(MUSCLE_LOG_INFO, "Note that the MUSCLE server will not listen to your commands unless your ip address was\n");
          LogTime(MUSCLE_LOG_INFO, "specified as a privileged IP address in its command line arguments [e.g. ./muscled privall=your.IP.address]\n");
-         LogTime(MUSCLE_LOG_INFO, "Usage:  admin [server=localhost] [ban=pattern] [unban=pattern] [kick=pattern] [kickban=pattern]\n");
+         LogTime(MUSCLE_LOG_INFO, "Usage:  admin [server=localhost] [ban=pattern] [unban=pattern] [kick=pattern] [kickban=pattern] [stats] [top[=seconds]]\n");
          return 0;
       }
    }
@@ -126,6 +219,12 @@ int main(int argc, char ** argv)
       }
    }
 
+   if ((printStats)&&(RequestSessionStats(gw).IsError()))
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "Couldn't queue session-stats request!\n");
+      return 10;
+   }
+
    // Lastly, request a PONG so we know when all has been done
    if (gw.AddOutgoingMessage(MessageRef(GetMessageFromPool(PR_COMMAND_PING))).IsError())
    {
@@ -134,10 +233,14 @@ int main(int argc, char ** argv)
    }
 
    // send them, and then wait for the pong back
-   const uint64 timeoutTime = GetRunTime64() + SecondsToMicros(30);
+   // (in top mode we keep going until the user presses Control-C)
+   const uint64 timeoutTime = (topInterval == MUSCLE_TIME_NEVER) ? (GetRunTime64() + SecondsToMicros(30)) : MUSCLE_TIME_NEVER;
    uint32 errorCount = 0;
    QueueGatewayMessageReceiver inQueue;
    SocketMultiplexer multiplexer;
+   uint64 nextStatsRequestTime = MUSCLE_TIME_NEVER;
+   MessageRef prevStatsMsg;
+   uint64 prevStatsTime = 0;
    while(s())
    {
       const int fd = s()->GetFileDescriptor();
@@ -145,13 +248,24 @@ int main(int argc, char ** argv)
       if (gw.HasBytesToOutput()) (void) multiplexer.RegisterSocketForWriteReady(fd);
 
       status_t ret;
-      if (multiplexer.WaitForEvents(timeoutTime).IsError(ret))
+      if (multiplexer.WaitForEvents(muscleMin(timeoutTime, nextStatsRequestTime)).IsError(ret))
       {
          LogTime(MUSCLE_LOG_CRITICALERROR, "WaitForEvents() failed, exiting! [%s]\n", ret());
          errorCount++;
          break;
       }
 
+      if (GetRunTime64() >= nextStatsRequestTime)
+      {
+         if (RequestSessionStats(gw).IsError())
+         {
+            LogTime(MUSCLE_LOG_CRITICALERROR, "Couldn't queue session-stats request!\n");
+            errorCount++;
+            break;
+         }
+         nextStatsRequestTime = MUSCLE_TIME_NEVER;
+      }
+
       const bool readError  = ((multiplexer.IsSocketReadyForRead(fd)) &&(gw.DoInput(inQueue).IsError()));
       const bool writeError = ((multiplexer.IsSocketReadyForWrite(fd))&&(gw.DoOutput().IsError()));
       if ((readError)||(writeError))
@@ -170,7 +284,22 @@ int main(int argc, char ** argv)
             switch(msg->what)
             {
                case PR_RESULT_PONG:
-                  s.Reset();
+                  if (topInterval == MUSCLE_TIME_NEVER) s.Reset();
+               break;
+
+               case PR_RESULT_SESSIONSTATS:
+               {
+                  const uint64 now = GetRunTime64();
+                  if (topInterval != MUSCLE_TIME_NEVER)
+                  {
+                     printf("\033[H\033[2J");  // clear the terminal, like top does
+                     printf("Session stats from %s (refreshed every %s, Control-C to quit)\n\n", hostName, GetHumanReadableUnsignedTimeIntervalString(topInterval)());
+                     nextStatsRequestTime = now+topInterval;
+                  }
+                  PrintSessionStats(*msg, prevStatsMsg(), now-prevStatsTime);
+                  prevStatsMsg  = incoming;
+                  prevStatsTime = now;
+               }
                break;
 
                case PR_RESULT_ERRORACCESSDENIED:
@@ -179,7 +308,12 @@ int main(int argc, char ** argv)
                   LogTime(MUSCLE_LOG_ERROR, "Access denied!  ");
                   const char * who;
                   ConstMessageRef subMsg;
-                  if ((msg->FindMessage(PR_NAME_REJECTED_MESSAGE, subMsg).IsOK())&&(subMsg()->FindString(PR_NAME_KEYS, &who).IsOK()))
+                  if ((msg->FindMessage(PR_NAME_REJECTED_MESSAGE, subMsg).IsOK())&&(subMsg()->what == PR_COMMAND_GETSESSIONSTATS))
+                  {
+                     LogPlain(MUSCLE_LOG_ERROR, "You are not allowed to view the session stats!");
+                     s.Reset();  // no point hanging around in top mode, either
+                  }
+                  else if ((subMsg())&&(subMsg()->FindString(PR_NAME_KEYS, &who).IsOK()))
                   {
                      const char * action = "do that to";
                      switch(subMsg()->what)
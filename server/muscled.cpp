@@ -4,9 +4,11 @@
 # include "dataio/FileDataIO.h"
 #endif
 
+#include "iogateway/CaptureIOGateway.h"
 #include "reflector/ReflectServer.h"
 #include "reflector/DumbReflectSession.h"
 #include "reflector/StorageReflectSession.h"
+#include "reflector/FairShareSessionIOPolicy.h"
 #include "reflector/FilterSessionFactory.h"
 #include "reflector/RateLimitSessionIOPolicy.h"
 #include "reflector/SignalHandlerSession.h"
@@ -48,6 +50,91 @@ static status_t LoadCryptoKey(bool isPublic, const String * optKeyFilePath, Refl
    return B_IO_ERROR;
 }
 
+// Decorator factory that wraps each new session's gateway in a CaptureIOGateway, so that its traffic gets recorded
+class CaptureSessionFactory : public ProxySessionFactory
+{
+public:
+   CaptureSessionFactory(const ReflectSessionFactoryRef & slaveRef, const MessageCaptureWriterRef & writer) : ProxySessionFactory(slaveRef), _writer(writer) {/* empty */}
+
+   virtual AbstractReflectSessionRef CreateSession(const String & clientHostIP, const IPAddressAndPort & iap)
+   {
+      if (GetSlave()() == NULL) return B_BAD_OBJECT;
+
+      AbstractReflectSessionRef ret = GetSlave()()->CreateSession(clientHostIP, iap);
+      MRETURN_ON_ERROR(ret);
+
+      AbstractMessageIOGatewayRef slaveGateway = ret()->GetGateway();
+      if (slaveGateway() == NULL) slaveGateway = ret()->CreateGateway();
+      MRETURN_ON_ERROR(slaveGateway);
+
+      AbstractMessageIOGatewayRef captureGateway(newnothrow CaptureIOGateway(slaveGateway, _writer, ret()->GetSessionID()));
+      MRETURN_ON_ERROR(captureGateway);
+
+      ret()->SetGateway(captureGateway);
+      return ret;
+   }
+
+private:
+   MessageCaptureWriterRef _writer;
+};
+
+// Socket-less session that periodically writes every session's traffic counters to a file, in Prometheus's text format
+class SessionStatsDumpSession : public AbstractReflectSession
+{
+public:
+   SessionStatsDumpSession(const String & filePath, uint64 interval) : _filePath(filePath), _interval(interval), _nextDumpTime(0) {/* empty */}
+
+   virtual String GetClientDescriptionString() const {return "session-stats dumper";}
+   virtual void MessageReceivedFromGateway(const MessageRef &, void *) {/* empty */}
+
+   virtual uint64 GetPulseTime(const PulseArgs & args) {return muscleMin(AbstractReflectSession::GetPulseTime(args), _nextDumpTime);}
+
+   virtual void Pulse(const PulseArgs & args)
+   {
+      AbstractReflectSession::Pulse(args);
+      if (args.GetCallbackTime() >= _nextDumpTime)
+      {
+         const status_t ret = WriteStatsFile();
+         if (ret.IsError()) LogTime(MUSCLE_LOG_ERROR, "Couldn't write session stats to file [%s] [%s]\n", _filePath(), ret());
+         _nextDumpTime = args.GetCallbackTime()+_interval;
+      }
+   }
+
+private:
+   // Writes to a temporary file first, so that a scraper will never see a half-written file
+   status_t WriteStatsFile() const
+   {
+      const String tempPath = _filePath+".tmp";
+      FILE * f = muscleFopen(tempPath(), "w");
+      if (f == NULL) return B_ERRNO;
+
+      GetOwner()->PrintSessionStatsAsPrometheusText(f);
+      GetOwner()->PrintAcceptStatsAsPrometheusText(f);
+      const bool writeFailed = (ferror(f) != 0);
+      if ((fclose(f) != 0)||(writeFailed)) return B_IO_ERROR;
+
+#ifdef WIN32
+      (void) remove(_filePath());  // Windows' rename() won't replace an existing file
+#endif
+      return (rename(tempPath(), _filePath()) == 0) ? B_NO_ERROR : B_ERRNO;
+   }
+
+   const String _filePath;
+   const uint64 _interval;
+   uint64 _nextDumpTime;
+};
+
+// Returns a new policy that limits its sessions' aggregate bandwidth to (maxRate) bytes per second.
+// If (fairShare) is true, the bandwidth is also divided fairly amongst the client hosts, according to (hostWeights).
+static AbstractSessionIOPolicy * CreateBandwidthPolicy(uint32 maxRate, bool fairShare, const Hashtable<String, uint32> & hostWeights)
+{
+   if (fairShare == false) return new RateLimitSessionIOPolicy(maxRate);
+
+   FairShareSessionIOPolicy * p = new FairShareSessionIOPolicy(maxRate);
+   for (ConstHashtableIterator<String, uint32> iter(hostWeights); iter.HasData(); iter++) (void) p->SetHostWeight(iter.GetKey(), iter.GetValue());
+   return p;
+}
+
 // Aux method; main() without the global stuff.  This is a good method to
 // call if you already have the global stuff set up the way you like it.
 // The third argument can be passed in as NULL, or point to a UsageLimitProxyMemoryAllocator object
@@ -72,6 +159,7 @@ static int muscledmainAux(int argc, char ** argv, void * cookie)
    Queue<String> requires;
    Message tempPrivs;
    Hashtable<IPAddress, String> tempRemaps;
+   Hashtable<String, uint32> hostWeights;
 
    Message args; (void) ParseArgs(argc, argv, args);
    HandleStandardDaemonArgs(args);
@@ -87,11 +175,16 @@ static int muscledmainAux(int argc, char ** argv, void * cookie)
       LogPlain(MUSCLE_LOG_INFO, "                [maxchildrenpernode=num]\n");
       LogPlain(MUSCLE_LOG_INFO, "                [ban=ippattern] [require=ippattern]\n");
       LogPlain(MUSCLE_LOG_INFO, "                [privban=ippattern] [privunban=ippattern]\n");
-      LogPlain(MUSCLE_LOG_INFO, "                [privkick=ippattern] [privall=ippattern]\n");
+      LogPlain(MUSCLE_LOG_INFO, "                [privkick=ippattern] [privstats=ippattern]\n");
+      LogPlain(MUSCLE_LOG_INFO, "                [privall=ippattern]\n");
       LogPlain(MUSCLE_LOG_INFO, "                [maxsendrate=kBps] [maxreceiverate=kBps]\n");
       LogPlain(MUSCLE_LOG_INFO, "                [maxcombinedrate=kBps] [maxmessagesize=k]\n");
+      LogPlain(MUSCLE_LOG_INFO, "                [fairshare] [hostweight=host=weight]\n");
       LogPlain(MUSCLE_LOG_INFO, "                [maxsessions=num] [maxsessionsperhost=num]\n");
-      LogPlain(MUSCLE_LOG_INFO, "                [localhost=ipaddress] [daemon]\n");
+      LogPlain(MUSCLE_LOG_INFO, "                [localhost=ipaddress] [capture=filename] [daemon]\n");
+      LogPlain(MUSCLE_LOG_INFO, "                [slowcallback=millis] [statsfile=filename]\n");
+      LogPlain(MUSCLE_LOG_INFO, "                [statsinterval=seconds] [acceptsockets=num]\n");
+      LogPlain(MUSCLE_LOG_INFO, "                [acceptbacklog=num] [acceptbatch=num]\n");
       LogPlain(MUSCLE_LOG_INFO, " - port may be any number between 1 and 65536\n");
       LogPlain(MUSCLE_LOG_INFO, " - listen is like port, except it includes a local interface IP as well.\n");
       LogPlain(MUSCLE_LOG_INFO, " - lvl is: none, critical, errors, warnings, info, debug, or trace.\n");
@@ -105,11 +198,28 @@ static int muscledmainAux(int argc, char ** argv, void * cookie)
       LogPlain(MUSCLE_LOG_INFO, "   If any of these are present, then only IP addresses that match\n");
       LogPlain(MUSCLE_LOG_INFO, "   at least one of them will be allowed to connect.\n");
       LogPlain(MUSCLE_LOG_INFO, " - To assign privileges, specify one of the following:\n");
-      LogPlain(MUSCLE_LOG_INFO, "   privban=<pattern>, privunban=<pattern>,\n");
-      LogPlain(MUSCLE_LOG_INFO, "   privkick=<pattern> or privall=<pattern>.\n");
+      LogPlain(MUSCLE_LOG_INFO, "   privban=<pattern>, privunban=<pattern>, privkick=<pattern>,\n");
+      LogPlain(MUSCLE_LOG_INFO, "   privstats=<pattern> or privall=<pattern>.\n");
       LogPlain(MUSCLE_LOG_INFO, "   privall assigns all privileges to the matching IP addresses.\n");
       LogPlain(MUSCLE_LOG_INFO, " - remap tells muscled to treat connections from a given IP address\n");
       LogPlain(MUSCLE_LOG_INFO, "   as if they are coming from another (for stupid NAT tricks, etc)\n");
+      LogPlain(MUSCLE_LOG_INFO, " - fairshare divides the bandwidth evenly amongst the client hosts\n");
+      LogPlain(MUSCLE_LOG_INFO, "   (and then amongst each host's connections) instead of serving\n");
+      LogPlain(MUSCLE_LOG_INFO, "   whoever is busiest.  hostweight gives a host a larger share.\n");
+      LogPlain(MUSCLE_LOG_INFO, " - capture records every client's incoming and outgoing Messages\n");
+      LogPlain(MUSCLE_LOG_INFO, "   to the given file, for later playback with musclereplay\n");
+      LogPlain(MUSCLE_LOG_INFO, "   (add catchsignals so that Control-C closes the file cleanly)\n");
+      LogPlain(MUSCLE_LOG_INFO, " - slowcallback logs a warning (with a stack trace) whenever a session\n");
+      LogPlain(MUSCLE_LOG_INFO, "   callback takes at least the given number of milliseconds to return\n");
+      LogPlain(MUSCLE_LOG_INFO, "   (with catchsignals, SIGUSR1 logs the event-loop latency histograms)\n");
+      LogPlain(MUSCLE_LOG_INFO, " - statsfile periodically writes every client's traffic counters\n");
+      LogPlain(MUSCLE_LOG_INFO, "   to the given file in Prometheus text format (every 10 seconds,\n");
+      LogPlain(MUSCLE_LOG_INFO, "   unless statsinterval says otherwise)\n");
+      LogPlain(MUSCLE_LOG_INFO, " - acceptsockets opens that many SO_REUSEPORT listening sockets per\n");
+      LogPlain(MUSCLE_LOG_INFO, "   port, and acceptbacklog sets each one's backlog-queue length (default 20),\n");
+      LogPlain(MUSCLE_LOG_INFO, "   so that a storm of reconnecting clients doesn't overflow the backlog.\n");
+      LogPlain(MUSCLE_LOG_INFO, "   acceptbatch is the most connections to accept per event-loop\n");
+      LogPlain(MUSCLE_LOG_INFO, "   iteration (default 64).\n");
       LogPlain(MUSCLE_LOG_INFO, " - If daemon is specified, muscled will run as a background process.\n");
       return(5);
    }
@@ -183,6 +293,15 @@ static int muscledmainAux(int argc, char ** argv, void * cookie)
       maxCombinedRate = muscleMax((uint32)0, (uint32)(k*1024.0f));
    }
 
+   for (int32 i=0; (args.FindString("hostweight", i, &value).IsOK()); i++)
+   {
+      StringTokenizer tok(value, "=");
+      const char * host   = tok();
+      const char * weight = tok();
+      if ((host)&&(weight)&&(atoi(weight) > 0)) (void) hostWeights.Put(host, atoi(weight));
+                                             else LogTime(MUSCLE_LOG_ERROR, "Error parsing hostweight argument (it should look something like hostweight=192.168.0.1=3).\n");
+   }
+
    if (args.FindString("maxnodespersession", &value).IsOK())
    {
       maxNodesPerSession = atoi(value);
@@ -224,10 +343,10 @@ static int muscledmainAux(int argc, char ** argv, void * cookie)
    }
 
    {
-      const char * privNames[] = {"privkick", "privban", "privunban", "privall"};
-      MUSCLE_STATIC_ASSERT_ARRAY_LENGTH(privNames, PR_NUM_PRIVILEGES+1);
+      const char * privNames[] = {"privkick", "privban", "privunban", "privall", "privstats"};
+      MUSCLE_STATIC_ASSERT_ARRAY_LENGTH(privNames, PR_NUM_PRIVILEGES);
 
-      for (int p=0; p<=PR_NUM_PRIVILEGES; p++)  // if (p == PR_NUM_PRIVILEGES), that means all privileges
+      for (int p=0; p<PR_NUM_PRIVILEGES; p++)
       {
          for (int32 q=0; (args.FindString(privNames[p], q, &value).IsOK()); q++)
          {
@@ -246,36 +365,71 @@ static int muscledmainAux(int argc, char ** argv, void * cookie)
    status_t ret;
    server.GetAddressRemappingTable() = std_move_if_available(tempRemaps);
 
+   if (args.FindString("slowcallback", &value).IsOK())
+   {
+      const uint64 threshold = MillisToMicros(Atoull(value));
+      server.SetSlowCallbackThreshold(threshold);
+      LogTime(MUSCLE_LOG_INFO, "Logging any session callbacks that take %s or longer.\n", GetHumanReadableUnsignedTimeIntervalString(threshold)());
+   }
+   if ((args.HasName("slowcallback"))||(GetMainReflectServerCatchSignals())) server.SetEventLoopStatsEnabled(true);  // the slow-callback detector and SIGUSR1's report both need them
+
+   if (args.FindString("acceptsockets", &value).IsOK()) server.SetNumAcceptSocketsPerPort((uint32) atoi(value));
+   if (args.FindString("acceptbacklog", &value).IsOK()) server.SetAcceptBacklog((uint32) atoi(value));
+   if (args.FindString("acceptbatch",   &value).IsOK()) server.SetMaxAcceptsPerIteration((uint32) atoi(value));
+   if (server.GetNumAcceptSocketsPerPort() > 1) LogTime(MUSCLE_LOG_INFO, "Accepting connections on " UINT32_FORMAT_SPEC " sockets per port, with a backlog of " UINT32_FORMAT_SPEC " each.\n", server.GetNumAcceptSocketsPerPort(), server.GetAcceptBacklog());
+
    if (maxNodesPerSession != MUSCLE_NO_LIMIT) ret |= server.GetCentralState().AddInt32(PR_NAME_MAX_NODES_PER_SESSION, maxNodesPerSession);
    if (maxChildrenPerNode != MUSCLE_NO_LIMIT) ret |= server.GetCentralState().AddInt32(PR_NAME_MAX_CHILDREN_PER_NODE, maxChildrenPerNode);
    for (MessageFieldNameIterator iter = tempPrivs.GetFieldNameIterator(); iter.HasData(); iter++) ret |= tempPrivs.CopyName(iter.GetFieldName(), server.GetCentralState());
 
    // If the user asked for bandwidth limiting, create Policy objects to handle that.
+   const bool fairShare = args.HasName("fairshare");
    AbstractSessionIOPolicyRef inputPolicyRef, outputPolicyRef;
    if (maxCombinedRate != MUSCLE_NO_LIMIT)
    {
-      inputPolicyRef.SetRef(new RateLimitSessionIOPolicy(maxCombinedRate));
+      inputPolicyRef.SetRef(CreateBandwidthPolicy(maxCombinedRate, fairShare, hostWeights));
       outputPolicyRef = inputPolicyRef;
       LogTime(MUSCLE_LOG_INFO, "Limiting aggregate I/O bandwidth to %.02f kilobytes/second.\n", ((float)maxCombinedRate/1024.0f));
    }
    else
    {
-      if (maxReceiveRate != MUSCLE_NO_LIMIT)
+      if ((maxReceiveRate != MUSCLE_NO_LIMIT)||(fairShare))
       {
-         inputPolicyRef.SetRef(new RateLimitSessionIOPolicy(maxReceiveRate));
-         LogTime(MUSCLE_LOG_INFO, "Limiting aggregate receive bandwidth to %.02f kilobytes/second.\n", ((float)maxReceiveRate/1024.0f));
+         inputPolicyRef.SetRef(CreateBandwidthPolicy(maxReceiveRate, fairShare, hostWeights));
+         if (maxReceiveRate != MUSCLE_NO_LIMIT) LogTime(MUSCLE_LOG_INFO, "Limiting aggregate receive bandwidth to %.02f kilobytes/second.\n", ((float)maxReceiveRate/1024.0f));
       }
-      if (maxSendRate != MUSCLE_NO_LIMIT)
+      if ((maxSendRate != MUSCLE_NO_LIMIT)||(fairShare))
       {
-         outputPolicyRef.SetRef(new RateLimitSessionIOPolicy(maxSendRate));
-         LogTime(MUSCLE_LOG_INFO, "Limiting aggregate send bandwidth to %.02f kilobytes/second.\n", ((float)maxSendRate/1024.0f));
+         outputPolicyRef.SetRef(CreateBandwidthPolicy(maxSendRate, fairShare, hostWeights));
+         if (maxSendRate != MUSCLE_NO_LIMIT) LogTime(MUSCLE_LOG_INFO, "Limiting aggregate send bandwidth to %.02f kilobytes/second.\n", ((float)maxSendRate/1024.0f));
       }
    }
+   if (fairShare) LogTime(MUSCLE_LOG_INFO, "Sharing bandwidth fairly amongst client hosts.\n");
 
    // Set up the Session Factory.  This factory object creates the new StorageReflectSessions
    // as needed when people connect, and also has a filter to keep out the riff-raff.
    StorageReflectSessionFactory factory; factory.SetMaxIncomingMessageSize(maxMessageSize);
-   FilterSessionFactory filter(DummyReflectSessionFactoryRef(factory), maxSessionsPerHost, maxSessions);
+   ReflectSessionFactoryRef factoryRef = DummyReflectSessionFactoryRef(factory);
+
+   // If the user asked for a traffic capture, interpose a factory that wraps each session's gateway in a CaptureIOGateway
+   MessageCaptureWriterRef captureWriter;
+   if (args.FindString("capture", &value).IsOK())
+   {
+      captureWriter.SetRef(newnothrow MessageCaptureWriter);
+      if ((captureWriter())&&(captureWriter()->Open(value).IsOK(ret)))
+      {
+         LogTime(MUSCLE_LOG_INFO, "Capturing all client traffic to file [%s]\n", value);
+         factoryRef.SetRef(newnothrow CaptureSessionFactory(factoryRef, captureWriter));
+         if (factoryRef() == NULL) ret = B_OUT_OF_MEMORY;
+      }
+      else
+      {
+         if (captureWriter() == NULL) ret = B_OUT_OF_MEMORY;
+         LogTime(MUSCLE_LOG_CRITICALERROR, "Couldn't open capture file [%s] [%s]\n", value, ret());
+      }
+   }
+
+   FilterSessionFactory filter(factoryRef, maxSessionsPerHost, maxSessions);
    filter.SetInputPolicy(inputPolicyRef);
    filter.SetOutputPolicy(outputPolicyRef);
 
@@ -300,8 +454,17 @@ static int muscledmainAux(int argc, char ** argv, void * cookie)
       }
    }
 
+   if ((ret.IsOK())&&(args.FindString("statsfile", &value).IsOK()))
+   {
+      const char * intervalStr = args.GetCstr("statsinterval");
+      const uint64 interval = SecondsToMicros(intervalStr ? muscleMax((uint64)1, (uint64)Atoull(intervalStr)) : (uint64)10);
+      if (server.AddNewSession(AbstractReflectSessionRef(newnothrow SessionStatsDumpSession(value, interval))).IsOK(ret)) LogTime(MUSCLE_LOG_INFO, "Writing session stats to file [%s] every %s.\n", value, GetHumanReadableUnsignedTimeIntervalString(interval)());
+                                                                                                                else LogTime(MUSCLE_LOG_CRITICALERROR, "Couldn't set up session-stats file [%s] [%s]\n", value, ret());
+   }
+
    if (ret.IsOK())
    {
+      (void) SetBiasedRefCountingEnabledForCurrentThread(true);  // almost all of our Messages and DataNodes are created and released by this thread
       retVal = server.ServerProcessLoop().IsOK(ret) ? 0 : 10;
       if (retVal > 0) LogTime(MUSCLE_LOG_CRITICALERROR, "Server process aborted! [%s]\n", ret());
                  else LogTime(MUSCLE_LOG_INFO,          "Server process exiting.\n");
@@ -0,0 +1,46 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#ifndef MuscleSIMD_h
+#define MuscleSIMD_h
+
+#include "support/MuscleSupport.h"
+
+/** @file MuscleSIMD.h
+  * This header detects which (if any) SIMD instruction sets the compiler is targetting, and
+  * includes the corresponding intrinsics-headers.  Code that wants to provide a vectorized
+  * implementation of some algorithm can test the MUSCLE_USE_* macros defined here, and should
+  * always provide a plain-C++ fallback for when none of them are defined.
+  *
+  * The following macros may be defined by this header:
+  *   MUSCLE_USE_SSE2  -- SSE2 intrinsics (from emmintrin.h) are available
+  *   MUSCLE_USE_AVX2  -- AVX2 intrinsics (from immintrin.h) are available (implies MUSCLE_USE_SSE2)
+  *   MUSCLE_USE_NEON  -- ARM NEON intrinsics (from arm_neon.h) are available
+  *   MUSCLE_USE_SSE42_CRC32 -- the SSE4.2 CRC32 instructions (from nmmintrin.h) are available
+  *   MUSCLE_USE_ARM_CRC32   -- the ARMv8 CRC32 instructions (from arm_acle.h) are available
+  *
+  * Define MUSCLE_AVOID_SIMD to force all MUSCLE code to use the plain-C++ fallback implementations.
+  */
+
+#ifndef MUSCLE_AVOID_SIMD
+# if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#  define MUSCLE_USE_SSE2 1
+#  include <emmintrin.h>
+#  if defined(__AVX2__)
+#   define MUSCLE_USE_AVX2 1
+#   include <immintrin.h>
+#  endif
+#  if defined(__SSE4_2__)
+#   define MUSCLE_USE_SSE42_CRC32 1
+#   include <nmmintrin.h>
+#  endif
+# elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  define MUSCLE_USE_NEON 1
+#  include <arm_neon.h>
+# endif
+# if defined(__ARM_FEATURE_CRC32)
+#  define MUSCLE_USE_ARM_CRC32 1
+#  include <arm_acle.h>
+# endif
+#endif
+
+#endif
@@ -2034,24 +2034,201 @@ MUSCLE_NODISCARD static inline uint32 EuclideanModulo(int32 value, uint32 diviso
    return (value < 0) ? ((divisor-1)-(((uint32)(-1-value))%divisor)) : (((uint32)value)%divisor);
 }
 
-/** Hash function for arbitrary data.  Note that the current implementation of this function
-  * is MurmurHash2/Aligned, taken from http://murmurhash.googlepages.com/ and used as public domain code.
-  * Thanks to Austin Appleby for the cool algorithm!
+/** MurmurHash2 hash function for arbitrary data.  This is MurmurHash2/Aligned, taken from http://murmurhash.googlepages.com/
+  * and used as public domain code.  Thanks to Austin Appleby for the cool algorithm!
+  * Unless one of the MUSCLE_USE_*_HASH_CODES compiler flags is defined, this is the algorithm used by CalculateHashCode().
   * @param key Pointer to the data to hash
   * @param numBytes Number of bytes to hash start at (key)
   * @param seed An arbitrary number that affects the output values.  Defaults to zero.
   * @returns a 32-bit hash value corresponding to the hashed data.
   */
-MUSCLE_NODISCARD uint32 CalculateHashCode(const void * key, size_t numBytes, uint32 seed = 0);
+MUSCLE_NODISCARD uint32 CalculateMurmurHashCode(const void * key, size_t numBytes, uint32 seed = 0);
 
-/** Same as HashCode(), but this version produces a 64-bit result.
-  * This code is also part of MurmurHash2, written by Austin Appleby
+/** Same as CalculateMurmurHashCode(), but this version produces a 64-bit result.
+  * This code is also part of MurmurHash2 (MurmurHash64A), written by Austin Appleby
   * @param key Pointer to the data to hash
   * @param numBytes Number of bytes to hash start at (key)
   * @param seed An arbitrary number that affects the output values.  Defaults to zero.
   * @returns a 64-bit hash value corresponding to the hashed data.
   */
-MUSCLE_NODISCARD uint64 CalculateHashCode64(const void * key, size_t numBytes, uint64 seed = 0);
+MUSCLE_NODISCARD uint64 CalculateMurmurHashCode64(const void * key, size_t numBytes, uint64 seed = 0);
+
+/** Calculates the CRC-32C (Castagnoli) checksum of the given data.  When the compiler is targetting a CPU with
+  * CRC32 instructions (i.e. SSE4.2 on x86 or the ARMv8 CRC extension), those instructions are used; otherwise
+  * a table-driven software implementation is used.  Both give identical results.
+  * @param key Pointer to the data to checksum
+  * @param numBytes Number of bytes to checksum, starting at (key)
+  * @param seed The CRC of any previous data, if you are calculating a CRC incrementally.  Defaults to zero.
+  * @returns the CRC-32C value of the data (e.g. 0xE3069283 for the nine ASCII bytes "123456789")
+  */
+MUSCLE_NODISCARD uint32 CalculateCRC32C(const void * key, size_t numBytes, uint32 seed = 0);
+
+#ifndef DOXYGEN_SHOULD_IGNORE_THIS
+namespace muscle_private
+{
+# if defined(__SIZEOF_INT128__)
+   __extension__ typedef unsigned __int128 uint128;  // __extension__ keeps -Wpedantic from complaining about the non-standard type
+# endif
+
+   // Returns the 128-bit product of (a) and (b), XOR-folded down to 64 bits
+   MUSCLE_NODISCARD static inline uint64 WyMix(uint64 a, uint64 b)
+   {
+# if defined(__SIZEOF_INT128__)
+      const uint128 r = ((uint128)a)*b;
+      return ((uint64)r)^((uint64)(r>>64));
+# else
+      const uint64 ha = a>>32, hb = b>>32, la = (uint32)a, lb = (uint32)b;
+      const uint64 rh = ha*hb, rm0 = ha*lb, rm1 = hb*la, rl = la*lb, t = rl+(rm0<<32);
+      const uint64 lo = t+(rm1<<32);
+      const uint64 hi = rh+(rm0>>32)+(rm1>>32)+(t<rl)+(lo<t);
+      return lo^hi;
+# endif
+   }
+
+   MUSCLE_NODISCARD static inline uint64 WyRead8(const uint8 * p) {return B_LENDIAN_TO_HOST_INT64(muscleCopyIn<uint64>(p));}
+   MUSCLE_NODISCARD static inline uint64 WyRead4(const uint8 * p) {return B_LENDIAN_TO_HOST_INT32(muscleCopyIn<uint32>(p));}
+}
+#endif
+
+/** Fast hash function for arbitrary data.  The current implementation is Wang Yi's wyhash (final version 4), which
+  * processes 16 or 48 bytes per step using 64x64->128-bit multiplies, and is several times faster than MurmurHash2
+  * on long keys while still passing SMHasher.  It is implemented inline, so that hashing of short keys (e.g. field
+  * names) doesn't incur any function-call overhead.  Results are the same on all CPU architectures.
+  * @param key Pointer to the data to hash
+  * @param numBytes Number of bytes to hash start at (key)
+  * @param seed An arbitrary number that affects the output values.  Defaults to zero.
+  * @returns a 64-bit hash value corresponding to the hashed data.
+  */
+MUSCLE_NODISCARD static inline uint64 CalculateFastHashCode64(const void * key, size_t numBytes, uint64 seed = 0)
+{
+   using namespace muscle_private;
+   static const uint64 s0 = 0x2d358dccaa6c78a5ULL, s1 = 0x8bb84b93962eacc9ULL, s2 = 0x4b33a62ed433d4a3ULL, s3 = 0x4d5a2da51de1aa47ULL;
+
+   const uint8 * p = (const uint8 *) key;
+   seed ^= WyMix(seed^s0, s1);
+
+   uint64 a, b;
+   if (numBytes <= 16)
+   {
+      if (numBytes >= 4)
+      {
+         const size_t q = (numBytes>>3)<<2;
+         a = (WyRead4(p)<<32)|WyRead4(p+q);
+         b = (WyRead4(p+numBytes-4)<<32)|WyRead4(p+numBytes-4-q);
+      }
+      else if (numBytes > 0)
+      {
+         a = (((uint64)p[0])<<16)|(((uint64)p[numBytes>>1])<<8)|p[numBytes-1];
+         b = 0;
+      }
+      else a = b = 0;
+   }
+   else
+   {
+      size_t i = numBytes;
+      if (i >= 48)
+      {
+         uint64 see1 = seed, see2 = seed;
+         do {
+            seed = WyMix(WyRead8(p)   ^s1, WyRead8(p+8) ^seed);
+            see1 = WyMix(WyRead8(p+16)^s2, WyRead8(p+24)^see1);
+            see2 = WyMix(WyRead8(p+32)^s3, WyRead8(p+40)^see2);
+            p += 48;
+            i -= 48;
+         } while(i >= 48);
+         seed ^= see1^see2;
+      }
+      while(i > 16)
+      {
+         seed = WyMix(WyRead8(p)^s1, WyRead8(p+8)^seed);
+         i -= 16;
+         p += 16;
+      }
+      a = WyRead8(p+i-16);
+      b = WyRead8(p+i-8);
+   }
+
+   // The final multiply needs both halves of the product separately, so we can't use WyMix() for it
+   a ^= s1;
+   b ^= seed;
+#if defined(__SIZEOF_INT128__)
+   const uint128 r = ((uint128)a)*b;
+   a = (uint64) r;
+   b = (uint64)(r>>64);
+#else
+   {
+      const uint64 ha = a>>32, hb = b>>32, la = (uint32)a, lb = (uint32)b;
+      const uint64 rh = ha*hb, rm0 = ha*lb, rm1 = hb*la, rl = la*lb, t = rl+(rm0<<32);
+      a = t+(rm1<<32);
+      b = rh+(rm0>>32)+(rm1>>32)+(t<rl)+(a<t);
+   }
+#endif
+   return WyMix(a^s0^((uint64)numBytes), b^s1);
+}
+
+/** 32-bit version of CalculateFastHashCode64().
+  * @param key Pointer to the data to hash
+  * @param numBytes Number of bytes to hash start at (key)
+  * @param seed An arbitrary number that affects the output values.  Defaults to zero.
+  * @returns a 32-bit hash value corresponding to the hashed data.
+  */
+MUSCLE_NODISCARD static inline uint32 CalculateFastHashCode(const void * key, size_t numBytes, uint32 seed = 0)
+{
+   const uint64 h = CalculateFastHashCode64(key, numBytes, seed);
+   return (uint32)(h^(h>>32));
+}
+
+/** Hash function for arbitrary data.  This is the hash function used by String, PODHashFunctor, and the
+  * various CalculateChecksum() methods.  Which algorithm it uses is selected at compile time:
+  *   - By default, it is MurmurHash2 (see CalculateMurmurHashCode()).
+  *   - If MUSCLE_USE_FAST_HASH_CODES is defined, it is wyhash (see CalculateFastHashCode()).
+  *   - If MUSCLE_USE_CRC32C_HASH_CODES is defined, it is CRC-32C (see CalculateCRC32C()).  This is only a good choice
+  *     when the target CPU has CRC32 instructions, since the software fallback is much slower than the other two.
+  * Note that changing the algorithm changes the values returned by all of the CalculateChecksum() methods as well,
+  * so all programs that compare checksums with each other (e.g. via the network) must be compiled with the same setting.
+  * @param key Pointer to the data to hash
+  * @param numBytes Number of bytes to hash start at (key)
+  * @param seed An arbitrary number that affects the output values.  Defaults to zero.
+  * @returns a 32-bit hash value corresponding to the hashed data.
+  */
+MUSCLE_NODISCARD static inline uint32 CalculateHashCode(const void * key, size_t numBytes, uint32 seed = 0)
+{
+#if defined(MUSCLE_USE_FAST_HASH_CODES)
+   return CalculateFastHashCode(key, numBytes, seed);
+#elif defined(MUSCLE_USE_CRC32C_HASH_CODES)
+   return CalculateCRC32C(key, numBytes, seed);
+#else
+   return CalculateMurmurHashCode(key, numBytes, seed);
+#endif
+}
+
+/** Same as CalculateHashCode(), but this version produces a 64-bit result.
+  * Uses wyhash if MUSCLE_USE_FAST_HASH_CODES or MUSCLE_USE_CRC32C_HASH_CODES is defined, or MurmurHash64A otherwise.
+  * @param key Pointer to the data to hash
+  * @param numBytes Number of bytes to hash start at (key)
+  * @param seed An arbitrary number that affects the output values.  Defaults to zero.
+  * @returns a 64-bit hash value corresponding to the hashed data.
+  */
+MUSCLE_NODISCARD static inline uint64 CalculateHashCode64(const void * key, size_t numBytes, uint64 seed = 0)
+{
+#if defined(MUSCLE_USE_FAST_HASH_CODES) || defined(MUSCLE_USE_CRC32C_HASH_CODES)
+   return CalculateFastHashCode64(key, numBytes, seed);
+#else
+   return CalculateMurmurHashCode64(key, numBytes, seed);
+#endif
+}
+
+/** Bulk version of CalculateHashCode():  computes the hash codes of (numKeys) separate keys in a single call.
+  * This is more efficient than calling CalculateHashCode() in a loop when hashing many short keys (e.g. when
+  * building a table of field names), since the keys' bytes are prefetched ahead of time and the hashing
+  * of one key can overlap with the hashing of the next.
+  * @param keys an array of (numKeys) pointers to the keys' bytes
+  * @param numBytes an array of (numKeys) byte-counts, one per key
+  * @param numKeys the number of keys to hash
+  * @param retHashCodes an array of (numKeys) uint32s that the hash codes will be written to, in the same order as (keys)
+  * @param seed An arbitrary number that affects the output values.  Defaults to zero.
+  */
+void CalculateHashCodes(const void * const * keys, const uint32 * numBytes, uint32 numKeys, uint32 * retHashCodes, uint32 seed = 0);
 
 /** This is a convenience function that will read through the passed-in byte
   * buffer and create a 32-bit checksum corresponding to its contents.
@@ -71,16 +71,22 @@ public:
      * Returns true iff the count's new value is 1; returns false
      *              if the count's new value is any other value.
      */
-   MUSCLE_NODISCARD inline bool AtomicIncrement()
+   MUSCLE_NODISCARD inline bool AtomicIncrement() {return (AtomicFetchAndIncrement() == 0);}
+
+   /** Atomically increments our counter by one, and returns the value it had just before the increment.
+     * Unlike calling GetCount() followed by AtomicIncrement(), this guarantees that no two
+     * callers will ever see the same return value (until the counter wraps around, anyway).
+     */
+   MUSCLE_NODISCARD inline int32 AtomicFetchAndIncrement()
    {
 #if defined(MUSCLE_SINGLE_THREAD_ONLY) || !defined(MUSCLE_AVOID_CPLUSPLUS11)
-      return (++_count == 1);
+      return _count++;
 #elif defined(MUSCLE_USE_MUTEXES_FOR_ATOMIC_OPERATIONS)
-      return (DoMutexAtomicIncrement(&_count, 1) == 1);
+      return DoMutexAtomicIncrement(&_count, 1)-1;
 #elif defined(WIN32)
-      return (InterlockedIncrement(&_count) == 1);
+      return InterlockedIncrement(&_count)-1;
 #elif defined(__APPLE__)
-      return (OSAtomicIncrement32Barrier(&_count) == 1);
+      return OSAtomicIncrement32Barrier(&_count)-1;
 #elif defined(MUSCLE_USE_POWERPC_INLINE_ASSEMBLY)
       volatile int * p = &_count;
       int tmp;  // tmp will be set to the value after the increment
@@ -92,7 +98,7 @@ public:
          : "=&r" (tmp)
          : "r" (p)
          : "cc", "memory");
-      return (tmp == 1);
+      return tmp-1;
 #elif defined(MUSCLE_USE_X86_INLINE_ASSEMBLY)
       int value = 1;  // the increment-by value
       asm volatile(
@@ -100,7 +106,7 @@ public:
          :"=a" (value)                 // Output
          : "a" (value), "m" (_count)  // Input
          :"memory");
-      return (value==0);  // at this point value contains the counter's pre-increment value
+      return value;  // at this point value contains the counter's pre-increment value
 #else
 # error "No atomic increment supplied for this OS!  Add it here in AtomicCount.h, remove -DMUSCLE_AVOID_CPLUSPLUS11 from your compiler-defines to use std::atomic, or put -DMUSCLE_SINGLE_THREAD_ONLY in your compiler-defines if you will not be using multithreading."
 #endif
@@ -41,6 +41,18 @@ static MemoryAllocatorRef _globalAllocatorRef;
 void SetCPlusPlusGlobalMemoryAllocator(const MemoryAllocatorRef & maRef) {_globalAllocatorRef = maRef;}
 const MemoryAllocatorRef & GetCPlusPlusGlobalMemoryAllocator() {return _globalAllocatorRef;}
 
+// On 64-bit platforms, the top byte of each allocation's header-word records which MUSCLE_MEMORY_TAG_* it was tallied under
+# ifdef MUSCLE_64_BIT_PLATFORM
+static const uint32 MEMORY_TAG_SHIFT = 56;
+static inline size_t GET_INTERNAL_SIZE(const size_t * iptr) {return (*iptr & ((((size_t)1)<<MEMORY_TAG_SHIFT)-1));}
+static inline uint32 GET_INTERNAL_TAG(const size_t * iptr)  {return (uint32)(*iptr >> MEMORY_TAG_SHIFT);}
+static inline void   SET_INTERNAL_HEADER(size_t * iptr, size_t iNumBytes, uint32 tag) {*iptr = iNumBytes | (((size_t)tag)<<MEMORY_TAG_SHIFT);}
+# else
+static inline size_t GET_INTERNAL_SIZE(const size_t * iptr) {return *iptr;}
+static inline uint32 GET_INTERNAL_TAG(const size_t *)       {return MUSCLE_MEMORY_TAG_NONE;}
+static inline void   SET_INTERNAL_HEADER(size_t * iptr, size_t iNumBytes, uint32) {*iptr = iNumBytes;}
+# endif
+
 # if MUSCLE_ENABLE_MEMORY_PARANOIA > 0
 
 // Functions for converting user-visible pointers (etc) to our internal implementation and back
@@ -52,7 +64,7 @@ static inline uint32    CONVERT_INTERNAL_TO_USER_SIZE(uint32 iNumBytes) {return
 static inline size_t *  CONVERT_USER_TO_INTERNAL_POINTER(void * uptr)   {return (((size_t*)uptr)-(1+MUSCLE_ENABLE_MEMORY_PARANOIA));}
 static inline void   *  CONVERT_INTERNAL_TO_USER_POINTER(size_t * iptr) {return ((void *)(iptr+1+MUSCLE_ENABLE_MEMORY_PARANOIA));}
 static inline size_t ** CONVERT_INTERNAL_TO_FRONT_GUARD(size_t * iptr)  {return ((size_t **)(((size_t*)iptr)+1));}
-static inline size_t ** CONVERT_INTERNAL_TO_REAR_GUARD(size_t * iptr)   {return ((size_t **)((((char *)iptr)+(*iptr))-(MUSCLE_ENABLE_MEMORY_PARANOIA*sizeof(size_t *))));}
+static inline size_t ** CONVERT_INTERNAL_TO_REAR_GUARD(size_t * iptr)   {return ((size_t **)((((char *)iptr)+GET_INTERNAL_SIZE(iptr))-(MUSCLE_ENABLE_MEMORY_PARANOIA*sizeof(size_t *))));}
 
 status_t MemoryParanoiaCheckBuffer(void * userPtr, bool crashIfInvalid)
 {
@@ -61,7 +73,8 @@ status_t MemoryParanoiaCheckBuffer(void * userPtr, bool crashIfInvalid)
       size_t * internalPtr = CONVERT_USER_TO_INTERNAL_POINTER(userPtr);
       size_t ** frontRead  = CONVERT_INTERNAL_TO_FRONT_GUARD(internalPtr);
       size_t ** rearRead   = CONVERT_INTERNAL_TO_REAR_GUARD(internalPtr);
-      size_t userBufLen    = CONVERT_INTERNAL_TO_USER_SIZE(*internalPtr);
+      size_t internalSize  = GET_INTERNAL_SIZE(internalPtr);
+      size_t userBufLen    = CONVERT_INTERNAL_TO_USER_SIZE(internalSize);
 
       bool foundCorruption = false;
       for (int i=0; i<MUSCLE_ENABLE_MEMORY_PARANOIA; i++)
@@ -73,19 +86,19 @@ status_t MemoryParanoiaCheckBuffer(void * userPtr, bool crashIfInvalid)
          {
             foundCorruption = true;
             TCHECKPOINT;
-            printf("MEMORY GUARD CORRUPTION (%i words before front): buffer (%p,%zu) (userptr=%p,%zu) expected %p, got %p!\n", (MUSCLE_ENABLE_MEMORY_PARANOIA-i), internalPtr, *internalPtr, userPtr, userBufLen, expectedFrontVal, frontRead[i]);
+            printf("MEMORY GUARD CORRUPTION (%i words before front): buffer (%p,%zu) (userptr=%p,%zu) expected %p, got %p!\n", (MUSCLE_ENABLE_MEMORY_PARANOIA-i), internalPtr, internalSize, userPtr, userBufLen, expectedFrontVal, frontRead[i]);
          }
          if (rearRead[i] != expectedRearVal)
          {
             foundCorruption = true;
             TCHECKPOINT;
-            printf("MEMORY GUARD CORRUPTION (%i words after rear):   buffer (%p,%zu) (userptr=%p,%zu) expected %p, got %p!\n", i+1, internalPtr, *internalPtr, userPtr, userBufLen, expectedRearVal, rearRead[i]);
+            printf("MEMORY GUARD CORRUPTION (%i words after rear):   buffer (%p,%zu) (userptr=%p,%zu) expected %p, got %p!\n", i+1, internalPtr, internalSize, userPtr, userBufLen, expectedRearVal, rearRead[i]);
          }
       }
       if (foundCorruption)
       {
          printf("CORRUPTED MEMORY BUFFER CONTENTS ARE (including %i front-guards and %i rear-guards of %zu bytes each):\n", MUSCLE_ENABLE_MEMORY_PARANOIA, MUSCLE_ENABLE_MEMORY_PARANOIA, sizeof(size_t *));
-         for (size_t i=0; i<*internalPtr; i++) printf("%02x ", ((char *)internalPtr)[i]); printf("\n");
+         for (size_t i=0; i<internalSize; i++) printf("%02x ", ((char *)internalPtr)[i]); printf("\n");
          if (crashIfInvalid)
          {
             fflush(stdout);
@@ -107,7 +120,7 @@ static void MemoryParanoiaPrepareBuffer(size_t * internalPtr, uint32 oldSize)
       rearWrite[i]  = internalPtr+i+MUSCLE_ENABLE_MEMORY_PARANOIA;
    }
 
-   uint32 newSize = CONVERT_INTERNAL_TO_USER_SIZE(*internalPtr);
+   uint32 newSize = CONVERT_INTERNAL_TO_USER_SIZE(GET_INTERNAL_SIZE(internalPtr));
    if (newSize > oldSize) memset(((char *)CONVERT_INTERNAL_TO_USER_POINTER(internalPtr))+oldSize, MEMORY_PARANOIA_ALLOCATED_GARBAGE_VALUE, newSize-oldSize);
 }
 
@@ -121,36 +134,254 @@ static inline void   *  CONVERT_INTERNAL_TO_USER_POINTER(size_t * iptr) {return
 
 # endif
 
-static size_t _currentlyAllocatedBytes = 0;  // Running tally of how many bytes our process has allocated
+static size_t _currentlyAllocatedBytes = 0;  // Running tally of how many bytes our process has allocated (including bytes that threads have reserved in advance)
+static int64 _taggedBytes[NUM_MUSCLE_MEMORY_TAGS] = {0};  // Running tallies of how many bytes are allocated under each memory-tag (index 0 is unused)
 
-size_t GetNumAllocatedBytes() {return _currentlyAllocatedBytes;}
+static const char * _memoryTagNames[NUM_MUSCLE_MEMORY_TAGS] = {
+   "Untagged",
+   "Messages",
+   "ByteBuffers",
+   "DataNodes"
+};
 
-void * muscleAlloc(size_t userSize, bool retryOnFailure)
+// Locks the global muscle lock (if there is one) for the duration of a slow-path accounting update
+class AccountingLockGuard MUSCLE_FINAL_CLASS : public NotCopyable
 {
-   using namespace muscle;
+public:
+   AccountingLockGuard() : _lock(GetGlobalMuscleLock())
+   {
+#ifndef MUSCLE_SINGLE_THREAD_ONLY
+      if ((_lock)&&(_lock->Lock().IsError()))
+      {
+         printf("Error, AccountingLockGuard could not lock the global muscle lock!\n");
+         _lock = NULL;
+      }
+#endif
+   }
 
-   const size_t internalSize = CONVERT_USER_TO_INTERNAL_SIZE(userSize);
+   ~AccountingLockGuard()
+   {
+#ifndef MUSCLE_SINGLE_THREAD_ONLY
+      if (_lock) (void) _lock->Unlock();
+#endif
+   }
 
-   void * userPtr = NULL;
+private:
+   Mutex * _lock;
+};
+
+#ifndef MUSCLE_AVOID_CPLUSPLUS11_THREAD_LOCAL_KEYWORD
+
+// Each thread charges and credits its allocations against a small local reserve of bytes, so that the global
+// lock (and the MemoryAllocator's policy callbacks) only need to be involved about once per
+// MUSCLE_MEMORY_TRACKING_THREAD_BATCH_BYTES, rather than once per allocation.
+// This class is deliberately trivially-constructible, so that accessing it can never cause an allocation.
+class ThreadMemoryAccount
+{
+public:
+   size_t _reservedBytes;                     // bytes already added to _currentlyAllocatedBytes on our behalf, but not yet handed out
+   int64 _tagDeltas[NUM_MUSCLE_MEMORY_TAGS];  // changes to _taggedBytes that we haven't folded into it yet
+   uint32 _currentTag;                        // the MUSCLE_MEMORY_TAG_* that this thread's new allocations should be tallied under
+   bool _isGone;                              // set true when our thread's exit-handler has run
+};
+static thread_local ThreadMemoryAccount _threadMemoryAccount;
+
+// Moves (acct)'s per-tag deltas, and all but (keepReservedBytes) of its reserve, into the process-wide tallies
+static void FoldThreadMemoryAccount(ThreadMemoryAccount & acct, size_t keepReservedBytes)
+{
+   AccountingLockGuard alg;
+   if (acct._reservedBytes > keepReservedBytes)
+   {
+      const size_t numBytes = acct._reservedBytes-keepReservedBytes;
+      MemoryAllocator * ma = GetCPlusPlusGlobalMemoryAllocator()();
+      if (ma) ma->AboutToFree(_currentlyAllocatedBytes, numBytes);
+      _currentlyAllocatedBytes -= numBytes;
+      acct._reservedBytes = keepReservedBytes;
+   }
+   for (uint32 i=1; i<NUM_MUSCLE_MEMORY_TAGS; i++)
+   {
+      _taggedBytes[i] += acct._tagDeltas[i];
+      acct._tagDeltas[i] = 0;
+   }
+}
+
+// Hands a thread's reserve back when the thread exits (after which that thread's allocations go straight to the global tallies)
+class ThreadMemoryAccountExitHandler
+{
+public:
+   ThreadMemoryAccountExitHandler() : _isArmed(false) {/* empty */}
+
+   ~ThreadMemoryAccountExitHandler()
+   {
+      if (_isArmed)
+      {
+         FoldThreadMemoryAccount(_threadMemoryAccount, 0);
+         _threadMemoryAccount._isGone = true;
+      }
+   }
+
+   bool _isArmed;
+};
+static thread_local ThreadMemoryAccountExitHandler _threadMemoryAccountExitHandler;
+
+static inline ThreadMemoryAccount * GetThreadMemoryAccount()
+{
+   if (_threadMemoryAccount._isGone) return NULL;
+   _threadMemoryAccountExitHandler._isArmed = true;  // so that our reserve and tag-deltas get handed back when our thread exits, even if it never charged anything
+   return &_threadMemoryAccount;
+}
+static inline uint32 GetCurrentThreadMemoryTag() {return _threadMemoryAccount._currentTag;}
+
+#else
+
+// Without the thread_local keyword, there are no per-thread accounts, and every allocation updates the global tallies directly
+class ThreadMemoryAccount;
+static inline ThreadMemoryAccount * GetThreadMemoryAccount() {return NULL;}
+static inline uint32 GetCurrentThreadMemoryTag() {return MUSCLE_MEMORY_TAG_NONE;}
+
+#endif
+
+// Accounts for (numBytes) that the calling thread is about to allocate.
+// Returns true if the allocation may proceed, or false if the MemoryAllocator vetoed it.
+static bool ChargeBytes(size_t numBytes)
+{
+   ThreadMemoryAccount * acct = GetThreadMemoryAccount();
+#ifndef MUSCLE_AVOID_CPLUSPLUS11_THREAD_LOCAL_KEYWORD
+   if (acct)
+   {
+      if (acct->_reservedBytes >= numBytes)
+      {
+         acct->_reservedBytes -= numBytes;  // fast path:  no locking necessary
+         return true;
+      }
+   }
+   const size_t haveBytes = acct ? acct->_reservedBytes : 0;
+#else
+   const size_t haveBytes = 0;
+#endif
+
+   // Slow path:  reserve what we need plus another batch from the global tally, or (if the policy won't allow that) just what we need
+   const size_t needBytes = numBytes-haveBytes;
+   size_t topUpBytes = acct ? (size_t)MUSCLE_MEMORY_TRACKING_THREAD_BATCH_BYTES : 0;
+
+   AccountingLockGuard alg;
    MemoryAllocator * ma = GetCPlusPlusGlobalMemoryAllocator()();
+   if ((ma)&&(ma->AboutToAllocate(_currentlyAllocatedBytes, needBytes+topUpBytes).IsError()))
+   {
+      if ((topUpBytes == 0)||(ma->AboutToAllocate(_currentlyAllocatedBytes, needBytes).IsError())) return false;
+      topUpBytes = 0;
+   }
 
-#ifndef MUSCLE_SINGLE_THREAD_ONLY
-   Mutex * glock = ma ? GetGlobalMuscleLock() : NULL;
-   if ((glock)&&(glock->Lock().IsError()))
+   _currentlyAllocatedBytes += (needBytes+topUpBytes);
+#ifndef MUSCLE_AVOID_CPLUSPLUS11_THREAD_LOCAL_KEYWORD
+   if (acct) acct->_reservedBytes = topUpBytes;
+#endif
+   return true;
+}
+
+// Accounts for (numBytes) that the calling thread has just freed (or that it charged for but didn't end up allocating)
+static void CreditBytes(size_t numBytes)
+{
+#ifndef MUSCLE_AVOID_CPLUSPLUS11_THREAD_LOCAL_KEYWORD
+   ThreadMemoryAccount * acct = GetThreadMemoryAccount();
+   if (acct)
+   {
+      acct->_reservedBytes += numBytes;
+      if (acct->_reservedBytes > (2*MUSCLE_MEMORY_TRACKING_THREAD_BATCH_BYTES)) FoldThreadMemoryAccount(*acct, MUSCLE_MEMORY_TRACKING_THREAD_BATCH_BYTES);
+      return;
+   }
+#endif
+
+   AccountingLockGuard alg;
+   MemoryAllocator * ma = GetCPlusPlusGlobalMemoryAllocator()();
+   if (ma) ma->AboutToFree(_currentlyAllocatedBytes, numBytes);
+   _currentlyAllocatedBytes -= numBytes;
+}
+
+// Adds (delta) to the tally for the given (non-zero) memory-tag
+static void AdjustTaggedBytes(uint32 tag, int64 delta)
+{
+#ifndef MUSCLE_AVOID_CPLUSPLUS11_THREAD_LOCAL_KEYWORD
+   ThreadMemoryAccount * acct = GetThreadMemoryAccount();
+   if (acct)
    {
-      printf("Error, muscleAlloc() could not lock the global muscle lock!\n");
-      SetFailedMemoryRequestSize(userSize);   // FogBugz #7547
-      return NULL;  // serialize access to (ma)
+      int64 & d = acct->_tagDeltas[tag];
+      d += delta;
+      if ((d > MUSCLE_MEMORY_TRACKING_THREAD_BATCH_BYTES)||(d < -MUSCLE_MEMORY_TRACKING_THREAD_BATCH_BYTES)) FoldThreadMemoryAccount(*acct, acct->_reservedBytes);
+      return;
    }
 #endif
 
-   if ((ma == NULL)||(ma->AboutToAllocate(_currentlyAllocatedBytes, internalSize).IsOK()))
+   AccountingLockGuard alg;
+   _taggedBytes[tag] += delta;
+}
+
+// Called when an allocation has failed:  hands back our thread's reserve (so the retry has as much room as possible)
+// and then gives the MemoryAllocator a chance to free up some memory.  Returns the MemoryAllocator, or NULL if there isn't one.
+static MemoryAllocator * HandleAllocationFailure(size_t numBytes)
+{
+   MemoryAllocator * ma = GetCPlusPlusGlobalMemoryAllocator()();
+   if (ma)
+   {
+      FlushCurrentThreadMemoryAccounting();
+      ma->AllocationFailed(_currentlyAllocatedBytes, numBytes);  // see if ma can free spare buffers up for us
+   }
+   return ma;
+}
+
+size_t GetNumAllocatedBytes() {return _currentlyAllocatedBytes;}
+
+size_t GetNumAllocatedBytesForTag(uint32 tag)
+{
+   if (tag >= NUM_MUSCLE_MEMORY_TAGS) return 0;
+
+   AccountingLockGuard alg;
+   if (tag == MUSCLE_MEMORY_TAG_NONE)
+   {
+      int64 untagged = _currentlyAllocatedBytes;
+      for (uint32 i=1; i<NUM_MUSCLE_MEMORY_TAGS; i++) untagged -= _taggedBytes[i];
+      return (size_t) muscleMax(untagged, (int64)0);
+   }
+   else return (size_t) muscleMax(_taggedBytes[tag], (int64)0);  // (can be briefly negative, if a thread freed what another thread allocated)
+}
+
+const char * GetMemoryTagName(uint32 tag) {return (tag < NUM_MUSCLE_MEMORY_TAGS) ? _memoryTagNames[tag] : NULL;}
+
+uint32 SetCurrentThreadMemoryTag(uint32 tag)
+{
+#ifndef MUSCLE_AVOID_CPLUSPLUS11_THREAD_LOCAL_KEYWORD
+   const uint32 oldTag = _threadMemoryAccount._currentTag;
+   _threadMemoryAccount._currentTag = (tag < NUM_MUSCLE_MEMORY_TAGS) ? tag : MUSCLE_MEMORY_TAG_NONE;
+   return oldTag;
+#else
+   (void) tag;
+   return MUSCLE_MEMORY_TAG_NONE;
+#endif
+}
+
+void FlushCurrentThreadMemoryAccounting()
+{
+#ifndef MUSCLE_AVOID_CPLUSPLUS11_THREAD_LOCAL_KEYWORD
+   ThreadMemoryAccount * acct = GetThreadMemoryAccount();
+   if (acct) FoldThreadMemoryAccount(*acct, 0);
+#endif
+}
+
+void * muscleAlloc(size_t userSize, bool retryOnFailure)
+{
+   using namespace muscle;
+
+   const size_t internalSize = CONVERT_USER_TO_INTERNAL_SIZE(userSize);
+
+   void * userPtr = NULL;
+   if (ChargeBytes(internalSize))
    {
       size_t * internalPtr = (size_t *) malloc(internalSize);
       if (internalPtr)
       {
-         *internalPtr = internalSize;  // our little header tag so that muscleFree() will know how big the allocation was
-         _currentlyAllocatedBytes += internalSize;
+         const uint32 tag = GetCurrentThreadMemoryTag();
+         SET_INTERNAL_HEADER(internalPtr, internalSize, tag);  // our little header tag so that muscleFree() will know how big the allocation was
+         if (tag != MUSCLE_MEMORY_TAG_NONE) AdjustTaggedBytes(tag, internalSize);
 
 #if MUSCLE_ENABLE_MEMORY_PARANOIA > 0
          MemoryParanoiaPrepareBuffer(internalPtr, 0);
@@ -165,30 +396,28 @@ void * muscleAlloc(size_t userSize, bool retryOnFailure)
          }
 #endif
       }
-      else if (ma) ma->AboutToFree(_currentlyAllocatedBytes+internalSize, internalSize);  // FogBugz #4494:  roll back the call to AboutToAllocate()!
+      else CreditBytes(internalSize);  // FogBugz #4494:  roll back the call to ChargeBytes()!
    }
 
-   if ((ma)&&(userPtr == NULL))
+   if ((userPtr == NULL)&&(GetCPlusPlusGlobalMemoryAllocator()()))
    {
+      AccountingLockGuard alg;  // serialize access to the MemoryAllocator
+
       // I call printf() instead of LogTime() to avoid any chance of an infinite recursion
       printf("muscleAlloc:  allocation failure (tried to allocate " UINT32_FORMAT_SPEC " internal bytes / " UINT32_FORMAT_SPEC " user bytes)\n", (uint32)internalSize, (uint32)userSize);
       fflush(stdout);  // make sure this message gets out!
 
-      ma->AllocationFailed(_currentlyAllocatedBytes, internalSize);  // see if ma can free spare buffers up for us
+      MemoryAllocator * ma = HandleAllocationFailure(internalSize);
 
       // Maybe the AllocationFailed() method was able to free up some memory; so we'll try it one more time
       // That way we might be able to recover without interrupting the operation that was in progress.
-      if (retryOnFailure)
+      if ((ma)&&(retryOnFailure))
       {
          userPtr = muscleAlloc(userSize, false);
          if (userPtr == NULL) ma->SetAllocationHasFailed(true);
       }
    }
 
-#ifndef MUSCLE_SINGLE_THREAD_ONLY
-   if (glock) (void) glock->Unlock();
-#endif
-
    if (userPtr == NULL) SetFailedMemoryRequestSize(userSize);   // FogBugz #7547
    return userPtr;
 }
@@ -221,33 +450,23 @@ void * muscleRealloc(void * oldUserPtr, size_t newUserSize, bool retryOnFailure)
 
    const size_t newInternalSize = CONVERT_USER_TO_INTERNAL_SIZE(newUserSize);
    size_t * oldInternalPtr      = CONVERT_USER_TO_INTERNAL_POINTER(oldUserPtr);
-   const size_t oldInternalSize = *oldInternalPtr;
+   const size_t oldInternalSize = GET_INTERNAL_SIZE(oldInternalPtr);
    if (newInternalSize == oldInternalSize) return oldUserPtr;  // same size as before?  Then we are already done!
 
+   const uint32 tag = GET_INTERNAL_TAG(oldInternalPtr);  // a resized buffer stays tallied under the tag it was originally allocated with
    void * newUserPtr = NULL;
-   MemoryAllocator * ma = GetCPlusPlusGlobalMemoryAllocator()();
-
-#ifndef MUSCLE_SINGLE_THREAD_ONLY
-   Mutex * glock = ma ? GetGlobalMuscleLock() : NULL;
-   if ((glock)&&(glock->Lock().IsError()))
-   {
-      printf("Error, muscleRealloc() could not lock the global muscle lock!\n");
-      SetFailedMemoryRequestSize(newUserSize);   // FogBugz #7547
-      return NULL;  // serialize access to (ma)
-   }
-#endif
 
    const size_t oldUserSize = CONVERT_INTERNAL_TO_USER_SIZE(oldInternalSize);
    if (newInternalSize > oldInternalSize)
    {
       const size_t growBy = newInternalSize-oldInternalSize;
-      if ((ma == NULL)||(ma->AboutToAllocate(_currentlyAllocatedBytes, growBy).IsOK()))
+      if (ChargeBytes(growBy))
       {
          size_t * newInternalPtr = (size_t *) realloc(oldInternalPtr, newInternalSize);
          if (newInternalPtr)
          {
-            _currentlyAllocatedBytes += growBy;  // only reflect the newly-allocated bytes
-            *newInternalPtr = newInternalSize;  // our little header tag so that muscleFree() will know how big the allocation was
+            SET_INTERNAL_HEADER(newInternalPtr, newInternalSize, tag);  // our little header tag so that muscleFree() will know how big the allocation was
+            if (tag != MUSCLE_MEMORY_TAG_NONE) AdjustTaggedBytes(tag, growBy);  // only reflect the newly-allocated bytes
             newUserPtr = CONVERT_INTERNAL_TO_USER_POINTER(newInternalPtr);
 
 #ifdef DEBUG_LARGE_MEMORY_ALLOCATIONS_THRESHOLD
@@ -262,20 +481,22 @@ void * muscleRealloc(void * oldUserPtr, size_t newUserSize, bool retryOnFailure)
             MemoryParanoiaPrepareBuffer(newInternalPtr, oldUserSize);
 #endif
          }
-         else if (ma) ma->AboutToFree(_currentlyAllocatedBytes+growBy, growBy);  // FogBugz #4494:  roll back the call to AboutToAllocate()!
+         else CreditBytes(growBy);  // FogBugz #4494:  roll back the call to ChargeBytes()!
       }
 
-      if ((ma)&&(newUserPtr == NULL))
+      if ((newUserPtr == NULL)&&(GetCPlusPlusGlobalMemoryAllocator()()))
       {
+         AccountingLockGuard alg;  // serialize access to the MemoryAllocator
+
          // I call printf() instead of LogTime() to avoid any chance of an infinite recursion
          printf("muscleRealloc:  reallocation failure (tried to grow " UINT32_FORMAT_SPEC "->" UINT32_FORMAT_SPEC " internal bytes / " UINT32_FORMAT_SPEC "->" UINT32_FORMAT_SPEC " user bytes))\n", (uint32)oldInternalSize, (uint32)newInternalSize, (uint32)oldUserSize, (uint32)newUserSize);
          fflush(stdout);  // make sure this message gets out!
 
-         ma->AllocationFailed(_currentlyAllocatedBytes, growBy);  // see if ma can free spare buffers up for us
+         MemoryAllocator * ma = HandleAllocationFailure(growBy);
 
          // Maybe the AllocationFailed() method was able to free up some memory; so we'll try it one more time
          // That way we might be able to recover without interrupting the operation that was in progress.
-         if (retryOnFailure)
+         if ((ma)&&(retryOnFailure))
          {
             newUserPtr = muscleRealloc(oldUserPtr, newUserSize, false);
             if (newUserPtr == NULL) ma->SetAllocationHasFailed(true);
@@ -285,13 +506,12 @@ void * muscleRealloc(void * oldUserPtr, size_t newUserSize, bool retryOnFailure)
    else
    {
       const size_t shrinkBy = oldInternalSize-newInternalSize;
-      if (ma) ma->AboutToFree(_currentlyAllocatedBytes, shrinkBy);
-
       size_t * newInternalPtr = (size_t *) realloc(oldInternalPtr, newInternalSize);
       if (newInternalPtr)
       {
-         *newInternalPtr = newInternalSize;  // our little header tag so that muscleFree() will know how big the allocation is now
-         _currentlyAllocatedBytes -= shrinkBy;
+         SET_INTERNAL_HEADER(newInternalPtr, newInternalSize, tag);  // our little header tag so that muscleFree() will know how big the allocation is now
+         if (tag != MUSCLE_MEMORY_TAG_NONE) AdjustTaggedBytes(tag, -((int64)shrinkBy));
+         CreditBytes(shrinkBy);
 
 #if MUSCLE_ENABLE_MEMORY_PARANOIA > 0
          MemoryParanoiaPrepareBuffer(newInternalPtr, MUSCLE_NO_LIMIT);
@@ -304,18 +524,12 @@ void * muscleRealloc(void * oldUserPtr, size_t newUserSize, bool retryOnFailure)
       }
       else
       {
-         if (ma) (void) ma->AboutToAllocate(_currentlyAllocatedBytes, shrinkBy);  // roll back the previous call to AboutToFree()
-
          newUserPtr = oldUserPtr;  // I guess the best thing to do is just send back the old pointer?  Not sure what to do here.
          printf("muscleRealloc:  reallocation failure (tried to shrink " UINT32_FORMAT_SPEC "->" UINT32_FORMAT_SPEC " internal bytes / " UINT32_FORMAT_SPEC "->" UINT32_FORMAT_SPEC " user bytes))\n", (uint32)oldInternalSize, (uint32)newInternalSize, (uint32)oldUserSize, (uint32)newUserSize);
          fflush(stdout);  // make sure this message gets out!
       }
    }
 
-#ifndef MUSCLE_SINGLE_THREAD_ONLY
-   if (glock) (void) glock->Unlock();
-#endif
-
    if (newUserPtr == NULL) SetFailedMemoryRequestSize(newUserSize);   // FogBugz #7547
    return newUserPtr;
 }
@@ -330,35 +544,22 @@ void muscleFree(void * userPtr)
       MemoryParanoiaCheckBuffer(userPtr);
 #endif
 
-      MemoryAllocator * ma = GetCPlusPlusGlobalMemoryAllocator()();
-
-#ifndef MUSCLE_SINGLE_THREAD_ONLY
-      Mutex * glock = ma ? GetGlobalMuscleLock() : NULL;
-      if ((glock)&&(glock->Lock().IsError()))
-      {
-         printf("Error, muscleFree() could not lock the global muscle lock!!!\n");
-         return;  // serialize access to (ma)
-      }
-#endif
-
       size_t * internalPtr = CONVERT_USER_TO_INTERNAL_POINTER(userPtr);
-      if (ma) ma->AboutToFree(_currentlyAllocatedBytes, *internalPtr);
-
-      _currentlyAllocatedBytes -= *internalPtr;
+      const size_t internalSize = GET_INTERNAL_SIZE(internalPtr);
+      const uint32 tag = GET_INTERNAL_TAG(internalPtr);
 
 #ifdef DEBUG_LARGE_MEMORY_ALLOCATIONS_THRESHOLD
-      if (*internalPtr >= DEBUG_LARGE_MEMORY_ALLOCATIONS_THRESHOLD) printf("-" UINT32_FORMAT_SPEC " = " UINT32_FORMAT_SPEC " userPtr=%p\n", (uint32)*internalPtr, (uint32)_currentlyAllocatedBytes, userPtr);
-#endif
-
-#ifndef MUSCLE_SINGLE_THREAD_ONLY
-      if (glock) (void) glock->Unlock();
+      if (internalSize >= DEBUG_LARGE_MEMORY_ALLOCATIONS_THRESHOLD) printf("-" UINT32_FORMAT_SPEC " = " UINT32_FORMAT_SPEC " userPtr=%p\n", (uint32)internalSize, (uint32)(_currentlyAllocatedBytes-internalSize), userPtr);
 #endif
 
 #if MUSCLE_ENABLE_MEMORY_PARANOIA > 0
-      memset(internalPtr, MEMORY_PARANOIA_DEALLOCATED_GARBAGE_VALUE, *internalPtr);  // make it obvious this memory was freed by munging it
+      memset(internalPtr, MEMORY_PARANOIA_DEALLOCATED_GARBAGE_VALUE, internalSize);  // make it obvious this memory was freed by munging it
 #endif
 
       free(internalPtr);
+
+      if (tag != MUSCLE_MEMORY_TAG_NONE) AdjustTaggedBytes(tag, -((int64)internalSize));
+      CreditBytes(internalSize);
    }
 }
 
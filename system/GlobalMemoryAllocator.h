@@ -3,15 +3,31 @@
 #ifndef MuscleGlobalMemoryAllocator_h
 #define MuscleGlobalMemoryAllocator_h
 
+#include "support/NotCopyable.h"
 #include "util/MemoryAllocator.h"
 
 namespace muscle {
 
+/** Memory-tags that can be passed to a MemoryTagGuard, so that the bytes allocated within its scope can be tallied separately.
+  * (Per-tag tallies are only kept when MUSCLE_ENABLE_MEMORY_TRACKING is defined; see GetNumAllocatedBytesForTag())
+  */
+enum {
+   MUSCLE_MEMORY_TAG_NONE = 0,     /**< memory that wasn't allocated within the scope of any MemoryTagGuard */
+   MUSCLE_MEMORY_TAG_MESSAGES,     /**< memory allocated on behalf of Message objects and their fields */
+   MUSCLE_MEMORY_TAG_BYTEBUFFERS,  /**< memory allocated on behalf of ByteBuffer objects */
+   MUSCLE_MEMORY_TAG_DATANODES,    /**< memory allocated on behalf of a server's DataNode tree */
+   NUM_MUSCLE_MEMORY_TAGS          /**< guard value */
+};
+
 // You can't use these functions unless memory tracking is enabled!
 // So if you are getting errors, make sure -DMUSCLE_ENABLE_MEMORY_TRACKING
 // is specified in your Makefile.
 #ifdef MUSCLE_ENABLE_MEMORY_TRACKING
 
+#ifndef MUSCLE_MEMORY_TRACKING_THREAD_BATCH_BYTES
+# define MUSCLE_MEMORY_TRACKING_THREAD_BATCH_BYTES (32*1024)  /**< how many bytes a thread may allocate or free before it updates the process-wide tally (see COMPILEROPTIONS.txt) */
+#endif
+
 /** Set the MemoryAllocator object that is to be called by the C++ global new and delete operators.
   * @note this function is only available is -DMUSCLE_ENABLE_MEMORY_TRACKING is defined in the Makefile.
   * @param maRef Reference to The new MemoryAllocator object to use.  May be a NULL reference
@@ -27,9 +43,43 @@ MUSCLE_NODISCARD const MemoryAllocatorRef & GetCPlusPlusGlobalMemoryAllocator();
 
 /** Returns the number of bytes currently dynamically allocated by this process.
   * @note this function is only available is -DMUSCLE_ENABLE_MEMORY_TRACKING is defined in the Makefile.
+  * @note each thread accounts for its allocations locally, and only updates the process-wide tally when it has
+  *       allocated or freed more than MUSCLE_MEMORY_TRACKING_THREAD_BATCH_BYTES since its last update.  Bytes that a
+  *       thread has reserved this way are included in the returned value, so it may be too high by up to
+  *       (2*MUSCLE_MEMORY_TRACKING_THREAD_BATCH_BYTES) per thread.  Call FlushCurrentThreadMemoryAccounting() first if that matters.
   */
 MUSCLE_NODISCARD size_t GetNumAllocatedBytes();
 
+/** Returns the number of bytes currently allocated by this process within the scope of a MemoryTagGuard for the given tag.
+  * @param tag a MUSCLE_MEMORY_TAG_* value.  If MUSCLE_MEMORY_TAG_NONE is passed, the number of allocated bytes that were not tagged is returned.
+  * @note this function is only available is -DMUSCLE_ENABLE_MEMORY_TRACKING is defined in the Makefile.
+  * @note per-tag counts are folded into the process-wide tallies lazily, so the returned value may lag behind the truth
+  *       by up to MUSCLE_MEMORY_TRACKING_THREAD_BATCH_BYTES per thread.  Per-tag tallies are only kept on 64-bit platforms;
+  *       on other platforms all allocations are counted as untagged.
+  */
+MUSCLE_NODISCARD size_t GetNumAllocatedBytesForTag(uint32 tag);
+
+/** Returns a human-readable name for the given MUSCLE_MEMORY_TAG_* value (e.g. "ByteBuffers"), or NULL if (tag) isn't valid.
+  * @param tag a MUSCLE_MEMORY_TAG_* value
+  * @note this function is only available is -DMUSCLE_ENABLE_MEMORY_TRACKING is defined in the Makefile.
+  */
+MUSCLE_NODISCARD const char * GetMemoryTagName(uint32 tag);
+
+/** Sets the memory-tag that subsequent allocations made by the calling thread will be tallied under.
+  * Usually you'll want to declare a MemoryTagGuard instead of calling this directly.
+  * @param tag a MUSCLE_MEMORY_TAG_* value
+  * @returns the calling thread's previous memory-tag.
+  * @note this function is only available is -DMUSCLE_ENABLE_MEMORY_TRACKING is defined in the Makefile.
+  */
+uint32 SetCurrentThreadMemoryTag(uint32 tag);
+
+/** Folds the calling thread's locally-accounted allocation counts (and any bytes it has reserved in advance)
+  * into the process-wide tallies, so that GetNumAllocatedBytes() and GetNumAllocatedBytesForTag() will be exact
+  * with respect to the calling thread's allocations.  Threads do this automatically when they exit.
+  * @note this function is only available is -DMUSCLE_ENABLE_MEMORY_TRACKING is defined in the Makefile.
+  */
+void FlushCurrentThreadMemoryAccounting();
+
 /** MUSCLE version of the C malloc() call.  Unlike the C malloc() call, however
  *  this function will use the global MemoryAllocator object when allocating memory.
  *  The only time you should need to call this directly is from C code where
@@ -129,6 +179,35 @@ MUSCLE_NODISCARD static inline char * muscleStrdup(const char * s, bool retryOnF
 
 #endif
 
+/** A RAII class that sets the calling thread's memory-tag for the duration of its scope, so that any memory
+  * allocated within that scope will be tallied under the given tag (see GetNumAllocatedBytesForTag()).
+  * The tag is recorded with each allocation, so the allocation is un-tallied correctly no matter which thread
+  * or scope it is later freed from.  If MUSCLE_ENABLE_MEMORY_TRACKING isn't defined, this class is a no-op.
+  */
+class MUSCLE_NODISCARD MemoryTagGuard MUSCLE_FINAL_CLASS : public NotCopyable
+{
+public:
+   /** Constructor.
+     * @param tag the MUSCLE_MEMORY_TAG_* value to tally allocations under while this object exists.
+     */
+#ifdef MUSCLE_ENABLE_MEMORY_TRACKING
+   explicit MemoryTagGuard(uint32 tag) : _prevTag(SetCurrentThreadMemoryTag(tag)) {/* empty */}
+
+   /** Destructor.  Restores the calling thread's previous memory-tag. */
+   ~MemoryTagGuard() {(void) SetCurrentThreadMemoryTag(_prevTag);}
+#else
+   explicit MemoryTagGuard(uint32 tag) {(void) tag;}
+#endif
+
+#ifdef MUSCLE_ENABLE_MEMORY_TRACKING
+private:
+   const uint32 _prevTag;
+#endif
+};
+
+/** Convenience macro:  Declares an anonymous MemoryTagGuard object on the stack, for the given MUSCLE_MEMORY_TAG_* value. */
+#define DECLARE_MEMORY_TAG_GUARD(tag) MemoryTagGuard MUSCLE_UNIQUE_NAME(tag)
+
 } // end namespace muscle
 
 #endif
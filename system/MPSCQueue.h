@@ -0,0 +1,175 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#ifndef MuscleMPSCQueue_h
+#define MuscleMPSCQueue_h
+
+#include "support/NotCopyable.h"
+#include "system/AtomicCounter.h"
+
+#if defined(MUSCLE_AVOID_CPLUSPLUS11) || defined(MUSCLE_SINGLE_THREAD_ONLY)
+# include "system/Mutex.h"
+# include "util/Queue.h"
+#else
+# include <atomic>
+# include <thread>  // for std::this_thread::yield()
+# define MUSCLE_MPSC_QUEUE_IS_LOCK_FREE 1  /**< defined iff MPSCQueue is using its lock-free implementation */
+#endif
+
+namespace muscle {
+
+/** This class is a FIFO queue that any number of threads may add items to concurrently, but that only
+  * one thread (the "consumer") may remove items from.  Adding and removing items doesn't lock any Mutex.
+  *
+  * It is implemented as a singly-linked list of heap-allocated nodes (using Dmitry Vyukov's node-based MPSC
+  * algorithm):  a producer links in its node with a single atomic exchange, and the consumer unlinks nodes
+  * with plain loads and stores, so neither side ever has to wait for a lock.
+  *
+  * AddTail() also tells the caller whether the queue was empty before the new item was added, which makes
+  * it easy to signal the consumer only when it might be sleeping (i.e. on the empty-to-non-empty transition)
+  * rather than once per item.
+  *
+  * If MUSCLE_AVOID_CPLUSPLUS11 is defined, this class falls back to a Mutex-guarded Queue with the same API.
+  * @tparam ItemType the type of object to hold in the queue.  Must be default-constructible and copyable.
+  */
+template <class ItemType> class MUSCLE_NODISCARD MPSCQueue MUSCLE_FINAL_CLASS : public NotCopyable
+{
+public:
+   /** Default constructor. */
+   MPSCQueue()
+#ifdef MUSCLE_MPSC_QUEUE_IS_LOCK_FREE
+      : _head(&_stub), _tail(&_stub)
+#endif
+   {
+      // empty
+   }
+
+   /** Destructor.  Any items still in the queue are deleted. */
+   ~MPSCQueue()
+   {
+      Clear();
+#ifdef MUSCLE_MPSC_QUEUE_IS_LOCK_FREE
+      if (_tail != &_stub) delete _tail;
+#endif
+   }
+
+   /** Appends an item to the tail of the queue.  May be called from any thread.
+     * @param item the item to append
+     * @param optRetWasEmpty if non-NULL, this bool will be set to true iff the queue contained no items
+     *                       just before (item) was added to it, or false otherwise.
+     * @returns B_NO_ERROR on success, or B_OUT_OF_MEMORY.
+     */
+   status_t AddTail(const ItemType & item, bool * optRetWasEmpty = NULL)
+   {
+#ifdef MUSCLE_MPSC_QUEUE_IS_LOCK_FREE
+      Node * n = newnothrow Node(item);
+      MRETURN_OOM_ON_NULL(n);
+
+      Node * prev = _head.exchange(n, std::memory_order_acq_rel);
+      prev->_next.store(n, std::memory_order_release);  // until this store, the consumer can't see (n) yet
+
+      const bool wasEmpty = _count.AtomicIncrement();  // done after the link, so that a non-zero count means there is an item to pop
+#else
+      bool wasEmpty;
+      {
+         DECLARE_MUTEXGUARD(_mutex);
+         MRETURN_ON_ERROR(_queue.AddTail(item));
+         wasEmpty = (_queue.GetNumItems() == 1);
+      }
+#endif
+      if (optRetWasEmpty) *optRetWasEmpty = wasEmpty;
+      return B_NO_ERROR;
+   }
+
+   /** Removes the item at the head of the queue and places it into (retItem).
+     * @note only the consumer thread may call this method!
+     * @param retItem on success, the removed item is written here.
+     * @param optRetNumItemsLeft if non-NULL, this value will be set to the number of items still in the queue
+     *                           after the removal.  (In the presence of concurrent producers this is just an estimate)
+     * @returns B_NO_ERROR on success, or B_DATA_NOT_FOUND if the queue was empty.
+     */
+   status_t RemoveHead(ItemType & retItem, uint32 * optRetNumItemsLeft = NULL)
+   {
+#ifdef MUSCLE_MPSC_QUEUE_IS_LOCK_FREE
+      if (_count.GetCount() <= 0)
+      {
+         if (optRetNumItemsLeft) *optRetNumItemsLeft = 0;
+         return B_DATA_NOT_FOUND;
+      }
+
+      // Since (_count) is non-zero, an item has been fully linked in, but a producer that exchanged
+      // _head before it may still be about to store its link; in that case we wait for it to do so.
+      Node * tail = _tail;
+      Node * next;
+      for (uint32 spins=0; (next = tail->_next.load(std::memory_order_acquire)) == NULL; spins++)
+      {
+         if (spins >= 64) std::this_thread::yield();  // the producer may have been preempted mid-link
+      }
+
+      retItem = next->_item;
+      next->_item = GetDefaultObjectForType<ItemType>();  // (next) becomes our new stub node, so it shouldn't hold on to anything
+      _tail = next;
+      if (tail != &_stub) delete tail;
+
+      const int32 numLeft = _count.GetCount()-1;
+      (void) _count.AtomicDecrement();
+      if (optRetNumItemsLeft) *optRetNumItemsLeft = (uint32) muscleMax(numLeft, (int32)0);
+      return B_NO_ERROR;
+#else
+      DECLARE_MUTEXGUARD(_mutex);
+      const status_t ret = _queue.RemoveHead(retItem);
+      if (optRetNumItemsLeft) *optRetNumItemsLeft = _queue.GetNumItems();
+      return ret;
+#endif
+   }
+
+   /** Returns the number of items currently in the queue.  In the presence of concurrent producers or
+     * a concurrent consumer, the returned value may be out of date by the time the caller looks at it.
+     */
+   MUSCLE_NODISCARD uint32 GetNumItems() const
+   {
+#ifdef MUSCLE_MPSC_QUEUE_IS_LOCK_FREE
+      return (uint32) muscleMax(_count.GetCount(), (int32)0);
+#else
+      DECLARE_MUTEXGUARD(_mutex);
+      return _queue.GetNumItems();
+#endif
+   }
+
+   /** Returns true iff the queue currently holds at least one item.  (Same caveats as GetNumItems()) */
+   MUSCLE_NODISCARD bool HasItems() const {return (GetNumItems() > 0);}
+
+   /** Returns true iff the queue currently holds no items.  (Same caveats as GetNumItems()) */
+   MUSCLE_NODISCARD bool IsEmpty() const {return (GetNumItems() == 0);}
+
+   /** Removes all items from the queue.  Only the consumer thread may call this method. */
+   void Clear()
+   {
+      ItemType junk;
+      while(RemoveHead(junk).IsOK()) {/* empty */}
+   }
+
+private:
+#ifdef MUSCLE_MPSC_QUEUE_IS_LOCK_FREE
+   class Node
+   {
+   public:
+      Node() : _next(NULL) {/* empty */}
+      explicit Node(const ItemType & item) : _next(NULL), _item(item) {/* empty */}
+
+      std::atomic<Node *> _next;
+      ItemType _item;
+   };
+
+   Node _stub;                  // the initial (empty) node, so that the list is never empty
+   std::atomic<Node *> _head;   // the most recently added node; producers exchange new nodes into here
+   Node * _tail;                // the consumer's stub node; the next item to pop is (_tail->_next)
+   AtomicCounter _count;        // number of fully-linked items that haven't been popped yet
+#else
+   mutable Mutex _mutex;
+   Queue<ItemType> _queue;
+#endif
+};
+
+} // end namespace muscle
+
+#endif
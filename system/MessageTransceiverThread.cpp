@@ -1,6 +1,7 @@
 /* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
 
 #include "system/MessageTransceiverThread.h"
+#include "dataio/FileDescriptorDataIO.h"
 #include "iogateway/SignalMessageIOGateway.h"
 #include "iogateway/MessageIOGateway.h"
 #include "reflector/ReflectServer.h"
@@ -12,7 +13,7 @@ MessageTransceiverThread :: MessageTransceiverThread(ICallbackMechanism * optCal
    , _forwardAllIncomingMessagesToSupervisor(true)
    , _sendMessagesToOwner(sendMessagesToOwner)
 {
-   // empty
+   SetUseEventFDForInternalThreadWakeups(true);  // our ThreadSupervisorSession is the only reader of the internal wakeup socket
 }
 
 MessageTransceiverThread :: ~MessageTransceiverThread()
@@ -661,6 +662,15 @@ AbstractMessageIOGatewayRef ThreadSupervisorSession :: CreateGateway()
    return AbstractMessageIOGatewayRef(new SignalMessageIOGateway);
 }
 
+DataIORef ThreadSupervisorSession :: CreateDataIO(const ConstSocketRef & socket)
+{
+#if defined(__linux__) && !defined(MUSCLE_AVOID_EVENTFD)
+   return DataIORef(new FileDescriptorDataIO(socket, false));  // works for both eventfds and sockets
+#else
+   return StorageReflectSession::CreateDataIO(socket);
+#endif
+}
+
 void ThreadSupervisorSession :: MessageReceivedFromGateway(const MessageRef &, void *)
 {
    // The message from the gateway is merely a signal that we should check
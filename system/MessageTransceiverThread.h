@@ -246,6 +246,12 @@ public:
    /** Overridden to create a custom gateway for interacting with the MessageTransceiverThread */
    virtual AbstractMessageIOGatewayRef CreateGateway();
 
+   /** Overridden to read the internal thread's wakeup signals with a FileDescriptorDataIO, since under Linux
+     * the MessageTransceiverThread's internal wakeup-socket is an eventfd rather than a socket.
+     * @param socket the internal thread's wakeup socket
+     */
+   virtual DataIORef CreateDataIO(const ConstSocketRef & socket);
+
    /** Overridden to deal with the MessageTransceiverThread.  If you are subclassing
      * ThreadSupervisorSession, don't override this method; override MessageReceivedFromOwner() instead.
      * @param msg the Message coming from the gateway object
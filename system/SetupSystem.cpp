@@ -1,6 +1,7 @@
 /* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
 
 #include "system/SetupSystem.h"
+#include "support/MuscleSIMD.h"  // for the CRC32 intrinsics used by CalculateCRC32C()
 #include "support/Flattenable.h"
 #include "dataio/SeekableDataIO.h"
 #include "reflector/SignalHandlerSession.h"  // for SetMainReflectServerCatchSignals()
@@ -2124,7 +2125,7 @@ bool IsCurrentThreadMainThread()
 #endif
 
 // adapted from MurmurHashA by Austin Appleby
-uint32 CalculateHashCode(const void * key, size_t numBytes, uint32 seed)
+uint32 CalculateMurmurHashCode(const void * key, size_t numBytes, uint32 seed)
 {
 #define MURMUR2_MIX(h,k,m) { (k) *= (m); (k) ^= (k) >> (r); (k) *= (m); (h) *= (m); (h) ^= (k); }
    const uint32 m = 0x5bd1e995;
@@ -2246,7 +2247,7 @@ uint32 CalculateHashCode(const void * key, size_t numBytes, uint32 seed)
 }
 
 // adapted from MurmurHash64A by Austin Appleby
-uint64 CalculateHashCode64(const void * key, size_t numBytes, uint64 seed)
+uint64 CalculateMurmurHashCode64(const void * key, size_t numBytes, uint64 seed)
 {
    const uint64 m = 0xc6a4a7935bd1e995;
    const int r = 47;
@@ -2287,6 +2288,68 @@ uint64 CalculateHashCode64(const void * key, size_t numBytes, uint64 seed)
    return h;
 }
 
+#if !defined(MUSCLE_USE_SSE42_CRC32) && !defined(MUSCLE_USE_ARM_CRC32)
+// Lookup table for the software implementation of CRC-32C (reflected polynomial 0x82F63B78)
+class CRC32CTable
+{
+public:
+   CRC32CTable()
+   {
+      for (uint32 i=0; i<ARRAYITEMS(_table); i++)
+      {
+         uint32 c = i;
+         for (uint32 j=0; j<8; j++) c = (c & 1) ? ((c>>1)^0x82F63B78) : (c>>1);
+         _table[i] = c;
+      }
+   }
+
+   uint32 _table[256];
+};
+static const CRC32CTable _crc32cTable;
+#endif
+
+uint32 CalculateCRC32C(const void * key, size_t numBytes, uint32 seed)
+{
+   const uint8 * data = (const uint8 *) key;
+   uint32 crc = ~seed;
+
+#if defined(MUSCLE_USE_SSE42_CRC32) || defined(MUSCLE_USE_ARM_CRC32)
+# if defined(MUSCLE_USE_SSE42_CRC32) && (defined(__x86_64__) || defined(_M_X64))
+   uint64 crc64 = crc;
+   for (; numBytes >= sizeof(uint64); numBytes -= sizeof(uint64), data += sizeof(uint64)) crc64 = _mm_crc32_u64(crc64, muscleCopyIn<uint64>(data));
+   crc = (uint32) crc64;
+# elif defined(MUSCLE_USE_SSE42_CRC32)
+   for (; numBytes >= sizeof(uint32); numBytes -= sizeof(uint32), data += sizeof(uint32)) crc = _mm_crc32_u32(crc, muscleCopyIn<uint32>(data));
+# else
+   for (; numBytes >= sizeof(uint64); numBytes -= sizeof(uint64), data += sizeof(uint64)) crc = __crc32cd(crc, muscleCopyIn<uint64>(data));
+# endif
+   for (; numBytes > 0; numBytes--, data++)
+   {
+#  if defined(MUSCLE_USE_SSE42_CRC32)
+      crc = _mm_crc32_u8(crc, *data);
+#  else
+      crc = __crc32cb(crc, *data);
+#  endif
+   }
+#else
+   const uint32 * table = _crc32cTable._table;
+   for (; numBytes > 0; numBytes--, data++) crc = table[(crc^*data)&0xFF]^(crc>>8);
+#endif
+
+   return ~crc;
+}
+
+void CalculateHashCodes(const void * const * keys, const uint32 * numBytes, uint32 numKeys, uint32 * retHashCodes, uint32 seed)
+{
+   for (uint32 i=0; i<numKeys; i++)
+   {
+#if defined(__GNUC__) || defined(__clang__)
+      if (i+4 < numKeys) __builtin_prefetch(keys[i+4]);  // so that the next few keys' bytes will already be in cache when we get to them
+#endif
+      retHashCodes[i] = CalculateHashCode(keys[i], numBytes[i], seed);
+   }
+}
+
 #ifdef MUSCLE_ENABLE_OBJECT_COUNTING
 
 static ObjectCounterBase * _firstObjectCounter = NULL;
@@ -2576,6 +2639,10 @@ Queue<String> GetBuildFlags()
    (void) q.AddTail(String("SMALL_QUEUE_SIZE=%1").Arg(SMALL_QUEUE_SIZE));
 #endif
 
+#ifdef MUSCLE_DATANODE_MAX_INLINE_CHILDREN
+   (void) q.AddTail(String("MUSCLE_DATANODE_MAX_INLINE_CHILDREN=%1").Arg(MUSCLE_DATANODE_MAX_INLINE_CHILDREN));
+#endif
+
 #ifdef SMALL_MUSCLE_STRING_LENGTH
    (void) q.AddTail(String("SMALL_MUSCLE_STRING_LENGTH=%1").Arg(SMALL_MUSCLE_STRING_LENGTH));
 #endif
@@ -2604,6 +2671,10 @@ Queue<String> GetBuildFlags()
    (void) q.AddTail("MUSCLE_DEFAULT_RUNTIME_DISABLE_DEADLOCK_FINDER");
 #endif
 
+#ifdef MUSCLE_MEMORY_TRACKING_THREAD_BATCH_BYTES
+   (void) q.AddTail(String("MUSCLE_MEMORY_TRACKING_THREAD_BATCH_BYTES=%1").Arg(MUSCLE_MEMORY_TRACKING_THREAD_BATCH_BYTES));
+#endif
+
 #ifdef MUSCLE_POOL_SLAB_SIZE
    (void) q.AddTail(String("MUSCLE_POOL_SLAB_SIZE=%1").Arg(MUSCLE_POOL_SLAB_SIZE));
 #endif
@@ -2671,6 +2742,14 @@ Queue<String> GetBuildFlags()
 #ifdef MUSCLE_USE_TEMPLATING_MESSAGE_IO_GATEWAY_BY_DEFAULT
    (void) q.AddTail("MUSCLE_USE_TEMPLATING_MESSAGE_IO_GATEWAY_BY_DEFAULT");
 #endif
+
+#ifdef MUSCLE_AVOID_BIASED_REFCOUNTING
+   (void) q.AddTail("MUSCLE_AVOID_BIASED_REFCOUNTING");
+#endif
+
+#ifdef MUSCLE_AVOID_BYTEBUFFER_SIZE_CLASSES
+   (void) q.AddTail("MUSCLE_AVOID_BYTEBUFFER_SIZE_CLASSES");
+#endif
    return q;
 }
 
@@ -2969,4 +3048,146 @@ const char * muscleStrError(int e)
    return ret ? ret : "No error string returned";
 }
 
+#ifdef MUSCLE_USE_BIASED_REFCOUNTING
+
+static void DestroyUnreferencedRefCountable(const RefCountable * rc)
+{
+   AbstractObjectManager * m = rc->GetManager();
+   if (m) m->RecycleObject(dynamic_cast<void *>(const_cast<RefCountable *>(rc)));  // the manager expects a pointer to the most-derived object
+     else delete rc;
+}
+
+// One of these is allocated for each thread that enables biased reference-counting.  They are never deleted,
+// since objects that were biased towards a thread may outlive that thread (and still point to its record).
+class BiasedRefCountThreadState MUSCLE_FINAL_CLASS
+{
+public:
+   BiasedRefCountThreadState() : _isRetired(false) {/* empty */}
+
+   // Called by a non-owner thread that just released the reference that made (rc)'s shared count go negative.
+   // Returns true iff (rc) got merged right away and is no longer referenced.
+   bool Enqueue(const RefCountable * rc)
+   {
+      {
+         DECLARE_MUTEXGUARD(_mutex);
+         if (_isRetired == false)
+         {
+            if (_pending.AddTail(rc).IsOK()) _hasPending.SetCount(1);
+                                        else MWARN_OUT_OF_MEMORY;  // (rc) can't be merged safely from this thread, so it will be leaked
+            return false;
+         }
+      }
+      return rc->MergeBiasedRefCount();  // our owner-thread won't be merging anymore, so we can do it ourself
+   }
+
+   // Called by the owner thread only
+   void MergePendingObjects()
+   {
+      if (_hasPending.GetCount() == 0) return;  // cheap check for the common case
+
+      Queue<const RefCountable *> merging;
+      {
+         DECLARE_MUTEXGUARD(_mutex);
+         merging.SwapContents(_pending);
+         _hasPending.SetCount(0);
+      }
+      for (uint32 i=0; i<merging.GetNumItems(); i++) if (merging[i]->MergeBiasedRefCount()) DestroyUnreferencedRefCountable(merging[i]);
+
+      merging.FastClear();
+      DECLARE_MUTEXGUARD(_mutex);
+      if (_pending.IsEmpty()) _pending.SwapContents(merging);  // so that we can re-use the Queue's array next time
+   }
+
+   // Called by the owner thread when it stops biasing; after this, other threads will merge on their own
+   void Retire()
+   {
+      {
+         DECLARE_MUTEXGUARD(_mutex);
+         _isRetired = true;
+      }
+      _hasPending.SetCount(1);  // force MergePendingObjects() to look inside the queue
+      MergePendingObjects();
+   }
+
+private:
+   Mutex _mutex;
+   Queue<const RefCountable *> _pending;  // objects that are waiting for their counts to be merged
+   bool _isRetired;
+   AtomicCounter _hasPending;  // non-zero iff (_pending) might be non-empty
+};
+
+bool RefCountable :: EnqueueForMerge() const
+{
+   return const_cast<BiasedRefCountThreadState *>(_biasOwner)->Enqueue(this);
+}
+
+bool RefCountable :: MergeBiasedRefCount() const
+{
+   const int32 biasedCount = _biasedCount.load(std::memory_order_relaxed);
+   _biasedCount.store(0, std::memory_order_relaxed);
+
+   int32 sw = _sharedWord.load(std::memory_order_relaxed);
+   int32 newSW;
+   do {
+      newSW = (((sw & SHARED_FLAG_UNBIASED) != 0) ? sw : ((sw + (biasedCount*SHARED_COUNT_ONE)) | SHARED_FLAG_UNBIASED)) & ~SHARED_FLAG_QUEUED;
+   } while(_sharedWord.compare_exchange_weak(sw, newSW, std::memory_order_acq_rel, std::memory_order_relaxed) == false);
+
+   return ((newSW & ~SHARED_FLAG_NEVERBIAS) == SHARED_FLAG_UNBIASED);
+}
+
+// Retires the thread's biasing record (if any) when the thread exits
+class BiasedRefCountThreadExitHandler MUSCLE_FINAL_CLASS
+{
+public:
+   BiasedRefCountThreadExitHandler() : _isArmed(false) {/* empty */}
+   ~BiasedRefCountThreadExitHandler() {if (_isArmed) (void) SetBiasedRefCountingEnabledForCurrentThread(false);}
+
+   bool _isArmed;
+};
+static thread_local BiasedRefCountThreadExitHandler _biasedRefCountThreadExitHandler;
+
+#endif
+
+status_t SetBiasedRefCountingEnabledForCurrentThread(bool enable)
+{
+#ifdef MUSCLE_USE_BIASED_REFCOUNTING
+   BiasedRefCountThreadState * & curState = BiasedRefCountCurrentThread<0>::_state;
+   if (enable == (curState != NULL)) return B_NO_ERROR;
+
+   if (enable)
+   {
+      BiasedRefCountThreadState * newState = newnothrow BiasedRefCountThreadState;
+      MRETURN_OOM_ON_NULL(newState);
+      _biasedRefCountThreadExitHandler._isArmed = true;
+      curState = newState;
+   }
+   else
+   {
+      BiasedRefCountThreadState * oldState = curState;
+      curState = NULL;  // so that from here on, this thread uses the shared counts only
+      oldState->Retire();
+   }
+   return B_NO_ERROR;
+#else
+   return enable ? B_UNIMPLEMENTED : B_NO_ERROR;
+#endif
+}
+
+bool IsBiasedRefCountingEnabledForCurrentThread()
+{
+#ifdef MUSCLE_USE_BIASED_REFCOUNTING
+   return (BiasedRefCountCurrentThread<0>::_state != NULL);
+#else
+   return false;
+#endif
+}
+
+void MergeBiasedRefCountsForCurrentThread()
+{
+#ifdef MUSCLE_USE_BIASED_REFCOUNTING
+   BiasedRefCountThreadState * curState = BiasedRefCountCurrentThread<0>::_state;
+   if (curState) curState->MergePendingObjects();
+#endif
+}
+
 } // end namespace muscle
@@ -280,4 +280,87 @@ status_t GetNumberOfProcessors(uint32 & retNumProcessors)
 #endif
 }
 
+#if defined(__linux__)
+// Parses a Linux sysfs CPU/node list (e.g. "0-3,8-11") into a Queue of indices
+static status_t ParseLinuxIndexList(const char * path, Queue<uint32> & retIndices)
+{
+   retIndices.Clear();
+
+   FILE * f = muscleFopen(path, "r");
+   if (f == NULL) return B_ERRNO;
+
+   char line[1024];
+   const bool readOkay = (fgets(line, sizeof(line), f) != NULL);
+   fclose(f);
+   if (readOkay == false) return B_IO_ERROR;
+
+   const char * s = line;
+   while(*s)
+   {
+      if ((*s < '0')||(*s > '9')) {s++; continue;}
+
+      char * end;
+      const uint32 first = (uint32) strtoul(s, &end, 10);
+      uint32 last = first;
+      if (*end == '-') last = (uint32) strtoul(end+1, &end, 10);
+      for (uint32 i=first; i<=last; i++) MRETURN_ON_ERROR(retIndices.AddTail(i));
+      s = end;
+   }
+   return B_NO_ERROR;
+}
+#endif
+
+status_t GetNumberOfNUMANodes(uint32 & retNumNodes)
+{
+#if defined(__linux__)
+   Queue<uint32> nodes;
+   if ((ParseLinuxIndexList("/sys/devices/system/node/possible", nodes).IsOK())&&(nodes.HasItems()))
+   {
+      retNumNodes = nodes.Tail()+1;
+      return B_NO_ERROR;
+   }
+#endif
+
+   retNumNodes = 1;  // no NUMA information available, so we'll treat the whole computer as a single node
+   return B_NO_ERROR;
+}
+
+status_t GetNUMANodeCPUs(uint32 nodeIndex, Queue<uint32> & retCPUIndices)
+{
+#if defined(__linux__)
+   char path[128]; muscleSprintf(path, "/sys/devices/system/node/node" UINT32_FORMAT_SPEC "/cpulist", nodeIndex);
+   if (ParseLinuxIndexList(path, retCPUIndices).IsOK()) return B_NO_ERROR;
+
+   uint32 numNodes;
+   if ((GetNumberOfNUMANodes(numNodes).IsOK())&&(numNodes > 1)) return B_DATA_NOT_FOUND;  // a real NUMA system, just not a node we know about
+#endif
+
+   // No NUMA information available, so node 0 is the whole computer
+   if (nodeIndex > 0) return B_DATA_NOT_FOUND;
+
+   uint32 numCPUs;
+   MRETURN_ON_ERROR(GetNumberOfProcessors(numCPUs));
+   retCPUIndices.Clear();
+   MRETURN_ON_ERROR(retCPUIndices.EnsureSize(numCPUs));
+   for (uint32 i=0; i<numCPUs; i++) (void) retCPUIndices.AddTail(i);
+   return B_NO_ERROR;
+}
+
+status_t GetNUMANodeForCPU(uint32 cpuIndex, uint32 & retNodeIndex)
+{
+   uint32 numNodes;
+   MRETURN_ON_ERROR(GetNumberOfNUMANodes(numNodes));
+
+   Queue<uint32> cpus;
+   for (uint32 i=0; i<numNodes; i++)
+   {
+      if ((GetNUMANodeCPUs(i, cpus).IsOK())&&(cpus.Contains(cpuIndex)))
+      {
+         retNodeIndex = i;
+         return B_NO_ERROR;
+      }
+   }
+   return B_DATA_NOT_FOUND;
+}
+
 } // end namespace muscle
@@ -52,6 +52,27 @@ status_t GetSystemPath(uint32 whichPath, String & outStr);
   */
 status_t GetNumberOfProcessors(uint32 & retNumProcessors);
 
+/** Queries the number of NUMA nodes (i.e. groups of CPU cores that share a local memory controller) on this computer.
+  * On a computer (or OS) without NUMA support, the whole computer is considered to be a single NUMA node.
+  * @param retNumNodes On success, the number of NUMA nodes is placed here.  NUMA node indices range from 0 to (retNumNodes-1).
+  * @returns B_NO_ERROR on success, or an error code on failure.
+  */
+status_t GetNumberOfNUMANodes(uint32 & retNumNodes);
+
+/** Queries which CPU cores belong to the specified NUMA node.
+  * @param nodeIndex the index of the NUMA node to query (0 for the first NUMA node)
+  * @param retCPUIndices On success, this Queue will be cleared and then filled with the indices of the node's CPU cores, in ascending order.
+  * @returns B_NO_ERROR on success, or B_DATA_NOT_FOUND if there is no such NUMA node, or some other error code.
+  */
+status_t GetNUMANodeCPUs(uint32 nodeIndex, Queue<uint32> & retCPUIndices);
+
+/** Queries which NUMA node the specified CPU core belongs to.
+  * @param cpuIndex the index of the CPU core to look up (0 for the first CPU core)
+  * @param retNodeIndex On success, the index of the CPU core's NUMA node is placed here.
+  * @returns B_NO_ERROR on success, or B_DATA_NOT_FOUND if the CPU core isn't part of any NUMA node, or some other error code.
+  */
+status_t GetNUMANodeForCPU(uint32 cpuIndex, uint32 & retNodeIndex);
+
 /** Returns the file-path-separator character to use for this operating
   * system:  ie backslash for Windows, and forward-slash for every
   * other operating system.
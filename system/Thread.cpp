@@ -6,13 +6,19 @@
 #endif
 
 #ifdef __linux__
+# include <pthread.h>      // for pthread_setaffinity_np()
 # include <sys/syscall.h>
+# ifndef MUSCLE_AVOID_EVENTFD
+#  include <sys/eventfd.h>
+#  define MUSCLE_THREAD_EVENTFD_SUPPORTED 1
+# endif
 #endif
 
 #include "system/Thread.h"
 #include "util/NetworkUtilityFunctions.h"
 #include "dataio/TCPSocketDataIO.h"  // to get the proper #includes for recv()'ing
 #include "system/SetupSystem.h"      // for GetCurrentThreadID()
+#include "system/SystemInfo.h"       // for GetNUMANodeCPUs()
 
 #if defined(MUSCLE_USE_QT_THREADS) && defined(MUSCLE_ENABLE_QTHREAD_EVENT_LOOP_INTEGRATION)
 # include "platform/qt/QMessageTransceiverThread.h"   // for MuscleQThreadSocketNotifier
@@ -40,6 +46,7 @@ Thread :: Thread(bool useMessagingSockets, ICallbackMechanism * optCallbackMecha
    , _useMessagingSockets(useMessagingSockets)
 #endif
    , _messageSocketsAllocated(!_useMessagingSockets)  // preset to true if we're not using sockets, to prevent us from demand-allocating them
+   , _useEventFDForInternalWakeups(false)
    , _threadRunning(false)
    , _suggestedStackSize(0)
    , _threadStackBase(NULL)
@@ -85,16 +92,29 @@ const ConstSocketRef & Thread :: GetThreadWakeupSocketAux(ThreadSpecificData & t
    if (_messageSocketsAllocated == false)
    {
       if (CreateConnectedSocketPair(_threadData[MESSAGE_THREAD_INTERNAL]._messageSocket, _threadData[MESSAGE_THREAD_OWNER]._messageSocket).IsError()) return GetNullSocket();
+
+#ifdef MUSCLE_THREAD_EVENTFD_SUPPORTED
+      // The internal thread's end of the socket-pair is still used to signal the owner (and to give him EOF when we exit)
+      if (_useEventFDForInternalWakeups)
+      {
+         _threadData[MESSAGE_THREAD_INTERNAL]._eventFD = GetConstSocketRefFromPool(eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC));
+         if (_threadData[MESSAGE_THREAD_INTERNAL]._eventFD() == NULL) LogTime(MUSCLE_LOG_WARNING, "Thread %p:  Couldn't create eventfd [%s], falling back to socket-pair wakeups\n", this, B_ERRNO());
+      }
+#endif
       _messageSocketsAllocated = true;
    }
-   return tsd._messageSocket;
+   return tsd._eventFD() ? tsd._eventFD : tsd._messageSocket;
 }
 
 void Thread :: CloseSockets()
 {
    if (_useMessagingSockets)
    {
-      for (uint32 i=0; i<NUM_MESSAGE_THREADS; i++) _threadData[i]._messageSocket.Reset();
+      for (uint32 i=0; i<NUM_MESSAGE_THREADS; i++)
+      {
+         _threadData[i]._messageSocket.Reset();
+         _threadData[i]._eventFD.Reset();
+      }
       _messageSocketsAllocated = false;
    }
 }
@@ -181,12 +201,9 @@ status_t Thread :: SendMessageAux(int whichQueue, const MessageRef & replyRef)
 {
    ThreadSpecificData & tsd = _threadData[whichQueue];
 
+   // We only need to wake up the receiving thread if the queue was empty; otherwise it's been signalled already
    bool sendNotification;
-   {
-      DECLARE_MUTEXGUARD(tsd._queueLock);
-      MRETURN_ON_ERROR(tsd._messages.AddTail(replyRef));
-      sendNotification = (tsd._messages.GetNumItems() == 1);
-   }
+   MRETURN_ON_ERROR(tsd._messages.AddTail(replyRef, &sendNotification));
 
    if (sendNotification)
    {
@@ -202,6 +219,15 @@ status_t Thread :: SendMessageAux(int whichQueue, const MessageRef & replyRef)
 
 void Thread :: SignalInternalThread()
 {
+#ifdef MUSCLE_THREAD_EVENTFD_SUPPORTED
+   const int efd = _threadData[MESSAGE_THREAD_INTERNAL]._eventFD.GetFileDescriptor();
+   if (efd >= 0)
+   {
+      const uint64 one = 1;
+      while((write(efd, &one, sizeof(one)) < 0)&&(PreviousOperationWasInterrupted())) {/* empty */}
+      return;
+   }
+#endif
    SignalAux(MESSAGE_THREAD_OWNER);  // we send a byte on the owner's socket and the byte comes out on the internal socket
 }
 
@@ -257,21 +283,32 @@ status_t Thread :: WaitForNextMessageAux(ThreadSpecificData & tsd, MessageRef &
 {
    if (optRetNumMessagesLeftInQueue) *optRetNumMessagesLeftInQueue = 0;
 
+   // Fast path:  if a Message is already waiting, there's no need to make any system calls at all.
+   // (any signal that accompanied it will be absorbed below, the next time we find the queue empty)
+   if (tsd._messages.RemoveHead(ref, optRetNumMessagesLeftInQueue).IsOK()) return B_NO_ERROR;
+
    if ((_useMessagingSockets)&&(tsd._messageSocket.GetFileDescriptor() >= 0))  // latter clause is just to keep Coverity happy
    {
-      // Be sure to always absorb any signal-bytes that were sent to us, now that we've been awoken,
+      // Be sure to always absorb any signal-bytes that were sent to us before we go back to sleep,
       // otherwise we could end up in a CPU-burning loop with select() always returning immediately
-      // This won't block because we always set up the _messageSocket sockets to be in non-blocking mode.
-      uint8 bytes[256];
-      (void) recv_ignore_eintr(tsd._messageSocket.GetFileDescriptor(), (char *)bytes, sizeof(bytes), 0);
+      // This won't block because we always set up the _messageSocket sockets (and eventfds) to be in non-blocking mode.
+#ifdef MUSCLE_THREAD_EVENTFD_SUPPORTED
+      const int efd = tsd._eventFD.GetFileDescriptor();
+      if (efd >= 0)
+      {
+         uint64 count;
+         while((read(efd, &count, sizeof(count)) < 0)&&(PreviousOperationWasInterrupted())) {/* empty */}
+      }
+      else
+#endif
+      {
+         uint8 bytes[256];
+         (void) recv_ignore_eintr(tsd._messageSocket.GetFileDescriptor(), (char *)bytes, sizeof(bytes), 0);
+      }
    }
 
-   status_t ret;
-   {
-      DECLARE_MUTEXGUARD(tsd._queueLock);
-      ret = tsd._messages.RemoveHead(ref);
-      if (optRetNumMessagesLeftInQueue) *optRetNumMessagesLeftInQueue = tsd._messages.GetNumItems();
-   }
+   // Check again, in case a Message was added (and its signal absorbed above) after our first check
+   status_t ret = tsd._messages.RemoveHead(ref, optRetNumMessagesLeftInQueue);
 
    if (ret.IsOK())      return ret;
    if (wakeupTime == 0) return B_TIMED_OUT;
@@ -279,7 +316,7 @@ status_t Thread :: WaitForNextMessageAux(ThreadSpecificData & tsd, MessageRef &
    // If we got here, no Message was available, so we'll have to wait until there is one (or until wakeupTime)
    if (_useMessagingSockets)
    {
-      const int msgfd = tsd._messageSocket.GetFileDescriptor();
+      const int msgfd = (tsd._eventFD() ? tsd._eventFD : tsd._messageSocket).GetFileDescriptor();
       if (msgfd < 0) return B_BAD_OBJECT;  // semi-paranoia
 
       // block until either
@@ -444,13 +481,15 @@ void Thread::InternalThreadEntryAux()
    {
       LogTime(MUSCLE_LOG_ERROR, "Thread %p:  Unable to set thread priority to (%s/%s) [%s]\n", this, GetThreadSchedulerName(_threadScheduler), GetThreadPriorityName(_threadPriority), ret());
    }
+   if ((_cpuAffinity.HasItems())&&(SetThreadCPUAffinityAux(_cpuAffinity, true).IsError(ret)))
+   {
+      LogTime(MUSCLE_LOG_ERROR, "Thread %p:  Unable to set thread CPU affinity [%s]\n", this, ret());
+   }
 
    {
       // If there are already reply-Messages present in the reply-Queue, make sure the owner thread is signalled to come get them
       // This could happen e.g. if a subclass decided to call SendMessageToOwner() in advance.
-      ThreadSpecificData & ownerTSD = _threadData[MESSAGE_THREAD_OWNER];
-      DECLARE_MUTEXGUARD(ownerTSD._queueLock);
-      if (ownerTSD._messages.HasItems()) SignalOwner();
+      if (_threadData[MESSAGE_THREAD_OWNER]._messages.HasItems()) SignalOwner();
    }
 
    InternalThreadEntry();
@@ -712,6 +751,75 @@ const char * Thread :: GetThreadSchedulerName(int sched)
    return "???";
 }
 
+status_t Thread :: SetThreadCPUAffinity(const Queue<uint32> & cpuIndices)
+{
+   if (IsInternalThreadRunning()) MRETURN_ON_ERROR(SetThreadCPUAffinityAux(cpuIndices, IsCallerInternalThread()));
+   _cpuAffinity = cpuIndices;  // just remember the setting for now; when we actually launch the thread we'll set the thread's affinity
+   return B_NO_ERROR;
+}
+
+status_t Thread :: SetThreadCPUAffinityToNUMANode(uint32 nodeIndex)
+{
+   Queue<uint32> cpuIndices;
+   MRETURN_ON_ERROR(GetNUMANodeCPUs(nodeIndex, cpuIndices));
+   return SetThreadCPUAffinity(cpuIndices);
+}
+
+status_t Thread :: SetThreadCPUAffinityToSocketNUMANode(const ConstSocketRef & sock)
+{
+   uint32 cpuIndex, nodeIndex;
+   MRETURN_ON_ERROR(GetSocketIncomingCPU(sock, cpuIndex));
+   MRETURN_ON_ERROR(GetNUMANodeForCPU(cpuIndex, nodeIndex));
+   return SetThreadCPUAffinityToNUMANode(nodeIndex);
+}
+
+status_t Thread :: SetThreadCPUAffinityAux(const Queue<uint32> & cpuIndices, bool calledFromInternalThread)
+{
+   (void) calledFromInternalThread;  // just to inhibit compiler warnings
+
+#if defined(__linux__) && (defined(MUSCLE_USE_PTHREADS) || defined(MUSCLE_USE_CPLUSPLUS11_THREADS))
+   cpu_set_t cpuSet;
+   CPU_ZERO(&cpuSet);
+   if (cpuIndices.IsEmpty())
+   {
+      for (uint32 i=0; i<CPU_SETSIZE; i++) CPU_SET(i, &cpuSet);  // no restrictions
+   }
+   else
+   {
+      for (uint32 i=0; i<cpuIndices.GetNumItems(); i++)
+      {
+         if (cpuIndices[i] >= CPU_SETSIZE) return B_BAD_ARGUMENT;
+         CPU_SET(cpuIndices[i], &cpuSet);
+      }
+   }
+# if defined(MUSCLE_USE_PTHREADS)
+   const pthread_t pthreadID = GetPthreadID(calledFromInternalThread);
+# else
+   const pthread_t pthreadID = calledFromInternalThread ? pthread_self() : _thread.native_handle();  // under Linux, std::thread is implemented via pthreads
+# endif
+   return B_ERRNUM(pthread_setaffinity_np(pthreadID, sizeof(cpuSet), &cpuSet));
+#elif defined(WIN32)
+   DWORD_PTR mask = 0;
+   if (cpuIndices.IsEmpty())
+   {
+      DWORD_PTR systemMask;
+      if (GetProcessAffinityMask(GetCurrentProcess(), &mask, &systemMask) == false) return B_ERRNO;
+   }
+   else
+   {
+      for (uint32 i=0; i<cpuIndices.GetNumItems(); i++)
+      {
+         if (cpuIndices[i] >= (sizeof(mask)*8)) return B_BAD_ARGUMENT;
+         mask |= (((DWORD_PTR)1) << cpuIndices[i]);
+      }
+   }
+   return (SetThreadAffinityMask(GetNativeThreadHandle(calledFromInternalThread), mask) != 0) ? B_NO_ERROR : B_ERRNO;
+#else
+   (void) cpuIndices;
+   return B_UNIMPLEMENTED;  // dunno how to set thread affinity on this platform
+#endif
+}
+
 void CheckThreadStackUsage(const char * fileName, uint32 line)
 {
    Thread * curThread = Thread::GetCurrentThread();
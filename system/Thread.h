@@ -8,6 +8,7 @@
 #endif
 
 #include "support/NotCopyable.h"
+#include "system/MPSCQueue.h"
 #include "system/Mutex.h"
 #include "system/WaitCondition.h"
 #include "message/Message.h"
@@ -339,6 +340,34 @@ public:
      */
    MUSCLE_NODISCARD MUSCLE_NEVER_RETURNS_NULL static const char * GetThreadSchedulerName(int sched);
 
+   /** Restricts this thread to running only on the specified CPU cores.
+     * If the thread is currently running, the change will take place immediately; otherwise
+     * the affinity will be set when the thread is started.
+     * @param cpuIndices the indices of the CPU cores this thread may run on (0 for the first core), or an empty Queue to let it run on any core.
+     * @returns B_NO_ERROR on success, or B_UNIMPLEMENTED if thread CPU affinity isn't supported on this OS, or an error code on failure.
+     */
+   status_t SetThreadCPUAffinity(const Queue<uint32> & cpuIndices);
+
+   /** Returns the CPU-core indices this thread is restricted to (as specified by a previous call to
+     * SetThreadCPUAffinity()), or an empty Queue if the thread may run on any core.
+     */
+   MUSCLE_NODISCARD const Queue<uint32> & GetThreadCPUAffinity() const {return _cpuAffinity;}
+
+   /** Convenience method:  Restricts this thread to running only on the CPU cores of the specified NUMA node,
+     * so that (on a multi-socket computer) the thread and the memory it allocates stay local to each other.
+     * @param nodeIndex the index of the NUMA node to run on (0 for the first node).  See GetNumberOfNUMANodes().
+     * @returns B_NO_ERROR on success, or an error code on failure.
+     */
+   status_t SetThreadCPUAffinityToNUMANode(uint32 nodeIndex);
+
+   /** Convenience method:  Restricts this thread to running only on the CPU cores of the NUMA node that is
+     * handling the incoming network traffic for the specified socket (see GetSocketIncomingCPU()), so that
+     * the thread that handles the socket's data runs on the same node as the network interface's interrupts.
+     * @param sock a socket that has already received some data.
+     * @returns B_NO_ERROR on success, or B_UNIMPLEMENTED if this OS can't tell us which CPU core handles the socket, or an error code on failure.
+     */
+   status_t SetThreadCPUAffinityToSocketNUMANode(const ConstSocketRef & sock);
+
 #if defined(MUSCLE_USE_QT_THREADS)
    /** Returns a pointer to the QThread object being used to implement our internal thread.
      * Note that this method is only available when the MUSCLE_USE_QT_THREADS preprocessor macro is defined,
@@ -428,7 +457,7 @@ protected:
 
    /** Called by SendMessageToInternalThread() whenever there is a need to wake up the internal
      * thread so that it will look at its reply queue.
-     * Default implementation sends a byte on a socket to implement this,
+     * Default implementation sends a byte on a socket (or writes to an eventfd) to implement this,
      * but you can override this method to do it a different way if you need to.
      */
    virtual void SignalInternalThread();
@@ -450,6 +479,18 @@ protected:
    /** Closes all of our threading sockets, if they are open. */
    void CloseSockets();
 
+   /** Call this (before the thread-signalling sockets are allocated, e.g. in your constructor) to request that
+     * the internal thread be woken up via a Linux eventfd rather than via a byte sent across a socket-pair.
+     * Writing to an eventfd is cheaper than sending on a socket, and repeated signals coalesce into a single wakeup.
+     * The owner-side wakeup socket is unaffected.
+     * @param useEventFD true to use an eventfd for internal-thread wakeups, or false to use the socket-pair (the default).
+     * @note if you enable this, GetInternalThreadWakeupSocket() will return the eventfd, which can be select()'d
+     *       on normally but must be read with read() rather than recv().  So only enable this if nothing reads
+     *       the internal wakeup socket except this class (or a FileDescriptorDataIO).
+     * @note this setting has no effect on operating systems other than Linux, or if MUSCLE_AVOID_EVENTFD is defined.
+     */
+   void SetUseEventFDForInternalThreadWakeups(bool useEventFD) {_useEventFDForInternalWakeups = useEventFD;}
+
    /** This function returns a read-only reference to one of the three socket-sets
     *  that WaitForNextMessageFromOwner() will optionally use to determine whether
     *  to return early.  By default, all three of the socket-sets are empty, and
@@ -552,9 +593,9 @@ private:
    public:
       ThreadSpecificData() {/* empty */}
 
-      Mutex _queueLock;
       ConstSocketRef _messageSocket;
-      Queue<MessageRef> _messages;
+      ConstSocketRef _eventFD;  // if valid, this thread is woken via this eventfd instead of via (_messageSocket)
+      MPSCQueue<MessageRef> _messages;
       Hashtable<ConstSocketRef, bool> _socketSets[NUM_SOCKET_SETS];  // (socket -> isFlagged)
       SocketMultiplexer _multiplexer;
 
@@ -569,6 +610,7 @@ private:
    void SignalAux(int whichSocket);
    void InternalThreadEntryAux();
    status_t SetThreadSchedulerAndPriorityAux(int newSched, int newPriority, bool calledFromInternalThread);
+   status_t SetThreadCPUAffinityAux(const Queue<uint32> & cpuIndices, bool calledFromInternalThread);
 
    enum {
       MESSAGE_THREAD_INTERNAL = 0,  // internal thread's (input queue, socket to block on)
@@ -578,6 +620,7 @@ private:
 
    const bool _useMessagingSockets;
    bool _messageSocketsAllocated;
+   bool _useEventFDForInternalWakeups;
 
    ThreadSpecificData _threadData[NUM_MESSAGE_THREADS];
 
@@ -649,6 +692,7 @@ private:
    const uint8 * _threadStackBase;
    int _threadPriority;
    int _threadScheduler;
+   Queue<uint32> _cpuAffinity;
 
 #if defined(__linux__)
 # if defined(MUSCLE_AVOID_CPLUSPLUS11)
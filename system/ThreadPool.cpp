@@ -1,12 +1,29 @@
 /* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
 
 #include "system/ThreadPool.h"
+#include "system/SystemInfo.h"
 #include "system/WaitCondition.h"
 
 namespace muscle {
 
 static Message _dummyMsg;
 
+// Per-client scheduling state.  Everything in here except (_client) is guarded by (_lock).
+class ThreadPoolClientState
+{
+public:
+   explicit ThreadPoolClientState(IThreadPoolClient * client) : _client(client), _isScheduled(false), _isBeingUnregistered(false), _isDetached(false), _waitingForCompletion(NULL) {/* empty */}
+
+   IThreadPoolClient * const _client;
+
+   Mutex _lock;
+   Queue<MessageRef> _messages;  // Messages that haven't been handed to a pool thread yet
+   bool _isScheduled;            // true iff this client is in a pool thread's deque, or is being handled by a pool thread
+   bool _isBeingUnregistered;    // true iff a thread is inside UnregisterClient() for this client (and will therefore delete us)
+   bool _isDetached;             // true iff ThreadPool::Shutdown() has detached us from the pool (in which case the pool's destructor will delete us)
+   WaitCondition * _waitingForCompletion;  // non-NULL iff a thread is blocked in UnregisterClient() waiting for (_isScheduled) to become false
+};
+
 IThreadPoolClient :: ~IThreadPoolClient()
 {
    MASSERT(_threadPool == NULL, "You must not delete an IThreadPoolClient Thread object it is still registered with a ThreadPool!  (Call SetThreadPool(NULL) on it BEFORE deleting it!)");
@@ -39,246 +56,452 @@ void IThreadPoolClient :: SetThreadPool(ThreadPool * tp)
 
 ThreadPool :: ThreadPool(uint32 maxThreadCount)
    : _maxThreadCount(maxThreadCount)
-   , _shuttingDown(false)
-   , _threadIDCounter(0)
-   , _availableThreads(PreallocatedItemSlotsCount(maxThreadCount))
-   , _activeThreads(PreallocatedItemSlotsCount(maxThreadCount))
+   , _placementPolicy(THREAD_PLACEMENT_NONE)
+   , _workers(newnothrow_array(ThreadPoolThread *, muscleMax(maxThreadCount, (uint32)1)))
+   , _idleWorkers(PreallocatedItemSlotsCount(maxThreadCount))
 {
-   // empty
+   if (_workers == NULL) MWARN_OUT_OF_MEMORY;
 }
 
 ThreadPool :: ~ThreadPool()
 {
    (void) Shutdown();
+   for (uint32 i=0; i<_retiredClientStates.GetNumItems(); i++) delete _retiredClientStates[i];
+   delete [] _workers;
 }
 
-// Should be called without _poolLock already being held
-uint32 ThreadPool :: ShutdownThreadsInTableWithoutDeadlocking(Hashtable<uint32, ThreadPoolThreadRef> & table)
+void ThreadPool :: Print(const OutputPrinter & p) const
 {
-   Hashtable<uint32, ThreadPoolThreadRef> temp;
+   uint32 numRegisteredClients;
    {
       DECLARE_MUTEXGUARD(_poolLock);
-      temp.SwapContents(table);  // (table) becomes empty at this point, and (temp) becomes populated
+      numRegisteredClients = _registeredClients.GetNumItems();
+   }
+   uint32 numIdleWorkers;
+   {
+      DECLARE_MUTEXGUARD(_idleLock);
+      numIdleWorkers = _idleWorkers.GetNumItems();
    }
 
-   for (HashtableIterator<uint32, ThreadPoolThreadRef> iter(temp); iter.HasData(); iter++) iter.GetValue()()->ShutdownInternalThread();
-   return temp.GetNumItems();
+   const uint32 numWorkers = GetNumWorkers();
+   p.printf("ThreadPool %p:  _maxThreadCount=" UINT32_FORMAT_SPEC ", _shuttingDown=%i, _numWorkers=" UINT32_FORMAT_SPEC ", _idleWorkers=" UINT32_FORMAT_SPEC ", _registeredClients=" UINT32_FORMAT_SPEC "\n", this, _maxThreadCount, IsShuttingDown(), numWorkers, numIdleWorkers, numRegisteredClients);
+   for (uint32 i=0; i<numWorkers; i++) p.printf("   ThreadPoolThread #" UINT32_FORMAT_SPEC ":  " UINT32_FORMAT_SPEC " clients queued\n", i, _workers[i]->GetNumQueuedClients());
 }
 
 uint32 ThreadPool :: Shutdown()
 {
+   _shuttingDown.SetCount(1);  // from here on, the pool threads will exit rather than handle more clients
+
+   // Do this part without holding _poolLock, to avoid potential deadlocks with the threads we are shutting down.
+   // (We keep the ThreadPoolThread objects themselves around until our destructor, in case another thread is still looking at them)
+   Queue<ThreadPoolThreadRef> workers;
    {
       DECLARE_MUTEXGUARD(_poolLock);
-      _shuttingDown = true;
+      workers = _workerRefs;
    }
 
-   // Do this part without holding _poolLock, to avoid potential deadlocks with the threads we are shutting down
-   uint32 count = 0;
-   while(true)  // probably paranoia
+   uint32 ret = 0;
+   for (uint32 i=0; i<workers.GetNumItems(); i++)
    {
-      const uint32 numAvailableThreadsShutDown = ShutdownThreadsInTableWithoutDeadlocking(_availableThreads);
-      const uint32 numActiveThreadsShutDown    = ShutdownThreadsInTableWithoutDeadlocking(_activeThreads);
-      if ((numAvailableThreadsShutDown > 0)||(numActiveThreadsShutDown > 0)) count += (numAvailableThreadsShutDown+numActiveThreadsShutDown);
-                                                                        else break;
+      ThreadPoolThread * t = workers[i]();
+      if (t->IsInternalThreadRunning())
+      {
+         t->ShutdownInternalThread();
+         ret++;
+      }
    }
 
    DECLARE_MUTEXGUARD(_poolLock);
-   for (ConstHashtableIterator<IThreadPoolClient *, bool> iter(_registeredClients);  iter.HasData(); iter++) iter.GetKey()->_threadPool = NULL;  // so they won't try to unregister from us
+   for (HashtableIterator<IThreadPoolClient *, ThreadPoolClientState *> iter(_registeredClients); iter.HasData(); iter++)
+   {
+      IThreadPoolClient * client = iter.GetKey();
+      ThreadPoolClientState * cs = iter.GetValue();
+      client->_threadPool = NULL;  // so it won't try to unregister from us
 
-   const uint32 ret = count+_registeredClients.GetNumItems()+_pendingMessages.GetNumItems()+_deferredMessages.GetNumItems()+_waitingForCompletion.GetNumItems();
-   _availableThreads.Clear();
-   _activeThreads.Clear();
+      bool retireState = true;
+      {
+         DECLARE_MUTEXGUARD(cs->_lock);
+         cs->_isDetached = true;  // so that any SendMessageToThreadPool() call that is racing with us will give up
+         if (cs->_isBeingUnregistered)
+         {
+            retireState = false;  // UnregisterClient() will delete it instead
+            cs->_isScheduled = false;
+            if (cs->_waitingForCompletion)
+            {
+               MLOG_ON_ERROR("ThreadPool::Shutdown::Notify()", cs->_waitingForCompletion->Notify());
+               cs->_waitingForCompletion = NULL;
+            }
+         }
+         ret += cs->_messages.GetNumItems();
+      }
+      // Another thread might be inside SendMessageToThreadPool() with (cs) in hand, so we can't delete (cs) until our destructor runs
+      if ((retireState)&&(_retiredClientStates.AddTail(cs).IsError())) MWARN_OUT_OF_MEMORY;  // leaking (cs) is better than a use-after-free
+   }
+   ret += _registeredClients.GetNumItems();
    _registeredClients.Clear();
-   _pendingMessages.Clear();
-   _deferredMessages.Clear();
-
-   for (HashtableIterator<IThreadPoolClient *, WaitCondition *> iter(_waitingForCompletion); iter.HasData(); iter++) MLOG_ON_ERROR("ThreadPool::Shutdown::Notify()", iter.GetValue()->Notify());
-   _waitingForCompletion.Clear();
-
    return ret;
 }
 
 status_t ThreadPool :: RegisterClient(IThreadPoolClient * client)
 {
-   DECLARE_MUTEXGUARD(_poolLock);
+   ThreadPoolClientState * cs = newnothrow ThreadPoolClientState(client);
+   MRETURN_OOM_ON_NULL(cs);
 
-   MRETURN_ON_ERROR(_registeredClients.Put(client, false));
-
-   const status_t ret = _waitingForCompletion.EnsureSize(_registeredClients.GetNumItems());  // just to make sure there's room later on
-   if (ret.IsError()) (void) _registeredClients.Remove(client);  // roll back!
-   return ret;
-}
+   DECLARE_MUTEXGUARD(_poolLock);
 
-static bool AreThereMessagesInQueue(const Queue<MessageRef> * mq) {return ((mq)&&(mq->HasItems()));}
+   status_t ret;
+   if (_registeredClients.Put(client, cs).IsError(ret))
+   {
+      delete cs;  // roll back!
+      return ret;
+   }
 
-// Assumes _poolLock is locked!
-bool ThreadPool :: DoesClientHaveMessagesOutstandingUnsafe(IThreadPoolClient * client) const
-{
-   return ((_registeredClients.GetWithDefault(client))||(AreThereMessagesInQueue(_pendingMessages.Get(client)))||(AreThereMessagesInQueue(_deferredMessages.Get(client))));
+   client->_clientState = cs;
+   return B_NO_ERROR;
 }
 
 void ThreadPool :: UnregisterClient(IThreadPoolClient * client)
 {
    WaitCondition waitCondition;
 
+   ThreadPoolClientState * cs = NULL;
    bool doWait = false;
    {
-      // If this client has any Messages pending, we need to block until they are gone
       DECLARE_MUTEXGUARD(_poolLock);
+      if (_registeredClients.Get(client, cs).IsError()) return;  // Shutdown() must have gotten to it first
 
-      // The Put() call should never fail in practice because we called _waitingForCompletion.EnsureSize() earlier in RegisterClient()
-      if ((DoesClientHaveMessagesOutstandingUnsafe(client))&&(_waitingForCompletion.Put(client, &waitCondition).IsOK())) doWait = true;
+      // If this client has any Messages pending, we need to block until they are gone
+      DECLARE_MUTEXGUARD(cs->_lock);
+      cs->_isBeingUnregistered = true;
+      if ((cs->_isScheduled)&&(IsShuttingDown() == false))
+      {
+         cs->_waitingForCompletion = &waitCondition;
+         doWait = true;
+      }
    }
-   if (doWait) MLOG_ON_ERROR("ThreadPool::Wait()", waitCondition.Wait()); // block here (outside of the _poolLock) until we are notified, indicating that we can continue
+   if (doWait) MLOG_ON_ERROR("ThreadPool::Wait()", waitCondition.Wait()); // block here (outside of any locks) until we are notified, indicating that we can continue
 
    // final cleanup
-   DECLARE_MUTEXGUARD(_poolLock);
-   (void) _registeredClients.Remove(client);
-   (void) _pendingMessages.Remove(client);
-   (void) _deferredMessages.Remove(client);
-   (void) _waitingForCompletion.Remove(client);  // shouldn't be necessary but just in case
+   {
+      DECLARE_MUTEXGUARD(_poolLock);
+      (void) _registeredClients.Remove(client);
+   }
+   {
+      DECLARE_MUTEXGUARD(cs->_lock);  // make sure whoever notified us is done with (cs) before we delete it
+   }
+   client->_clientState = NULL;
+   delete cs;
 }
 
-status_t ThreadPool :: ThreadPoolThread :: SendMessagesToInternalThread(IThreadPoolClient * client, Queue<MessageRef> & mq)
+status_t ThreadPool :: SendMessageToThreadPool(IThreadPoolClient * client, const MessageRef & msg)
 {
-   MASSERT((_currentClient == NULL),   "ThreadPoolThread::SendMessagesToInternalThread:  _currentClient isn't NULL!");
-   MASSERT((_internalQueue.IsEmpty()), "ThreadPoolThread::SendMessagesToInternalThread:  _internalQueue isn't empty!");
+   if (IsShuttingDown()) return B_SHUTTING_DOWN;
 
-   _currentClient = client;
-   _internalQueue.SwapContents(mq);
+   ThreadPoolClientState * cs = client->_clientState;  // not freed until our destructor runs, even if Shutdown() detaches it meanwhile
+   if (cs == NULL) return B_BAD_ARGUMENT;
 
-   const status_t ret = SendMessageToInternalThread(DummyMessageRef(_dummyMsg));  // Send an empty Message, just to signal the internal thread
-   if (ret.IsOK()) return B_NO_ERROR;
-   else
    {
-      // roll back!
-      _currentClient = NULL;
-      _internalQueue.SwapContents(mq);
-      return ret;
+      DECLARE_MUTEXGUARD(cs->_lock);
+      if (cs->_isDetached) return B_SHUTTING_DOWN;
+      MRETURN_ON_ERROR(cs->_messages.AddTail(msg));
+      if (cs->_isScheduled) return B_NO_ERROR;  // a pool thread already has this client queued up (or in hand), and will see our new Message
+      cs->_isScheduled = true;
    }
+
+   status_t ret;
+   if (ScheduleClient(cs).IsError(ret))
+   {
+      // roll back, so that the next call to SendMessageToThreadPool() will try to schedule the client again
+      DECLARE_MUTEXGUARD(cs->_lock);
+      cs->_isScheduled = false;
+      if (cs->_waitingForCompletion)
+      {
+         MLOG_ON_ERROR("ThreadPool::Notify()", cs->_waitingForCompletion->Notify());
+         cs->_waitingForCompletion = NULL;
+      }
+   }
+   return ret;
 }
 
-status_t ThreadPool :: ThreadPoolThread :: MessageReceivedFromOwner(const MessageRef & msgRef, uint32 /*numLeft*/)
+status_t ThreadPool :: ScheduleClient(ThreadPoolClientState * cs)
 {
-   if (msgRef() == NULL) return B_SHUTTING_DOWN;  // time to go away!
+   if (IsShuttingDown()) return B_SHUTTING_DOWN;  // no sense dispatching more messages if we're in the process of shutting down
 
-   MASSERT((_currentClient != NULL),    "ThreadPoolThread::MessageReceivedFromOwner:  _currentClient is NULL!");
-   MASSERT((_internalQueue.HasItems()), "ThreadPoolThread::MessageReceivedFromOwner:  _internalQueue is empty!");
+   // Prefer an idle pool thread (or a new one), since it can start on the client right away -- unless another
+   // idle thread is already on its way to look for work, in which case that one will find (cs) too.  Waking
+   // up one idle thread per scheduled client would just have a lot of threads fighting over a few tiny batches.
+   ThreadPoolThread * worker = (_numWakingWorkers.GetCount() == 0) ? PopIdleWorker() : NULL;
+   if (worker == NULL) worker = CreateWorkerThread();
 
-   while(_internalQueue.HasItems())
+   const bool wakeWorker = (worker != NULL);
+   if (worker == NULL)
    {
-      _threadPool->MessageReceivedFromThreadPoolAux(_currentClient, _internalQueue.Head(), _internalQueue.GetLastValidIndex());
-      (void) _internalQueue.RemoveHead();
+      // Just add the client to one of our pool threads' deques; whichever thread frees up first will steal it if necessary
+      const uint32 numWorkers = GetNumWorkers();
+      if (numWorkers == 0) return B_ERROR("No pool threads available");
+      worker = _workers[((uint32)_nextWorkerIndex.AtomicFetchAndIncrement())%numWorkers];
    }
 
-   IThreadPoolClient * client = _currentClient;
-   _currentClient = NULL; // we need _currentClient to be NULL when we call ThreadFinishedProcessingClientMessages()
-   _threadPool->ThreadFinishedProcessingClientMessages(_threadID, client);
+   MRETURN_ON_ERROR(worker->PushClient(cs));
+
+   if (wakeWorker) MLOG_ON_ERROR("ThreadPool::ScheduleClient()", worker->SendMessageToInternalThread(DummyMessageRef(_dummyMsg)));
+   else
+   {
+      // In case a pool thread went idle between our checks above and our PushClient() call; otherwise (cs) could sit in a busy thread's deque
+      WakeIdleWorker();
+   }
    return B_NO_ERROR;
 }
 
-status_t ThreadPool :: SendMessageToThreadPool(IThreadPoolClient * client, const MessageRef & msg)
+ThreadPool::ThreadPoolThread * ThreadPool :: CreateWorkerThread()
 {
+   if ((_workers == NULL)||(GetNumWorkers() >= _maxThreadCount)) return NULL;  // checked before locking, so that a fully-populated pool never touches _poolLock here
+
    DECLARE_MUTEXGUARD(_poolLock);
 
-   bool * isBeingHandled = _registeredClients.Get(client);
-   if (isBeingHandled == NULL) return B_BAD_ARGUMENT;
+   const uint32 numWorkers = GetNumWorkers();
+   if ((numWorkers >= _maxThreadCount)||(IsShuttingDown())) return NULL;
 
-   Queue<MessageRef> * mq = ((*isBeingHandled)?_deferredMessages:_pendingMessages).GetOrPut(client);
-   MRETURN_OOM_ON_NULL(mq);
-   MRETURN_ON_ERROR(mq->AddTail(msg));
+   // demand-allocate a new Thread for us to use
+   ThreadPoolThreadRef tRef(newnothrow ThreadPoolThread(this, numWorkers));
+   if (tRef() == NULL) {MWARN_OUT_OF_MEMORY; return NULL;}
+   if (_workerRefs.AddTail(tRef).IsError()) return NULL;
 
-   if ((*isBeingHandled == false)&&(mq->GetNumItems() == 1)) DispatchPendingMessagesUnsafe();
-   return B_NO_ERROR;
+   status_t ret;
+   if (ApplyThreadPlacementPolicy(*tRef(), numWorkers).IsError(ret)) LogTime(MUSCLE_LOG_WARNING, "ThreadPool:  Unable to apply thread placement policy " UINT32_FORMAT_SPEC " to thread #" UINT32_FORMAT_SPEC " [%s]\n", _placementPolicy, numWorkers, ret());
+   if (StartInternalThread(*tRef()).IsError(ret))
+   {
+      LogTime(MUSCLE_LOG_ERROR, "ThreadPool:  Error launching thread! [%s]\n", ret());
+      (void) _workerRefs.RemoveTail();  // roll back!
+      return NULL;
+   }
+
+   // Publish the new thread only after it is running, so that other threads never assign clients to a thread that can't handle them
+   _workers[numWorkers] = tRef();
+   (void) _numWorkers.AtomicIncrement();
+   return tRef();
 }
 
-// Note:  This method assumes the _poolLock is already locked!
-void ThreadPool :: DispatchPendingMessagesUnsafe()
+status_t ThreadPool :: ApplyThreadPlacementPolicy(ThreadPoolThread & thread, uint32 threadIndex) const
 {
-   if (_shuttingDown) return;  // no sense dispatching more messages if we're in the process of shutting down
-
-   while(_pendingMessages.HasItems())
+   switch(_placementPolicy)
    {
-      IThreadPoolClient * client = *_pendingMessages.GetFirstKey();
-      Queue<MessageRef> * mq     = _pendingMessages.GetFirstValue();
-      bool * isBeingHandled      = _registeredClients.Get(client);
-      if ((isBeingHandled)&&(mq)&&(mq->HasItems()))  // we actually know mq will be non-NULL, but testing it makes clang++ happy
+      case THREAD_PLACEMENT_NONE:
+         return B_NO_ERROR;
+
+      case THREAD_PLACEMENT_PER_CPU:
       {
-         MASSERT(*isBeingHandled == false, "DispatchPendingMessagesUnsafe:  Client that is being handled is in the _pendingMessages table!");
+         // List the cores one NUMA node at a time, so that a pool with fewer threads than cores stays on as few nodes as possible
+         uint32 numNodes;
+         MRETURN_ON_ERROR(GetNumberOfNUMANodes(numNodes));
 
-         if ((_availableThreads.IsEmpty())&&(_activeThreads.GetNumItems() < _maxThreadCount))
+         Queue<uint32> allCPUs, nodeOfCPU, nodeCPUs;
+         for (uint32 i=0; i<numNodes; i++)
          {
-            // demand-allocate a new Thread for us to use
-            ThreadPoolThreadRef tRef(new ThreadPoolThread(this, _threadIDCounter++));
-
-            status_t ret;
-            if (StartInternalThread(*tRef()).IsError(ret)) {LogTime(MUSCLE_LOG_ERROR, "ThreadPool:  Error launching thread! [%s]\n", ret()); break;}
-            if (_availableThreads.Put(tRef()->GetThreadID(), tRef).IsError()) {tRef()->ShutdownInternalThread(); break;}  // should never happen, but just in case
+            if (GetNUMANodeCPUs(i, nodeCPUs).IsError()) continue;  // nodes without any cores are possible
+            MRETURN_ON_ERROR(allCPUs.AddTailMulti(nodeCPUs));
+            for (uint32 j=0; j<nodeCPUs.GetNumItems(); j++) MRETURN_ON_ERROR(nodeOfCPU.AddTail(i));
          }
+         if (allCPUs.IsEmpty()) return B_DATA_NOT_FOUND;
 
-         if (_availableThreads.HasItems())
-         {
-            // Okay, there's an idle thread awaiting something to do, so we'll just pass the next client's requests off to him.
-            ThreadPoolThreadRef tRef = *_availableThreads.GetLastValue();  // use the last thread because it's "hottest" in cache
-            if (_availableThreads.MoveToTable(tRef()->GetThreadID(), _activeThreads).IsOK())
-            {
-               if (tRef()->SendMessagesToInternalThread(client, *mq).IsOK())
-               {
-                  *isBeingHandled = true;  // this is to note that this client now has a Thread that is processing its data
-                  (void) _pendingMessages.RemoveFirst();
-               }
-               else
-               {
-                  (void) _activeThreads.MoveToTable(tRef()->GetThreadID(), _availableThreads);  // roll back!
-                  break;
-               }
-            }
-            else break;  // wtf!?
-         }
-         else break;  // nothing more we can do for now, all our pool threads are already busy
+         const uint32 idx = threadIndex%allCPUs.GetNumItems();
+         Queue<uint32> cpu; MRETURN_ON_ERROR(cpu.AddTail(allCPUs[idx]));
+         MRETURN_ON_ERROR(thread.SetThreadCPUAffinity(cpu));
+         thread.SetNUMANode(nodeOfCPU[idx]);
+         return B_NO_ERROR;
       }
-      else (void) _pendingMessages.RemoveFirst();  // nothing to do for this client!?
+
+      case THREAD_PLACEMENT_PER_NUMA_NODE:
+      {
+         uint32 numNodes;
+         MRETURN_ON_ERROR(GetNumberOfNUMANodes(numNodes));
+
+         const uint32 node = threadIndex%numNodes;
+         MRETURN_ON_ERROR(thread.SetThreadCPUAffinityToNUMANode(node));
+         thread.SetNUMANode(node);
+         return B_NO_ERROR;
+      }
+
+      default:
+         return B_BAD_ARGUMENT;
    }
 }
 
-void ThreadPool :: ThreadFinishedProcessingClientMessages(uint32 threadID, IThreadPoolClient * client)
+ThreadPool::ThreadPoolThread * ThreadPool :: PopIdleWorker()
 {
-   DECLARE_MUTEXGUARD(_poolLock);
-   if (_shuttingDown) return;
+   if (_numIdleWorkers.GetCount() == 0) return NULL;  // quick check, so that a busy pool doesn't need to lock _idleLock at all
 
-   bool * isClientBeingHandled = _registeredClients.Get(client);
-   if (isClientBeingHandled)
+   DECLARE_MUTEXGUARD(_idleLock);
+   ThreadPoolThread * ret = NULL;
+   uint32 threadID;
+   if (_idleWorkers.RemoveLast(threadID, ret).IsOK())  // use the most-recently-idled thread because it's "hottest" in cache
    {
-      MASSERT(*isClientBeingHandled, "ThreadFinishedProcessingClientMessages: *isBeingClientHandled if false!");
-      *isClientBeingHandled = false;
+      ret->_isWaking = true;  // the caller is about to wake it up
+      (void) _numWakingWorkers.AtomicIncrement();
+   }
+   _numIdleWorkers.SetCount(_idleWorkers.GetNumItems());
+   return ret;
+}
+
+void ThreadPool :: WakeIdleWorker()
+{
+   if (_numWakingWorkers.GetCount() > 0) return;  // the thread that is already waking up will wake another one if it finds more work than it can handle
+
+   ThreadPoolThread * worker = PopIdleWorker();
+   if (worker) MLOG_ON_ERROR("ThreadPool::WakeIdleWorker()", worker->SendMessageToInternalThread(DummyMessageRef(_dummyMsg)));
+}
+
+void ThreadPool :: SetWorkerIdle(ThreadPoolThread * worker, bool isIdle)
+{
+   DECLARE_MUTEXGUARD(_idleLock);
+   if (isIdle)
+   {
+      (void) _idleWorkers.Put(worker->GetThreadID(), worker);  // can't fail, since we preallocated (_maxThreadCount) slots
+      if (worker->_isWaking)
+      {
+         // We were woken up but found nothing to do.  Done before the worker's last look for work, so that
+         // anyone who decided not to wake an idle thread because of us is sure to have their client seen.
+         worker->_isWaking = false;
+         (void) _numWakingWorkers.AtomicDecrement();
+      }
+   }
+   else (void) _idleWorkers.Remove(worker->GetThreadID());
+   _numIdleWorkers.SetCount(_idleWorkers.GetNumItems());
+}
+
+void ThreadPool :: WorkerFoundClient(ThreadPoolThread * worker)
+{
+   // No locking needed here, since (worker) isn't in _idleWorkers, so no other thread will touch its _isWaking flag
+   if (worker->_isWaking)
+   {
+      worker->_isWaking = false;
+
+      // If there is still more work queued up, pass the baton on to another idle thread
+      if ((_numWakingWorkers.AtomicDecrement())&&(_numQueuedClients.GetCount() > 0)) WakeIdleWorker();
+   }
+}
+
+status_t ThreadPool :: ThreadPoolThread :: PushClient(ThreadPoolClientState * cs, bool * optRetHadOtherClients)
+{
+   DECLARE_MUTEXGUARD(_dequeLock);
+   if (optRetHadOtherClients) *optRetHadOtherClients = _deque.HasItems();
+   MRETURN_ON_ERROR(_deque.AddTail(cs));
+   (void) _threadPool->_numQueuedClients.AtomicIncrement();  // done while still locked, so that anyone who sees the new count will also see (cs)
+   return B_NO_ERROR;
+}
+
+ThreadPoolClientState * ThreadPool :: ThreadPoolThread :: PopClient()
+{
+   DECLARE_MUTEXGUARD(_dequeLock);
+   ThreadPoolClientState * ret = _deque.RemoveHeadWithDefault();
+   if (ret) (void) _threadPool->_numQueuedClients.AtomicDecrement();
+   return ret;
+}
+
+ThreadPoolClientState * ThreadPool :: ThreadPoolThread :: StealClient()
+{
+   DECLARE_MUTEXGUARD(_dequeLock);
+   ThreadPoolClientState * ret = _deque.RemoveTailWithDefault();  // take from the opposite end from our owner, to stay out of its way
+   if (ret) (void) _threadPool->_numQueuedClients.AtomicDecrement();
+   return ret;
+}
+
+uint32 ThreadPool :: ThreadPoolThread :: GetNumQueuedClients() const
+{
+   DECLARE_MUTEXGUARD(_dequeLock);
+   return _deque.GetNumItems();
+}
+
+ThreadPoolClientState * ThreadPool :: ThreadPoolThread :: FindClientToHandle()
+{
+   ThreadPoolClientState * cs = PopClient();
+   if (cs) return cs;
+
+   if (_threadPool->_numQueuedClients.GetCount() <= 0) return NULL;  // nothing to steal, so don't bother locking every other thread's deque
 
-      Queue<MessageRef> * deferredMessages = _deferredMessages.Get(client);
-      if ((deferredMessages)&&(deferredMessages->HasItems()))
+   // Nothing of our own to do, so try to steal a client (along with all of its pending Messages) from another
+   // pool thread.  We look at the pool threads on our own NUMA node first, so that the client's data stays local if possible.
+   const uint32 numWorkers = _threadPool->GetNumWorkers();
+   for (uint32 pass=0; pass<2; pass++)
+   {
+      const bool sameNode = (pass == 0);
+      for (uint32 i=1; i<numWorkers; i++)
       {
-         Queue<MessageRef> * pendingMessages = _pendingMessages.GetOrPut(client);
-         if (pendingMessages)
+         ThreadPoolThread * victim = _threadPool->_workers[(_threadID+i)%numWorkers];
+         if ((victim->GetNUMANode() == _numaNode) == sameNode)
          {
-            MASSERT(pendingMessages->IsEmpty(), "ThreadPool::ThreadFinishedProcessingClientMessages():  pendingMessages isn't empty!");
-            pendingMessages->SwapContents(*deferredMessages);
+            cs = victim->StealClient();
+            if (cs) return cs;
          }
-         else
+      }
+   }
+   return NULL;
+}
+
+void ThreadPool :: ThreadPoolThread :: HandleClientMessages(ThreadPoolClientState * cs)
+{
+   while(true)
+   {
+      {
+         DECLARE_MUTEXGUARD(cs->_lock);
+         _batch.SwapContents(cs->_messages);
+      }
+
+      while(_batch.HasItems())
+      {
+         _threadPool->MessageReceivedFromThreadPoolAux(cs->_client, _batch.Head(), _batch.GetLastValidIndex());
+         (void) _batch.RemoveHead();
+      }
+
+      {
+         DECLARE_MUTEXGUARD(cs->_lock);
+         if (cs->_messages.IsEmpty())
          {
-            LogTime(MUSCLE_LOG_CRITICALERROR, "ThreadPool::ThreadFinishedProcessingClientMessages():  couldn't allocate pending Messages Queue, dropping " UINT32_FORMAT_SPEC " deferred Messages!\n", deferredMessages->GetNumItems());
-            deferredMessages->Clear();
+            cs->_isScheduled = false;
+            if (cs->_waitingForCompletion)
+            {
+               MLOG_ON_ERROR("ThreadPool::Notify()", cs->_waitingForCompletion->Notify());  // wake up user thread if he's waiting in UnregisterClient()
+               cs->_waitingForCompletion = NULL;
+            }
+            return;  // note that (cs) may be deleted by UnregisterClient() as soon as we unlock cs->_lock
          }
       }
+
+      // More Messages arrived while we were busy; requeue the client behind our other clients so that it can't starve them
+      bool hadOtherClients;
+      if (PushClient(cs, &hadOtherClients).IsOK())
+      {
+         if (hadOtherClients) _threadPool->WakeIdleWorker();  // an idle thread might as well steal something from us (unless one is already on its way)
+         return;
+      }
+      // else we couldn't requeue it, so we'll just handle its new Messages right away
    }
-   (void) _activeThreads.MoveToTable(threadID, _availableThreads);  // this thread is now available again for further tasks
-   DispatchPendingMessagesUnsafe();
+}
 
-   if (DoesClientHaveMessagesOutstandingUnsafe(client) == false)
+void ThreadPool :: ThreadPoolThread :: InternalThreadEntry()
+{
+   while(_threadPool->IsShuttingDown() == false)
    {
-      WaitCondition * wc = _waitingForCompletion[client];  // wake up user thread if he's waiting in UnregisterClient()
-      if (wc)
+      ThreadPoolClientState * cs = FindClientToHandle();
+      if (cs == NULL)
       {
-         MLOG_ON_ERROR("ThreadPool::Notify()", wc->Notify());
-         (void) _waitingForCompletion.Remove(client);
+         // Mark ourself idle before looking again, so that a client scheduled after our last look can't go unnoticed
+         _threadPool->SetWorkerIdle(this, true);
+         cs = FindClientToHandle();
+         if (cs == NULL)
+         {
+            MessageRef msgRef;
+            const status_t waitRet = WaitForNextMessageFromOwner(msgRef);  // a Message (usually an empty one) means there may be work to do
+            _threadPool->SetWorkerIdle(this, false);
+
+            if (waitRet == B_TIMED_OUT) continue;
+            if ((waitRet.IsError())||(msgRef() == NULL)) break;  // time to go away!
+            continue;
+         }
+         _threadPool->SetWorkerIdle(this, false);
       }
+      _threadPool->WorkerFoundClient(this);
+      HandleClientMessages(cs);
    }
 }
 
@@ -3,6 +3,7 @@
 #ifndef MuscleThreadPool_h
 #define MuscleThreadPool_h
 
+#include "system/AtomicCounter.h"
 #include "system/Thread.h"
 #include "system/Mutex.h"
 #include "util/Queue.h"
@@ -13,6 +14,7 @@
 namespace muscle {
 
 class ThreadPool;
+class ThreadPoolClientState;
 class WaitCondition;
 
 /** This is an interface class that should be implemented by objects that want to make use of a ThreadPool. */
@@ -23,7 +25,7 @@ public:
      * @param threadPool Pointer to the ThreadPool object this client should register with, or NULL if you wish this client
      *                   to start out unregistered.  (If the latter, be sure to call SetThreadPool() later on).
      */
-   IThreadPoolClient(ThreadPool * threadPool) : _threadPool(NULL) {SetThreadPool(threadPool);}
+   IThreadPoolClient(ThreadPool * threadPool) : _threadPool(NULL), _clientState(NULL) {SetThreadPool(threadPool);}
 
    /** Destructor.  Note that if this object is still registered with a ThreadPool when this destructor is called,
      * an assertion failure will be triggered -- registered IThreadPoolClient objects MUST call SetThreadPool(NULL)
@@ -75,6 +77,7 @@ private:
    friend class ThreadPool;
 
    ThreadPool * _threadPool;
+   ThreadPoolClientState * _clientState;  // our per-client scheduling state inside (_threadPool); only meaningful while (_threadPool) is non-NULL
 };
 
 /** This class allows you to multiplex the handling of a large number of parallel Message streams
@@ -83,6 +86,16 @@ private:
   *
   * This class is Thread-safe, in that you can have IThreadPoolClients using it from different
   * threads simultaneously, and it will still work as expected.
+  *
+  * Scheduling is done via work-stealing:  each pool thread has its own queue of clients that have
+  * Messages ready to be handled, and a pool thread that runs out of clients to handle will steal
+  * a client (along with all of that client's pending Messages) from another pool thread's queue.
+  * Each client is in at most one of those queues (or being handled by at most one thread) at any
+  * given time, so a client's Messages are always handled serially and in the order they were sent.
+  * Sending a Message to the ThreadPool locks only that client's own Mutex (plus, occasionally,
+  * a pool thread's queue-Mutex), so clients in different threads don't contend with each other.
+  * Only one idle pool thread at a time is woken up to look for work; once it finds some, it wakes
+  * up another idle thread if there is still more work waiting.
   */
 class MUSCLE_NODISCARD ThreadPool : private AbstractObjectRecycler
 {
@@ -99,11 +112,26 @@ public:
    /** Returns the maximum number of threads this ThreadPool is allowed to keep around at once time (as specified in the constructor) */
    MUSCLE_NODISCARD uint32 GetMaxThreadCount() const {return _maxThreadCount;}
 
+   /** Values to pass in to SetThreadPlacementPolicy() to specify which CPU cores the pool threads may run on */
+   enum {
+      THREAD_PLACEMENT_NONE = 0,      /**< pool threads may run on any CPU core (the default) */
+      THREAD_PLACEMENT_PER_CPU,       /**< each pool thread is pinned to a single CPU core; cores are assigned one NUMA node at a time */
+      THREAD_PLACEMENT_PER_NUMA_NODE, /**< each pool thread may run on any core of a single NUMA node; nodes are assigned round-robin */
+      NUM_THREAD_PLACEMENTS           /**< guard value */
+   };
+
+   /** Sets the policy used to decide which CPU cores each pool thread may run on.  When a placement policy is
+     * in effect, idle pool threads also prefer to steal work from pool threads on their own NUMA node.
+     * @param policy a THREAD_PLACEMENT_* value.
+     * @note this only affects pool threads created after this call, so it should be called before any Messages are sent to the pool.
+     */
+   void SetThreadPlacementPolicy(uint32 policy) {_placementPolicy = policy;}
+
+   /** Returns the THREAD_PLACEMENT_* value that was passed to SetThreadPlacementPolicy().  Default value is THREAD_PLACEMENT_NONE. */
+   MUSCLE_NODISCARD uint32 GetThreadPlacementPolicy() const {return _placementPolicy;}
+
    /** @copydoc DoxyTemplate::Print(const OutputPrinter &) const */
-   virtual void Print(const OutputPrinter & p) const
-   {
-      p.printf("ThreadPool %p:  _maxThreadCount=" UINT32_FORMAT_SPEC ", _shuttingDown=%i, _threadIDCounter=" UINT32_FORMAT_SPEC ", _availableThreads=" UINT32_FORMAT_SPEC ", _activeThreads=" UINT32_FORMAT_SPEC ", _registeredClients=" UINT32_FORMAT_SPEC ", _pendingMessages=" UINT32_FORMAT_SPEC ", _deferredMessages=" UINT32_FORMAT_SPEC ", _waitingForCompletion=" UINT32_FORMAT_SPEC "\n", this, _maxThreadCount, _shuttingDown, _threadIDCounter, _availableThreads.GetNumItems(), _activeThreads.GetNumItems(), _registeredClients.GetNumItems(), _pendingMessages.GetNumItems(), _deferredMessages.GetNumItems(), _waitingForCompletion.GetNumItems());
-   }
+   virtual void Print(const OutputPrinter & p) const;
 
 protected:
    /** Starts the specified Thread object's internal thread running.
@@ -123,19 +151,35 @@ private:
    class ThreadPoolThread : public Thread, public RefCountable
    {
    public:
-      ThreadPoolThread(ThreadPool * tp, uint32 threadID) : _threadID(threadID), _threadPool(tp), _currentClient(NULL) {/* empty */}
+      ThreadPoolThread(ThreadPool * tp, uint32 threadID) : _threadID(threadID), _threadPool(tp), _numaNode(0), _isWaking(false) {/* empty */}
 
       uint32 GetThreadID() const {return _threadID;}
-      status_t SendMessagesToInternalThread(IThreadPoolClient * client, Queue<MessageRef> & mq);
+
+      void SetNUMANode(uint32 numaNode) {_numaNode = numaNode;}
+      uint32 GetNUMANode() const {return _numaNode;}
+
+      status_t PushClient(ThreadPoolClientState * cs, bool * optRetHadOtherClients = NULL);  // appends (cs) to the tail of our deque
+      ThreadPoolClientState * PopClient();              // removes the client at the head of our deque (called by our own internal thread)
+      ThreadPoolClientState * StealClient();            // removes the client at the tail of our deque (called by other pool threads)
+      uint32 GetNumQueuedClients() const;
 
    protected:
-      virtual status_t MessageReceivedFromOwner(const MessageRef & msgRef, uint32 numLeft);
+      virtual void InternalThreadEntry();
 
    private:
+      ThreadPoolClientState * FindClientToHandle();
+      void HandleClientMessages(ThreadPoolClientState * cs);
+
       const uint32 _threadID;
       ThreadPool * _threadPool;
-      IThreadPoolClient * _currentClient;
-      Queue<MessageRef> _internalQueue;
+      uint32 _numaNode;  // which NUMA node our placement policy put us on (always 0 if there is no placement policy)
+      bool _isWaking;    // true iff we were woken up to look for work and haven't found any (or gone idle again) yet; see ThreadPool::_numWakingWorkers
+
+      friend class ThreadPool;
+
+      mutable Mutex _dequeLock;
+      Queue<ThreadPoolClientState *> _deque;  // clients that have been assigned to this thread and are waiting for it to handle their Messages
+      Queue<MessageRef> _batch;              // the Messages we are currently handling (swapped out of a client's queue)
    };
    DECLARE_REFTYPES(ThreadPoolThread);
 #endif
@@ -146,24 +190,35 @@ private:
    status_t RegisterClient(IThreadPoolClient * client);
    void UnregisterClient(IThreadPoolClient * client);
    status_t SendMessageToThreadPool(IThreadPoolClient * client, const MessageRef & msg);
-   void DispatchPendingMessagesUnsafe();  // _poolLock must be locked when this is called!
-   void ThreadFinishedProcessingClientMessages(uint32 threadID, IThreadPoolClient * client);
-   MUSCLE_NODISCARD bool DoesClientHaveMessagesOutstandingUnsafe(IThreadPoolClient * client) const;
+   status_t ScheduleClient(ThreadPoolClientState * cs);
+   ThreadPoolThread * CreateWorkerThread();
+   status_t ApplyThreadPlacementPolicy(ThreadPoolThread & thread, uint32 threadIndex) const;
+   ThreadPoolThread * PopIdleWorker();
+   void WakeIdleWorker();
+   void SetWorkerIdle(ThreadPoolThread * worker, bool isIdle);
+   void WorkerFoundClient(ThreadPoolThread * worker);
+   MUSCLE_NODISCARD bool IsShuttingDown() const {return (_shuttingDown.GetCount() != 0);}
+   MUSCLE_NODISCARD uint32 GetNumWorkers() const {return (uint32) _numWorkers.GetCount();}
    void MessageReceivedFromThreadPoolAux(IThreadPoolClient * client, const MessageRef & msg, uint32 numLeft) {client->MessageReceivedFromThreadPool(msg, numLeft);}  // just to skirt protected-member issues
-   MUSCLE_NODISCARD uint32 ShutdownThreadsInTableWithoutDeadlocking(Hashtable<uint32, ThreadPoolThreadRef> & table);
 
    const uint32 _maxThreadCount;
-
-   Mutex _poolLock;
-   bool _shuttingDown;
-
-   uint32 _threadIDCounter;
-   Hashtable<uint32, ThreadPoolThreadRef> _availableThreads;
-   Hashtable<uint32, ThreadPoolThreadRef> _activeThreads;
-   Hashtable<IThreadPoolClient *, bool> _registeredClients;  // registered clients -> (true iff a Thread is currently handling them)
-   Hashtable<IThreadPoolClient *, Queue<MessageRef> > _pendingMessages;  // Messages ready to be sent to a pool Thread
-   Hashtable<IThreadPoolClient *, Queue<MessageRef> > _deferredMessages; // Messages to be be sent to a pool Thread when the current Thread's Messages are done
-   Hashtable<IThreadPoolClient *, WaitCondition *> _waitingForCompletion; // Clients who are blocked in UnregisterClient() waiting for Messages to complete processing
+   uint32 _placementPolicy;
+   AtomicCounter _shuttingDown;
+
+   mutable Mutex _poolLock;  // guards _registeredClients, _retiredClientStates and _workerRefs; not used when sending or handling Messages
+   Hashtable<IThreadPoolClient *, ThreadPoolClientState *> _registeredClients;
+   Queue<ThreadPoolClientState *> _retiredClientStates;  // detached by Shutdown(), but kept until our destructor in case another thread is still sending with them
+   Queue<ThreadPoolThreadRef> _workerRefs;
+
+   ThreadPoolThread ** _workers;  // array of (_maxThreadCount) pointers; the first (_numWorkers) of them are valid and never change
+   AtomicCounter _numWorkers;
+   AtomicCounter _nextWorkerIndex;   // for round-robin assignment of clients when no pool thread is idle
+   AtomicCounter _numQueuedClients;  // total number of clients in all of the pool threads' deques
+
+   mutable Mutex _idleLock;
+   Hashtable<uint32, ThreadPoolThread *> _idleWorkers;  // pool threads that are (or are about to be) blocked waiting for work
+   AtomicCounter _numIdleWorkers;  // always equal to _idleWorkers.GetNumItems(), but readable without locking _idleLock
+   AtomicCounter _numWakingWorkers;  // number of pool threads that have been woken up but haven't found a client yet
 
    DECLARE_COUNTED_OBJECT(ThreadPool);
 };
@@ -0,0 +1,14 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#ifndef MuscleTestMacros_h
+#define MuscleTestMacros_h
+
+#include "syslog/SysLog.h"
+
+/** Shared by the test programs whose test functions return a status_t:  if (x) evaluates to false, logs the
+  * line number and the text of the failed condition, and then returns B_LOGIC_ERROR from the calling function.
+  * @note the including file is expected to have a "using namespace muscle;" in effect, as all the test programs do.
+  */
+#define TEST(x) if (!(x)) {LogTime(MUSCLE_LOG_CRITICALERROR, "Test failed at line %i:  %s\n", __LINE__, #x); return B_LOGIC_ERROR;}
+
+#endif
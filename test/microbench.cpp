@@ -0,0 +1,480 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#include <stdio.h>
+#include <math.h>
+
+#include "message/Message.h"
+#include "system/SetupSystem.h"
+#include "util/Hashtable.h"
+#include "util/MiscUtilityFunctions.h"
+#include "util/ObjectPool.h"
+#include "util/Queue.h"
+#include "util/String.h"
+#include "util/TimeUtilityFunctions.h"
+#include "zlib/ZLibCodec.h"
+
+using namespace muscle;
+
+// Each benchmark function performs (numOps) operations, and returns a checksum of its results so that the compiler can't optimize the work away
+typedef uint64 (*BenchmarkFunc)(uint32 numOps);
+
+class MicroBenchmark
+{
+public:
+   const char * _name;
+   BenchmarkFunc _func;
+   uint32 _bytesPerOp;  // if non-zero, we'll report throughput also
+};
+
+static const uint32 NUM_TABLE_KEYS   = 10000;
+static const uint32 ZLIB_BUFFER_SIZE = 16*1024;
+
+static const char * _shortCString = "short string";
+static const char * _longCString  = "This string is long enough that it can't fit into String's small-string-optimization buffer, so copies need heap memory";
+
+static inline uint32 GetTableKey(uint32 i) {return i*2654435761u;}  // spread the keys out a bit
+
+class PooledBenchObject : public RefCountable
+{
+public:
+   PooledBenchObject() : _value(0) {/* empty */}
+
+   uint32 _value;
+   char _padding[60];
+};
+
+// Input data shared by the benchmarks; it's set up by main() before any benchmarks are run, so that it isn't part of what gets timed
+class BenchmarkInputs
+{
+public:
+   BenchmarkInputs()
+   {
+      for (uint32 i=0; i<NUM_TABLE_KEYS; i++) (void) _lookupTable.Put(GetTableKey(i), i);
+
+      _sampleMessage.what = 1234;
+      Message sub(5678);
+      for (uint32 i=0; i<10; i++)
+      {
+         char fieldName[32]; muscleSprintf(fieldName, "field_" UINT32_FORMAT_SPEC, i);
+         (void) _sampleMessage.AddString(fieldName, _longCString);
+         (void) _sampleMessage.AddInt32(fieldName+String("_int"), i);
+         (void) _sampleMessage.AddFloat(fieldName+String("_float"), i*1.5f);
+         (void) sub.AddInt64(fieldName, i);
+      }
+      (void) _sampleMessage.AddMessage("sub", sub);
+
+      // Semi-compressible text, roughly similar to what flattened Messages full of strings look like
+      String s;
+      for (uint32 i=0; s.Length()<ZLIB_BUFFER_SIZE; i++) s += String("node_%1=%2;").Arg(i%37).Arg(i*7919);
+      (void) _textBuffer.SetBuffer(ZLIB_BUFFER_SIZE, (const uint8 *) s());
+   }
+
+   Hashtable<uint32, uint32> _lookupTable;
+   Message _sampleMessage;
+   ByteBuffer _textBuffer;
+   ObjectPool<PooledBenchObject> _objectPool;
+};
+static BenchmarkInputs * _inputs = NULL;
+
+static uint64 BenchHashtablePut(uint32 numOps)
+{
+   Hashtable<uint32, uint32> table;
+   uint64 ret = 0;
+   for (uint32 i=0; i<numOps; i++)
+   {
+      if ((i%NUM_TABLE_KEYS) == 0) {ret += table.GetNumItems(); table.Clear();}
+      (void) table.Put(GetTableKey(i), i);
+   }
+   return ret+table.GetNumItems();
+}
+
+static uint64 BenchHashtableGet(uint32 numOps)
+{
+   const Hashtable<uint32, uint32> & table = _inputs->_lookupTable;
+   uint64 ret = 0;
+   for (uint32 i=0; i<numOps; i++) ret += table.GetWithDefault(GetTableKey(i%NUM_TABLE_KEYS));
+   return ret;
+}
+
+static uint64 BenchHashtableRemove(uint32 numOps)
+{
+   Hashtable<uint32, uint32> table = _inputs->_lookupTable;
+   uint64 ret = 0;
+   for (uint32 i=0; i<numOps; i++)
+   {
+      const uint32 key = GetTableKey(i%NUM_TABLE_KEYS);
+      uint32 val = 0;
+      if (table.Remove(key, val).IsOK()) ret += val;
+      (void) table.Put(key, val);  // put it back, so that the table stays the same size
+   }
+   return ret;
+}
+
+static uint64 BenchQueueAddTailRemoveHead(uint32 numOps)
+{
+   Queue<uint32> q;
+   for (uint32 i=0; i<100; i++) (void) q.AddTail(i);
+
+   uint64 ret = 0;
+   for (uint32 i=0; i<numOps; i++)
+   {
+      uint32 val = 0;
+      (void) q.RemoveHead(val);
+      (void) q.AddTail(val+i);
+      ret += val;
+   }
+   return ret;
+}
+
+static uint64 BenchQueueInsertItemAt(uint32 numOps)
+{
+   Queue<uint32> q;
+   for (uint32 i=0; i<100; i++) (void) q.AddTail(i);
+
+   uint64 ret = 0;
+   for (uint32 i=0; i<numOps; i++)
+   {
+      const uint32 idx = i%q.GetNumItems();
+      (void) q.InsertItemAt(idx, i);
+      ret += q.RemoveItemAtWithDefault(q.GetNumItems()-1-idx);
+   }
+   return ret;
+}
+
+static uint64 BenchStringCopyShort(uint32 numOps)
+{
+   const String orig(_shortCString);
+   uint64 ret = 0;
+   for (uint32 i=0; i<numOps; i++) {const String s(orig); ret += s.Length();}
+   return ret;
+}
+
+static uint64 BenchStringCopyLong(uint32 numOps)
+{
+   const String orig(_longCString);
+   uint64 ret = 0;
+   for (uint32 i=0; i<numOps; i++) {const String s(orig); ret += s.Length();}
+   return ret;
+}
+
+static uint64 BenchStringAppend(uint32 numOps)
+{
+   String s;
+   uint64 ret = 0;
+   for (uint32 i=0; i<numOps; i++)
+   {
+      if ((i%100) == 0) {ret += s.Length(); s.Clear();}
+      s += "append";
+   }
+   return ret+s.Length();
+}
+
+static uint64 BenchStringCompare(uint32 numOps)
+{
+   const String a(_longCString), b[2] = {_longCString, String(_longCString).WithReplacements("memory", "MEMORY")};
+   uint64 ret = 0;
+   for (uint32 i=0; i<numOps; i++) if (a == b[i%2]) ret += i;
+   return ret;
+}
+
+static uint64 BenchStringIndexOf(uint32 numOps)
+{
+   const String s(_longCString), sub("heap memory");
+   uint64 ret = 0;
+   for (uint32 i=0; i<numOps; i++) ret += s.IndexOf(sub, i%16);
+   return ret;
+}
+
+static uint64 BenchMessageFlatten(uint32 numOps)
+{
+   const Message & msg = _inputs->_sampleMessage;
+   ByteBuffer buf;
+   uint64 ret = 0;
+   for (uint32 i=0; i<numOps; i++)
+   {
+      (void) msg.FlattenToByteBuffer(buf);
+      ret += buf.GetNumBytes();
+   }
+   return ret;
+}
+
+static uint64 BenchMessageUnflatten(uint32 numOps)
+{
+   ByteBuffer buf;
+   (void) _inputs->_sampleMessage.FlattenToByteBuffer(buf);
+
+   Message msg;
+   uint64 ret = 0;
+   for (uint32 i=0; i<numOps; i++)
+   {
+      (void) msg.UnflattenFromByteBuffer(buf);
+      ret += msg.GetNumNames();
+   }
+   return ret;
+}
+
+static uint64 BenchObjectPool(uint32 numOps)
+{
+   ObjectPool<PooledBenchObject> & pool = _inputs->_objectPool;
+   uint64 ret = 0;
+   for (uint32 i=0; i<numOps; i++)
+   {
+      PooledBenchObject * obj = pool.ObtainObject();
+      if (obj)
+      {
+         obj->_value = i;
+         ret += obj->_value;
+         pool.ReleaseObject(obj);
+      }
+   }
+   return ret;
+}
+
+static uint64 BenchGetMessageFromPool(uint32 numOps)
+{
+   uint64 ret = 0;
+   for (uint32 i=0; i<numOps; i++)
+   {
+      MessageRef msg = GetMessageFromPool(i);
+      if (msg()) ret += msg()->what;
+   }
+   return ret;
+}
+
+#ifdef MUSCLE_ENABLE_ZLIB_ENCODING
+static uint64 BenchZLibDeflate(uint32 numOps)
+{
+   const ByteBuffer & src = _inputs->_textBuffer;
+   ZLibCodec codec;
+   uint64 ret = 0;
+   for (uint32 i=0; i<numOps; i++)
+   {
+      ByteBufferRef deflated = codec.Deflate(src, true);
+      if (deflated()) ret += deflated()->GetNumBytes();
+   }
+   return ret;
+}
+
+static uint64 BenchZLibInflate(uint32 numOps)
+{
+   ZLibCodec codec;
+   ByteBufferRef deflated = codec.Deflate(_inputs->_textBuffer, true);
+   if (deflated() == NULL) return 0;
+
+   uint64 ret = 0;
+   for (uint32 i=0; i<numOps; i++)
+   {
+      ByteBufferRef inflated = codec.Inflate(*deflated());
+      if (inflated()) ret += inflated()->GetNumBytes();
+   }
+   return ret;
+}
+#endif
+
+static uint64 BenchCalculateHashCode64(uint32 numOps)
+{
+   const ByteBuffer & src = _inputs->_textBuffer;
+   uint64 ret = 0;
+   for (uint32 i=0; i<numOps; i++) ret += CalculateHashCode(src.GetBuffer()+(i%64), 64);
+   return ret;
+}
+
+static uint64 BenchCalculateHashCode4K(uint32 numOps)
+{
+   const ByteBuffer & src = _inputs->_textBuffer;
+   uint64 ret = 0;
+   for (uint32 i=0; i<numOps; i++) ret += CalculateHashCode(src.GetBuffer()+(i%64), 4096);
+   return ret;
+}
+
+static const MicroBenchmark _benchmarks[] = {
+   {"Hashtable::Put()",                  BenchHashtablePut,           0},
+   {"Hashtable::Get()",                  BenchHashtableGet,           0},
+   {"Hashtable::Remove()+Put()",         BenchHashtableRemove,        0},
+   {"Queue::AddTail()+RemoveHead()",     BenchQueueAddTailRemoveHead, 0},
+   {"Queue::InsertItemAt()+RemoveItemAt()", BenchQueueInsertItemAt,   0},
+   {"String copy (short)",               BenchStringCopyShort,        0},
+   {"String copy (long)",                BenchStringCopyLong,         0},
+   {"String::operator+=()",              BenchStringAppend,           0},
+   {"String::operator==()",              BenchStringCompare,          0},
+   {"String::IndexOf()",                 BenchStringIndexOf,          0},
+   {"Message::Flatten()",                BenchMessageFlatten,         0},
+   {"Message::Unflatten()",              BenchMessageUnflatten,       0},
+   {"ObjectPool obtain+release",         BenchObjectPool,             0},
+   {"GetMessageFromPool()",              BenchGetMessageFromPool,     0},
+#ifdef MUSCLE_ENABLE_ZLIB_ENCODING
+   {"ZLibCodec::Deflate() 16KB",         BenchZLibDeflate,            ZLIB_BUFFER_SIZE},
+   {"ZLibCodec::Inflate() 16KB",         BenchZLibInflate,            ZLIB_BUFFER_SIZE},
+#endif
+   {"CalculateHashCode() 64B",           BenchCalculateHashCode64,    64},
+   {"CalculateHashCode() 4KB",           BenchCalculateHashCode4K,    4096},
+};
+
+// Summary statistics (in nanoseconds per operation) of one benchmark's repetitions
+class BenchmarkResult
+{
+public:
+   BenchmarkResult() : _numOpsPerRep(0), _min(0.0), _median(0.0), _mean(0.0), _stdDev(0.0) {/* empty */}
+
+   uint32 _numOpsPerRep;
+   double _min;
+   double _median;
+   double _mean;
+   double _stdDev;
+};
+
+static volatile uint64 _checksumSink = 0;  // so that the benchmarks' results are never unused
+
+static uint64 TimeBenchmark(const MicroBenchmark & b, uint32 numOps)
+{
+   const uint64 startTime = GetRunTime64();
+   _checksumSink += b._func(numOps);
+   return GetRunTime64()-startTime;
+}
+
+static BenchmarkResult RunBenchmark(const MicroBenchmark & b, uint32 numReps, uint64 targetMicrosPerRep)
+{
+   // Warm up (caches, pools, lazily-built inputs) while finding out how many operations fill up one repetition
+   uint32 numOps = 1;
+   while(numOps < (1u<<30))
+   {
+      const uint64 elapsed = TimeBenchmark(b, numOps);
+      if (elapsed >= targetMicrosPerRep) break;
+      numOps = (elapsed > (targetMicrosPerRep/16)) ? (uint32) muscleMin((uint64)numOps*2*targetMicrosPerRep/muscleMax(elapsed, (uint64)1), (uint64)(1u<<30)) : numOps*8;
+   }
+
+   Queue<double> samples;
+   for (uint32 i=0; i<numReps; i++) (void) samples.AddTail((1000.0*TimeBenchmark(b, numOps))/numOps);
+   samples.Sort();
+
+   BenchmarkResult r;
+   r._numOpsPerRep = numOps;
+   if (samples.HasItems())
+   {
+      double sum = 0.0;
+      for (uint32 i=0; i<samples.GetNumItems(); i++) sum += samples[i];
+      r._mean = sum/samples.GetNumItems();
+
+      double sumSquares = 0.0;
+      for (uint32 i=0; i<samples.GetNumItems(); i++) sumSquares += (samples[i]-r._mean)*(samples[i]-r._mean);
+      r._stdDev = sqrt(sumSquares/samples.GetNumItems());
+
+      const uint32 mid = samples.GetNumItems()/2;
+      r._min    = samples.Head();
+      r._median = (samples.GetNumItems()%2) ? samples[mid] : ((samples[mid-1]+samples[mid])/2.0);
+   }
+   return r;
+}
+
+// Baseline files are plain text:  one "name<TAB>median-nanoseconds-per-op" line per benchmark
+static status_t LoadBaseline(const char * fileName, Hashtable<String, double> & retBaseline)
+{
+   FILE * fpIn = muscleFopen(fileName, "r");
+   if (fpIn == NULL) return B_ERRNO;
+
+   status_t ret;
+   char line[512];
+   while(fgets(line, sizeof(line), fpIn))
+   {
+      if (line[0] == '#') continue;
+      char * tab = strchr(line, '\t');
+      if (tab == NULL) continue;
+      *tab = '\0';
+      if (retBaseline.Put(line, atof(tab+1)).IsError(ret)) break;
+   }
+   fclose(fpIn);
+   return ret;
+}
+
+static status_t SaveResults(const char * fileName, const Hashtable<String, BenchmarkResult> & results)
+{
+   FILE * fpOut = muscleFopen(fileName, "w");
+   if (fpOut == NULL) return B_ERRNO;
+
+   fprintf(fpOut, "# muscle_bench results:  benchmark name<TAB>median nanoseconds per operation\n");
+   for (ConstHashtableIterator<String, BenchmarkResult> iter(results); iter.HasData(); iter++) fprintf(fpOut, "%s\t%.3f\n", iter.GetKey()(), iter.GetValue()._median);
+   fclose(fpOut);
+   return B_NO_ERROR;
+}
+
+static void PrintUsage()
+{
+   printf("Usage:  muscle_bench [filter=substring] [reps=10] [time=50] [save=results.txt] [baseline=results.txt] [threshold=10] [strict]\n");
+   printf("  filter     = only run the benchmarks whose names contain this substring\n");
+   printf("  reps       = number of timed repetitions of each benchmark\n");
+   printf("  time       = approximate number of milliseconds each repetition should take\n");
+   printf("  save       = write the median results to this file, for use as a future baseline\n");
+   printf("  baseline   = compare the results against a file previously written via save=\n");
+   printf("  threshold  = percentage slowdown (relative to the baseline) that counts as a regression\n");
+   printf("  strict     = exit with an error code if any regressions were found\n");
+}
+
+// This program is a microbenchmark harness for MUSCLE's core containers and serialization code.
+// Each benchmark is warmed up, then timed over several repetitions; the results can be saved
+// and compared against a previous run to catch performance regressions.
+int main(int argc, char ** argv)
+{
+   CompleteSetupSystem css;
+
+   Message args; (void) ParseArgs(argc, argv, args);
+   if (args.HasName("help")) {PrintUsage(); return 0;}
+
+   const bool isFromScript = args.HasName("fromscript");  // just make sure that everything runs
+   const uint32 numReps    = isFromScript ? 1 : muscleMax((uint32) atol(args.GetCstr("reps", "10")), (uint32)1);
+   const uint64 repMicros  = isFromScript ? 1000 : MillisToMicros(muscleMax(atol(args.GetCstr("time", "50")), 1L));
+   const double threshold  = atof(args.GetCstr("threshold", "10"));
+   const char * filter     = args.GetCstr("filter");
+   const char * saveFile   = args.GetCstr("save");
+   const char * baseFile   = args.GetCstr("baseline");
+
+   Hashtable<String, double> baseline;
+   status_t ret;
+   if ((baseFile)&&(LoadBaseline(baseFile, baseline).IsError(ret)))
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "Unable to load baseline file [%s] [%s]\n", baseFile, ret());
+      return 10;
+   }
+
+   printf("%-40s %12s %12s %12s %24s %12s%s\n", "Benchmark", "ops/rep", "min ns/op", "median ns/op", "mean ns/op", "MB/sec", baseFile?"   vs baseline":"");
+
+   BenchmarkInputs inputs;
+   _inputs = &inputs;
+
+   Hashtable<String, BenchmarkResult> results;
+   uint32 numRegressions = 0;
+   for (uint32 i=0; i<ARRAYITEMS(_benchmarks); i++)
+   {
+      const MicroBenchmark & b = _benchmarks[i];
+      if ((filter)&&(strstr(b._name, filter) == NULL)) continue;
+
+      const BenchmarkResult r = RunBenchmark(b, numReps, repMicros);
+      (void) results.Put(b._name, r);
+
+      char meanBuf[64]; muscleSprintf(meanBuf, "%.2f +/- %.2f", r._mean, r._stdDev);
+      char mbBuf[32] = "";
+      if (b._bytesPerOp > 0) muscleSprintf(mbBuf, "%.1f", (b._bytesPerOp*1000000000.0)/(muscleMax(r._median, 0.001)*1024.0*1024.0));
+      printf("%-40s %12" UINT32_FORMAT_SPEC_NOPERCENT " %12.2f %12.2f %24s %12s", b._name, r._numOpsPerRep, r._min, r._median, meanBuf, mbBuf);
+
+      const double * baseMedian = baseline.Get(b._name);
+      if ((baseMedian)&&(*baseMedian > 0.0))
+      {
+         const double pctChange = (100.0*(r._median-*baseMedian))/(*baseMedian);
+         const bool isRegression = (pctChange > threshold);
+         if (isRegression) numRegressions++;
+         printf("   %+.1f%%%s", pctChange, isRegression?"  REGRESSION":"");
+      }
+      else if (baseFile) printf("   (no baseline)");
+      printf("\n");
+   }
+
+   _inputs = NULL;
+
+   if ((saveFile)&&(SaveResults(saveFile, results).IsError(ret)))
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "Unable to save results to [%s] [%s]\n", saveFile, ret());
+      return 10;
+   }
+
+   if (baseFile) printf("\n" UINT32_FORMAT_SPEC " benchmark(s) were more than %.1f%% slower than the baseline.\n", numRegressions, threshold);
+   return ((numRegressions > 0)&&(args.HasName("strict"))) ? 10 : 0;
+}
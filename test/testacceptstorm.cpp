@@ -0,0 +1,94 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#include <stdio.h>
+
+#include "reflector/ReflectServer.h"
+#include "reflector/StorageReflectSession.h"
+#include "system/SetupSystem.h"
+#include "test/TestMacros.h"
+#include "util/NetworkUtilityFunctions.h"
+
+using namespace muscle;
+
+static const uint32 NUM_CLIENTS       = 100;
+static const uint32 ACCEPTS_PER_CYCLE = 16;
+
+// Connects a burst of clients before the server gets a chance to accept any of them, and then
+// makes sure the server accepts them all, in batches no bigger than its per-iteration budget
+static status_t TestAcceptStorm(ReflectServer & server, ReflectSessionFactory & factory, uint32 socketsPerPort)
+{
+   server.SetNumAcceptSocketsPerPort(socketsPerPort);
+   server.SetAcceptBacklog(NUM_CLIENTS);
+   server.SetMaxAcceptsPerIteration(ACCEPTS_PER_CYCLE);
+
+   uint16 port = 0;
+   MRETURN_ON_ERROR(server.PutAcceptFactory(0, DummyReflectSessionFactoryRef(factory), invalidIP, &port));
+   TEST(port > 0);
+
+   Message stats;
+   MRETURN_ON_ERROR(server.SaveAcceptStatsToMessage(stats));
+#ifdef SO_REUSEPORT
+   TEST(stats.GetInt64("acceptsockets") == socketsPerPort);
+#else
+   TEST(stats.GetInt64("acceptsockets") == 1);
+#endif
+
+   // The kernel completes these connections on its own, so they'll all be waiting in the backlog-queues
+   Queue<ConstSocketRef> clients;
+   for (uint32 i=0; i<NUM_CLIENTS; i++)
+   {
+      ConstSocketRef s = Connect(IPAddressAndPort(localhostIP, port), NULL, NULL, true, SecondsToMicros(5));
+      MRETURN_ON_ERROR(s);
+      MRETURN_ON_ERROR(clients.AddTail(s));
+   }
+
+   const uint64 endTime = GetRunTime64()+SecondsToMicros(10);
+   while((server.GetNumAcceptedConnections() < NUM_CLIENTS)&&(GetRunTime64() < endTime)) MRETURN_ON_ERROR(server.ServerProcessLoop(GetRunTime64()+MillisToMicros(10)));
+
+   TEST(server.GetNumAcceptedConnections() == NUM_CLIENTS);
+   TEST(server.GetSessions().GetNumItems() == NUM_CLIENTS);
+   TEST(server.GetLargestAcceptBatch() == ACCEPTS_PER_CYCLE);  // the first pass should have used up its whole budget...
+   TEST(server.GetNumAcceptBudgetExhaustions() > 0);           // ... and left some connections for the next pass
+   TEST(server.GetAcceptRate() >= 0.0);
+
+   stats.Clear();
+   MRETURN_ON_ERROR(server.SaveAcceptStatsToMessage(stats));
+   TEST(stats.GetInt64("accepts") == NUM_CLIENTS);
+   TEST(stats.GetInt64("maxbatch") == ACCEPTS_PER_CYCLE);
+
+   uint64 numOverflows, numDrops;
+#ifdef __linux__
+   TEST(GetListenQueueOverflowCounts(numOverflows, numDrops).IsOK());
+   TEST(stats.HasName("listenoverflows"));
+#else
+   (void) GetListenQueueOverflowCounts(numOverflows, numDrops);
+#endif
+   return B_NO_ERROR;
+}
+
+// This program tests ReflectServer's handling of many simultaneous incoming connections
+int main(int, char **)
+{
+   CompleteSetupSystem css;
+
+   // Once with the default single accept-socket per port, and once with several
+   const uint32 socketsPerPort[] = {1, 4};
+   for (uint32 i=0; i<ARRAYITEMS(socketsPerPort); i++)
+   {
+      StorageReflectSessionFactory factory;  // declared first, since it must outlive the server's Cleanup() call
+      ReflectServer server;
+      server.SetDoLogging(false);
+
+      status_t ret;
+      if (TestAcceptStorm(server, factory, socketsPerPort[i]).IsError(ret))
+      {
+         LogTime(MUSCLE_LOG_CRITICALERROR, "Accept-storm test failed with " UINT32_FORMAT_SPEC " accept-sockets per port [%s]\n", socketsPerPort[i], ret());
+         server.Cleanup();
+         return 10;
+      }
+      server.Cleanup();
+   }
+
+   printf("Accept-storm tests passed.\n");
+   return 0;
+}
@@ -0,0 +1,298 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#include <stdio.h>
+
+#include "dataio/AsyncFileDataIO.h"
+#include "dataio/FileDataIO.h"
+#include "system/SetupSystem.h"
+#include "util/MiscUtilityFunctions.h"
+#include "util/SocketMultiplexer.h"
+
+using namespace muscle;
+
+static const char * TEST_FILE_NAME = "testasyncfiledataio.tmp";
+
+// Blocks until (io)'s select-socket indicates that an I/O operation has completed (or a second has passed)
+static void WaitForIO(const AsyncFileDataIO & io)
+{
+   SocketMultiplexer sm;
+   (void) sm.RegisterSocketForReadReady(io.GetReadSelectSocket().GetFileDescriptor());
+   (void) sm.WaitForEvents(GetRunTime64()+SecondsToMicros(1));
+}
+
+// Writes all of (data) to (io), in chunks of the given size, the way an event-loop would
+static status_t WriteAll(AsyncFileDataIO & io, const ByteBuffer & data, uint32 chunkSize)
+{
+   uint32 numWritten = 0;
+   while(numWritten < data.GetNumBytes())
+   {
+      const io_status_t ret = io.Write(data.GetBuffer()+numWritten, muscleMin(chunkSize, data.GetNumBytes()-numWritten));
+      MRETURN_ON_ERROR(ret);
+      if (ret.GetByteCount() == 0)
+      {
+         WaitForIO(io);
+         (void) io.Read(NULL, 0);  // drains the notify-socket and reaps completed writes
+      }
+      numWritten += ret.GetByteCount();
+   }
+   return io.WaitForPendingWrites();
+}
+
+// Reads everything from (io)'s current position until the end of the file, in chunks of the given size
+static status_t ReadAll(AsyncFileDataIO & io, uint32 chunkSize, ByteBuffer & retData)
+{
+   retData.Clear();
+   ByteBuffer chunk;
+   MRETURN_ON_ERROR(chunk.SetNumBytes(chunkSize, false));
+   while(true)
+   {
+      const io_status_t ret = io.Read(chunk.GetBuffer(), chunk.GetNumBytes());
+      if (ret.GetStatus() == B_END_OF_STREAM) return B_NO_ERROR;
+      MRETURN_ON_ERROR(ret);
+
+      if (ret.GetByteCount() > 0) MRETURN_ON_ERROR(retData.AppendBytes(chunk.GetBuffer(), ret.GetByteCount()));
+                             else WaitForIO(io);
+   }
+}
+
+static status_t TestAsyncFileDataIO(uint32 fileSize, uint32 chunkSize, uint32 numThreads, uint32 blockSize, uint32 numBlocks)
+{
+   ByteBuffer data;
+   MRETURN_ON_ERROR(data.SetNumBytes(fileSize, false));
+   for (uint32 i=0; i<fileSize; i++) data.GetBuffer()[i] = (uint8) GetInsecurePseudoRandomNumber32();
+
+   {
+      AsyncFileDataIO writer(TEST_FILE_NAME, "wb", numThreads, blockSize, numBlocks, blockSize*2, blockSize*8);
+      if (writer.IsFileOpen() == false) return B_IO_ERROR;
+      MRETURN_ON_ERROR(WriteAll(writer, data, chunkSize));
+      if (writer.GetLength() != (int64)fileSize) return B_LOGIC_ERROR;
+   }
+
+   AsyncFileDataIO reader(TEST_FILE_NAME, "rb", numThreads, blockSize, numBlocks);
+   if (reader.IsFileOpen() == false) return B_IO_ERROR;
+   if (reader.Write(data.GetBuffer(), 1).GetStatus() != B_ACCESS_DENIED) return B_LOGIC_ERROR;
+
+   ByteBuffer readBack;
+   MRETURN_ON_ERROR(ReadAll(reader, chunkSize, readBack));
+   if (readBack != data)
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "Read back " UINT32_FORMAT_SPEC " bytes that didn't match the " UINT32_FORMAT_SPEC " bytes written (chunkSize=" UINT32_FORMAT_SPEC ", blockSize=" UINT32_FORMAT_SPEC ")\n", readBack.GetNumBytes(), data.GetNumBytes(), chunkSize, blockSize);
+      return B_LOGIC_ERROR;
+   }
+
+   // Seeking into the middle of the file should discard the old read-ahead and start over from there
+   if (fileSize > 0)
+   {
+      const uint32 seekTo = fileSize/3;
+      MRETURN_ON_ERROR(reader.Seek(seekTo, SeekableDataIO::IO_SEEK_SET));
+      MRETURN_ON_ERROR(ReadAll(reader, chunkSize, readBack));
+      if ((readBack.GetNumBytes() != fileSize-seekTo)||(memcmp(readBack.GetBuffer(), data.GetBuffer()+seekTo, readBack.GetNumBytes()) != 0))
+      {
+         LogTime(MUSCLE_LOG_CRITICALERROR, "Read after seek to " UINT32_FORMAT_SPEC " didn't match!\n", seekTo);
+         return B_LOGIC_ERROR;
+      }
+   }
+
+   // Read/write mode:  overwrite the middle of the file, then read the whole thing back
+   {
+      AsyncFileDataIO rw(TEST_FILE_NAME, "r+b", numThreads, blockSize, numBlocks);
+      if (rw.IsFileOpen() == false) return B_IO_ERROR;
+
+      const uint32 patchOffset = fileSize/2;
+      const uint32 patchSize   = muscleMin(fileSize-patchOffset, (uint32)1000);
+      ByteBuffer patch;
+      MRETURN_ON_ERROR(patch.SetNumBytes(patchSize, false));
+      memset(patch.GetBuffer(), 'x', patchSize);
+      memcpy(data.GetBuffer()+patchOffset, patch.GetBuffer(), patchSize);
+
+      MRETURN_ON_ERROR(rw.Seek(patchOffset, SeekableDataIO::IO_SEEK_SET));
+      MRETURN_ON_ERROR(WriteAll(rw, patch, chunkSize));
+      MRETURN_ON_ERROR(rw.Seek(0, SeekableDataIO::IO_SEEK_SET));
+      MRETURN_ON_ERROR(ReadAll(rw, chunkSize, readBack));
+      if (readBack != data)
+      {
+         LogTime(MUSCLE_LOG_CRITICALERROR, "Read-after-write in r+b mode didn't match!\n");
+         return B_LOGIC_ERROR;
+      }
+   }
+   return B_NO_ERROR;
+}
+
+// Writes the same range of the file over and over, seeking back before each pass, and makes sure the last pass is what ends up on disk
+static status_t TestOverlappingWrites(uint32 numThreads)
+{
+   const uint32 batchSize = 1024;
+   const uint32 fileSize  = batchSize*4;
+   const uint32 numPasses = 50;
+
+   ByteBuffer data;
+   MRETURN_ON_ERROR(data.SetNumBytes(fileSize, false));
+   {
+      AsyncFileDataIO writer(TEST_FILE_NAME, "wb", numThreads, batchSize, 4, batchSize, fileSize*numPasses);
+      if (writer.IsFileOpen() == false) return B_IO_ERROR;
+
+      for (uint32 pass=0; pass<numPasses; pass++)
+      {
+         memset(data.GetBuffer(), 'a'+(pass%26), fileSize);
+         MRETURN_ON_ERROR(writer.Seek(0, SeekableDataIO::IO_SEEK_SET));
+
+         const io_status_t ret = writer.Write(data.GetBuffer(), data.GetNumBytes());  // the pending-bytes limit is big enough that this will never return 0
+         MRETURN_ON_ERROR(ret);
+         if (ret.GetByteCount() != fileSize) return B_LOGIC_ERROR;
+      }
+      MRETURN_ON_ERROR(writer.WaitForPendingWrites());
+   }
+
+   AsyncFileDataIO reader(TEST_FILE_NAME, "rb", numThreads);
+   ByteBuffer readBack;
+   MRETURN_ON_ERROR(ReadAll(reader, 1000, readBack));
+   if (readBack != data)
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "Overlapping writes with " UINT32_FORMAT_SPEC " threads left the wrong bytes in the file!\n", numThreads);
+      return B_LOGIC_ERROR;
+   }
+   return B_NO_ERROR;
+}
+
+// Makes sure that while Write() is refusing bytes, we don't offer an always-ready write-select-socket (which would make an event-loop spin)
+static status_t TestWriteBackpressure()
+{
+   const uint32 batchSize = 1024;
+   AsyncFileDataIO writer(TEST_FILE_NAME, "wb", 1, batchSize, 1, batchSize, batchSize*2);
+   if (writer.IsFileOpen() == false) return B_IO_ERROR;
+   if (writer.GetWriteSelectSocket()() == NULL) return B_LOGIC_ERROR;
+
+   ByteBuffer data;
+   MRETURN_ON_ERROR(data.SetNumBytes(batchSize*4, true));
+   const io_status_t ret = writer.Write(data.GetBuffer(), data.GetNumBytes());
+   MRETURN_ON_ERROR(ret);
+   if (ret.GetByteCount() != batchSize*2) return B_LOGIC_ERROR;
+   if (writer.GetWriteSelectSocket()() != NULL) return B_LOGIC_ERROR;  // we're full, so there's no point in select()-ing for ready-to-write
+
+   MRETURN_ON_ERROR(writer.WaitForPendingWrites());
+   if (writer.GetWriteSelectSocket()() == NULL) return B_LOGIC_ERROR;
+   return B_NO_ERROR;
+}
+
+// Opens more files at once than the shared I/O pool has threads, and makes sure they all still read back correctly
+static status_t TestManyOpenFiles()
+{
+   const uint32 fileSize = 100000;
+   ByteBuffer data;
+   MRETURN_ON_ERROR(data.SetNumBytes(fileSize, false));
+   for (uint32 i=0; i<fileSize; i++) data.GetBuffer()[i] = (uint8) (i%251);
+   {
+      FileDataIO fdio(muscleFopen(TEST_FILE_NAME, "wb"));
+      MRETURN_ON_ERROR(fdio.WriteFully(data.GetBuffer(), data.GetNumBytes()));
+   }
+
+   Queue<AsyncFileDataIORef> readers;
+   for (uint32 i=0; i<MUSCLE_ASYNC_FILE_IO_THREAD_POOL_SIZE*4; i++)
+   {
+      AsyncFileDataIORef reader(newnothrow AsyncFileDataIO(TEST_FILE_NAME, "rb", 2, 4096, 4));
+      MRETURN_OOM_ON_NULL(reader());
+      if (reader()->IsFileOpen() == false) return B_IO_ERROR;
+      MRETURN_ON_ERROR(readers.AddTail(reader));
+   }
+
+   for (uint32 i=0; i<readers.GetNumItems(); i++)
+   {
+      ByteBuffer readBack;
+      MRETURN_ON_ERROR(ReadAll(*readers[i](), 1000, readBack));
+      if (readBack != data)
+      {
+         LogTime(MUSCLE_LOG_CRITICALERROR, "Reader #" UINT32_FORMAT_SPEC " of " UINT32_FORMAT_SPEC " read the wrong bytes!\n", i, readers.GetNumItems());
+         return B_LOGIC_ERROR;
+      }
+   }
+   return B_NO_ERROR;
+}
+
+static void BenchmarkRead(uint32 fileSize)
+{
+   ByteBuffer data;
+   if (data.SetNumBytes(fileSize, false).IsError()) return;
+   memset(data.GetBuffer(), 'b', fileSize);
+   {
+      FileDataIO fdio(muscleFopen(TEST_FILE_NAME, "wb"));
+      if (fdio.WriteFully(data.GetBuffer(), data.GetNumBytes()).IsError()) return;
+   }
+
+   ByteBuffer chunk;
+   if (chunk.SetNumBytes(16*1024, false).IsError()) return;
+   for (uint32 pass=0; pass<2; pass++)
+   {
+      uint64 numRead = 0;
+      const uint64 startTime = GetRunTime64();
+      if (pass == 0)
+      {
+         FileDataIO fdio(muscleFopen(TEST_FILE_NAME, "rb"));
+         io_status_t ret;
+         while((ret = fdio.Read(chunk.GetBuffer(), chunk.GetNumBytes())).GetByteCount() > 0) numRead += ret.GetByteCount();
+      }
+      else
+      {
+         AsyncFileDataIO afdio(TEST_FILE_NAME, "rb");
+         while(true)
+         {
+            const io_status_t ret = afdio.Read(chunk.GetBuffer(), chunk.GetNumBytes());
+            if (ret.IsError()) break;
+            if (ret.GetByteCount() > 0) numRead += ret.GetByteCount();
+                                   else WaitForIO(afdio);
+         }
+      }
+      const uint64 elapsed = muscleMax(GetRunTime64()-startTime, (uint64)1);
+      printf("   %s:  read " UINT64_FORMAT_SPEC " bytes at %.1f MB/sec\n", (pass==0)?"     FileDataIO":"AsyncFileDataIO", numRead, ((double)numRead)/elapsed);
+   }
+}
+
+// This program tests the AsyncFileDataIO class, and benchmarks it against FileDataIO if run interactively
+int main(int argc, char ** argv)
+{
+   CompleteSetupSystem css;
+
+   Message args; (void) ParseArgs(argc, argv, args);
+   const bool isFromScript = args.HasName("fromscript");
+
+   const uint32 fileSizes[]  = {0, 1, 4095, 4096, 4097, 100000, 1000000};
+   const uint32 chunkSizes[] = {1000, 65536};
+   for (uint32 i=0; i<ARRAYITEMS(fileSizes); i++)
+   {
+      for (uint32 j=0; j<ARRAYITEMS(chunkSizes); j++)
+      {
+         status_t ret;
+         if ((TestAsyncFileDataIO(fileSizes[i], chunkSizes[j], 1, 4096,  1).IsError(ret))||
+             (TestAsyncFileDataIO(fileSizes[i], chunkSizes[j], 3, 4096,  8).IsError(ret))||
+             (TestAsyncFileDataIO(fileSizes[i], chunkSizes[j], 2, 65536, 4).IsError(ret)))
+         {
+            LogTime(MUSCLE_LOG_CRITICALERROR, "AsyncFileDataIO test failed for fileSize=" UINT32_FORMAT_SPEC " chunkSize=" UINT32_FORMAT_SPEC " [%s]\n", fileSizes[i], chunkSizes[j], ret());
+            (void) remove(TEST_FILE_NAME);
+            return 10;
+         }
+      }
+   }
+
+   status_t ret;
+   if ((TestOverlappingWrites(1).IsError(ret))||(TestOverlappingWrites(4).IsError(ret))||(TestWriteBackpressure().IsError(ret)))
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "AsyncFileDataIO write-ordering test failed [%s]\n", ret());
+      (void) remove(TEST_FILE_NAME);
+      return 10;
+   }
+   if (TestManyOpenFiles().IsError(ret))
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "AsyncFileDataIO many-open-files test failed [%s]\n", ret());
+      (void) remove(TEST_FILE_NAME);
+      return 10;
+   }
+   printf("AsyncFileDataIO tests passed.\n");
+
+   if (isFromScript == false)
+   {
+      printf("Benchmarking sequential reads:\n");
+      BenchmarkRead(256*1024*1024);
+   }
+
+   (void) remove(TEST_FILE_NAME);
+   return 0;
+}
@@ -4,6 +4,7 @@
 
 #include "dataio/FileDataIO.h"
 #include "system/SetupSystem.h"
+#include "test/TestMacros.h"
 #include "util/MiscUtilityFunctions.h"
 #include "util/ByteBuffer.h"
 
@@ -142,12 +143,127 @@ template<class EndianConverter> status_t TestHelpers()
    return unflat.GetStatus();
 }
 
+static status_t TestSizeClasses()
+{
+   TEST(SizeClassMemoryAllocationStrategy::GetSizeClassBytes(0)     == 0);
+   TEST(SizeClassMemoryAllocationStrategy::GetSizeClassBytes(1)     == 64);
+   TEST(SizeClassMemoryAllocationStrategy::GetSizeClassBytes(64)    == 64);
+   TEST(SizeClassMemoryAllocationStrategy::GetSizeClassBytes(65)    == 80);
+   TEST(SizeClassMemoryAllocationStrategy::GetSizeClassBytes(129)   == 160);
+   TEST(SizeClassMemoryAllocationStrategy::GetSizeClassBytes(1000)  == 1024);
+   TEST(SizeClassMemoryAllocationStrategy::GetSizeClassBytes(1025)  == 1280);
+   TEST(SizeClassMemoryAllocationStrategy::GetSizeClassBytes(65536) == 65536);
+   TEST(SizeClassMemoryAllocationStrategy::GetSizeClassBytes(65537) == 0);
+
+   // Every size should round up to the smallest class that can hold it, and classes should be at most 25% bigger than the sizes they hold
+   uint32 prevClassBytes = 64;
+   for (uint32 i=1; i<=65536; i++)
+   {
+      const uint32 classBytes = SizeClassMemoryAllocationStrategy::GetSizeClassBytes(i);
+      TEST(classBytes >= i);
+      TEST(SizeClassMemoryAllocationStrategy::GetSizeClassBytes(classBytes) == classBytes);
+      TEST((classBytes == prevClassBytes)||(i == prevClassBytes+1));
+      TEST((i <= 64)||(classBytes <= i+(i/4)+1));
+      prevClassBytes = classBytes;
+   }
+
+   SizeClassMemoryAllocationStrategy * scmas = GetSizeClassMemoryAllocationStrategy();
+
+   // Pooled ByteBuffers should use the size-class strategy, and re-use a freed block of the same class
+   {
+      ByteBufferRef a = GetByteBufferFromPool(1000);
+      MRETURN_OOM_ON_NULL(a());
+#ifndef MUSCLE_AVOID_BYTEBUFFER_SIZE_CLASSES
+      TEST(a()->GetMemoryAllocationStrategy() == scmas);
+#endif
+      const uint8 * oldBuf = a()->GetBuffer();
+      a.Reset();
+
+      ByteBufferRef b = GetByteBufferFromPool(900);
+      MRETURN_OOM_ON_NULL(b());
+#ifndef MUSCLE_AVOID_BYTEBUFFER_SIZE_CLASSES
+      TEST(b()->GetBuffer() == oldBuf);
+#endif
+
+      // Growing within the same size-class shouldn't move our bytes; growing past it should move them but keep them intact
+      for (uint32 i=0; i<b()->GetNumBytes(); i++) b()->GetBuffer()[i] = (uint8) i;
+      const uint8 * bBuf = b()->GetBuffer();
+      MRETURN_ON_ERROR(b()->SetNumBytes(1024, true));
+      TEST(b()->GetBuffer() == bBuf);
+      MRETURN_ON_ERROR(b()->SetNumBytes(20000, true));
+      for (uint32 i=0; i<900; i++) TEST(b()->GetBuffer()[i] == (uint8) i);
+      MRETURN_ON_ERROR(b()->SetNumBytes(200000, true));  // larger than the largest size-class
+      MRETURN_ON_ERROR(b()->SetNumBytes(300000, true));
+      for (uint32 i=0; i<900; i++) TEST(b()->GetBuffer()[i] == (uint8) i);
+      b()->TruncateToLength(100);
+      MRETURN_ON_ERROR(b()->FreeExtraBytes());
+      for (uint32 i=0; i<100; i++) TEST(b()->GetBuffer()[i] == (uint8) i);
+
+      // A released buffer must be freeable with muscleFree()
+      muscleFree(b()->ReleaseBuffer());
+
+      // An adopted buffer must not be handed to the size-classes when it is freed
+      uint8 * adoptMe = (uint8 *) muscleAlloc(100);
+      MRETURN_OOM_ON_NULL(adoptMe);
+      b()->AdoptBuffer(100, adoptMe);
+      TEST(b()->GetMemoryAllocationStrategy() == NULL);
+   }
+
+   (void) scmas->FlushCachedObjects();
+   TEST(SizeClassMemoryAllocationStrategy::GetNumCachedBytes() == 0);
+
+#ifndef MUSCLE_AVOID_BYTEBUFFER_SIZE_CLASSES
+   // A plain ObjectPool recycles a ByteBuffer by assignment, which keeps a tiny array allocated.  That array
+   // came from muscleAlloc(), so GetByteBufferFromPool() must not let the size-class strategy free it later.
+   {
+      ObjectPool<ByteBuffer> pool;
+      const uint8 * tinyBuf;
+      {
+         ByteBufferRef a(pool.ObtainObject());
+         MRETURN_OOM_ON_NULL(a());
+         TEST(a()->GetMemoryAllocationStrategy() == NULL);
+         MRETURN_ON_ERROR(a()->SetBuffer(1));
+         tinyBuf = a()->GetBuffer();
+      }
+
+      ByteBufferRef b = GetByteBufferFromPool(pool, 1);
+      MRETURN_OOM_ON_NULL(b());
+      TEST(b()->GetMemoryAllocationStrategy() == scmas);
+      TEST(b()->GetBuffer() != tinyBuf);
+   }
+   (void) scmas->FlushCachedObjects();
+#endif
+   return B_NO_ERROR;
+}
+
+// Allocates and frees ByteBuffers of various sizes between 1KB and 64KB (as a gateway's receive-buffers might be)
+static void BenchmarkAllocations(IMemoryAllocationStrategy * optStrategy)
+{
+   const uint32 numIterations = 2000000;
+   ByteBuffer bufs[64];
+   for (uint32 i=0; i<ARRAYITEMS(bufs); i++) bufs[i].SetMemoryAllocationStrategy(optStrategy);
+
+   uint32 x = 12345;
+   const uint64 startTime = GetRunTime64();
+   for (uint32 i=0; i<numIterations; i++)
+   {
+      x = (x*1103515245)+12345;
+      ByteBuffer & bb = bufs[(x>>8)%ARRAYITEMS(bufs)];
+      bb.Clear(true);
+      if (bb.SetNumBytes(1024+((x>>12)%(63*1024)), false).IsError()) {MWARN_OUT_OF_MEMORY; return;}
+      bb.GetBuffer()[0] = (uint8) i;
+   }
+   const uint64 elapsed = GetRunTime64()-startTime;
+   printf("%s:  " UINT32_FORMAT_SPEC " allocate/free cycles took %s (%.1f nanoseconds each)\n", optStrategy?"SizeClassMemoryAllocationStrategy":"   muscleAlloc()/muscleFree()", numIterations, GetHumanReadableUnsignedTimeIntervalString(elapsed)(), (1000.0*elapsed)/numIterations);
+}
+
 // This program exercises the ByteBuffer class.
 int main(int argc, char ** argv)
 {
    CompleteSetupSystem css;
 
-   if ((argc > 1)&&(strcmp(argv[1], "fromscript") != 0))
+   const bool doBenchmark = ((argc == 1)||((argc > 1)&&(strcmp(argv[1], "benchmark") == 0)));
+   if ((argc > 1)&&(strcmp(argv[1], "fromscript") != 0)&&(strcmp(argv[1], "benchmark") != 0))
    {
       const char * fileName = argv[1];
       FILE * f = muscleFopen(fileName, "rb");
@@ -171,6 +287,19 @@ int main(int argc, char ** argv)
    {
       status_t ret;
 
+      if (TestSizeClasses().IsError(ret))
+      {
+         LogTime(MUSCLE_LOG_CRITICALERROR, "TestSizeClasses() failed [%s]\n", ret());
+         return 10;
+      }
+      printf("Size-class allocation tests passed.\n");
+
+      if (doBenchmark)
+      {
+         BenchmarkAllocations(NULL);
+         BenchmarkAllocations(GetSizeClassMemoryAllocationStrategy());
+      }
+
       printf("\n\nTesting ByteBufferHelpers with LittleEndianConverter:\n");
       ret = TestHelpers<LittleEndianConverter>();
       if (ret.IsError()) LogTime(MUSCLE_LOG_CRITICALERROR, "TestHelpers<LittleEndianConverter> failed [%s]\n", ret());
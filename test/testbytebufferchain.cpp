@@ -0,0 +1,204 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#include <stdio.h>
+
+#include "dataio/ByteBufferChainDataIO.h"
+#include "system/SetupSystem.h"
+#include "util/ByteBufferChain.h"
+#include "util/MiscUtilityFunctions.h"
+#include "util/NetworkUtilityFunctions.h"
+
+using namespace muscle;
+
+static ByteBufferRef MakeBuffer(uint32 numBytes, uint8 firstByte)
+{
+   ByteBufferRef ret = GetByteBufferFromPool(numBytes);
+   if (ret()) for (uint32 i=0; i<numBytes; i++) ret()->GetBuffer()[i] = (uint8)(firstByte+i);
+   return ret;
+}
+
+// Returns an error if (chain)'s contents don't match (expected), byte-for-byte
+static status_t CheckChain(const char * desc, const ByteBufferChain & chain, const ByteBuffer & expected)
+{
+   ConstByteBufferRef flat = chain.GetFlattenedBuffer();
+   MRETURN_OOM_ON_NULL(flat());
+   if ((*flat() != expected)||(chain.GetNumBytes() != expected.GetNumBytes()))
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "%s:  chain contents (" UINT32_FORMAT_SPEC " bytes in " UINT32_FORMAT_SPEC " slices) didn't match the expected " UINT32_FORMAT_SPEC " bytes!\n", desc, chain.GetNumBytes(), chain.GetNumSlices(), expected.GetNumBytes());
+      return B_LOGIC_ERROR;
+   }
+   return B_NO_ERROR;
+}
+
+static status_t TestChainOperations()
+{
+   ByteBufferRef header  = MakeBuffer(10,   0);
+   ByteBufferRef payload = MakeBuffer(1000, 10);
+   ByteBufferRef trailer = MakeBuffer(5,    200);
+   MRETURN_OOM_ON_NULL(header());
+   MRETURN_OOM_ON_NULL(payload());
+   MRETURN_OOM_ON_NULL(trailer());
+
+   ByteBuffer expected;
+   MRETURN_ON_ERROR(expected.AppendBytes(header()->GetBuffer(),  header()->GetNumBytes()));
+   MRETURN_ON_ERROR(expected.AppendBytes(payload()->GetBuffer(), payload()->GetNumBytes()));
+   MRETURN_ON_ERROR(expected.AppendBytes(trailer()->GetBuffer(), trailer()->GetNumBytes()));
+
+   // Prepending a header and appending a trailer should not copy any bytes
+   ByteBufferChain chain(payload);
+   if (chain.GetFlattenedBuffer()() != payload()) return B_LOGIC_ERROR;  // single whole-buffer slice should be returned as-is
+   MRETURN_ON_ERROR(chain.PrependBuffer(header));
+   MRETURN_ON_ERROR(chain.AppendBuffer(trailer));
+   if ((chain.GetNumSlices() != 3)||(chain.GetSliceAt(1).GetBytes() != payload()->GetBuffer())) return B_LOGIC_ERROR;
+   MRETURN_ON_ERROR(CheckChain("prepend/append", chain, expected));
+
+   // Sub-chains at every possible offset and a few different lengths
+   const uint32 lengths[] = {0, 1, 9, 10, 11, 500, 1014, 1015, MUSCLE_NO_LIMIT};
+   for (uint32 offset=0; offset<=expected.GetNumBytes(); offset++)
+   {
+      for (uint32 i=0; i<ARRAYITEMS(lengths); i++)
+      {
+         ByteBufferChain sub;
+         MRETURN_ON_ERROR(chain.GetSubChain(offset, lengths[i], sub));
+
+         const uint32 expectedLength = muscleMin(lengths[i], expected.GetNumBytes()-offset);
+         ByteBuffer expectedSub(expectedLength, expected.GetBuffer()+offset);
+         MRETURN_ON_ERROR(CheckChain("GetSubChain", sub, expectedSub));
+
+         uint8 copyBuf[1100];
+         if ((chain.CopyBytes(offset, copyBuf, expectedLength) != expectedLength)||(memcmp(copyBuf, expectedSub.GetBuffer(), expectedLength) != 0)) return B_LOGIC_ERROR;
+      }
+   }
+
+   // Splitting and then rejoining should give us back the original bytes; rejoining adjacent slices should merge them again
+   for (uint32 offset=0; offset<=expected.GetNumBytes(); offset += 7)
+   {
+      ByteBufferChain head(chain), tail;
+      MRETURN_ON_ERROR(head.SplitAt(offset, tail));
+      if ((head.GetNumBytes() != offset)||(tail.GetNumBytes() != expected.GetNumBytes()-offset)) return B_LOGIC_ERROR;
+      MRETURN_ON_ERROR(head.AppendChain(tail));
+      MRETURN_ON_ERROR(CheckChain("SplitAt/AppendChain", head, expected));
+      if (head.GetNumSlices() != 3) return B_LOGIC_ERROR;
+   }
+
+   // Removing bytes from either end
+   {
+      ByteBufferChain c(chain);
+      if (c.RemoveHeadBytes(15) != 15) return B_LOGIC_ERROR;
+      if (c.RemoveTailBytes(7)  != 7)  return B_LOGIC_ERROR;
+      ByteBuffer e(expected.GetNumBytes()-22, expected.GetBuffer()+15);
+      MRETURN_ON_ERROR(CheckChain("RemoveHead/TailBytes", c, e));
+      if ((c.GetNumSlices() != 1)||(c.RemoveHeadBytes(MUSCLE_NO_LIMIT) != e.GetNumBytes())||(c.HasBytes())||(c.GetNumSlices() != 0)) return B_LOGIC_ERROR;
+   }
+
+   // Appending or prepending a chain to itself
+   {
+      ByteBufferChain c(chain);
+      MRETURN_ON_ERROR(c.AppendChain(c));
+      MRETURN_ON_ERROR(c.PrependChain(c));
+      ByteBuffer e;
+      for (uint32 i=0; i<4; i++) MRETURN_ON_ERROR(e.AppendBytes(expected.GetBuffer(), expected.GetNumBytes()));
+      MRETURN_ON_ERROR(CheckChain("self-append", c, e));
+   }
+
+   // Chains with identical contents but different slice-boundaries should compare equal
+   {
+      ByteBufferChain c;
+      for (uint32 i=0; i<expected.GetNumBytes(); i+=3) MRETURN_ON_ERROR(c.AppendBytes(expected.GetBuffer()+i, muscleMin((uint32)3, expected.GetNumBytes()-i)));
+      if (c != chain) return B_LOGIC_ERROR;
+      (void) c.RemoveTailBytes(1);
+      if (c == chain) return B_LOGIC_ERROR;
+   }
+   return B_NO_ERROR;
+}
+
+static status_t TestDataIOAndVectoredWrite()
+{
+   // ByteBufferChainDataIO should behave like a FIFO
+   ByteBufferChainDataIO dio(true);
+   const char * words[] = {"Hello", ", ", "vectored ", "world"};
+   for (uint32 i=0; i<ARRAYITEMS(words); i++) MRETURN_ON_ERROR(dio.WriteFully(words[i], (uint32)strlen(words[i])));
+
+   char readBuf[64];
+   MRETURN_ON_ERROR(dio.ReadFully(readBuf, 7));
+   if (memcmp(readBuf, "Hello, ", 7) != 0) return B_LOGIC_ERROR;
+
+   // Send the rest of the chain through a socket in one writev() and make sure it arrives intact
+   ConstSocketRef s1, s2;
+   MRETURN_ON_ERROR(CreateConnectedSocketPair(s1, s2, true));
+
+   const uint32 numToSend = dio.GetChain().GetNumBytes();
+   const io_status_t sent = dio.GetChain().WriteVectored(s1, true);
+   MRETURN_ON_ERROR(sent);
+   if ((sent.GetByteCount() != (int32)numToSend)||(dio.GetChain().HasBytes())) return B_LOGIC_ERROR;
+
+   uint32 numReceived = 0;
+   while(numReceived < numToSend)
+   {
+      const io_status_t r = ReceiveData(s2, readBuf+numReceived, sizeof(readBuf)-numReceived, true);
+      MRETURN_ON_ERROR(r);
+      numReceived += r.GetByteCount();
+   }
+   if (memcmp(readBuf, "vectored world", numToSend) != 0) return B_LOGIC_ERROR;
+
+   return (dio.Read(readBuf, 1).GetStatus() == B_END_OF_STREAM) ? B_NO_ERROR : B_LOGIC_ERROR;
+}
+
+// Compares the cost of prepending a small header to a payload by copying vs by chaining
+static void BenchmarkPrepend(uint32 payloadSize, uint32 numIterations)
+{
+   ByteBufferRef header  = MakeBuffer(16, 0);
+   ByteBufferRef payload = MakeBuffer(payloadSize, 0);
+   if ((header() == NULL)||(payload() == NULL)) return;
+
+   for (uint32 pass=0; pass<2; pass++)
+   {
+      uint64 checksum = 0;
+      const uint64 startTime = GetRunTime64();
+      for (uint32 i=0; i<numIterations; i++)
+      {
+         if (pass == 0)
+         {
+            ByteBufferRef combined = GetByteBufferFromPool(header()->GetNumBytes()+payloadSize);
+            if (combined() == NULL) return;
+            memcpy(combined()->GetBuffer(), header()->GetBuffer(), header()->GetNumBytes());
+            memcpy(combined()->GetBuffer()+header()->GetNumBytes(), payload()->GetBuffer(), payloadSize);
+            checksum += combined()->GetNumBytes();
+         }
+         else
+         {
+            ByteBufferChain chain(payload);
+            if (chain.PrependBuffer(header).IsError()) return;
+            checksum += chain.GetNumBytes();
+         }
+      }
+      const uint64 elapsed = muscleMax(GetRunTime64()-startTime, (uint64)1);
+      printf("   %s:  " UINT32_FORMAT_SPEC " prepends to a " UINT32_FORMAT_SPEC "-byte payload took " UINT64_FORMAT_SPEC " microseconds (%.3f us each, checksum=" UINT64_FORMAT_SPEC ")\n", (pass==0)?"     copy":"    chain", numIterations, payloadSize, elapsed, ((double)elapsed)/numIterations, checksum);
+   }
+}
+
+// This program tests the ByteBufferChain and ByteBufferChainDataIO classes, and benchmarks them if run interactively
+int main(int argc, char ** argv)
+{
+   CompleteSetupSystem css;
+
+   Message args; (void) ParseArgs(argc, argv, args);
+   const bool isFromScript = args.HasName("fromscript");
+
+   status_t ret;
+   if ((TestChainOperations().IsError(ret))||(TestDataIOAndVectoredWrite().IsError(ret)))
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "ByteBufferChain test failed [%s]\n", ret());
+      return 10;
+   }
+   printf("ByteBufferChain tests passed.\n");
+
+   if (isFromScript == false)
+   {
+      printf("Benchmarking header-prepends:\n");
+      BenchmarkPrepend(1024,       100000);
+      BenchmarkPrepend(64*1024,    10000);
+      BenchmarkPrepend(1024*1024,  1000);
+   }
+   return 0;
+}
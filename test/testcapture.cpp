@@ -0,0 +1,123 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#include <stdio.h>
+
+#include "dataio/FileDataIO.h"
+#include "iogateway/CaptureIOGateway.h"
+#include "iogateway/MessageIOGateway.h"
+#include "system/SetupSystem.h"
+#include "test/TestMacros.h"
+
+using namespace muscle;
+
+static const uint32 NUM_TEST_MESSAGES = 100;
+static const uint32 WRITER_SESSION_ID = 5;
+static const uint32 READER_SESSION_ID = 6;
+
+static MessageRef GetTestMessage(uint32 idx)
+{
+   MessageRef m = GetMessageFromPool(MakeWhatCode("TeSt"));
+   if ((m() == NULL)||(m()->AddInt32("idx", idx).IsError())||(m()->AddString("str", String("Message #%1").Arg(idx)).IsError())) return MessageRef();
+   return m;
+}
+
+// Sends our test Messages through one CaptureIOGateway into a file, then reads them back in through another one
+static status_t CaptureTestMessages(const MessageCaptureWriterRef & writer, const char * dataFileName)
+{
+   {
+      FILE * f = muscleFopen(dataFileName, "wb");
+      if (f == NULL) return B_ERRNO;
+
+      CaptureIOGateway g(AbstractMessageIOGatewayRef(newnothrow MessageIOGateway), writer, WRITER_SESSION_ID);
+      g.SetDataIO(DataIORef(newnothrow FileDataIO(f)));
+      for (uint32 i=0; i<NUM_TEST_MESSAGES; i++)
+      {
+         MessageRef m = GetTestMessage(i);
+         MRETURN_ON_ERROR(m);
+         MRETURN_ON_ERROR(g.AddOutgoingMessage(m));
+      }
+      TEST(g.GetOutgoingMessageQueue().GetNumItems() == NUM_TEST_MESSAGES);  // nothing gets captured until it goes out
+      TEST(writer()->GetNumRecordsWritten() == 0);
+      while(g.HasBytesToOutput()) MRETURN_ON_ERROR(g.DoOutput());
+   }
+
+   FILE * in = muscleFopen(dataFileName, "rb");
+   if (in == NULL) return B_ERRNO;
+
+   QueueGatewayMessageReceiver inQueue;
+   CaptureIOGateway g(AbstractMessageIOGatewayRef(newnothrow MessageIOGateway), writer, READER_SESSION_ID);
+   g.SetDataIO(DataIORef(newnothrow FileDataIO(in)));
+   while(g.DoInput(inQueue).GetByteCount() > 0) {/* empty */}
+
+   TEST(inQueue.GetMessages().GetNumItems() == NUM_TEST_MESSAGES);
+   for (uint32 i=0; i<NUM_TEST_MESSAGES; i++) TEST(inQueue.GetMessages()[i]()->GetInt32("idx", -1) == (int32)i);
+   return B_NO_ERROR;
+}
+
+// Makes sure the capture file holds every Message, in order, with the right session IDs and directions
+static status_t VerifyCaptureFile(const char * captureFileName)
+{
+   MessageCaptureReader reader;
+   MRETURN_ON_ERROR(reader.Open(captureFileName));
+   TEST(reader.GetCaptureStartTime() > 0);
+
+   uint64 lastTimeStamp = 0;
+   for (uint32 i=0; i<2*NUM_TEST_MESSAGES; i++)
+   {
+      uint64 timeStamp;
+      uint32 sessionID, direction;
+      MessageRef msg;
+      MRETURN_ON_ERROR(reader.ReadNextMessage(timeStamp, sessionID, direction, msg));
+
+      const bool isOutgoing = (i < NUM_TEST_MESSAGES);
+      const uint32 idx      = i%NUM_TEST_MESSAGES;
+      TEST(timeStamp >= lastTimeStamp);
+      TEST(sessionID == (isOutgoing ? WRITER_SESSION_ID : READER_SESSION_ID));
+      TEST(direction == (uint32)(isOutgoing ? MESSAGE_CAPTURE_DIRECTION_OUTGOING : MESSAGE_CAPTURE_DIRECTION_INCOMING));
+
+      MessageRef expected = GetTestMessage(idx);
+      MRETURN_ON_ERROR(expected);
+      TEST(*msg() == *expected());
+      lastTimeStamp = timeStamp;
+   }
+
+   uint64 timeStamp;
+   uint32 sessionID, direction;
+   MessageRef msg;
+   TEST(reader.ReadNextMessage(timeStamp, sessionID, direction, msg) == B_DATA_NOT_FOUND);
+   return B_NO_ERROR;
+}
+
+// This program tests the CaptureIOGateway class, and the MessageCaptureWriter and MessageCaptureReader classes it uses
+int main(int, char **)
+{
+   CompleteSetupSystem css;
+
+   const char * captureFileName = "testcapture.mcap";
+   const char * dataFileName    = "testcapture.dat";
+
+   MessageCaptureWriterRef writer(newnothrow MessageCaptureWriter);
+   status_t ret;
+   if ((writer.GetStatus().IsError(ret))||(writer()->Open(captureFileName).IsError(ret))||(CaptureTestMessages(writer, dataFileName).IsError(ret)))
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "Capturing test Messages failed [%s]\n", ret());
+      return 10;
+   }
+   if (writer()->GetNumRecordsWritten() != 2*NUM_TEST_MESSAGES)
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "Expected " UINT32_FORMAT_SPEC " capture records, but " UINT64_FORMAT_SPEC " were written!\n", 2*NUM_TEST_MESSAGES, writer()->GetNumRecordsWritten());
+      return 10;
+   }
+   writer()->Close();
+
+   if (VerifyCaptureFile(captureFileName).IsError(ret))
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "Verifying capture file failed [%s]\n", ret());
+      return 10;
+   }
+
+   (void) remove(captureFileName);
+   (void) remove(dataFileName);
+   printf("CaptureIOGateway tests passed.\n");
+   return 0;
+}
@@ -0,0 +1,433 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#include <stdio.h>
+
+#include "reflector/StorageReflectSession.h"
+#include "system/SetupSystem.h"
+#include "system/ThreadPool.h"
+#include "test/TestMacros.h"
+#include "util/MiscUtilityFunctions.h"
+
+using namespace muscle;
+
+// Just so we can get at StorageReflectSession::GetNewDataNode()
+class TestStorageReflectSession : public StorageReflectSession
+{
+public:
+   static DataNodeRef NewNode(const String & name) {return GetNewDataNode(name, ConstMessageRef());}
+
+   status_t SaveTree(Message & msg, const DataNode & node, bool saveData) const {return SaveNodeTreeToMessage(msg, &node, GetEmptyString(), saveData);}
+};
+
+static String GetChildName(uint32 i) {return String("child%1").Arg(i);}
+
+// Makes sure (node) has children named child0 through child(numChildren-1), in that order
+static status_t CheckChildren(const DataNode & node, uint32 numChildren)
+{
+   TEST(node.GetNumChildren() == numChildren);
+   TEST(node.HasChildren() == (numChildren > 0));
+
+   uint32 count = 0;
+   for (DataNodeRefIterator iter = node.GetChildIterator(); iter.HasData(); iter++)
+   {
+      const String expectedName = GetChildName(count++);
+      TEST(*iter.GetKey() == expectedName);
+      TEST(iter.GetValue()()->GetNodeName() == expectedName);
+      TEST(iter.GetValue()()->GetParent() == &node);
+      TEST(node.GetChild(expectedName)() == iter.GetValue()());
+   }
+   TEST(count == numChildren);
+
+   // and backwards too
+   for (DataNodeRefIterator iter = node.GetChildIterator(HTIT_FLAG_BACKWARDS); iter.HasData(); iter++) TEST(*iter.GetKey() == GetChildName(--count));
+   TEST(count == 0);
+
+   TEST(node.HasChild("nonexistent") == false);
+   TEST(node.GetChild("nonexistent")() == NULL);
+   return B_NO_ERROR;
+}
+
+// Adds children one at a time, so that the node has to switch from its small-array to a Hashtable part way through
+static status_t TestAddAndRemove()
+{
+   const uint32 numChildren = (MUSCLE_DATANODE_MAX_INLINE_CHILDREN*2)+3;
+
+   DataNodeRef parent = TestStorageReflectSession::NewNode("parent");
+   MRETURN_ON_ERROR(parent);
+   MRETURN_ON_ERROR(CheckChildren(*parent(), 0));
+
+   const uint32 leafSize = parent()->GetTotalDataSize();
+   for (uint32 i=0; i<numChildren; i++)
+   {
+      DataNodeRef child = TestStorageReflectSession::NewNode(GetChildName(i));
+      MRETURN_ON_ERROR(child);
+      MRETURN_ON_ERROR(parent()->PutChild(child, NULL, NULL));
+      MRETURN_ON_ERROR(CheckChildren(*parent(), i+1));
+      TEST(child()->GetDepth() == 1);
+      TEST(parent()->GetTotalDataSize() > leafSize);
+   }
+
+   // Replacing a child with a same-named one shouldn't change the number of children, or their order
+   {
+      DataNodeRef replacement = TestStorageReflectSession::NewNode(GetChildName(1));
+      MRETURN_ON_ERROR(replacement);
+      MRETURN_ON_ERROR(parent()->PutChild(replacement, NULL, NULL));
+      TEST(parent()->GetChild(GetChildName(1))() == replacement());
+      MRETURN_ON_ERROR(CheckChildren(*parent(), numChildren));
+   }
+
+   // Removing children from the end should leave the remaining ones in order
+   for (uint32 i=numChildren; i>0; i--)
+   {
+      MRETURN_ON_ERROR(parent()->RemoveChild(GetChildName(i-1), NULL, false, NULL));
+      MRETURN_ON_ERROR(CheckChildren(*parent(), i-1));
+   }
+   TEST(parent()->RemoveChild(GetChildName(0), NULL, false, NULL) == B_DATA_NOT_FOUND);
+   return B_NO_ERROR;
+}
+
+// Makes sure removing a child from the middle of the small-array keeps the others in order
+static status_t TestRemoveFromMiddle()
+{
+   DataNodeRef parent = TestStorageReflectSession::NewNode("parent");
+   MRETURN_ON_ERROR(parent);
+
+   const uint32 numChildren = muscleMax((uint32)MUSCLE_DATANODE_MAX_INLINE_CHILDREN, (uint32)3);
+   for (uint32 i=0; i<numChildren; i++) MRETURN_ON_ERROR(parent()->PutChild(TestStorageReflectSession::NewNode(GetChildName(i)), NULL, NULL));
+
+   MRETURN_ON_ERROR(parent()->RemoveChild(GetChildName(1), NULL, false, NULL));
+   TEST(parent()->GetNumChildren() == numChildren-1);
+   TEST(parent()->HasChild(GetChildName(1)) == false);
+
+   uint32 expected = 0;
+   for (DataNodeRefIterator iter = parent()->GetChildIterator(); iter.HasData(); iter++)
+   {
+      if (expected == 1) expected++;
+      TEST(*iter.GetKey() == GetChildName(expected++));
+   }
+   TEST(expected == numChildren);
+   return B_NO_ERROR;
+}
+
+// Builds a small tree and removes it recursively
+static status_t TestRecursiveRemove()
+{
+   DataNodeRef root = TestStorageReflectSession::NewNode("root");
+   MRETURN_ON_ERROR(root);
+
+   uint32 nodeCount = 1;
+   DataNodeRef top = TestStorageReflectSession::NewNode("top");
+   MRETURN_ON_ERROR(root()->PutChild(top, NULL, NULL));
+   for (uint32 i=0; i<20; i++)
+   {
+      DataNodeRef child = TestStorageReflectSession::NewNode(GetChildName(i));
+      MRETURN_ON_ERROR(top()->PutChild(child, NULL, NULL));
+      nodeCount++;
+      for (uint32 j=0; j<i%4; j++)
+      {
+         MRETURN_ON_ERROR(child()->PutChild(TestStorageReflectSession::NewNode(GetChildName(j)), NULL, NULL));
+         nodeCount++;
+      }
+   }
+   TEST(root()->FindFirstMatchingNode("top/child3/child2") != NULL);
+   TEST(root()->FindFirstMatchingNode("top/child*/child2") != NULL);
+   TEST(root()->GetDescendant("top/child7/child1")() != NULL);
+   TEST(root()->GetDescendant("top/child4/child1")() == NULL);
+
+   MRETURN_ON_ERROR(root()->RemoveChild("top", NULL, true, &nodeCount));
+   TEST(nodeCount == 0);
+   TEST(top()->HasChildren() == false);
+   TEST(top()->GetParent() == NULL);
+   TEST(root()->HasChildren() == false);
+   return B_NO_ERROR;
+}
+
+static ConstMessageRef GetPayload(uint32 val)
+{
+   MessageRef msg = GetMessageFromPool(val);
+   if ((msg())&&(msg()->AddInt32("val", val).IsError())) msg.Reset();
+   return AddConstToRef(msg);
+}
+
+// Builds a tree of nodes named child0, child1, etc, (fanOut) nodes wide and (depth) levels deep under (parent)
+static status_t BuildTree(DataNode & parent, uint32 fanOut, uint32 depth)
+{
+   for (uint32 i=0; i<fanOut; i++)
+   {
+      DataNodeRef child = TestStorageReflectSession::NewNode(GetChildName(i));
+      MRETURN_ON_ERROR(child);
+      child()->SetData(GetPayload(i), NULL);
+      MRETURN_ON_ERROR(parent.PutChild(child, NULL, NULL));
+      if (depth > 1) MRETURN_ON_ERROR(BuildTree(*child(), fanOut, depth-1));
+   }
+   return B_NO_ERROR;
+}
+
+// Makes sure snapshots are re-used until something changes, and that a change only re-copies the nodes above it
+static status_t TestSnapshotSharing()
+{
+   DataNodeRef root = TestStorageReflectSession::NewNode("root");
+   MRETURN_ON_ERROR(root);
+   MRETURN_ON_ERROR(BuildTree(*root(), MUSCLE_DATANODE_MAX_INLINE_CHILDREN+2, 3));  // wide enough that the nodes use their child-Hashtables
+
+   ConstDataNodeSnapshotRef snap1 = root()->GetSnapshot();
+   MRETURN_ON_ERROR(snap1);
+   TEST(root()->GetSnapshot()() == snap1());  // nothing changed, so we should get the same snapshot back
+   TEST(snap1()->GetNumChildren() == root()->GetNumChildren());
+   TEST(snap1()->CalculateChecksum() == root()->CalculateChecksum());
+
+   const uint32 oldChecksum = root()->CalculateChecksum();
+   ConstDataNodeSnapshotRef oldChild0 = snap1()->GetChild(GetChildName(0));
+   ConstDataNodeSnapshotRef oldChild1 = snap1()->GetChild(GetChildName(1));
+   TEST(oldChild0() != NULL);
+   TEST(oldChild1() != NULL);
+   TEST(snap1()->GetChild("nonexistent")() == NULL);
+   TEST(snap1()->GetDescendant("child1/child2/child3")() != NULL);
+   TEST(snap1()->GetDescendant("child1/nonexistent/child3")() == NULL);
+
+   // Change a grandchild of child1
+   DataNode * grandChild = root()->GetDescendant("child1/child2")();
+   TEST(grandChild != NULL);
+   grandChild->SetData(GetPayload(666), NULL);
+
+   ConstDataNodeSnapshotRef snap2 = root()->GetSnapshot();
+   MRETURN_ON_ERROR(snap2);
+   TEST(snap2() != snap1());
+   TEST(snap2()->GetChild(GetChildName(0))() == oldChild0());  // untouched subtrees are shared...
+   TEST(snap2()->GetChild(GetChildName(1))() != oldChild1());  // ... but the changed node's ancestors are not
+   TEST(snap2()->GetDescendant("child1/child3")() == oldChild1()->GetDescendant("child3")());
+   TEST(snap2()->GetDescendant("child1/child2")()->GetData()()->what == 666);
+   TEST(snap2()->CalculateChecksum() == root()->CalculateChecksum());
+
+   // and the old snapshot should still show the tree the way it was
+   TEST(snap1()->GetDescendant("child1/child2")()->GetData()()->what == 2);
+   TEST(snap1()->CalculateChecksum() == oldChecksum);
+
+   // Removing a node and reordering an index should be noticed as well
+   MRETURN_ON_ERROR(root()->GetChild(GetChildName(2))()->RemoveChild(GetChildName(0), NULL, true, NULL));
+   TEST(root()->GetSnapshot()()->GetDescendant("child2/child0")() == NULL);
+   TEST(snap2()->GetDescendant("child2/child0")() != NULL);
+
+   DataNode * indexed = root()->GetChild(GetChildName(3))();
+   for (uint32 i=0; i<3; i++) MRETURN_ON_ERROR(indexed->InsertOrderedChild(GetPayload(100+i), GetEmptyString(), GetEmptyString(), NULL, NULL, NULL));
+   ConstDataNodeSnapshotRef snap3 = root()->GetSnapshot();
+   MRETURN_ON_ERROR(snap3);
+   const Queue<ConstDataNodeSnapshotRef> * snapIndex = snap3()->GetChild(GetChildName(3))()->GetIndex();
+   TEST(snapIndex != NULL);
+   TEST(snapIndex->GetNumItems() == 3);
+   TEST((*snapIndex)[2]()->GetData()()->what == 102);
+   TEST(snap3()->CalculateChecksum() == root()->CalculateChecksum());
+
+   const DataNodeRef lastIndexed = indexed->GetIndex()->Tail();  // copied, since ReorderChild() modifies the index it came from
+   MRETURN_ON_ERROR(indexed->ReorderChild(lastIndexed, indexed->GetIndex()->Head()()->GetNodeName(), NULL));
+   TEST(root()->GetSnapshot()()->GetDescendant(GetChildName(3))()->GetIndex()->Head()()->GetData()()->what == 102);
+   TEST((*snapIndex)[2]()->GetData()()->what == 102);
+   TEST(root()->GetSnapshot()()->CalculateChecksum() == root()->CalculateChecksum());
+   return B_NO_ERROR;
+}
+
+// Makes sure DropCachedSnapshots() lets go of the affected snapshots, and only of those
+static status_t TestDropCachedSnapshots()
+{
+   DataNodeRef root = TestStorageReflectSession::NewNode("root");
+   MRETURN_ON_ERROR(root);
+   MRETURN_ON_ERROR(BuildTree(*root(), 3, 3));
+
+   ConstDataNodeSnapshotRef oldChild0, oldGrandChild;
+   {
+      ConstDataNodeSnapshotRef snap = root()->GetSnapshot();
+      MRETURN_ON_ERROR(snap);
+      oldChild0     = snap()->GetChild(GetChildName(0));
+      oldGrandChild = snap()->GetDescendant("child1/child2");
+      TEST(oldChild0() != NULL);
+      TEST(oldGrandChild() != NULL);
+   }
+   TEST(oldGrandChild()->GetRefCount() > 1);  // still cached by its node, and referenced by its cached parent-snapshot
+
+   root()->GetChild(GetChildName(1))()->DropCachedSnapshots();
+   TEST(oldGrandChild()->GetRefCount() == 1);  // now we're the only ones left holding it
+   TEST(oldGrandChild()->GetData()()->what == 2);  // ... and it's still valid
+
+   ConstDataNodeSnapshotRef snap = root()->GetSnapshot();
+   MRETURN_ON_ERROR(snap);
+   TEST(snap()->GetChild(GetChildName(0))() == oldChild0());  // an unaffected subtree's cached snapshot is still used
+   TEST(snap()->GetDescendant("child1/child2")() != oldGrandChild());
+   TEST(snap()->CalculateChecksum() == root()->CalculateChecksum());
+
+   root()->DropCachedSnapshots();
+   TEST(root()->GetSnapshot()() != snap());
+   return B_NO_ERROR;
+}
+
+// Makes sure a snapshot saves itself the same way StorageReflectSession saves the tree it was taken from
+static status_t TestSnapshotQueries()
+{
+   DataNodeRef root = TestStorageReflectSession::NewNode("root");
+   MRETURN_ON_ERROR(root);
+   MRETURN_ON_ERROR(BuildTree(*root(), 4, 3));
+   MRETURN_ON_ERROR(root()->GetChild(GetChildName(1))()->InsertOrderedChild(GetPayload(7), GetEmptyString(), GetEmptyString(), NULL, NULL, NULL));
+
+   ConstDataNodeSnapshotRef snap = root()->GetSnapshot();
+   MRETURN_ON_ERROR(snap);
+
+   TestStorageReflectSession session;
+   Message fromNode, fromSnap;
+   MRETURN_ON_ERROR(session.SaveTree(fromNode, *root(), false));
+   MRETURN_ON_ERROR(snap()->SaveNodeTreeToMessage(fromSnap, false));
+   TEST(fromSnap == fromNode);
+
+   PathMatcher matcher;
+   MRETURN_ON_ERROR(matcher.PutPathString("child1/*", ConstQueryFilterRef()));
+   MRETURN_ON_ERROR(matcher.PutPathString("child*/child3/child0", ConstQueryFilterRef()));
+
+   Message results;
+   MRETURN_ON_ERROR(snap()->SaveMatchingNodesToMessage(matcher, GetEmptyString(), results));
+   TEST(results.GetNumNames() == 5+4);  // child1's five children (including the indexed one), plus child0 under each child3
+   TEST(results.HasName("child1/child2"));
+   TEST(results.HasName("child2/child3/child0"));
+   TEST(results.HasName("child2/child3/child1") == false);
+   TEST(results.HasName("child2") == false);
+   return B_NO_ERROR;
+}
+
+enum {
+   SNAPSHOT_JOB = 1886351988 // 'snap'
+};
+
+// Checksums and serializes DataNodeSnapshots inside the ThreadPool's threads, while the main thread keeps modifying the tree
+class SnapshotReader : public IThreadPoolClient
+{
+public:
+   SnapshotReader() : IThreadPoolClient(NULL), _numErrors(0) {/* empty */}
+
+   virtual void MessageReceivedFromThreadPool(const MessageRef & msg, uint32)
+   {
+      ConstDataNodeSnapshotRef snap;
+      uint32 expectedChecksum = 0;
+      Message saved;
+      bool ok = ((msg()->FindTag("snap", snap).IsOK())&&(msg()->FindInt32("chk", expectedChecksum).IsOK()));
+      if (ok) ok = ((snap()->CalculateChecksum() == expectedChecksum)&&(snap()->SaveNodeTreeToMessage(saved, true).IsOK()));
+
+      DECLARE_MUTEXGUARD(_mutex);
+      if (ok == false) _numErrors++;
+   }
+
+   uint32 GetNumErrors() const {DECLARE_MUTEXGUARD(_mutex); return _numErrors;}
+
+private:
+   mutable Mutex _mutex;
+   uint32 _numErrors;
+};
+
+static status_t TestSnapshotThreads()
+{
+   DataNodeRef root = TestStorageReflectSession::NewNode("root");
+   MRETURN_ON_ERROR(root);
+   MRETURN_ON_ERROR(BuildTree(*root(), 5, 3));
+
+   ThreadPool pool(4);
+   SnapshotReader reader;
+   reader.SetThreadPool(&pool);
+
+   status_t ret;
+   for (uint32 i=0; i<500; i++)
+   {
+      ConstDataNodeSnapshotRef snap = root()->GetSnapshot();
+      MessageRef job = GetMessageFromPool(SNAPSHOT_JOB);
+      if ((snap() == NULL)||(job() == NULL)) {ret = B_OUT_OF_MEMORY; break;}
+      if ((job()->AddTag("snap", CastAwayConstFromRef(snap)).IsError(ret))||(job()->AddInt32("chk", root()->CalculateChecksum()).IsError(ret))||(reader.SendMessageToThreadPool(job).IsError(ret))) break;
+
+      // Now change the tree while the workers are (probably) still reading the snapshot
+      DataNode * node = root()->GetDescendant(String("%1/%2").Arg(GetChildName(i%5)).Arg(GetChildName((i/5)%5)))();
+      if (node == NULL) {ret = B_LOGIC_ERROR; break;}
+      node->SetData(GetPayload(i), NULL);
+      if (node->RemoveChild(GetChildName(i%5), NULL, true, NULL).IsError(ret)) break;
+      if (node->PutChild(TestStorageReflectSession::NewNode(GetChildName(i%5)), NULL, NULL).IsError(ret)) break;
+   }
+
+   reader.SetThreadPool(NULL);  // blocks until all of the jobs have been handled
+   MRETURN_ON_ERROR(ret);
+   TEST(reader.GetNumErrors() == 0);
+   return B_NO_ERROR;
+}
+
+// This program tests the DataNode class's child-node bookkeeping, and its snapshots
+// Makes sure an attached child can be renamed, whether its parent keeps its children in a small array or in a Hashtable
+static status_t TestRename()
+{
+   const uint32 childCounts[] = {3, 20};
+   for (uint32 c=0; c<ARRAYITEMS(childCounts); c++)
+   {
+      const uint32 numChildren = childCounts[c];
+
+      DataNodeRef parent = TestStorageReflectSession::NewNode("parent");
+      MRETURN_ON_ERROR(parent);
+      for (uint32 i=0; i<numChildren; i++) MRETURN_ON_ERROR(parent()->PutChild(TestStorageReflectSession::NewNode(GetChildName(i)), NULL, NULL));
+
+      DataNodeRef child = parent()->GetChild(GetChildName(1));
+      TEST(child() != NULL);
+      child()->SetNodeName("renamed");
+      TEST(child()->GetNodeName() == "renamed");
+      TEST(parent()->GetChild("renamed")() == child());
+      TEST(parent()->HasChild(GetChildName(1)) == false);
+      TEST(parent()->GetNumChildren() == numChildren);
+
+      child()->SetNodeName(GetChildName(2));  // a sibling already has that name, so this should be refused
+      TEST(child()->GetNodeName() == "renamed");
+      TEST(parent()->GetChild(GetChildName(2))() != child());
+
+      child()->SetNodeName(GetChildName(1));
+      MRETURN_ON_ERROR(CheckChildren(*parent(), numChildren));  // including that it's back in its original position
+   }
+   return B_NO_ERROR;
+}
+
+int main(int, char **)
+{
+   CompleteSetupSystem css;
+
+   status_t ret;
+   if (TestAddAndRemove().IsError(ret))
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "Add-and-remove test failed [%s]\n", ret());
+      return 10;
+   }
+   if (TestRemoveFromMiddle().IsError(ret))
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "Remove-from-middle test failed [%s]\n", ret());
+      return 10;
+   }
+   if (TestRecursiveRemove().IsError(ret))
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "Recursive-remove test failed [%s]\n", ret());
+      return 10;
+   }
+   if (TestRename().IsError(ret))
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "Rename test failed [%s]\n", ret());
+      return 10;
+   }
+   if (TestSnapshotSharing().IsError(ret))
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "Snapshot-sharing test failed [%s]\n", ret());
+      return 10;
+   }
+   if (TestDropCachedSnapshots().IsError(ret))
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "Drop-cached-snapshots test failed [%s]\n", ret());
+      return 10;
+   }
+   if (TestSnapshotQueries().IsError(ret))
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "Snapshot-queries test failed [%s]\n", ret());
+      return 10;
+   }
+   if (TestSnapshotThreads().IsError(ret))
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "Snapshot-threads test failed [%s]\n", ret());
+      return 10;
+   }
+
+   printf("DataNode tests passed.\n");
+   return 0;
+}
@@ -0,0 +1,164 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#include <stdio.h>
+
+#include "dataio/TCPSocketDataIO.h"
+#include "iogateway/MessageIOGateway.h"
+#include "reflector/AbstractReflectSession.h"
+#include "reflector/ReflectServer.h"
+#include "system/SetupSystem.h"
+#include "test/TestMacros.h"
+#include "util/LatencyHistogram.h"
+#include "util/NetworkUtilityFunctions.h"
+
+using namespace muscle;
+
+static const uint32 NUM_TEST_MESSAGES = 10;
+static const uint32 NUM_TEST_PULSES   = 20;
+static const uint64 SLOW_DELAY        = MillisToMicros(20);
+static const uint64 SLOW_THRESHOLD    = MillisToMicros(10);
+static const uint32 SLOW_WHAT_CODE    = 1936486263;  // 'slow'
+
+// Makes sure LatencyHistogram's statistics are within its advertised 12.5% of the true values
+static status_t TestLatencyHistogram()
+{
+   LatencyHistogram h;
+   TEST(h.GetCount() == 0);
+   TEST(h.GetValueAtPercentile(50.0) == 0);
+
+   const uint64 numValues = 100000;
+   for (uint64 i=1; i<=numValues; i++) h.RecordValue(i);
+   TEST(h.GetCount()     == numValues);
+   TEST(h.GetMinValue()  == 1);
+   TEST(h.GetMaxValue()  == numValues);
+   TEST(h.GetMeanValue() == (numValues+1)/2);
+
+   const double percentiles[] = {1.0, 10.0, 50.0, 90.0, 99.0, 99.9};
+   for (uint32 i=0; i<ARRAYITEMS(percentiles); i++)
+   {
+      const double expected = (percentiles[i]*numValues)/100.0;
+      const double actual   = (double) h.GetValueAtPercentile(percentiles[i]);
+      TEST(actual >= expected);
+      TEST(actual <= expected*1.125);
+   }
+   TEST(h.GetValueAtPercentile(100.0) == numValues);
+
+   h.RecordValue(MUSCLE_TIME_NEVER-1);  // huge values shouldn't break anything
+   TEST(h.GetMaxValue() == MUSCLE_TIME_NEVER-1);
+   TEST(h.GetValueAtPercentile(100.0) == MUSCLE_TIME_NEVER-1);
+
+   h.Reset();
+   TEST(h.GetCount() == 0);
+   TEST(h.GetMaxValue() == 0);
+   return B_NO_ERROR;
+}
+
+// A session that occasionally takes too long to handle a Pulse() or a Message
+class TestSession : public AbstractReflectSession
+{
+public:
+   TestSession() : _nextPulseTime(0), _numPulses(0), _numMessages(0) {/* empty */}
+
+   virtual uint64 GetPulseTime(const PulseArgs & args) {return muscleMin(AbstractReflectSession::GetPulseTime(args), (_numPulses < NUM_TEST_PULSES) ? _nextPulseTime : MUSCLE_TIME_NEVER);}
+
+   virtual void Pulse(const PulseArgs & args)
+   {
+      AbstractReflectSession::Pulse(args);
+      if (++_numPulses == NUM_TEST_PULSES/2) (void) Snooze64(SLOW_DELAY);
+      _nextPulseTime = args.GetCallbackTime()+MillisToMicros(1);
+      CheckForEndOfTest();
+   }
+
+   virtual void MessageReceivedFromGateway(const MessageRef & msg, void *)
+   {
+      if (msg()->what == SLOW_WHAT_CODE) (void) Snooze64(SLOW_DELAY);
+      _numMessages++;
+      CheckForEndOfTest();
+   }
+
+private:
+   void CheckForEndOfTest() {if ((_numPulses >= NUM_TEST_PULSES)&&(_numMessages >= NUM_TEST_MESSAGES)) EndServer();}
+
+   uint64 _nextPulseTime;
+   uint32 _numPulses;
+   uint32 _numMessages;
+};
+
+// Returns the count recorded in the (phaseName) sub-Message of (msg), or zero if there isn't one
+static uint64 GetPhaseCount(const Message & msg, const char * phaseName)
+{
+   MessageRef phaseMsg;
+   return msg.FindMessage(phaseName, phaseMsg).IsOK() ? (uint64) phaseMsg()->GetInt64("count") : 0;
+}
+
+// Runs a ReflectServer with a TestSession in it, and makes sure the event-loop stats reflect what the session did
+static status_t TestEventLoopStats()
+{
+   ConstSocketRef serverSock, clientSock;
+   MRETURN_ON_ERROR(CreateConnectedSocketPair(serverSock, clientSock));
+
+   // Pre-load the socket with the Messages our TestSession will receive
+   {
+      MessageIOGateway gw;
+      gw.SetDataIO(DataIORef(new TCPSocketDataIO(clientSock, true)));
+      for (uint32 i=0; i<NUM_TEST_MESSAGES; i++) MRETURN_ON_ERROR(gw.AddOutgoingMessage(GetMessageFromPool((i==NUM_TEST_MESSAGES/2) ? SLOW_WHAT_CODE : 0)));
+      while(gw.HasBytesToOutput()) MRETURN_ON_ERROR(gw.DoOutput().GetStatus());
+   }
+
+   ReflectServer server;
+   TEST(server.GetEventLoopStatsEnabled() == false);  // they're opt-in
+   server.SetEventLoopStatsEnabled(true);
+   server.SetSlowCallbackThreshold(SLOW_THRESHOLD);
+   MRETURN_ON_ERROR(server.AddNewSession(AbstractReflectSessionRef(new TestSession), serverSock));
+   MRETURN_ON_ERROR(server.ServerProcessLoop(GetRunTime64()+SecondsToMicros(10)));
+
+   TEST(server.GetNumSlowCallbacks() >= 2);  // one slow Pulse() and one slow MessageReceivedFromGateway(), and possibly the DoInput() around it
+   TEST(server.GetEventLoopHistogram(EVENT_LOOP_PHASE_MESSAGE_RECEIVED).GetCount() == NUM_TEST_MESSAGES);
+   TEST(server.GetEventLoopHistogram(EVENT_LOOP_PHASE_MESSAGE_RECEIVED).GetMaxValue() >= SLOW_DELAY);
+   TEST(server.GetEventLoopHistogram(EVENT_LOOP_PHASE_PULSE).GetCount() >= NUM_TEST_PULSES);
+   TEST(server.GetEventLoopHistogram(EVENT_LOOP_PHASE_PULSE).GetMaxValue() >= SLOW_DELAY);
+   TEST(server.GetEventLoopHistogram(EVENT_LOOP_PHASE_DO_INPUT).GetCount() >= 1);
+   TEST(server.GetEventLoopHistogram(EVENT_LOOP_PHASE_ITERATION).GetCount() >= NUM_TEST_PULSES);
+
+   Message statsMsg;
+   MRETURN_ON_ERROR(server.SaveEventLoopStatsToMessage(statsMsg));
+   TEST(statsMsg.GetInt64("slowcallbacks") == (int64) server.GetNumSlowCallbacks());
+   TEST(statsMsg.GetInt64("slowthreshold") == (int64) SLOW_THRESHOLD);
+   TEST(GetPhaseCount(statsMsg, GetEventLoopPhaseName(EVENT_LOOP_PHASE_MESSAGE_RECEIVED)) == NUM_TEST_MESSAGES);
+
+   MessageRef typesMsg, typeMsg;
+   MRETURN_ON_ERROR(statsMsg.FindMessage("sessiontypes", typesMsg));
+   MRETURN_ON_ERROR(typesMsg()->FindMessage("TestSession", typeMsg));
+   TEST(GetPhaseCount(*typeMsg(), GetEventLoopPhaseName(EVENT_LOOP_PHASE_MESSAGE_RECEIVED)) == NUM_TEST_MESSAGES);
+   TEST(GetPhaseCount(*typeMsg(), GetEventLoopPhaseName(EVENT_LOOP_PHASE_ITERATION)) == 0);  // loop iterations are only counted server-wide
+
+   server.PrintEventLoopStats(stdout);
+
+   server.ResetEventLoopStats();
+   TEST(server.GetNumSlowCallbacks() == 0);
+   TEST(server.GetEventLoopHistogram(EVENT_LOOP_PHASE_PULSE).GetCount() == 0);
+
+   server.Cleanup();
+   return B_NO_ERROR;
+}
+
+// This program tests the LatencyHistogram class, and the ReflectServer's event-loop statistics that are based on it
+int main(int, char **)
+{
+   CompleteSetupSystem css;
+
+   status_t ret;
+   if (TestLatencyHistogram().IsError(ret))
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "LatencyHistogram test failed [%s]\n", ret());
+      return 10;
+   }
+   if (TestEventLoopStats().IsError(ret))
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "Event-loop stats test failed [%s]\n", ret());
+      return 10;
+   }
+
+   printf("Event-loop stats tests passed.\n");
+   return 0;
+}
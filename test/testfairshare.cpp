@@ -0,0 +1,230 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#include <stdio.h>
+
+#include "reflector/FairShareSessionIOPolicy.h"
+#include "reflector/ReflectServer.h"
+#include "system/SetupSystem.h"
+#include "test/TestMacros.h"
+
+using namespace muscle;
+
+static const uint64 PASS_INTERVAL = MillisToMicros(1);  // simulated time between passes through the event loop
+
+// A socket-less session that pretends to be connected from the host name we give it
+class TestSession : public AbstractReflectSession
+{
+public:
+   explicit TestSession(const String & hostName) : _bytesSent(0), _hostName(hostName) {/* empty */}
+
+   virtual void MessageReceivedFromGateway(const MessageRef &, void *) {/* empty */}
+
+   uint64 _bytesSent;
+
+protected:
+   virtual String GenerateHostName(const IPAddress &, const String &) const {return _hostName;}
+
+private:
+   const String _hostName;
+};
+
+// Adds (numSessions) TestSessions from the given host to (server) and to (retSessions)
+static status_t AddTestSessions(ReflectServer & server, const String & hostName, uint32 numSessions, Queue<TestSession *> & retSessions)
+{
+   for (uint32 i=0; i<numSessions; i++)
+   {
+      TestSession * ts = newnothrow TestSession(hostName);
+      MRETURN_OOM_ON_NULL(ts);
+
+      AbstractReflectSessionRef ref(ts);
+      MRETURN_ON_ERROR(server.AddNewSession(ref));
+      MRETURN_ON_ERROR(retSessions.AddTail(ts));
+   }
+   return B_NO_ERROR;
+}
+
+// Does what ReflectServer's event loop does with an output policy, for (numPasses) passes.
+// Each session in (busy) always has more data to send than the policy will let it send.
+// Returns the simulated time at the end of the last pass.
+static uint64 RunPasses(FairShareSessionIOPolicy & policy, const Queue<TestSession *> & busy, uint64 now, uint32 numPasses)
+{
+   Queue<PolicyHolder> approved;
+   for (uint32 p=0; p<numPasses; p++)
+   {
+      now += PASS_INTERVAL;
+      policy.BeginIO(now);
+
+      approved.Clear();
+      for (uint32 i=0; i<busy.GetNumItems(); i++)
+      {
+         const PolicyHolder ph(busy[i], false);
+         if (policy.OkayToTransfer(ph)) (void) approved.AddTail(ph);
+      }
+
+      for (uint32 i=0; i<approved.GetNumItems(); i++)
+      {
+         const PolicyHolder & ph = approved[i];
+         const uint32 numBytes = policy.GetMaxTransferChunkSize(ph);
+         policy.BytesTransferred(ph, numBytes);
+         static_cast<TestSession *>(ph.GetSession())->_bytesSent += numBytes;
+      }
+
+      policy.EndIO(now);
+   }
+   return now;
+}
+
+static void ResetTallies(const Queue<TestSession *> & sessions) {for (uint32 i=0; i<sessions.GetNumItems(); i++) sessions[i]->_bytesSent = 0;}
+
+static bool IsRoughly(uint64 actual, uint64 expected) {return ((actual*100 >= expected*99)&&(actual*100 <= expected*101));}
+
+// Makes sure per-session weights split the bandwidth in the right proportions
+static status_t TestSessionWeights(ReflectServer & server)
+{
+   Queue<TestSession *> sessions;
+   MRETURN_ON_ERROR(AddTestSessions(server, "host1", 2, sessions));
+
+   FairShareSessionIOPolicy policy;
+   MRETURN_ON_ERROR(policy.SetSessionWeight(sessions[1]->GetSessionID(), 3));
+   (void) RunPasses(policy, sessions, GetRunTime64(), 1000);
+
+   TEST(sessions[0]->_bytesSent > 0);
+   TEST(sessions[1]->_bytesSent == 3*sessions[0]->_bytesSent);
+   return B_NO_ERROR;
+}
+
+// Makes sure a session's weight is forgotten once the session stops using the policy
+static status_t TestSessionWeightCleanup(ReflectServer & server)
+{
+   Queue<TestSession *> sessions;
+   MRETURN_ON_ERROR(AddTestSessions(server, "host1", 1, sessions));
+
+   FairShareSessionIOPolicyRef policyRef(newnothrow FairShareSessionIOPolicy);
+   MRETURN_OOM_ON_NULL(policyRef());
+
+   const uint32 sessionID = sessions[0]->GetSessionID();
+   MRETURN_ON_ERROR(policyRef()->SetSessionWeight(sessionID, 3));
+   sessions[0]->SetInputPolicy(policyRef);
+   sessions[0]->SetOutputPolicy(policyRef);
+
+   sessions[0]->SetInputPolicy(AbstractSessionIOPolicyRef());
+   TEST(policyRef()->GetSessionWeight(sessionID) == 3);  // the session's output is still using the policy
+
+   sessions[0]->SetOutputPolicy(AbstractSessionIOPolicyRef());
+   TEST(policyRef()->GetSessionWeight(sessionID) == 1);
+   return B_NO_ERROR;
+}
+
+// Makes sure a host with one session gets as much bandwidth as a host with many sessions
+static status_t TestHostGrouping(ReflectServer & server)
+{
+   Queue<TestSession *> manySessions, oneSession;
+   MRETURN_ON_ERROR(AddTestSessions(server, "busyhost",  8, manySessions));
+   MRETURN_ON_ERROR(AddTestSessions(server, "quiethost", 1, oneSession));
+
+   Queue<TestSession *> all = manySessions;
+   MRETURN_ON_ERROR(all.AddTailMulti(oneSession));
+
+   FairShareSessionIOPolicy policy;
+   ResetTallies(all);
+   (void) RunPasses(policy, all, GetRunTime64(), 1000);
+
+   uint64 busyHostTotal = 0;
+   for (uint32 i=0; i<manySessions.GetNumItems(); i++)
+   {
+      TEST(manySessions[i]->_bytesSent == manySessions[0]->_bytesSent);
+      busyHostTotal += manySessions[i]->_bytesSent;
+   }
+   TEST(IsRoughly(oneSession[0]->_bytesSent, busyHostTotal));
+
+   // With host-grouping disabled, every session should get the same amount instead
+   policy.SetGroupByHost(false);
+   ResetTallies(all);
+   (void) RunPasses(policy, all, GetRunTime64(), 1000);
+   TEST(oneSession[0]->_bytesSent == manySessions[0]->_bytesSent);
+
+   // Host weights apply to the host as a whole
+   policy.SetGroupByHost(true);
+   MRETURN_ON_ERROR(policy.SetHostWeight("busyhost", 2));
+   ResetTallies(all);
+   (void) RunPasses(policy, all, GetRunTime64(), 1000);
+   busyHostTotal = 0;
+   for (uint32 i=0; i<manySessions.GetNumItems(); i++) busyHostTotal += manySessions[i]->_bytesSent;
+   TEST(IsRoughly(busyHostTotal, 2*oneSession[0]->_bytesSent));
+   return B_NO_ERROR;
+}
+
+// Makes sure the aggregate rate limit is honored, and that an idle session that wakes up gets its share right away
+static status_t TestRateLimit(ReflectServer & server)
+{
+   const uint32 maxRate    = 100*1000;  // bytes per second
+   const uint32 burstBytes = 10*1000;
+
+   Queue<TestSession *> bulk, interactive;
+   MRETURN_ON_ERROR(AddTestSessions(server, "bulkhost1", 1, bulk));
+   MRETURN_ON_ERROR(AddTestSessions(server, "bulkhost2", 1, bulk));
+   MRETURN_ON_ERROR(AddTestSessions(server, "interactivehost", 1, interactive));
+   ResetTallies(bulk);
+   ResetTallies(interactive);
+
+   FairShareSessionIOPolicy policy(maxRate, 1000, burstBytes);
+   const uint32 numSeconds = 10;
+   uint64 now = RunPasses(policy, bulk, GetRunTime64(), numSeconds*1000);
+   const uint64 bulkTotal = bulk[0]->_bytesSent+bulk[1]->_bytesSent;
+   TEST(bulkTotal >= (numSeconds-1)*maxRate);
+   TEST(bulkTotal <= (numSeconds*maxRate)+burstBytes);
+   TEST(IsRoughly(bulk[0]->_bytesSent, bulk[1]->_bytesSent));
+
+   // Now a third session wants to send a small message while the bulk transfers are still going on.
+   // It should get a third of the bandwidth starting with the very next pass, rather than having to wait its turn.
+   Queue<TestSession *> all = bulk;
+   MRETURN_ON_ERROR(all.AddTailMulti(interactive));
+
+   const uint64 smallMessageSize = 300;
+   uint32 numPasses = 0;
+   while(interactive[0]->_bytesSent < smallMessageSize)
+   {
+      now = RunPasses(policy, all, now, 1);
+      TEST(++numPasses <= 12);  // 100 bytes of tokens per pass, split three ways
+   }
+   return B_NO_ERROR;
+}
+
+// This program tests the FairShareSessionIOPolicy class, by calling it the same way ReflectServer's event loop does
+int main(int, char **)
+{
+   CompleteSetupSystem css;
+
+   status_t ret;
+   {
+      ReflectServer server;
+      if (TestSessionWeights(server).IsError(ret))
+      {
+         LogTime(MUSCLE_LOG_CRITICALERROR, "Session-weights test failed [%s]\n", ret());
+         server.Cleanup();
+         return 10;
+      }
+      if (TestSessionWeightCleanup(server).IsError(ret))
+      {
+         LogTime(MUSCLE_LOG_CRITICALERROR, "Session-weight cleanup test failed [%s]\n", ret());
+         server.Cleanup();
+         return 10;
+      }
+      if (TestHostGrouping(server).IsError(ret))
+      {
+         LogTime(MUSCLE_LOG_CRITICALERROR, "Host-grouping test failed [%s]\n", ret());
+         server.Cleanup();
+         return 10;
+      }
+      if (TestRateLimit(server).IsError(ret))
+      {
+         LogTime(MUSCLE_LOG_CRITICALERROR, "Rate-limit test failed [%s]\n", ret());
+         server.Cleanup();
+         return 10;
+      }
+      server.Cleanup();
+   }
+
+   printf("FairShareSessionIOPolicy tests passed.\n");
+   return 0;
+}
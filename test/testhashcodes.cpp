@@ -3,7 +3,11 @@
 #include <stdio.h>
 
 #include "system/SetupSystem.h"
+#include "util/Hashtable.h"
+#include "util/MiscUtilityFunctions.h"
 #include "util/Queue.h"
+#include "util/String.h"
+#include "util/TimeUtilityFunctions.h"
 
 using namespace muscle;
 
@@ -19,33 +23,140 @@ static uint32 lcg_parkmiller()
    return _state;
 }
 
+// Checks our wyhash and CRC-32C implementations against their algorithms' published test vectors
+static status_t CheckTestVectors()
+{
+   const char * wyInputs[] = {"", "a", "abc", "message digest", "abcdefghijklmnopqrstuvwxyz", "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789", "12345678901234567890123456789012345678901234567890123456789012345678901234567890"};
+   const uint64 wyOutputs[] = {0x93228a4de0eec5a2ULL, 0xc5bac3db178713c4ULL, 0xa97f2f7b1d9b3314ULL, 0x786d1f1df3801df4ULL, 0xdca5a8138ad37c87ULL, 0xb9e734f117cfaf70ULL, 0x6cc5eab49a92d617ULL};
+   for (uint32 i=0; i<ARRAYITEMS(wyInputs); i++)
+   {
+      const uint64 h = CalculateFastHashCode64(wyInputs[i], strlen(wyInputs[i]), i);
+      if (h != wyOutputs[i])
+      {
+         printf("ERROR, CalculateFastHashCode64(\"%s\", seed=" UINT32_FORMAT_SPEC ") returned " XINT64_FORMAT_SPEC ", expected " XINT64_FORMAT_SPEC "\n", wyInputs[i], i, h, wyOutputs[i]);
+         return B_LOGIC_ERROR;
+      }
+   }
+
+   const uint32 crc = CalculateCRC32C("123456789", 9);
+   if (crc != 0xE3069283)
+   {
+      printf("ERROR, CalculateCRC32C(\"123456789\") returned " XINT32_FORMAT_SPEC ", expected 0xE3069283\n", crc);
+      return B_LOGIC_ERROR;
+   }
+
+   // Calculating a CRC incrementally should give the same result as calculating it all at once
+   if (CalculateCRC32C("6789", 4, CalculateCRC32C("12345", 5)) != crc)
+   {
+      printf("ERROR, incremental CalculateCRC32C() gave the wrong result\n");
+      return B_LOGIC_ERROR;
+   }
+   return B_NO_ERROR;
+}
+
+typedef uint32 (*HashFunc)(const void * key, size_t numBytes, uint32 seed);
+
+static uint32 CRC32CHashFunc(const void * key, size_t numBytes, uint32 seed) {return CalculateCRC32C(key, numBytes, seed);}
+static uint32 FastHashFunc(  const void * key, size_t numBytes, uint32 seed) {return CalculateFastHashCode(key, numBytes, seed);}
+static uint32 MurmurHashFunc(const void * key, size_t numBytes, uint32 seed) {return CalculateMurmurHashCode(key, numBytes, seed);}
+
+// Prints the speed and distribution-quality of the given hash function on the given set of keys
+static void BenchmarkHashFunction(const char * algName, HashFunc func, const char * keySetName, const Queue<String> & keys)
+{
+   const uint32 numKeys = keys.GetNumItems();
+   uint64 numBytes = 0;
+   for (uint32 i=0; i<numKeys; i++) numBytes += keys[i].Length();
+
+   Queue<uint32> hashes;
+   if (hashes.EnsureSize(numKeys, true).IsError()) return;
+
+   // Null (func) means "use the bulk API", which wants arrays of pointers and lengths
+   Queue<const void *> keyPtrs;
+   Queue<uint32> keyLengths;
+   if ((keyPtrs.EnsureSize(numKeys, true).IsError())||(keyLengths.EnsureSize(numKeys, true).IsError())) return;
+   for (uint32 i=0; i<numKeys; i++) {keyPtrs[i] = keys[i](); keyLengths[i] = keys[i].Length();}
+
+   const uint32 numPasses = 20;
+   const uint64 startTime = GetRunTime64();
+   for (uint32 pass=0; pass<numPasses; pass++)
+   {
+      if (func) for (uint32 i=0; i<numKeys; i++) hashes[i] = func(keys[i](), keys[i].Length(), 0);
+           else CalculateHashCodes(keyPtrs.HeadPointer(), keyLengths.HeadPointer(), numKeys, hashes.HeadPointer());
+   }
+   const uint64 elapsed = muscleMax(GetRunTime64()-startTime, (uint64)1);
+
+   // Count the number of full 32-bit collisions, and how evenly the keys spread across (numKeys) hash-buckets
+   Hashtable<uint32, uint32> counts;
+   uint32 numCollisions = 0;
+   for (uint32 i=0; i<numKeys; i++) if ((*counts.GetOrPut(hashes[i], 0))++ > 0) numCollisions++;
+
+   uint32 numBuckets = 1; while(numBuckets < numKeys) numBuckets *= 2;
+   Queue<uint32> buckets;
+   if (buckets.EnsureSize(numBuckets, true).IsError()) return;
+   for (uint32 i=0; i<numBuckets; i++) buckets[i] = 0;
+   for (uint32 i=0; i<numKeys; i++) buckets[hashes[i]&(numBuckets-1)]++;
+
+   double chiSquared = 0.0;
+   const double expected = ((double)numKeys)/numBuckets;
+   for (uint32 i=0; i<numBuckets; i++) chiSquared += ((buckets[i]-expected)*(buckets[i]-expected))/expected;
+
+   printf("   %-14s %-12s %6.1f ns/key  %7.1f MB/sec  " UINT32_FORMAT_SPEC " collisions  chi^2/buckets=%.3f (1.000 is ideal)\n", algName, keySetName, (elapsed*1000.0)/(numKeys*(uint64)numPasses), ((double)numBytes*numPasses)/elapsed, numCollisions, chiSquared/numBuckets);
+}
+
+static void BenchmarkHashFunctions()
+{
+   // Keys that look like the node-paths and Message field-names that muscled hashes all day long
+   Queue<String> nodePaths, fieldNames;
+   for (uint32 i=0; i<200000; i++)
+   {
+      (void) nodePaths.AddTail(String("/192.168.%1.%2/%3/client_%4/nodes/node_%5").Arg((i/256)%256).Arg(i%256).Arg(i/100).Arg(i%17).Arg(i));
+      (void) fieldNames.AddTail(String("%1%2").Arg((i%3)==0?"name":((i%3)==1?"_pos":"val")).Arg(i));
+   }
+
+   printf("Benchmarking hash functions:\n");
+   const char * algNames[] = {"MurmurHash2", "wyhash", "CRC-32C", "bulk default"};
+   const HashFunc funcs[]  = {MurmurHashFunc, FastHashFunc, CRC32CHashFunc, NULL};
+   for (uint32 i=0; i<ARRAYITEMS(funcs); i++)
+   {
+      BenchmarkHashFunction(algNames[i], funcs[i], "node paths",  nodePaths);
+      BenchmarkHashFunction(algNames[i], funcs[i], "field names", fieldNames);
+   }
+}
+
 // This program prints out a series of hash-code calculatations for a series of known, arbitrary byte
 // sequences.  The intent is just to check that our hash-code functions give the same results on different
-// CPU architectures.
-int main(int, char **)
+// CPU architectures.  When run interactively, it also benchmarks the various hash functions against each other.
+int main(int argc, char ** argv)
 {
    CompleteSetupSystem css;
 
+   Message args; (void) ParseArgs(argc, argv, args);
+   if (CheckTestVectors().IsError()) return 10;
+
    const uint32 MAX_BUF_SIZE = 1000;
 
    Queue<uint8> bytes;
    if (bytes.EnsureSize(MAX_BUF_SIZE).IsError()) return 10;
 
-   uint32 metaHash32 = 0;
-   uint64 metaHash64 = 0;
+   uint32 metaHash32 = 0, metaHashCRC = 0;
+   uint64 metaHash64 = 0, metaHashFast64 = 0;
    for (uint32 i=0; i<MAX_BUF_SIZE; i++)
    {
       (void) bytes.AddTail((uint8) (lcg_parkmiller() & 0xFF));
       //printf("i=%u lastByte=%u\n", i, bytes.Tail());
 
       const uint32 qLen   = bytes.GetNumItems();
-      const uint32 hash32 = CalculateHashCode(  bytes.HeadPointer(), qLen);
-      const uint64 hash64 = CalculateHashCode64(bytes.HeadPointer(), qLen);
-      printf("len=" UINT32_FORMAT_SPEC " hash=" UINT32_FORMAT_SPEC " hash64=" UINT64_FORMAT_SPEC "\n", qLen, hash32, hash64);
-      metaHash32 += hash32;
-      metaHash64 += hash64;
+      const uint32 hash32     = CalculateMurmurHashCode(  bytes.HeadPointer(), qLen);
+      const uint64 hash64     = CalculateMurmurHashCode64(bytes.HeadPointer(), qLen);
+      const uint64 hashFast64 = CalculateFastHashCode64(  bytes.HeadPointer(), qLen);
+      const uint32 hashCRC    = CalculateCRC32C(          bytes.HeadPointer(), qLen);
+      printf("len=" UINT32_FORMAT_SPEC " hash=" UINT32_FORMAT_SPEC " hash64=" UINT64_FORMAT_SPEC " fast64=" UINT64_FORMAT_SPEC " crc32c=" UINT32_FORMAT_SPEC "\n", qLen, hash32, hash64, hashFast64, hashCRC);
+      metaHash32     += hash32;
+      metaHash64     += hash64;
+      metaHashFast64 += hashFast64;
+      metaHashCRC    += hashCRC;
    }
-   printf("For " UINT32_FORMAT_SPEC " items, metaHash32=" UINT32_FORMAT_SPEC ", metaHash64=" UINT64_FORMAT_SPEC "\n", bytes.GetNumItems(), metaHash32, metaHash64);
+   printf("For " UINT32_FORMAT_SPEC " items, metaHash32=" UINT32_FORMAT_SPEC ", metaHash64=" UINT64_FORMAT_SPEC ", metaHashFast64=" UINT64_FORMAT_SPEC ", metaHashCRC=" UINT32_FORMAT_SPEC "\n", bytes.GetNumItems(), metaHash32, metaHash64, metaHashFast64, metaHashCRC);
 
    const uint32 expectedMetaHash32 = 2688496155;
    if (metaHash32 != expectedMetaHash32)
@@ -61,5 +172,20 @@ int main(int, char **)
       return 10;
    }
 
+   const uint64 expectedMetaHashFast64 = 6419520083914569462ULL;
+   if (metaHashFast64 != expectedMetaHashFast64)
+   {
+      printf("ERROR, expected metaHashFast64 value was " UINT64_FORMAT_SPEC ", calculated value was " UINT64_FORMAT_SPEC "\n", expectedMetaHashFast64, metaHashFast64);
+      return 10;
+   }
+
+   const uint32 expectedMetaHashCRC = 1921442517;
+   if (metaHashCRC != expectedMetaHashCRC)
+   {
+      printf("ERROR, expected metaHashCRC value was " UINT32_FORMAT_SPEC ", calculated value was " UINT32_FORMAT_SPEC "\n", expectedMetaHashCRC, metaHashCRC);
+      return 10;
+   }
+
+   if (args.HasName("fromscript") == false) BenchmarkHashFunctions();
    return 0;
 }
@@ -7,6 +7,7 @@
 #include "message/Message.h"
 #include "system/SetupSystem.h"
 #include "system/Thread.h"
+#include "util/FlatHashtable.h"
 #include "util/Hashtable.h"
 #include "util/MiscUtilityFunctions.h"
 #include "util/String.h"
@@ -350,6 +351,120 @@ static void AddTally(Hashtable<String, double> & tallies, const char * verb, uin
    *(tallies.GetOrPut(verb)) += itemsPerSecond;
 }
 
+// Applies the same random sequence of operations to a Hashtable and a FlatHashtable, and bombs if their contents ever diverge
+template<class FlatTableType> static void TestFlatHashtable(const char * desc, bool preserveOrdering)
+{
+   printf("Testing %s...\n", desc);
+   Hashtable<uint32, uint32> reference;
+   FlatTableType flat(preserveOrdering);
+   srand(0);
+   for (uint32 i=0; i<200000; i++)
+   {
+      const uint32 key = GetInsecurePseudoRandomNumber32(5000);
+      switch(GetInsecurePseudoRandomNumber32(4))
+      {
+         case 0: case 1:
+            if ((reference.Put(key, i).IsError())||(flat.Put(key, i).IsError())) bomb("%s:  Put() failed!\n", desc);
+         break;
+
+         case 2:
+         {
+            uint32 refVal = 0, flatVal = 0;
+            const bool refRemoved  = reference.Remove(key, refVal).IsOK();
+            const bool flatRemoved = flat.Remove(key, flatVal).IsOK();
+            if ((refRemoved != flatRemoved)||(refVal != flatVal)) bomb("%s:  Remove(" UINT32_FORMAT_SPEC ") mismatch!\n", desc, key);
+         }
+         break;
+
+         default:
+         {
+            const uint32 * refVal  = reference.Get(key);
+            const uint32 * flatVal = flat.Get(key);
+            if (((refVal == NULL) != (flatVal == NULL))||((refVal)&&(*refVal != *flatVal))) bomb("%s:  Get(" UINT32_FORMAT_SPEC ") mismatch!\n", desc, key);
+         }
+         break;
+      }
+      if (reference.GetNumItems() != flat.GetNumItems()) bomb("%s:  size mismatch " UINT32_FORMAT_SPEC " vs " UINT32_FORMAT_SPEC "!\n", desc, reference.GetNumItems(), flat.GetNumItems());
+   }
+
+   // Ordered tables must iterate in the same order as Hashtable does
+   uint32 count = 0;
+   HashtableIterator<uint32, uint32> refIter(reference);
+   for (typename FlatTableType::ConstIteratorType iter(flat); iter.HasData(); iter++,count++)
+   {
+      if (reference.GetWithDefault(iter.GetKey(), MUSCLE_NO_LIMIT) != iter.GetValue()) bomb("%s:  iteration found bad entry " UINT32_FORMAT_SPEC "!\n", desc, iter.GetKey());
+      if (preserveOrdering)
+      {
+         if (refIter.GetKey() != iter.GetKey()) bomb("%s:  iteration order mismatch at item " UINT32_FORMAT_SPEC "!\n", desc, count);
+         refIter++;
+      }
+   }
+   if (count != reference.GetNumItems()) bomb("%s:  iteration visited " UINT32_FORMAT_SPEC " items, expected " UINT32_FORMAT_SPEC "!\n", desc, count, reference.GetNumItems());
+
+   // Copying, comparing and swapping
+   FlatTableType copy(flat);
+   if (copy != flat) bomb("%s:  copy wasn't equal!\n", desc);
+   (void) copy.Put(MUSCLE_NO_LIMIT, 0);
+   if (copy == flat) bomb("%s:  modified copy was still equal!\n", desc);
+   copy.SwapContents(flat);
+   if ((flat.ContainsKey(MUSCLE_NO_LIMIT) == false)||(copy.ContainsKey(MUSCLE_NO_LIMIT))) bomb("%s:  SwapContents() failed!\n", desc);
+
+   // Removing every entry while iterating
+   for (typename FlatTableType::IteratorType iter(flat); iter.HasData(); iter++) if (flat.Remove(iter.GetKey()).IsError()) bomb("%s:  remove-during-iteration failed!\n", desc);
+   if (flat.HasItems()) bomb("%s:  table still had " UINT32_FORMAT_SPEC " items after remove-during-iteration!\n", desc, flat.GetNumItems());
+
+   // GetOrPut() and String keys
+   FlatHashtable<String, String> sTable(preserveOrdering);
+   for (uint32 i=0; i<1000; i++) (void) sTable.Put(String("key%1").Arg(i), String("value%1").Arg(i));
+   if ((sTable.GetWithDefault("key500") != "value500")||(sTable["key1000"] != GetEmptyString())) bomb("%s:  String lookup failed!\n", desc);
+   if ((*sTable.GetOrPut("key1", "x") != "value1")||(*sTable.GetOrPut("new", "x") != "x")||(sTable.GetNumItems() != 1001)) bomb("%s:  GetOrPut() failed!\n", desc);
+   sTable.Clear(true);
+   if ((sTable.HasItems())||(sTable.GetNumAllocatedItemSlots() != 0)||(sTable.ContainsKey("key1"))) bomb("%s:  Clear(true) failed!\n", desc);
+
+   printf("%s tests passed.\n", desc);
+}
+
+// Times Put(), Get() and Remove() of (keys) in a table of the specified type
+template<class TableType, class KeyType> static void BenchmarkTable(const char * desc, const Queue<KeyType> & keys)
+{
+   const uint32 numKeys = keys.GetNumItems();
+   TableType table;
+   uint64 startTime = GetRunTime64();
+   for (uint32 i=0; i<numKeys; i++) (void) table.Put(keys[i], i);
+   const uint64 putTime = GetRunTime64()-startTime;
+
+   uint64 checksum = 0;
+   startTime = GetRunTime64();
+   for (uint32 pass=0; pass<4; pass++) for (uint32 i=0; i<numKeys; i++) checksum += *table.Get(keys[i]);
+   const uint64 getTime = (GetRunTime64()-startTime)/4;
+
+   startTime = GetRunTime64();
+   for (uint32 i=0; i<numKeys; i++) (void) table.Remove(keys[i]);
+   const uint64 removeTime = GetRunTime64()-startTime;
+
+   printf("   %-32s  " UINT32_FORMAT_SPEC " keys:  Put=%.1fns  Get=%.1fns  Remove=%.1fns  (checksum=" UINT64_FORMAT_SPEC ")\n", desc, numKeys, (putTime*1000.0)/numKeys, (getTime*1000.0)/numKeys, (removeTime*1000.0)/numKeys, checksum);
+}
+
+static void BenchmarkFlatHashtable(uint32 numKeys)
+{
+   Queue<uint32> intKeys;
+   Queue<String> stringKeys;
+   srand(0);
+   for (uint32 i=0; i<numKeys; i++)
+   {
+      const uint32 r = GetInsecurePseudoRandomNumber32();
+      (void) intKeys.AddTail(r);
+      (void) stringKeys.AddTail(String("key-%1").Arg(r));
+   }
+
+   BenchmarkTable<Hashtable<uint32, uint32> >             ("Hashtable<uint32>",             intKeys);
+   BenchmarkTable<FlatHashtable<uint32, uint32> >         ("FlatHashtable<uint32>",         intKeys);
+   BenchmarkTable<OrderedFlatHashtable<uint32, uint32> >  ("OrderedFlatHashtable<uint32>",  intKeys);
+   BenchmarkTable<Hashtable<String, uint32> >             ("Hashtable<String>",             stringKeys);
+   BenchmarkTable<FlatHashtable<String, uint32> >         ("FlatHashtable<String>",         stringKeys);
+   BenchmarkTable<OrderedFlatHashtable<String, uint32> >  ("OrderedFlatHashtable<String>",  stringKeys);
+}
+
 // This program exercises the Hashtable class.
 int main(int argc, char ** argv)
 {
@@ -809,6 +924,15 @@ int main(int argc, char ** argv)
       PrintAndClearStringCopyCounts(stdout, "After String Sort test");
    }
 
+   TestFlatHashtable<FlatHashtable<uint32, uint32> >("FlatHashtable", false);
+   TestFlatHashtable<FlatHashtable<uint32, uint32> >("FlatHashtable (ordered)", true);
+   if (!isFromScript)
+   {
+      printf("FLATHASHTABLE VS HASHTABLE SPEED TEST:\n");
+      BenchmarkFlatHashtable(1000);
+      BenchmarkFlatHashtable(1000000);
+   }
+
    _state = 4;
    if (!isFromScript)
    {
@@ -0,0 +1,176 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#include <stdio.h>
+
+#include "system/SetupSystem.h"
+#include "system/Thread.h"
+#include "test/TestMacros.h"
+#include "util/Hashtable.h"
+#include "util/InternedString.h"
+#include "util/MiscUtilityFunctions.h"
+#include "util/TimeUtilityFunctions.h"
+
+using namespace muscle;
+
+static status_t TestBasics()
+{
+   const uint32 baseCount = InternedString::GetNumInternedStrings();
+   {
+      const String longName = "this_node_name_is_too_long_for_the_short_string_optimization";
+
+      InternedString a(longName), b(longName()), c("short"), empty, emptyToo("");
+      TEST(a == b);
+      TEST(a != c);
+      TEST(&a.GetString() == &b.GetString());   // both handles share one copy of the characters
+      TEST(a.GetString() == longName);
+      TEST(a == longName);
+      TEST(strcmp(c(), "short") == 0);
+      TEST(a.HashCode() == longName.HashCode());
+      TEST(c.HashCode() == String("short").HashCode());
+      TEST(a.Length() == longName.Length());
+      TEST((empty == emptyToo)&&(empty.IsEmpty())&&(emptyToo.IsEmpty()));
+      TEST(empty.HashCode() == String().HashCode());
+      TEST(*empty() == '\0');
+      TEST(c < a);
+      TEST(InternedString::GetNumInternedStrings() == baseCount+2);
+
+      // Copies should share the entry; the entry should go away when the last handle does
+      {
+         InternedString d(c);
+         InternedString e; e = d;
+         c.Reset();
+         TEST(e == d);
+         TEST(e == "short");
+         TEST(InternedString::GetNumInternedStrings() == baseCount+2);
+      }
+      TEST(InternedString::GetNumInternedStrings() == baseCount+1);
+
+      // Re-interning a string that was released should give us a working new entry
+      MRETURN_ON_ERROR(c.SetFromString("short"));
+      TEST(c == InternedString("short"));
+      TEST(InternedString::GetNumInternedStrings() == baseCount+2);
+
+      c.SwapContents(a);
+      TEST((c == b)&&(a == "short"));
+   }
+   TEST(InternedString::GetNumInternedStrings() == baseCount);
+   return B_NO_ERROR;
+}
+
+static const uint32 NUM_SHARED_NAMES = 64;
+
+// Repeatedly interns and releases a small set of names that the other threads are interning and releasing at the same time
+class InternThread : public Thread
+{
+public:
+   InternThread(uint32 seed, uint32 numIterations) : Thread(false), _seed(seed), _numIterations(numIterations), _status(B_NO_ERROR) {/* empty */}
+
+   status_t GetStatus() const {return _status;}
+
+   virtual void InternalThreadEntry()
+   {
+      InternedString held[8];
+      uint32 x = _seed;
+      for (uint32 i=0; i<_numIterations; i++)
+      {
+         x = (x*1103515245)+12345;
+         const uint32 nameIdx = (x>>16)%NUM_SHARED_NAMES;
+         char buf[64]; muscleSprintf(buf, "shared_node_name_number_" UINT32_FORMAT_SPEC, nameIdx);
+
+         InternedString & slot = held[i%ARRAYITEMS(held)];
+         if (slot.SetFromString(buf).IsError(_status)) return;
+         if (strcmp(slot(), buf) != 0) {_status = B_LOGIC_ERROR; return;}
+      }
+   }
+
+private:
+   const uint32 _seed;
+   const uint32 _numIterations;
+   status_t _status;
+};
+
+static status_t TestConcurrentInterning()
+{
+   const uint32 baseCount = InternedString::GetNumInternedStrings();
+
+   InternThread * threads[8];
+   for (uint32 i=0; i<ARRAYITEMS(threads); i++) threads[i] = new InternThread(i+1, 200000);
+   for (uint32 i=0; i<ARRAYITEMS(threads); i++) MRETURN_ON_ERROR(threads[i]->StartInternalThread());
+
+   status_t ret;
+   for (uint32 i=0; i<ARRAYITEMS(threads); i++)
+   {
+      (void) threads[i]->WaitForInternalThreadToExit();
+      if (threads[i]->GetStatus().IsError()) ret = threads[i]->GetStatus();
+      delete threads[i];
+   }
+   MRETURN_ON_ERROR(ret);
+
+   TEST(InternedString::GetNumInternedStrings() == baseCount);  // every entry should have been removed by now
+   return B_NO_ERROR;
+}
+
+// Compares the cost of storing and comparing many copies of a few long names, as Strings vs InternedStrings
+static void BenchmarkRepeatedNames(uint32 numNodes, uint32 numDistinctNames)
+{
+   Queue<String> names;
+   for (uint32 i=0; i<numDistinctNames; i++)
+   {
+      char buf[64]; muscleSprintf(buf, "session_node_name_that_is_long_" UINT32_FORMAT_SPEC, i);
+      if (names.AddTail(buf).IsError()) return;
+   }
+
+   {
+      const uint64 startTime = GetRunTime64();
+      Queue<String> strs;
+      if (strs.EnsureSize(numNodes).IsError()) return;
+      for (uint32 i=0; i<numNodes; i++) (void) strs.AddTail(String(names[i%numDistinctNames]()));  // each DataNode used to get its own copy
+      const uint64 storeTime = GetRunTime64()-startTime;
+
+      uint32 numMatches = 0;
+      const uint64 compareStart = GetRunTime64();
+      for (uint32 i=1; i<numNodes; i++) if (strs[i] == strs[i%numDistinctNames]) numMatches++;
+      const uint64 compareTime = GetRunTime64()-compareStart;
+
+      printf("         String:  stored " UINT32_FORMAT_SPEC " names in " UINT64_FORMAT_SPEC " us, compared them in " UINT64_FORMAT_SPEC " us (" UINT32_FORMAT_SPEC " matches), heap bytes for characters ~" UINT64_FORMAT_SPEC "\n", numNodes, storeTime, compareTime, numMatches, (uint64)numNodes*(names[0].Length()+1));
+   }
+
+   {
+      const uint64 startTime = GetRunTime64();
+      Queue<InternedString> strs;
+      if (strs.EnsureSize(numNodes).IsError()) return;
+      for (uint32 i=0; i<numNodes; i++) (void) strs.AddTail(InternedString(names[i%numDistinctNames]));
+      const uint64 storeTime = GetRunTime64()-startTime;
+
+      uint32 numMatches = 0;
+      const uint64 compareStart = GetRunTime64();
+      for (uint32 i=1; i<numNodes; i++) if (strs[i] == strs[i%numDistinctNames]) numMatches++;
+      const uint64 compareTime = GetRunTime64()-compareStart;
+
+      printf(" InternedString:  stored " UINT32_FORMAT_SPEC " names in " UINT64_FORMAT_SPEC " us, compared them in " UINT64_FORMAT_SPEC " us (" UINT32_FORMAT_SPEC " matches), heap bytes for characters ~" UINT64_FORMAT_SPEC "\n", numNodes, storeTime, compareTime, numMatches, (uint64)numDistinctNames*(names[0].Length()+1));
+   }
+}
+
+// This program tests the InternedString class, and benchmarks it if run interactively
+int main(int argc, char ** argv)
+{
+   CompleteSetupSystem css;
+
+   Message args; (void) ParseArgs(argc, argv, args);
+   const bool isFromScript = args.HasName("fromscript");
+
+   status_t ret;
+   if ((TestBasics().IsError(ret))||(TestConcurrentInterning().IsError(ret)))
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "InternedString test failed [%s]\n", ret());
+      return 10;
+   }
+   printf("InternedString tests passed.\n");
+
+   if (isFromScript == false)
+   {
+      printf("Benchmarking repeated node names:\n");
+      BenchmarkRepeatedNames(1000000, 50);
+   }
+   return 0;
+}
@@ -0,0 +1,265 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#include <stdio.h>
+
+#include "system/GlobalMemoryAllocator.h"
+#include "system/SetupSystem.h"
+#include "system/Thread.h"
+#include "test/TestMacros.h"
+#include "util/MiscUtilityFunctions.h"
+#include "util/TimeUtilityFunctions.h"
+
+using namespace muscle;
+
+#ifdef MUSCLE_ENABLE_MEMORY_TRACKING
+
+static const size_t MAX_HEADER_BYTES = 64;  // generous upper bound on muscleAlloc()'s per-allocation overhead (including memory-paranoia guards)
+
+static size_t GetExactNumAllocatedBytes()
+{
+   FlushCurrentThreadMemoryAccounting();
+   return GetNumAllocatedBytes();
+}
+
+static size_t GetExactNumAllocatedBytesForTag(uint32 tag)
+{
+   FlushCurrentThreadMemoryAccounting();
+   return GetNumAllocatedBytesForTag(tag);
+}
+
+static status_t TestBasics()
+{
+   const size_t baseBytes = GetExactNumAllocatedBytes();
+
+   void * ptrs[100];
+   for (uint32 i=0; i<ARRAYITEMS(ptrs); i++) {ptrs[i] = muscleAlloc(1000); MRETURN_OOM_ON_NULL(ptrs[i]);}
+
+   const size_t usedBytes = GetExactNumAllocatedBytes()-baseBytes;
+   TEST(usedBytes >= ARRAYITEMS(ptrs)*1000);
+   TEST(usedBytes <= ARRAYITEMS(ptrs)*(1000+MAX_HEADER_BYTES));
+
+   for (uint32 i=0; i<ARRAYITEMS(ptrs); i++) muscleFree(ptrs[i]);
+   TEST(GetExactNumAllocatedBytes() == baseBytes);
+
+   // Without a flush, the process-wide tally should still be within a couple of batches of the truth
+   for (uint32 i=0; i<ARRAYITEMS(ptrs); i++) {ptrs[i] = muscleAlloc(1000); MRETURN_OOM_ON_NULL(ptrs[i]);}
+   const size_t lazyBytes = GetNumAllocatedBytes()-baseBytes;
+   TEST(lazyBytes >= ARRAYITEMS(ptrs)*1000);
+   TEST(lazyBytes <= (ARRAYITEMS(ptrs)*(1000+MAX_HEADER_BYTES))+(2*MUSCLE_MEMORY_TRACKING_THREAD_BATCH_BYTES));
+   for (uint32 i=0; i<ARRAYITEMS(ptrs); i++) muscleFree(ptrs[i]);
+   TEST(GetExactNumAllocatedBytes() == baseBytes);
+   return B_NO_ERROR;
+}
+
+static status_t TestTags()
+{
+#ifdef MUSCLE_64_BIT_PLATFORM
+   TEST(strcmp(GetMemoryTagName(MUSCLE_MEMORY_TAG_BYTEBUFFERS), "ByteBuffers") == 0);
+   TEST(GetMemoryTagName(NUM_MUSCLE_MEMORY_TAGS) == NULL);
+
+   const size_t baseBB  = GetExactNumAllocatedBytesForTag(MUSCLE_MEMORY_TAG_BYTEBUFFERS);
+   const size_t baseMsg = GetExactNumAllocatedBytesForTag(MUSCLE_MEMORY_TAG_MESSAGES);
+
+   void * p;
+   {
+      DECLARE_MEMORY_TAG_GUARD(MUSCLE_MEMORY_TAG_BYTEBUFFERS);
+      p = muscleAlloc(50000);
+      MRETURN_OOM_ON_NULL(p);
+      {
+         MemoryTagGuard nested(MUSCLE_MEMORY_TAG_MESSAGES);
+         void * q = muscleAlloc(100);
+         TEST(GetExactNumAllocatedBytesForTag(MUSCLE_MEMORY_TAG_MESSAGES) >= baseMsg+100);
+         muscleFree(q);
+      }
+      TEST(GetExactNumAllocatedBytesForTag(MUSCLE_MEMORY_TAG_MESSAGES) == baseMsg);
+   }
+   TEST(GetExactNumAllocatedBytesForTag(MUSCLE_MEMORY_TAG_BYTEBUFFERS) >= baseBB+50000);
+
+   // Resizing the buffer outside of the guard's scope should keep it tallied under its original tag
+   void * p2 = muscleRealloc(p, 100000);
+   MRETURN_OOM_ON_NULL(p2);
+   TEST(GetExactNumAllocatedBytesForTag(MUSCLE_MEMORY_TAG_BYTEBUFFERS) >= baseBB+100000);
+   p = muscleRealloc(p2, 10);
+   MRETURN_OOM_ON_NULL(p);
+   TEST(GetExactNumAllocatedBytesForTag(MUSCLE_MEMORY_TAG_BYTEBUFFERS) <= baseBB+10+MAX_HEADER_BYTES);
+
+   muscleFree(p);
+   TEST(GetExactNumAllocatedBytesForTag(MUSCLE_MEMORY_TAG_BYTEBUFFERS) == baseBB);
+#endif
+   return B_NO_ERROR;
+}
+
+// Allocates a bunch of tagged buffers and hands them to the main thread to free
+class AllocatorThread : public Thread
+{
+public:
+   AllocatorThread() : Thread(false) {/* empty */}
+
+   virtual void InternalThreadEntry()
+   {
+      DECLARE_MEMORY_TAG_GUARD(MUSCLE_MEMORY_TAG_DATANODES);
+      for (uint32 i=0; i<ARRAYITEMS(_ptrs); i++) _ptrs[i] = muscleAlloc(1000);
+   }
+
+   void * _ptrs[200];
+};
+
+static status_t TestCrossThreadFrees()
+{
+   const size_t baseTag = GetExactNumAllocatedBytesForTag(MUSCLE_MEMORY_TAG_DATANODES);
+
+   AllocatorThread * t = new AllocatorThread;
+   MRETURN_ON_ERROR(t->StartInternalThread());
+   MRETURN_ON_ERROR(t->WaitForInternalThreadToExit());  // the thread's exit-handler should hand back its reserve
+
+#ifdef MUSCLE_64_BIT_PLATFORM
+   TEST(GetExactNumAllocatedBytesForTag(MUSCLE_MEMORY_TAG_DATANODES) >= baseTag+(ARRAYITEMS(t->_ptrs)*1000));
+#endif
+
+   for (uint32 i=0; i<ARRAYITEMS(t->_ptrs); i++) {TEST(t->_ptrs[i] != NULL); muscleFree(t->_ptrs[i]);}
+   delete t;
+
+   TEST(GetExactNumAllocatedBytesForTag(MUSCLE_MEMORY_TAG_DATANODES) == baseTag);  // even though the frees were all done by a different thread
+   return B_NO_ERROR;
+}
+
+// Frees buffers that were allocated by the main thread, and never allocates anything itself
+class FreerThread : public Thread
+{
+public:
+   FreerThread() : Thread(false) {/* empty */}
+
+   virtual void InternalThreadEntry() {for (uint32 i=0; i<ARRAYITEMS(_ptrs); i++) muscleFree(_ptrs[i]);}
+
+   void * _ptrs[200];
+};
+
+// Makes sure a thread that only frees still hands back its reserve and its tag-deltas when it exits
+static status_t TestFreeOnlyThread()
+{
+   const size_t baseBytes = GetExactNumAllocatedBytes();
+   const size_t baseTag   = GetExactNumAllocatedBytesForTag(MUSCLE_MEMORY_TAG_DATANODES);
+
+   FreerThread * t = new FreerThread;
+   {
+      DECLARE_MEMORY_TAG_GUARD(MUSCLE_MEMORY_TAG_DATANODES);
+      for (uint32 i=0; i<ARRAYITEMS(t->_ptrs); i++) {t->_ptrs[i] = muscleAlloc(1000); MRETURN_OOM_ON_NULL(t->_ptrs[i]);}
+   }
+   MRETURN_ON_ERROR(t->StartInternalThread());
+   MRETURN_ON_ERROR(t->WaitForInternalThreadToExit());
+   delete t;
+
+   TEST(GetExactNumAllocatedBytesForTag(MUSCLE_MEMORY_TAG_DATANODES) == baseTag);
+   TEST(GetExactNumAllocatedBytes() == baseBytes);
+   return B_NO_ERROR;
+}
+
+static status_t TestUsageLimit()
+{
+   FlushCurrentThreadMemoryAccounting();
+
+   const size_t limit = GetNumAllocatedBytes()+(1024*1024);
+   UsageLimitProxyMemoryAllocator ulpma(MemoryAllocatorRef(), limit);
+   SetCPlusPlusGlobalMemoryAllocator(DummyMemoryAllocatorRef(ulpma));
+
+   printf("(The following allocation is expected to fail)\n");
+   void * tooBig = muscleAlloc(2*1024*1024);
+   void * okay   = muscleAlloc(256*1024);
+
+   // Many small allocations should also be held to the limit, give or take a batch or two
+   Queue<void *> smalls;
+   for (uint32 i=0; i<2048; i++)
+   {
+      void * p = muscleAlloc(1024, false);
+      if (p == NULL) break;
+      (void) smalls.AddTail(p);
+   }
+   const bool allocationFailed = ulpma.HasAllocationFailed();
+
+   SetCPlusPlusGlobalMemoryAllocator(MemoryAllocatorRef());
+   for (uint32 i=0; i<smalls.GetNumItems(); i++) muscleFree(smalls[i]);
+   muscleFree(okay);
+   muscleFree(tooBig);
+
+   TEST(tooBig == NULL);
+   TEST(okay != NULL);
+   TEST(allocationFailed);
+   TEST(smalls.GetNumItems() > 512);   // there was ~768KB of room left
+   TEST(smalls.GetNumItems() < 1024);
+   return B_NO_ERROR;
+}
+
+// Allocates and frees small buffers as fast as it can
+class BenchmarkThread : public Thread
+{
+public:
+   BenchmarkThread(uint32 numIterations) : Thread(false), _numIterations(numIterations) {/* empty */}
+
+   virtual void InternalThreadEntry()
+   {
+      void * ptrs[16] = {NULL};
+      for (uint32 i=0; i<_numIterations; i++)
+      {
+         void * & p = ptrs[i%ARRAYITEMS(ptrs)];
+         muscleFree(p);
+         p = muscleAlloc(32+(i%256));
+      }
+      for (uint32 i=0; i<ARRAYITEMS(ptrs); i++) muscleFree(ptrs[i]);
+   }
+
+private:
+   const uint32 _numIterations;
+};
+
+static void BenchmarkAllocations(uint32 numThreads, bool withLimit)
+{
+   UsageLimitProxyMemoryAllocator ulpma(MemoryAllocatorRef(), ((size_t)1)<<40);
+   if (withLimit) SetCPlusPlusGlobalMemoryAllocator(DummyMemoryAllocatorRef(ulpma));
+
+   const uint32 numIterations = 2000000;
+   Queue<BenchmarkThread *> threads;
+   for (uint32 i=0; i<numThreads; i++) (void) threads.AddTail(new BenchmarkThread(numIterations));
+
+   const uint64 startTime = GetRunTime64();
+   for (uint32 i=0; i<numThreads; i++) (void) threads[i]->StartInternalThread();
+   for (uint32 i=0; i<numThreads; i++) {(void) threads[i]->WaitForInternalThreadToExit(); delete threads[i];}
+   const uint64 elapsed = GetRunTime64()-startTime;
+
+   if (withLimit) SetCPlusPlusGlobalMemoryAllocator(MemoryAllocatorRef());
+   printf("  " UINT32_FORMAT_SPEC " thread(s), %s:  %.1f nanoseconds per muscleAlloc()/muscleFree() pair\n", numThreads, withLimit?"with a usage-limit":"   no usage-limit", (1000.0*elapsed)/(numThreads*numIterations));
+}
+
+#endif
+
+// This program tests the per-thread memory accounting that muscleAlloc()/muscleFree() do when MUSCLE_ENABLE_MEMORY_TRACKING is defined
+int main(int argc, char ** argv)
+{
+   CompleteSetupSystem css;
+
+   Message args; (void) ParseArgs(argc, argv, args);
+   const bool isFromScript = args.HasName("fromscript");
+
+#ifdef MUSCLE_ENABLE_MEMORY_TRACKING
+   status_t ret;
+   if ((TestBasics().IsError(ret))||(TestTags().IsError(ret))||(TestCrossThreadFrees().IsError(ret))||(TestFreeOnlyThread().IsError(ret))||(TestUsageLimit().IsError(ret)))
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "Memory-tracking test failed [%s]\n", ret());
+      return 10;
+   }
+   printf("Memory-tracking tests passed.\n");
+
+   if (isFromScript == false)
+   {
+      printf("Benchmarking muscleAlloc()/muscleFree():\n");
+      for (uint32 i=1; i<=4; i*=2)
+      {
+         BenchmarkAllocations(i, false);
+         BenchmarkAllocations(i, true);
+      }
+   }
+#else
+   (void) isFromScript;
+   printf("MUSCLE_ENABLE_MEMORY_TRACKING isn't defined, so there is nothing to test.\n");
+#endif
+   return 0;
+}
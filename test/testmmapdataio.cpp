@@ -0,0 +1,143 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#include <stdio.h>
+
+#include "dataio/FileDataIO.h"
+#include "dataio/MMapDataIO.h"
+#include "message/Message.h"
+#include "system/SetupSystem.h"
+#include "util/MiscUtilityFunctions.h"
+
+using namespace muscle;
+
+static const char * TEST_FILE_NAME = "testmmapdataio.tmp";
+
+// Writes a flattened Message containing (numBlobs) blobs of (blobSize) bytes each to our test file
+static status_t WriteTestFile(uint32 numBlobs, uint32 blobSize, Message & retMsg)
+{
+   retMsg.Clear();
+   ByteBuffer blob;
+   MRETURN_ON_ERROR(blob.SetNumBytes(blobSize, false));
+   for (uint32 i=0; i<numBlobs; i++)
+   {
+      for (uint32 j=0; j<blobSize; j++) blob.GetBuffer()[j] = (uint8) (i+j);
+      MRETURN_ON_ERROR(retMsg.AddData("blob", B_RAW_TYPE, blob.GetBuffer(), blob.GetNumBytes()));
+      MRETURN_ON_ERROR(retMsg.AddString("name", String("Blob #%1").Arg(i)));
+   }
+
+   ByteBufferRef flat = retMsg.FlattenToByteBuffer();
+   MRETURN_OOM_ON_NULL(flat());
+
+   FileDataIO fdio(muscleFopen(TEST_FILE_NAME, "wb"));
+   if (fdio.GetFile() == NULL) return B_ERRNO;
+   return fdio.WriteFully(flat()->GetBuffer(), flat()->GetNumBytes());
+}
+
+static status_t TestMMapDataIO()
+{
+   Message origMsg;
+   MRETURN_ON_ERROR(WriteTestFile(10, 10000, origMsg));
+
+   ConstByteBufferRef slice;
+   {
+      MMapDataIO mmio(TEST_FILE_NAME);
+      if (mmio.IsMapped() == false) return B_IO_ERROR;
+      if (mmio.GetLength() != (int64) origMsg.FlattenedSize())
+      {
+         LogTime(MUSCLE_LOG_CRITICALERROR, "MMapDataIO reported length " INT64_FORMAT_SPEC ", expected " UINT32_FORMAT_SPEC "\n", mmio.GetLength(), origMsg.FlattenedSize());
+         return B_LOGIC_ERROR;
+      }
+      (void) mmio.SetAccessPatternHint(MMapDataIO::MMAP_ACCESS_SEQUENTIAL);  // just to make sure it doesn't crash; it's okay if it's unimplemented
+
+      // Reading via the DataIO interface should give us the same bytes as the zero-copy slice does
+      ByteBuffer readBuf;
+      MRETURN_ON_ERROR(readBuf.SetNumBytes((uint32) mmio.GetLength(), false));
+      MRETURN_ON_ERROR(mmio.ReadFully(readBuf.GetBuffer(), readBuf.GetNumBytes()));
+      if (mmio.Read(readBuf.GetBuffer(), 1).GetStatus() != B_END_OF_STREAM) return B_LOGIC_ERROR;
+      if (mmio.Write(readBuf.GetBuffer(), 1).GetStatus() != B_ACCESS_DENIED) return B_LOGIC_ERROR;
+
+      MRETURN_ON_ERROR(mmio.Seek(0, SeekableDataIO::IO_SEEK_SET));
+      slice = mmio.ReadSlice(MUSCLE_NO_LIMIT);
+      MRETURN_OOM_ON_NULL(slice());
+      if ((*slice() != readBuf)||(slice()->GetBuffer() != mmio.GetMappedBytes())||(mmio.GetPosition() != mmio.GetLength())) return B_LOGIC_ERROR;
+
+      // Check some slices that don't start at the beginning of the file
+      const uint32 offsets[] = {1, 100, 4095, 4096, 4097, readBuf.GetNumBytes()-1, readBuf.GetNumBytes()};
+      for (uint32 i=0; i<ARRAYITEMS(offsets); i++)
+      {
+         ConstByteBufferRef subSlice = mmio.GetSlice(offsets[i], 5000);
+         MRETURN_OOM_ON_NULL(subSlice());
+         const uint32 expectedSize = muscleMin((uint32)5000, readBuf.GetNumBytes()-offsets[i]);
+         if ((subSlice()->GetNumBytes() != expectedSize)||(memcmp(subSlice()->GetBuffer(), readBuf.GetBuffer()+offsets[i], expectedSize) != 0))
+         {
+            LogTime(MUSCLE_LOG_CRITICALERROR, "Slice at offset " UINT32_FORMAT_SPEC " didn't match!\n", offsets[i]);
+            return B_LOGIC_ERROR;
+         }
+      }
+      if (mmio.GetSlice(readBuf.GetNumBytes()+1, 1)() != NULL) return B_LOGIC_ERROR;  // out of range
+   }
+
+   // (slice) should still be valid even though the MMapDataIO is gone
+   Message msg;
+   MRETURN_ON_ERROR(msg.UnflattenFromByteBuffer(slice));
+   if (msg != origMsg)
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "Message unflattened from the mapped file didn't match the original!\n");
+      return B_LOGIC_ERROR;
+   }
+   return B_NO_ERROR;
+}
+
+static void BenchmarkLoad(uint32 numBlobs, uint32 blobSize)
+{
+   Message origMsg;
+   if (WriteTestFile(numBlobs, blobSize, origMsg).IsError()) return;
+
+   for (uint32 pass=0; pass<2; pass++)
+   {
+      const uint64 startTime = GetRunTime64();
+      Message msg;
+      status_t ret;
+      if (pass == 0)
+      {
+         FileDataIO fdio(muscleFopen(TEST_FILE_NAME, "rb"));
+         ByteBufferRef buf = GetByteBufferFromPool((uint32) fdio.GetLength());
+         if ((buf())&&(fdio.ReadFully(buf()->GetBuffer(), buf()->GetNumBytes()).IsOK(ret))) ret = msg.UnflattenFromByteBuffer(buf);
+      }
+      else
+      {
+         MMapDataIO mmio(TEST_FILE_NAME);
+         (void) mmio.SetAccessPatternHint(MMapDataIO::MMAP_ACCESS_SEQUENTIAL);
+         ret = msg.UnflattenFromByteBuffer(mmio.GetSlice(0, MUSCLE_NO_LIMIT));
+      }
+      const uint64 elapsed = muscleMax(GetRunTime64()-startTime, (uint64)1);
+      printf("   %s:  loaded a " UINT32_FORMAT_SPEC "-byte Message in " UINT64_FORMAT_SPEC " microseconds (%.1f MB/sec) [%s]\n", (pass==0)?"FileDataIO":"MMapDataIO", origMsg.FlattenedSize(), elapsed, ((double)origMsg.FlattenedSize())/elapsed, ret());
+   }
+}
+
+// This program tests the MMapDataIO class, and benchmarks it against FileDataIO if run interactively
+int main(int argc, char ** argv)
+{
+   CompleteSetupSystem css;
+
+   Message args; (void) ParseArgs(argc, argv, args);
+   const bool isFromScript = args.HasName("fromscript");
+
+   status_t ret;
+   if (TestMMapDataIO().IsError(ret))
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "MMapDataIO test failed [%s]\n", ret());
+      (void) remove(TEST_FILE_NAME);
+      return 10;
+   }
+   printf("MMapDataIO test passed.\n");
+
+   if (isFromScript == false)
+   {
+      printf("Benchmarking Message-loading:\n");
+      BenchmarkLoad(200, 1024*1024);
+   }
+
+   (void) remove(TEST_FILE_NAME);
+   return 0;
+}
@@ -4,10 +4,12 @@
 #include "reflector/AbstractReflectSession.h"
 #include "reflector/ReflectServer.h"
 #include "system/SetupSystem.h"
+#include "test/TestMacros.h"
 #include "util/MiscUtilityFunctions.h"
 #include "util/NetworkUtilityFunctions.h"
 #include "util/PulseNode.h"
 #include "util/String.h"
+#include "util/TimeUtilityFunctions.h"
 
 using namespace muscle;
 
@@ -91,6 +93,199 @@ void TestPulseChild :: CheckForEndOfTest()
    static_cast<TestSession *>(GetPulseParent())->CheckForEndOfTest();
 }
 
+static uint32 _randSeed = 12345;
+static uint32 GetNextRandomNumber() {_randSeed = (_randSeed*1103515245)+12345; return _randSeed>>8;}
+
+// A PulseNode that wants to be pulsed at a pseudo-random interval, and keeps track of when it was pulsed
+class RandomPulseChild : public PulseNode
+{
+public:
+   RandomPulseChild() : _nextTime(MUSCLE_TIME_NEVER), _lastPulsedAt(MUSCLE_TIME_NEVER), _numPulses(0), _numEarlyPulses(0) {/* empty */}
+
+   virtual uint64 GetPulseTime(const PulseArgs &) {return _nextTime;}
+
+   virtual void Pulse(const PulseArgs & args)
+   {
+      if (args.GetCallbackTime() < _nextTime) _numEarlyPulses++;
+      _lastPulsedAt = args.GetCallbackTime();
+      _numPulses++;
+      _nextTime = args.GetCallbackTime()+1+(GetNextRandomNumber()%1000000);
+   }
+
+   void SetNextTime(uint64 nextTime) {_nextTime = nextTime; InvalidatePulseTime();}
+
+   uint64 _nextTime;
+   uint64 _lastPulsedAt;
+   uint32 _numPulses;
+   uint32 _numEarlyPulses;
+};
+
+// Drives a tree of PulseNodes using a simulated clock, the same way ReflectServer drives its sessions
+class SimulatedPulseNodeManager : public PulseNodeManager
+{
+public:
+   SimulatedPulseNodeManager(PulseNode & root) : _root(root), _now(0) {/* empty */}
+
+   // Returns the root's next pulse time
+   uint64 GetNextPulseTime()
+   {
+      uint64 min = MUSCLE_TIME_NEVER;
+      CallGetPulseTimeAux(_root, _now, min);
+      return min;
+   }
+
+   void AdvanceTo(uint64 t)
+   {
+      _now = t;
+      CallSetCycleStartTime(_root, _now);
+      CallPulseAux(_root, _now);
+   }
+
+   uint64 GetNow() const {return _now;}
+
+private:
+   PulseNode & _root;
+   uint64 _now;
+};
+
+// Checks that the children of a PulseNode get pulsed at the right times, even as they are rescheduled, added and removed
+static status_t TestPulseScheduling()
+{
+   const uint32 numChildren = 2000;
+   RandomPulseChild children[numChildren];
+   PulseNode root, middle;
+   SimulatedPulseNodeManager pnm(root);
+   root.PutPulseChild(&middle);
+   for (uint32 i=0; i<numChildren; i++)
+   {
+      children[i]._nextTime = (i%10 == 0) ? MUSCLE_TIME_NEVER : (GetNextRandomNumber()%1000000);
+      ((i%2)?root:middle).PutPulseChild(&children[i]);
+   }
+
+   for (uint32 step=0; step<20000; step++)
+   {
+      uint64 expectedMin = MUSCLE_TIME_NEVER;
+      for (uint32 i=0; i<numChildren; i++) if (children[i].GetPulseParent()) expectedMin = muscleMin(expectedMin, children[i]._nextTime);
+
+      const uint64 nextTime = pnm.GetNextPulseTime();
+      TEST(nextTime == expectedMin);
+      if (nextTime == MUSCLE_TIME_NEVER) break;
+
+      pnm.AdvanceTo(nextTime);
+      for (uint32 i=0; i<numChildren; i++)
+      {
+         const RandomPulseChild & c = children[i];
+         if (c.GetPulseParent()) TEST(c._nextTime > pnm.GetNow());  // nobody who is due should have been skipped
+      }
+
+      // Shake things up a bit, the way sessions do when their keepalive or reconnect times change
+      RandomPulseChild & c = children[GetNextRandomNumber()%numChildren];
+      switch(GetNextRandomNumber()%4)
+      {
+         case 0:  c.SetNextTime(pnm.GetNow()+(GetNextRandomNumber()%1000000));  break;
+         case 1:  c.SetNextTime(MUSCLE_TIME_NEVER);                             break;
+         case 2:  if (c.GetPulseParent()) c.GetPulseParent()->RemovePulseChild(&c); else ((GetNextRandomNumber()%2)?root:middle).PutPulseChild(&c); break;
+         default: /* empty */ break;
+      }
+   }
+
+   for (uint32 i=0; i<numChildren; i++) TEST(children[i]._numEarlyPulses == 0);
+   root.ClearPulseChildren();
+   middle.ClearPulseChildren();
+   for (uint32 i=0; i<numChildren; i++) TEST(children[i].GetPulseParent() == NULL);
+   return B_NO_ERROR;
+}
+
+// A PulseNode that wants to be pulsed once, at a given time, and records the order it was pulsed in
+class OrderedPulseChild : public PulseNode
+{
+public:
+   OrderedPulseChild() : _id(0), _pulseOrder(NULL), _nextTime(MUSCLE_TIME_NEVER) {/* empty */}
+
+   virtual uint64 GetPulseTime(const PulseArgs &) {return _nextTime;}
+
+   virtual void Pulse(const PulseArgs &)
+   {
+      (void) _pulseOrder->AddTail(_id);
+      _nextTime = MUSCLE_TIME_NEVER;
+   }
+
+   void SetNextTime(uint64 nextTime) {_nextTime = nextTime; InvalidatePulseTime();}
+
+   uint32 _id;
+   Queue<uint32> * _pulseOrder;
+   uint64 _nextTime;
+};
+
+// Checks that children that are due at the same time get pulsed in the order they were scheduled in
+static status_t TestEqualTimeOrder()
+{
+   const uint32 numChildren = 200;
+   const uint64 dueTime = 1000;
+   Queue<uint32> pulseOrder;
+   OrderedPulseChild children[numChildren];
+   PulseNode root;
+   SimulatedPulseNodeManager pnm(root);
+   for (uint32 i=0; i<numChildren; i++)
+   {
+      children[i]._id = i;
+      children[i]._pulseOrder = &pulseOrder;
+      root.PutPulseChild(&children[i]);
+   }
+   (void) pnm.GetNextPulseTime();
+
+   // Every third child gets scheduled for earlier or later, so that the heap has some structure to it
+   for (uint32 i=0; i<numChildren; i++)
+   {
+      children[i].SetNextTime((i%3 == 0) ? (dueTime-1-(GetNextRandomNumber()%100)) : ((i%3 == 1) ? dueTime : (dueTime+1+(GetNextRandomNumber()%100))));
+      (void) pnm.GetNextPulseTime();  // schedule each child separately, so that they are scheduled in order
+   }
+
+   // Pulse the earlier ones, so that the heap has been restructured by the time the equal-time children are due
+   pnm.AdvanceTo(dueTime-1);
+   TEST(pnm.GetNextPulseTime() == dueTime);
+   pulseOrder.Clear();
+
+   pnm.AdvanceTo(dueTime);
+   uint32 expectedID = 1;
+   TEST(pulseOrder.GetNumItems() == (numChildren+1)/3);
+   for (uint32 i=0; i<pulseOrder.GetNumItems(); i++, expectedID += 3) TEST(pulseOrder[i] == expectedID);
+
+   root.ClearPulseChildren();
+   return B_NO_ERROR;
+}
+
+// Measures how long it takes to service (numPulses) Pulse() calls spread across (numChildren) children with random pulse-intervals
+static void BenchmarkPulseScheduling(uint32 numChildren, uint32 numPulses)
+{
+   RandomPulseChild * children = newnothrow_array(RandomPulseChild, numChildren);
+   if (children == NULL) {MWARN_OUT_OF_MEMORY; return;}
+
+   PulseNode root;
+   SimulatedPulseNodeManager pnm(root);
+   for (uint32 i=0; i<numChildren; i++)
+   {
+      children[i]._nextTime = GetNextRandomNumber()%1000000;
+      root.PutPulseChild(&children[i]);
+   }
+
+   const uint64 startTime = GetRunTime64();
+   uint32 numPulsesSoFar = 0;
+   while(numPulsesSoFar < numPulses)
+   {
+      const uint64 nextTime = pnm.GetNextPulseTime();
+      if (nextTime == MUSCLE_TIME_NEVER) break;
+      pnm.AdvanceTo(nextTime);
+      numPulsesSoFar++;
+   }
+   const uint64 elapsed = GetRunTime64()-startTime;
+
+   printf("  " UINT32_FORMAT_SPEC " children:  serviced " UINT32_FORMAT_SPEC " pulses in %.3f seconds (%.1f nanoseconds per pulse)\n", numChildren, numPulsesSoFar, ((double)elapsed)/MICROS_PER_SECOND, (1000.0*elapsed)/muscleMax(numPulsesSoFar, (uint32)1));
+
+   root.ClearPulseChildren();
+   delete [] children;
+}
+
 int main(int argc, char ** argv)
 {
    CompleteSetupSystem css;  // set up our environment
@@ -98,10 +293,34 @@ int main(int argc, char ** argv)
    Message args; (void) ParseArgs(argc, argv, args);
    HandleStandardDaemonArgs(args);
 
-   ReflectServer server;
-   TestSession session(args.HasName("fromscript") ? 100 : -1);
+   const bool isFromScript = args.HasName("fromscript");
 
    status_t ret;
+   if (TestPulseScheduling().IsError(ret))
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "PulseNode scheduling test failed [%s]\n", ret());
+      return 10;
+   }
+   LogTime(MUSCLE_LOG_INFO, "PulseNode scheduling test passed.\n");
+
+   if (TestEqualTimeOrder().IsError(ret))
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "PulseNode equal-time ordering test failed [%s]\n", ret());
+      return 10;
+   }
+   LogTime(MUSCLE_LOG_INFO, "PulseNode equal-time ordering test passed.\n");
+
+   if ((isFromScript == false)||(args.HasName("benchmark")))
+   {
+      printf("Benchmarking PulseNode scheduling:\n");
+      BenchmarkPulseScheduling(1000,   1000000);
+      BenchmarkPulseScheduling(100000, 1000000);
+      if (args.HasName("benchmark")) return 0;
+   }
+
+   ReflectServer server;
+   TestSession session(isFromScript ? 100 : -1);
+
    if (server.AddNewSession(DummyAbstractReflectSessionRef(session)).IsOK(ret))
    {
       LogTime(MUSCLE_LOG_INFO, "Beginning PulseNode test...\n");
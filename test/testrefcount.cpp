@@ -4,11 +4,13 @@
 
 #include "system/SetupSystem.h"
 #include "system/Thread.h"
+#include "test/TestMacros.h"
 #include "util/String.h"
 #include "util/RefCount.h"
 #include "util/Queue.h"
 #include "util/Hashtable.h"
 #include "util/MiscUtilityFunctions.h"
+#include "util/TimeUtilityFunctions.h"
 
 using namespace muscle;
 
@@ -73,6 +75,164 @@ public:
    }
 };
 
+static AtomicCounter _numLiveCountedItems;
+
+// Keeps track of how many instances of it exist, so we can tell exactly when they get deleted
+class CountedItem : public RefCountable
+{
+public:
+   CountedItem()  {(void) _numLiveCountedItems.AtomicIncrement();}
+   ~CountedItem() {(void) _numLiveCountedItems.AtomicDecrement();}
+};
+DECLARE_REFTYPES(CountedItem);
+
+// RefCountable is deliberately not this class's first base class, so that recycling it requires a pointer-adjustment
+class OffsetBase
+{
+public:
+   OffsetBase() : _padding(0) {/* empty */}
+   virtual ~OffsetBase() {/* empty */}
+
+   uint64 _padding;
+};
+
+class PooledOffsetItem : public OffsetBase, public RefCountable
+{
+public:
+   PooledOffsetItem() {/* empty */}
+};
+DECLARE_REFTYPES(PooledOffsetItem);
+static PooledOffsetItemRef::ItemPool _offsetPool;
+
+// Releases (and re-references) the Refs it was handed before it was started, in its own thread
+class ReleaserThread : public Thread
+{
+public:
+   ReleaserThread() {/* empty */}
+
+   virtual void InternalThreadEntry()
+   {
+      for (uint32 i=0; i<_countedRefs.GetNumItems(); i++)
+      {
+         CountedItemRef copy = _countedRefs[i];  // a non-owner copy goes into the shared count
+         _countedRefs[i].Reset();
+      }
+      _countedRefs.Clear();
+      _pooledRefs.Clear();
+   }
+
+   Queue<CountedItemRef> _countedRefs;
+   Queue<PooledOffsetItemRef> _pooledRefs;
+};
+
+static status_t TestBiasedRefCounting()
+{
+   if (SetBiasedRefCountingEnabledForCurrentThread(true) == B_UNIMPLEMENTED)
+   {
+      printf("Biased reference-counting is compiled out of this build; skipping its tests.\n");
+      return B_NO_ERROR;
+   }
+   TEST(IsBiasedRefCountingEnabledForCurrentThread());
+
+   const int32 baseLiveCount = _numLiveCountedItems.GetCount();
+
+   // Owner-thread-only usage:  objects should go away as soon as their last Ref does
+   {
+      CountedItemRef a(new CountedItem);
+      TEST(a.IsRefPrivate());
+      TEST(a()->GetRefCount() == 1);
+      {
+         CountedItemRef b = a;
+         ConstCountedItemRef c = b;
+         TEST(a()->GetRefCount() == 3);
+         TEST(a.IsRefPrivate() == false);
+      }
+      TEST(a.IsRefPrivate());
+      TEST(_numLiveCountedItems.GetCount() == baseLiveCount+1);
+   }
+   TEST(_numLiveCountedItems.GetCount() == baseLiveCount);
+
+   // Refs created by this (owner) thread but released by another thread should be freed at our next merge
+   const uint32 numItems = 1000;
+   {
+      ReleaserThread releaser;
+      for (uint32 i=0; i<numItems; i++)
+      {
+         CountedItemRef r(new CountedItem);
+         MRETURN_ON_ERROR(releaser._countedRefs.AddTail(r));
+
+         PooledOffsetItemRef pr(_offsetPool.ObtainObject());
+         MRETURN_OOM_ON_NULL(pr());
+         MRETURN_ON_ERROR(releaser._pooledRefs.AddTail(pr));
+      }
+      TEST(_numLiveCountedItems.GetCount() == (int32)(baseLiveCount+numItems));
+
+      MRETURN_ON_ERROR(releaser.StartInternalThread());
+      MRETURN_ON_ERROR(releaser.WaitForInternalThreadToExit());
+
+      TEST(_numLiveCountedItems.GetCount() == (int32)(baseLiveCount+numItems));  // still biased towards us, so not freed yet
+      MergeBiasedRefCountsForCurrentThread();
+      TEST(_numLiveCountedItems.GetCount() == baseLiveCount);
+   }
+
+   // Same thing, but with references still held by this thread while the other thread releases its own
+   {
+      ReleaserThread releaser;
+      Queue<CountedItemRef> kept;
+      for (uint32 i=0; i<numItems; i++)
+      {
+         CountedItemRef r(new CountedItem);
+         MRETURN_ON_ERROR(kept.AddTail(r));
+         MRETURN_ON_ERROR(releaser._countedRefs.AddTail(r));
+      }
+      MRETURN_ON_ERROR(releaser.StartInternalThread());
+      MRETURN_ON_ERROR(releaser.WaitForInternalThreadToExit());
+
+      MergeBiasedRefCountsForCurrentThread();
+      TEST(_numLiveCountedItems.GetCount() == (int32)(baseLiveCount+numItems));  // we still reference them all
+      for (uint32 i=0; i<kept.GetNumItems(); i++) TEST(kept[i].IsRefPrivate());
+      kept.Clear();
+      TEST(_numLiveCountedItems.GetCount() == baseLiveCount);
+   }
+
+   // Once we disable biasing, other threads should be able to free the objects that were biased towards us on their own
+   {
+      ReleaserThread releaser;
+      for (uint32 i=0; i<numItems; i++)
+      {
+         CountedItemRef r(new CountedItem);
+         MRETURN_ON_ERROR(releaser._countedRefs.AddTail(r));
+      }
+      MRETURN_ON_ERROR(SetBiasedRefCountingEnabledForCurrentThread(false));
+      TEST(IsBiasedRefCountingEnabledForCurrentThread() == false);
+
+      MRETURN_ON_ERROR(releaser.StartInternalThread());
+      MRETURN_ON_ERROR(releaser.WaitForInternalThreadToExit());
+      TEST(_numLiveCountedItems.GetCount() == baseLiveCount);
+   }
+   return B_NO_ERROR;
+}
+
+// Times how long it takes to copy and release a Ref many times over, with and without biasing
+static void BenchmarkRefCounting(bool biased)
+{
+   (void) SetBiasedRefCountingEnabledForCurrentThread(biased);
+
+   const uint32 numIterations = 50000000;
+   CountedItemRef r(new CountedItem);
+   const uint64 startTime = GetRunTime64();
+   for (uint32 i=0; i<numIterations; i++)
+   {
+      CountedItemRef copy(r);
+      copy.Reset();
+   }
+   const uint64 elapsed = GetRunTime64()-startTime;
+   printf("%s refcounting:  " UINT32_FORMAT_SPEC " Ref copy/release iterations took %s (%.2f nanoseconds/iteration)\n", biased?"  Biased":"Unbiased", numIterations, GetHumanReadableUnsignedTimeIntervalString(elapsed)(), (1000.0*elapsed)/numIterations);
+
+   r.Reset();
+   (void) SetBiasedRefCountingEnabledForCurrentThread(false);
+}
+
 // This program exercises the Ref class.
 int main(int argc, char ** argv)
 {
@@ -82,6 +242,14 @@ int main(int argc, char ** argv)
 
    const bool isFromScript = ((argc>=2)&&(strcmp(argv[1], "fromscript")==0));
 
+   status_t ret;
+   if (TestBiasedRefCounting().IsError(ret))
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "Biased reference-counting test failed [%s]\n", ret());
+      return 10;
+   }
+   printf("Biased reference-counting tests passed.\n");
+
    {
       printf("Checking queue...\n");
       Queue<TestItemRef> q;
@@ -126,6 +294,9 @@ int main(int argc, char ** argv)
       (void) Snooze64(SecondsToMicros(10));
       for (uint32 i=0; i<NUM_THREADS; i++) threads[i].ShutdownInternalThread();
       printf("Multithreaded object usage test complete.\n");
+
+      BenchmarkRefCounting(false);
+      BenchmarkRefCounting(true);
    }
 
    printf("testrefcount complete, bye!\n");
@@ -0,0 +1,162 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#include <stdio.h>
+
+#include "dataio/TCPSocketDataIO.h"
+#include "iogateway/MessageIOGateway.h"
+#include "reflector/ReflectServer.h"
+#include "reflector/StorageReflectSession.h"
+#include "system/SetupSystem.h"
+#include "test/TestMacros.h"
+#include "util/NetworkUtilityFunctions.h"
+
+using namespace muscle;
+
+static const uint32 NUM_CLIENT_MESSAGES = 4;  // SETPARAMETERS, SETDATA, GETSESSIONSTATS and PING
+
+// Connects a client to a StorageReflectSession, has it subscribe, upload a node and ask for the session stats,
+// and then returns the server's reply to the stats request in (retReply)
+static status_t GetSessionStatsFromServer(ReflectServer & server, MessageRef & retReply)
+{
+   ConstSocketRef serverSock, clientSock;
+   MRETURN_ON_ERROR(CreateConnectedSocketPair(serverSock, clientSock));
+   MRETURN_ON_ERROR(server.AddNewSession(AbstractReflectSessionRef(newnothrow StorageReflectSession), serverSock));
+
+   MessageIOGateway gw;
+   gw.SetDataIO(DataIORef(newnothrow TCPSocketDataIO(clientSock, false)));
+
+   MessageRef setParams = GetMessageFromPool(PR_COMMAND_SETPARAMETERS);
+   MRETURN_ON_ERROR(setParams);
+   MRETURN_ON_ERROR(setParams()->AddBool(PR_NAME_SUBSCRIBE_PREFIX "/*/*/*", true));
+   MRETURN_ON_ERROR(setParams()->AddBool(PR_NAME_REFLECT_TO_SELF, true));  // so we'll get updates about our own node, too
+   MRETURN_ON_ERROR(gw.AddOutgoingMessage(setParams));
+
+   MessageRef setData = GetMessageFromPool(PR_COMMAND_SETDATA);
+   MRETURN_ON_ERROR(setData);
+   MRETURN_ON_ERROR(setData()->AddMessage("testnode", GetMessageFromPool(1234)));
+   MRETURN_ON_ERROR(gw.AddOutgoingMessage(setData));
+
+   MRETURN_ON_ERROR(gw.AddOutgoingMessage(GetMessageFromPool(PR_COMMAND_GETSESSIONSTATS)));
+   MRETURN_ON_ERROR(gw.AddOutgoingMessage(GetMessageFromPool(PR_COMMAND_PING)));
+
+   // Pump the server and the client until the PONG comes back
+   QueueGatewayMessageReceiver inQueue;
+   const uint64 endTime = GetRunTime64()+SecondsToMicros(10);
+   while(GetRunTime64() < endTime)
+   {
+      MRETURN_ON_ERROR(server.ServerProcessLoop(GetRunTime64()+MillisToMicros(10)));
+      MRETURN_ON_ERROR(gw.DoOutput().GetStatus());
+      MRETURN_ON_ERROR(gw.DoInput(inQueue).GetStatus());
+
+      MessageRef msg;
+      while(inQueue.RemoveHead(msg).IsOK())
+      {
+              if ((msg()->what == PR_RESULT_SESSIONSTATS)||(msg()->what == PR_RESULT_ERRORACCESSDENIED)) retReply = msg;
+         else if (msg()->what == PR_RESULT_PONG) return retReply() ? B_NO_ERROR : B_DATA_NOT_FOUND;
+      }
+   }
+   return B_TIMED_OUT;
+}
+
+// Makes sure an unprivileged client isn't allowed to see the session stats
+static status_t TestAccessDenied(ReflectServer & server)
+{
+   MessageRef reply;
+   MRETURN_ON_ERROR(GetSessionStatsFromServer(server, reply));
+   TEST(reply()->what == PR_RESULT_ERRORACCESSDENIED);
+   return B_NO_ERROR;
+}
+
+// Makes sure the "priv3" key that older configurations use to grant all privileges still includes PR_PRIVILEGE_GETSTATS
+static status_t TestAllPrivileges(ReflectServer & server)
+{
+   TEST(PR_PRIVILEGE_ALL == 3);
+   MRETURN_ON_ERROR(server.GetCentralState().AddString("priv3", "*"));
+
+   MessageRef reply;
+   MRETURN_ON_ERROR(GetSessionStatsFromServer(server, reply));
+   TEST(reply()->what == PR_RESULT_SESSIONSTATS);
+   return B_NO_ERROR;
+}
+
+// Makes sure a privileged client gets back the right counters
+static status_t TestSessionStats(ReflectServer & server)
+{
+   server.SetEventLoopStatsEnabled(true);  // so that the session's callback time gets tallied
+   MRETURN_ON_ERROR(server.GetCentralState().AddString(String("priv%1").Arg((int32)PR_PRIVILEGE_GETSTATS), "*"));
+
+   MessageRef reply;
+   MRETURN_ON_ERROR(GetSessionStatsFromServer(server, reply));
+   TEST(reply()->what == PR_RESULT_SESSIONSTATS);
+
+   TEST(server.GetSessions().GetNumItems() == 1);
+   const AbstractReflectSession * session = server.GetSessions().GetFirstValue()->GetItemPointer();
+   TEST(session != NULL);
+
+   MessageRef sessionMsg;
+   MRETURN_ON_ERROR(reply()->FindMessage(session->GetSessionIDString(), sessionMsg));
+   const Message & m = *sessionMsg();
+   TEST(m.GetString("type") == "StorageReflectSession");
+   TEST(m.GetInt64("msgsin") == NUM_CLIENT_MESSAGES-1);  // the stats were gathered before the PING arrived
+   TEST(m.GetInt64("msgsout") >= 1);                     // at least the subscription update for our node
+   TEST(m.HasName("bytesin", B_INT64_TYPE));            // (byte counts are only updated after each read completes, so it's likely still zero here)
+   TEST(m.GetInt64("maxoutq") >= 1);
+   TEST(m.GetInt64("subscriptions") == 1);
+   TEST(m.GetInt64("nodes") == 1);
+
+   TEST(session->GetNumMessagesReceived() == NUM_CLIENT_MESSAGES);
+   TEST(session->GetNumMessagesSent() >= 3);  // the subscription update, the stats and the PONG
+   TEST(session->GetNumBytesReceived() > 0);
+   TEST(session->GetNumBytesSent() > 0);
+   TEST(session->GetTotalCallbackTime() > 0);
+
+   String text;
+   server.PrintSessionStatsAsPrometheusText(text);
+   TEST(text.Contains("# TYPE muscle_session_received_messages_total counter\n"));
+   TEST(text.Contains(String("muscle_session_subscriptions{session=\"%1\",type=\"StorageReflectSession\"").Arg(session->GetSessionIDString())));
+   printf("%s", text());
+   return B_NO_ERROR;
+}
+
+// This program tests the per-session traffic counters, and the PR_COMMAND_GETSESSIONSTATS command that reports them
+int main(int, char **)
+{
+   CompleteSetupSystem css;
+
+   status_t ret;
+   {
+      ReflectServer server;
+      ret = TestAccessDenied(server);
+      server.Cleanup();
+   }
+   if (ret.IsError())
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "Session-stats access test failed [%s]\n", ret());
+      return 10;
+   }
+
+   {
+      ReflectServer server;
+      ret = TestAllPrivileges(server);
+      server.Cleanup();
+   }
+   if (ret.IsError())
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "All-privileges test failed [%s]\n", ret());
+      return 10;
+   }
+
+   {
+      ReflectServer server;
+      ret = TestSessionStats(server);
+      server.Cleanup();
+   }
+   if (ret.IsError())
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "Session-stats test failed [%s]\n", ret());
+      return 10;
+   }
+
+   printf("Session stats tests passed.\n");
+   return 0;
+}
@@ -205,9 +205,91 @@ static status_t UnitTestString()
    return B_NO_ERROR;
 }
 
-int main(int, char **)
+// Makes sure that String's cached hash codes always match a freshly-computed hash code, no matter how the String was modified
+static status_t TestHashCodeCaching()
 {
-   const status_t ret = UnitTestString();
+   String s = "this String is too long for the short-string-optimization";
+   if (s.HashCode() != CalculateHashCode(s(), s.Length())) return B_LOGIC_ERROR;
+
+   const uint32 numSteps = 8;
+   for (uint32 i=0; i<numSteps; i++)
+   {
+      const uint32 before = s.HashCode();
+      switch(i)
+      {
+         case 0:  s += "!";                                         break;
+         case 1:  s[3] = 'X';                                       break;
+         case 2:  (void) s.Replace('o', '0');                       break;
+         case 3:  s.TruncateChars(5);                               break;
+         case 4:  MRETURN_ON_ERROR(s.PrependChars("prefix "));      break;
+         case 5:  s = s.ToUpperCase();                              break;
+         case 6:  MRETURN_ON_ERROR(s.SetCstr("short"));             break;  // still has a heap buffer, but is short now
+         default: s = "another String that's too long for the SSO"; break;
+      }
+
+      const uint32 after = s.HashCode();
+      if ((after != CalculateHashCode(s(), s.Length()))||(after == before))
+      {
+         LogTime(MUSCLE_LOG_CRITICALERROR, "Cached hash code was stale after modification step " UINT32_FORMAT_SPEC " [%s]\n", i, s());
+         return B_LOGIC_ERROR;
+      }
+
+      // Copies (with or without heap buffers) must hash the same as the original
+      const String copy(s);
+      const String shrunk = s.WithoutSuffix("nothing to remove");
+      if ((copy.HashCode() != after)||(shrunk.HashCode() != after)||(s.CalculateChecksum() != after)) return B_LOGIC_ERROR;
+   }
+   return B_NO_ERROR;
+}
+
+// Hash functor that always recomputes the String's hash code, i.e. the behavior we had before hash codes were cached
+class UncachedStringHashFunctor
+{
+public:
+   MUSCLE_NODISCARD uint32 operator()(const String * s) const {return CalculateHashCode(s->Cstr(), s->Length());}
+   MUSCLE_NODISCARD bool AreKeysEqual(const String * s1, const String * s2) const {return (*s1 == *s2);}
+};
+
+// Simulates the child-lookups DataNode does when walking a node-tree, with and without the hash-code cache
+template<class HashFunctorType> static void BenchmarkNodeTreeLookups(const char * desc)
+{
+   // A two-level tree, like /<host>/<session>, keyed by const String pointers as DataNode's child-tables are
+   Queue<String> hostNames, sessionNames;
+   for (uint32 i=0; i<100; i++) (void) hostNames.AddTail(String("host_192.168.%1.%2").Arg(i/10).Arg(i%10));
+   for (uint32 i=0; i<1000; i++) (void) sessionNames.AddTail(String("session_%1_connected_from_port").Arg(i));
+
+   Hashtable<const String *, Hashtable<const String *, uint32, HashFunctorType>, HashFunctorType> tree;
+   for (uint32 h=0; h<hostNames.GetNumItems(); h++)
+   {
+      Hashtable<const String *, uint32, HashFunctorType> * children = tree.GetOrPut(&hostNames[h]);
+      if (children) for (uint32 s=0; s<sessionNames.GetNumItems(); s++) (void) children->Put(&sessionNames[s], s);
+   }
+
+   const uint32 numLookups = 10000000;
+   uint64 checksum = 0;
+   const uint64 startTime = GetRunTime64();
+   for (uint32 i=0; i<numLookups; i++)
+   {
+      const Hashtable<const String *, uint32, HashFunctorType> * children = tree.Get(&hostNames[i%hostNames.GetNumItems()]);
+      const uint32 * v = children ? children->Get(&sessionNames[(i*7)%sessionNames.GetNumItems()]) : NULL;
+      if (v) checksum += *v;
+   }
+   const uint64 elapsed = GetRunTime64()-startTime;
+   printf("   %s:  " UINT32_FORMAT_SPEC " two-level node lookups took " UINT64_FORMAT_SPEC " microseconds (%.1f ns each, checksum=" UINT64_FORMAT_SPEC ")\n", desc, numLookups, elapsed, (elapsed*1000.0)/numLookups, checksum);
+}
+
+int main(int argc, char ** argv)
+{
+   CompleteSetupSystem css;
+
+   status_t ret = UnitTestString();
+   if (ret.IsOK()) ret = TestHashCodeCaching();
+   if ((ret.IsOK())&&((argc < 2)||(strcmp(argv[1], "fromscript") != 0)))
+   {
+      printf("Benchmarking node-tree lookups:\n");
+      BenchmarkNodeTreeLookups<UncachedStringHashFunctor>("recomputed hash codes");
+      BenchmarkNodeTreeLookups<DEFAULT_HASH_FUNCTOR(const String *)>("  cached hash codes");
+   }
    if (ret.IsOK())
    {
       LogTime(MUSCLE_LOG_INFO, "teststring unit test passed.\n");
@@ -35,5 +35,21 @@ int main(int, char **)
    printf("                 docs path = [%s]\n", GetSystemPathAux(SYSTEM_PATH_DOCUMENTS)());
    printf("                 root path = [%s]\n", GetSystemPathAux(SYSTEM_PATH_ROOT)());
    printf("                 proc mem  = " UINT64_FORMAT_SPEC " bytes\n", GetProcessMemoryUsage());
+
+   uint32 numNodes;
+   if (GetNumberOfNUMANodes(numNodes).IsOK())
+   {
+      printf("                 NUMA nodes = " UINT32_FORMAT_SPEC "\n", numNodes);
+      for (uint32 i=0; i<numNodes; i++)
+      {
+         Queue<uint32> cpus;
+         if (GetNUMANodeCPUs(i, cpus).IsError()) continue;
+
+         String cpuList;
+         for (uint32 j=0; j<cpus.GetNumItems(); j++) cpuList += String(j>0?",":"") + String("%1").Arg(cpus[j]);
+         printf("                   node " UINT32_FORMAT_SPEC " CPUs = [%s]\n", i, cpuList());
+      }
+   }
+   else printf("TestSystemInfo:  Unable to determine the number of NUMA nodes in the system.\n");
    return 0;
 }
@@ -45,11 +45,188 @@ public:
    }
 };
 
+// Echoes every Message it receives back to its owner; used for the ping-pong benchmark
+class EchoThread : public Thread
+{
+public:
+   explicit EchoThread(bool useEventFD) : Thread(true) {SetUseEventFDForInternalThreadWakeups(useEventFD);}
+
+   virtual status_t MessageReceivedFromOwner(const MessageRef & msgRef, uint32)
+   {
+      if (msgRef() == NULL) return B_SHUTTING_DOWN;
+      if ((msgRef()->what == 'done')||(msgRef()->what == 'ping')) return SendMessageToOwner(msgRef);
+      return B_NO_ERROR;  // throughput-test Messages are just absorbed
+   }
+};
+
+// Counts the Messages it receives from several producer threads, and verifies that each producer's Messages arrive in order
+class CountingThread : public Thread
+{
+public:
+   CountingThread() : Thread(true), _numReceived(0), _status(B_NO_ERROR) {/* empty */}
+
+   virtual status_t MessageReceivedFromOwner(const MessageRef & msgRef, uint32)
+   {
+      if (msgRef() == NULL) return B_SHUTTING_DOWN;
+
+      const uint32 producerIdx = msgRef()->GetInt32("p");
+      const uint32 seq         = msgRef()->GetInt32("s");
+      if ((producerIdx >= ARRAYITEMS(_nextSeq))||(seq != _nextSeq[producerIdx]))
+      {
+         printf("CountingThread:  Error, expected seq " UINT32_FORMAT_SPEC " from producer " UINT32_FORMAT_SPEC ", got " UINT32_FORMAT_SPEC "\n", (producerIdx < ARRAYITEMS(_nextSeq)) ? _nextSeq[producerIdx] : 0, producerIdx, seq);
+         _status = B_LOGIC_ERROR;
+      }
+      else _nextSeq[producerIdx]++;
+
+      _numReceived++;
+      return B_NO_ERROR;
+   }
+
+   uint32 _nextSeq[4];
+   uint32 _numReceived;
+   status_t _status;
+};
+
+// Sends a sequence of Messages to another Thread's internal thread, concurrently with other ProducerThreads
+class ProducerThread : public Thread
+{
+public:
+   ProducerThread(Thread * target, uint32 producerIdx, uint32 numToSend) : Thread(false), _target(target), _producerIdx(producerIdx), _numToSend(numToSend) {/* empty */}
+
+   virtual void InternalThreadEntry()
+   {
+      for (uint32 i=0; i<_numToSend; i++)
+      {
+         MessageRef msg = GetMessageFromPool(1234);
+         if ((msg() == NULL)||(msg()->AddInt32("p", _producerIdx).IsError())||(msg()->AddInt32("s", i).IsError())||(_target->SendMessageToInternalThread(msg).IsError())) {printf("ProducerThread:  send failed!\n"); break;}
+      }
+   }
+
+private:
+   Thread * _target;
+   const uint32 _producerIdx;
+   const uint32 _numToSend;
+};
+
+static status_t TestMultipleProducers()
+{
+   const uint32 numPerProducer = 20000;
+
+   CountingThread counter;
+   for (uint32 i=0; i<ARRAYITEMS(counter._nextSeq); i++) counter._nextSeq[i] = 0;
+   MRETURN_ON_ERROR(counter.StartInternalThread());
+
+   ProducerThread * producers[ARRAYITEMS(counter._nextSeq)];
+   for (uint32 i=0; i<ARRAYITEMS(producers); i++) producers[i] = new ProducerThread(&counter, i, numPerProducer);
+   for (uint32 i=0; i<ARRAYITEMS(producers); i++) MRETURN_ON_ERROR(producers[i]->StartInternalThread());
+   for (uint32 i=0; i<ARRAYITEMS(producers); i++)
+   {
+      (void) producers[i]->WaitForInternalThreadToExit();
+      delete producers[i];
+   }
+
+   counter.ShutdownInternalThread();
+   MRETURN_ON_ERROR(counter._status);
+   if (counter._numReceived != ARRAYITEMS(producers)*numPerProducer)
+   {
+      printf("TestMultipleProducers:  Error, received " UINT32_FORMAT_SPEC " Messages, expected " UINT32_FORMAT_SPEC "\n", counter._numReceived, (uint32) ARRAYITEMS(producers)*numPerProducer);
+      return B_LOGIC_ERROR;
+   }
+   printf("TestMultipleProducers:  " UINT32_FORMAT_SPEC " Messages from " UINT32_FORMAT_SPEC " producer threads all arrived in order.\n", counter._numReceived, (uint32) ARRAYITEMS(producers));
+   return B_NO_ERROR;
+}
+
+// Blocks until the next reply arrives (GetNextReplyFromInternalThread() may return B_TIMED_OUT early, if it sees a stale wakeup signal)
+static status_t WaitForReply(Thread & t, MessageRef & retReply)
+{
+   status_t ret;
+   while(t.GetNextReplyFromInternalThread(retReply, MUSCLE_TIME_NEVER).IsError(ret)) if (ret != B_TIMED_OUT) return ret;
+   return B_NO_ERROR;
+}
+
+// Pins an EchoThread to the first CPU core, makes sure it still works, and then un-pins it again
+static status_t TestCPUAffinity()
+{
+   EchoThread t(false);
+
+   Queue<uint32> firstCore;
+   MRETURN_ON_ERROR(firstCore.AddTail(0));
+   MRETURN_ON_ERROR(t.SetThreadCPUAffinity(firstCore));  // the thread isn't running yet, so this just records the setting
+   if (t.GetThreadCPUAffinity() != firstCore) return B_LOGIC_ERROR;
+
+   MRETURN_ON_ERROR(t.StartInternalThread());
+
+   MessageRef reply;
+   status_t ret = t.SendMessageToInternalThread(GetMessageFromPool('ping'));
+   if (ret.IsOK()) ret = WaitForReply(t, reply);
+   if (ret.IsOK())
+   {
+      const status_t unpinRet = t.SetThreadCPUAffinity(Queue<uint32>());
+      if ((unpinRet.IsError())&&(unpinRet != B_UNIMPLEMENTED)) ret = unpinRet;  // B_UNIMPLEMENTED just means this OS doesn't support CPU affinity
+   }
+
+   t.ShutdownInternalThread();
+   return ret;
+}
+
+// Measures the round-trip latency of owner->internal->owner Messages, and the one-way throughput of owner->internal Messages
+static status_t BenchmarkMessagingAux(EchoThread & t, bool useEventFD)
+{
+   const MessageRef pingMsg = GetMessageFromPool('ping');
+   const MessageRef dataMsg = GetMessageFromPool(1234);
+   const MessageRef doneMsg = GetMessageFromPool('done');
+   MRETURN_OOM_ON_NULL(pingMsg());
+   MRETURN_OOM_ON_NULL(dataMsg());
+   MRETURN_OOM_ON_NULL(doneMsg());
+
+   MessageRef reply;
+   const uint32 numPings = 100000;
+   uint64 startTime = GetRunTime64();
+   for (uint32 i=0; i<numPings; i++)
+   {
+      MRETURN_ON_ERROR(t.SendMessageToInternalThread(pingMsg));
+      MRETURN_ON_ERROR(WaitForReply(t, reply));
+   }
+   const uint64 pingTime = GetRunTime64()-startTime;
+
+   const uint32 numMessages = 2000000;
+   startTime = GetRunTime64();
+   for (uint32 i=0; i<numMessages; i++) MRETURN_ON_ERROR(t.SendMessageToInternalThread(dataMsg));
+   MRETURN_ON_ERROR(t.SendMessageToInternalThread(doneMsg));
+   MRETURN_ON_ERROR(WaitForReply(t, reply));
+   const uint64 throughputTime = muscleMax(GetRunTime64()-startTime, (uint64)1);
+
+   printf("   %s:  ping-pong round trip %.3f us, one-way throughput %.0f Messages/second\n", useEventFD?"   eventfd":"socketpair", ((double)pingTime)/numPings, ((double)numMessages*1000000.0)/throughputTime);
+   return B_NO_ERROR;
+}
+
+static status_t BenchmarkMessaging(bool useEventFD)
+{
+   EchoThread t(useEventFD);
+   MRETURN_ON_ERROR(t.StartInternalThread());
+
+   const status_t ret = BenchmarkMessagingAux(t, useEventFD);
+   t.ShutdownInternalThread();
+   return ret;
+}
+
 // This program exercises the Thread class.
 int main(int argc, char ** argv)
 {
    CompleteSetupSystem css;
 
+   if ((argc>1)&&(strcmp(argv[1], "benchmark") == 0))
+   {
+      printf("Benchmarking Thread messaging:\n");
+      status_t ret;
+      if ((BenchmarkMessaging(false).IsError(ret))||(BenchmarkMessaging(true).IsError(ret)))
+      {
+         printf("Benchmark failed [%s]\n", ret());
+         return 10;
+      }
+      return 0;
+   }
+
    int * tls = _tls.GetOrCreateThreadLocalObject();
    if (tls) *tls = 3;
        else MWARN_OUT_OF_MEMORY;
@@ -64,6 +241,9 @@ int main(int argc, char ** argv)
 
    const bool isFromScript = ((argc >= 2)&&(strcmp(argv[1], "fromscript") == 0));
 
+   if (TestMultipleProducers().IsError(ret)) {printf("TestMultipleProducers() failed [%s]\n", ret()); return 10;}
+   if (TestCPUAffinity().IsError(ret))       {printf("TestCPUAffinity() failed [%s]\n", ret()); return 10;}
+
    if (t.StartInternalThread().IsOK())
    {
       if (isFromScript)
@@ -2,8 +2,10 @@
 
 #include <stdio.h>
 
-#include "system/ThreadPool.h"
 #include "system/SetupSystem.h"
+#include "system/ThreadPool.h"
+#include "util/MiscUtilityFunctions.h"
+#include "util/TimeUtilityFunctions.h"
 
 using namespace muscle;
 
@@ -24,11 +26,179 @@ public:
    }
 };
 
-// This program exercises the Thread class.
-int main(int, char **)
+// Checks that its Messages arrive one at a time and in order, and optionally burns some CPU on each one
+class OrderCheckingClient : public IThreadPoolClient
+{
+public:
+   OrderCheckingClient() : IThreadPoolClient(NULL), _expectedWhat(0), _workPerMessage(0), _numErrors(0), _junk(0) {/* empty */}
+
+   void SetWorkPerMessage(uint32 wpm) {_workPerMessage = wpm;}
+
+   virtual void MessageReceivedFromThreadPool(const MessageRef & msgRef, uint32 /*numLeft*/)
+   {
+      if (_inCallback.AtomicIncrement() == false) _numErrors++;  // another thread is handling one of our Messages at the same time!?
+      if (msgRef()->what != _expectedWhat) _numErrors++;
+      _expectedWhat = msgRef()->what+1;
+
+      uint32 x = _junk;
+      for (uint32 i=0; i<_workPerMessage; i++) x = (x*1103515245)+12345;
+      _junk = x;
+
+      (void) _inCallback.AtomicDecrement();
+   }
+
+   uint32 GetNumMessagesReceived() const {return _expectedWhat;}
+   uint32 GetNumErrors() const {return _numErrors;}
+
+private:
+   AtomicCounter _inCallback;
+   uint32 _expectedWhat;
+   uint32 _workPerMessage;
+   uint32 _numErrors;
+   uint32 _junk;
+};
+
+// Sends a series of numbered Messages to each of a range of clients, in round-robin order
+class SenderThread : public Thread
+{
+public:
+   SenderThread(OrderCheckingClient * clients, uint32 numClients, uint32 numMessagesPerClient) : Thread(false), _clients(clients), _numClients(numClients), _numMessagesPerClient(numMessagesPerClient), _status(B_NO_ERROR) {/* empty */}
+
+   status_t GetStatus() const {return _status;}
+
+   virtual void InternalThreadEntry()
+   {
+      for (uint32 i=0; i<_numMessagesPerClient; i++)
+      {
+         for (uint32 j=0; j<_numClients; j++)
+         {
+            MessageRef msg = GetMessageFromPool(i);
+            if (msg() == NULL) {_status = B_OUT_OF_MEMORY; return;}
+            if (_clients[j].SendMessageToThreadPool(msg).IsError(_status)) return;
+         }
+      }
+   }
+
+private:
+   OrderCheckingClient * _clients;
+   const uint32 _numClients;
+   const uint32 _numMessagesPerClient;
+   status_t _status;
+};
+
+// Has (numSenders) threads each send (numMessagesPerClient) Messages to its own share of (numClients) clients,
+// waits for all of the Messages to be handled, and returns the number of microseconds that took
+static status_t RunClients(uint32 maxThreads, uint32 placementPolicy, uint32 numSenders, uint32 numClients, uint32 numMessagesPerClient, uint32 workPerMessage, uint64 & retElapsedMicros)
+{
+   ThreadPool pool(maxThreads);
+   pool.SetThreadPlacementPolicy(placementPolicy);
+
+   OrderCheckingClient * clients = newnothrow_array(OrderCheckingClient, numClients);
+   MRETURN_OOM_ON_NULL(clients);
+   for (uint32 i=0; i<numClients; i++)
+   {
+      clients[i].SetWorkPerMessage(workPerMessage);
+      clients[i].SetThreadPool(&pool);
+   }
+
+   Queue<SenderThread *> senders;
+   const uint32 clientsPerSender = numClients/numSenders;
+   for (uint32 i=0; i<numSenders; i++) (void) senders.AddTail(new SenderThread(&clients[i*clientsPerSender], (i==numSenders-1)?(numClients-(i*clientsPerSender)):clientsPerSender, numMessagesPerClient));
+
+   const uint64 startTime = GetRunTime64();
+   status_t ret;
+   for (uint32 i=0; i<senders.GetNumItems(); i++) if (senders[i]->StartInternalThread().IsError()) ret = B_ERROR("Couldn't start sender thread");
+   for (uint32 i=0; i<senders.GetNumItems(); i++)
+   {
+      (void) senders[i]->WaitForInternalThreadToExit();
+      if (senders[i]->GetStatus().IsError()) ret = senders[i]->GetStatus();
+   }
+   for (uint32 i=0; i<numClients; i++) clients[i].SetThreadPool(NULL);  // this will block until all of the client's Messages have been handled
+   retElapsedMicros = GetRunTime64()-startTime;
+
+   for (uint32 i=0; i<senders.GetNumItems(); i++) delete senders[i];
+
+   if (ret.IsOK())
+   {
+      for (uint32 i=0; i<numClients; i++)
+      {
+         if (clients[i].GetNumErrors() > 0)
+         {
+            LogTime(MUSCLE_LOG_CRITICALERROR, "Client #" UINT32_FORMAT_SPEC " saw " UINT32_FORMAT_SPEC " out-of-order or concurrent Messages!\n", i, clients[i].GetNumErrors());
+            ret = B_LOGIC_ERROR;
+            break;
+         }
+         if (clients[i].GetNumMessagesReceived() != numMessagesPerClient)
+         {
+            LogTime(MUSCLE_LOG_CRITICALERROR, "Client #" UINT32_FORMAT_SPEC " received " UINT32_FORMAT_SPEC " Messages, expected " UINT32_FORMAT_SPEC "!\n", i, clients[i].GetNumMessagesReceived(), numMessagesPerClient);
+            ret = B_LOGIC_ERROR;
+            break;
+         }
+      }
+   }
+   delete [] clients;
+   return ret;
+}
+
+// Shuts down a ThreadPool while other threads are still sending Messages to its clients; the senders should
+// simply start getting errors back (rather than touching freed client-state, as they once could)
+static status_t TestShutdownWhileSending()
+{
+   const uint32 numClients = 16, numSenders = 4;
+
+   ThreadPool pool(4);
+   OrderCheckingClient clients[numClients];
+   for (uint32 i=0; i<numClients; i++) clients[i].SetThreadPool(&pool);
+
+   SenderThread * senders[numSenders];
+   for (uint32 i=0; i<numSenders; i++) senders[i] = new SenderThread(&clients[i*(numClients/numSenders)], numClients/numSenders, MUSCLE_NO_LIMIT);
+   for (uint32 i=0; i<numSenders; i++) MRETURN_ON_ERROR(senders[i]->StartInternalThread());
+
+   (void) Snooze64(MillisToMicros(50));
+   AbstractObjectRecycler::GlobalFlushAllCachedObjects();  // this is how a ThreadPool gets shut down at exit (see ~CompleteSetupSystem())
+
+   status_t ret;
+   for (uint32 i=0; i<numSenders; i++)
+   {
+      (void) senders[i]->WaitForInternalThreadToExit();
+      if (senders[i]->GetStatus().IsOK()) ret = B_LOGIC_ERROR;  // every sender should have been told the pool went away
+      delete senders[i];
+   }
+   return ret;
+}
+
+// Measures ThreadPool throughput with many clients and short tasks, for various numbers of pool threads
+static void BenchmarkThreadPool()
+{
+   const uint32 numClients = 512, numMessagesPerClient = 2000, numSenders = 4;
+   const uint32 workLevels[] = {0, 500};
+   const uint32 threadCounts[] = {1, 2, 4, 8, 16};
+   for (uint32 w=0; w<ARRAYITEMS(workLevels); w++)
+   {
+      for (uint32 t=0; t<ARRAYITEMS(threadCounts); t++)
+      {
+         uint64 elapsed = 0;
+         status_t ret;
+         if (RunClients(threadCounts[t], ThreadPool::THREAD_PLACEMENT_NONE, numSenders, numClients, numMessagesPerClient, workLevels[w], elapsed).IsError(ret))
+         {
+            printf("Benchmark failed [%s]\n", ret());
+            return;
+         }
+
+         const uint32 numMessages = numClients*numMessagesPerClient;
+         printf("   %2" UINT32_FORMAT_SPEC_NOPERCENT " pool threads, " UINT32_FORMAT_SPEC " clients, work=" UINT32_FORMAT_SPEC ":  " UINT32_FORMAT_SPEC " Messages in " UINT64_FORMAT_SPEC " ms (%.0f Messages/second)\n", threadCounts[t], numClients, workLevels[w], numMessages, elapsed/1000, (elapsed>0)?(((double)numMessages*1000000.0)/elapsed):0.0);
+      }
+   }
+}
+
+// This program exercises the ThreadPool class, and benchmarks it if run interactively
+int main(int argc, char ** argv)
 {
    CompleteSetupSystem css;
 
+   Message args; (void) ParseArgs(argc, argv, args);
+   const bool isFromScript = args.HasName("fromscript");
+
    printf("Creating pool...\n"); fflush(stdout);
 
    ThreadPool pool;
@@ -51,6 +221,32 @@ int main(int, char **)
       printf("Messages completed!\n");
    }
 
+   printf("Checking per-client Message ordering...\n"); fflush(stdout);
+   uint64 elapsed;
+   status_t ret;
+   for (uint32 i=0; i<ThreadPool::NUM_THREAD_PLACEMENTS; i++)
+   {
+      if (RunClients(8, i, 4, 200, 2000, 0, elapsed).IsError(ret))
+      {
+         LogTime(MUSCLE_LOG_CRITICALERROR, "ThreadPool ordering test failed with placement policy " UINT32_FORMAT_SPEC " [%s]\n", i, ret());
+         return 10;
+      }
+   }
+   printf("Per-client Message ordering was preserved.\n");
+
+   printf("Shutting down a pool while Messages are being sent to it...\n"); fflush(stdout);
+   if (TestShutdownWhileSending().IsError(ret))
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "ThreadPool shutdown-while-sending test failed [%s]\n", ret());
+      return 10;
+   }
+
+   if (isFromScript == false)
+   {
+      printf("Benchmarking ThreadPool throughput:\n");
+      BenchmarkThreadPool();
+   }
+
    printf("Exiting, bye!\n");
    return 0;
 }
@@ -0,0 +1,340 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#include <stdio.h>
+
+#include "dataio/ByteBufferDataIO.h"
+#include "iogateway/RawDataMessageIOGateway.h"  // for PR_COMMAND_RAW_DATA
+#include "iogateway/WebSocketMessageIOGateway.h"
+#include "system/SetupSystem.h"
+#include "util/MiscUtilityFunctions.h"
+#include "zlib/ZLibCodec.h"
+
+using namespace muscle;
+
+// The original byte-at-a-time algorithm, used as a reference for correctness and speed comparisons
+static void NaiveApplyMask(const uint8 * mask, uint32 maskPhase, const uint8 * inBytes, uint8 * outBytes, uint32 numBytes)
+{
+   for (uint32 i=0; i<numBytes; i++) outBytes[i] = inBytes[i] ^ mask[(i+maskPhase)%4];
+}
+
+static status_t TestMaskingKernel()
+{
+   const uint8 mask[4] = {0x12, 0x34, 0x56, 0x78};
+
+   uint8 inBuf[300], outBuf[300], refBuf[300];
+   for (uint32 i=0; i<sizeof(inBuf); i++) inBuf[i] = (uint8) GetInsecurePseudoRandomNumber32();
+
+   for (uint32 offset=0; offset<4; offset++)   // test unaligned buffers too
+   {
+      for (uint32 phase=0; phase<8; phase++)
+      {
+         for (uint32 numBytes=0; numBytes<(sizeof(inBuf)-offset); numBytes++)
+         {
+            NaiveApplyMask(mask, phase, inBuf+offset, refBuf, numBytes);
+            WebSocketMessageIOGateway::ApplyMask(mask, phase, inBuf+offset, outBuf+offset, numBytes);
+            if (memcmp(refBuf, outBuf+offset, numBytes) != 0)
+            {
+               LogTime(MUSCLE_LOG_CRITICALERROR, "ApplyMask() output mismatch:  offset=" UINT32_FORMAT_SPEC " phase=" UINT32_FORMAT_SPEC " numBytes=" UINT32_FORMAT_SPEC "\n", offset, phase, numBytes);
+               return B_LOGIC_ERROR;
+            }
+
+            // Masking twice (in-place) should give us back the original data
+            WebSocketMessageIOGateway::ApplyMask(mask, phase, outBuf+offset, outBuf+offset, numBytes);
+            if (memcmp(inBuf+offset, outBuf+offset, numBytes) != 0)
+            {
+               LogTime(MUSCLE_LOG_CRITICALERROR, "In-place ApplyMask() failed to round-trip:  offset=" UINT32_FORMAT_SPEC " phase=" UINT32_FORMAT_SPEC " numBytes=" UINT32_FORMAT_SPEC "\n", offset, phase, numBytes);
+               return B_LOGIC_ERROR;
+            }
+         }
+      }
+   }
+   return B_NO_ERROR;
+}
+
+// Sends (payloadSizes) as binary frames from a client-side gateway (which masks them) to a server-side
+// gateway (which unmasks them), feeding the server no more than (maxBytesPerRead) bytes per DoInput() call
+static status_t TestRoundTrip(const Queue<uint32> & payloadSizes, uint32 maxBytesPerRead)
+{
+   ByteBuffer expected;
+   ByteBufferRef wireBuf = GetByteBufferFromPool(0);
+   MRETURN_OOM_ON_NULL(wireBuf());
+
+   const bool isClient = true;
+   WebSocketMessageIOGateway clientGateway(&isClient);
+   clientGateway.SetDataIO(DataIORef(new ByteBufferDataIO(wireBuf)));
+   for (uint32 i=0; i<payloadSizes.GetNumItems(); i++)
+   {
+      ByteBufferRef payload = GetByteBufferFromPool(payloadSizes[i]);
+      MRETURN_OOM_ON_NULL(payload());
+      for (uint32 j=0; j<payload()->GetNumBytes(); j++) payload()->GetBuffer()[j] = (uint8) (i+j);
+      MRETURN_ON_ERROR(expected.AppendBytes(payload()->GetBuffer(), payload()->GetNumBytes()));
+
+      MessageRef msg = GetMessageFromPool(PR_COMMAND_RAW_DATA);
+      MRETURN_OOM_ON_NULL(msg());
+      MRETURN_ON_ERROR(msg()->AddData(PR_NAME_DATA_CHUNKS, B_RAW_TYPE, payload()->GetBuffer(), payload()->GetNumBytes()));
+      MRETURN_ON_ERROR(clientGateway.AddOutgoingMessage(msg));
+   }
+   while(clientGateway.HasBytesToOutput()) MRETURN_ON_ERROR(clientGateway.DoOutput());
+
+   const bool isServer = false;
+   WebSocketMessageIOGateway serverGateway(&isServer);
+   serverGateway.SetDataIO(DataIORef(new ByteBufferDataIO(wireBuf)));
+   QueueGatewayMessageReceiver q;
+   while(true)
+   {
+      const io_status_t ret = serverGateway.DoInput(q, maxBytesPerRead);
+      MRETURN_ON_ERROR(ret);
+      if (ret.GetByteCount() == 0) break;
+   }
+
+   ByteBuffer received;
+   MessageRef msg;
+   while(q.RemoveHead(msg).IsOK())
+   {
+      ByteBufferRef chunk;
+      for (uint32 i=0; msg()->FindFlat(PR_NAME_DATA_CHUNKS, i, chunk).IsOK(); i++) MRETURN_ON_ERROR(received.AppendBytes(chunk()->GetBuffer(), chunk()->GetNumBytes()));
+   }
+
+   if (received != expected)
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "Round trip with maxBytesPerRead=" UINT32_FORMAT_SPEC " received " UINT32_FORMAT_SPEC " bytes that didn't match the " UINT32_FORMAT_SPEC " bytes that were sent!\n", maxBytesPerRead, received.GetNumBytes(), expected.GetNumBytes());
+      return B_LOGIC_ERROR;
+   }
+   return B_NO_ERROR;
+}
+
+// Moves whatever bytes (from) wants to send over to (to), and returns the number of bytes moved
+static io_status_t PumpBytes(WebSocketMessageIOGateway & from, WebSocketMessageIOGateway & to, QueueGatewayMessageReceiver & toReceiver)
+{
+   ByteBufferRef wireBuf = GetByteBufferFromPool(0);
+   MRETURN_OOM_ON_NULL(wireBuf());
+
+   from.SetDataIO(DataIORef(new ByteBufferDataIO(wireBuf)));
+   while(from.HasBytesToOutput()) MRETURN_ON_ERROR(from.DoOutput());
+
+   to.SetDataIO(DataIORef(new ByteBufferDataIO(wireBuf)));
+   while(true)
+   {
+      const io_status_t ret = to.DoInput(toReceiver);
+      MRETURN_ON_ERROR(ret);
+      if (ret.GetByteCount() == 0) break;
+   }
+   return io_status_t(wireBuf()->GetNumBytes());
+}
+
+// Does a full HTTP handshake between a client and a server gateway with the given permessage-deflate
+// settings, then sends messages in both directions and verifies that they arrive intact
+static status_t TestPerMessageDeflate(bool clientWantsDeflate, bool serverWantsDeflate, uint32 maxWindowBits, bool noContextTakeover)
+{
+   WebSocketMessageIOGateway clientGateway("/test", "localhost", "muscle", "localhost");
+   WebSocketMessageIOGateway serverGateway;
+   clientGateway.SetPerMessageDeflateSettings(clientWantsDeflate, 6, maxWindowBits, 8, noContextTakeover);
+   serverGateway.SetPerMessageDeflateSettings(serverWantsDeflate, 6, 15,            8, noContextTakeover);
+
+   QueueGatewayMessageReceiver clientQ, serverQ;
+   MRETURN_ON_ERROR(PumpBytes(clientGateway, serverGateway, serverQ));  // handshake request
+   MRETURN_ON_ERROR(PumpBytes(serverGateway, clientGateway, clientQ));  // handshake response
+   if ((clientGateway.IsHandshakeInProgress())||(serverGateway.IsHandshakeInProgress()))
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "TestPerMessageDeflate:  handshake didn't complete!\n");
+      return B_LOGIC_ERROR;
+   }
+
+   const bool expectDeflate = ((clientWantsDeflate)&&(serverWantsDeflate));
+   if ((clientGateway.IsPerMessageDeflateActive() != expectDeflate)||(serverGateway.IsPerMessageDeflateActive() != expectDeflate))
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "TestPerMessageDeflate:  expected deflate=%i, got client=%i server=%i\n", expectDeflate, clientGateway.IsPerMessageDeflateActive(), serverGateway.IsPerMessageDeflateActive());
+      return B_LOGIC_ERROR;
+   }
+
+   for (uint32 dir=0; dir<2; dir++)
+   {
+      WebSocketMessageIOGateway & sender   = (dir == 0) ? clientGateway : serverGateway;
+      WebSocketMessageIOGateway & receiver = (dir == 0) ? serverGateway : clientGateway;
+      QueueGatewayMessageReceiver & q      = (dir == 0) ? serverQ : clientQ;
+
+      ByteBuffer expected;
+      uint32 numSent = 0;
+      for (uint32 i=0; i<20; i++)
+      {
+         // Repetitive text, so that it will actually compress, and so that context-takeover has something to take over
+         String text;
+         for (uint32 j=0; j<(i*i)+1; j++) text += String("Message #%1 line %2 of the permessage-deflate test.  ").Arg(i).Arg(j);
+         MRETURN_ON_ERROR(expected.AppendBytes((const uint8 *) text(), text.Length()));
+
+         MessageRef msg = GetMessageFromPool(PR_COMMAND_RAW_DATA);
+         MRETURN_OOM_ON_NULL(msg());
+         MRETURN_ON_ERROR(msg()->AddData(PR_NAME_DATA_CHUNKS, B_RAW_TYPE, text(), text.Length()));
+         MRETURN_ON_ERROR(sender.AddOutgoingMessage(msg));
+
+         const io_status_t ret = PumpBytes(sender, receiver, q);  // one message at a time, so that we exercise the idle-codec logic too
+         MRETURN_ON_ERROR(ret);
+         numSent += ret.GetByteCount();
+      }
+
+      ByteBuffer received;
+      MessageRef msg;
+      while(q.RemoveHead(msg).IsOK())
+      {
+         ByteBufferRef chunk;
+         for (uint32 i=0; msg()->FindFlat(PR_NAME_DATA_CHUNKS, i, chunk).IsOK(); i++) MRETURN_ON_ERROR(received.AppendBytes(chunk()->GetBuffer(), chunk()->GetNumBytes()));
+      }
+      if (received != expected)
+      {
+         LogTime(MUSCLE_LOG_CRITICALERROR, "TestPerMessageDeflate:  %s received " UINT32_FORMAT_SPEC " bytes that didn't match the " UINT32_FORMAT_SPEC " bytes that were sent!\n", (dir==0)?"server":"client", received.GetNumBytes(), expected.GetNumBytes());
+         return B_LOGIC_ERROR;
+      }
+      if ((expectDeflate)&&(numSent >= expected.GetNumBytes()))
+      {
+         LogTime(MUSCLE_LOG_CRITICALERROR, "TestPerMessageDeflate:  " UINT32_FORMAT_SPEC " bytes of text took " UINT32_FORMAT_SPEC " bytes on the wire; compression isn't happening!\n", expected.GetNumBytes(), numSent);
+         return B_LOGIC_ERROR;
+      }
+      LogTime(MUSCLE_LOG_DEBUG, "TestPerMessageDeflate:  " UINT32_FORMAT_SPEC " bytes of text took " UINT32_FORMAT_SPEC " bytes on the wire\n", expected.GetNumBytes(), numSent);
+   }
+   return B_NO_ERROR;
+}
+
+#ifdef MUSCLE_ENABLE_ZLIB_ENCODING
+// Makes sure that a peer that ends each message's deflate stream with a final block
+// doesn't leave our inflater stuck at Z_STREAM_END for the following messages
+static status_t TestInflateAfterStreamEnd()
+{
+   const uint8 finalStoredBlock[] = {0x01, 0x05, 0x00, 0xFA, 0xFF, 'h', 'e', 'l', 'l', 'o'};  // BFINAL=1, BTYPE=00, LEN=5, NLEN=~5
+
+   ZLibCodec codec(6, 15);
+   for (uint32 i=0; i<3; i++)
+   {
+      ByteBuffer inflated;
+      MRETURN_ON_ERROR(codec.InflateRaw(finalStoredBlock, sizeof(finalStoredBlock), false, inflated));
+      if ((inflated.GetNumBytes() != 5)||(memcmp(inflated.GetBuffer(), "hello", 5) != 0))
+      {
+         LogTime(MUSCLE_LOG_CRITICALERROR, "TestInflateAfterStreamEnd:  inflate #" UINT32_FORMAT_SPEC " produced " UINT32_FORMAT_SPEC " bytes instead of \"hello\"!\n", i, inflated.GetNumBytes());
+         return B_LOGIC_ERROR;
+      }
+   }
+   return B_NO_ERROR;
+}
+
+// Makes sure that a message that inflates to exactly the size limit is accepted, and that one byte more is not
+static status_t TestInflateExactLimit()
+{
+   const uint32 rawSizes[] = {100, 5000};  // one that fits in InflateRaw()'s initial buffer-size guess, and one that requires it to grow
+   for (uint32 i=0; i<ARRAYITEMS(rawSizes); i++)
+   {
+      const uint32 rawSize = rawSizes[i];
+      ByteBuffer raw;
+      MRETURN_ON_ERROR(raw.SetNumBytes(rawSize, false));
+      for (uint32 j=0; j<rawSize; j++) raw.GetBuffer()[j] = (uint8) ('a'+((j*7)%26));
+
+      ZLibCodec deflater(6, 15), inflater(6, 15);
+      ByteBuffer deflated;
+      MRETURN_ON_ERROR(deflater.DeflateRaw(raw.GetBuffer(), raw.GetNumBytes(), true, deflated));
+
+      ByteBuffer inflated;
+      status_t ret;
+      if (inflater.InflateRaw(deflated.GetBuffer(), deflated.GetNumBytes(), true, inflated, rawSize).IsError(ret))
+      {
+         LogTime(MUSCLE_LOG_CRITICALERROR, "TestInflateExactLimit:  inflating " UINT32_FORMAT_SPEC " bytes with a limit of " UINT32_FORMAT_SPEC " bytes failed [%s]\n", rawSize, rawSize, ret());
+         return B_LOGIC_ERROR;
+      }
+      if (inflated != raw)
+      {
+         LogTime(MUSCLE_LOG_CRITICALERROR, "TestInflateExactLimit:  inflating " UINT32_FORMAT_SPEC " bytes produced " UINT32_FORMAT_SPEC " bytes of the wrong data!\n", rawSize, inflated.GetNumBytes());
+         return B_LOGIC_ERROR;
+      }
+
+      ret = inflater.InflateRaw(deflated.GetBuffer(), deflated.GetNumBytes(), true, inflated, rawSize-1);
+      if (ret != B_RESOURCE_LIMIT)
+      {
+         LogTime(MUSCLE_LOG_CRITICALERROR, "TestInflateExactLimit:  inflating " UINT32_FORMAT_SPEC " bytes with a limit of " UINT32_FORMAT_SPEC " bytes returned [%s] rather than B_RESOURCE_LIMIT!\n", rawSize, rawSize-1, ret());
+         return B_LOGIC_ERROR;
+      }
+   }
+   return B_NO_ERROR;
+}
+#endif
+
+static void BenchmarkMaskingKernel(uint32 numBytes)
+{
+   ByteBuffer buf;
+   if (buf.SetNumBytes(numBytes, false).IsError()) return;
+   memset(buf.GetBuffer(), 0x55, numBytes);
+
+   const uint8 mask[4] = {0x12, 0x34, 0x56, 0x78};
+   const uint32 numIterations = 200;
+   for (uint32 pass=0; pass<2; pass++)
+   {
+      const uint64 startTime = GetRunTime64();
+      for (uint32 i=0; i<numIterations; i++)
+      {
+         if (pass == 0) NaiveApplyMask(mask, i, buf.GetBuffer(), buf.GetBuffer(), numBytes);
+                   else WebSocketMessageIOGateway::ApplyMask(mask, i, buf.GetBuffer(), buf.GetBuffer(), numBytes);
+      }
+      const uint64 elapsed = muscleMax(GetRunTime64()-startTime, (uint64)1);
+      printf("   %s masking of " UINT32_FORMAT_SPEC "-byte buffers:  %.1f MB/sec\n", (pass==0)?"Byte-at-a-time":"   Vectorized", numBytes, ((double)numBytes*numIterations)/elapsed);
+   }
+}
+
+static void BenchmarkFrameParsing(uint32 frameSize, uint32 numFrames)
+{
+   Queue<uint32> sizes;
+   for (uint32 i=0; i<numFrames; i++) (void) sizes.AddTail(frameSize);
+
+   const uint64 startTime = GetRunTime64();
+   if (TestRoundTrip(sizes, MUSCLE_NO_LIMIT).IsOK())
+   {
+      const uint64 elapsed = muscleMax(GetRunTime64()-startTime, (uint64)1);
+      printf("   Masked round trip of " UINT32_FORMAT_SPEC " " UINT32_FORMAT_SPEC "-byte binary frames:  %.1f MB/sec\n", numFrames, frameSize, ((double)frameSize*numFrames)/elapsed);
+   }
+   else printf("   Round trip of " UINT32_FORMAT_SPEC "-byte binary frames failed!\n", frameSize);
+}
+
+// This program tests the WebSocketMessageIOGateway's masking, frame-parsing and permessage-deflate logic, and benchmarks it if run interactively
+int main(int argc, char ** argv)
+{
+   CompleteSetupSystem css;
+
+   Message args; (void) ParseArgs(argc, argv, args);
+   HandleStandardDaemonArgs(args);
+   const bool isFromScript = args.HasName("fromscript");
+
+   if (TestMaskingKernel().IsError()) return 10;
+   printf("Masking-kernel test passed.\n");
+
+   Queue<uint32> sizes;
+   const uint32 interestingSizes[] = {1, 3, 4, 5, 17, 125, 126, 127, 200, 4095, 4096, 4097, 65535, 65536, 70000};
+   for (uint32 i=0; i<ARRAYITEMS(interestingSizes); i++) (void) sizes.AddTail(interestingSizes[i]);
+   for (uint32 i=0; i<50; i++) (void) sizes.AddTail(1+GetInsecurePseudoRandomNumber32(300));  // a burst of small frames
+
+   const uint32 readSizes[] = {1, 2, 7, 13, 100, 4096, 10000, MUSCLE_NO_LIMIT};
+   for (uint32 i=0; i<ARRAYITEMS(readSizes); i++)
+   {
+      if (TestRoundTrip(sizes, readSizes[i]).IsError()) return 10;
+   }
+   printf("Frame round-trip tests passed.\n");
+
+   for (uint32 i=0; i<4; i++)
+   {
+      if (TestPerMessageDeflate((i&1)!=0, (i&2)!=0, 15, false).IsError()) return 10;  // negotiation with either side declining
+   }
+   const uint32 windowBits[] = {9, 12, 15};
+   for (uint32 i=0; i<ARRAYITEMS(windowBits); i++)
+   {
+      if (TestPerMessageDeflate(true, true, windowBits[i], false).IsError()) return 10;
+      if (TestPerMessageDeflate(true, true, windowBits[i], true).IsError())  return 10;
+   }
+#ifdef MUSCLE_ENABLE_ZLIB_ENCODING
+   if (TestInflateAfterStreamEnd().IsError()) return 10;
+   if (TestInflateExactLimit().IsError())     return 10;
+#endif
+   printf("permessage-deflate tests passed.\n");
+
+   if (isFromScript == false)
+   {
+      printf("Benchmarking WebSocket masking and frame parsing:\n");
+      BenchmarkMaskingKernel(1024*1024);
+      BenchmarkFrameParsing(1024*1024, 100);
+      BenchmarkFrameParsing(1024, 10000);
+   }
+   return 0;
+}
@@ -0,0 +1,474 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#include <stdio.h>
+
+#include "dataio/ChildProcessDataIO.h"
+#include "dataio/TCPSocketDataIO.h"
+#include "iogateway/MessageIOGateway.h"
+#include "reflector/StorageReflectConstants.h"
+#include "system/SetupSystem.h"
+#include "util/MiscUtilityFunctions.h"
+#include "util/NetworkUtilityFunctions.h"
+#include "util/SocketMultiplexer.h"
+#include "util/TimeUtilityFunctions.h"
+
+using namespace muscle;
+
+enum {
+   MUSCLEBENCH_DATA_TYPECODE = 1835164520  // 'mbch'
+};
+
+static const char * MUSCLEBENCH_NODE_PREFIX = "musclebench";
+
+static void PrintUsage()
+{
+   printf("Usage:  musclebench [host=localhost] [port=2960] [publishers=1] [subscribers=1] [rate=100] [payload=100]\n");
+   printf("                    [nodes=1] [duration=10] [warmup=1] [drain=2] [pattern=/*/*/musclebench/*]\n");
+   printf("                    [muscled=path/to/muscled] [serverpid=pid] [json[=filename]]\n");
+   printf("\n");
+   printf("  publishers   = number of client connections that upload PR_COMMAND_SETDATA messages\n");
+   printf("  subscribers  = number of client connections that subscribe to the published nodes\n");
+   printf("  rate         = number of updates per second sent by each publisher (0 == as fast as possible)\n");
+   printf("  payload      = number of bytes of payload data to include in each update\n");
+   printf("  nodes        = number of different nodes each publisher cycles its updates through\n");
+   printf("  duration     = length of the measurement period, in seconds\n");
+   printf("  warmup       = number of seconds to publish before starting to measure\n");
+   printf("  drain        = max number of seconds to wait for in-flight updates after publishing stops\n");
+   printf("  pattern      = the subscription path the subscribers should use\n");
+   printf("  muscled      = if specified, musclebench will launch this muscled executable and benchmark it\n");
+   printf("  serverpid    = process ID of an already-running local muscled, so that its CPU and RSS can be reported\n");
+   printf("  json         = print the results as JSON (to stdout, or to the specified file) for regression tracking\n");
+}
+
+// Accumulates the measurements shared by all of our connections
+class BenchStats
+{
+public:
+   BenchStats()
+      : _measureStartTime(MUSCLE_TIME_NEVER)
+      , _measureEndTime(MUSCLE_TIME_NEVER)
+      , _numPublished(0)
+      , _numSkipped(0)
+      , _numReceived(0)
+   {
+      // empty
+   }
+
+   bool IsInMeasurementPeriod(uint64 t) const {return ((t >= _measureStartTime)&&(t < _measureEndTime));}
+
+   void UpdateReceived(const Message & data, uint64 now)
+   {
+      const uint64 sentAt = (uint64) data.GetInt64("t", MUSCLE_TIME_NEVER);
+      if ((IsInMeasurementPeriod(sentAt))&&(now >= sentAt))
+      {
+         _numReceived++;
+         (void) _latencies.AddTail((uint32) muscleMin(now-sentAt, (uint64)MUSCLE_NO_LIMIT));
+      }
+   }
+
+   uint64 _measureStartTime;
+   uint64 _measureEndTime;
+   uint64 _numPublished;     // updates sent during the measurement period
+   uint64 _numSkipped;       // updates that weren't sent because the publisher's outgoing queue was backed up
+   uint64 _numReceived;      // updates received (by all subscribers) that were sent during the measurement period
+   Queue<uint32> _latencies; // end-to-end latencies of the received updates, in microseconds
+};
+
+// One client connection to the server, acting as either a publisher or a subscriber
+class BenchConnection : public AbstractGatewayMessageReceiver, public RefCountable
+{
+public:
+   BenchConnection(uint32 idx, bool isPublisher, BenchStats & stats)
+      : _idx(idx)
+      , _isPublisher(isPublisher)
+      , _stats(stats)
+      , _isReady(false)
+      , _numSent(0)
+   {
+      // empty
+   }
+
+   status_t ConnectTo(const char * hostName, uint16 port)
+   {
+      _sock = Connect(hostName, port, "musclebench");
+      if (_sock() == NULL) return B_IO_ERROR;
+
+      TCPSocketDataIO * tcpIO = newnothrow TCPSocketDataIO(_sock, false);
+      MRETURN_OOM_ON_NULL(tcpIO);
+      _gateway.SetDataIO(DataIORef(tcpIO));
+      return B_NO_ERROR;
+   }
+
+   // Sends our subscription (if we are a subscriber) followed by a ping; our PR_RESULT_PONG tells us the server has processed it
+   status_t SendSetupMessages(const String & subscriptionPattern)
+   {
+      if (_isPublisher == false)
+      {
+         MessageRef subMsg = GetMessageFromPool(PR_COMMAND_SETPARAMETERS);
+         MRETURN_OOM_ON_NULL(subMsg());
+         MRETURN_ON_ERROR(subMsg()->AddBool(PR_NAME_SUBSCRIBE_PREFIX + subscriptionPattern, true));
+         MRETURN_ON_ERROR(subMsg()->AddBool(PR_NAME_SUBSCRIBE_QUIETLY, true));
+         MRETURN_ON_ERROR(_gateway.AddOutgoingMessage(subMsg));
+      }
+
+      MessageRef pingMsg = GetMessageFromPool(PR_COMMAND_PING);
+      MRETURN_OOM_ON_NULL(pingMsg());
+      return _gateway.AddOutgoingMessage(pingMsg);
+   }
+
+   // Sends one PR_COMMAND_SETDATA update, timestamped with the current time
+   status_t Publish(uint64 now, uint32 numNodes, const ByteBuffer & payload)
+   {
+      MessageRef dataMsg = GetMessageFromPool(MUSCLEBENCH_DATA_TYPECODE);
+      MRETURN_OOM_ON_NULL(dataMsg());
+      MRETURN_ON_ERROR(dataMsg()->AddInt64("t", (int64) now));
+      MRETURN_ON_ERROR(dataMsg()->AddInt64("seq", (int64) _numSent));
+      if (payload.GetNumBytes() > 0) MRETURN_ON_ERROR(dataMsg()->AddData("payload", B_RAW_TYPE, payload.GetBuffer(), payload.GetNumBytes()));
+
+      char nodePath[64]; muscleSprintf(nodePath, "%s/p" UINT32_FORMAT_SPEC "_" UINT64_FORMAT_SPEC, MUSCLEBENCH_NODE_PREFIX, _idx, _numSent%numNodes);
+      MessageRef setMsg = GetMessageFromPool(PR_COMMAND_SETDATA);
+      MRETURN_OOM_ON_NULL(setMsg());
+      MRETURN_ON_ERROR(setMsg()->AddMessage(nodePath, dataMsg));
+      MRETURN_ON_ERROR(_gateway.AddOutgoingMessage(setMsg));
+
+      _numSent++;
+      if (_stats.IsInMeasurementPeriod(now)) _stats._numPublished++;
+      return B_NO_ERROR;
+   }
+
+   // Called when we've fallen too far behind to send the updates that were due
+   void SkipUpdates(uint64 numToSkip) {_numSent += numToSkip; _stats._numSkipped += numToSkip;}
+
+   MUSCLE_NODISCARD uint64 GetNumSent() const {return _numSent;}
+   MUSCLE_NODISCARD uint32 GetNumQueuedOutgoingMessages() const {return _gateway.GetOutgoingMessageQueue().GetNumItems();}
+   MUSCLE_NODISCARD bool IsReady() const {return _isReady;}
+   MUSCLE_NODISCARD bool IsPublisher() const {return _isPublisher;}
+   MUSCLE_NODISCARD int GetFileDescriptor() const {return _sock.GetFileDescriptor();}
+   MUSCLE_NODISCARD bool HasBytesToOutput() const {return _gateway.HasBytesToOutput();}
+
+   io_status_t DoInput()  {return _gateway.DoInput(*this);}
+   io_status_t DoOutput() {return _gateway.DoOutput();}
+
+protected:
+   virtual void MessageReceivedFromGateway(const MessageRef & msg, void *)
+   {
+      switch(msg()->what)
+      {
+         case PR_RESULT_PONG:
+            _isReady = true;
+         break;
+
+         case PR_RESULT_DATAITEMS:
+         {
+            const uint64 now = GetRunTime64();
+            for (MessageFieldNameIterator fnIter = msg()->GetFieldNameIterator(B_MESSAGE_TYPE); fnIter.HasData(); fnIter++)
+            {
+               ConstMessageRef data;
+               for (uint32 i=0; msg()->FindMessage(fnIter.GetFieldName(), i, data).IsOK(); i++) _stats.UpdateReceived(*data(), now);
+            }
+         }
+         break;
+
+         case PR_RESULT_ERRORUNIMPLEMENTED: case PR_RESULT_ERRORACCESSDENIED:
+            LogTime(MUSCLE_LOG_ERROR, "musclebench connection #" UINT32_FORMAT_SPEC " got an error reply from the server:\n", _idx);
+            msg()->Print(stdout);
+         break;
+
+         default:
+            // empty
+         break;
+      }
+   }
+
+private:
+   const uint32 _idx;
+   const bool _isPublisher;
+   BenchStats & _stats;
+
+   ConstSocketRef _sock;
+   MessageIOGateway _gateway;
+   bool _isReady;
+   uint64 _numSent;
+};
+DECLARE_REFTYPES(BenchConnection);
+
+// Reads the given process's total CPU time and resident-set size from /proc
+static status_t GetServerProcessStats(muscle_pid_t pid, uint64 & retCPUMicros, uint64 & retRSSBytes)
+{
+#ifdef __linux__
+   char path[64]; muscleSprintf(path, "/proc/%li/stat", (long) pid);
+   FILE * fpIn = muscleFopen(path, "r");
+   if (fpIn == NULL) return B_ERRNO;
+
+   char buf[1024];
+   const size_t numRead = fread(buf, 1, sizeof(buf)-1, fpIn);
+   fclose(fpIn);
+   buf[numRead] = '\0';
+
+   const char * afterName = strrchr(buf, ')');  // the command name is in parentheses and could contain spaces
+   if (afterName == NULL) return B_BAD_DATA;
+
+   unsigned long uTime = 0, sTime = 0;
+   long rssPages = 0;
+   if (sscanf(afterName+1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu %*d %*d %*d %*d %*d %*d %*u %*u %ld", &uTime, &sTime, &rssPages) != 3) return B_BAD_DATA;
+
+   const long ticksPerSecond = sysconf(_SC_CLK_TCK);
+   if (ticksPerSecond <= 0) return B_ERRNO;
+
+   retCPUMicros = (((uint64)(uTime+sTime))*MICROS_PER_SECOND)/ticksPerSecond;
+   retRSSBytes  = ((uint64)muscleMax(rssPages, 0L))*sysconf(_SC_PAGESIZE);
+   return B_NO_ERROR;
+#else
+   (void) pid; (void) retCPUMicros; (void) retRSSBytes;
+   return B_UNIMPLEMENTED;
+#endif
+}
+
+static uint32 GetPercentile(const Queue<uint32> & sortedLatencies, double percentile)
+{
+   const uint32 numItems = sortedLatencies.GetNumItems();
+   return (numItems > 0) ? sortedLatencies[muscleMin((uint32)(percentile*numItems), numItems-1)] : 0;
+}
+
+static double ParseSeconds(const Message & args, const char * argName, double defaultValue)
+{
+   const char * s = args.GetCstr(argName);
+   return s ? muscleMax(atof(s), 0.0) : defaultValue;
+}
+
+static uint32 ParseUint32(const Message & args, const char * argName, uint32 defaultValue)
+{
+   const char * s = args.GetCstr(argName);
+   return s ? (uint32) muscleMax(atol(s), 0L) : defaultValue;
+}
+
+// This program measures the end-to-end latency and throughput of a muscled server, by running
+// a number of publisher and subscriber connections against it and timing every update's round-trip.
+int main(int argc, char ** argv)
+{
+   CompleteSetupSystem css;
+
+   Message args; (void) ParseArgs(argc, argv, args);
+   if (args.HasName("help")) {PrintUsage(); return 0;}
+
+   const String hostName        = args.GetString("host", "localhost");
+   const uint16 port            = (uint16) ParseUint32(args, "port", 2960);
+   const uint32 numPublishers   = ParseUint32(args, "publishers",  1);
+   const uint32 numSubscribers  = ParseUint32(args, "subscribers", 1);
+   const uint32 rate            = ParseUint32(args, "rate",        100);
+   const uint32 payloadSize     = ParseUint32(args, "payload",     100);
+   const uint32 numNodes        = muscleMax(ParseUint32(args, "nodes", 1), (uint32)1);
+   const double durationSecs    = ParseSeconds(args, "duration", 10.0);
+   const double warmupSecs      = ParseSeconds(args, "warmup",    1.0);
+   const double drainSecs       = ParseSeconds(args, "drain",     2.0);
+   const String pattern         = args.GetString("pattern", String("/*/*/%1/*").Arg(MUSCLEBENCH_NODE_PREFIX));
+   const bool   jsonOutput      = args.HasName("json");
+   const String jsonFileName    = args.GetString("json");
+   muscle_pid_t serverPID       = (muscle_pid_t) ParseUint32(args, "serverpid", 0);
+
+   if ((numPublishers == 0)||(numSubscribers == 0))
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "musclebench needs at least one publisher and one subscriber.\n");
+      return 10;
+   }
+
+   // Optionally launch the server ourself, so that the whole benchmark is one command
+   ChildProcessDataIO serverProcess(false);
+   const char * muscledPath = args.GetCstr("muscled");
+   if (muscledPath)
+   {
+      Queue<String> serverArgv;
+      char portArg[32]; muscleSprintf(portArg, "port=%u", port);
+      status_t ret;
+      if ((serverArgv.AddTail(muscledPath).IsError(ret))||(serverArgv.AddTail(portArg).IsError(ret))||(serverArgv.AddTail("displaylevel=warning").IsError(ret))
+        ||(serverProcess.LaunchChildProcess(serverArgv, ChildProcessLaunchFlags()).IsError(ret)))
+      {
+         LogTime(MUSCLE_LOG_CRITICALERROR, "Unable to launch [%s] [%s]\n", muscledPath, ret());
+         return 10;
+      }
+      serverPID = serverProcess.GetChildProcessID();
+
+      // Give the server a moment to start accepting connections
+      const uint64 giveUpTime = GetRunTime64()+SecondsToMicros(5);
+      while((Connect(hostName(), port, NULL, true, MillisToMicros(100))() == NULL)&&(GetRunTime64() < giveUpTime)) (void) Snooze64(MillisToMicros(50));
+   }
+
+   BenchStats stats;
+   Queue<BenchConnectionRef> conns;
+   const uint32 numConns = numPublishers+numSubscribers;
+   for (uint32 i=0; i<numConns; i++)
+   {
+      const bool isPublisher = (i >= numSubscribers);  // connect the subscribers first
+      BenchConnectionRef bc(newnothrow BenchConnection(isPublisher?(i-numSubscribers):i, isPublisher, stats));
+      status_t ret = bc.GetStatus();
+      if ((ret.IsError())||(conns.AddTail(bc).IsError(ret))||(bc()->ConnectTo(hostName(), port).IsError(ret))||(bc()->SendSetupMessages(pattern).IsError(ret)))
+      {
+         LogTime(MUSCLE_LOG_CRITICALERROR, "Unable to set up connection #" UINT32_FORMAT_SPEC " to %s:%u [%s]\n", i, hostName(), port, ret());
+         return 10;
+      }
+   }
+
+   ByteBuffer payload;
+   if (payload.SetNumBytes(payloadSize, false).IsError()) {MWARN_OUT_OF_MEMORY; return 10;}
+   for (uint32 i=0; i<payloadSize; i++) payload.GetBuffer()[i] = (uint8) i;
+
+   const uint64 setupStartTime = GetRunTime64();
+   uint64 startTime    = MUSCLE_TIME_NEVER;  // set when all connections are ready
+   uint64 drainEndTime = MUSCLE_TIME_NEVER;
+   status_t ret;
+
+   // Samples of the server's CPU usage at the start and end of the measurement period, plus its RSS once per second
+   uint64 cpuStartTime = MUSCLE_TIME_NEVER, cpuEndTime = MUSCLE_TIME_NEVER, serverCPUStart = 0, serverCPUEnd = 0;
+   uint64 serverRSS = 0, serverPeakRSS = 0, nextSampleTime = 0;
+
+   SocketMultiplexer multiplexer;
+   while(true)
+   {
+      const uint64 now = GetRunTime64();
+      if (startTime == MUSCLE_TIME_NEVER)
+      {
+         uint32 numReady = 0;
+         for (uint32 i=0; i<numConns; i++) if (conns[i]()->IsReady()) numReady++;
+         if (numReady == numConns)
+         {
+            startTime               = now;
+            stats._measureStartTime = startTime+SecondsToMicros(warmupSecs);
+            stats._measureEndTime   = stats._measureStartTime+SecondsToMicros(durationSecs);
+            drainEndTime            = stats._measureEndTime+SecondsToMicros(drainSecs);
+            LogTime(jsonOutput?MUSCLE_LOG_DEBUG:MUSCLE_LOG_INFO, "All " UINT32_FORMAT_SPEC " connections are ready; benchmarking for %.1f seconds (after %.1f seconds of warmup)\n", numConns, durationSecs, warmupSecs);
+         }
+         else if (now >= setupStartTime+SecondsToMicros(30))
+         {
+            LogTime(MUSCLE_LOG_CRITICALERROR, "Timed out waiting for the server to respond to our connections (" UINT32_FORMAT_SPEC "/" UINT32_FORMAT_SPEC " ready)\n", numReady, numConns);
+            ret = B_TIMED_OUT;
+            break;
+         }
+      }
+
+      uint64 nextWakeupTime = now+MillisToMicros(100);
+      if (startTime != MUSCLE_TIME_NEVER)
+      {
+         if (serverPID > 0)
+         {
+            const bool needStartSample = ((cpuStartTime == MUSCLE_TIME_NEVER)&&(now >= stats._measureStartTime));
+            const bool needEndSample   = ((cpuStartTime != MUSCLE_TIME_NEVER)&&(cpuEndTime == MUSCLE_TIME_NEVER)&&(now >= stats._measureEndTime));
+            if ((needStartSample)||(needEndSample)||(now >= nextSampleTime))
+            {
+               uint64 cpu, rss;
+               if (GetServerProcessStats(serverPID, cpu, rss).IsOK())
+               {
+                  if (needStartSample) {cpuStartTime = now; serverCPUStart = cpu;}
+                  if (needEndSample)   {cpuEndTime   = now; serverCPUEnd   = cpu;}
+                  serverRSS     = rss;
+                  serverPeakRSS = muscleMax(serverPeakRSS, rss);
+               }
+               nextSampleTime = now+MICROS_PER_SECOND;
+            }
+            nextWakeupTime = muscleMin(nextWakeupTime, nextSampleTime);
+         }
+
+         if (now >= drainEndTime) break;
+         if ((now >= stats._measureEndTime)&&(stats._numReceived >= stats._numPublished*numSubscribers)) break;  // everything has arrived
+      }
+
+      // Send whatever updates are due
+      if ((startTime != MUSCLE_TIME_NEVER)&&(now < stats._measureEndTime))
+      {
+         for (uint32 i=numSubscribers; i<numConns; i++)
+         {
+            BenchConnection * bc = conns[i]();
+            if (rate > 0)
+            {
+               const uint64 numDue = ((now-startTime)*rate)/MICROS_PER_SECOND;
+               while(bc->GetNumSent() < numDue)
+               {
+                  if (bc->GetNumQueuedOutgoingMessages() >= 1000) {bc->SkipUpdates(numDue-bc->GetNumSent()); break;}  // we're too far behind to catch up
+                  if (bc->Publish(now, numNodes, payload).IsError()) break;
+               }
+               nextWakeupTime = muscleMin(nextWakeupTime, startTime+(((bc->GetNumSent()+1)*MICROS_PER_SECOND)/rate));
+            }
+            else if (bc->GetNumQueuedOutgoingMessages() < 2) (void) bc->Publish(now, numNodes, payload);  // as fast as the connection will take them
+         }
+         nextWakeupTime = muscleMin(nextWakeupTime, stats._measureStartTime>now?stats._measureStartTime:stats._measureEndTime);
+      }
+
+      for (uint32 i=0; i<numConns; i++)
+      {
+         BenchConnection * bc = conns[i]();
+         const int fd = bc->GetFileDescriptor();
+         (void) multiplexer.RegisterSocketForReadReady(fd);
+         if (bc->HasBytesToOutput()) (void) multiplexer.RegisterSocketForWriteReady(fd);
+      }
+      if (multiplexer.WaitForEvents(nextWakeupTime).IsError(ret))
+      {
+         LogTime(MUSCLE_LOG_CRITICALERROR, "WaitForEvents() failed [%s]\n", ret());
+         break;
+      }
+
+      bool connectionLost = false;
+      for (uint32 i=0; i<numConns; i++)
+      {
+         BenchConnection * bc = conns[i]();
+         const int fd = bc->GetFileDescriptor();
+         if (((multiplexer.IsSocketReadyForWrite(fd))&&(bc->DoOutput().IsError()))||((multiplexer.IsSocketReadyForRead(fd))&&(bc->DoInput().IsError()))) connectionLost = true;
+      }
+      if (connectionLost)
+      {
+         LogTime(MUSCLE_LOG_CRITICALERROR, "Lost our connection to the server!\n");
+         ret = B_IO_ERROR;
+         break;
+      }
+      ret = B_NO_ERROR;
+   }
+
+   conns.Clear();
+   if (ret.IsError()) return 10;
+
+   // Summarize the results
+   stats._latencies.Sort();
+   const Queue<uint32> & lats = stats._latencies;
+   uint64 latencySum = 0;
+   for (uint32 i=0; i<lats.GetNumItems(); i++) latencySum += lats[i];
+
+   const double measuredSecs    = muscleMax(durationSecs, 0.000001);
+   const uint64 expected        = stats._numPublished*numSubscribers;
+   const double publishRate     = stats._numPublished/measuredSecs;
+   const double deliveryRate    = stats._numReceived/measuredSecs;
+   const double meanLatency     = lats.HasItems() ? ((double)latencySum)/lats.GetNumItems() : 0.0;
+   const bool haveServerStats   = (cpuEndTime != MUSCLE_TIME_NEVER);
+   const double serverCPUPct    = haveServerStats ? ((100.0*(serverCPUEnd-serverCPUStart))/muscleMax(cpuEndTime-cpuStartTime, (uint64)1)) : -1.0;
+
+   if (jsonOutput)
+   {
+      FILE * fpOut = jsonFileName.HasChars() ? muscleFopen(jsonFileName(), "w") : stdout;
+      if (fpOut == NULL)
+      {
+         LogTime(MUSCLE_LOG_CRITICALERROR, "Unable to open [%s] for writing [%s]\n", jsonFileName(), B_ERRNO());
+         return 10;
+      }
+
+      fprintf(fpOut, "{\n");
+      fprintf(fpOut, "  \"config\": {\"host\": \"%s\", \"port\": %u, \"publishers\": " UINT32_FORMAT_SPEC ", \"subscribers\": " UINT32_FORMAT_SPEC ", \"rate\": " UINT32_FORMAT_SPEC ", \"payload\": " UINT32_FORMAT_SPEC ", \"nodes\": " UINT32_FORMAT_SPEC ", \"duration\": %.3f, \"warmup\": %.3f},\n", hostName(), port, numPublishers, numSubscribers, rate, payloadSize, numNodes, durationSecs, warmupSecs);
+      fprintf(fpOut, "  \"published\": " UINT64_FORMAT_SPEC ",\n", stats._numPublished);
+      fprintf(fpOut, "  \"skipped\": " UINT64_FORMAT_SPEC ",\n", stats._numSkipped);
+      fprintf(fpOut, "  \"expected_deliveries\": " UINT64_FORMAT_SPEC ",\n", expected);
+      fprintf(fpOut, "  \"delivered\": " UINT64_FORMAT_SPEC ",\n", stats._numReceived);
+      fprintf(fpOut, "  \"publish_msgs_per_sec\": %.1f,\n", publishRate);
+      fprintf(fpOut, "  \"delivery_msgs_per_sec\": %.1f,\n", deliveryRate);
+      fprintf(fpOut, "  \"latency_us\": {\"min\": " UINT32_FORMAT_SPEC ", \"mean\": %.1f, \"p50\": " UINT32_FORMAT_SPEC ", \"p90\": " UINT32_FORMAT_SPEC ", \"p99\": " UINT32_FORMAT_SPEC ", \"p999\": " UINT32_FORMAT_SPEC ", \"max\": " UINT32_FORMAT_SPEC "},\n", lats.HasItems()?lats.Head():0, meanLatency, GetPercentile(lats, 0.50), GetPercentile(lats, 0.90), GetPercentile(lats, 0.99), GetPercentile(lats, 0.999), lats.HasItems()?lats.Tail():0);
+      if (haveServerStats) fprintf(fpOut, "  \"server\": {\"pid\": %li, \"cpu_percent\": %.1f, \"rss_bytes\": " UINT64_FORMAT_SPEC ", \"peak_rss_bytes\": " UINT64_FORMAT_SPEC "}\n", (long) serverPID, serverCPUPct, serverRSS, serverPeakRSS);
+                      else fprintf(fpOut, "  \"server\": null\n");
+      fprintf(fpOut, "}\n");
+      if (fpOut != stdout) fclose(fpOut);
+   }
+   else
+   {
+      printf("musclebench results (" UINT32_FORMAT_SPEC " publishers at " UINT32_FORMAT_SPEC " updates/sec each, " UINT32_FORMAT_SPEC " subscribers, " UINT32_FORMAT_SPEC "-byte payloads, %.1f seconds):\n", numPublishers, rate, numSubscribers, payloadSize, durationSecs);
+      printf("   Published:  " UINT64_FORMAT_SPEC " updates (%.1f/sec), " UINT64_FORMAT_SPEC " skipped because the publishers fell behind\n", stats._numPublished, publishRate, stats._numSkipped);
+      printf("   Delivered:  " UINT64_FORMAT_SPEC " of " UINT64_FORMAT_SPEC " expected updates (%.1f/sec)\n", stats._numReceived, expected, deliveryRate);
+      printf("     Latency:  min=" UINT32_FORMAT_SPEC "us mean=%.1fus p50=" UINT32_FORMAT_SPEC "us p90=" UINT32_FORMAT_SPEC "us p99=" UINT32_FORMAT_SPEC "us p999=" UINT32_FORMAT_SPEC "us max=" UINT32_FORMAT_SPEC "us\n", lats.HasItems()?lats.Head():0, meanLatency, GetPercentile(lats, 0.50), GetPercentile(lats, 0.90), GetPercentile(lats, 0.99), GetPercentile(lats, 0.999), lats.HasItems()?lats.Tail():0);
+      if (haveServerStats) printf("      Server:  pid=%li cpu=%.1f%% rss=" UINT64_FORMAT_SPEC " bytes (peak " UINT64_FORMAT_SPEC " bytes)\n", (long) serverPID, serverCPUPct, serverRSS, serverPeakRSS);
+                      else printf("      Server:  (specify serverpid=<pid> or muscled=<path> to see the server's CPU and memory usage)\n");
+   }
+   return 0;
+}
@@ -0,0 +1,430 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#include <stdio.h>
+
+#include "dataio/ChildProcessDataIO.h"
+#include "dataio/TCPSocketDataIO.h"
+#include "iogateway/CaptureIOGateway.h"
+#include "iogateway/MessageIOGateway.h"
+#include "reflector/StorageReflectConstants.h"
+#include "system/SetupSystem.h"
+#include "util/MiscUtilityFunctions.h"
+#include "util/NetworkUtilityFunctions.h"
+#include "util/SocketMultiplexer.h"
+#include "util/TimeUtilityFunctions.h"
+
+using namespace muscle;
+
+static const char * MUSCLEREPLAY_PING_TIME_NAME = "_musclereplay_t";  // tags the PR_COMMAND_PINGs that we insert into the replayed streams
+static const uint32 MAX_QUEUED_MESSAGES_PER_SESSION = 1000;           // when replaying at max speed, we won't get further ahead of the server than this
+
+static void PrintUsage()
+{
+   printf("Usage:  musclereplay file=capturefile [host=localhost] [port=2960] [speed=1]\n");
+   printf("                     [drain=5] [muscled=path/to/muscled] [serverpid=pid]\n");
+   printf("\n");
+   printf("  file       = a capture file, as written by \"muscled capture=capturefile\"\n");
+   printf("  speed      = playback speed multiplier (e.g. 1 for real-time, 10 for ten times faster, 0 for as fast as possible)\n");
+   printf("  drain      = max number of seconds to wait for the server's replies after the last Message has been sent\n");
+   printf("  muscled    = if specified, musclereplay will launch this muscled executable and replay the capture against it\n");
+   printf("  serverpid  = process ID of an already-running local muscled, so that its CPU and RSS can be reported\n");
+}
+
+// A Message that a client sent to the server during the capture, and when it sent it
+class CapturedMessage
+{
+public:
+   CapturedMessage() : _timeStamp(0) {/* empty */}
+   CapturedMessage(uint64 timeStamp, const MessageRef & msg) : _timeStamp(timeStamp), _msg(msg) {/* empty */}
+
+   uint64 _timeStamp;  // microseconds since the start of the capture
+   MessageRef _msg;
+};
+
+// Replays the client side of one captured session, over its own connection to the server
+class ReplaySession : public AbstractGatewayMessageReceiver, public RefCountable
+{
+public:
+   explicit ReplaySession(uint32 capturedSessionID)
+      : _capturedSessionID(capturedSessionID)
+      , _numCapturedReplies(0)
+      , _lastActivityTimeStamp(0)
+      , _nextToSend(0)
+      , _numOutstandingPings(0)
+      , _numRepliesReceived(0)
+      , _connectionLost(false)
+   {
+      // empty
+   }
+
+   status_t AddCapturedMessage(uint64 timeStamp, const MessageRef & msg) {_lastActivityTimeStamp = timeStamp; return _toSend.AddTail(CapturedMessage(timeStamp, msg));}
+   void AddCapturedReply(uint64 timeStamp) {_lastActivityTimeStamp = timeStamp; _numCapturedReplies++;}
+
+   status_t ConnectTo(const char * hostName, uint16 port)
+   {
+      _sock = Connect(hostName, port, "musclereplay");
+      if (_sock() == NULL) return B_IO_ERROR;
+
+      TCPSocketDataIO * tcpIO = newnothrow TCPSocketDataIO(_sock, false);
+      MRETURN_OOM_ON_NULL(tcpIO);
+      _gateway.SetDataIO(DataIORef(tcpIO));
+      return B_NO_ERROR;
+   }
+
+   void Disconnect()
+   {
+      _gateway.SetDataIO(DataIORef());
+      _sock.Reset();
+   }
+
+   // Queues up every captured Message whose timestamp is at or before (captureTime), followed
+   // by a tagged PR_COMMAND_PING, so that we can tell when the server has finished processing them.
+   status_t SendMessagesDueBy(uint64 captureTime, uint64 now)
+   {
+      uint32 numSent = 0;
+      while((_nextToSend < _toSend.GetNumItems())&&(_toSend[_nextToSend]._timeStamp <= captureTime)&&(_gateway.GetOutgoingMessageQueue().GetNumItems() < MAX_QUEUED_MESSAGES_PER_SESSION))
+      {
+         MRETURN_ON_ERROR(_gateway.AddOutgoingMessage(_toSend[_nextToSend++]._msg));
+         numSent++;
+      }
+
+      if (numSent > 0)
+      {
+         MessageRef pingMsg = GetMessageFromPool(PR_COMMAND_PING);
+         MRETURN_OOM_ON_NULL(pingMsg());
+         MRETURN_ON_ERROR(pingMsg()->AddInt64(MUSCLEREPLAY_PING_TIME_NAME, (int64) now));
+         MRETURN_ON_ERROR(_gateway.AddOutgoingMessage(pingMsg));
+         _numOutstandingPings++;
+      }
+      return B_NO_ERROR;
+   }
+
+   MUSCLE_NODISCARD uint32 GetCapturedSessionID() const {return _capturedSessionID;}
+   MUSCLE_NODISCARD uint64 GetFirstTimeStamp() const {return _toSend.HasItems() ? _toSend.Head()._timeStamp : 0;}
+   MUSCLE_NODISCARD uint64 GetNextTimeStamp() const {return (_nextToSend < _toSend.GetNumItems()) ? _toSend[_nextToSend]._timeStamp : MUSCLE_TIME_NEVER;}
+   MUSCLE_NODISCARD uint32 GetNumMessages() const {return _toSend.GetNumItems();}
+   MUSCLE_NODISCARD uint32 GetNumSent() const {return _nextToSend;}
+   MUSCLE_NODISCARD uint32 GetNumCapturedReplies() const {return _numCapturedReplies;}
+   MUSCLE_NODISCARD uint32 GetNumRepliesReceived() const {return _numRepliesReceived;}
+   MUSCLE_NODISCARD bool IsConnected() const {return (_sock() != NULL);}
+   MUSCLE_NODISCARD bool WasConnectionLost() const {return _connectionLost;}
+   MUSCLE_NODISCARD bool IsFinished(uint64 captureTime) const {return ((_connectionLost)||((_nextToSend == _toSend.GetNumItems())&&(_numOutstandingPings == 0)&&(_gateway.HasBytesToOutput() == false)&&(captureTime >= _lastActivityTimeStamp)));}
+   MUSCLE_NODISCARD bool IsBackedUp() const {return (_gateway.GetOutgoingMessageQueue().GetNumItems() >= MAX_QUEUED_MESSAGES_PER_SESSION);}
+   MUSCLE_NODISCARD int GetFileDescriptor() const {return _sock.GetFileDescriptor();}
+   MUSCLE_NODISCARD bool HasBytesToOutput() const {return _gateway.HasBytesToOutput();}
+   MUSCLE_NODISCARD const Queue<uint32> & GetLatencies() const {return _latencies;}
+   Queue<uint32> & GetLatencies() {return _latencies;}
+
+   void DoIO(bool readReady, bool writeReady)
+   {
+      if (((writeReady)&&(_gateway.DoOutput().IsError()))||((readReady)&&(_gateway.DoInput(*this).IsError())))
+      {
+         LogTime(MUSCLE_LOG_WARNING, "Server closed the connection for captured session " UINT32_FORMAT_SPEC " (after " UINT32_FORMAT_SPEC "/" UINT32_FORMAT_SPEC " Messages were sent)\n", _capturedSessionID, _nextToSend, _toSend.GetNumItems());
+         _connectionLost = true;
+         Disconnect();
+      }
+   }
+
+protected:
+   virtual void MessageReceivedFromGateway(const MessageRef & msg, void *)
+   {
+      const uint64 pingTime = (uint64) msg()->GetInt64(MUSCLEREPLAY_PING_TIME_NAME, MUSCLE_TIME_NEVER);
+      if ((msg()->what == PR_RESULT_PONG)&&(pingTime != MUSCLE_TIME_NEVER))
+      {
+         const uint64 now = GetRunTime64();
+         if (now >= pingTime) (void) _latencies.AddTail((uint32) muscleMin(now-pingTime, (uint64)MUSCLE_NO_LIMIT));
+         if (_numOutstandingPings > 0) _numOutstandingPings--;
+      }
+      else _numRepliesReceived++;
+   }
+
+private:
+   const uint32 _capturedSessionID;
+   Queue<CapturedMessage> _toSend;
+   uint32 _numCapturedReplies;     // how many Messages the server sent to this session during the capture
+   uint64 _lastActivityTimeStamp;  // timestamp of this session's last record in the capture
+
+   ConstSocketRef _sock;
+   MessageIOGateway _gateway;
+   uint32 _nextToSend;
+   uint32 _numOutstandingPings;
+   uint32 _numRepliesReceived;
+   bool _connectionLost;
+   Queue<uint32> _latencies;  // microseconds from when each burst of Messages was queued until its PR_RESULT_PONG arrived
+};
+DECLARE_REFTYPES(ReplaySession);
+
+// Sorts ReplaySessions into the order in which they first sent a Message
+class FirstTimeStampCompareFunctor
+{
+public:
+   MUSCLE_NODISCARD int Compare(const ReplaySessionRef & a, const ReplaySessionRef & b, void *) const {return muscleCompare(a()->GetFirstTimeStamp(), b()->GetFirstTimeStamp());}
+};
+
+// Reads the given process's total CPU time and resident-set size from /proc
+static status_t GetServerProcessStats(muscle_pid_t pid, uint64 & retCPUMicros, uint64 & retRSSBytes)
+{
+#ifdef __linux__
+   char path[64]; muscleSprintf(path, "/proc/%li/stat", (long) pid);
+   FILE * fpIn = muscleFopen(path, "r");
+   if (fpIn == NULL) return B_ERRNO;
+
+   char buf[1024];
+   const size_t numRead = fread(buf, 1, sizeof(buf)-1, fpIn);
+   fclose(fpIn);
+   buf[numRead] = '\0';
+
+   const char * afterName = strrchr(buf, ')');  // the command name is in parentheses and could contain spaces
+   if (afterName == NULL) return B_BAD_DATA;
+
+   unsigned long uTime = 0, sTime = 0;
+   long rssPages = 0;
+   if (sscanf(afterName+1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu %*d %*d %*d %*d %*d %*d %*u %*u %ld", &uTime, &sTime, &rssPages) != 3) return B_BAD_DATA;
+
+   const long ticksPerSecond = sysconf(_SC_CLK_TCK);
+   if (ticksPerSecond <= 0) return B_ERRNO;
+
+   retCPUMicros = (((uint64)(uTime+sTime))*MICROS_PER_SECOND)/ticksPerSecond;
+   retRSSBytes  = ((uint64)muscleMax(rssPages, 0L))*sysconf(_SC_PAGESIZE);
+   return B_NO_ERROR;
+#else
+   (void) pid; (void) retCPUMicros; (void) retRSSBytes;
+   return B_UNIMPLEMENTED;
+#endif
+}
+
+static uint32 GetPercentile(const Queue<uint32> & sortedLatencies, double percentile)
+{
+   const uint32 numItems = sortedLatencies.GetNumItems();
+   return (numItems > 0) ? sortedLatencies[muscleMin((uint32)(percentile*numItems), numItems-1)] : 0;
+}
+
+static void PrintLatencies(const char * label, const Queue<uint32> & sortedLatencies)
+{
+   uint64 latencySum = 0;
+   for (uint32 i=0; i<sortedLatencies.GetNumItems(); i++) latencySum += sortedLatencies[i];
+   const double meanLatency = sortedLatencies.HasItems() ? ((double)latencySum)/sortedLatencies.GetNumItems() : 0.0;
+   printf("%s latency:  min=" UINT32_FORMAT_SPEC "us mean=%.1fus p50=" UINT32_FORMAT_SPEC "us p90=" UINT32_FORMAT_SPEC "us p99=" UINT32_FORMAT_SPEC "us max=" UINT32_FORMAT_SPEC "us\n", label, sortedLatencies.HasItems()?sortedLatencies.Head():0, meanLatency, GetPercentile(sortedLatencies, 0.50), GetPercentile(sortedLatencies, 0.90), GetPercentile(sortedLatencies, 0.99), sortedLatencies.HasItems()?sortedLatencies.Tail():0);
+}
+
+// Reads the capture file into one ReplaySession per captured session, in order of each session's first Message
+static status_t LoadCaptureFile(const String & filePath, Queue<ReplaySessionRef> & retSessions)
+{
+   MessageCaptureReader reader;
+   MRETURN_ON_ERROR(reader.Open(filePath));
+
+   Hashtable<uint32, ReplaySessionRef> sessions;
+   uint64 timeStamp;
+   uint32 sessionID, direction;
+   MessageRef msg;
+   status_t ret;
+   while(reader.ReadNextMessage(timeStamp, sessionID, direction, msg).IsOK(ret))
+   {
+      ReplaySessionRef * rs = sessions.Get(sessionID);
+      if (rs == NULL)
+      {
+         ReplaySessionRef newSession(newnothrow ReplaySession(sessionID));
+         MRETURN_ON_ERROR(newSession);
+         rs = sessions.PutAndGet(sessionID, newSession);
+         MRETURN_OOM_ON_NULL(rs);
+      }
+
+      if (direction == MESSAGE_CAPTURE_DIRECTION_INCOMING) MRETURN_ON_ERROR(rs->GetItemPointer()->AddCapturedMessage(timeStamp, msg));
+                                                      else rs->GetItemPointer()->AddCapturedReply(timeStamp);
+   }
+   if (ret != B_DATA_NOT_FOUND)  // B_DATA_NOT_FOUND just means we reached the end of the file
+   {
+      if (sessions.IsEmpty()) return ret;
+      LogTime(MUSCLE_LOG_WARNING, "Capture file [%s] appears to be truncated [%s]; replaying only the records before that point.\n", filePath(), ret());
+   }
+
+   // Sessions that never sent anything have nothing to replay
+   for (HashtableIterator<uint32, ReplaySessionRef> iter(sessions); iter.HasData(); iter++) if (iter.GetValue()()->GetNumMessages() > 0) MRETURN_ON_ERROR(retSessions.AddTail(iter.GetValue()));
+
+   retSessions.Sort(FirstTimeStampCompareFunctor());
+   return B_NO_ERROR;
+}
+
+// This program replays the client traffic that was recorded by "muscled capture=filename" against a
+// (typically local) muscled server, with each captured session getting its own concurrent connection,
+// and then reports the per-session latencies and the server's CPU usage during the replay.
+int main(int argc, char ** argv)
+{
+   CompleteSetupSystem css;
+
+   Message args; (void) ParseArgs(argc, argv, args);
+   const String fileName = args.GetString("file");
+   if ((args.HasName("help"))||(fileName.IsEmpty())) {PrintUsage(); return fileName.HasChars() ? 0 : 5;}
+
+   const String hostName  = args.GetString("host", "localhost");
+   const uint16 port      = (uint16) atol(args.GetCstr("port", "2960"));
+   const double speed     = muscleMax(atof(args.GetCstr("speed", "1")), 0.0);  // 0.0 means "as fast as possible"
+   const double drainSecs = muscleMax(atof(args.GetCstr("drain", "5")), 0.0);
+   muscle_pid_t serverPID = (muscle_pid_t) atol(args.GetCstr("serverpid", "0"));
+
+   Queue<ReplaySessionRef> sessions;
+   status_t ret;
+   if (LoadCaptureFile(fileName, sessions).IsError(ret))
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "Unable to load capture file [%s] [%s]\n", fileName(), ret());
+      return 10;
+   }
+   if (sessions.IsEmpty())
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "Capture file [%s] contains no client Messages to replay.\n", fileName());
+      return 10;
+   }
+
+   uint64 totalMessages = 0;
+   for (uint32 i=0; i<sessions.GetNumItems(); i++) totalMessages += sessions[i]()->GetNumMessages();
+   LogTime(MUSCLE_LOG_INFO, "Replaying " UINT64_FORMAT_SPEC " Messages from " UINT32_FORMAT_SPEC " sessions at %s speed\n", totalMessages, sessions.GetNumItems(), (speed>0.0)?String("%1x").Arg(speed)():"max");
+
+   // Optionally launch the server ourself, so that the whole replay is one command
+   ChildProcessDataIO serverProcess(false);
+   const char * muscledPath = args.GetCstr("muscled");
+   if (muscledPath)
+   {
+      Queue<String> serverArgv;
+      char portArg[32]; muscleSprintf(portArg, "port=%u", port);
+      if ((serverArgv.AddTail(muscledPath).IsError(ret))||(serverArgv.AddTail(portArg).IsError(ret))||(serverArgv.AddTail("displaylevel=warning").IsError(ret))
+        ||(serverProcess.LaunchChildProcess(serverArgv, ChildProcessLaunchFlags()).IsError(ret)))
+      {
+         LogTime(MUSCLE_LOG_CRITICALERROR, "Unable to launch [%s] [%s]\n", muscledPath, ret());
+         return 10;
+      }
+      serverPID = serverProcess.GetChildProcessID();
+
+      // Give the server a moment to start accepting connections
+      const uint64 giveUpTime = GetRunTime64()+SecondsToMicros(5);
+      while((Connect(hostName(), port, NULL, true, MillisToMicros(100))() == NULL)&&(GetRunTime64() < giveUpTime)) (void) Snooze64(MillisToMicros(50));
+   }
+
+   uint64 serverCPUStart = 0, serverCPUEnd = 0, serverRSS = 0, serverPeakRSS = 0, nextSampleTime = 0;
+   const bool haveServerStats = ((serverPID > 0)&&(GetServerProcessStats(serverPID, serverCPUStart, serverRSS).IsOK()));
+
+   const uint64 captureStartTime = sessions.Head()()->GetFirstTimeStamp();
+   const uint64 replayStartTime  = GetRunTime64();
+   uint64 lastSendTime    = MUSCLE_TIME_NEVER;  // set when the last captured Message has been queued
+   uint64 lastReceiveTime = 0;                  // the last time any of our connections received data from the server
+
+   SocketMultiplexer multiplexer;
+   while(true)
+   {
+      const uint64 now = GetRunTime64();
+      const uint64 captureNow = (speed > 0.0) ? (captureStartTime+(uint64)((now-replayStartTime)*speed)) : MUSCLE_TIME_NEVER;  // the point in the capture that we should be replaying now
+
+      uint64 nextWakeupTime = now+MillisToMicros(100);
+      if ((haveServerStats)&&(now >= nextSampleTime))
+      {
+         uint64 cpu;
+         if (GetServerProcessStats(serverPID, cpu, serverRSS).IsOK()) serverPeakRSS = muscleMax(serverPeakRSS, serverRSS);
+         nextSampleTime = now+MICROS_PER_SECOND;
+      }
+
+      bool allSent = true, allFinished = true;
+      for (uint32 i=0; i<sessions.GetNumItems(); i++)
+      {
+         ReplaySession * rs = sessions[i]();
+         if (rs->WasConnectionLost()) continue;
+
+         const uint64 nextTimeStamp = rs->GetNextTimeStamp();
+         if ((nextTimeStamp != MUSCLE_TIME_NEVER)&&(nextTimeStamp <= captureNow))
+         {
+            if ((rs->IsConnected() == false)&&(rs->ConnectTo(hostName(), port).IsError(ret)))
+            {
+               LogTime(MUSCLE_LOG_CRITICALERROR, "Unable to connect to %s:%u for captured session " UINT32_FORMAT_SPEC " [%s]\n", hostName(), port, rs->GetCapturedSessionID(), ret());
+               return 10;
+            }
+            (void) rs->SendMessagesDueBy(captureNow, now);
+         }
+
+         const uint64 stillToSend = rs->GetNextTimeStamp();
+         if (stillToSend != MUSCLE_TIME_NEVER)
+         {
+            allSent = false;
+            if ((speed > 0.0)&&(rs->IsBackedUp() == false)) nextWakeupTime = muscleMin(nextWakeupTime, replayStartTime+(uint64)((stillToSend-captureStartTime)/speed));
+         }
+      }
+
+      // A session stays connected until it has no more replayed work in flight, and the rest of the capture has caught up with
+      // its last captured activity (so that e.g. a subscriber is still around to receive the updates other sessions' Messages cause)
+      for (uint32 i=0; i<sessions.GetNumItems(); i++)
+      {
+         ReplaySession * rs = sessions[i]();
+         if ((allSent)&&(rs->IsFinished(captureNow)))
+         {
+            if ((speed > 0.0)&&(rs->IsConnected())) rs->Disconnect();  // the session is done, so let the server clean it up
+         }
+         else allFinished = false;
+      }
+
+      if ((allSent)&&(lastSendTime == MUSCLE_TIME_NEVER)) lastSendTime = now;
+      if (allFinished)
+      {
+         // Wait for the server to go quiet, so that we don't miss any updates that are still on their way to us
+         const uint64 quietTime = lastReceiveTime+MillisToMicros(100);
+         if (now >= quietTime) break;
+         nextWakeupTime = muscleMin(nextWakeupTime, quietTime);
+      }
+      if ((lastSendTime != MUSCLE_TIME_NEVER)&&(now >= lastSendTime+SecondsToMicros(drainSecs)))
+      {
+         LogTime(MUSCLE_LOG_WARNING, "Timed out waiting for the server's replies to the last replayed Messages.\n");
+         break;
+      }
+
+      for (uint32 i=0; i<sessions.GetNumItems(); i++)
+      {
+         const ReplaySession * rs = sessions[i]();
+         if (rs->IsConnected())
+         {
+            const int fd = rs->GetFileDescriptor();
+            (void) multiplexer.RegisterSocketForReadReady(fd);
+            if (rs->HasBytesToOutput()) (void) multiplexer.RegisterSocketForWriteReady(fd);
+         }
+      }
+      if (multiplexer.WaitForEvents(nextWakeupTime).IsError(ret))
+      {
+         LogTime(MUSCLE_LOG_CRITICALERROR, "WaitForEvents() failed [%s]\n", ret());
+         return 10;
+      }
+
+      for (uint32 i=0; i<sessions.GetNumItems(); i++)
+      {
+         ReplaySession * rs = sessions[i]();
+         if (rs->IsConnected())
+         {
+            const int fd = rs->GetFileDescriptor();
+            const bool readReady = multiplexer.IsSocketReadyForRead(fd);
+            if (readReady) lastReceiveTime = GetRunTime64();
+            rs->DoIO(readReady, multiplexer.IsSocketReadyForWrite(fd));
+         }
+      }
+   }
+
+   const uint64 replayEndTime = GetRunTime64();
+   const bool haveServerEndStats = ((haveServerStats)&&(GetServerProcessStats(serverPID, serverCPUEnd, serverRSS).IsOK()));
+   for (uint32 i=0; i<sessions.GetNumItems(); i++) sessions[i]()->Disconnect();
+
+   // Summarize the results
+   const uint64 replayMicros = muscleMax(replayEndTime-replayStartTime, (uint64)1);
+   printf("musclereplay results (" UINT32_FORMAT_SPEC " sessions, " UINT64_FORMAT_SPEC " Messages, %.3f seconds):\n", sessions.GetNumItems(), totalMessages, ((double)replayMicros)/MICROS_PER_SECOND);
+
+   Queue<uint32> allLatencies;
+   for (uint32 i=0; i<sessions.GetNumItems(); i++)
+   {
+      ReplaySession * rs = sessions[i]();
+      Queue<uint32> & lats = rs->GetLatencies();
+      (void) allLatencies.AddTailMulti(lats);
+      lats.Sort();
+
+      char label[128]; muscleSprintf(label, "   Session " UINT32_FORMAT_SPEC, rs->GetCapturedSessionID());
+      printf("%s:  sent " UINT32_FORMAT_SPEC "/" UINT32_FORMAT_SPEC " Messages, received " UINT32_FORMAT_SPEC " replies (" UINT32_FORMAT_SPEC " in the capture)%s\n", label, rs->GetNumSent(), rs->GetNumMessages(), rs->GetNumRepliesReceived(), rs->GetNumCapturedReplies(), rs->WasConnectionLost()?" [disconnected by server]":"");
+      PrintLatencies(label, lats);
+   }
+
+   allLatencies.Sort();
+   PrintLatencies("   Overall", allLatencies);
+   if (haveServerEndStats) printf("   Server:  pid=%li cpu=%.1f%% rss=" UINT64_FORMAT_SPEC " bytes (peak " UINT64_FORMAT_SPEC " bytes)\n", (long) serverPID, (100.0*(serverCPUEnd-serverCPUStart))/replayMicros, serverRSS, muscleMax(serverPeakRSS, serverRSS));
+                      else printf("   Server:  (specify serverpid=<pid> or muscled=<path> to see the server's CPU and memory usage)\n");
+   return 0;
+}
@@ -0,0 +1,244 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#include <stdio.h>
+
+#include "dataio/ChildProcessDataIO.h"
+#include "dataio/TCPSocketDataIO.h"
+#include "iogateway/MessageIOGateway.h"
+#include "reflector/StorageReflectConstants.h"
+#include "system/SetupSystem.h"
+#include "util/MiscUtilityFunctions.h"
+#include "util/NetworkUtilityFunctions.h"
+#include "util/SocketMultiplexer.h"
+#include "util/TimeUtilityFunctions.h"
+
+using namespace muscle;
+
+static void PrintUsage()
+{
+   printf("Usage:  musclestorm [host=localhost] [port=2960] [clients=900] [timeout=30]\n");
+   printf("                    [muscled=path/to/muscled] [serverarg=arg] [serverarg=arg] [...]\n");
+   printf("\n");
+   printf("  clients    = number of clients that will all try to connect at once (as after a server restart)\n");
+   printf("               (more than about 1000 clients requires that musclestorm be compiled with -DMUSCLE_USE_POLL or -DMUSCLE_USE_EPOLL)\n");
+   printf("  timeout    = max number of seconds to wait for all of the clients to get their PR_RESULT_PONG back\n");
+   printf("  muscled    = if specified, musclestorm will launch this muscled executable and storm it\n");
+   printf("  serverarg  = an argument to pass to the launched muscled (e.g. serverarg=acceptsockets=4); may be repeated\n");
+}
+
+// One client in the storm:  it connects, sends a PR_COMMAND_PING, and waits for the PR_RESULT_PONG
+class StormClient : public AbstractGatewayMessageReceiver
+{
+public:
+   StormClient() : _startTime(0), _connectedTime(0), _pongTime(0), _failed(false) {/* empty */}
+
+   status_t Start(const IPAddressAndPort & iap)
+   {
+      _startTime = GetRunTime64();
+
+      bool isReady = false;
+      _sock = ConnectAsync(iap, isReady);
+      MRETURN_ON_ERROR(_sock);
+
+      TCPSocketDataIO * tcpIO = newnothrow TCPSocketDataIO(_sock, false);
+      MRETURN_OOM_ON_NULL(tcpIO);
+      _gateway.SetDataIO(DataIORef(tcpIO));
+
+      MessageRef pingMsg = GetMessageFromPool(PR_COMMAND_PING);
+      MRETURN_ON_ERROR(pingMsg);
+      MRETURN_ON_ERROR(_gateway.AddOutgoingMessage(pingMsg));
+
+      if (isReady) _connectedTime = GetRunTime64();
+      return B_NO_ERROR;
+   }
+
+   void DoIO(bool readReady, bool writeReady)
+   {
+      if ((writeReady)&&(IsConnecting()))
+      {
+         if (FinalizeAsyncConnect(_sock).IsError()) {Fail(); return;}
+         _connectedTime = GetRunTime64();
+      }
+      if (((writeReady)&&(_gateway.DoOutput().IsError()))||((readReady)&&(_gateway.DoInput(*this).IsError()))) Fail();
+   }
+
+   void Fail()
+   {
+      _failed = true;
+      Disconnect();
+   }
+
+   void Disconnect()
+   {
+      _gateway.SetDataIO(DataIORef());
+      _sock.Reset();
+   }
+
+   MUSCLE_NODISCARD bool IsActive() const {return (_sock() != NULL);}
+   MUSCLE_NODISCARD bool IsConnecting() const {return ((_sock())&&(_connectedTime == 0));}
+   MUSCLE_NODISCARD bool IsFinished() const {return ((_failed)||(_pongTime > 0));}
+   MUSCLE_NODISCARD bool HasFailed() const {return _failed;}
+   MUSCLE_NODISCARD bool WantsToWrite() const {return ((IsConnecting())||(_gateway.HasBytesToOutput()));}
+   MUSCLE_NODISCARD int GetFileDescriptor() const {return _sock.GetFileDescriptor();}
+   MUSCLE_NODISCARD uint64 GetConnectTime() const {return (_connectedTime > 0) ? (_connectedTime-_startTime) : 0;}
+   MUSCLE_NODISCARD uint64 GetPongTime() const {return (_pongTime > 0) ? (_pongTime-_startTime) : 0;}
+
+protected:
+   virtual void MessageReceivedFromGateway(const MessageRef & msg, void *)
+   {
+      if ((msg()->what == PR_RESULT_PONG)&&(_pongTime == 0)) _pongTime = GetRunTime64();
+   }
+
+private:
+   ConstSocketRef _sock;
+   MessageIOGateway _gateway;
+   uint64 _startTime;
+   uint64 _connectedTime;
+   uint64 _pongTime;
+   bool _failed;
+};
+
+static uint32 GetPercentile(const Queue<uint32> & sortedTimes, double percentile)
+{
+   const uint32 numItems = sortedTimes.GetNumItems();
+   return (numItems > 0) ? sortedTimes[muscleMin((uint32)(percentile*numItems), numItems-1)] : 0;
+}
+
+static void PrintTimes(const char * label, const Queue<uint32> & sortedTimes)
+{
+   printf("%s:  p50=%.1fms p90=%.1fms p99=%.1fms max=%.1fms\n", label, GetPercentile(sortedTimes, 0.50)/1000.0, GetPercentile(sortedTimes, 0.90)/1000.0, GetPercentile(sortedTimes, 0.99)/1000.0, (sortedTimes.HasItems()?sortedTimes.Tail():0)/1000.0);
+}
+
+// This program simulates a reconnect-storm:  a large number of clients that all try to connect to a
+// MUSCLE server at the same moment (as they would after a server restart or a network outage), each
+// of which sends a PR_COMMAND_PING and waits for the reply.  It then reports how long it took for
+// all of the clients to be served.  Connections that take more than a second usually mean that the
+// server's listen-queue overflowed and the client's kernel had to retransmit its SYN.
+int main(int argc, char ** argv)
+{
+   CompleteSetupSystem css;
+
+   Message args; (void) ParseArgs(argc, argv, args);
+   if (args.HasName("help")) {PrintUsage(); return 0;}
+
+   const String hostName   = args.GetString("host", "localhost");
+   const uint16 port       = (uint16) atol(args.GetCstr("port", "2960"));
+   const uint32 numClients = muscleMax((uint32) atol(args.GetCstr("clients", "900")), (uint32)1);
+   const uint64 timeout    = SecondsToMicros(muscleMax((uint64) Atoull(args.GetCstr("timeout", "30")), (uint64)1));
+
+   const IPAddress hostIP = GetHostByName(hostName());
+   if (hostIP == invalidIP)
+   {
+      LogTime(MUSCLE_LOG_CRITICALERROR, "Unable to resolve host name [%s]\n", hostName());
+      return 10;
+   }
+
+   // Optionally launch the server ourself, so that the whole benchmark is one command
+   status_t ret;
+   ChildProcessDataIO serverProcess(false);
+   const char * muscledPath = args.GetCstr("muscled");
+   if (muscledPath)
+   {
+      Queue<String> serverArgv;
+      char portArg[32]; muscleSprintf(portArg, "port=%u", port);
+      if ((serverArgv.AddTail(muscledPath).IsError(ret))||(serverArgv.AddTail(portArg).IsError(ret))||(serverArgv.AddTail("displaylevel=warning").IsError(ret))) return 10;
+
+      const char * serverArg;
+      for (int32 i=0; args.FindString("serverarg", i, &serverArg).IsOK(); i++) if (serverArgv.AddTail(serverArg).IsError(ret)) return 10;
+
+      if (serverProcess.LaunchChildProcess(serverArgv, ChildProcessLaunchFlags()).IsError(ret))
+      {
+         LogTime(MUSCLE_LOG_CRITICALERROR, "Unable to launch [%s] [%s]\n", muscledPath, ret());
+         return 10;
+      }
+
+      // Give the server a moment to start accepting connections
+      const uint64 giveUpTime = GetRunTime64()+SecondsToMicros(5);
+      while((Connect(hostName(), port, NULL, true, MillisToMicros(100))() == NULL)&&(GetRunTime64() < giveUpTime)) (void) Snooze64(MillisToMicros(50));
+      (void) Snooze64(MillisToMicros(200));  // let the server finish cleaning up after our probe-connection
+   }
+
+   StormClient * clients = newnothrow_array(StormClient, numClients);
+   if (clients == NULL) {MWARN_OUT_OF_MEMORY; return 10;}
+
+   LogTime(MUSCLE_LOG_INFO, "Connecting " UINT32_FORMAT_SPEC " clients to %s:%u at once...\n", numClients, hostName(), port);
+
+   // Start all of the connections as quickly as we can
+   const IPAddressAndPort iap(hostIP, port);
+   const uint64 stormStartTime = GetRunTime64();
+   uint32 numStartFailures = 0;
+   for (uint32 i=0; i<numClients; i++)
+   {
+      if (clients[i].Start(iap).IsError(ret))
+      {
+         if (numStartFailures++ == 0) LogTime(MUSCLE_LOG_ERROR, "Unable to start connection #" UINT32_FORMAT_SPEC " [%s]\n", i, ret());
+         clients[i].Fail();
+      }
+   }
+
+   SocketMultiplexer multiplexer;
+   bool timedOut = false;
+   while(true)
+   {
+      uint32 numActive = 0;
+      for (uint32 i=0; i<numClients; i++)
+      {
+         StormClient & c = clients[i];
+         if ((c.IsActive())&&(c.IsFinished() == false))
+         {
+            const int fd = c.GetFileDescriptor();
+            (void) multiplexer.RegisterSocketForReadReady(fd);
+            if (c.WantsToWrite()) (void) multiplexer.RegisterSocketForWriteReady(fd);
+            numActive++;
+         }
+      }
+      if (numActive == 0) break;
+
+      const uint64 giveUpTime = stormStartTime+timeout;
+      if (GetRunTime64() >= giveUpTime) {timedOut = true; break;}
+      if (multiplexer.WaitForEvents(giveUpTime).IsError(ret))
+      {
+         LogTime(MUSCLE_LOG_CRITICALERROR, "WaitForEvents() failed [%s]\n", ret());
+         break;
+      }
+
+      for (uint32 i=0; i<numClients; i++)
+      {
+         StormClient & c = clients[i];
+         if ((c.IsActive())&&(c.IsFinished() == false))
+         {
+            const int fd = c.GetFileDescriptor();
+            c.DoIO(multiplexer.IsSocketReadyForRead(fd), multiplexer.IsSocketReadyForWrite(fd));
+         }
+      }
+   }
+   const uint64 stormEndTime = GetRunTime64();
+
+   // Summarize the results
+   Queue<uint32> connectTimes, pongTimes;
+   uint32 numFailed = 0, numUnanswered = 0, numSlow = 0;
+   for (uint32 i=0; i<numClients; i++)
+   {
+      const StormClient & c = clients[i];
+           if (c.HasFailed())         numFailed++;
+      else if (c.GetPongTime() == 0)  numUnanswered++;
+      else
+      {
+         (void) connectTimes.AddTail((uint32) muscleMin(c.GetConnectTime(), (uint64)MUSCLE_NO_LIMIT));
+         (void) pongTimes.AddTail((uint32) muscleMin(c.GetPongTime(), (uint64)MUSCLE_NO_LIMIT));
+         if (c.GetPongTime() >= MICROS_PER_SECOND) numSlow++;
+      }
+      clients[i].Disconnect();
+   }
+   connectTimes.Sort();
+   pongTimes.Sort();
+
+   printf("musclestorm results (" UINT32_FORMAT_SPEC " clients%s):\n", numClients, timedOut?", timed out":"");
+   printf("   All clients served in %.3f seconds; " UINT32_FORMAT_SPEC " served, " UINT32_FORMAT_SPEC " failed, " UINT32_FORMAT_SPEC " unanswered\n", ((double)(stormEndTime-stormStartTime))/MICROS_PER_SECOND, pongTimes.GetNumItems(), numFailed, numUnanswered);
+   printf("   " UINT32_FORMAT_SPEC " clients took a second or more (most likely due to listen-queue overflows and SYN retransmits)\n", numSlow);
+   PrintTimes("   Connect time     ", connectTimes);
+   PrintTimes("   Time until PONG  ", pongTimes);
+
+   delete [] clients;
+   return ((numFailed > 0)||(numUnanswered > 0)) ? 10 : 0;
+}
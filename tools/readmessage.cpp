@@ -2,7 +2,7 @@
 
 #include <stdio.h>
 
-#include "dataio/FileDataIO.h"
+#include "dataio/MMapDataIO.h"
 #include "system/SetupSystem.h"
 #include "message/Message.h"
 #include "util/ByteBuffer.h"
@@ -58,34 +58,28 @@ int main(int argc, char ** argv)
 
    const char * fileName   = (argc > 1) ? argv[1] : "test.msg";
    const bool isSizeReport = (((argc > 2)&&(strstr(argv[2], "sizes") != NULL))||(String(argv[0]).EndsWith("sizes")));
-   FILE * fpIn = muscleFopen(fileName, "rb");
-   if (fpIn)
+   MMapDataIO mmio;  // mapping the file lets us unflatten the Message directly out of the page cache, without copying it first
+   status_t mapRet;
+   if (mmio.SetFile(fileName).IsOK(mapRet))
    {
-      FileDataIO fdio(fpIn);
+      const int64 fileSize = mmio.GetLength();
+      printf("fileSize=" INT64_FORMAT_SPEC "\n", fileSize);
 
-      const int64 fileSize = fdio.GetLength();
-      if (fileSize < 0)
+      if (fileSize >= (int64)MUSCLE_NO_LIMIT)
       {
-         LogTime(MUSCLE_LOG_ERROR, "Unable to determine file size of [%s]\n", fileName);
+         LogTime(MUSCLE_LOG_CRITICALERROR, "File [%s] is too large (" INT64_FORMAT_SPEC " bytes) to be read as a single Message\n", fileName, fileSize);
          return 10;
       }
 
-      printf("fileSize=" INT64_FORMAT_SPEC "\n", fileSize);
+      (void) mmio.SetAccessPatternHint(MMapDataIO::MMAP_ACCESS_SEQUENTIAL);  // since Unflatten() reads the file start-to-finish
 
-      ByteBufferRef buf = GetByteBufferFromPool((uint32)fileSize);
+      ConstByteBufferRef buf = mmio.GetSlice(0, (uint32) fileSize);
       if (buf() == NULL)
       {
-         MWARN_OUT_OF_MEMORY;
-         return 10;
-      }
-
-      const status_t rfRet = fdio.ReadFully(buf()->GetBuffer(), buf()->GetNumBytes());
-      if (rfRet.IsOK()) LogTime(MUSCLE_LOG_INFO, "Read " UINT32_FORMAT_SPEC " bytes from [%s]\n", buf()->GetNumBytes(), fileName);
-      else
-      {
-         LogTime(MUSCLE_LOG_CRITICALERROR, "Error [%s] reading " UINT32_FORMAT_SPEC " bytes\n", rfRet(), buf()->GetNumBytes());
+         LogTime(MUSCLE_LOG_CRITICALERROR, "Unable to access the contents of [%s]\n", fileName);
          return 10;
       }
+      LogTime(MUSCLE_LOG_INFO, "Mapped " UINT32_FORMAT_SPEC " bytes from [%s]\n", buf()->GetNumBytes(), fileName);
 
 #ifdef MUSCLE_ENABLE_ZLIB_ENCODING
       ByteBufferRef infBuf = InflateByteBuffer(buf);
@@ -123,7 +117,7 @@ int main(int argc, char ** argv)
    }
    else
    {
-      LogTime(MUSCLE_LOG_CRITICALERROR, "Could not read input flattened-message file [%s] [%s]\n", fileName, B_ERRNO());
+      LogTime(MUSCLE_LOG_CRITICALERROR, "Could not read input flattened-message file [%s] [%s]\n", fileName, mapRet());
       retVal = 10;
    }
 
@@ -2,12 +2,14 @@
 #include "util/ByteBuffer.h"
 #include "util/MiscUtilityFunctions.h"
 #include "system/GlobalMemoryAllocator.h"
+#include "system/Mutex.h"
 
 namespace muscle {
 
 void ByteBuffer :: AdoptBuffer(uint32 numBytes, uint8 * optBuffer)
 {
    Clear(true);  // free any previously held array
+   if (dynamic_cast<SizeClassMemoryAllocationStrategy *>(_allocStrategy)) _allocStrategy = NULL;  // (optBuffer) came from muscleAlloc(), not from one of our size-classes
    _buffer = optBuffer;
    _numValidBytes = _numAllocatedBytes = numBytes;
 }
@@ -42,6 +44,7 @@ status_t ByteBuffer :: SetBuffer(uint32 numBytes, const uint8 * buffer)
 status_t ByteBuffer :: SetNumBytes(uint32 newNumBytes, bool retainData)
 {
    TCHECKPOINT;
+   DECLARE_MEMORY_TAG_GUARD(MUSCLE_MEMORY_TAG_BYTEBUFFERS);
 
    if (newNumBytes > _numAllocatedBytes)
    {
@@ -111,6 +114,7 @@ status_t ByteBuffer :: SetNumBytesWithExtraSpace(uint32 newNumValidBytes, bool a
 status_t ByteBuffer :: FreeExtraBytes()
 {
    TCHECKPOINT;
+   DECLARE_MEMORY_TAG_GUARD(MUSCLE_MEMORY_TAG_BYTEBUFFERS);
 
    if (_numValidBytes < _numAllocatedBytes)
    {
@@ -207,7 +211,17 @@ ByteBufferRef GetByteBufferFromPool(uint32 numBytes, const uint8 * optBuffer) {r
 ByteBufferRef GetByteBufferFromPool(ObjectPool<ByteBuffer> & pool, uint32 numBytes, const uint8 * optBuffer)
 {
    ByteBufferRef ref(pool.ObtainObject());
-   if ((ref())&&(ref()->SetBuffer(numBytes, optBuffer).IsError())) ref.Reset();  // return NULL ref on out-of-memory
+   if (ref())
+   {
+#ifndef MUSCLE_AVOID_BYTEBUFFER_SIZE_CLASSES
+      if (ref()->GetMemoryAllocationStrategy() == NULL)
+      {
+         ref()->Clear(true);  // a recycled buffer may still hold a small array from muscleAlloc(), which the size-class strategy must never see
+         ref()->SetMemoryAllocationStrategy(GetSizeClassMemoryAllocationStrategy());
+      }
+#endif
+      if (ref()->SetBuffer(numBytes, optBuffer).IsError()) ref.Reset();  // return NULL ref on out-of-memory
+   }
    return ref;
 }
 
@@ -236,6 +250,331 @@ ByteBufferRef GetByteBufferFromPool(ObjectPool<ByteBuffer> & pool, SeekableDataI
    return ret;
 }
 
+// Size-classes are 64 bytes, and then four classes per doubling (e.g. 80, 96, 112, 128, 160, 192, ...) up to 64KB
+static const uint32 SIZE_CLASS_MIN_BYTES = 64;
+static const uint32 SIZE_CLASS_MAX_BYTES = 64*1024;
+static const uint32 NUM_SIZE_CLASSES     = 41;
+static const uint32 BYTES_PER_THREAD_CACHE_CLASS = 256*1024;  // roughly how many bytes of free blocks a thread may cache per size-class
+static const uint32 MAX_BLOCKS_PER_THREAD_CACHE_CLASS = 64;
+
+// Returns the index of the size-class that (numBytes) belongs in.  (numBytes) must be between 1 and SIZE_CLASS_MAX_BYTES.
+static inline uint32 GetSizeClassIndex(size_t numBytes)
+{
+   if (numBytes <= SIZE_CLASS_MIN_BYTES) return 0;
+
+   uint32 k = 6;  // find k such that 2^k < numBytes <= 2^(k+1)
+   while((((size_t)2)<<k) < numBytes) k++;
+
+   const uint32 stepShift = k-2;
+   const uint32 step = (numBytes-(((size_t)1)<<k)+((((size_t)1)<<stepShift)-1))>>stepShift;  // 1-4
+   return 1+((k-6)*4)+(step-1);
+}
+
+static inline uint32 GetSizeClassSize(uint32 idx)
+{
+   if (idx == 0) return SIZE_CLASS_MIN_BYTES;
+   const uint32 k = 6+((idx-1)/4);
+   return (1<<k)+((((idx-1)%4)+1)<<(k-2));
+}
+
+static inline uint32 GetMaxBlocksPerThreadCacheClass(uint32 idx) {return muscleClamp(BYTES_PER_THREAD_CACHE_CLASS/GetSizeClassSize(idx), (uint32)4, MAX_BLOCKS_PER_THREAD_CACHE_CLASS);}
+
+// A singly-linked list of free blocks; each free block holds the pointer to the next one in its first bytes
+class SizeClassFreeList
+{
+public:
+   SizeClassFreeList() : _head(NULL), _count(0) {/* empty */}
+
+   void Push(void * block)
+   {
+      *static_cast<void **>(block) = _head;
+      _head = block;
+      _count++;
+   }
+
+   MUSCLE_NODISCARD void * Pop()
+   {
+      void * ret = _head;
+      if (ret)
+      {
+         _head = *static_cast<void **>(ret);
+         _count--;
+      }
+      return ret;
+   }
+
+   // Moves up to (maxBlocks) blocks from our head to the head of (to)
+   void MoveBlocksTo(SizeClassFreeList & to, uint32 maxBlocks)
+   {
+      for (uint32 i=0; i<maxBlocks; i++)
+      {
+         void * b = Pop();
+         if (b == NULL) break;
+         to.Push(b);
+      }
+   }
+
+   uint32 FreeAllBlocks()
+   {
+      const uint32 ret = _count;
+      void * b;
+      while((b = Pop()) != NULL) muscleFree(b);
+      return ret;
+   }
+
+   void * _head;
+   uint32 _count;
+};
+
+// The process-wide depot that the threads' caches exchange blocks with.  Deliberately never deleted, so that
+// ByteBuffers that are destroyed during static-destruction time can still return their blocks to it.
+class SizeClassDepot
+{
+public:
+   SizeClassDepot() {/* empty */}
+
+   Mutex _mutex;
+   SizeClassFreeList _lists[NUM_SIZE_CLASSES];
+};
+
+static SizeClassDepot * GetSizeClassDepot()
+{
+   static SizeClassDepot * _depot = newnothrow SizeClassDepot;
+   return _depot;
+}
+
+// Free blocks that the calling thread may re-use without locking anything
+class SizeClassThreadCache
+{
+public:
+   SizeClassThreadCache() {/* empty */}
+
+   // Returns all of our blocks to the depot (or frees them, if there's no depot)
+   void FlushToDepot()
+   {
+      SizeClassDepot * depot = GetSizeClassDepot();
+      if (depot)
+      {
+         DECLARE_MUTEXGUARD(depot->_mutex);
+         for (uint32 i=0; i<NUM_SIZE_CLASSES; i++) _lists[i].MoveBlocksTo(depot->_lists[i], MUSCLE_NO_LIMIT);
+      }
+      else for (uint32 i=0; i<NUM_SIZE_CLASSES; i++) (void) _lists[i].FreeAllBlocks();
+   }
+
+   SizeClassFreeList _lists[NUM_SIZE_CLASSES];
+};
+
+#ifndef MUSCLE_AVOID_CPLUSPLUS11_THREAD_LOCAL_KEYWORD
+static SizeClassThreadCache * const THREAD_CACHE_IS_GONE = reinterpret_cast<SizeClassThreadCache *>(1);
+static thread_local SizeClassThreadCache * _sizeClassThreadCache = NULL;  // or THREAD_CACHE_IS_GONE, if this thread is exiting
+
+// Returns the calling thread's cached blocks to the depot when the thread exits
+class SizeClassThreadCacheExitHandler
+{
+public:
+   SizeClassThreadCacheExitHandler() : _isArmed(false) {/* empty */}
+   ~SizeClassThreadCacheExitHandler()
+   {
+      SizeClassThreadCache * tc = _sizeClassThreadCache;
+      _sizeClassThreadCache = THREAD_CACHE_IS_GONE;  // any blocks freed after this point will go straight to the depot
+      if ((_isArmed)&&(tc != THREAD_CACHE_IS_GONE))
+      {
+         tc->FlushToDepot();
+         delete tc;
+      }
+   }
+
+   bool _isArmed;
+};
+static thread_local SizeClassThreadCacheExitHandler _sizeClassThreadCacheExitHandler;
+#endif
+
+// Returns the calling thread's cache, creating it if necessary, or NULL if thread-local caches aren't available
+static SizeClassThreadCache * GetSizeClassThreadCache()
+{
+#ifdef MUSCLE_AVOID_CPLUSPLUS11_THREAD_LOCAL_KEYWORD
+   return NULL;
+#else
+   SizeClassThreadCache * tc = _sizeClassThreadCache;
+   if (tc == THREAD_CACHE_IS_GONE) return NULL;
+   if (tc == NULL)
+   {
+      tc = newnothrow SizeClassThreadCache;
+      if (tc == NULL) return NULL;
+      _sizeClassThreadCacheExitHandler._isArmed = true;  // so that its destructor will run when this thread exits
+      _sizeClassThreadCache = tc;
+   }
+   return tc;
+#endif
+}
+
+uint32 SizeClassMemoryAllocationStrategy :: GetSizeClassBytes(size_t numBytes)
+{
+   return ((numBytes > 0)&&(numBytes <= SIZE_CLASS_MAX_BYTES)) ? GetSizeClassSize(GetSizeClassIndex(numBytes)) : 0;
+}
+
+void * SizeClassMemoryAllocationStrategy :: Malloc(size_t size)
+{
+   if ((size == 0)||(size > SIZE_CLASS_MAX_BYTES)) return muscleAlloc(size);
+
+   const uint32 idx = GetSizeClassIndex(size);
+   SizeClassThreadCache * tc = GetSizeClassThreadCache();
+   if (tc)
+   {
+      SizeClassFreeList & list = tc->_lists[idx];
+      if (list._count == 0)
+      {
+         // Grab a batch of blocks from the depot, so we won't need to lock it again for a while
+         SizeClassDepot * depot = GetSizeClassDepot();
+         if (depot)
+         {
+            DECLARE_MUTEXGUARD(depot->_mutex);
+            depot->_lists[idx].MoveBlocksTo(list, GetMaxBlocksPerThreadCacheClass(idx)/2);
+         }
+      }
+
+      void * ret = list.Pop();
+      if (ret) return ret;
+   }
+   else
+   {
+      SizeClassDepot * depot = GetSizeClassDepot();
+      if (depot)
+      {
+         DECLARE_MUTEXGUARD(depot->_mutex);
+         void * ret = depot->_lists[idx].Pop();
+         if (ret) return ret;
+      }
+   }
+
+   return muscleAlloc(GetSizeClassSize(idx));
+}
+
+void SizeClassMemoryAllocationStrategy :: Free(void * ptr, size_t size)
+{
+   if (ptr == NULL) return;
+   if ((size == 0)||(size > SIZE_CLASS_MAX_BYTES)) {muscleFree(ptr); return;}
+
+   const uint32 idx = GetSizeClassIndex(size);
+   SizeClassDepot * depot = GetSizeClassDepot();
+   SizeClassThreadCache * tc = GetSizeClassThreadCache();
+   if (tc)
+   {
+      SizeClassFreeList & list = tc->_lists[idx];
+      list.Push(ptr);
+
+      const uint32 maxBlocks = GetMaxBlocksPerThreadCacheClass(idx);
+      if (list._count > maxBlocks)
+      {
+         // Our cache for this class is full, so hand half of it over to the depot (or free it, if the depot is full too)
+         SizeClassFreeList toFree;
+         if (depot)
+         {
+            DECLARE_MUTEXGUARD(depot->_mutex);
+            SizeClassFreeList & depotList = depot->_lists[idx];
+            const uint32 depotMax = maxBlocks*4;
+            const uint32 numToMove = list._count/2;
+            const uint32 numToDepot = (depotList._count < depotMax) ? muscleMin(numToMove, depotMax-depotList._count) : 0;
+            list.MoveBlocksTo(depotList, numToDepot);
+            list.MoveBlocksTo(toFree, numToMove-numToDepot);
+         }
+         else list.MoveBlocksTo(toFree, list._count/2);
+
+         (void) toFree.FreeAllBlocks();  // done outside of the critical section
+      }
+   }
+   else if (depot)
+   {
+      {
+         DECLARE_MUTEXGUARD(depot->_mutex);
+         SizeClassFreeList & depotList = depot->_lists[idx];
+         if (depotList._count < GetMaxBlocksPerThreadCacheClass(idx)*4)
+         {
+            depotList.Push(ptr);
+            return;
+         }
+      }
+      muscleFree(ptr);
+   }
+   else muscleFree(ptr);
+}
+
+void * SizeClassMemoryAllocationStrategy :: Realloc(void * ptr, size_t newSize, size_t oldSize, bool retainData)
+{
+   if (ptr == NULL) return (newSize > 0) ? Malloc(newSize) : NULL;
+   if (newSize == 0)
+   {
+      Free(ptr, oldSize);
+      return NULL;
+   }
+
+   const bool oldIsLarge = (oldSize > SIZE_CLASS_MAX_BYTES);
+   const bool newIsLarge = (newSize > SIZE_CLASS_MAX_BYTES);
+   if ((oldIsLarge)&&(newIsLarge)) return muscleRealloc(ptr, newSize);
+   if ((oldIsLarge == false)&&(newIsLarge == false)&&(oldSize > 0)&&(GetSizeClassIndex(oldSize) == GetSizeClassIndex(newSize))) return ptr;  // the block is already the right size
+
+   void * newPtr = Malloc(newSize);
+   if (newPtr == NULL) return NULL;
+
+   if (retainData) memcpy(newPtr, ptr, muscleMin(oldSize, newSize));
+   Free(ptr, oldSize);
+   return newPtr;
+}
+
+uint32 SizeClassMemoryAllocationStrategy :: FlushCachedObjects()
+{
+   uint32 ret = 0;
+
+   SizeClassThreadCache * tc = GetSizeClassThreadCache();
+   if (tc) for (uint32 i=0; i<NUM_SIZE_CLASSES; i++) ret += tc->_lists[i].FreeAllBlocks();
+
+   SizeClassDepot * depot = GetSizeClassDepot();
+   if (depot)
+   {
+      SizeClassFreeList toFree[NUM_SIZE_CLASSES];
+      {
+         DECLARE_MUTEXGUARD(depot->_mutex);
+         for (uint32 i=0; i<NUM_SIZE_CLASSES; i++) muscleSwap(toFree[i], depot->_lists[i]);
+      }
+      for (uint32 i=0; i<NUM_SIZE_CLASSES; i++) ret += toFree[i].FreeAllBlocks();
+   }
+   return ret;
+}
+
+uint64 SizeClassMemoryAllocationStrategy :: GetNumCachedBytes()
+{
+   uint64 ret = 0;
+
+   SizeClassThreadCache * tc = GetSizeClassThreadCache();
+   if (tc) for (uint32 i=0; i<NUM_SIZE_CLASSES; i++) ret += ((uint64)tc->_lists[i]._count)*GetSizeClassSize(i);
+
+   SizeClassDepot * depot = GetSizeClassDepot();
+   if (depot)
+   {
+      DECLARE_MUTEXGUARD(depot->_mutex);
+      for (uint32 i=0; i<NUM_SIZE_CLASSES; i++) ret += ((uint64)depot->_lists[i]._count)*GetSizeClassSize(i);
+   }
+   return ret;
+}
+
+void SizeClassMemoryAllocationStrategy :: Print(const OutputPrinter & p) const
+{
+   p.printf("SizeClassMemoryAllocationStrategy %p:  " UINT64_FORMAT_SPEC " bytes cached in the depot and this thread's cache\n", this, GetNumCachedBytes());
+
+   SizeClassDepot * depot = GetSizeClassDepot();
+   if (depot)
+   {
+      DECLARE_MUTEXGUARD(depot->_mutex);
+      for (uint32 i=0; i<NUM_SIZE_CLASSES; i++) if (depot->_lists[i]._count > 0) p.printf("   " UINT32_FORMAT_SPEC "-byte class:  " UINT32_FORMAT_SPEC " blocks in depot\n", GetSizeClassSize(i), depot->_lists[i]._count);
+   }
+}
+
+SizeClassMemoryAllocationStrategy * GetSizeClassMemoryAllocationStrategy()
+{
+   static SizeClassMemoryAllocationStrategy * _strategy = new SizeClassMemoryAllocationStrategy;  // deliberately never deleted
+   return _strategy;
+}
+
 // These Flattenable methods are implemented here so that if you don't use them, you
 // don't need to include ByteBuffer.o in your Makefile.  If you do use them, then you
 // needed to include ByteBuffer.o in your Makefile anyway.
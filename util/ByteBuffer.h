@@ -377,6 +377,60 @@ public:
    virtual void Free(void * ptr, size_t size) = 0;
 };
 
+/** This IMemoryAllocationStrategy rounds each allocation of up to 64KB up to one of a fixed set of size-classes
+  * (64 bytes, then four classes per doubling:  80, 96, 112, 128, 160, ... 65536 bytes), and keeps freed blocks
+  * around in per-size-class free-lists so that later allocations of a similar size can re-use them without calling
+  * muscleAlloc() or muscleFree().  Each thread has its own small cache of free blocks (so most allocations and frees
+  * don't need to lock anything), backed by a Mutex-protected process-wide depot that threads exchange blocks with
+  * in batches.  Allocations larger than 64KB are passed through to muscleAlloc(), muscleRealloc() and muscleFree().
+  *
+  * Every block is individually allocated with muscleAlloc(), so a buffer that was allocated by this strategy may
+  * safely be handed to muscleFree() (e.g. after ByteBuffer::ReleaseBuffer()).
+  *
+  * ByteBuffers obtained via GetByteBufferFromPool() use this strategy by default (unless -DMUSCLE_AVOID_BYTEBUFFER_SIZE_CLASSES
+  * was specified).  Call GetSizeClassMemoryAllocationStrategy() to get a pointer to the shared instance.
+  */
+class SizeClassMemoryAllocationStrategy MUSCLE_FINAL_CLASS : public IMemoryAllocationStrategy, public AbstractObjectRecycler
+{
+public:
+   /** Default constructor.  Note that all SizeClassMemoryAllocationStrategy objects share the same caches. */
+   SizeClassMemoryAllocationStrategy() {/* empty */}
+
+   MUSCLE_NODISCARD virtual void * Malloc(size_t size);
+   MUSCLE_NODISCARD virtual void * Realloc(void * ptr, size_t newSize, size_t oldSize, bool retainData);
+   virtual void Free(void * ptr, size_t size);
+
+   /** Implemented as a no-op, since we don't manage objects; we're an AbstractObjectRecycler only so that our caches get flushed along with the ObjectPools' caches.
+     * @param obj ignored
+     */
+   virtual void RecycleObject(void * obj) {(void) obj;}
+
+   /** Frees all of the blocks in the process-wide depot and in the calling thread's cache.
+     * (Other threads' caches are flushed into the depot when those threads exit)
+     * @returns the number of blocks that were freed.
+     */
+   virtual uint32 FlushCachedObjects();
+
+   /** Prints the number of cached blocks in each size-class to the given OutputPrinter
+     * @param p the OutputPrinter to print to
+     */
+   virtual void Print(const OutputPrinter & p) const;
+
+   /** Returns the number of bytes the given allocation-size would be rounded up to, or 0 if (numBytes) is
+     * zero or larger than the largest size-class (in which case it would be passed through to muscleAlloc()).
+     * @param numBytes the number of bytes that would be requested
+     */
+   MUSCLE_NODISCARD static uint32 GetSizeClassBytes(size_t numBytes);
+
+   /** Returns the number of bytes currently held in the process-wide depot plus the calling thread's cache. */
+   MUSCLE_NODISCARD static uint64 GetNumCachedBytes();
+};
+
+/** Returns a pointer to the shared SizeClassMemoryAllocationStrategy object.  The object is never deleted,
+  * so it remains usable even during static-destruction time.
+  */
+MUSCLE_NODISCARD MUSCLE_NEVER_RETURNS_NULL SizeClassMemoryAllocationStrategy * GetSizeClassMemoryAllocationStrategy();
+
 // The methods below have been implemented here (instead of inside DataFlattener.h or DataUnflattener.h)
 // to avoid chicken-and-egg programs with include-ordering.  At this location we are guaranteed that the compiler
 // knows everything it needs to know about both the DataFlattener/DataUnflattener classes and the ByteBuffer class.
@@ -0,0 +1,271 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#ifndef WIN32
+# include <sys/uio.h>
+# include <limits.h>  // for IOV_MAX
+#endif
+
+#include "util/ByteBufferChain.h"
+#include "util/NetworkUtilityFunctions.h"
+
+namespace muscle {
+
+#ifndef WIN32
+# if defined(IOV_MAX) && (IOV_MAX < 64)
+static const uint32 MAX_VECTORED_WRITE_SLICES = IOV_MAX;
+# else
+static const uint32 MAX_VECTORED_WRITE_SLICES = 64;
+# endif
+#else
+static const uint32 MAX_VECTORED_WRITE_SLICES = 64;
+#endif
+
+bool ByteBufferChain :: operator ==(const ByteBufferChain & rhs) const
+{
+   if (this == &rhs) return true;
+   if (_numBytes != rhs._numBytes) return false;
+
+   // Walk both slice-lists in parallel, comparing whatever overlapping runs of bytes they have
+   uint32 myIdx = 0, myOffset = 0, hisIdx = 0, hisOffset = 0, numLeft = _numBytes;
+   while(numLeft > 0)
+   {
+      const ByteBufferSlice & mySlice  = _slices[myIdx];
+      const ByteBufferSlice & hisSlice = rhs._slices[hisIdx];
+      const uint32 runLength = muscleMin(mySlice.GetNumBytes()-myOffset, hisSlice.GetNumBytes()-hisOffset);
+      if (memcmp(mySlice.GetBytes()+myOffset, hisSlice.GetBytes()+hisOffset, runLength) != 0) return false;
+
+      myOffset  += runLength; if (myOffset  == mySlice.GetNumBytes())  {myIdx++;  myOffset  = 0;}
+      hisOffset += runLength; if (hisOffset == hisSlice.GetNumBytes()) {hisIdx++; hisOffset = 0;}
+      numLeft   -= runLength;
+   }
+   return true;
+}
+
+status_t ByteBufferChain :: AppendSlice(const ByteBufferSlice & slice)
+{
+   if (slice.GetNumBytes() == 0) return B_NO_ERROR;
+   if (WillUnsignedAddOverflow(_numBytes, slice.GetNumBytes())) return B_RESOURCE_LIMIT;
+
+   // If (slice) continues on directly from our last slice, we can just extend our last slice instead of adding a new one
+   ByteBufferSlice * tail = _slices.TailPointer();
+   if ((tail)&&(tail->GetBuffer() == slice.GetBuffer())&&(tail->GetOffset()+tail->GetNumBytes() == slice.GetOffset())) *tail = ByteBufferSlice(tail->GetBuffer(), tail->GetOffset(), tail->GetNumBytes()+slice.GetNumBytes());
+                                                                                                                   else MRETURN_ON_ERROR(_slices.AddTail(slice));
+   _numBytes += slice.GetNumBytes();
+   return B_NO_ERROR;
+}
+
+status_t ByteBufferChain :: PrependSlice(const ByteBufferSlice & slice)
+{
+   if (slice.GetNumBytes() == 0) return B_NO_ERROR;
+   if (WillUnsignedAddOverflow(_numBytes, slice.GetNumBytes())) return B_RESOURCE_LIMIT;
+
+   // If our first slice continues on directly from (slice), we can just extend our first slice instead of adding a new one
+   ByteBufferSlice * head = _slices.HeadPointer();
+   if ((head)&&(head->GetBuffer() == slice.GetBuffer())&&(slice.GetOffset()+slice.GetNumBytes() == head->GetOffset())) *head = ByteBufferSlice(slice.GetBuffer(), slice.GetOffset(), slice.GetNumBytes()+head->GetNumBytes());
+                                                                                                                   else MRETURN_ON_ERROR(_slices.AddHead(slice));
+   _numBytes += slice.GetNumBytes();
+   return B_NO_ERROR;
+}
+
+status_t ByteBufferChain :: AppendChain(const ByteBufferChain & chain)
+{
+   if (&chain == this)
+   {
+      const ByteBufferChain temp(chain);
+      return AppendChain(temp);
+   }
+
+   if (WillUnsignedAddOverflow(_numBytes, chain._numBytes)) return B_RESOURCE_LIMIT;
+   MRETURN_ON_ERROR(_slices.EnsureSize(_slices.GetNumItems()+chain._slices.GetNumItems()));
+   for (uint32 i=0; i<chain._slices.GetNumItems(); i++) MRETURN_ON_ERROR(AppendSlice(chain._slices[i]));  // guaranteed not to fail
+   return B_NO_ERROR;
+}
+
+status_t ByteBufferChain :: PrependChain(const ByteBufferChain & chain)
+{
+   if (&chain == this)
+   {
+      const ByteBufferChain temp(chain);
+      return PrependChain(temp);
+   }
+
+   if (WillUnsignedAddOverflow(_numBytes, chain._numBytes)) return B_RESOURCE_LIMIT;
+   MRETURN_ON_ERROR(_slices.EnsureSize(_slices.GetNumItems()+chain._slices.GetNumItems()));
+   for (int32 i=((int32)chain._slices.GetNumItems())-1; i>=0; i--) MRETURN_ON_ERROR(PrependSlice(chain._slices[i]));  // guaranteed not to fail
+   return B_NO_ERROR;
+}
+
+status_t ByteBufferChain :: AppendBytes(const void * bytes, uint32 numBytes)
+{
+   if (numBytes == 0) return B_NO_ERROR;
+
+   ByteBufferRef buf = GetByteBufferFromPool(numBytes, (const uint8 *) bytes);
+   MRETURN_OOM_ON_NULL(buf());
+   return AppendBuffer(buf);
+}
+
+uint32 ByteBufferChain :: FindSlice(uint32 offset, uint32 & retOffsetInSlice) const
+{
+   const uint32 numSlices = _slices.GetNumItems();
+   for (uint32 i=0; i<numSlices; i++)
+   {
+      const uint32 sliceSize = _slices[i].GetNumBytes();
+      if (offset < sliceSize)
+      {
+         retOffsetInSlice = offset;
+         return i;
+      }
+      offset -= sliceSize;
+   }
+
+   retOffsetInSlice = 0;
+   return numSlices;
+}
+
+status_t ByteBufferChain :: GetSubChain(uint32 offset, uint32 numBytes, ByteBufferChain & retChain) const
+{
+   if (&retChain == this) return B_BAD_ARGUMENT;
+
+   retChain.Clear();
+   if (offset >= _numBytes) return B_NO_ERROR;
+   numBytes = muscleMin(numBytes, _numBytes-offset);
+
+   uint32 offsetInSlice;
+   for (uint32 i=FindSlice(offset, offsetInSlice); numBytes>0; i++)
+   {
+      const ByteBufferSlice subSlice = _slices[i].GetSubSlice(offsetInSlice, numBytes);
+      MRETURN_ON_ERROR(retChain.AppendSlice(subSlice));
+      numBytes -= subSlice.GetNumBytes();
+      offsetInSlice = 0;
+   }
+   return B_NO_ERROR;
+}
+
+status_t ByteBufferChain :: SplitAt(uint32 offset, ByteBufferChain & retTail)
+{
+   MRETURN_ON_ERROR(GetSubChain(offset, MUSCLE_NO_LIMIT, retTail));
+   (void) RemoveTailBytes(retTail.GetNumBytes());
+   return B_NO_ERROR;
+}
+
+uint32 ByteBufferChain :: RemoveHeadBytes(uint32 numBytes)
+{
+   const uint32 ret = numBytes = muscleMin(numBytes, _numBytes);
+   while(numBytes > 0)
+   {
+      ByteBufferSlice & head = _slices.Head();
+      if (numBytes >= head.GetNumBytes())
+      {
+         numBytes -= head.GetNumBytes();
+         (void) _slices.RemoveHead();
+      }
+      else
+      {
+         head = head.GetSubSlice(numBytes, MUSCLE_NO_LIMIT);
+         numBytes = 0;
+      }
+   }
+   _numBytes -= ret;
+   return ret;
+}
+
+uint32 ByteBufferChain :: RemoveTailBytes(uint32 numBytes)
+{
+   const uint32 ret = numBytes = muscleMin(numBytes, _numBytes);
+   while(numBytes > 0)
+   {
+      ByteBufferSlice & tail = _slices.Tail();
+      if (numBytes >= tail.GetNumBytes())
+      {
+         numBytes -= tail.GetNumBytes();
+         (void) _slices.RemoveTail();
+      }
+      else
+      {
+         tail = tail.GetSubSlice(0, tail.GetNumBytes()-numBytes);
+         numBytes = 0;
+      }
+   }
+   _numBytes -= ret;
+   return ret;
+}
+
+uint32 ByteBufferChain :: CopyBytes(uint32 offset, void * buffer, uint32 numBytes) const
+{
+   if (offset >= _numBytes) return 0;
+
+   const uint32 ret = numBytes = muscleMin(numBytes, _numBytes-offset);
+   uint8 * out = (uint8 *) buffer;
+   uint32 offsetInSlice;
+   for (uint32 i=FindSlice(offset, offsetInSlice); numBytes>0; i++)
+   {
+      const ByteBufferSlice & slice = _slices[i];
+      const uint32 numToCopy = muscleMin(numBytes, slice.GetNumBytes()-offsetInSlice);
+      memcpy(out, slice.GetBytes()+offsetInSlice, numToCopy);
+      out           += numToCopy;
+      numBytes      -= numToCopy;
+      offsetInSlice  = 0;
+   }
+   return ret;
+}
+
+ConstByteBufferRef ByteBufferChain :: GetFlattenedBuffer() const
+{
+   if (_slices.IsEmpty()) return GetEmptyByteBufferRef();
+
+   const ByteBufferSlice & head = _slices.Head();
+   if ((_slices.GetNumItems() == 1)&&(head.GetOffset() == 0)&&(head.GetNumBytes() == head.GetBuffer()()->GetNumBytes())) return head.GetBuffer();
+
+   ByteBufferRef ret = GetByteBufferFromPool(_numBytes);
+   if (ret()) (void) CopyBytes(0, ret()->GetBuffer(), _numBytes);
+   return ret;
+}
+
+#ifndef WIN32
+uint32 ByteBufferChain :: GetIOVecs(struct iovec * retVecs, uint32 maxVecs) const
+{
+   const uint32 numVecs = muscleMin(maxVecs, _slices.GetNumItems());
+   for (uint32 i=0; i<numVecs; i++)
+   {
+      const ByteBufferSlice & slice = _slices[i];
+      retVecs[i].iov_base = const_cast<uint8 *>(slice.GetBytes());
+      retVecs[i].iov_len  = slice.GetNumBytes();
+   }
+   return numVecs;
+}
+#endif
+
+io_status_t ByteBufferChain :: WriteVectored(const ConstSocketRef & sock, bool blocking)
+{
+   const int fd = sock.GetFileDescriptor();
+   if (fd < 0) return B_BAD_ARGUMENT;
+   if (_numBytes == 0) return io_status_t(0);
+
+#ifdef WIN32
+   WSABUF bufs[MAX_VECTORED_WRITE_SLICES];
+   const uint32 numBufs = muscleMin(MAX_VECTORED_WRITE_SLICES, _slices.GetNumItems());
+   for (uint32 i=0; i<numBufs; i++)
+   {
+      const ByteBufferSlice & slice = _slices[i];
+      bufs[i].buf = (CHAR *) slice.GetBytes();
+      bufs[i].len = slice.GetNumBytes();
+   }
+
+   DWORD numSent = 0;
+   const int32 r = (WSASend(fd, bufs, numBufs, &numSent, 0, NULL, NULL) == 0) ? (int32)numSent : -1;
+#else
+   struct iovec vecs[MAX_VECTORED_WRITE_SLICES];
+   const uint32 numVecs = GetIOVecs(vecs, MAX_VECTORED_WRITE_SLICES);
+
+   int32 r;
+   do {r = (int32) writev(fd, vecs, numVecs);} while((r<0)&&(PreviousOperationWasInterrupted()));
+#endif
+
+   const int32 ret = ConvertReturnValueToMuscleSemantics(r, _numBytes, blocking);
+   if (ret < 0) return B_ERRNO;
+
+   (void) RemoveHeadBytes(ret);
+   return io_status_t(ret);
+}
+
+} // end namespace muscle
@@ -0,0 +1,253 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#ifndef MuscleByteBufferChain_h
+#define MuscleByteBufferChain_h
+
+#include "util/ByteBuffer.h"
+#include "util/Queue.h"
+#include "util/Socket.h"
+
+#ifndef WIN32
+struct iovec;  // forward declaration, so that we don't have to include <sys/uio.h> here
+#endif
+
+namespace muscle {
+
+/** A read-only view of a contiguous range of bytes inside a ConstByteBuffer.  The slice holds a reference
+  * to the ConstByteBuffer, so the bytes it refers to will remain valid for as long as the slice exists.
+  */
+class ByteBufferSlice
+{
+public:
+   /** Default constructor.  Creates an empty slice that doesn't refer to any buffer. */
+   ByteBufferSlice() : _offset(0), _numBytes(0) {/* empty */}
+
+   /** Constructor.
+     * @param buf the ConstByteBuffer that this slice should refer to.
+     * @param offset the index of the first byte within (buf) that is part of the slice.
+     * @param numBytes the number of bytes in the slice.
+     * @note It's the caller's responsibility to ensure that (offset+numBytes) is not greater than (buf)'s size.
+     */
+   ByteBufferSlice(const ConstByteBufferRef & buf, uint32 offset, uint32 numBytes) : _buf(buf), _offset(offset), _numBytes(numBytes) {/* empty */}
+
+   /** Returns the ConstByteBuffer that this slice refers to. */
+   MUSCLE_NODISCARD const ConstByteBufferRef & GetBuffer() const {return _buf;}
+
+   /** Returns the index of our first byte within our ConstByteBuffer. */
+   MUSCLE_NODISCARD uint32 GetOffset() const {return _offset;}
+
+   /** Returns the number of bytes in this slice. */
+   MUSCLE_NODISCARD uint32 GetNumBytes() const {return _numBytes;}
+
+   /** Returns a pointer to the first byte of this slice, or NULL if this slice doesn't refer to a buffer. */
+   MUSCLE_NODISCARD const uint8 * GetBytes() const {return _buf() ? (_buf()->GetBuffer()+_offset) : NULL;}
+
+   /** Returns a slice that refers to a sub-range of this slice's bytes.  No bytes are copied.
+     * @param offset the index (relative to the start of this slice) of the first byte to include.
+     * @param numBytes the maximum number of bytes to include.  The returned slice will be clipped to fit within this slice.
+     */
+   MUSCLE_NODISCARD ByteBufferSlice GetSubSlice(uint32 offset, uint32 numBytes) const
+   {
+      const uint32 clippedOffset = muscleMin(offset, _numBytes);
+      return ByteBufferSlice(_buf, _offset+clippedOffset, muscleMin(numBytes, _numBytes-clippedOffset));
+   }
+
+   /** @copydoc DoxyTemplate::operator==(const DoxyTemplate &) const */
+   bool operator ==(const ByteBufferSlice & rhs) const {return ((_buf == rhs._buf)&&(_offset == rhs._offset)&&(_numBytes == rhs._numBytes));}
+
+   /** @copydoc DoxyTemplate::operator!=(const DoxyTemplate &) const */
+   bool operator !=(const ByteBufferSlice & rhs) const {return !(*this == rhs);}
+
+private:
+   ConstByteBufferRef _buf;
+   uint32 _offset;
+   uint32 _numBytes;
+};
+
+/** A ByteBufferChain (aka a "rope") is a logical sequence of bytes that is made up of an ordered list of ByteBufferSlices.
+  * Appending, prepending, splitting and sub-slicing a ByteBufferChain are all done by manipulating the list of slices,
+  * so that (for example) a header can be prepended to a payload, or several payloads concatenated together, without
+  * allocating a new ByteBuffer and copying all of the bytes into it.  When the bytes finally need to go out over the
+  * network, WriteVectored() can hand all of the slices to the kernel in a single vectored-write call.
+  * @note since the slices are read-only views into ConstByteBuffers that may be shared with other code, the
+  *       bytes themselves must not be modified while they are part of a chain.
+  */
+class ByteBufferChain : public RefCountable
+{
+public:
+   /** Default constructor.  Creates an empty chain. */
+   ByteBufferChain() : _numBytes(0) {/* empty */}
+
+   /** Convenience constructor.  Creates a chain containing all of the bytes in (buf).
+     * @param buf the buffer to add to the chain.  No bytes are copied.
+     */
+   explicit ByteBufferChain(const ConstByteBufferRef & buf) : _numBytes(0) {(void) AppendBuffer(buf);}
+
+   /** @copydoc DoxyTemplate::DoxyTemplate(const DoxyTemplate &) */
+   ByteBufferChain(const ByteBufferChain & rhs) : RefCountable(), _slices(rhs._slices), _numBytes(rhs._numBytes) {/* empty */}
+
+   /** Destructor */
+   virtual ~ByteBufferChain() {/* empty */}
+
+   /** @copydoc DoxyTemplate::operator=(const DoxyTemplate &) */
+   ByteBufferChain & operator =(const ByteBufferChain & rhs) {if (this != &rhs) {_slices = rhs._slices; _numBytes = rhs._numBytes;} return *this;}
+
+   /** Returns true iff (rhs) contains the same sequence of bytes that we do (regardless of how the bytes are divided up into slices)
+     * @param rhs the ByteBufferChain to compare against
+     */
+   bool operator ==(const ByteBufferChain & rhs) const;
+
+   /** @copydoc DoxyTemplate::operator!=(const DoxyTemplate &) const */
+   bool operator !=(const ByteBufferChain & rhs) const {return !(*this == rhs);}
+
+   /** Appends a range of bytes from (buf) to the end of this chain.  No bytes are copied.
+     * @param buf the buffer to append bytes from.
+     * @param offset the index of the first byte within (buf) to append.  Defaults to zero.
+     * @param numBytes the maximum number of bytes to append.  Defaults to MUSCLE_NO_LIMIT (i.e. all of (buf)'s bytes after (offset))
+     * @returns B_NO_ERROR on success, B_BAD_ARGUMENT if (buf) is a NULL reference, or B_OUT_OF_MEMORY.
+     */
+   status_t AppendBuffer(const ConstByteBufferRef & buf, uint32 offset = 0, uint32 numBytes = MUSCLE_NO_LIMIT) {return buf() ? AppendSlice(MakeSlice(buf, offset, numBytes)) : B_BAD_ARGUMENT;}
+
+   /** Prepends a range of bytes from (buf) to the beginning of this chain.  No bytes are copied.
+     * @param buf the buffer to prepend bytes from.
+     * @param offset the index of the first byte within (buf) to prepend.  Defaults to zero.
+     * @param numBytes the maximum number of bytes to prepend.  Defaults to MUSCLE_NO_LIMIT (i.e. all of (buf)'s bytes after (offset))
+     * @returns B_NO_ERROR on success, B_BAD_ARGUMENT if (buf) is a NULL reference, or B_OUT_OF_MEMORY.
+     */
+   status_t PrependBuffer(const ConstByteBufferRef & buf, uint32 offset = 0, uint32 numBytes = MUSCLE_NO_LIMIT) {return buf() ? PrependSlice(MakeSlice(buf, offset, numBytes)) : B_BAD_ARGUMENT;}
+
+   /** Appends (slice) to the end of this chain.  Empty slices are ignored.
+     * @param slice the slice to append
+     * @returns B_NO_ERROR on success, or B_OUT_OF_MEMORY, or B_RESOURCE_LIMIT if the chain would become larger than 4GB.
+     */
+   status_t AppendSlice(const ByteBufferSlice & slice);
+
+   /** Prepends (slice) to the beginning of this chain.  Empty slices are ignored.
+     * @param slice the slice to prepend
+     * @returns B_NO_ERROR on success, or B_OUT_OF_MEMORY, or B_RESOURCE_LIMIT if the chain would become larger than 4GB.
+     */
+   status_t PrependSlice(const ByteBufferSlice & slice);
+
+   /** Appends all of (chain)'s slices to the end of this chain.  No bytes are copied.
+     * @param chain the chain to append.  It's okay for (chain) to be this chain.
+     * @returns B_NO_ERROR on success, or B_OUT_OF_MEMORY, or B_RESOURCE_LIMIT if the chain would become larger than 4GB.
+     */
+   status_t AppendChain(const ByteBufferChain & chain);
+
+   /** Prepends all of (chain)'s slices to the beginning of this chain.  No bytes are copied.
+     * @param chain the chain to prepend.  It's okay for (chain) to be this chain.
+     * @returns B_NO_ERROR on success, or B_OUT_OF_MEMORY, or B_RESOURCE_LIMIT if the chain would become larger than 4GB.
+     */
+   status_t PrependChain(const ByteBufferChain & chain);
+
+   /** Convenience method:  copies (numBytes) bytes from (bytes) into a new ByteBuffer, and appends that buffer to this chain.
+     * @param bytes pointer to the bytes to copy
+     * @param numBytes the number of bytes to copy
+     * @returns B_NO_ERROR on success, or B_OUT_OF_MEMORY.
+     */
+   status_t AppendBytes(const void * bytes, uint32 numBytes);
+
+   /** Sets (retChain) to contain the specified sub-range of our bytes.  No bytes are copied.
+     * @param offset the index of the first byte to include in (retChain).
+     * @param numBytes the maximum number of bytes to include in (retChain).  The range will be clipped to fit within this chain.
+     * @param retChain on success, this chain's previous contents will be replaced with the requested range.  May not be this chain.
+     * @returns B_NO_ERROR on success, or B_BAD_ARGUMENT if (retChain) is this chain, or B_OUT_OF_MEMORY.
+     */
+   status_t GetSubChain(uint32 offset, uint32 numBytes, ByteBufferChain & retChain) const;
+
+   /** Splits this chain into two at the specified byte-offset.  No bytes are copied.
+     * @param offset the index of the first byte that should be moved into (retTail).  Bytes before this index remain in this chain.
+     * @param retTail on success, this chain's previous contents will be replaced with our bytes from (offset) onwards.  May not be this chain.
+     * @returns B_NO_ERROR on success, or B_BAD_ARGUMENT if (retTail) is this chain, or B_OUT_OF_MEMORY.
+     */
+   status_t SplitAt(uint32 offset, ByteBufferChain & retTail);
+
+   /** Removes up to (numBytes) bytes from the beginning of this chain.
+     * @param numBytes the number of bytes to remove.
+     * @returns the number of bytes that were actually removed.
+     */
+   uint32 RemoveHeadBytes(uint32 numBytes);
+
+   /** Removes up to (numBytes) bytes from the end of this chain.
+     * @param numBytes the number of bytes to remove.
+     * @returns the number of bytes that were actually removed.
+     */
+   uint32 RemoveTailBytes(uint32 numBytes);
+
+   /** Copies bytes out of this chain into a contiguous array.
+     * @param offset the index of the first byte to copy.
+     * @param buffer the array to copy bytes into.
+     * @param numBytes the maximum number of bytes to copy.
+     * @returns the number of bytes that were actually copied.
+     */
+   uint32 CopyBytes(uint32 offset, void * buffer, uint32 numBytes) const;
+
+   /** Returns a ConstByteBuffer containing all of our bytes.  If this chain consists of a single slice that spans an
+     * entire ConstByteBuffer, that ConstByteBuffer is returned directly; otherwise a new ByteBuffer is allocated and
+     * all of our bytes are copied into it.
+     * @returns a reference to the buffer on success, or a NULL reference on failure (out of memory).
+     */
+   ConstByteBufferRef GetFlattenedBuffer() const;
+
+#ifndef WIN32
+   /** Fills in an array of iovec structs (as used by writev() and sendmsg()) to point to our slices, in order.
+     * @param retVecs the array of iovec structs to fill in.
+     * @param maxVecs the number of iovec structs in (retVecs).
+     * @returns the number of iovec structs that were filled in.  If this chain has more than (maxVecs) slices,
+     *          only the first (maxVecs) slices will be described.
+     */
+   uint32 GetIOVecs(struct iovec * retVecs, uint32 maxVecs) const;
+#endif
+
+   /** Writes as many of our bytes as possible to (sock) using a single vectored-write call (writev() on POSIX,
+     * WSASend() under Windows), and then removes the bytes that were written from the beginning of this chain.
+     * @param sock the socket or file descriptor to write to.  (Under Windows, this must be a socket)
+     * @param blocking true iff (sock) is in blocking-I/O mode.  Defaults to false.
+     * @returns the number of bytes that were written (which may be zero if (sock) is non-blocking and its buffer is full), or an error code.
+     */
+   io_status_t WriteVectored(const ConstSocketRef & sock, bool blocking = false);
+
+   /** Removes all slices from this chain. */
+   void Clear() {_slices.Clear(); _numBytes = 0;}
+
+   /** Returns the total number of bytes in this chain. */
+   MUSCLE_NODISCARD uint32 GetNumBytes() const {return _numBytes;}
+
+   /** Returns true iff this chain contains no bytes. */
+   MUSCLE_NODISCARD bool IsEmpty() const {return (_numBytes == 0);}
+
+   /** Returns true iff this chain contains at least one byte. */
+   MUSCLE_NODISCARD bool HasBytes() const {return (_numBytes > 0);}
+
+   /** Returns the number of slices in this chain. */
+   MUSCLE_NODISCARD uint32 GetNumSlices() const {return _slices.GetNumItems();}
+
+   /** Returns the slice at the specified index.
+     * @param idx the index of the slice to return.  Must be less than GetNumSlices().
+     */
+   MUSCLE_NODISCARD const ByteBufferSlice & GetSliceAt(uint32 idx) const {return _slices[idx];}
+
+   /** Swaps our contents with those of (rhs).
+     * @param rhs the ByteBufferChain to swap contents with
+     */
+   void SwapContents(ByteBufferChain & rhs) {_slices.SwapContents(rhs._slices); muscleSwap(_numBytes, rhs._numBytes);}
+
+private:
+   static ByteBufferSlice MakeSlice(const ConstByteBufferRef & buf, uint32 offset, uint32 numBytes)
+   {
+      const uint32 bufSize       = buf()->GetNumBytes();
+      const uint32 clippedOffset = muscleMin(offset, bufSize);
+      return ByteBufferSlice(buf, clippedOffset, muscleMin(numBytes, bufSize-clippedOffset));
+   }
+
+   // Returns the index of the slice that contains byte (offset), and sets (retOffsetInSlice) to that byte's index within the slice
+   uint32 FindSlice(uint32 offset, uint32 & retOffsetInSlice) const;
+
+   Queue<ByteBufferSlice> _slices;
+   uint32 _numBytes;
+};
+DECLARE_REFTYPES(ByteBufferChain);
+
+} // end namespace muscle
+
+#endif
@@ -0,0 +1,703 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#ifndef MuscleFlatHashtable_h
+#define MuscleFlatHashtable_h
+
+#include "support/MuscleSIMD.h"
+#include "util/HashtableIterator.h"  // for the HT_* move-semantics macros
+#include "util/Queue.h"
+
+namespace muscle {
+
+template <class KeyType, class ValueType, class HashFunctorType> class FlatHashtableIterator;
+template <class KeyType, class ValueType, class HashFunctorType> class ConstFlatHashtableIterator;
+
+/** FlatHashtable is an open-addressing hash table that can be used as a faster alternative to Hashtable for lookup-heavy tables.
+  *
+  * Rather than chaining entries together in buckets, FlatHashtable keeps one control-byte per slot (holding 7 bits of the key's
+  * hash code, or an empty/deleted marker), and probes the control-bytes sixteen at a time using SSE2 or NEON instructions (when
+  * available) to find the few slots whose entries are worth comparing against the lookup-key.  The key/value pairs themselves
+  * are stored densely in a separate array, so iterating over the table is a simple linear scan.
+  *
+  * FlatHashtable supports the commonly-used subset of Hashtable's API (Put(), Get(), GetOrPut(), Remove(), ContainsKey(), etc),
+  * so that a call site that uses only that subset can switch between the two by changing a typedef.  Note the following differences:
+  *  - A plain FlatHashtable doesn't guarantee any particular iteration order.  Use OrderedFlatHashtable (or pass true to the
+  *    constructor) if you need entries to be iterated in the order they were inserted, as Hashtable does.
+  *  - It is safe to remove the current entry while iterating, but adding entries (or removing any other entry) while an iterator
+  *    is in use invalidates that iterator.  (Hashtable's iterators are more forgiving)
+  *  - Pointers to keys and values are invalidated by any subsequent Put() or Remove() call.
+  *  - Sorting, PutBefore()/PutBehind(), index-based access and the other order-manipulation methods are not supported.
+  *
+  * @tparam KeyType the type of the keys of the key-value pairs in the FlatHashtable.
+  * @tparam ValueType the type of the values of the key-value pairs in the FlatHashtable.
+  * @tparam HashFunctorType the type of the hash functor to use to calculate hashes of keys in the table.  If not specified, an appropriate type will be chosen via SFINAE magic.
+  */
+template<class KeyType, class ValueType, class HashFunctorType=typename DEFAULT_HASH_FUNCTOR(KeyType) > class MUSCLE_NODISCARD FlatHashtable
+{
+public:
+   /** The iterator types that go with this FlatHashtable type */
+   typedef FlatHashtableIterator<KeyType,ValueType,HashFunctorType> IteratorType;
+   typedef ConstFlatHashtableIterator<KeyType,ValueType,HashFunctorType> ConstIteratorType;
+
+   /** Default constructor.
+     * @param preserveOrdering if true, iteration will visit the entries in the order they were inserted (as Hashtable does),
+     *                         at the cost of leaving a placeholder in the entries-array for each removed entry until the
+     *                         next time the table is rehashed.  Defaults to false.
+     */
+   explicit FlatHashtable(bool preserveOrdering = false) : _groups(NULL), _numSlots(0), _numItems(0), _numUsedSlots(0), _preserveOrdering(preserveOrdering) {/* empty */}
+
+   /** @copydoc DoxyTemplate::DoxyTemplate(const DoxyTemplate &) */
+   FlatHashtable(const FlatHashtable & rhs) : _groups(NULL), _numSlots(0), _numItems(0), _numUsedSlots(0), _preserveOrdering(rhs._preserveOrdering) {(void) CopyFrom(rhs);}
+
+   /** Destructor. */
+   ~FlatHashtable() {delete [] _groups;}
+
+   /** @copydoc DoxyTemplate::operator=(const DoxyTemplate &) */
+   FlatHashtable & operator=(const FlatHashtable & rhs) {if (this != &rhs) (void) CopyFrom(rhs); return *this;}
+
+#ifndef MUSCLE_AVOID_CPLUSPLUS11
+   /** @copydoc DoxyTemplate::DoxyTemplate(DoxyTemplate &&) */
+   FlatHashtable(FlatHashtable && rhs) MUSCLE_NOEXCEPT : _groups(NULL), _numSlots(0), _numItems(0), _numUsedSlots(0), _preserveOrdering(rhs._preserveOrdering) {SwapContents(rhs);}
+
+   /** @copydoc DoxyTemplate::operator=(DoxyTemplate &&) */
+   FlatHashtable & operator=(FlatHashtable && rhs) MUSCLE_NOEXCEPT {SwapContents(rhs); return *this;}
+#endif
+
+   /** Returns true iff this table contains the same set of key/value pairs as (rhs).  Ordering is not considered.
+     * @param rhs the table to compare against
+     */
+   bool operator==(const FlatHashtable & rhs) const;
+
+   /** Returns true iff this table's contents differ from (rhs)'s contents.
+     * @param rhs the table to compare against
+     */
+   bool operator!=(const FlatHashtable & rhs) const {return !(*this == rhs);}
+
+   /** Returns the number of items stored in the table. */
+   MUSCLE_NODISCARD uint32 GetNumItems() const {return _numItems;}
+
+   /** Convenience method;  Returns true iff the table is empty (ie if GetNumItems() is zero). */
+   MUSCLE_NODISCARD bool IsEmpty() const {return (_numItems == 0);}
+
+   /** Convenience method;  Returns true iff the table is non-empty (ie if GetNumItems() is non-zero). */
+   MUSCLE_NODISCARD bool HasItems() const {return (_numItems > 0);}
+
+   /** Returns the number of slots in our control-array.  The table will be rehashed into a larger array when more than 7/8 of these are in use. */
+   MUSCLE_NODISCARD uint32 GetNumAllocatedItemSlots() const {return _numSlots;}
+
+   /** Returns true iff this table iterates its entries in insertion-order (see the constructor) */
+   MUSCLE_NODISCARD bool IsPreservingOrdering() const {return _preserveOrdering;}
+
+   /** Returns true iff the table contains a mapping with the given key.
+     * @param key the key to inquire about
+     */
+   MUSCLE_NODISCARD bool ContainsKey(const KeyType & key) const {return (FindEntry(ComputeHash(key), key) != NULL);}
+
+   /** Retrieve a pointer to the associated value object for the given key.
+    *  @param key The key to use to look up a value.
+    *  @return A pointer to the internally held value object for the given key, or NULL if no object was found.
+    *          Note that this pointer is only guaranteed to remain valid as long as the table remains unchanged.
+    */
+   MUSCLE_NODISCARD ValueType * Get(const KeyType & key) {Entry * e = FindEntry(ComputeHash(key), key); return e ? &e->_value : NULL;}
+
+   /** As above, but read-only.
+    *  @param key The key to use to look up a value.
+    *  @return A pointer to the internally held value object for the given key, or NULL if no object was found.
+    */
+   MUSCLE_NODISCARD const ValueType * Get(const KeyType & key) const {const Entry * e = FindEntry(ComputeHash(key), key); return e ? &e->_value : NULL;}
+
+   /** Attempts to retrieve the associated value from the table for a given key.
+    *  @param key The key to use to look up a value.
+    *  @param retValue On success, the associated value is copied into this object.
+    *  @return B_NO_ERROR on success, B_DATA_NOT_FOUND if there was no value found for the given key.
+    */
+   status_t Get(const KeyType & key, ValueType & retValue) const
+   {
+      const ValueType * v = Get(key);
+      if (v == NULL) return B_DATA_NOT_FOUND;
+      retValue = *v;
+      return B_NO_ERROR;
+   }
+
+   /** Returns a reference to the value associated with (key), or a reference to a default-constructed value if (key) isn't in the table.
+     * @param key the key to look up
+     */
+   MUSCLE_NODISCARD const ValueType & GetWithDefault(const KeyType & key) const {const ValueType * v = Get(key); return v ? *v : GetDefaultObjectForType<ValueType>();}
+
+   /** Returns a copy of the value associated with (key), or (defaultValue) if (key) isn't in the table.
+     * @param key the key to look up
+     * @param defaultValue the value to return if (key) isn't in the table
+     */
+   MUSCLE_NODISCARD ValueType GetWithDefault(const KeyType & key, const ValueType & defaultValue) const {const ValueType * v = Get(key); return v ? *v : defaultValue;}
+
+   /** Synonym for GetWithDefault(key)
+     * @param key the key to look up
+     */
+   MUSCLE_NODISCARD const ValueType & operator[](const KeyType & key) const {return GetWithDefault(key);}
+
+   /** Places the given (key, value) mapping into the table, replacing any existing value that was associated with (key).
+    *  @param key The key that the new value is to be associated with.
+    *  @param value The value to associate with the new key.
+    *  @returns B_NO_ERROR on success, or B_OUT_OF_MEMORY.
+    */
+   HT_UniversalSinkKeyValueRef status_t Put(HT_SinkKeyParam key, HT_SinkValueParam value) {return (PutAux(ComputeHash(key), HT_ForwardKey(key), HT_ForwardValue(value), true) != NULL) ? B_NO_ERROR : B_OUT_OF_MEMORY;}
+
+   /** Convenience method:  Places (key) into the table with a default-constructed value.
+    *  @param key The key to place into the table.
+    *  @returns B_NO_ERROR on success, or B_OUT_OF_MEMORY.
+    */
+   HT_UniversalSinkKeyRef status_t PutWithDefault(HT_SinkKeyParam key) {return Put(HT_ForwardKey(key), GetDefaultObjectForType<ValueType>());}
+
+   /** Places the given (key, value) mapping into the table, and returns a pointer to the value held in the table.
+    *  @param key The key that the new value is to be associated with.
+    *  @param value The value to associate with the new key.
+    *  @returns a pointer to the value in the table on success, or NULL on failure (out of memory).
+    */
+   HT_UniversalSinkKeyValueRef MUSCLE_NODISCARD ValueType * PutAndGet(HT_SinkKeyParam key, HT_SinkValueParam value) {Entry * e = PutAux(ComputeHash(key), HT_ForwardKey(key), HT_ForwardValue(value), true); return e ? &e->_value : NULL;}
+
+   /** As above, except a default-constructed value is placed into the table.
+    *  @param key The key to place into the table.
+    *  @returns a pointer to the value in the table on success, or NULL on failure (out of memory).
+    */
+   HT_UniversalSinkKeyRef MUSCLE_NODISCARD ValueType * PutAndGet(HT_SinkKeyParam key) {return PutAndGet(HT_ForwardKey(key), GetDefaultObjectForType<ValueType>());}
+
+   /** Returns a pointer to the value associated with (key).  If (key) isn't in the table, it is first placed into the table with (defaultValue).
+    *  @param key The key to look up (or add).
+    *  @param defaultValue The value to associate with (key) if (key) isn't already in the table.
+    *  @returns a pointer to the value in the table on success, or NULL on failure (out of memory).
+    */
+   HT_UniversalSinkKeyValueRef MUSCLE_NODISCARD ValueType * GetOrPut(HT_SinkKeyParam key, HT_SinkValueParam defaultValue) {Entry * e = PutAux(ComputeHash(key), HT_ForwardKey(key), HT_ForwardValue(defaultValue), false); return e ? &e->_value : NULL;}
+
+   /** As above, except that a default-constructed value is used if (key) isn't already in the table.
+    *  @param key The key to look up (or add).
+    *  @returns a pointer to the value in the table on success, or NULL on failure (out of memory).
+    */
+   HT_UniversalSinkKeyRef MUSCLE_NODISCARD ValueType * GetOrPut(HT_SinkKeyParam key) {return GetOrPut(HT_ForwardKey(key), GetDefaultObjectForType<ValueType>());}
+
+   /** Removes the mapping with the given key from the table.
+    *  @param key The key of the key/value pair to remove.
+    *  @return B_NO_ERROR on success, or B_DATA_NOT_FOUND if (key) wasn't in the table.
+    */
+   status_t Remove(const KeyType & key) {return RemoveAux(key, NULL);}
+
+   /** Removes the mapping with the given key from the table, and copies the removed value into (setRemovedValue).
+    *  @param key The key of the key/value pair to remove.
+    *  @param setRemovedValue on success, the removed value is written here.
+    *  @return B_NO_ERROR on success, or B_DATA_NOT_FOUND if (key) wasn't in the table.
+    */
+   status_t Remove(const KeyType & key, ValueType & setRemovedValue) {return RemoveAux(key, &setRemovedValue);}
+
+   /** Removes all key/value pairs from the table.
+     * @param releaseCachedData if true, we'll also free our internal arrays.  Otherwise they are kept around for re-use.  Defaults to false.
+     */
+   void Clear(bool releaseCachedData = false);
+
+   /** Makes sure the table has enough room to hold (numItems) items without needing to rehash.
+     * @param numItems the number of items the table should be able to hold.
+     * @returns B_NO_ERROR on success, or B_OUT_OF_MEMORY.
+     */
+   status_t EnsureSize(uint32 numItems);
+
+   /** Swaps our contents with those of (swapMe).
+     * @param swapMe the table to swap contents with
+     */
+   void SwapContents(FlatHashtable & swapMe) MUSCLE_NOEXCEPT
+   {
+      _entries.SwapContents(swapMe._entries);
+      muscleSwap(_groups,           swapMe._groups);
+      muscleSwap(_numSlots,         swapMe._numSlots);
+      muscleSwap(_numItems,         swapMe._numItems);
+      muscleSwap(_numUsedSlots,     swapMe._numUsedSlots);
+      muscleSwap(_preserveOrdering, swapMe._preserveOrdering);
+   }
+
+   /** Returns the average number of key-comparisons done per successful lookup, for all of the keys currently in the table.  (for debugging) */
+   MUSCLE_NODISCARD double CountAverageLookupComparisons() const;
+
+private:
+   friend class FlatHashtableIterator<KeyType,ValueType,HashFunctorType>;
+   friend class ConstFlatHashtableIterator<KeyType,ValueType,HashFunctorType>;
+
+   enum {
+      GROUP_WIDTH = 16,                                     // number of control-bytes that are examined at once
+      GROUP_SIZE  = GROUP_WIDTH+(GROUP_WIDTH*sizeof(uint32))  // each group's control-bytes are followed by its slots' entry-indices, so a lookup touches one region instead of two
+   };
+
+   static const uint8  CTRL_EMPTY    = 0x80;  // slot has never been used (since the last rehash)
+   static const uint8  CTRL_DELETED  = 0xFE;  // slot's entry was removed, but a probe-sequence may continue past it
+   static const uint32 INVALID_INDEX = (uint32)-1;
+
+#ifndef DOXYGEN_SHOULD_IGNORE_THIS
+   class Entry
+   {
+   public:
+      Entry() : _key(), _value(), _hash(0), _slot(INVALID_INDEX) {/* empty */}
+
+      KeyType _key;
+      ValueType _value;
+      uint32 _hash;  // the key's hash code, as returned by ComputeHash()
+      uint32 _slot;  // index of the slot that points to this entry, or INVALID_INDEX if this entry is a placeholder for a removed entry
+   };
+#endif
+
+   MUSCLE_NODISCARD inline uint32 ComputeHash(const KeyType & key) const {return GetDefaultObjectForType<HashFunctorType>()(key);}
+   MUSCLE_NODISCARD inline bool AreKeysEqual(const KeyType & k1, const KeyType & k2) const {return GetDefaultObjectForType<HashFunctorType>().AreKeysEqual(k1, k2);}
+
+   // Scrambles the hash code a bit, so that poorly-distributed hash codes (e.g. sequential integers) still spread out well
+   MUSCLE_NODISCARD static inline uint32 MixHash(uint32 hash) {const uint32 m = hash*0x9E3779B1; return m ^ (m>>15);}
+   MUSCLE_NODISCARD static inline uint8 GetControlByteForMixedHash(uint32 mixed) {return (uint8)(mixed & 0x7F);}
+   MUSCLE_NODISCARD static inline uint32 GetFirstGroupForMixedHash(uint32 mixed, uint32 numGroups) {return (uint32)((((uint64)mixed)*numGroups)>>32);}
+   MUSCLE_NODISCARD static inline uint32 MatchByte(const uint8 * group, uint8 b);
+   MUSCLE_NODISCARD static inline uint32 MatchEmptyOrDeleted(const uint8 * group);
+   MUSCLE_NODISCARD static inline uint32 GetLowestBitIndex(uint32 mask);
+
+   MUSCLE_NODISCARD uint8 * GetGroupControlBytes(uint32 groupIdx) const {return &_groups[groupIdx*GROUP_SIZE];}
+   MUSCLE_NODISCARD uint8 & GetControlByte(uint32 slotIdx) const {return GetGroupControlBytes(slotIdx/GROUP_WIDTH)[slotIdx%GROUP_WIDTH];}
+   MUSCLE_NODISCARD uint32 & GetSlotEntryIndex(uint32 slotIdx) const {return reinterpret_cast<uint32 *>(GetGroupControlBytes(slotIdx/GROUP_WIDTH)+GROUP_WIDTH)[slotIdx%GROUP_WIDTH];}
+   void ClearControlBytes() {for (uint32 i=0; i<_numSlots/GROUP_WIDTH; i++) memset(GetGroupControlBytes(i), CTRL_EMPTY, GROUP_WIDTH);}
+
+   MUSCLE_NODISCARD Entry * FindEntry(uint32 hash, const KeyType & key) const;
+   MUSCLE_NODISCARD uint32 FindSlot(uint32 hash, const KeyType & key) const;
+   MUSCLE_NODISCARD uint32 FindInsertionSlot(uint32 mixed) const;
+   HT_UniversalSinkKeyValueRef MUSCLE_NODISCARD Entry * PutAux(uint32 hash, HT_SinkKeyParam key, HT_SinkValueParam value, bool replaceExistingValue);
+   status_t RemoveAux(const KeyType & key, ValueType * optSetRemovedValue);
+   status_t Rehash(uint32 newNumSlots);
+   status_t CopyFrom(const FlatHashtable & rhs);
+   void CompactEntries();
+
+   // Iteration support:  returns the index of the entry to visit after (entryIdx), or -1 if there are no more.  Pass -1 to get the first entry.
+   // Unordered tables are iterated from back to front, so that removing the current entry (which moves the last entry into its place) is safe.
+   MUSCLE_NODISCARD int32 GetNextIterationIndex(int32 entryIdx) const
+   {
+      const int32 numEntries = (int32) _entries.GetNumItems();
+      if (_preserveOrdering)
+      {
+         for (int32 i=entryIdx+1; i<numEntries; i++) if (_entries[i]._slot != INVALID_INDEX) return i;
+         return -1;
+      }
+      else return (entryIdx < 0) ? (numEntries-1) : (muscleMin(entryIdx, numEntries)-1);
+   }
+   MUSCLE_NODISCARD bool IsIterationIndexValid(int32 entryIdx) const {return ((entryIdx >= 0)&&(entryIdx < (int32)_entries.GetNumItems()));}
+
+   Queue<Entry> _entries;  // our key/value pairs, stored densely (in insertion-order, if _preserveOrdering is true)
+   uint8 * _groups;        // array of groups; each group is GROUP_WIDTH control-bytes followed by GROUP_WIDTH uint32 entry-indices
+   uint32 _numSlots;       // always either zero or a power of two that is at least GROUP_WIDTH
+   uint32 _numItems;
+   uint32 _numUsedSlots;   // number of slots that are not CTRL_EMPTY
+   bool _preserveOrdering;
+};
+
+/** Same as FlatHashtable, except that iteration always visits the entries in the order they were inserted, as Hashtable's does.
+  * @tparam KeyType the type of the keys of the key-value pairs in the table.
+  * @tparam ValueType the type of the values of the key-value pairs in the table.
+  * @tparam HashFunctorType the type of the hash functor to use to calculate hashes of keys in the table.
+  */
+template<class KeyType, class ValueType, class HashFunctorType=typename DEFAULT_HASH_FUNCTOR(KeyType) > class MUSCLE_NODISCARD OrderedFlatHashtable : public FlatHashtable<KeyType, ValueType, HashFunctorType>
+{
+public:
+   /** Default constructor */
+   OrderedFlatHashtable() : FlatHashtable<KeyType, ValueType, HashFunctorType>(true) {/* empty */}
+};
+
+/** Iterator for a FlatHashtable.  Usage is the same as for a HashtableIterator:
+  * <pre>for (FlatHashtableIterator<String, int> iter(table); iter.HasData(); iter++) printf("%s -> %i\n", iter.GetKey()(), iter.GetValue());</pre>
+  * @tparam KeyType the key-type of the FlatHashtable to iterate over
+  * @tparam ValueType the value-type of the FlatHashtable to iterate over
+  * @tparam HashFunctorType the hash-functor-type of the FlatHashtable to iterate over
+  */
+template <class KeyType, class ValueType, class HashFunctorType=typename DEFAULT_HASH_FUNCTOR(KeyType) > class MUSCLE_NODISCARD FlatHashtableIterator
+{
+public:
+   /** Default constructor.  Creates an iterator that has no data. */
+   FlatHashtableIterator() : _table(NULL), _entryIdx(-1) {/* empty */}
+
+   /** Constructor.
+     * @param table the table to iterate over.
+     */
+   FlatHashtableIterator(FlatHashtable<KeyType,ValueType,HashFunctorType> & table) : _table(&table), _entryIdx(table.GetNextIterationIndex(-1)) {/* empty */}
+
+   /** Advances the iterator to the next key/value pair in the table. */
+   void operator++(int) {if (_table) _entryIdx = _table->GetNextIterationIndex(_entryIdx);}
+
+   /** Returns true iff this iterator is currently pointing to a valid key/value pair. */
+   MUSCLE_NODISCARD bool HasData() const {return ((_table)&&(_table->IsIterationIndexValid(_entryIdx)));}
+
+   /** Returns a reference to the current key.  Only call this when HasData() returns true! */
+   MUSCLE_NODISCARD const KeyType & GetKey() const {return _table->_entries[_entryIdx]._key;}
+
+   /** Returns a reference to the current value.  Only call this when HasData() returns true! */
+   MUSCLE_NODISCARD ValueType & GetValue() const {return _table->_entries[_entryIdx]._value;}
+
+private:
+   FlatHashtable<KeyType,ValueType,HashFunctorType> * _table;
+   int32 _entryIdx;
+};
+
+/** Read-only iterator for a FlatHashtable.
+  * @tparam KeyType the key-type of the FlatHashtable to iterate over
+  * @tparam ValueType the value-type of the FlatHashtable to iterate over
+  * @tparam HashFunctorType the hash-functor-type of the FlatHashtable to iterate over
+  */
+template <class KeyType, class ValueType, class HashFunctorType=typename DEFAULT_HASH_FUNCTOR(KeyType) > class MUSCLE_NODISCARD ConstFlatHashtableIterator
+{
+public:
+   /** Default constructor.  Creates an iterator that has no data. */
+   ConstFlatHashtableIterator() : _table(NULL), _entryIdx(-1) {/* empty */}
+
+   /** Constructor.
+     * @param table the table to iterate over.
+     */
+   ConstFlatHashtableIterator(const FlatHashtable<KeyType,ValueType,HashFunctorType> & table) : _table(&table), _entryIdx(table.GetNextIterationIndex(-1)) {/* empty */}
+
+   /** Advances the iterator to the next key/value pair in the table. */
+   void operator++(int) {if (_table) _entryIdx = _table->GetNextIterationIndex(_entryIdx);}
+
+   /** Returns true iff this iterator is currently pointing to a valid key/value pair. */
+   MUSCLE_NODISCARD bool HasData() const {return ((_table)&&(_table->IsIterationIndexValid(_entryIdx)));}
+
+   /** Returns a reference to the current key.  Only call this when HasData() returns true! */
+   MUSCLE_NODISCARD const KeyType & GetKey() const {return _table->_entries[_entryIdx]._key;}
+
+   /** Returns a reference to the current value.  Only call this when HasData() returns true! */
+   MUSCLE_NODISCARD const ValueType & GetValue() const {return _table->_entries[_entryIdx]._value;}
+
+private:
+   const FlatHashtable<KeyType,ValueType,HashFunctorType> * _table;
+   int32 _entryIdx;
+};
+
+//===============================================================
+// Implementation of FlatHashtable
+//===============================================================
+
+template<class KeyType, class ValueType, class HashFunctorType>
+uint32
+FlatHashtable<KeyType,ValueType,HashFunctorType>::MatchByte(const uint8 * group, uint8 b)
+{
+#if defined(MUSCLE_USE_SSE2)
+   return (uint32) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) group), _mm_set1_epi8((char)b)));
+#elif defined(MUSCLE_USE_NEON)
+   static const uint8 bitWeights[16] = {1,2,4,8,16,32,64,128,1,2,4,8,16,32,64,128};
+   const uint8x16_t matches = vandq_u8(vceqq_u8(vld1q_u8(group), vdupq_n_u8(b)), vld1q_u8(bitWeights));
+   uint8x8_t sums = vpadd_u8(vget_low_u8(matches), vget_high_u8(matches));
+   sums = vpadd_u8(sums, sums);
+   sums = vpadd_u8(sums, sums);
+   return ((uint32)vget_lane_u8(sums, 0)) | (((uint32)vget_lane_u8(sums, 1))<<8);
+#else
+   uint32 ret = 0;
+   for (uint32 i=0; i<GROUP_WIDTH; i++) if (group[i] == b) ret |= (1<<i);
+   return ret;
+#endif
+}
+
+template<class KeyType, class ValueType, class HashFunctorType>
+uint32
+FlatHashtable<KeyType,ValueType,HashFunctorType>::MatchEmptyOrDeleted(const uint8 * group)
+{
+   // CTRL_EMPTY and CTRL_DELETED are the only control-byte values that have their high bit set
+#if defined(MUSCLE_USE_SSE2)
+   return (uint32) _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) group));
+#elif defined(MUSCLE_USE_NEON)
+   static const uint8 bitWeights[16] = {1,2,4,8,16,32,64,128,1,2,4,8,16,32,64,128};
+   const uint8x16_t matches = vandq_u8(vtstq_u8(vld1q_u8(group), vdupq_n_u8(0x80)), vld1q_u8(bitWeights));
+   uint8x8_t sums = vpadd_u8(vget_low_u8(matches), vget_high_u8(matches));
+   sums = vpadd_u8(sums, sums);
+   sums = vpadd_u8(sums, sums);
+   return ((uint32)vget_lane_u8(sums, 0)) | (((uint32)vget_lane_u8(sums, 1))<<8);
+#else
+   uint32 ret = 0;
+   for (uint32 i=0; i<GROUP_WIDTH; i++) if (group[i] & 0x80) ret |= (1<<i);
+   return ret;
+#endif
+}
+
+template<class KeyType, class ValueType, class HashFunctorType>
+uint32
+FlatHashtable<KeyType,ValueType,HashFunctorType>::GetLowestBitIndex(uint32 mask)
+{
+#if defined(__GNUC__) || defined(__clang__)
+   return (uint32) __builtin_ctz(mask);
+#else
+   uint32 ret = 0;
+   while((mask & 1) == 0) {mask >>= 1; ret++;}
+   return ret;
+#endif
+}
+
+template<class KeyType, class ValueType, class HashFunctorType>
+uint32
+FlatHashtable<KeyType,ValueType,HashFunctorType>::FindSlot(uint32 hash, const KeyType & key) const
+{
+   if (_numItems == 0) return INVALID_INDEX;
+
+   const uint32 mixed     = MixHash(hash);
+   const uint8 ctrlByte   = GetControlByteForMixedHash(mixed);
+   const uint32 numGroups = _numSlots/GROUP_WIDTH;
+   const uint32 groupMask = numGroups-1;
+   uint32 groupIdx        = GetFirstGroupForMixedHash(mixed, numGroups);
+   for (uint32 probeCount=1; probeCount<=numGroups; probeCount++)
+   {
+      const uint8 * group = GetGroupControlBytes(groupIdx);
+      for (uint32 matches = MatchByte(group, ctrlByte); matches != 0; matches &= (matches-1))
+      {
+         const uint32 slotIdx = (groupIdx*GROUP_WIDTH)+GetLowestBitIndex(matches);
+         const Entry & e = _entries[GetSlotEntryIndex(slotIdx)];
+         if ((e._hash == hash)&&(AreKeysEqual(e._key, key))) return slotIdx;
+      }
+      if (MatchByte(group, CTRL_EMPTY) != 0) break;  // an empty slot means the key would have been placed here, had it been in the table
+
+      groupIdx = (groupIdx+probeCount)&groupMask;  // triangular probing visits every group exactly once
+   }
+   return INVALID_INDEX;
+}
+
+template<class KeyType, class ValueType, class HashFunctorType>
+typename FlatHashtable<KeyType,ValueType,HashFunctorType>::Entry *
+FlatHashtable<KeyType,ValueType,HashFunctorType>::FindEntry(uint32 hash, const KeyType & key) const
+{
+   const uint32 slotIdx = FindSlot(hash, key);
+   return (slotIdx == INVALID_INDEX) ? NULL : const_cast<Entry *>(&_entries[GetSlotEntryIndex(slotIdx)]);
+}
+
+template<class KeyType, class ValueType, class HashFunctorType>
+uint32
+FlatHashtable<KeyType,ValueType,HashFunctorType>::FindInsertionSlot(uint32 mixed) const
+{
+   const uint32 numGroups = _numSlots/GROUP_WIDTH;
+   const uint32 groupMask = numGroups-1;
+   uint32 groupIdx        = GetFirstGroupForMixedHash(mixed, numGroups);
+   for (uint32 probeCount=1; probeCount<=numGroups; probeCount++)
+   {
+      const uint32 available = MatchEmptyOrDeleted(GetGroupControlBytes(groupIdx));
+      if (available != 0) return (groupIdx*GROUP_WIDTH)+GetLowestBitIndex(available);
+      groupIdx = (groupIdx+probeCount)&groupMask;
+   }
+   return INVALID_INDEX;  // should never happen, since we never let the table get completely full
+}
+
+template<class KeyType, class ValueType, class HashFunctorType>
+HT_UniversalSinkKeyValueRef
+typename FlatHashtable<KeyType,ValueType,HashFunctorType>::Entry *
+FlatHashtable<KeyType,ValueType,HashFunctorType>::PutAux(uint32 hash, HT_SinkKeyParam key, HT_SinkValueParam value, bool replaceExistingValue)
+{
+   Entry * e = FindEntry(hash, key);
+   if (e)
+   {
+      if (replaceExistingValue) e->_value = HT_ForwardValue(value);
+      return e;
+   }
+
+   // Rehash if adding another entry would push us past our maximum load factor of 7/8, or if (_entries) is mostly placeholders
+   const uint32 maxUsedSlots = _numSlots-(_numSlots/8);
+   if ((_numUsedSlots+1 > maxUsedSlots)||(_entries.GetNumItems() > (2*_numItems)+GROUP_WIDTH))
+   {
+      uint32 newNumSlots = muscleMax((uint32)GROUP_WIDTH, _numSlots);
+      while((_numItems+1) > (newNumSlots-(newNumSlots/8))/2) newNumSlots *= 2;  // leave room to grow, so we don't have to rehash again right away
+      if (Rehash(newNumSlots).IsError()) return NULL;
+   }
+
+   const uint32 mixed   = MixHash(hash);
+   const uint32 slotIdx = FindInsertionSlot(mixed);
+   if (slotIdx == INVALID_INDEX) return NULL;  // paranoia
+
+   e = _entries.AddTailAndGet();
+   if (e == NULL) {MWARN_OUT_OF_MEMORY; return NULL;}
+
+   e->_key   = HT_ForwardKey(key);
+   e->_value = HT_ForwardValue(value);
+   e->_hash  = hash;
+   e->_slot  = slotIdx;
+
+   uint8 & ctrl = GetControlByte(slotIdx);
+   if (ctrl == CTRL_EMPTY) _numUsedSlots++;
+   ctrl = GetControlByteForMixedHash(mixed);
+   GetSlotEntryIndex(slotIdx) = _entries.GetLastValidIndex();
+   _numItems++;
+   return e;
+}
+
+template<class KeyType, class ValueType, class HashFunctorType>
+status_t
+FlatHashtable<KeyType,ValueType,HashFunctorType>::RemoveAux(const KeyType & key, ValueType * optSetRemovedValue)
+{
+   const uint32 slotIdx = FindSlot(ComputeHash(key), key);
+   if (slotIdx == INVALID_INDEX) return B_DATA_NOT_FOUND;
+
+   const uint32 entryIdx = GetSlotEntryIndex(slotIdx);
+   Entry & e = _entries[entryIdx];
+   if (optSetRemovedValue) *optSetRemovedValue = e._value;
+
+   // If this slot's group still has an empty slot, no probe-sequence can have continued past it, so the slot can go back to being empty
+   if (MatchByte(GetGroupControlBytes(slotIdx/GROUP_WIDTH), CTRL_EMPTY) != 0)
+   {
+      GetControlByte(slotIdx) = CTRL_EMPTY;
+      _numUsedSlots--;
+   }
+   else GetControlByte(slotIdx) = CTRL_DELETED;
+
+   const uint32 lastIdx = _entries.GetLastValidIndex();
+   if (_preserveOrdering)
+   {
+      if (entryIdx == lastIdx)
+      {
+         (void) _entries.RemoveTail();
+         while((_entries.HasItems())&&(_entries.Tail()._slot == INVALID_INDEX)) (void) _entries.RemoveTail();  // trim any trailing placeholders too
+      }
+      else
+      {
+         // Leave a placeholder, so that the following entries keep their positions in the iteration-order
+         e._key   = GetDefaultObjectForType<KeyType>();
+         e._value = GetDefaultObjectForType<ValueType>();
+         e._slot  = INVALID_INDEX;
+      }
+   }
+   else
+   {
+      // Move the last entry into the removed entry's position, to keep (_entries) dense
+      if (entryIdx != lastIdx)
+      {
+#ifndef MUSCLE_AVOID_CPLUSPLUS11
+         e = std::move(_entries.Tail());
+#else
+         e = _entries.Tail();
+#endif
+         GetSlotEntryIndex(e._slot) = entryIdx;
+      }
+      (void) _entries.RemoveTail();
+   }
+
+   _numItems--;
+   return B_NO_ERROR;
+}
+
+template<class KeyType, class ValueType, class HashFunctorType>
+void
+FlatHashtable<KeyType,ValueType,HashFunctorType>::CompactEntries()
+{
+   // Squeeze out any placeholders left behind by Remove(), preserving the order of the remaining entries
+   const uint32 numEntries = _entries.GetNumItems();
+   uint32 writeIdx = 0;
+   for (uint32 readIdx=0; readIdx<numEntries; readIdx++)
+   {
+      if (_entries[readIdx]._slot != INVALID_INDEX)
+      {
+#ifndef MUSCLE_AVOID_CPLUSPLUS11
+         if (writeIdx != readIdx) _entries[writeIdx] = std::move(_entries[readIdx]);
+#else
+         if (writeIdx != readIdx) _entries[writeIdx] = _entries[readIdx];
+#endif
+         writeIdx++;
+      }
+   }
+   while(_entries.GetNumItems() > writeIdx) (void) _entries.RemoveTail();
+}
+
+template<class KeyType, class ValueType, class HashFunctorType>
+status_t
+FlatHashtable<KeyType,ValueType,HashFunctorType>::Rehash(uint32 newNumSlots)
+{
+   uint8 * newGroups = newnothrow_array(uint8, (newNumSlots/GROUP_WIDTH)*GROUP_SIZE);
+   MRETURN_OOM_ON_NULL(newGroups);
+
+   if (_entries.GetNumItems() > _numItems) CompactEntries();
+
+   delete [] _groups;
+   _groups       = newGroups;
+   _numSlots     = newNumSlots;
+   _numUsedSlots = _numItems;
+   ClearControlBytes();
+
+   for (uint32 i=0; i<_numItems; i++)
+   {
+      Entry & e = _entries[i];
+      const uint32 mixed = MixHash(e._hash);
+      e._slot = FindInsertionSlot(mixed);
+      GetControlByte(e._slot)    = GetControlByteForMixedHash(mixed);
+      GetSlotEntryIndex(e._slot) = i;
+   }
+   return B_NO_ERROR;
+}
+
+template<class KeyType, class ValueType, class HashFunctorType>
+status_t
+FlatHashtable<KeyType,ValueType,HashFunctorType>::EnsureSize(uint32 numItems)
+{
+   uint32 newNumSlots = muscleMax((uint32)GROUP_WIDTH, _numSlots);
+   while(numItems > newNumSlots-(newNumSlots/8)) newNumSlots *= 2;
+   return (newNumSlots > _numSlots) ? Rehash(newNumSlots) : B_NO_ERROR;
+}
+
+template<class KeyType, class ValueType, class HashFunctorType>
+void
+FlatHashtable<KeyType,ValueType,HashFunctorType>::Clear(bool releaseCachedData)
+{
+   _entries.Clear(releaseCachedData);
+   _numItems     = 0;
+   _numUsedSlots = 0;
+   if (releaseCachedData)
+   {
+      delete [] _groups;
+      _groups   = NULL;
+      _numSlots = 0;
+   }
+   else ClearControlBytes();
+}
+
+template<class KeyType, class ValueType, class HashFunctorType>
+status_t
+FlatHashtable<KeyType,ValueType,HashFunctorType>::CopyFrom(const FlatHashtable & rhs)
+{
+   Clear();
+   MRETURN_ON_ERROR(EnsureSize(rhs._numItems));
+   for (ConstFlatHashtableIterator<KeyType,ValueType,HashFunctorType> iter(rhs); iter.HasData(); iter++) MRETURN_ON_ERROR(Put(iter.GetKey(), iter.GetValue()));
+   return B_NO_ERROR;
+}
+
+template<class KeyType, class ValueType, class HashFunctorType>
+bool
+FlatHashtable<KeyType,ValueType,HashFunctorType>::operator==(const FlatHashtable & rhs) const
+{
+   if (this == &rhs) return true;
+   if (_numItems != rhs._numItems) return false;
+
+   for (ConstFlatHashtableIterator<KeyType,ValueType,HashFunctorType> iter(*this); iter.HasData(); iter++)
+   {
+      const ValueType * hisValue = rhs.Get(iter.GetKey());
+      if ((hisValue == NULL)||(!(*hisValue == iter.GetValue()))) return false;
+   }
+   return true;
+}
+
+template<class KeyType, class ValueType, class HashFunctorType>
+double
+FlatHashtable<KeyType,ValueType,HashFunctorType>::CountAverageLookupComparisons() const
+{
+   if (_numItems == 0) return 0.0;
+
+   uint64 totalComparisons = 0;
+   for (ConstFlatHashtableIterator<KeyType,ValueType,HashFunctorType> iter(*this); iter.HasData(); iter++)
+   {
+      const uint32 hash      = ComputeHash(iter.GetKey());
+      const uint32 mixed     = MixHash(hash);
+      const uint8 ctrlByte   = GetControlByteForMixedHash(mixed);
+      const uint32 numGroups = _numSlots/GROUP_WIDTH;
+      uint32 groupIdx        = GetFirstGroupForMixedHash(mixed, numGroups);
+      for (uint32 probeCount=1; probeCount<=numGroups; probeCount++)
+      {
+         bool found = false;
+         for (uint32 matches = MatchByte(GetGroupControlBytes(groupIdx), ctrlByte); matches != 0; matches &= (matches-1))
+         {
+            totalComparisons++;
+            const Entry & e = _entries[GetSlotEntryIndex((groupIdx*GROUP_WIDTH)+GetLowestBitIndex(matches))];
+            if ((e._hash == hash)&&(AreKeysEqual(e._key, iter.GetKey()))) {found = true; break;}
+         }
+         if (found) break;
+         groupIdx = (groupIdx+probeCount)&(numGroups-1);
+      }
+   }
+   return ((double)totalComparisons)/_numItems;
+}
+
+} // end namespace muscle
+
+#endif
@@ -246,7 +246,7 @@ private:
    {
       if (ref.IsRefPrivate())           return REF_STATUS_PRIVATE;
       if (ref.IsRefCounting() == false) return REF_STATUS_PUBLIC;  // paranoia?
-      if (ref()->GetRefCount() == 2)
+      if (ref()->IsRefCountEqualTo(2))
       {
          const ConstImmutableHashtableTypeRef * inCache = _lruCache.Get(ref()->_hashCodeSum);
          if ((inCache)&&(inCache->GetItemPointer() == ref())) return REF_STATUS_INLRUCACHE;
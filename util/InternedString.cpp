@@ -0,0 +1,108 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#include "util/InternedString.h"
+#include "util/Hashtable.h"
+#include "system/Mutex.h"
+
+namespace muscle {
+
+// The atom table is split into several independently-locked shards, so that threads interning
+// different strings at the same time will usually not contend for the same Mutex.
+static const uint32 NUM_INTERNED_STRING_SHARDS = 16;
+
+class InternedStringShard
+{
+public:
+   InternedStringShard() {/* empty */}
+
+   Mutex _mutex;
+   Hashtable<const String *, void *> _table;  // values are (InternedString::Entry *)s; the keys point to each Entry's _string
+};
+
+// Deliberately never deleted, so that InternedStrings that are destroyed during static-destruction time remain safe
+static InternedStringShard * GetInternedStringShards()
+{
+   static InternedStringShard * _shards = newnothrow_array(InternedStringShard, NUM_INTERNED_STRING_SHARDS);
+   return _shards;
+}
+
+static inline InternedStringShard * GetShardForHashCode(InternedStringShard * shards, uint32 hashCode)
+{
+   return &shards[(hashCode ^ (hashCode >> 16)) % NUM_INTERNED_STRING_SHARDS];
+}
+
+status_t InternedString :: SetFromString(const String & s)
+{
+   Reset();
+   if (s.IsEmpty()) return B_NO_ERROR;  // the empty string is always represented by a NULL entry
+
+   InternedStringShard * shards = GetInternedStringShards();
+   MRETURN_OOM_ON_NULL(shards);
+
+   const uint32 hashCode = s.HashCode();
+   InternedStringShard * shard = GetShardForHashCode(shards, hashCode);
+
+   DECLARE_MUTEXGUARD(shard->_mutex);
+
+   Entry * e = static_cast<Entry *>(shard->_table.GetWithDefault(&s));
+   if (e)
+   {
+      // Revive the existing entry, but only if its reference-count hasn't already dropped to zero.
+      // (If it has, its last owner is about to delete it, so we'll need to replace it with a new one)
+      while(1)
+      {
+         const int32 count = e->_refCount.GetCount();
+         if (count <= 0) break;
+         if (e->_refCount.ConditionalSetCount(count, count+1).IsOK())
+         {
+            _entry = e;
+            return B_NO_ERROR;
+         }
+      }
+
+      // Hashtable::Put() would keep the dying entry's key-pointer, so we need to remove it explicitly here
+      (void) shard->_table.Remove(&s);
+   }
+
+   e = newnothrow Entry(s, hashCode);
+   MRETURN_OOM_ON_NULL(e);
+
+   status_t ret;
+   if (shard->_table.Put(&e->_string, e).IsError(ret))
+   {
+      delete e;
+      return ret;
+   }
+
+   _entry = e;
+   return B_NO_ERROR;
+}
+
+void InternedString :: DeleteEntry(const Entry * entry)
+{
+   InternedStringShard * shard = GetShardForHashCode(GetInternedStringShards(), entry->_hashCode);  // (shards) can't be NULL if (entry) exists
+   {
+      DECLARE_MUTEXGUARD(shard->_mutex);
+
+      // Only remove the table's entry if it is still ours; a newer Entry might have replaced it already
+      void * tableEntry;
+      if ((shard->_table.Get(&entry->_string, tableEntry).IsOK())&&(tableEntry == entry)) (void) shard->_table.Remove(&entry->_string);
+   }
+   delete entry;
+}
+
+uint32 InternedString :: GetNumInternedStrings()
+{
+   InternedStringShard * shards = GetInternedStringShards();
+   if (shards == NULL) return 0;
+
+   uint32 ret = 0;
+   for (uint32 i=0; i<NUM_INTERNED_STRING_SHARDS; i++)
+   {
+      DECLARE_MUTEXGUARD(shards[i]._mutex);
+      ret += shards[i]._table.GetNumItems();
+   }
+   return ret;
+}
+
+} // end namespace muscle
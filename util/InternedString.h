@@ -0,0 +1,160 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#ifndef MuscleInternedString_h
+#define MuscleInternedString_h
+
+#include "system/AtomicCounter.h"
+#include "util/String.h"
+
+namespace muscle {
+
+/** An InternedString is a small, immutable handle to a String that is stored in a process-wide, thread-safe atom table.
+  * All InternedStrings that hold the same characters share a single copy of those characters, so storing the same
+  * name in many places (e.g. the names of the DataNodes in thousands of sessions' subtrees) costs only one pointer
+  * per place rather than one heap-allocated String per place.
+  *
+  * Because equal strings are always represented by the same table entry, comparing two InternedStrings for equality
+  * is a single pointer comparison, and HashCode() returns a value that was computed once when the string was interned.
+  * The hash code is the same value String::HashCode() returns for the same characters.
+  *
+  * Table entries are reference-counted, and are removed from the table when the last InternedString referring to them
+  * is destroyed.  Interning a string requires locking one of the table's mutexes; copying, comparing, hashing and
+  * destroying an InternedString does not (except when the destroyed InternedString was the last one referring to its entry).
+  */
+class MUSCLE_NODISCARD InternedString MUSCLE_FINAL_CLASS
+{
+public:
+   /** Default constructor.  Creates an empty InternedString. */
+   MUSCLE_CONSTEXPR InternedString() : _entry(NULL) {/* empty */}
+
+   /** Constructor.  Interns the given String.
+     * @param s the String to intern.
+     * @note if the atom table can't allocate memory for a new entry, this InternedString will be empty.  Call SetFromString() instead if you need to detect that case.
+     */
+   explicit InternedString(const String & s) : _entry(NULL) {(void) SetFromString(s);}
+
+   /** Constructor.  Interns the given C string.
+     * @param s the NUL-terminated C string to intern, or NULL (which is treated the same as "").
+     */
+   explicit InternedString(const char * s) : _entry(NULL) {(void) SetFromString(s);}
+
+   /** @copydoc DoxyTemplate::DoxyTemplate(const DoxyTemplate &) */
+   InternedString(const InternedString & rhs) : _entry(rhs._entry) {if (_entry) (void) _entry->_refCount.AtomicIncrement();}
+
+   /** Destructor. */
+   ~InternedString() {ReleaseEntry();}
+
+   /** @copydoc DoxyTemplate::operator=(const DoxyTemplate &) */
+   InternedString & operator = (const InternedString & rhs)
+   {
+      if (rhs._entry != _entry)
+      {
+         if (rhs._entry) (void) rhs._entry->_refCount.AtomicIncrement();
+         ReleaseEntry();
+         _entry = rhs._entry;
+      }
+      return *this;
+   }
+
+#ifndef MUSCLE_AVOID_CPLUSPLUS11
+   /** @copydoc DoxyTemplate::DoxyTemplate(DoxyTemplate &&) */
+   InternedString(InternedString && rhs) MUSCLE_NOEXCEPT : _entry(rhs._entry) {rhs._entry = NULL;}
+
+   /** @copydoc DoxyTemplate::operator=(DoxyTemplate &&) */
+   InternedString & operator = (InternedString && rhs) MUSCLE_NOEXCEPT {muscleSwap(_entry, rhs._entry); return *this;}
+#endif
+
+   /** Sets this InternedString to refer to the atom-table entry for (s), creating the entry if necessary.
+     * @param s the String to intern.
+     * @returns B_NO_ERROR on success, or B_OUT_OF_MEMORY (in which case this InternedString will be left empty).
+     */
+   status_t SetFromString(const String & s);
+
+   /** Convenience method:  Sets this InternedString to refer to the atom-table entry for (s).
+     * @param s the NUL-terminated C string to intern, or NULL (which is treated the same as "").
+     * @returns B_NO_ERROR on success, or B_OUT_OF_MEMORY (in which case this InternedString will be left empty).
+     */
+   status_t SetFromString(const char * s) {return ((s)&&(*s)) ? SetFromString(String(s)) : SetFromString(GetEmptyString());}
+
+   /** Returns a reference to our interned String.  The reference remains valid for as long as this InternedString continues to hold its current value. */
+   MUSCLE_NODISCARD const String & GetString() const {return _entry ? _entry->_string : GetEmptyString();}
+
+   /** Returns a pointer to our interned characters, as a NUL-terminated C string.  Never returns NULL. */
+   MUSCLE_NODISCARD MUSCLE_NEVER_RETURNS_NULL const char * operator()() const {return GetString()();}
+
+   /** Returns a pointer to our interned characters, as a NUL-terminated C string.  Never returns NULL. */
+   MUSCLE_NODISCARD MUSCLE_NEVER_RETURNS_NULL const char * Cstr() const {return GetString()();}
+
+   /** Returns the number of characters in our String. */
+   MUSCLE_NODISCARD uint32 Length() const {return GetString().Length();}
+
+   /** Returns true iff this InternedString is empty. */
+   MUSCLE_NODISCARD bool IsEmpty() const {return (_entry == NULL);}
+
+   /** Returns true iff this InternedString is non-empty. */
+   MUSCLE_NODISCARD bool HasChars() const {return (_entry != NULL);}
+
+   /** Returns our hash code.  This is the same value that GetString().HashCode() would return, except that it was pre-computed. */
+   MUSCLE_NODISCARD uint32 HashCode() const {return _entry ? _entry->_hashCode : GetEmptyString().HashCode();}
+
+   /** Returns a checksum for this InternedString.  This is the same value that GetString().CalculateChecksum() would return. */
+   MUSCLE_NODISCARD uint32 CalculateChecksum() const {return HashCode();}
+
+   /** Returns true iff this InternedString holds the same characters as (rhs).  This is a simple pointer-comparison.
+     * @param rhs the InternedString to compare against
+     */
+   bool operator == (const InternedString & rhs) const {return (_entry == rhs._entry);}
+
+   /** Returns true iff this InternedString holds different characters than (rhs).  This is a simple pointer-comparison.
+     * @param rhs the InternedString to compare against
+     */
+   bool operator != (const InternedString & rhs) const {return (_entry != rhs._entry);}
+
+   /** Returns true iff this InternedString holds the same characters as (rhs).
+     * @param rhs the String to compare against
+     */
+   bool operator == (const String & rhs) const {return (GetString() == rhs);}
+
+   /** Returns true iff this InternedString holds different characters than (rhs).
+     * @param rhs the String to compare against
+     */
+   bool operator != (const String & rhs) const {return (GetString() != rhs);}
+
+   /** Compares our characters to (rhs)'s characters, so that InternedStrings sort the same way Strings do.
+     * @param rhs the InternedString to compare against
+     */
+   bool operator < (const InternedString & rhs) const {return ((_entry != rhs._entry)&&(GetString() < rhs.GetString()));}
+
+   /** Sets this InternedString back to its default (empty) state. */
+   void Reset() {ReleaseEntry(); _entry = NULL;}
+
+   /** Swaps our contents with those of (swapMe).
+     * @param swapMe the InternedString to swap contents with
+     */
+   void SwapContents(InternedString & swapMe) MUSCLE_NOEXCEPT {muscleSwap(_entry, swapMe._entry);}
+
+   /** Returns the number of distinct strings currently held in the process-wide atom table.  (Useful for debugging and statistics) */
+   MUSCLE_NODISCARD static uint32 GetNumInternedStrings();
+
+private:
+#ifndef DOXYGEN_SHOULD_IGNORE_THIS
+   class Entry
+   {
+   public:
+      Entry(const String & s, uint32 hashCode) : _string(s), _hashCode(hashCode), _refCount(1) {/* empty */}
+
+      const String _string;
+      const uint32 _hashCode;
+      mutable AtomicCounter _refCount;
+   };
+#endif
+
+   void ReleaseEntry() {if ((_entry)&&(_entry->_refCount.AtomicDecrement())) DeleteEntry(_entry);}
+   static void DeleteEntry(const Entry * entry);
+
+   const Entry * _entry;  // NULL means we're an empty string
+};
+
+} // end namespace muscle
+
+#endif
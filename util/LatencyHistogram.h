@@ -0,0 +1,142 @@
+/* This file is Copyright 2000-2026 Meyer Sound Laboratories Inc.  See the included LICENSE.txt file for details. */
+
+#ifndef MuscleLatencyHistogram_h
+#define MuscleLatencyHistogram_h
+
+#include "message/Message.h"
+#include "util/OutputPrinter.h"
+#include "util/TimeUtilityFunctions.h"
+
+namespace muscle {
+
+/** This class is a compact, fixed-size histogram of latency values (in microseconds), in the style of
+  * an HDR histogram:  every power-of-two range of values is split into eight equal-width sub-buckets,
+  * so any percentile it reports is within 12.5% of the true value, no matter how large the values get.
+  * Recording a value is O(1), and never allocates any memory.
+  */
+class LatencyHistogram MUSCLE_FINAL_CLASS
+{
+public:
+   /** Default constructor.  Creates an empty histogram. */
+   LatencyHistogram() {Reset();}
+
+   /** Adds a value to this histogram.
+     * @param micros the value to add (typically a duration, in microseconds)
+     */
+   void RecordValue(uint64 micros)
+   {
+      _counts[GetBucketIndexForValue(micros)]++;
+      if (_count == 0) _minValue = _maxValue = micros;
+      else
+      {
+         _minValue = muscleMin(_minValue, micros);
+         _maxValue = muscleMax(_maxValue, micros);
+      }
+      _count++;
+      _totalValue += micros;
+   }
+
+   /** Resets this histogram back to its empty state. */
+   void Reset()
+   {
+      memset(_counts, 0, sizeof(_counts));
+      _count = _totalValue = _minValue = _maxValue = 0;
+   }
+
+   /** Returns the number of values that have been recorded. */
+   MUSCLE_NODISCARD uint64 GetCount() const {return _count;}
+
+   /** Returns the smallest value that has been recorded, or zero if the histogram is empty. */
+   MUSCLE_NODISCARD uint64 GetMinValue() const {return _minValue;}
+
+   /** Returns the largest value that has been recorded, or zero if the histogram is empty. */
+   MUSCLE_NODISCARD uint64 GetMaxValue() const {return _maxValue;}
+
+   /** Returns the average of all the values that have been recorded, or zero if the histogram is empty. */
+   MUSCLE_NODISCARD uint64 GetMeanValue() const {return (_count > 0) ? (_totalValue/_count) : 0;}
+
+   /** Returns an estimate of the value below which the given percentage of recorded values fall.
+     * @param percentile a percentage, between 0.0 and 100.0 (e.g. 99.9)
+     * @returns the upper bound of the bucket containing the specified percentile, or zero if the histogram is empty.
+     */
+   MUSCLE_NODISCARD uint64 GetValueAtPercentile(double percentile) const
+   {
+      if (_count == 0) return 0;
+
+      const double exactCount = (percentile*_count)/100.0;
+      uint64 targetCount = (uint64) exactCount;
+      if ((double)targetCount < exactCount) targetCount++;  // round up
+      targetCount = muscleClamp(targetCount, (uint64)1, _count);
+
+      uint64 runningCount = 0;
+      for (uint32 i=0; i<NUM_BUCKETS; i++)
+      {
+         runningCount += _counts[i];
+         if (runningCount >= targetCount) return muscleClamp(GetUpperBoundForBucketIndex(i), _minValue, _maxValue);
+      }
+      return _maxValue;
+   }
+
+   /** Adds our summary statistics (count, min, mean, max, and the 50th, 90th, 99th and 99.9th percentiles) to a Message.
+     * @param msg the Message to add int64 fields named "count", "min", "mean", "max", "p50", "p90", "p99" and "p999" to.
+     * @returns B_NO_ERROR on success, or an error code on failure.
+     */
+   status_t SaveToMessage(Message & msg) const
+   {
+      MRETURN_ON_ERROR(msg.AddInt64("count", _count));
+      MRETURN_ON_ERROR(msg.AddInt64("min",   _minValue));
+      MRETURN_ON_ERROR(msg.AddInt64("mean",  GetMeanValue()));
+      MRETURN_ON_ERROR(msg.AddInt64("max",   _maxValue));
+      MRETURN_ON_ERROR(msg.AddInt64("p50",   GetValueAtPercentile(50.0)));
+      MRETURN_ON_ERROR(msg.AddInt64("p90",   GetValueAtPercentile(90.0)));
+      MRETURN_ON_ERROR(msg.AddInt64("p99",   GetValueAtPercentile(99.0)));
+      return           msg.AddInt64("p999",  GetValueAtPercentile(99.9));
+   }
+
+   /** Prints a one-line summary of our statistics (all values in microseconds) using the specified OutputPrinter.
+     * @param p the OutputPrinter to print with
+     */
+   void Print(const OutputPrinter & p) const
+   {
+      p.printf("count=" UINT64_FORMAT_SPEC " min=" UINT64_FORMAT_SPEC " mean=" UINT64_FORMAT_SPEC " p50=" UINT64_FORMAT_SPEC " p90=" UINT64_FORMAT_SPEC " p99=" UINT64_FORMAT_SPEC " p99.9=" UINT64_FORMAT_SPEC " max=" UINT64_FORMAT_SPEC " (us)\n", _count, _minValue, GetMeanValue(), GetValueAtPercentile(50.0), GetValueAtPercentile(90.0), GetValueAtPercentile(99.0), GetValueAtPercentile(99.9), _maxValue);
+   }
+
+private:
+   enum {
+      SUB_BUCKET_BITS = 3,                                                 // 2^3 = 8 sub-buckets per power-of-two
+      NUM_SUB_BUCKETS = (1<<SUB_BUCKET_BITS),
+      MAX_MAGNITUDE   = 40,                                                // 2^40 microseconds is about 12 days; larger values go into the last bucket
+      NUM_BUCKETS     = NUM_SUB_BUCKETS*(MAX_MAGNITUDE-SUB_BUCKET_BITS+2)
+   };
+
+   MUSCLE_NODISCARD static uint32 GetBucketIndexForValue(uint64 v)
+   {
+      if (v < NUM_SUB_BUCKETS) return (uint32) v;  // small values get a bucket each
+
+      uint32 magnitude = 0;  // index of (v)'s highest set bit
+      for (uint32 shift=32; shift>0; shift/=2) if ((v>>(magnitude+shift)) != 0) magnitude += shift;
+      if (magnitude > MAX_MAGNITUDE) return NUM_BUCKETS-1;
+
+      const uint32 subBucket = (uint32) ((v>>(magnitude-SUB_BUCKET_BITS))&(NUM_SUB_BUCKETS-1));
+      return ((magnitude-SUB_BUCKET_BITS+1)*NUM_SUB_BUCKETS)+subBucket;
+   }
+
+   MUSCLE_NODISCARD static uint64 GetUpperBoundForBucketIndex(uint32 idx)
+   {
+      if (idx < NUM_SUB_BUCKETS) return idx;
+      if (idx >= NUM_BUCKETS-1)  return MUSCLE_TIME_NEVER;
+
+      const uint32 shift = (idx/NUM_SUB_BUCKETS)-1;
+      return ((((uint64)(NUM_SUB_BUCKETS+(idx%NUM_SUB_BUCKETS)))+1)<<shift)-1;
+   }
+
+   uint64 _counts[NUM_BUCKETS];
+   uint64 _count;
+   uint64 _totalValue;
+   uint64 _minValue;
+   uint64 _maxValue;
+};
+
+} // end namespace muscle
+
+#endif
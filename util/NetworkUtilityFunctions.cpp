@@ -379,8 +379,12 @@ static IPAddress _defaultAcceptInterfaceIP;
 void SetDefaultAcceptInterfaceIP(const IPAddress & ip) {_defaultAcceptInterfaceIP = ip;}
 const IPAddress & GetDefaultAcceptInterfaceIP() {return _defaultAcceptInterfaceIP;}
 
-ConstSocketRef CreateAcceptingSocket(uint16 port, int maxbacklog, uint16 * optRetPort, const IPAddress & optBindToInterfaceIP, int socketFamily)
+ConstSocketRef CreateAcceptingSocket(uint16 port, int maxbacklog, uint16 * optRetPort, const IPAddress & optBindToInterfaceIP, int socketFamily, bool reusePort)
 {
+#ifndef SO_REUSEPORT
+   if (reusePort) return B_UNIMPLEMENTED;
+#endif
+
    const IPAddress & optInterfaceIP = optBindToInterfaceIP.IsValid() ? optBindToInterfaceIP : _defaultAcceptInterfaceIP;
 
    ConstSocketRef ret = CreateMuscleSocket(SOCK_STREAM, GlobalSocketCallback::SOCKET_CALLBACK_CREATE_ACCEPTING, socketFamily);
@@ -395,6 +399,14 @@ ConstSocketRef CreateAcceptingSocket(uint16 port, int maxbacklog, uint16 * optRe
    (void) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (const sockopt_arg *) &trueValue, sizeof(trueValue));
 #endif
 
+#ifdef SO_REUSEPORT
+   if (reusePort)
+   {
+      const int reuseValue = 1;
+      if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (const sockopt_arg *) &reuseValue, sizeof(reuseValue)) != 0) return B_ERRNO;
+   }
+#endif
+
    // coverity[returned_null : FALSE] - if ret() was going to return NULL, then fd would be negative above and execution wouldn't get here
    switch(ret()->GetFamily())
    {
@@ -1539,6 +1551,66 @@ static int32 GetSocketBufferSizeAux(const ConstSocketRef & sock, int optionName)
 int32 GetSocketSendBufferSize(   const ConstSocketRef & sock) {return GetSocketBufferSizeAux(sock, SO_SNDBUF);}
 int32 GetSocketReceiveBufferSize(const ConstSocketRef & sock) {return GetSocketBufferSizeAux(sock, SO_RCVBUF);}
 
+status_t GetSocketIncomingCPU(const ConstSocketRef & sock, uint32 & retCPUIndex)
+{
+#if defined(__linux__) && defined(SO_INCOMING_CPU)
+   const int fd = sock.GetFileDescriptor();
+   if (fd < 0) return B_BAD_ARGUMENT;
+
+   int cpu = -1;
+   muscle_socklen_t len = sizeof(cpu);
+   if (getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, (sockopt_arg *) &cpu, &len) != 0) return B_ERRNO;
+   if (cpu < 0) return B_DATA_NOT_FOUND;  // no data has been received on this socket yet
+
+   retCPUIndex = (uint32) cpu;
+   return B_NO_ERROR;
+#else
+   (void) sock;
+   (void) retCPUIndex;
+   return B_UNIMPLEMENTED;
+#endif
+}
+
+status_t GetListenQueueOverflowCounts(uint64 & retNumOverflows, uint64 & retNumDrops)
+{
+#ifdef __linux__
+   FILE * fpIn = muscleFopen("/proc/net/netstat", "r");
+   if (fpIn == NULL) return B_ERRNO;
+
+   // The file holds pairs of lines:  a line of field names, followed by a line of values for those fields
+   status_t ret = B_DATA_NOT_FOUND;
+   char names[4096], values[4096];
+   while((fgets(names, sizeof(names), fpIn))&&(fgets(values, sizeof(values), fpIn)))
+   {
+      if ((strncmp(names, "TcpExt:", 7) != 0)||(strncmp(values, "TcpExt:", 7) != 0)) continue;
+
+      bool gotOverflows = false, gotDrops = false;
+      const char * n = names+7;
+      const char * v = values+7;
+      while(true)
+      {
+         char name[64];
+         unsigned long long value;
+         int nLen = 0, vLen = 0;
+         if ((sscanf(n, " %63s%n", name, &nLen) != 1)||(sscanf(v, " %llu%n", &value, &vLen) != 1)) break;
+         n += nLen;
+         v += vLen;
+
+              if (strcmp(name, "ListenOverflows") == 0) {retNumOverflows = (uint64) value; gotOverflows = true;}
+         else if (strcmp(name, "ListenDrops")     == 0) {retNumDrops     = (uint64) value; gotDrops     = true;}
+      }
+      if ((gotOverflows)&&(gotDrops)) ret = B_NO_ERROR;
+      break;
+   }
+   fclose(fpIn);
+   return ret;
+#else
+   (void) retNumOverflows;
+   (void) retNumDrops;
+   return B_UNIMPLEMENTED;
+#endif
+}
+
 NetworkInterfaceInfo :: NetworkInterfaceInfo()
    : _ip(invalidIP)
    , _netmask(invalidIP)
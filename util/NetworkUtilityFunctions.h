@@ -365,9 +365,14 @@ status_t ShutdownSocket(const ConstSocketRef & sock, bool disableReception = tru
  *                        if passed in as (invalidIP), then this socket will listen on all available network interfaces.
  *  @param socketFamily a SOCKET_FAMILY_* value indicating whether this should be an IPv4 or IPv6 socket.  Defaults to SOCKET_FAMILY_PREFERRED,
  *                      ie to IPv6 (unless MUSCLE_AVOID_IPV6 was defined at compile-time).
+ *  @param reusePort If true, the SO_REUSEPORT option will be set on the socket before it is bound, so that several
+ *                   listening-sockets (each created with this argument set to true) can be bound to the same port at once.
+ *                   Under Linux, the kernel then spreads the incoming connections across those sockets, each of which
+ *                   has its own backlog-queue.  Defaults to false.
  *  @return A non-NULL ConstSocketRef if the port was bound successfully, or a NULL ConstSocketRef if the accept failed.
+ *          If (reusePort) was specified on an OS that doesn't support SO_REUSEPORT, B_UNIMPLEMENTED is returned.
  */
-ConstSocketRef CreateAcceptingSocket(uint16 port, int maxbacklog = 20, uint16 * optRetPort = NULL, const IPAddress & optInterfaceIP = invalidIP, int socketFamily = SOCKET_FAMILY_PREFERRED);
+ConstSocketRef CreateAcceptingSocket(uint16 port, int maxbacklog = 20, uint16 * optRetPort = NULL, const IPAddress & optInterfaceIP = invalidIP, int socketFamily = SOCKET_FAMILY_PREFERRED, bool reusePort = false);
 
 /** Translates the given IP address into a string representation.
  *  @param address The IP address to translate into text.
@@ -536,6 +541,27 @@ status_t SetSocketReceiveBufferSize(const ConstSocketRef & sock, uint32 receiveB
   */
 MUSCLE_NODISCARD int32 GetSocketReceiveBufferSize(const ConstSocketRef & sock);
 
+/**
+  * Returns the index of the CPU core that the kernel most recently used to process incoming data for the
+  * given socket (i.e. the core that is handling the network interface's interrupts for this socket's traffic).
+  * Useful for running the thread that handles a socket on the same core (or NUMA node) as its interrupts.
+  * @param sock The socket to query.  It should have received some data already.
+  * @param retCPUIndex on success, the CPU core's index is written here.
+  * @returns B_NO_ERROR on success, or B_UNIMPLEMENTED if this OS doesn't support the query, or an error code on failure.
+  * @note currently this is implemented only under Linux (via the SO_INCOMING_CPU socket option).
+  */
+status_t GetSocketIncomingCPU(const ConstSocketRef & sock, uint32 & retCPUIndex);
+
+/**
+  * Retrieves the host-wide counts of incoming TCP connections that were lost because a listening-socket's
+  * accept-queue was full.  These counts cover every process on the host, and every listening socket, since boot.
+  * @param retNumOverflows on success, the number of times a completed connection couldn't be added to a full accept-queue is written here.
+  * @param retNumDrops on success, the number of incoming connection-requests that were dropped (for any reason, including overflows) is written here.
+  * @returns B_NO_ERROR on success, or B_UNIMPLEMENTED if this OS doesn't support the query, or an error code on failure.
+  * @note currently this is implemented only under Linux (via the ListenOverflows and ListenDrops fields of /proc/net/netstat).
+  */
+status_t GetListenQueueOverflowCounts(uint64 & retNumOverflows, uint64 & retNumDrops);
+
 /** This class is an interface to an object that can have its SocketCallback() method called
   * at the appropriate times when certain actions are performed on a socket.  By installing
   * a GlobalSocketCallback object via SetGlobalSocketCallback(), behaviors can be set for all
@@ -13,6 +13,9 @@ PulseNode :: PulseNode()
    , _curList(-1)
    , _prevSibling(NULL)
    , _nextSibling(NULL)
+   , _firstHeapChild(NULL)
+   , _scheduleSequence(0)
+   , _nextScheduleSequence(0)
    , _maxTimeSlice(MUSCLE_TIME_NEVER)
    , _timeSlicingSuggested(false)
 {
@@ -113,13 +116,88 @@ void PulseNode :: ClearPulseChildren()
    for (uint32 i=0; i<NUM_LINKED_LISTS; i++) while(_firstChild[i]) RemovePulseChild(_firstChild[i]);
 }
 
+// Returns true iff (a) should be pulsed before (b):  whoever is due first, or whoever was scheduled first if they are due at the same time
+bool PulseNode :: IsDueBefore(const PulseNode * a, const PulseNode * b)
+{
+   if (a->_aggregatePulseTime != b->_aggregatePulseTime) return (a->_aggregatePulseTime < b->_aggregatePulseTime);
+   return (((int32)(a->_scheduleSequence-b->_scheduleSequence)) < 0);  // written this way so that it still works when the sequence numbers wrap around
+}
+
+// Links the two given heaps together and returns the root of the combined heap (whichever root is due first)
+PulseNode * PulseNode :: MeldHeaps(PulseNode * a, PulseNode * b)
+{
+   if (IsDueBefore(b, a)) muscleSwap(a, b);
+
+   // (b) becomes the first heap-child of (a)
+   b->_prevSibling = a;
+   b->_nextSibling = a->_firstHeapChild;
+   if (b->_nextSibling) b->_nextSibling->_prevSibling = b;
+   a->_firstHeapChild = b;
+   return a;
+}
+
+// Standard two-pass pairing-heap merge of a list of sibling sub-heaps; returns the root of the combined heap
+PulseNode * PulseNode :: MergeHeapSiblings(PulseNode * firstSibling)
+{
+   if (firstSibling == NULL) return NULL;
+
+   // First pass:  meld the siblings together in pairs, left to right, pushing each pair onto a singly-linked stack
+   PulseNode * pairs = NULL;
+   while(firstSibling)
+   {
+      PulseNode * a = firstSibling;
+      PulseNode * b = a->_nextSibling;
+      firstSibling = b ? b->_nextSibling : NULL;
+
+      a->_prevSibling = a->_nextSibling = NULL;
+      if (b)
+      {
+         b->_prevSibling = b->_nextSibling = NULL;
+         a = MeldHeaps(a, b);
+      }
+      a->_nextSibling = pairs;
+      pairs = a;
+   }
+
+   // Second pass:  meld the pairs together, right to left
+   PulseNode * ret = pairs;
+   pairs = pairs->_nextSibling;
+   ret->_nextSibling = NULL;
+   while(pairs)
+   {
+      PulseNode * next = pairs->_nextSibling;
+      pairs->_nextSibling = NULL;
+      ret = MeldHeaps(ret, pairs);
+      pairs = next;
+   }
+   return ret;
+}
+
+void PulseNode :: RemoveFromScheduledHeap(PulseNode * child)
+{
+   PulseNode * & root = _firstChild[LINKED_LIST_SCHEDULED];
+   PulseNode * subHeap = MergeHeapSiblings(child->_firstHeapChild);
+   if (child == root) root = subHeap;
+   else
+   {
+      // Cut (child) out of its heap-parent's list of heap-children, then put its own heap-children back into the heap
+      PulseNode * prev = child->_prevSibling;
+      if (prev->_firstHeapChild == child) prev->_firstHeapChild = child->_nextSibling;
+                                     else prev->_nextSibling    = child->_nextSibling;
+      if (child->_nextSibling) child->_nextSibling->_prevSibling = prev;
+      if (subHeap) root = MeldHeaps(root, subHeap);
+   }
+   child->_prevSibling = child->_nextSibling = child->_firstHeapChild = NULL;
+}
+
 void PulseNode :: ReschedulePulseChild(PulseNode * child, int whichList)
 {
    const int cl = child->_curList;
    if ((whichList != cl)||(cl == LINKED_LIST_SCHEDULED))  // since we may need to move within the scheduled list
    {
       // First, remove the child from any list he may currently be in
-      if (cl >= 0)
+      if (cl == LINKED_LIST_SCHEDULED) RemoveFromScheduledHeap(child);
+      else if (cl >= 0)
       {
          if (child->_prevSibling) child->_prevSibling->_nextSibling = child->_nextSibling;
          if (child->_nextSibling) child->_nextSibling->_prevSibling = child->_prevSibling;
@@ -133,31 +211,10 @@ void PulseNode :: ReschedulePulseChild(PulseNode * child, int whichList)
       {
          case LINKED_LIST_SCHEDULED:
          {
-            PulseNode * p = _firstChild[whichList];
-            if (p)
-            {
-               PulseNode * lastChild = _lastChild[whichList];  // checking this for non-NULL solely to keep ClangSA happy --jaf
-               if ((lastChild)&&(child->_aggregatePulseTime >= lastChild->_aggregatePulseTime))
-               {
-                  // Shortcut:  append to the tail of the list!
-                  child->_prevSibling = lastChild;
-                  lastChild->_nextSibling = child;
-                  _lastChild[whichList] = child;
-               }
-               else
-               {
-                  // Worst case:  O(N) walk through the list to find the place to insert (child)
-                  while(p->_aggregatePulseTime < child->_aggregatePulseTime) p = p->_nextSibling;
-
-                  // insert (child) just before (p)
-                  child->_nextSibling = p;
-                  child->_prevSibling = p->_prevSibling;
-                  if (p->_prevSibling) p->_prevSibling->_nextSibling = child;
-                                  else _firstChild[whichList] = child;  // FogBugz #4092(b)
-                  p->_prevSibling = child;
-               }
-            }
-            else _firstChild[whichList] = _lastChild[whichList] = child;
+            // O(1) insert into the pairing-heap, so that rescheduling doesn't depend on how many other children we have
+            child->_scheduleSequence = _nextScheduleSequence++;
+            PulseNode * & root = _firstChild[whichList];
+            root = root ? MeldHeaps(root, child) : child;
          }
          break;
 
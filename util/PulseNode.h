@@ -191,6 +191,10 @@ private:
    MUSCLE_NODISCARD uint64 GetFirstScheduledChildTime() const {return _firstChild[LINKED_LIST_SCHEDULED] ? _firstChild[LINKED_LIST_SCHEDULED]->_aggregatePulseTime : MUSCLE_TIME_NEVER;}
    void GetPulseTimeAux(uint64 now, uint64 & min);
    void PulseAux(uint64 now);
+   void RemoveFromScheduledHeap(PulseNode * child);
+   MUSCLE_NODISCARD static bool IsDueBefore(const PulseNode * a, const PulseNode * b);
+   MUSCLE_NODISCARD static PulseNode * MeldHeaps(PulseNode * a, PulseNode * b);
+   MUSCLE_NODISCARD static PulseNode * MergeHeapSiblings(PulseNode * firstSibling);
 
    // Sets the cycle-started-at time for this object, as returned by GetCycleStartTime().
    void SetCycleStartTime(uint64 st) {_cycleStartedAt = st;}
@@ -202,19 +206,22 @@ private:
    uint64 _cycleStartedAt;      // time when the PulseNodeManager started serving us.
    bool _myScheduledTimeValid;  // true iff _myScheduledTime doesn't need to be recalculated
 
-   // Linked list that this node is in (or NULL if we're not in any linked list)
+   // Linked list (or heap) that this node is in (or NULL if we're not in any linked list)
    int _curList;                // index of the list we are part of, or -1 if we're not in any list
-   PulseNode * _prevSibling;
+   PulseNode * _prevSibling;    // in the scheduled-heap, this points to our heap-parent if we are its first heap-child
    PulseNode * _nextSibling;
+   PulseNode * _firstHeapChild; // only used while we are in our parent's scheduled-heap
+   uint32 _scheduleSequence;    // when we were put into our parent's scheduled-heap, so that children with equal pulse-times get pulsed in FIFO order
+   uint32 _nextScheduleSequence; // the _scheduleSequence value to give to the next child we put into our scheduled-heap
 
    enum {
-      LINKED_LIST_SCHEDULED = 0,  // list of children with known upcoming pulse-times (sorted)
+      LINKED_LIST_SCHEDULED = 0,  // pairing-heap of children with known upcoming pulse-times (ordered by _aggregatePulseTime, then by _scheduleSequence)
       LINKED_LIST_UNSCHEDULED,    // list of children with known MUSCLE_TIME_NEVER pulse-times (unsorted)
       LINKED_LIST_NEEDSRECALC,    // list of children whose pulse-times need to be recalculated (unsorted)
       NUM_LINKED_LISTS
    };
 
-   // Endpoints of our three linked lists of child nodes
+   // Endpoints of our three linked lists of child nodes (for LINKED_LIST_SCHEDULED, _firstChild is the root of the heap and _lastChild is unused)
    PulseNode * _firstChild[NUM_LINKED_LISTS];
    PulseNode * _lastChild[NUM_LINKED_LISTS];
 
@@ -256,6 +263,12 @@ protected:
      */
    inline void CallPulseAux(PulseNode & p, uint64 now) const {if (now >= p._aggregatePulseTime) p.PulseAux(now);}
 
+   /** Returns true iff a call to CallPulseAux() with the same arguments would result in Pulse() being called on (p) or on any of its children.
+     * @param p the PulseNode to check
+     * @param now the approximate current time in microseconds, as returned by GetRunTime64()
+     */
+   MUSCLE_NODISCARD inline bool IsPulseDue(const PulseNode & p, uint64 now) const {return (now >= p._aggregatePulseTime);}
+
    /** Passes the call on through to the given PulseNode
      * @param p the PulseNode to call SetCycleStartTime() on
      * @param now the approximate current time in microseconds, as returned by GetRunTime64()
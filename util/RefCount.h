@@ -13,10 +13,68 @@
 #include "util/PointerAndBits.h"
 #include "system/AtomicCounter.h"
 
+// Biased reference-counting needs C++11 atomics and thread_local, and is disabled in builds that are meant to be
+// checked by a race detector, since its owner-thread-only counter would just confuse the detector.
+#if !defined(MUSCLE_AVOID_BIASED_REFCOUNTING) && !defined(MUSCLE_AVOID_CPLUSPLUS11) && !defined(MUSCLE_AVOID_CPLUSPLUS11_THREAD_LOCAL_KEYWORD) && !defined(MUSCLE_SINGLE_THREAD_ONLY) && !defined(MUSCLE_ENABLE_HELGRIND_ANNOTATIONS)
+# if defined(__SANITIZE_THREAD__)
+#  define MUSCLE_AVOID_BIASED_REFCOUNTING
+# elif defined(__has_feature)
+#  if __has_feature(thread_sanitizer)
+#   define MUSCLE_AVOID_BIASED_REFCOUNTING
+#  endif
+# endif
+# ifndef MUSCLE_AVOID_BIASED_REFCOUNTING
+#  define MUSCLE_USE_BIASED_REFCOUNTING 1  /**< defined iff RefCountable objects are using biased reference-counting */
+#  include <atomic>
+# endif
+#endif
+
 namespace muscle {
 
 class RefCountable;
 
+/** Enables or disables biased reference-counting for the calling thread.
+  * While it is enabled, the first Ref that the calling thread creates to a RefCountable object "biases" that object
+  * towards the calling thread, so that the calling thread's subsequent increments and decrements of the object's
+  * reference count are done with plain (non-atomic) loads and stores.  Other threads still use atomic operations
+  * to update the object's reference count, and if another thread releases a reference the owner-thread created,
+  * the object is queued up to have its two counts merged the next time the owner-thread calls
+  * MergeBiasedRefCountsForCurrentThread().
+  *
+  * This is a good fit for a thread that runs an event loop (e.g. a ReflectServer), since most of the objects it
+  * references are created, shared and destroyed in that same thread.  ReflectServer::ServerProcessLoop() calls
+  * MergeBiasedRefCountsForCurrentThread() once per event-loop iteration.
+  * @param enable true to enable biased reference-counting for the calling thread, or false to disable it.
+  *               Disabling it (or exiting the thread) causes any pending merges to be done immediately.
+  * @returns B_NO_ERROR on success, B_UNIMPLEMENTED if biased reference-counting was compiled out
+  *          (see MUSCLE_AVOID_BIASED_REFCOUNTING in COMPILEROPTIONS.txt), or B_OUT_OF_MEMORY.
+  * @note each call that enables biased reference-counting allocates a small per-thread record that is never freed,
+  *       so this is meant to be called once when a thread starts up, not toggled repeatedly.
+  */
+status_t SetBiasedRefCountingEnabledForCurrentThread(bool enable);  // implemented in SetupSystem.cpp
+
+/** Returns true iff biased reference-counting is currently enabled for the calling thread. */
+MUSCLE_NODISCARD bool IsBiasedRefCountingEnabledForCurrentThread();
+
+/** Merges the reference counts of any objects biased towards the calling thread that other threads have released
+  * references to since the last call, deleting (or recycling) any of those objects that are no longer referenced.
+  * Should be called periodically, at a point where the calling thread isn't in the middle of anything, by any
+  * thread that called SetBiasedRefCountingEnabledForCurrentThread(true).  This is a very cheap no-op when there is nothing to merge.
+  */
+void MergeBiasedRefCountsForCurrentThread();
+
+#ifdef MUSCLE_USE_BIASED_REFCOUNTING
+class BiasedRefCountThreadState;  // opaque per-thread record; defined in SetupSystem.cpp
+
+/** Holds the calling thread's biased-refcounting record, or NULL.  (It's a templated static so that it can live in this header) */
+template <int Dummy> class BiasedRefCountCurrentThread
+{
+public:
+   static thread_local BiasedRefCountThreadState * _state;
+};
+template <int Dummy> thread_local BiasedRefCountThreadState * BiasedRefCountCurrentThread<Dummy>::_state = NULL;
+#endif
+
 #ifdef MUSCLE_RECORD_REFCOUNTABLE_ALLOCATION_LOCATIONS
 class StackTrace;
 extern void UpdateAllocationStackTrace(bool isAllocation, StackTrace * & st);  // implemented in SysLog.cpp
@@ -40,13 +98,20 @@ class RefCountable
 public:
    /** Default constructor.  Refcount begins at zero. */
    MUSCLE_CONSTEXPR RefCountable() : _manager(NULL)
+#ifdef MUSCLE_USE_BIASED_REFCOUNTING
+      , _sharedWord(SHARED_FLAG_UNBIASED), _biasedCount(0), _biasOwner(NULL)
+#endif
 #ifdef MUSCLE_RECORD_REFCOUNTABLE_ALLOCATION_LOCATIONS
       , _allocatedAtStackTrace(NULL)
 #endif
    {/* empty */}
 
-   /** Copy constructor -- ref count and manager settings are deliberately not copied over! */
+   /** Copy constructor -- ref count and manager settings are deliberately not copied over!  (The SetBiasedRefCountingAllowed() setting is, since it is a per-type setting) */
+#ifdef MUSCLE_USE_BIASED_REFCOUNTING
+   RefCountable(const RefCountable & rhs) : _manager(NULL), _sharedWord(SHARED_FLAG_UNBIASED|(rhs._sharedWord.load(std::memory_order_relaxed)&SHARED_FLAG_NEVERBIAS)), _biasedCount(0), _biasOwner(NULL)
+#else
    MUSCLE_CONSTEXPR RefCountable(const RefCountable &) : _refCount(), _manager(NULL)
+#endif
 #ifdef MUSCLE_RECORD_REFCOUNTABLE_ALLOCATION_LOCATIONS
       , _allocatedAtStackTrace(NULL)
 #endif
@@ -63,12 +128,98 @@ public:
    /** Assigment operator.  deliberately implemented as a no-op! */
    inline RefCountable &operator=(const RefCountable &) {return *this;}
 
+#ifdef MUSCLE_USE_BIASED_REFCOUNTING
+   /** Increments the reference-count.  Thread safe. */
+   inline void IncrementRefCount() const
+   {
+      const BiasedRefCountThreadState * me = BiasedRefCountCurrentThread<0>::_state;
+      if (me)
+      {
+         const int32 sw = _sharedWord.load(std::memory_order_relaxed);
+         if ((_biasOwner == me)&&((sw & SHARED_FLAG_UNBIASED) == 0))
+         {
+            _biasedCount.store(_biasedCount.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);  // we're the owner-thread, so no atomic read-modify-write is necessary
+            return;
+         }
+
+         // If nobody references this object yet, we can bias it towards our own thread
+         int32 expected = SHARED_FLAG_UNBIASED;
+         if ((sw == expected)&&(_sharedWord.compare_exchange_strong(expected, 0, std::memory_order_acquire)))
+         {
+            _biasOwner = me;
+            _biasedCount.store(1, std::memory_order_relaxed);
+            return;
+         }
+      }
+      (void) _sharedWord.fetch_add(SHARED_COUNT_ONE, std::memory_order_relaxed);
+   }
+
+   /** Decrements the reference-count and returns true iff the object is no longer referenced (and should therefore be deleted or recycled by the caller).  Thread safe. */
+   inline bool DecrementRefCount() const
+   {
+      const BiasedRefCountThreadState * me = BiasedRefCountCurrentThread<0>::_state;
+      int32 sw = _sharedWord.load(std::memory_order_relaxed);
+      if ((sw & SHARED_FLAG_UNBIASED) != 0) return ((_sharedWord.fetch_sub(SHARED_COUNT_ONE, std::memory_order_acq_rel)-SHARED_COUNT_ONE) == (sw & SHARED_FLAG_NEVERBIAS)+SHARED_FLAG_UNBIASED);  // an unbiased object can't become biased again while we hold a reference to it
+
+      if ((me)&&(_biasOwner == me))
+      {
+         const int32 newBiasedCount = _biasedCount.load(std::memory_order_relaxed)-1;
+         _biasedCount.store(newBiasedCount, std::memory_order_relaxed);
+         if (newBiasedCount > 0) return false;
+
+         // Our thread no longer references this object, so hand it over to the shared count
+         const int32 oldSW = _sharedWord.fetch_or(SHARED_FLAG_UNBIASED, std::memory_order_acq_rel);
+         return ((oldSW & ~SHARED_FLAG_NEVERBIAS) == 0);  // if another thread has queued us for a merge, the merge will delete us instead
+      }
+
+      return DecrementSharedRefCountOfBiasedObject(sw);
+   }
+
+   /** Returns this object's current reference count.  Note that
+     * the value returned by this method is volatile in multithreaded
+     * environments, so it may already be wrong by the time it is returned.
+     * If the object is currently biased towards a different thread (see
+     * SetBiasedRefCountingEnabledForCurrentThread()), the returned value
+     * is only an estimate.  Be careful!
+     */
+   MUSCLE_NODISCARD uint32 GetRefCount() const
+   {
+      const int32 sw = _sharedWord.load(std::memory_order_acquire);
+      const int32 sharedCount = (sw-(sw&SHARED_FLAGS_MASK))/SHARED_COUNT_ONE;
+      return (uint32) (((sw & SHARED_FLAG_UNBIASED) != 0) ? sharedCount : (sharedCount+_biasedCount.load(std::memory_order_relaxed)));
+   }
+
+   /** Returns true only if this object's reference count is known to equal (count).
+     * Unlike (GetRefCount()==count), this method returns false whenever it can't be sure,
+     * i.e. when the object is biased towards a thread other than the calling thread.
+     * @param count the reference count to check for
+     */
+   MUSCLE_NODISCARD bool IsRefCountEqualTo(uint32 count) const
+   {
+      const int32 sw = _sharedWord.load(std::memory_order_acquire);
+      if (((sw & SHARED_FLAG_UNBIASED) == 0)&&(_biasOwner != BiasedRefCountCurrentThread<0>::_state)) return false;
+      return (GetRefCount() == count);
+   }
+#else
    /** Increments the reference-count.  Thread safe. */
    inline void IncrementRefCount() const {(void) _refCount.AtomicIncrement();}
 
    /** Decrements the reference-count and returns true iff the new value is zero.  Thread safe. */
    inline bool DecrementRefCount() const {return _refCount.AtomicDecrement();}
 
+   /** Returns this object's current reference count.  Note that
+     * the value returned by this method is volatile in multithreaded
+     * environments, so it may already be wrong by the time it is returned.
+     * Be careful!
+     */
+   MUSCLE_NODISCARD uint32 GetRefCount() const {return _refCount.GetCount();}
+
+   /** Returns true only if this object's reference count is known to equal (count).
+     * @param count the reference count to check for
+     */
+   MUSCLE_NODISCARD bool IsRefCountEqualTo(uint32 count) const {return (GetRefCount() == count);}
+#endif
+
    /** Sets the recycle-pointer for this object.  If set to non-NULL, this pointer
      * is used by the ObjectPool class to recycle this object when it is no longer
      * in use, so as to avoid the overhead of having to delete it and re-create it
@@ -87,13 +238,6 @@ public:
    /** Returns this object's current recyler pointer. */
    MUSCLE_NODISCARD AbstractObjectManager * GetManager() const {return _manager;}
 
-   /** Returns this object's current reference count.  Note that
-     * the value returned by this method is volatile in multithreaded
-     * environments, so it may already be wrong by the time it is returned.
-     * Be careful!
-     */
-   MUSCLE_NODISCARD uint32 GetRefCount() const {return _refCount.GetCount();}
-
 #ifdef MUSCLE_RECORD_REFCOUNTABLE_ALLOCATION_LOCATIONS
    /** If -DMUSCLE_RECORD_REFCOUNTABLE_ALLOCATION_LOCATIONS was specified on the compile line,
      * and this RefCountable is currently being managed by an ObjectPool, this will return
@@ -113,10 +257,64 @@ public:
    const AtomicCounter & GetAtomicCounter() const {return _refCount;}
 #endif
 
+protected:
+   /** Subclasses whose objects are routinely handed off to other threads right after they are created
+     * (so that biasing them towards their creating thread would only cause extra merge-work) can call
+     * this from their constructor to specify that objects of their type should never be biased.
+     * @param allowed true (the default) to allow this object to be biased towards the first thread that references it,
+     *                or false to have it always use the shared atomic reference-count.
+     * @note this must only be called while the object is not yet referenced by any Ref.  It's a no-op if
+     *       biased reference-counting is compiled out.
+     */
+   void SetBiasedRefCountingAllowed(bool allowed)
+   {
+#ifdef MUSCLE_USE_BIASED_REFCOUNTING
+      const int32 sw = _sharedWord.load(std::memory_order_relaxed);
+      _sharedWord.store(allowed ? (sw & ~SHARED_FLAG_NEVERBIAS) : (sw | SHARED_FLAG_NEVERBIAS), std::memory_order_relaxed);
+#else
+      (void) allowed;
+#endif
+   }
+
 private:
-   mutable AtomicCounter _refCount;
    AbstractObjectManager * _manager;
 
+#ifdef MUSCLE_USE_BIASED_REFCOUNTING
+   friend class BiasedRefCountThreadState;
+
+   // The low bits of (_sharedWord) are flags; the remaining bits hold the shared (atomically-updated) part of
+   // the reference count, which can go negative while the object is biased, if non-owner threads release
+   // references that the owner-thread created.  The object's total reference count is (_biasedCount + shared count).
+   enum {
+      SHARED_FLAG_UNBIASED  = (1<<0),  // set iff no thread owns (_biasedCount) any longer; all counting is then done in the shared count
+      SHARED_FLAG_QUEUED    = (1<<1),  // set iff this object is in its owner-thread's merge-queue
+      SHARED_FLAG_NEVERBIAS = (1<<2),  // set iff SetBiasedRefCountingAllowed(false) was called
+      SHARED_FLAGS_MASK     = (1<<3)-1,
+      SHARED_COUNT_ONE      = (1<<3)   // the amount to add to (_sharedWord) to add one to the shared count
+   };
+
+   bool DecrementSharedRefCountOfBiasedObject(int32 sw) const
+   {
+      int32 newSW;
+      do {
+         newSW = sw - SHARED_COUNT_ONE;
+         if (((sw & (SHARED_FLAG_UNBIASED|SHARED_FLAG_QUEUED)) == 0)&&(newSW < 0)) newSW |= SHARED_FLAG_QUEUED;  // first time we've gone negative:  the owner will need to merge
+      } while(_sharedWord.compare_exchange_weak(sw, newSW, std::memory_order_acq_rel, std::memory_order_relaxed) == false);
+
+      if (((newSW & SHARED_FLAG_QUEUED) != 0)&&((sw & SHARED_FLAG_QUEUED) == 0)) return EnqueueForMerge();
+      return ((newSW & ~SHARED_FLAG_NEVERBIAS) == SHARED_FLAG_UNBIASED);
+   }
+
+   bool EnqueueForMerge() const;      // implemented in SetupSystem.cpp; returns true iff the caller should delete this object
+   bool MergeBiasedRefCount() const;  // implemented in SetupSystem.cpp; returns true iff this object is no longer referenced
+
+   mutable std::atomic<int32> _sharedWord;        // shared reference count and SHARED_FLAG_* bits (see above)
+   mutable std::atomic<int32> _biasedCount;       // only ever modified by the owner-thread (or while merging)
+   mutable const BiasedRefCountThreadState * _biasOwner;  // only ever modified by the thread that biases the object to itself
+#else
+   mutable AtomicCounter _refCount;
+#endif
+
 #ifdef MUSCLE_RECORD_REFCOUNTABLE_ALLOCATION_LOCATIONS
    StackTrace * _allocatedAtStackTrace;
 #endif
@@ -411,7 +609,7 @@ public:
    MUSCLE_NODISCARD bool IsRefPrivate() const
    {
       const Item * item = this->GetItemPointer();
-      return ((item == NULL)||((this->IsRefCounting())&&(item->GetRefCount() == 1)));
+      return ((item == NULL)||((this->IsRefCounting())&&(item->IsRefCountEqualTo(1))));
    }
 
    /** This method will check our referenced object to see if there is any
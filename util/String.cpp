@@ -735,13 +735,14 @@ uint32 String :: GetNextBufferSize(uint32 bufLen)
 #ifdef MUSCLE_ENABLE_MEMORY_TRACKING
    geomLen -= sizeof(size_t);  // so that the internal allocation size will be a power of two, after GlobalMemoryAllocator.cpp adds its header bytes
 #endif
+   geomLen -= HASH_CODE_CACHE_BYTES;  // ditto, for the cached-hash-code bytes EnsureBufferSize() adds
    if (geomLen < (STRING_PAGE_SIZE-STRING_MALLOC_OVERHEAD)) return geomLen;
 
    // For large (multi-page) allocations, we'll increase by one page.  According to Trolltech, modern implementations
    // of realloc() don't actually copy the entire large buffer, they just rearrange the memory map and add
    // a new page to the end, so this will be more efficient than it appears.
-   const uint32 curNumPages = (bufLen+STRING_MALLOC_OVERHEAD)/STRING_PAGE_SIZE;
-   return ((curNumPages+1)*STRING_PAGE_SIZE)-STRING_MALLOC_OVERHEAD;
+   const uint32 curNumPages = (bufLen+STRING_MALLOC_OVERHEAD+HASH_CODE_CACHE_BYTES)/STRING_PAGE_SIZE;
+   return ((curNumPages+1)*STRING_PAGE_SIZE)-(STRING_MALLOC_OVERHEAD+HASH_CODE_CACHE_BYTES);
 }
 
 // This method tries to ensure that at least (newBufLen) chars
@@ -801,7 +802,7 @@ status_t String :: EnsureBufferSize(uint32 requestedBufLen, bool retainValue, bo
          else
          {
             // Oops, muscleRealloc() won't do in this case.... we'll just have to copy the bytes over
-            newBuf = (char *) muscleAlloc(newBufLen);
+            newBuf = (char *) muscleAlloc(newBufLen+HASH_CODE_CACHE_BYTES);
             MRETURN_OOM_ON_NULL(newBuf);
             memcpy(newBuf, GetBuffer(), muscleMin(oldStrlen+1, newBufLen));
          }
@@ -818,7 +819,7 @@ status_t String :: EnsureBufferSize(uint32 requestedBufLen, bool retainValue, bo
       }
       else
       {
-         newBuf = (char *) muscleAlloc(newBufLen);
+         newBuf = (char *) muscleAlloc(newBufLen+HASH_CODE_CACHE_BYTES);
          MRETURN_OOM_ON_NULL(newBuf);
          newBuf[0] = '\0';  // avoid potential user-visible garbage bytes
          if (arrayWasDynamicallyAllocated) _stringData._longStringData.FreeBuffer();
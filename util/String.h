@@ -17,6 +17,18 @@
 #include "system/GlobalMemoryAllocator.h"  // for muscleFree()
 #include "util/Hashtable.h"
 
+// Several threads may call HashCode() on the same const String at once (e.g. a static String, or a field name inside a
+// shared ConstMessageRef), so the cached hash code has to be accessed atomically.  Without std::atomic there's no portable
+// way to do that, so in that case (unless threads aren't being used at all) hash-code caching is disabled instead.
+#if !defined(MUSCLE_AVOID_STRING_HASH_CODE_CACHING) && !defined(MUSCLE_SINGLE_THREAD_ONLY)
+# ifdef MUSCLE_AVOID_CPLUSPLUS11
+#  define MUSCLE_AVOID_STRING_HASH_CODE_CACHING
+# else
+#  include <atomic>
+#  include <new>
+# endif
+#endif
+
 #ifdef __APPLE__
 // Using a forward declaration rather than an #include here to avoid pulling in other things like Mac's
 // Point and Rect typedefs, that can cause ambiguities with Muscle's Point and Rect classes.
@@ -450,6 +462,7 @@ public:
 
    /** Array Operator.  Used to get easy access to the characters that make up this string.
     *  @param index Index of the character to set.  Be sure to only use valid indices!
+    *  @note don't hold on to the returned reference past a call to HashCode(); writing through it afterwards would leave our cached hash code stale.
     */
    MUSCLE_NODISCARD char & operator [] (uint32 index) {VerifyIndex(index); return GetBuffer()[index];}
 
@@ -1147,8 +1160,21 @@ public:
      */
    MUSCLE_NODISCARD bool StartsWithIgnoreCase(const char * s) const {return StrStartsWithIgnoreCase(Cstr(), Length(), s, s?(uint32)strlen(s):0);}
 
-   /** @copydoc DoxyTemplate::HashCode() const */
-   MUSCLE_NODISCARD inline uint32 HashCode() const {return CalculateHashCode(Cstr(), Length());}
+   /** Returns a hash code for this String, as computed by CalculateHashCode().
+     * @note unless MUSCLE_AVOID_STRING_HASH_CODE_CACHING is defined, a String whose characters are stored
+     *       on the heap (i.e. one that is too long for the short-string optimization) will remember the
+     *       value computed here, so that subsequent calls (e.g. repeated Hashtable lookups using the same
+     *       String key) can return it without re-hashing all of the String's characters.  The cached value
+     *       is discarded whenever the String is modified.  Any number of threads may call this method on the
+     *       same (unchanging) String at once.
+     */
+   MUSCLE_NODISCARD inline uint32 HashCode() const
+   {
+#ifndef MUSCLE_AVOID_STRING_HASH_CODE_CACHING
+      if (IsArrayDynamicallyAllocated()) return _stringData._longStringData.HashCode();
+#endif
+      return CalculateHashCode(Cstr(), Length());
+   }
 
    /** @copydoc DoxyTemplate::HashCode64() const */
    MUSCLE_NODISCARD inline uint64 HashCode64() const {return CalculateHashCode64(Cstr(), Length());}
@@ -1543,7 +1569,7 @@ public:
    /** Returns a 32-bit checksum corresponding to this String's contents.
      * Note that this method method is O(N).
      */
-   MUSCLE_NODISCARD uint32 CalculateChecksum() const {return muscle::CalculateChecksum((const uint8 *) Cstr(), Length());}
+   MUSCLE_NODISCARD uint32 CalculateChecksum() const {return HashCode();}  // same value as muscle::CalculateChecksum(), but can use our cached hash code
 
    /** Returns true iff the given pointer points into our held character array.
      * @param s A character pointer.  It will not be dereferenced by this call.
@@ -1581,10 +1607,20 @@ private:
    void WriteNULTerminatorByte() {GetBuffer()[Length()] = '\0';}
    MUSCLE_NODISCARD int32 ReplaceAux(const Hashtable<String, String> & beforeToAfter, uint32 maxReplaceCount, String & writeTo) const;
 
+   // Number of extra bytes allocated past the end of a heap-allocated character-buffer, to hold its cached hash code
+#if defined(MUSCLE_AVOID_STRING_HASH_CODE_CACHING)
+   static const uint32 HASH_CODE_CACHE_BYTES = 0;
+#elif defined(MUSCLE_SINGLE_THREAD_ONLY)
+   static const uint32 HASH_CODE_CACHE_BYTES = sizeof(uint32);
+#else
+   static const uint32 HASH_CODE_CACHE_BYTES = sizeof(std::atomic<uint32>)+alignof(std::atomic<uint32>)-1;  // includes room to align the atomic
+#endif
+
    // Our data-layout for non-SSO "long" strings.  The intent is for this to be 16 bytes long (on a 64-bit system)
+   // There's no room left in here for a cached hash code, so that's stored in the HASH_CODE_CACHE_BYTES after the end of (_bigBuffer) instead.
    struct LongStringData
    {
-      void SetLength(uint32 len) {_strlen = len;}
+      void SetLength(uint32 len) {_strlen = len; InvalidateCachedHashCode();}
       MUSCLE_NODISCARD uint32 Length() const {return _strlen;}
 
       MUSCLE_NODISCARD uint32 GetNumAllocatedBytes() const {return B_LENDIAN_TO_HOST_INT32(_encBufLen) & ~((uint32)(1U<<31));}
@@ -1594,14 +1630,49 @@ private:
          _bigBuffer = newBuffer;
          _strlen    = oldStrlen;
          _encBufLen = B_HOST_TO_LENDIAN_INT32(newBufLen) | ((uint32)(1U<<31));
+         InvalidateCachedHashCode();
       }
 
       void FreeBuffer() {muscleFree(_bigBuffer);}  // no need to clear member-variables as ClearShortStringBuffer() will be called right after this
 
-      MUSCLE_NODISCARD MUSCLE_NEVER_RETURNS_NULL char * GetBuffer() {return _bigBuffer;}
+      MUSCLE_NODISCARD MUSCLE_NEVER_RETURNS_NULL char * GetBuffer() {InvalidateCachedHashCode(); return _bigBuffer;}  // since the caller is presumably about to modify our chars
       MUSCLE_NODISCARD MUSCLE_NEVER_RETURNS_NULL const char * Cstr() const {return _bigBuffer;}
 
-      char * ReallocBuffer(uint32 newLen) {return (char *) muscleRealloc(_bigBuffer, newLen);}
+      char * ReallocBuffer(uint32 newLen) {return (char *) muscleRealloc(_bigBuffer, newLen+HASH_CODE_CACHE_BYTES);}
+
+#ifdef MUSCLE_AVOID_STRING_HASH_CODE_CACHING
+      void InvalidateCachedHashCode() {/* empty */}
+#else
+      // Zero means "not computed yet".  A String whose hash code really is zero will just have it recomputed every time.
+# ifdef MUSCLE_SINGLE_THREAD_ONLY
+      void InvalidateCachedHashCode() {SetCachedHashCode(0);}
+      void SetCachedHashCode(uint32 hashCode) const {muscleCopyOut(_bigBuffer+GetNumAllocatedBytes(), hashCode);}
+      MUSCLE_NODISCARD uint32 GetCachedHashCode() const {return muscleCopyIn<uint32>(_bigBuffer+GetNumAllocatedBytes());}
+# else
+      // Only our owner's thread may invalidate the cache (since only it may modify our chars), but any thread may fill it
+      // in, so it's accessed with relaxed atomic operations:  every thread that fills it in will store the same value anyway.
+      void InvalidateCachedHashCode() {(void) new (GetCachedHashCodeAddress()) std::atomic<uint32>(0);}
+      void SetCachedHashCode(uint32 hashCode) const {static_cast<std::atomic<uint32> *>(GetCachedHashCodeAddress())->store(hashCode, std::memory_order_relaxed);}
+      MUSCLE_NODISCARD uint32 GetCachedHashCode() const {return static_cast<const std::atomic<uint32> *>(GetCachedHashCodeAddress())->load(std::memory_order_relaxed);}
+
+      MUSCLE_NODISCARD void * GetCachedHashCodeAddress() const
+      {
+         const uintptr alignMask = alignof(std::atomic<uint32>)-1;
+         return (void *) ((((uintptr)(_bigBuffer+GetNumAllocatedBytes()))+alignMask) & ~alignMask);
+      }
+# endif
+
+      MUSCLE_NODISCARD uint32 HashCode() const
+      {
+         uint32 ret = GetCachedHashCode();
+         if (ret == 0)
+         {
+            ret = CalculateHashCode(_bigBuffer, _strlen);
+            SetCachedHashCode(ret);
+         }
+         return ret;
+      }
+#endif
 
    private:
       char * _bigBuffer;  // pointer to our heap-allocated buffer
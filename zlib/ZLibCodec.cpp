@@ -48,26 +48,28 @@ static int32 GetInflatedSizeAux(const uint8 * compBytes, uint32 numComp, bool *
 class ZLibCodecImp
 {
 public:
-   ZLibCodecImp(int compressionLevel)
+   ZLibCodecImp(int compressionLevel, int windowBits, int memLevel)
       : _compressionLevel(muscleClamp(compressionLevel, 0, 9))
+      , _windowBits(windowBits)
+      , _memLevel(muscleClamp(memLevel, 1, MAX_MEM_LEVEL))
+      , _inflaterAllocated(false)
+      , _inflateOkay(true)
+      , _deflaterAllocated(false)
+      , _deflateOkay(true)
    {
-      InitStream(_inflater);
-      _inflateOkay = (inflateInit(&_inflater) == Z_OK);
-
-      InitStream(_deflater);
-      _deflateOkay = (deflateInit(&_deflater, _compressionLevel) == Z_OK);
+      // empty -- the z_streams are initialized on demand, since a codec is often used only for inflating, or only for deflating
    }
 
    ~ZLibCodecImp()
    {
-      if (_inflateOkay) inflateEnd(&_inflater);
-      if (_deflateOkay) deflateEnd(&_deflater);
+      if (_inflaterAllocated) inflateEnd(&_inflater);
+      if (_deflaterAllocated) deflateEnd(&_deflater);
    }
 
    ByteBufferRef Deflate(const uint8 * rawBytes, uint32 numRaw, bool independent, uint32 addHeaderBytes, uint32 addFooterBytes)
    {
       ByteBufferRef ret;
-      if ((rawBytes)&&(_deflateOkay))
+      if ((rawBytes)&&(IsDeflaterReady()))
       {
          if ((independent)&&(deflateReset(&_deflater) != Z_OK))
          {
@@ -101,7 +103,7 @@ public:
    status_t Deflate(const uint8 * rawBytes, uint32 numRaw, bool independent, ByteBuffer & outBuf, uint32 addHeaderBytes, uint32 addFooterBytes)
    {
       if (rawBytes     == NULL)  return B_BAD_ARGUMENT;
-      if (_deflateOkay == false) return B_BAD_OBJECT;
+      if (IsDeflaterReady() == false) return B_BAD_OBJECT;
 
       if ((independent)&&(deflateReset(&_deflater) != Z_OK))
       {
@@ -133,7 +135,7 @@ public:
 
       bool independent;
       const int32 rawLen = GetInflatedSizeAux(compBytes, numComp, &independent);
-      if ((rawLen >= 0)&&(_inflateOkay))
+      if ((rawLen >= 0)&&(IsInflaterReady()))
       {
          if (rawLen == 0) return GetByteBufferFromPool(0);  // corner-case of a compressed zero-byte buffer
          if ((independent)&&(inflateReset(&_inflater) != Z_OK))
@@ -165,7 +167,7 @@ public:
       bool independent;
       const int32 rawLen = GetInflatedSizeAux(compBytes, numComp, &independent);
       if (rawLen < 0)            return B_BAD_ARGUMENT;
-      if (_inflateOkay == false) return B_BAD_OBJECT;
+      if (IsInflaterReady() == false) return B_BAD_OBJECT;
       if (rawLen == 0) {outBuf.Clear(); return B_NO_ERROR;}  // corner-case of a compressed zero-byte buffer
 
       if ((independent)&&(inflateReset(&_inflater) != Z_OK))
@@ -190,7 +192,7 @@ public:
 
    status_t ReadAndDeflateAndWrite(DataIO & sourceRawIO, DataIO & destDeflatedIO, bool independent, uint32 totalBytesToRead)
    {
-      if (_deflateOkay == false) return B_BAD_OBJECT;
+      if (IsDeflaterReady() == false) return B_BAD_OBJECT;
 
       ByteBuffer scratchInBuf(32*1024);
       if (scratchInBuf.GetNumBytes() == 0) MRETURN_OUT_OF_MEMORY;
@@ -245,7 +247,7 @@ public:
 
    status_t ReadAndInflateAndWrite(DataIO & sourceDeflatedIO, DataIO & destInflatedIO)
    {
-      if (_inflateOkay == false) return B_BAD_OBJECT;
+      if (IsInflaterReady() == false) return B_BAD_OBJECT;
 
       ByteBuffer scratchInBuf(32*1024);
       if (scratchInBuf.GetNumBytes() == 0) MRETURN_OUT_OF_MEMORY;
@@ -298,9 +300,116 @@ public:
       return B_NO_ERROR;
    }
 
+   status_t DeflateRaw(const uint8 * rawBytes, uint32 numRaw, bool independent, ByteBuffer & outBuf, uint32 addHeaderBytes)
+   {
+      if ((rawBytes == NULL)&&(numRaw > 0)) return B_BAD_ARGUMENT;
+      if (IsDeflaterReady() == false) return B_BAD_OBJECT;
+
+      if ((independent)&&(deflateReset(&_deflater) != Z_OK))
+      {
+         _deflateOkay = false;
+         return B_ZLIB_ERROR;
+      }
+
+      MRETURN_ON_ERROR(outBuf.SetNumBytes((uint32)(addHeaderBytes+deflateBound(&_deflater, numRaw)+13), false));
+
+      _deflater.next_in  = (Bytef *)rawBytes;
+      _deflater.avail_in = numRaw;
+
+      uint32 numBytesUsed = addHeaderBytes;
+      while(true)
+      {
+         _deflater.next_out  = outBuf.GetBuffer()+numBytesUsed;
+         _deflater.avail_out = outBuf.GetNumBytes()-numBytesUsed;
+         if (deflate(&_deflater, Z_SYNC_FLUSH) != Z_OK) return B_ZLIB_ERROR;
+
+         numBytesUsed = outBuf.GetNumBytes()-_deflater.avail_out;
+         if (_deflater.avail_out > 0) break;  // per the zlib docs, if there was space left over then the flush is complete
+
+         MRETURN_ON_ERROR(outBuf.SetNumBytes(outBuf.GetNumBytes()*2, true));
+      }
+      return outBuf.SetNumBytes(numBytesUsed, true);
+   }
+
+   status_t InflateRaw(const uint8 * compBytes, uint32 numComp, bool independent, ByteBuffer & outBuf, uint32 maxRawBytes)
+   {
+      if ((compBytes == NULL)&&(numComp > 0)) return B_BAD_ARGUMENT;
+      if (IsInflaterReady() == false) return B_BAD_OBJECT;
+
+      if ((independent)&&(inflateReset(&_inflater) != Z_OK))
+      {
+         _inflateOkay = false;
+         return B_ZLIB_ERROR;
+      }
+
+      MRETURN_ON_ERROR(outBuf.SetNumBytes(muscleMin(maxRawBytes, muscleMax(numComp*4, (uint32)1024)), false));  // initial guess; we'll grow it if necessary
+
+      _inflater.next_in  = (Bytef *)compBytes;
+      _inflater.avail_in = numComp;
+
+      uint32 numBytesUsed = 0;
+      while(true)
+      {
+         _inflater.next_out  = outBuf.GetBuffer()+numBytesUsed;
+         _inflater.avail_out = outBuf.GetNumBytes()-numBytesUsed;
+
+         const int zRet = inflate(&_inflater, Z_SYNC_FLUSH);
+         if ((zRet != Z_OK)&&(zRet != Z_STREAM_END)&&(zRet != Z_BUF_ERROR)) return B_ZLIB_ERROR;
+
+         numBytesUsed = outBuf.GetNumBytes()-_inflater.avail_out;
+         if ((zRet == Z_STREAM_END)&&(inflateReset(&_inflater) != Z_OK))  // so that a subsequent dependent call can start a new stream, rather than failing
+         {
+            _inflateOkay = false;
+            return B_ZLIB_ERROR;
+         }
+         if ((zRet == Z_STREAM_END)||((_inflater.avail_in == 0)&&(_inflater.avail_out > 0))) break;  // all input consumed and all output produced
+         if (_inflater.avail_out > 0) return B_ZLIB_ERROR;  // Z_BUF_ERROR despite having output space available means the input is corrupt
+         if (outBuf.GetNumBytes() >= maxRawBytes)
+         {
+            // We've filled our buffer up to the limit, but that's only a problem if the inflater still has more output to give us
+            uint8 extraByte;
+            _inflater.next_out  = &extraByte;
+            _inflater.avail_out = 1;
+
+            const int probeRet = inflate(&_inflater, Z_SYNC_FLUSH);
+            if ((probeRet != Z_OK)&&(probeRet != Z_STREAM_END)&&(probeRet != Z_BUF_ERROR)) return B_ZLIB_ERROR;
+            if (_inflater.avail_out == 0) return B_RESOURCE_LIMIT;
+            if ((probeRet == Z_STREAM_END)&&(inflateReset(&_inflater) != Z_OK))
+            {
+               _inflateOkay = false;
+               return B_ZLIB_ERROR;
+            }
+            break;
+         }
+
+         MRETURN_ON_ERROR(outBuf.SetNumBytes(muscleMin(maxRawBytes, outBuf.GetNumBytes()*2), true));
+      }
+      return outBuf.SetNumBytes(numBytesUsed, true);
+   }
+
    int GetCompressionLevel() const {return _compressionLevel;}
 
 private:
+   bool IsInflaterReady()
+   {
+      if ((_inflateOkay)&&(_inflaterAllocated == false))
+      {
+         InitStream(_inflater);
+         _inflaterAllocated = _inflateOkay = (inflateInit2(&_inflater, _windowBits) == Z_OK);
+      }
+      return _inflateOkay;
+   }
+
+   bool IsDeflaterReady()
+   {
+      if ((_deflateOkay)&&(_deflaterAllocated == false))
+      {
+         InitStream(_deflater);
+         _deflaterAllocated = _deflateOkay = (deflateInit2(&_deflater, _compressionLevel, Z_DEFLATED, _windowBits, _memLevel, Z_DEFAULT_STRATEGY) == Z_OK);
+      }
+      return _deflateOkay;
+   }
+
    void InitStream(z_stream & stream) const
    {
       stream.next_in   = Z_NULL;
@@ -317,16 +426,26 @@ private:
    }
 
    const int _compressionLevel;
+   const int _windowBits;  // negative values indicate raw deflate streams, as per the zlib API
+   const int _memLevel;
 
+   bool _inflaterAllocated;
    bool _inflateOkay;
    z_stream _inflater;
 
+   bool _deflaterAllocated;
    bool _deflateOkay;
    z_stream _deflater;
 };
 
 ZLibCodec :: ZLibCodec(int compressionLevel)
-   : _imp(new ZLibCodecImp(compressionLevel))
+   : _imp(new ZLibCodecImp(compressionLevel, MAX_WBITS, 8))  // same window-size and memLevel that deflateInit() and inflateInit() use
+{
+   // empty
+}
+
+ZLibCodec :: ZLibCodec(int compressionLevel, uint32 windowBits, uint32 memLevel)
+   : _imp(new ZLibCodecImp(compressionLevel, -muscleClamp((int)windowBits, 9, MAX_WBITS), (int)memLevel))
 {
    // empty
 }
@@ -371,6 +490,16 @@ status_t ZLibCodec :: ReadAndInflateAndWrite(DataIO & sourceDeflatedIO, DataIO &
    return _imp ? _imp->ReadAndInflateAndWrite(sourceDeflatedIO, destInflatedIO) : B_BAD_OBJECT;
 }
 
+status_t ZLibCodec :: DeflateRaw(const uint8 * rawBytes, uint32 numRaw, bool independent, ByteBuffer & outBuf, uint32 addHeaderBytes)
+{
+   return _imp ? _imp->DeflateRaw(rawBytes, numRaw, independent, outBuf, addHeaderBytes) : B_BAD_OBJECT;
+}
+
+status_t ZLibCodec :: InflateRaw(const uint8 * compBytes, uint32 numComp, bool independent, ByteBuffer & outBuf, uint32 maxInflatedBytes)
+{
+   return _imp ? _imp->InflateRaw(compBytes, numComp, independent, outBuf, maxInflatedBytes) : B_BAD_OBJECT;
+}
+
 int ZLibCodec :: GetCompressionLevel() const
 {
    return _imp ? _imp->GetCompressionLevel() : 0;
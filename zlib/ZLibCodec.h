@@ -26,6 +26,20 @@ public:
      */
    ZLibCodec(int compressionLevel = 6);
 
+   /** Constructor for a codec that reads and writes raw deflate streams (as described in RFC 1951, i.e. with no zlib or
+     * ZLibCodec headers), via the DeflateRaw() and InflateRaw() methods.  This is useful for implementing protocols that
+     * specify raw deflate data, such as the WebSocket permessage-deflate extension (RFC 7692).
+     * @param compressionLevel how much to compress outgoing data.  0 is no compression, 9 is maximum compression.
+     * @param windowBits base-2 logarithm of the LZ77 window size to use (9-15).  When inflating, this must be at least as
+     *                   large as the window size that was used to deflate the data.
+     * @param memLevel how much memory zlib should allocate for its internal deflate state (1-9).  Lower values use less
+     *                 memory (roughly (1<<(memLevel+9)) bytes) but reduce the compression ratio.  Default is 8.
+     * @note zlib's internal state is allocated on demand (i.e. the first time it is needed), so a ZLibCodec that is only used
+     *       for deflating will use roughly (1<<(windowBits+2))+(1<<(memLevel+9)) bytes of RAM, and one that is only used for
+     *       inflating will use roughly (1<<windowBits)+7KB.
+     */
+   ZLibCodec(int compressionLevel, uint32 windowBits, uint32 memLevel = 8);
+
    /** Destructor */
    ~ZLibCodec();
 
@@ -205,6 +219,33 @@ public:
      */
    status_t ReadAndInflateAndWrite(DataIO & sourceDeflatedIO, DataIO & destInflatedIO);
 
+   /** Deflates (rawData) and writes the deflated bytes into (targetBuf) as raw deflate data, with no header bytes
+     * of any kind.  The deflated data is terminated with a Z_SYNC_FLUSH, so it will always end with the four bytes
+     * 0x00 0x00 0xFF 0xFF.  This method is intended for use with codecs created via the raw-stream constructor.
+     * @param rawData The raw data to compress
+     * @param numBytes The number of bytes (rawData) points to
+     * @param independent If true, the deflated data will be decompressible without reference to any
+     *                    previously deflated data (i.e. the deflater's LZ77 window will be reset before use).
+     * @param targetBuf On success, this ByteBuffer object will contain the deflated data.
+     * @param addHeaderBytes If set to non-zero, (targetBuf) will contain this many additional bytes at the beginning of
+     *                    its byte array, before the first compressed-data byte.  The values in these bytes are undefined.
+     * @returns B_NO_ERROR on success, or an error code on failure.
+     */
+   status_t DeflateRaw(const uint8 * rawData, uint32 numBytes, bool independent, ByteBuffer & targetBuf, uint32 addHeaderBytes=0);
+
+   /** Inflates raw deflate data (e.g. as previously produced by DeflateRaw()) into (targetBuf).
+     * This method is intended for use with codecs created via the raw-stream constructor.
+     * @param compressedData The raw deflate data to expand.
+     * @param numBytes The number of bytes (compressedData) points to
+     * @param independent If true, the inflater's state will be reset before use, so that (compressedData)
+     *                    is not expected to refer to any previously inflated data.
+     * @param targetBuf On success, this ByteBuffer object will contain the inflated data.
+     * @param maxInflatedBytes the maximum number of inflated bytes we are willing to produce.  If the inflated data
+     *                         would be larger than this, B_RESOURCE_LIMIT is returned.  Defaults to MUSCLE_NO_LIMIT.
+     * @returns B_NO_ERROR on success, or an error code on failure.
+     */
+   status_t InflateRaw(const uint8 * compressedData, uint32 numBytes, bool independent, ByteBuffer & targetBuf, uint32 maxInflatedBytes = MUSCLE_NO_LIMIT);
+
 private:
    ZLibCodecImp * _imp;
 };